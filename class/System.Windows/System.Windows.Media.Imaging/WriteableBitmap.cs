@@ -32,6 +32,7 @@ namespace System.Windows.Media.Imaging
 	{
 		int[] pixels;
 		GCHandle pixels_handle;
+		bool pixels_shared;
 
 		public WriteableBitmap (BitmapSource source) : base (SafeNativeMethods.writeable_bitmap_new (), true)
 		{
@@ -127,7 +128,14 @@ namespace System.Windows.Media.Imaging
 		}
 
 		public int[] Pixels {
-			get { return pixels; }
+			get {
+				// from now on we can't tell which pixels Invalidate has to upload
+				if (!pixels_shared) {
+					NativeMethods.writeable_bitmap_set_pixels_shared (native);
+					pixels_shared = true;
+				}
+				return pixels;
+			}
 		}
 
 		public void Render (UIElement element, Transform transform)
@@ -0,0 +1,1379 @@
+/*
+ * perf-micro.cpp: benchmarks of pieces of the runtime that don't need a
+ * test page (buffer pools, lookup tables, ...).
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+#include <runtime.h>
+#include <deployment.h>
+#include <pipeline.h>
+#include <pipeline-asf.h>
+#include <trace.h>
+#include <timesource.h>
+#include <clock.h>
+#include <animation.h>
+#include <easing.h>
+#include <factory.h>
+#include <canvas.h>
+#include <shape.h>
+#include <brush.h>
+#include <writeablebitmap.h>
+#include <richtextlayout.h>
+#include <richtextbox.h>
+#include <textelement.h>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef USE_GLX
+#define Visual _XxVisual
+#define Region _XxRegion
+#define Window _XxWindow
+#include <GL/glx.h>
+#undef Visual
+#undef Region
+#undef Window
+#include <context-opengl.h>
+#endif
+
+using namespace Moonlight;
+
+/* Globals, parameters */
+
+char *benchmark = NULL;		// Run all the benchmarks by default
+int repeat = 1;
+char *media_file = NULL;	// The file the frame-pool benchmark decodes
+
+static GOptionEntry entries [] =
+{
+	{ "benchmark", 'b', 0, G_OPTION_ARG_STRING, &benchmark, "Only run the benchmark NAME", "NAME" },
+	{ "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat, "Run every benchmark N times", "N" },
+	{ "media", 'm', 0, G_OPTION_ARG_FILENAME, &media_file, "Decode FILE in the frame-pool benchmark", "FILE" },
+	{ NULL }
+};
+
+static long
+get_minor_faults ()
+{
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	return usage.ru_minflt;
+}
+
+/*
+ * trace: the cost of a trace point with tracing disabled and enabled.
+ */
+
+#define TRACE_EVENTS 100000
+
+static void
+trace_events (int count)
+{
+	for (int i = 0; i < count; i++) {
+		MOON_TRACE_SCOPE ("perf", "Outer");
+		MOON_TRACE_BEGIN ("perf", "Inner");
+		MOON_TRACE_END ("perf", "Inner");
+	}
+}
+
+static void
+bench_trace ()
+{
+	TimeSpan start, disabled, enabled;
+
+	MoonTrace::Disable ();
+	start = get_now ();
+	trace_events (TRACE_EVENTS);
+	disabled = get_now () - start;
+
+	MoonTrace::Enable ();
+	start = get_now ();
+	trace_events (TRACE_EVENTS);
+	enabled = get_now () - start;
+	MoonTrace::Disable ();
+
+	printf ("trace: %i events: disabled: %.2f ns/event; enabled: %.2f ns/event\n", TRACE_EVENTS * 4,
+		disabled * 100.0 / (TRACE_EVENTS * 4), enabled * 100.0 / (TRACE_EVENTS * 4));
+}
+
+/*
+ * curve-table: 1000 animations with the same elastic ease and key spline
+ * ticking for 10 seconds at 60 frames per second, evaluating the curves
+ * and interpolating in their CurveTables.
+ */
+
+#define CURVE_ANIMATIONS 1000
+#define CURVE_TICKS 600
+
+static void
+init_runtime ()
+{
+	static bool inited = false;
+	Deployment *deployment;
+
+	if (inited)
+		return;
+
+	inited = true;
+	Runtime::Init (NULL, (RuntimeInitFlag) (RUNTIME_INIT_MANUAL_TIMESOURCE | RUNTIME_INIT_DISABLE_AUDIO |
+						 RUNTIME_INIT_CREATE_ROOT_DOMAIN), true);
+
+	deployment = new Deployment ();
+	deployment->Initialize ();
+	Deployment::SetCurrent (deployment);
+}
+
+static void
+bench_curve_table ()
+{
+	ElasticEase *elastic;
+	KeySpline *spline;
+	Point c1 (0.25, 0.1);
+	Point c2 (0.25, 1.0);
+	TimeSpan start, ease_analytic, ease_tabulated, spline_analytic, spline_tabulated;
+	double sum = 0.0;
+
+	init_runtime ();
+
+	elastic = MoonUnmanagedFactory::CreateElasticEase ();
+	elastic->SetOscillations (3);
+	elastic->SetSpringiness (3.0);
+
+	spline = MoonUnmanagedFactory::CreateKeySpline ();
+	spline->SetControlPoint1 (&c1);
+	spline->SetControlPoint2 (&c2);
+
+	start = get_now ();
+	for (int t = 0; t < CURVE_TICKS; t++)
+		for (int a = 0; a < CURVE_ANIMATIONS; a++)
+			sum += elastic->EaseWithMode (((t + a) % 60) / 60.0);
+	ease_analytic = get_now () - start;
+
+	start = get_now ();
+	for (int t = 0; t < CURVE_TICKS; t++)
+		for (int a = 0; a < CURVE_ANIMATIONS; a++)
+			sum += elastic->Ease (((t + a) % 60) / 60.0);
+	ease_tabulated = get_now () - start;
+
+	start = get_now ();
+	for (int t = 0; t < CURVE_TICKS; t++)
+		for (int a = 0; a < CURVE_ANIMATIONS; a++)
+			sum += spline->SolveSpline (((t + a) % 60) / 60.0);
+	spline_analytic = get_now () - start;
+
+	start = get_now ();
+	for (int t = 0; t < CURVE_TICKS; t++)
+		for (int a = 0; a < CURVE_ANIMATIONS; a++)
+			sum += spline->GetSplineProgress (((t + a) % 60) / 60.0);
+	spline_tabulated = get_now () - start;
+
+	printf ("curve-table: %i animations, %i ticks: elastic ease: %.3f ms evaluated, %.3f ms %s; key spline: %.3f ms solved, %.3f ms %s [%g]\n",
+		CURVE_ANIMATIONS, CURVE_TICKS,
+		ease_analytic / 10000.0, ease_tabulated / 10000.0, elastic->IsTabulated () ? "tabulated" : "not tabulated",
+		spline_analytic / 10000.0, spline_tabulated / 10000.0, spline->IsTabulated () ? "tabulated" : "not tabulated", sum);
+
+	elastic->unref ();
+	spline->unref ();
+}
+
+/*
+ * A window nothing is shown in, for the benchmarks which need a Surface
+ * to lay out and compute the bounds of their elements.
+ */
+
+class MicroWindow : public MoonWindow {
+ public:
+	MicroWindow (int width, int height) : MoonWindow (width, height) {}
+
+	virtual void ConnectToContainerPlatformWindow (gpointer container_window) {}
+	virtual void Resize (int width, int height) {}
+	virtual void SetCursor (CursorType cursor) {}
+	virtual void Invalidate (Rect r) {}
+	virtual void ProcessUpdates () {}
+	virtual gboolean HandleEvent (gpointer platformEvent) { return FALSE; }
+	virtual void Show () {}
+	virtual void Hide () {}
+	virtual void EnableEvents (bool first) {}
+	virtual void DisableEvents () {}
+	virtual void GrabFocus () {}
+	virtual bool HasFocus () { return false; }
+	virtual void SetLeft (double left) {}
+	virtual double GetLeft () { return 0.0; }
+	virtual void SetTop (double top) {}
+	virtual double GetTop () { return 0.0; }
+	virtual void SetWidth (double width) {}
+	virtual void SetHeight (double height) {}
+	virtual void SetTitle (const char *title) {}
+	virtual void SetIconFromPixbuf (MoonPixbuf *pixbuf) {}
+	virtual void SetStyle (WindowStyle style) {}
+	virtual MoonClipboard *GetClipboard (MoonClipboardType clipboardType) { return NULL; }
+	virtual gpointer GetPlatformWindow () { return NULL; }
+};
+
+/* A surface of @width x @height showing @root, laid out */
+static Surface *
+create_surface (Panel *root, int width, int height)
+{
+	Surface *surface = new Surface (new MicroWindow (width, height));
+
+	surface->Attach (root);
+	surface->ProcessDirtyElements ();
+
+	return surface;
+}
+
+static void
+destroy_surface (Surface *surface)
+{
+	surface->Zombify ();
+	surface->unref ();
+}
+
+/*
+ * writeable-bitmap: WriteableBitmap.Render of an element covering the
+ * whole 1024x1024 bitmap, and of a 64x64 one, 1000 times each, followed
+ * by Invalidate, without a display.
+ */
+
+#define BITMAP_SIZE 1024
+#define BITMAP_RENDERS 1000
+
+static Rectangle *
+create_rectangle (Canvas *canvas, double size, const char *color)
+{
+	Rectangle *rectangle = MoonUnmanagedFactory::CreateRectangle ();
+	SolidColorBrush *brush = new SolidColorBrush (color);
+
+	rectangle->SetFill (brush);
+	rectangle->SetWidth (size);
+	rectangle->SetHeight (size);
+	canvas->GetChildren ()->Add (rectangle);
+
+	brush->unref ();
+
+	return rectangle;
+}
+
+static void
+bench_writeable_bitmap ()
+{
+	WriteableBitmap *bitmap;
+	Canvas *canvas;
+	Rectangle *large, *small;
+	Surface *surface;
+	TimeSpan start, time_large, time_small;
+
+	init_runtime ();
+
+	canvas = MoonUnmanagedFactory::CreateCanvas ();
+	large = create_rectangle (canvas, BITMAP_SIZE, "#80ff0000");
+	small = create_rectangle (canvas, 64, "#ff0000ff");
+	surface = create_surface (canvas, BITMAP_SIZE, BITMAP_SIZE);
+
+	bitmap = MoonUnmanagedFactory::CreateWriteableBitmap ();
+	bitmap->SetPixelWidth (BITMAP_SIZE);
+	bitmap->SetPixelHeight (BITMAP_SIZE);
+	bitmap->SetBitmapData (g_malloc0 (BITMAP_SIZE * BITMAP_SIZE * 4), true);
+	bitmap->Invalidate ();
+
+	start = get_now ();
+	for (int i = 0; i < BITMAP_RENDERS; i++) {
+		bitmap->Render (large, NULL);
+		bitmap->Invalidate ();
+	}
+	time_large = get_now () - start;
+
+	start = get_now ();
+	for (int i = 0; i < BITMAP_RENDERS; i++) {
+		bitmap->Render (small, NULL);
+		bitmap->Invalidate ();
+	}
+	time_small = get_now () - start;
+
+	printf ("writeable-bitmap: %ix%i, %i renders: %ix%i element: %.3f ms; 64x64 element: %.3f ms\n",
+		BITMAP_SIZE, BITMAP_SIZE, BITMAP_RENDERS, BITMAP_SIZE, BITMAP_SIZE, time_large / 10000.0, time_small / 10000.0);
+
+	bitmap->unref ();
+	destroy_surface (surface);
+	canvas->unref ();
+}
+
+/*
+ * Media benchmarks: the files are opened with a FileSource which counts
+ * the reads, and the media events are delivered on the media thread (there
+ * is no main loop here).
+ */
+
+static gint media_opened;
+static gint media_failed;
+static gint media_seeks;
+
+/* Polls (for up to 10 seconds) until @value is at least @expected */
+static bool
+wait_for (gint *value, gint expected)
+{
+	for (int i = 0; i < 10000; i++) {
+		if (g_atomic_int_get (value) >= expected)
+			return true;
+		if (g_atomic_int_get (&media_failed))
+			return false;
+		g_usleep (1000);
+	}
+	return false;
+}
+
+static void
+media_opened_handler (EventObject *sender, EventArgs *args, gpointer closure)
+{
+	g_atomic_int_inc (&media_opened);
+}
+
+static void
+media_failed_handler (EventObject *sender, EventArgs *args, gpointer closure)
+{
+	g_atomic_int_inc (&media_failed);
+}
+
+static void
+media_seek_handler (EventObject *sender, EventArgs *args, gpointer closure)
+{
+	g_atomic_int_inc (&media_seeks);
+}
+
+class CountingFileSource : public FileSource {
+protected:
+	virtual ~CountingFileSource () {}
+
+	virtual void ReadAsyncInternal (MediaReadClosure *closure)
+	{
+		g_atomic_int_inc (&reads);
+		FileSource::ReadAsyncInternal (closure);
+	}
+
+public:
+	gint reads;
+
+	CountingFileSource (Media *media, const char *filename) : FileSource (media, filename)
+	{
+		reads = 0;
+	}
+};
+
+/* Opens @filename, NULL if it couldn't be opened */
+static Media *
+open_media (const char *filename, CountingFileSource **source)
+{
+	Media *media;
+
+	init_runtime ();
+
+	media_opened = 0;
+	media_failed = 0;
+	media_seeks = 0;
+
+	media = new Media (NULL);
+	media->AddSafeHandler (Media::OpenCompletedEvent, media_opened_handler, media, false);
+	media->AddSafeHandler (Media::MediaErrorEvent, media_failed_handler, media, false);
+	media->AddSafeHandler (Media::SeekCompletedEvent, media_seek_handler, media, false);
+
+	*source = new CountingFileSource (media, filename);
+	media->Initialize (*source);
+	media->OpenAsync ();
+
+	if (!wait_for (&media_opened, 1)) {
+		media->Dispose ();
+		media->unref ();
+		(*source)->unref ();
+		return NULL;
+	}
+
+	return media;
+}
+
+static void
+close_media (Media *media, CountingFileSource *source)
+{
+	media->Dispose ();
+	media->unref ();
+	source->unref ();
+}
+
+/*
+ * Seeks @media to @count random positions before @duration (in ms), one at
+ * a time. Returns the average time a seek took to complete and sets @reads
+ * to the average number of reads from the file it made.
+ */
+static TimeSpan
+seek_media (Media *media, CountingFileSource *source, guint32 duration, int count, double *reads)
+{
+	GRand *rand = g_rand_new_with_seed (4711);
+	TimeSpan start, total = 0;
+	gint total_reads = 0;
+
+	for (int i = 0; i < count; i++) {
+		guint32 time = g_rand_int_range (rand, 1, duration);
+		gint before = g_atomic_int_get (&source->reads);
+
+		start = get_now ();
+		media->SeekAsync (MilliSeconds_ToPts (time));
+		if (!wait_for (&media_seeks, i + 1)) {
+			printf ("!!! The seek to %u ms didn't complete\n", time);
+			exit (1);
+		}
+		total += get_now () - start;
+		total_reads += g_atomic_int_get (&source->reads) - before;
+	}
+
+	g_rand_free (rand);
+
+	*reads = total_reads / (double) count;
+	return total / count;
+}
+
+static void
+put_uint8 (GByteArray *array, guint8 v)
+{
+	g_byte_array_append (array, &v, 1);
+}
+
+static void
+put_uint16 (GByteArray *array, guint16 v)
+{
+	guint8 b [2] = { (guint8) v, (guint8) (v >> 8) };
+	g_byte_array_append (array, b, 2);
+}
+
+static void
+put_uint32 (GByteArray *array, guint32 v)
+{
+	guint8 b [4] = { (guint8) v, (guint8) (v >> 8), (guint8) (v >> 16), (guint8) (v >> 24) };
+	g_byte_array_append (array, b, 4);
+}
+
+static void
+put_uint64 (GByteArray *array, guint64 v)
+{
+	put_uint32 (array, (guint32) v);
+	put_uint32 (array, (guint32) (v >> 32));
+}
+
+/* Writes @array to a new temporary file, returns its name */
+static char *
+write_temp_file (const char *name, GByteArray *array)
+{
+	char *filename;
+	int fd;
+
+	if ((fd = g_file_open_tmp (name, &filename, NULL)) == -1 ||
+	    write (fd, array->data, array->len) != (ssize_t) array->len) {
+		printf ("!!! Couldn't write a temporary file\n");
+		exit (1);
+	}
+	close (fd);
+
+	return filename;
+}
+
+/*
+ * frame-pool: demuxes and decodes the video of a test media file (or of
+ * --media FILE) as fast as the decoder goes, with a few decoded frames
+ * queued for rendering, once with the frame buffers from malloc and once
+ * from the stream's MediaFramePool.
+ */
+
+#define FRAMES_QUEUED 4
+
+static long
+get_rss_kb ()
+{
+	long size, resident = 0;
+	FILE *statm;
+
+	if ((statm = fopen ("/proc/self/statm", "r")) != NULL) {
+		if (fscanf (statm, "%li %li", &size, &resident) != 2)
+			resident = 0;
+		fclose (statm);
+	}
+
+	return resident * (getpagesize () / 1024);
+}
+
+/* Selects the first video stream of @media (and nothing else), NULL if there is none */
+static VideoStream *
+select_video_stream (Media *media)
+{
+	IMediaDemuxer *demuxer = media->GetDemuxerReffed ();
+	VideoStream *video = NULL;
+
+	if (demuxer == NULL)
+		return NULL;
+
+	for (int i = 0; i < demuxer->GetStreamCount (); i++) {
+		IMediaStream *stream = demuxer->GetStream (i);
+
+		if (video == NULL && stream->IsVideo ()) {
+			video = (VideoStream *) stream;
+			video->SetSelected (true);
+		} else {
+			stream->SetSelected (false);
+		}
+	}
+
+	demuxer->unref ();
+
+	return video;
+}
+
+/*
+ * Pops every frame of @stream, keeping the last FRAMES_QUEUED alive.
+ * Returns the number of frames and sets @peak_rss to the largest RSS seen.
+ */
+static guint
+decode_media (Media *media, VideoStream *stream, long *peak_rss)
+{
+	MediaFrame *queue [FRAMES_QUEUED];
+	IMediaDemuxer *demuxer;
+	guint count = 0;
+	int idle = 0;
+
+	memset (queue, 0, sizeof (queue));
+	*peak_rss = get_rss_kb ();
+
+	while (!stream->GetOutputEnded () || !stream->IsDecodedQueueEmpty ()) {
+		MediaFrame *frame = stream->PopDecodedFrame ();
+
+		if (frame == NULL) {
+			if (g_atomic_int_get (&media_failed) || ++idle > 100000) {
+				printf ("!!! The decoder stopped after %u frames\n", count);
+				exit (1);
+			}
+			if ((demuxer = media->GetDemuxerReffed ()) != NULL) {
+				demuxer->FillBuffers ();
+				demuxer->unref ();
+			}
+			g_usleep (100);
+			continue;
+		}
+
+		idle = 0;
+		if (queue [count % FRAMES_QUEUED] != NULL)
+			queue [count % FRAMES_QUEUED]->unref ();
+		queue [count % FRAMES_QUEUED] = frame;
+		if (++count % 16 == 0)
+			*peak_rss = MAX (*peak_rss, get_rss_kb ());
+	}
+
+	for (int i = 0; i < FRAMES_QUEUED; i++) {
+		if (queue [i] != NULL)
+			queue [i]->unref ();
+	}
+
+	return count;
+}
+
+static void
+bench_frame_pool ()
+{
+	static const bool pooled [] = { false, true };
+	const char *filename = media_file ? media_file : TEST_MEDIA_DIR "/video/elephants-dream-320x180-first-minute.wmv";
+	guint frames = 0;
+
+	printf ("frame-pool: %s,", filename);
+
+	for (guint i = 0; i < G_N_ELEMENTS (pooled); i++) {
+		CountingFileSource *source;
+		VideoStream *stream;
+		long faults, rss, peak_rss;
+		TimeSpan start;
+		Media *media;
+
+		MediaFramePool::SetEnabled (pooled [i]);
+
+		if (!(media = open_media (filename, &source)) || !(stream = select_video_stream (media))) {
+			/* without a decoder for the file in this build there's nothing to measure */
+			printf (" couldn't decode it, skipped\n");
+			if (media != NULL)
+				close_media (media, source);
+			MediaFramePool::SetEnabled (true);
+			return;
+		}
+
+		rss = get_rss_kb ();
+		faults = get_minor_faults ();
+		start = get_now ();
+		frames = decode_media (media, stream, &peak_rss);
+		printf (" %s: %li page faults, %li KB peak RSS growth, %.3f ms;", pooled [i] ? "pool" : "malloc",
+			get_minor_faults () - faults, peak_rss - rss, (get_now () - start) / 10000.0);
+
+		close_media (media, source);
+	}
+
+	printf (" %u frames, %i queued\n", frames, FRAMES_QUEUED);
+
+	MediaFramePool::SetEnabled (true);
+}
+
+/*
+ * asf-seek: random seeks through a three hour variable bitrate ASF file,
+ * with a Simple Index object and without (where the demuxer can only
+ * estimate which packet to start at and reads its way to the key frame).
+ * Each 64 byte packet has a 2x2 YV12 frame, 20 ms apart for three minutes,
+ * then 180 ms apart for three minutes, and so on, with a key frame every
+ * 5 seconds.
+ */
+
+#define ASF_DURATION (3 * 60 * 60 * 1000)
+#define ASF_PACKET_SIZE 64
+#define ASF_FRAME_SIZE 6 /* 2x2 YV12 */
+#define ASF_KEY_FRAME_INTERVAL 5000
+#define ASF_SEEKS 200
+
+static void
+put_guid (GByteArray *array, ASFGuid *guid)
+{
+	put_uint32 (array, guid->a);
+	put_uint16 (array, guid->b);
+	put_uint16 (array, guid->c);
+	g_byte_array_append (array, guid->d, 8);
+}
+
+/* The time (in ms) of the frame in each packet */
+static guint32 *
+create_packet_times (guint32 *packet_count)
+{
+	GArray *times = g_array_new (false, false, sizeof (guint32));
+	guint32 time = 0;
+
+	while (time < ASF_DURATION) {
+		g_array_append_val (times, time);
+		time += (time / 180000) % 2 == 0 ? 20 : 180;
+	}
+
+	*packet_count = times->len;
+	return (guint32 *) g_array_free (times, false);
+}
+
+/* The packet with the last key frame at or before @time */
+static guint32
+key_frame_packet (guint32 *packet_times, guint32 packet_count, guint32 time)
+{
+	guint32 key_frame = time - time % ASF_KEY_FRAME_INTERVAL;
+	guint32 lo = 0, hi = packet_count;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+		if (packet_times [mid] > key_frame)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo - 1;
+}
+
+static char *
+create_asf (bool with_index, guint32 *packet_count)
+{
+	guint32 *times = create_packet_times (packet_count);
+	guint32 index_count = ASF_DURATION / 1000;
+	guint64 header_size = 30 + 104 + 129;
+	guint64 data_size = 50 + (guint64) *packet_count * ASF_PACKET_SIZE;
+	guint64 index_size = with_index ? 24 + 32 + index_count * 6 : 0;
+	GByteArray *array = g_byte_array_new ();
+	char *filename;
+
+	/* Header object: file and stream properties */
+	put_guid (array, &asf_guids_header);
+	put_uint64 (array, header_size);
+	put_uint32 (array, 2);
+	put_uint8 (array, 1);
+	put_uint8 (array, 2);
+
+	put_guid (array, &asf_guids_file_properties);
+	put_uint64 (array, 104);
+	put_uint64 (array, 0); /* file id */
+	put_uint64 (array, 0);
+	put_uint64 (array, header_size + data_size + index_size);
+	put_uint64 (array, 0); /* creation date */
+	put_uint64 (array, *packet_count);
+	put_uint64 (array, (guint64) ASF_DURATION * 10000); /* play duration */
+	put_uint64 (array, (guint64) ASF_DURATION * 10000); /* send duration */
+	put_uint64 (array, 0); /* preroll */
+	put_uint32 (array, 0x2); /* seekable */
+	put_uint32 (array, ASF_PACKET_SIZE);
+	put_uint32 (array, ASF_PACKET_SIZE);
+	put_uint32 (array, ASF_PACKET_SIZE * 8 * 50);
+
+	put_guid (array, &asf_guids_stream_properties);
+	put_uint64 (array, 129);
+	put_guid (array, &asf_guids_media_video);
+	put_guid (array, &asf_guids_no_error_correction);
+	put_uint64 (array, 0); /* time offset */
+	put_uint32 (array, 11 + 40);
+	put_uint32 (array, 0);
+	put_uint16 (array, 1); /* stream number */
+	put_uint32 (array, 0);
+	put_uint32 (array, 2);
+	put_uint32 (array, 2);
+	put_uint8 (array, 2);
+	put_uint16 (array, 40);
+	put_uint32 (array, 40); /* BITMAPINFOHEADER */
+	put_uint32 (array, 2);
+	put_uint32 (array, 2);
+	put_uint16 (array, 1);
+	put_uint16 (array, 12);
+	put_uint32 (array, CODEC_YV12);
+	put_uint32 (array, ASF_FRAME_SIZE);
+	for (int i = 0; i < 4; i++)
+		put_uint32 (array, 0);
+
+	/* Data object: one payload per packet, no error correction, byte sized padding length */
+	put_guid (array, &asf_guids_data);
+	put_uint64 (array, data_size);
+	put_uint64 (array, 0); /* file id */
+	put_uint64 (array, 0);
+	put_uint64 (array, *packet_count);
+	put_uint16 (array, 0x0101);
+
+	for (guint32 i = 0; i < *packet_count; i++) {
+		guint32 next = i + 1 < *packet_count ? times [i + 1] : ASF_DURATION;
+		guint32 boundary = (times [i] + ASF_KEY_FRAME_INTERVAL - 1) / ASF_KEY_FRAME_INTERVAL * ASF_KEY_FRAME_INTERVAL;
+		guint8 padding = ASF_PACKET_SIZE - 24 - ASF_FRAME_SIZE;
+
+		put_uint8 (array, 0x08);
+		put_uint8 (array, 0x5d);
+		put_uint8 (array, padding);
+		put_uint32 (array, times [i]); /* send time */
+		put_uint16 (array, next - times [i]);
+
+		/* the last frame before a key frame interval starts is a key frame */
+		put_uint8 (array, 1 | (boundary < next ? 0x80 : 0));
+		put_uint8 (array, i);
+		put_uint32 (array, 0); /* offset into the media object */
+		put_uint8 (array, 8);
+		put_uint32 (array, ASF_FRAME_SIZE);
+		put_uint32 (array, times [i]);
+		for (int k = 0; k < ASF_FRAME_SIZE + padding; k++)
+			put_uint8 (array, k < ASF_FRAME_SIZE ? i : 0);
+	}
+
+	/* Simple Index object, an entry every second */
+	if (with_index) {
+		put_guid (array, &asf_guids_simple_index);
+		put_uint64 (array, index_size);
+		put_uint64 (array, 0); /* file id */
+		put_uint64 (array, 0);
+		put_uint64 (array, MilliSeconds_ToPts (1000));
+		put_uint32 (array, 1);
+		put_uint32 (array, index_count);
+		for (guint32 i = 0; i < index_count; i++) {
+			put_uint32 (array, key_frame_packet (times, *packet_count, i * 1000));
+			put_uint16 (array, 1);
+		}
+	}
+
+	filename = write_temp_file ("perf-micro-XXXXXX.asf", array);
+
+	g_byte_array_free (array, true);
+	g_free (times);
+
+	return filename;
+}
+
+static void
+bench_asf_seek ()
+{
+	static const bool indexed [] = { true, false };
+	guint32 packet_count = 0;
+
+	printf ("asf-seek: %i minutes,", ASF_DURATION / 60000);
+
+	for (guint i = 0; i < G_N_ELEMENTS (indexed); i++) {
+		char *filename = create_asf (indexed [i], &packet_count);
+		CountingFileSource *source;
+		Media *media;
+		TimeSpan time;
+		double reads;
+
+		if (!(media = open_media (filename, &source))) {
+			printf ("!!! Couldn't open %s\n", filename);
+			exit (1);
+		}
+
+		time = seek_media (media, source, ASF_DURATION, ASF_SEEKS, &reads);
+		printf (" %s: %.3f ms/seek, %.1f reads/seek;", indexed [i] ? "simple index" : "no index", time / 10000.0, reads);
+
+		close_media (media, source);
+		g_unlink (filename);
+		g_free (filename);
+	}
+
+	printf (" %u packets, %i seeks\n", packet_count, ASF_SEEKS);
+}
+
+/*
+ * mp4-seek: random seeks through a two hour MP4 file with a 2x2 YV12 video
+ * track, 40 ms frames for three minutes, then 20 ms frames for three
+ * minutes, and so on (several stts entries), a key frame every 50 frames
+ * and 25 frames per chunk. The moov box follows the mdat box, the open
+ * time includes building the sample index.
+ */
+
+#define MP4_DURATION (2 * 60 * 60 * 1000)
+#define MP4_FRAME_SIZE 6 /* 2x2 YV12 */
+#define MP4_KEY_FRAMES 50
+#define MP4_CHUNK_SAMPLES 25
+#define MP4_SEEKS 200
+
+static void
+put_be_uint16 (GByteArray *array, guint16 v)
+{
+	guint8 b [2] = { (guint8) (v >> 8), (guint8) v };
+	g_byte_array_append (array, b, 2);
+}
+
+static void
+put_be_uint32 (GByteArray *array, guint32 v)
+{
+	guint8 b [4] = { (guint8) (v >> 24), (guint8) (v >> 16), (guint8) (v >> 8), (guint8) v };
+	g_byte_array_append (array, b, 4);
+}
+
+static void
+put_zeros (GByteArray *array, guint count)
+{
+	for (guint i = 0; i < count; i++)
+		put_uint8 (array, 0);
+}
+
+/* Starts a box (or a full box if @version isn't -1), returns where it starts */
+static guint
+begin_box (GByteArray *array, const char *type, int version, guint32 flags)
+{
+	guint start = array->len;
+
+	put_be_uint32 (array, 0);
+	g_byte_array_append (array, (const guint8 *) type, 4);
+	if (version != -1)
+		put_be_uint32 (array, (version << 24) | flags);
+
+	return start;
+}
+
+/* Writes the size of the box started at @start */
+static void
+end_box (GByteArray *array, guint start)
+{
+	guint32 size = array->len - start;
+
+	array->data [start] = size >> 24;
+	array->data [start + 1] = size >> 16;
+	array->data [start + 2] = size >> 8;
+	array->data [start + 3] = size;
+}
+
+static char *
+create_mp4 (guint32 *sample_count)
+{
+	GByteArray *array = g_byte_array_new ();
+	GArray *counts = g_array_new (false, false, sizeof (guint32));
+	GArray *deltas = g_array_new (false, false, sizeof (guint32));
+	guint32 data_offset, chunk_count;
+	guint32 time = 0;
+	char *filename;
+	guint box, moov, trak, mdia, minf, dref, stbl, entry;
+
+	/* The frame durations, run length encoded as in the stts box */
+	*sample_count = 0;
+	while (time < MP4_DURATION) {
+		guint32 delta = (time / 180000) % 2 == 0 ? 40 : 20;
+
+		if (deltas->len == 0 || g_array_index (deltas, guint32, deltas->len - 1) != delta) {
+			guint32 zero = 0;
+			g_array_append_val (counts, zero);
+			g_array_append_val (deltas, delta);
+		}
+		g_array_index (counts, guint32, counts->len - 1)++;
+		(*sample_count)++;
+		time += delta;
+	}
+	chunk_count = (*sample_count + MP4_CHUNK_SAMPLES - 1) / MP4_CHUNK_SAMPLES;
+
+	box = begin_box (array, "ftyp", -1, 0);
+	g_byte_array_append (array, (const guint8 *) "isom", 4);
+	put_be_uint32 (array, 0);
+	g_byte_array_append (array, (const guint8 *) "isommp42", 8);
+	end_box (array, box);
+
+	box = begin_box (array, "mdat", -1, 0);
+	data_offset = array->len;
+	for (guint32 i = 0; i < *sample_count; i++) {
+		for (int k = 0; k < MP4_FRAME_SIZE; k++)
+			put_uint8 (array, i);
+	}
+	end_box (array, box);
+
+	moov = begin_box (array, "moov", -1, 0);
+
+	box = begin_box (array, "mvhd", 0, 0);
+	put_be_uint32 (array, 0); /* creation time */
+	put_be_uint32 (array, 0); /* modification time */
+	put_be_uint32 (array, 1000);
+	put_be_uint32 (array, time);
+	put_be_uint32 (array, 0x00010000); /* rate */
+	put_be_uint16 (array, 0x0100); /* volume */
+	put_zeros (array, 2 + 8 + 36 + 24);
+	put_be_uint32 (array, 2); /* next track id */
+	end_box (array, box);
+
+	trak = begin_box (array, "trak", -1, 0);
+
+	box = begin_box (array, "tkhd", 0, 7);
+	put_be_uint32 (array, 0); /* creation time */
+	put_be_uint32 (array, 0); /* modification time */
+	put_be_uint32 (array, 1); /* track id */
+	put_be_uint32 (array, 0);
+	put_be_uint32 (array, time);
+	put_zeros (array, 8 + 2 + 2 + 2 + 2 + 36);
+	put_be_uint32 (array, 2 << 16); /* width */
+	put_be_uint32 (array, 2 << 16); /* height */
+	end_box (array, box);
+
+	mdia = begin_box (array, "mdia", -1, 0);
+
+	box = begin_box (array, "mdhd", 0, 0);
+	put_be_uint32 (array, 0); /* creation time */
+	put_be_uint32 (array, 0); /* modification time */
+	put_be_uint32 (array, 1000);
+	put_be_uint32 (array, time);
+	put_be_uint16 (array, 0); /* language */
+	put_be_uint16 (array, 0);
+	end_box (array, box);
+
+	box = begin_box (array, "hdlr", 0, 0);
+	put_be_uint32 (array, 0);
+	g_byte_array_append (array, (const guint8 *) "vide", 4);
+	put_zeros (array, 12 + 1);
+	end_box (array, box);
+
+	minf = begin_box (array, "minf", -1, 0);
+
+	box = begin_box (array, "vmhd", 0, 1);
+	put_zeros (array, 8);
+	end_box (array, box);
+
+	box = begin_box (array, "dinf", -1, 0);
+	dref = begin_box (array, "dref", 0, 0);
+	put_be_uint32 (array, 1);
+	end_box (array, begin_box (array, "url ", 0, 1));
+	end_box (array, dref);
+	end_box (array, box);
+
+	stbl = begin_box (array, "stbl", -1, 0);
+
+	box = begin_box (array, "stsd", 0, 0);
+	put_be_uint32 (array, 1);
+	entry = begin_box (array, "YV12", -1, 0);
+	put_zeros (array, 6);
+	put_be_uint16 (array, 1); /* data reference index */
+	put_zeros (array, 2 + 2 + 12);
+	put_be_uint16 (array, 2); /* width */
+	put_be_uint16 (array, 2); /* height */
+	put_be_uint32 (array, 72 << 16); /* horizontal resolution */
+	put_be_uint32 (array, 72 << 16); /* vertical resolution */
+	put_be_uint32 (array, 0);
+	put_be_uint16 (array, 1); /* frame count */
+	put_zeros (array, 32); /* compressor name */
+	put_be_uint16 (array, 12); /* depth */
+	put_be_uint16 (array, 0xffff);
+	end_box (array, entry);
+	end_box (array, box);
+
+	box = begin_box (array, "stts", 0, 0);
+	put_be_uint32 (array, counts->len);
+	for (guint i = 0; i < counts->len; i++) {
+		put_be_uint32 (array, g_array_index (counts, guint32, i));
+		put_be_uint32 (array, g_array_index (deltas, guint32, i));
+	}
+	end_box (array, box);
+
+	box = begin_box (array, "stss", 0, 0);
+	put_be_uint32 (array, (*sample_count + MP4_KEY_FRAMES - 1) / MP4_KEY_FRAMES);
+	for (guint32 i = 0; i < *sample_count; i += MP4_KEY_FRAMES)
+		put_be_uint32 (array, i + 1);
+	end_box (array, box);
+
+	box = begin_box (array, "stsc", 0, 0);
+	put_be_uint32 (array, 1);
+	put_be_uint32 (array, 1); /* first chunk */
+	put_be_uint32 (array, MP4_CHUNK_SAMPLES);
+	put_be_uint32 (array, 1); /* sample description index */
+	end_box (array, box);
+
+	box = begin_box (array, "stsz", 0, 0);
+	put_be_uint32 (array, MP4_FRAME_SIZE);
+	put_be_uint32 (array, *sample_count);
+	end_box (array, box);
+
+	box = begin_box (array, "stco", 0, 0);
+	put_be_uint32 (array, chunk_count);
+	for (guint32 i = 0; i < chunk_count; i++)
+		put_be_uint32 (array, data_offset + i * MP4_CHUNK_SAMPLES * MP4_FRAME_SIZE);
+	end_box (array, box);
+
+	end_box (array, stbl);
+	end_box (array, minf);
+	end_box (array, mdia);
+	end_box (array, trak);
+	end_box (array, moov);
+
+	filename = write_temp_file ("perf-micro-XXXXXX.mp4", array);
+
+	g_byte_array_free (array, true);
+	g_array_free (counts, true);
+	g_array_free (deltas, true);
+
+	return filename;
+}
+
+static void
+bench_mp4_seek ()
+{
+	CountingFileSource *source;
+	guint32 sample_count;
+	char *filename;
+	Media *media;
+	TimeSpan start, open, time;
+	double reads;
+
+	filename = create_mp4 (&sample_count);
+
+	start = get_now ();
+	if (!(media = open_media (filename, &source))) {
+		printf ("!!! Couldn't open %s\n", filename);
+		exit (1);
+	}
+	open = get_now () - start;
+
+	time = seek_media (media, source, MP4_DURATION, MP4_SEEKS, &reads);
+
+	printf ("mp4-seek: %i minutes, %u samples: open: %.3f ms; %i seeks: %.3f ms/seek, %.1f reads/seek\n",
+		MP4_DURATION / 60000, sample_count, open / 10000.0, MP4_SEEKS, time / 10000.0, reads);
+
+	close_media (media, source);
+	g_unlink (filename);
+	g_free (filename);
+}
+
+/*
+ * rich-text: RichTextLayouts of 10000 and 1000 lines, built line by line
+ * with RichTextLayoutLine and AddLine the way LayoutBlock builds them,
+ * rendered through a 400x100 clip scrolled down the document, and queried
+ * for the caret at the start and end of random lines. The times shouldn't
+ * depend on the length of the document.
+ */
+
+#define RICH_TEXT_WIDTH 400
+#define RICH_TEXT_HEIGHT 100
+#define RICH_TEXT_RENDERS 500
+#define RICH_TEXT_CARETS 10000
+
+struct RichText {
+	RichTextBox *rtb;
+	Run *run;
+	RichTextLayout *layout;
+	guint32 *starts; // the offset of the start and end of each line in the run
+	guint32 *ends;
+};
+
+static void
+create_rich_text (RichText *rich, int count)
+{
+	TextLayoutAttributes *attrs;
+	Paragraph *paragraph;
+	GString *text = g_string_new ("");
+
+	rich->starts = g_new (guint32, count);
+	rich->ends = g_new (guint32, count);
+
+	for (int i = 0; i < count; i++) {
+		if (i > 0)
+			g_string_append_c (text, '\n');
+		rich->starts [i] = text->len;
+		g_string_append_printf (text, "Line %i of the document, long enough to be a line", i);
+		rich->ends [i] = text->len;
+	}
+
+	rich->rtb = MoonUnmanagedFactory::CreateRichTextBox ();
+	rich->run = MoonUnmanagedFactory::CreateRun ();
+	rich->run->SetText (text->str);
+	paragraph = MoonUnmanagedFactory::CreateParagraph ();
+	paragraph->GetInlines ()->Add (rich->run);
+	rich->rtb->GetBlocks ()->Add (paragraph);
+	paragraph->unref ();
+	g_string_free (text, true);
+
+	rich->layout = new RichTextLayout ();
+	rich->layout->actual_width = 0.0;
+	rich->layout->actual_height = 0.0;
+	attrs = new TextLayoutAttributes (rich->run);
+
+	for (int i = 0; i < count; i++) {
+		TextPointer start (rich->run, rich->starts [i], LogicalDirectionForward);
+		TextPointer end (rich->run, rich->ends [i], LogicalDirectionBackward);
+		RichTextLayoutLine *line = new RichTextLayoutLine (rich->layout, start, rich->layout->actual_height);
+		RichTextLayoutInline *inline_ = new RichTextLayoutInlineGlyphs (line, attrs, start, end);
+
+		inline_->size.width = (rich->ends [i] - rich->starts [i]) * 7.0;
+		line->AddInline (inline_);
+		rich->layout->AddLine (line);
+	}
+}
+
+static void
+destroy_rich_text (RichText *rich)
+{
+	delete rich->layout;
+	rich->run->unref ();
+	rich->rtb->unref ();
+	g_free (rich->starts);
+	g_free (rich->ends);
+}
+
+/* The average time of a render through the clip and of a caret query */
+static void
+time_rich_text (int count, TimeSpan *render, TimeSpan *caret)
+{
+	cairo_surface_t *target;
+	RichText rich;
+	TimeSpan start;
+	cairo_t *cr;
+	GRand *rand;
+	double scroll;
+
+	init_runtime ();
+	create_rich_text (&rich, count);
+
+	target = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, RICH_TEXT_WIDTH, RICH_TEXT_HEIGHT);
+	cr = cairo_create (target);
+
+	start = get_now ();
+	for (int i = 0; i < RICH_TEXT_RENDERS; i++) {
+		scroll = (rich.layout->actual_height - RICH_TEXT_HEIGHT) * i / RICH_TEXT_RENDERS;
+
+		cairo_save (cr);
+		cairo_rectangle (cr, 0, 0, RICH_TEXT_WIDTH, RICH_TEXT_HEIGHT);
+		cairo_clip (cr);
+		rich.layout->Render (cr, Point (0, 0), Point (0, -scroll));
+		cairo_restore (cr);
+	}
+	*render = (get_now () - start) / RICH_TEXT_RENDERS;
+
+	rand = g_rand_new_with_seed (4711);
+	start = get_now ();
+	for (int i = 0; i < RICH_TEXT_CARETS; i++) {
+		int line = g_rand_int_range (rand, 0, count);
+		TextPointer tp (rich.run, i % 2 ? rich.ends [line] : rich.starts [line], LogicalDirectionForward);
+
+		rich.layout->GetCursor (Point (0, 0), tp);
+	}
+	*caret = (get_now () - start) / RICH_TEXT_CARETS;
+	g_rand_free (rand);
+
+	cairo_destroy (cr);
+	cairo_surface_destroy (target);
+	destroy_rich_text (&rich);
+}
+
+static void
+bench_rich_text ()
+{
+	TimeSpan render_long, caret_long, render_short, caret_short;
+
+	time_rich_text (10000, &render_long, &caret_long);
+	time_rich_text (1000, &render_short, &caret_short);
+
+	printf ("rich-text: %ix%i clip, %i renders, %i caret queries: 10000 lines: %.3f ms/render, %.2f us/query; 1000 lines: %.3f ms/render, %.2f us/query\n",
+		RICH_TEXT_WIDTH, RICH_TEXT_HEIGHT, RICH_TEXT_RENDERS, RICH_TEXT_CARETS,
+		render_long / 10000.0, caret_long / 10.0, render_short / 10000.0, caret_short / 10.0);
+}
+
+#ifdef USE_GLX
+/*
+ * gl-upload: a 1024x1024 surface drawn on with cairo and uploaded to its
+ * texture 200 times, on a GLX pbuffer, with MOONLIGHT_GL_PIXEL_BUFFERS=1
+ * (staged through the pixel buffers, even on software rasterizers) and =0.
+ * Each frame fills the whole surface untracked, then a 64x64 box tracked.
+ */
+
+#define UPLOAD_SIZE 1024
+#define UPLOAD_FRAMES 200
+
+class UploadSurface : public OpenGLSurface {
+public:
+	UploadSurface () : OpenGLSurface () {}
+	__GLFuncPtr GetProcAddress (const char *procname) { return glXGetProcAddressARB ((const GLubyte *) procname); }
+};
+
+class UploadContext : public OpenGLContext {
+public:
+	UploadContext (OpenGLSurface *surface) : OpenGLContext (surface) {}
+	bool HasPixelBuffers () { return hasPixelBuffers; }
+	GLuint Upload (GLSurface *surface) { return GetTexture (surface); }
+};
+
+static void
+upload_fill (OpenGLSurface *surface, int x, int y, int width, int height, double value)
+{
+	cairo_surface_t *dst = surface->Cairo ();
+	cairo_t *cr = cairo_create (dst);
+
+	cairo_set_source_rgb (cr, value, 1.0 - value, 0.5);
+	cairo_rectangle (cr, x, y, width, height);
+	cairo_fill (cr);
+	cairo_destroy (cr);
+	cairo_surface_destroy (dst);
+}
+
+static void
+bench_gl_upload ()
+{
+	static const char *modes [] = { "1", "0" };
+	int config_attribs [] = {
+		GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT,
+		GLX_RENDER_TYPE, GLX_RGBA_BIT,
+		GLX_RED_SIZE, 8, GLX_GREEN_SIZE, 8, GLX_BLUE_SIZE, 8, GLX_ALPHA_SIZE, 8,
+		None
+	};
+	int pbuffer_attribs [] = { GLX_PBUFFER_WIDTH, 16, GLX_PBUFFER_HEIGHT, 16, None };
+	GLXFBConfig *configs = NULL;
+	GLXPbuffer pbuffer = 0;
+	GLXContext ctx = NULL;
+	Display *display;
+	int n = 0;
+
+	if (!(display = XOpenDisplay (NULL))) {
+		printf ("gl-upload: skipped, no display\n");
+		return;
+	}
+
+	configs = glXChooseFBConfig (display, DefaultScreen (display), config_attribs, &n);
+	if (configs != NULL && n > 0) {
+		pbuffer = glXCreatePbuffer (display, configs [0], pbuffer_attribs);
+		ctx = glXCreateNewContext (display, configs [0], GLX_RGBA_TYPE, NULL, True);
+	}
+	if (configs != NULL)
+		XFree (configs);
+
+	if (!pbuffer || !ctx || !glXMakeContextCurrent (display, pbuffer, pbuffer, ctx)) {
+		printf ("gl-upload: skipped, no GLX pbuffers\n");
+		if (ctx)
+			glXDestroyContext (display, ctx);
+		if (pbuffer)
+			glXDestroyPbuffer (display, pbuffer);
+		XCloseDisplay (display);
+		return;
+	}
+
+	printf ("gl-upload: %ix%i, %i frames:", UPLOAD_SIZE, UPLOAD_SIZE, UPLOAD_FRAMES);
+
+	for (guint i = 0; i < G_N_ELEMENTS (modes); i++) {
+		UploadSurface *target = new UploadSurface ();
+		UploadContext *context = new UploadContext (target);
+		OpenGLSurface *surface = new OpenGLSurface (UPLOAD_SIZE, UPLOAD_SIZE);
+		TimeSpan start, full = 0, tracked = 0;
+
+		g_setenv ("MOONLIGHT_GL_PIXEL_BUFFERS", modes [i], TRUE);
+		context->Initialize ();
+
+		for (int f = 0; f < UPLOAD_FRAMES; f++) {
+			start = get_now ();
+			upload_fill (surface, 0, 0, UPLOAD_SIZE, UPLOAD_SIZE, f / (double) UPLOAD_FRAMES);
+			context->Upload (surface);
+			glFinish ();
+			full += get_now () - start;
+
+			start = get_now ();
+			surface->TrackDraw (Rect (f % (UPLOAD_SIZE - 64), 0, 64, 64));
+			upload_fill (surface, f % (UPLOAD_SIZE - 64), 0, 64, 64, 1.0);
+			context->Upload (surface);
+			glFinish ();
+			tracked += get_now () - start;
+		}
+
+		printf (" MOONLIGHT_GL_PIXEL_BUFFERS=%s (%s): %.3f ms full, %.3f ms tracked;", modes [i],
+			context->HasPixelBuffers () ? "staged" : "not staged", full / 10000.0, tracked / 10000.0);
+
+		surface->unref ();
+		delete context;
+		target->unref ();
+	}
+
+	printf ("\n");
+
+	g_unsetenv ("MOONLIGHT_GL_PIXEL_BUFFERS");
+	glXMakeContextCurrent (display, None, None, NULL);
+	glXDestroyContext (display, ctx);
+	glXDestroyPbuffer (display, pbuffer);
+	XCloseDisplay (display);
+}
+#endif
+
+struct Benchmark {
+	const char *name;
+	void (*run) ();
+};
+
+static Benchmark benchmarks [] = {
+	{ "frame-pool", bench_frame_pool },
+	{ "trace", bench_trace },
+	{ "curve-table", bench_curve_table },
+	{ "writeable-bitmap", bench_writeable_bitmap },
+	{ "asf-seek", bench_asf_seek },
+	{ "mp4-seek", bench_mp4_seek },
+	{ "rich-text", bench_rich_text },
+#ifdef USE_GLX
+	{ "gl-upload", bench_gl_upload },
+#endif
+};
+
+int
+main (int argc, char **argv)
+{
+	GError *error = NULL;
+	GOptionContext *context;
+	bool found = false;
+
+	context = g_option_context_new ("- run native micro benchmarks");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_print ("!!! Option parsing failed: %s\n", error->message);
+		exit (1);
+	}
+
+	for (guint i = 0; i < G_N_ELEMENTS (benchmarks); i++) {
+		if (benchmark != NULL && strcmp (benchmark, benchmarks [i].name))
+			continue;
+
+		found = true;
+		for (int r = 0; r < repeat; r++)
+			benchmarks [i].run ();
+	}
+
+	if (!found) {
+		g_print ("!!! No benchmark named %s\n", benchmark);
+		exit (1);
+	}
+
+	return 0;
+}
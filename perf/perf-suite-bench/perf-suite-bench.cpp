@@ -0,0 +1,514 @@
+/*
+ * perf-suite-bench.cpp: runs the tests in perf-suite-set without a browser
+ * or a display, and reports how long each phase of a frame took.
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+#include <runtime.h>
+#include <clock.h>
+#include <timemanager.h>
+#include <deployment.h>
+#include <context-cairo.h>
+#include <panel.h>
+#include <uri.h>
+#include <xaml.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Moonlight;
+
+/* Globals, parameters */
+
+char *set_filename = NULL;	// The drtlist.xml describing the tests
+char *test_id = NULL;		// Run all the tests by default
+char *output_filename = NULL;	// Write the results to stdout by default
+char *png_directory = NULL;	// Don't save the last frame of each test by default
+int frames = 0;			// By default (end time - start time) / interval
+int warmup_frames = 1;		// Not included in the results
+
+static GOptionEntry entries [] =
+{
+	{ "set", 's', 0, G_OPTION_ARG_STRING, &set_filename, "Read the tests from FILE (a drtlist.xml)", "FILE" },
+	{ "test-id", 't', 0, G_OPTION_ARG_STRING, &test_id, "Only run the test with the unique id ID", "ID" },
+	{ "frames", 'n', 0, G_OPTION_ARG_INT, &frames, "Step N frames in every test", "N" },
+	{ "warmup", 'w', 0, G_OPTION_ARG_INT, &warmup_frames, "Step N frames before measuring", "N" },
+	{ "output", 'o', 0, G_OPTION_ARG_STRING, &output_filename, "Write the results to FILE", "FILE" },
+	{ "png-directory", 'p', 0, G_OPTION_ARG_STRING, &png_directory, "Save the last frame of each test to DIR", "DIR" },
+	{ NULL }
+};
+
+/* Tests */
+
+struct DrtItem {
+	char *unique_id;
+	char *name;
+	char *input_file;
+	int start_time;
+	int end_time;
+	int interval;
+	int width;
+	int height;
+};
+
+static void
+drt_list_start_element (GMarkupParseContext *context, const gchar *element_name, const gchar **attribute_names,
+			const gchar **attribute_values, gpointer user_data, GError **error)
+{
+	GPtrArray *items = (GPtrArray *) user_data;
+	DrtItem *item;
+
+	if (strcmp (element_name, "DrtItem"))
+		return;
+
+	item = g_new0 (DrtItem, 1);
+	item->end_time = 5000;
+	item->interval = 40;
+	item->width = 400;
+	item->height = 400;
+
+	for (int i = 0; attribute_names [i] != NULL; i++) {
+		const char *name = attribute_names [i];
+		const char *value = attribute_values [i];
+
+		if (!strcmp (name, "uniqueId"))
+			item->unique_id = g_strdup (value);
+		else if (!strcmp (name, "name"))
+			item->name = g_strdup (value);
+		else if (!strcmp (name, "inputFile"))
+			item->input_file = g_strdup (value);
+		else if (!strcmp (name, "startTime"))
+			item->start_time = atoi (value);
+		else if (!strcmp (name, "endTime"))
+			item->end_time = atoi (value);
+		else if (!strcmp (name, "interval"))
+			item->interval = MAX (atoi (value), 1);
+		else if (!strcmp (name, "width"))
+			item->width = atoi (value);
+		else if (!strcmp (name, "height"))
+			item->height = atoi (value);
+	}
+
+	g_ptr_array_add (items, item);
+}
+
+static GPtrArray *
+load_drt_list (const char *filename)
+{
+	GMarkupParser parser = { drt_list_start_element, NULL, NULL, NULL, NULL };
+	GMarkupParseContext *context;
+	GError *error = NULL;
+	GPtrArray *items;
+	gchar *contents;
+	gsize length;
+
+	if (!g_file_get_contents (filename, &contents, &length, &error)) {
+		g_print ("!!! Could not read %s: %s\n", filename, error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	items = g_ptr_array_new ();
+	context = g_markup_parse_context_new (&parser, (GMarkupParseFlags) 0, items, NULL);
+	if (!g_markup_parse_context_parse (context, contents, length, &error) ||
+	    !g_markup_parse_context_end_parse (context, &error)) {
+		g_print ("!!! Could not parse %s: %s\n", filename, error->message);
+		g_error_free (error);
+	}
+	g_markup_parse_context_free (context);
+	g_free (contents);
+
+	return items;
+}
+
+/*
+ * The tests are html pages with the xaml embedded in a
+ * <script type="text/xaml"> element, extract it.
+ */
+static char *
+load_xaml (const char *filename)
+{
+	char *contents;
+	char *start, *end;
+	char *xaml = NULL;
+
+	if (!g_file_get_contents (filename, &contents, NULL, NULL))
+		return NULL;
+
+	if (!g_str_has_suffix (filename, ".html"))
+		return contents;
+
+	if ((start = strstr (contents, "type=\"text/xaml\"")) && (start = strchr (start, '>'))) {
+		start++;
+		if ((end = strstr (start, "</script>"))) {
+			// the xml declaration must be the first thing in the document
+			while (start < end && g_ascii_isspace (*start))
+				start++;
+			xaml = g_strndup (start, end - start);
+		}
+	}
+
+	g_free (contents);
+
+	return xaml;
+}
+
+/* The window */
+
+/*
+ * BenchWindow: a window which isn't shown anywhere, it only collects the
+ * invalidated areas. The benchmark paints them itself, so that painting
+ * isn't timed as part of the clock tick.
+ */
+class BenchWindow : public MoonWindow {
+	Region *damage;
+
+ public:
+	BenchWindow (int width, int height) : MoonWindow (width, height)
+	{
+		damage = new Region ();
+	}
+
+	virtual ~BenchWindow ()
+	{
+		delete damage;
+	}
+
+	Region *GetDamage () { return damage; }
+	void ClearDamage ()
+	{
+		delete damage;
+		damage = new Region ();
+	}
+
+	virtual void ConnectToContainerPlatformWindow (gpointer container_window) {}
+	virtual void Resize (int width, int height) {}
+	virtual void SetCursor (CursorType cursor) {}
+	virtual void Invalidate (Rect r) { damage->Union (r.Intersection (Rect (0, 0, width, height)).RoundOut ()); }
+	virtual void ProcessUpdates () {}
+	virtual gboolean HandleEvent (gpointer platformEvent) { return FALSE; }
+	virtual void Show () {}
+	virtual void Hide () {}
+	virtual void EnableEvents (bool first) {}
+	virtual void DisableEvents () {}
+	virtual void GrabFocus () {}
+	virtual bool HasFocus () { return false; }
+	virtual void SetLeft (double left) {}
+	virtual double GetLeft () { return 0.0; }
+	virtual void SetTop (double top) {}
+	virtual double GetTop () { return 0.0; }
+	virtual void SetWidth (double width) {}
+	virtual void SetHeight (double height) {}
+	virtual void SetTitle (const char *title) {}
+	virtual void SetIconFromPixbuf (MoonPixbuf *pixbuf) {}
+	virtual void SetStyle (WindowStyle style) {}
+	virtual MoonClipboard *GetClipboard (MoonClipboardType clipboardType) { return NULL; }
+	virtual gpointer GetPlatformWindow () { return NULL; }
+};
+
+/* Results */
+
+enum BenchPhase {
+	PhaseClock,
+	PhaseLayout,
+	PhaseDirty,
+	PhaseFrontToBack,
+	PhaseRender,
+	PhasePresent,
+	PhaseFrame,
+	NumPhases
+};
+
+static const char *phase_names [NumPhases] = {
+	"clock", "layout", "dirty", "front_to_back", "render", "present", "frame"
+};
+
+static int
+compare_timespan (const void *a, const void *b)
+{
+	TimeSpan x = *(const TimeSpan *) a;
+	TimeSpan y = *(const TimeSpan *) b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static double
+ticks_to_ms (TimeSpan ticks)
+{
+	return ticks / 10000.0;
+}
+
+static void
+print_json_string (FILE *out, const char *str)
+{
+	fputc ('"', out);
+	for (const char *p = str ? str : ""; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			fprintf (out, "\\%c", *p);
+		else if ((unsigned char) *p < 0x20)
+			fprintf (out, "\\u%04x", *p);
+		else
+			fputc (*p, out);
+	}
+	fputc ('"', out);
+}
+
+static void
+print_phase (FILE *out, BenchPhase phase, TimeSpan *samples, int count)
+{
+	TimeSpan total = 0;
+
+	for (int i = 0; i < count; i++)
+		total += samples [i];
+	qsort (samples, count, sizeof (TimeSpan), compare_timespan);
+
+	fprintf (out, "\t\t\t\t\"%s\": { \"total_ms\": %.3f, \"mean_ms\": %.4f, \"median_ms\": %.4f, \"p95_ms\": %.4f, \"max_ms\": %.4f }",
+		 phase_names [phase], ticks_to_ms (total), count ? ticks_to_ms (total) / count : 0.0,
+		 count ? ticks_to_ms (samples [count / 2]) : 0.0,
+		 count ? ticks_to_ms (samples [MIN (count - 1, count * 95 / 100)]) : 0.0,
+		 count ? ticks_to_ms (samples [count - 1]) : 0.0);
+}
+
+/* Running */
+
+static void
+present (CairoContext *ctx, CairoSurface *target, guint8 *front_buffer, int width, int height, Region *damage)
+{
+	int stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, width);
+	guint8 *data = target->GetData ();
+
+	// copy the damaged areas into the "front buffer", like a window
+	// system would when the back buffer is shown
+	ctx->Flush ();
+	for (int i = 0; i < damage->GetRectangleCount (); i++) {
+		Rect r = damage->GetRectangle (i);
+		int x = (int) r.x, y = (int) r.y, w = (int) r.width, h = (int) r.height;
+
+		for (int row = y; row < y + h; row++)
+			memcpy (front_buffer + row * stride + x * 4, data + row * stride + x * 4, w * 4);
+	}
+}
+
+static bool
+run_item (DrtItem *item, const char *set_directory, FILE *out, bool first)
+{
+	char *path = g_build_filename (set_directory, item->input_file, NULL);
+	char *xaml = load_xaml (path);
+	char *base_string;
+	BenchWindow *window;
+	Surface *surface;
+	XamlLoader *loader;
+	Uri *base;
+	Value *value;
+	Type::Kind element_type;
+	MoonError error;
+	SurfaceFrameTimings timings;
+	CairoSurface *target;
+	CairoContext *ctx;
+	ManualTimeSource *source;
+	guint8 *front_buffer;
+	TimeSpan *samples [NumPhases];
+	gint64 damaged_pixels = 0;
+	int count = frames > 0 ? frames : MAX ((item->end_time - item->start_time) / item->interval, 1);
+
+	if (xaml == NULL) {
+		g_print ("!!! Could not load the xaml from %s\n", path);
+		g_free (path);
+		return false;
+	}
+
+	window = new BenchWindow (item->width, item->height);
+	surface = new Surface (window);
+
+	base_string = g_strdup_printf ("file://%s/", set_directory);
+	base = Uri::Create (base_string);
+	surface->SetSourceLocation (base);
+
+	loader = XamlLoaderFactory::CreateLoader (base, surface);
+	value = loader->CreateFromStringWithError (xaml, true, &element_type, XamlLoader::IMPORT_DEFAULT_XMLNS, &error);
+	delete loader;
+	delete base;
+	g_free (base_string);
+	g_free (xaml);
+
+	if (value == NULL || !value->Is (surface->GetDeployment (), Type::PANEL)) {
+		g_print ("!!! Could not create the root visual from %s: %s\n", path, error.message ? error.message : "not a Panel");
+		delete value;
+		surface->Zombify ();
+		surface->unref ();
+		g_free (path);
+		return false;
+	}
+
+	surface->Attach ((Panel *) value->AsDependencyObject ());
+	delete value;
+	g_free (path);
+
+	target = new CairoSurface (item->width, item->height);
+	ctx = new CairoContext (target);
+	front_buffer = (guint8 *) g_malloc0 (cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, item->width) * item->height);
+	source = (ManualTimeSource *) surface->GetTimeManager ()->GetSource ();
+
+	for (int i = 0; i < NumPhases; i++)
+		samples [i] = g_new0 (TimeSpan, count);
+
+	for (int frame = -warmup_frames; frame < count; frame++) {
+		TimeSpan time = TimeSpan_FromSecondsFloat ((item->start_time + MAX (frame, 0) * item->interval) / 1000.0);
+		TimeSpan frame_start, tick, tick_work, present_start, end;
+
+		memset (&timings, 0, sizeof (timings));
+		surface->SetFrameTimings (&timings);
+
+		// the clock tick also processes the dirty elements (and the
+		// layout) if anything needs to be redrawn. Do it again in case
+		// nothing did, it's almost free when there's nothing to do.
+		frame_start = get_now ();
+		source->SetCurrentTime (time);
+		tick = get_now () - frame_start;
+		tick_work = timings.layout + timings.dirty;
+		surface->ProcessDirtyElements ();
+
+		if (!window->GetDamage ()->IsEmpty ())
+			surface->Paint (ctx, window->GetDamage (), false, true);
+
+		present_start = get_now ();
+		present (ctx, target, front_buffer, item->width, item->height, window->GetDamage ());
+		end = get_now ();
+
+		surface->SetFrameTimings (NULL);
+
+		if (frame < 0) {
+			window->ClearDamage ();
+			continue;
+		}
+
+		Rect extents = window->GetDamage ()->GetExtents ();
+		damaged_pixels += (gint64) (extents.width * extents.height);
+		window->ClearDamage ();
+
+		samples [PhaseLayout][frame] = timings.layout;
+		samples [PhaseDirty][frame] = timings.dirty;
+		samples [PhaseFrontToBack][frame] = timings.front_to_back;
+		samples [PhaseRender][frame] = timings.render;
+		samples [PhasePresent][frame] = end - present_start;
+		samples [PhaseFrame][frame] = end - frame_start;
+		// whatever the tick didn't spend on layout and dirty processing
+		samples [PhaseClock][frame] = MAX (tick - tick_work, 0);
+	}
+
+	if (png_directory) {
+		char *filename = g_strdup_printf ("%s/%s.png", png_directory, item->unique_id ? item->unique_id : "test");
+		cairo_surface_t *image = cairo_image_surface_create_for_data (front_buffer, CAIRO_FORMAT_ARGB32, item->width, item->height,
+									      cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, item->width));
+		cairo_surface_write_to_png (image, filename);
+		cairo_surface_destroy (image);
+		g_free (filename);
+	}
+
+	fprintf (out, "%s\t\t{\n", first ? "" : ",\n");
+	fprintf (out, "\t\t\t\"id\": ");
+	print_json_string (out, item->unique_id);
+	fprintf (out, ",\n\t\t\t\"name\": ");
+	print_json_string (out, item->name);
+	fprintf (out, ",\n\t\t\t\"file\": ");
+	print_json_string (out, item->input_file);
+	fprintf (out, ",\n\t\t\t\"width\": %d,\n\t\t\t\"height\": %d,\n\t\t\t\"frames\": %d,\n\t\t\t\"interval_ms\": %d,\n",
+		 item->width, item->height, count, item->interval);
+	fprintf (out, "\t\t\t\"damaged_pixels\": %" G_GINT64_FORMAT ",\n", damaged_pixels);
+	fprintf (out, "\t\t\t\"phases\": {\n");
+	for (int i = 0; i < NumPhases; i++) {
+		print_phase (out, (BenchPhase) i, samples [i], count);
+		fprintf (out, i < NumPhases - 1 ? ",\n" : "\n");
+		g_free (samples [i]);
+	}
+	fprintf (out, "\t\t\t}\n\t\t}");
+
+	surface->Zombify ();
+	surface->unref ();
+
+	g_free (front_buffer);
+	delete ctx;
+	target->unref ();
+
+	return true;
+}
+
+int
+main (int argc, char **argv)
+{
+	GError *error = NULL;
+	GOptionContext *context;
+	Deployment *deployment;
+	GPtrArray *items;
+	char *set_directory;
+	FILE *out = stdout;
+	bool first = true;
+	int failures = 0;
+
+	context = g_option_context_new ("- benchmark the perf suite tests without a display");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_print ("!!! Option parsing failed: %s\n", error->message);
+		exit (1);
+	}
+
+	if (set_filename == NULL)
+		set_filename = g_strdup ("perf-suite-set/drtlist.xml");
+
+	if (!(items = load_drt_list (set_filename)))
+		exit (1);
+
+	if (output_filename && !(out = fopen (output_filename, "w"))) {
+		g_print ("!!! Could not open %s for writing\n", output_filename);
+		exit (1);
+	}
+
+	// occlusion culling is on so that FrontToBack is measured too.
+	Runtime::Init (NULL, (RuntimeInitFlag) (RUNTIME_INIT_MANUAL_TIMESOURCE | RUNTIME_INIT_DISABLE_AUDIO |
+						 RUNTIME_INIT_OCCLUSION_CULLING | RUNTIME_INIT_CREATE_ROOT_DOMAIN), true);
+
+	deployment = new Deployment ();
+	deployment->Initialize ();
+	Deployment::SetCurrent (deployment);
+
+	if (g_path_is_absolute (set_filename)) {
+		set_directory = g_path_get_dirname (set_filename);
+	} else {
+		char *current_directory = g_get_current_dir ();
+		char *filename = g_build_filename (current_directory, set_filename, NULL);
+		set_directory = g_path_get_dirname (filename);
+		g_free (current_directory);
+		g_free (filename);
+	}
+
+	fprintf (out, "{\n\t\"tests\": [\n");
+	for (guint i = 0; i < items->len; i++) {
+		DrtItem *item = (DrtItem *) g_ptr_array_index (items, i);
+
+		if (test_id && (!item->unique_id || strcmp (test_id, item->unique_id)))
+			continue;
+		if (!item->input_file)
+			continue;
+
+		if (run_item (item, set_directory, out, first))
+			first = false;
+		else
+			failures++;
+	}
+	fprintf (out, "\n\t]\n}\n");
+
+	if (out != stdout)
+		fclose (out);
+
+	g_free (set_directory);
+
+	return failures ? 1 : 0;
+}
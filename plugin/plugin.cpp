@@ -140,6 +140,7 @@ PluginInstance::PluginInstance (NPP instance, guint16 mode)
 	maxFrameRate = 60;
 	
 	xaml_loader = NULL;
+	source_loader = NULL;
 	timers = NULL;
 	
 	wrapped_objects = g_hash_table_new (g_direct_hash, g_direct_equal);
@@ -341,6 +342,8 @@ PluginInstance::Shutdown ()
 	initParams = NULL;
 	delete xaml_loader;
 	xaml_loader = NULL;
+	delete source_loader;
+	source_loader = NULL;
 
 	g_free (source);
 	source = NULL;
@@ -905,6 +908,7 @@ PluginInstance::UpdateSource ()
 			this->ref ();
 			request->AddHandler (HttpRequest::ProgressChangedEvent, SourceProgressChangedHandler, this);
 			request->AddHandler (HttpRequest::StoppedEvent, SourceStoppedHandler, this);
+			request->AddHandler (HttpRequest::WriteEvent, SourceWriteHandler, this);
 			request->Open ("GET", request_uri, NoPolicy);
 			request->Send ();
 		}
@@ -1802,7 +1806,11 @@ PluginXamlLoader::TryLoad (int *error)
 	
 	GetSurface ()->Attach (NULL);
 	
-	if (GetXamlFile ()) {
+	if (IsParsing ()) {
+		element = EndParseDependencyObject (&element_type);
+		d(printf ("PluginXamlLoader::TryLoad: parsed %" G_GINT64_FORMAT " bytes while downloading in %.2f ms\n",
+			  GetParsedBytes (), GetParseTime () / 10000.0));
+	} else if (GetXamlFile ()) {
 		element = CreateDependencyObjectFromFile (GetXamlFile (), true, &element_type);
 	} else if (GetXamlString ()) {
 		element = CreateDependencyObjectFromString (GetXamlString (), true, &element_type);
@@ -1975,6 +1983,12 @@ PluginInstance::SourceStoppedHandler (EventObject *obj, EventArgs *args, gpointe
 	((PluginInstance *) closure)->SourceStopped ((HttpRequest *) obj, (HttpRequestStoppedEventArgs *) args);
 }
 
+void
+PluginInstance::SourceWriteHandler (EventObject *obj, EventArgs *args, gpointer closure)
+{
+	((PluginInstance *) closure)->SourceWrite ((HttpRequest *) obj, (HttpRequestWriteEventArgs *) args);
+}
+
 void
 PluginInstance::SourceProgressChanged (HttpRequest *request, HttpRequestProgressChangedEventArgs *args)
 {
@@ -1990,14 +2004,56 @@ PluginInstance::SourceProgressChanged (HttpRequest *request, HttpRequestProgress
 	}
 }
 
+void
+PluginInstance::SourceWrite (HttpRequest *request, HttpRequestWriteEventArgs *args)
+{
+	const char *data = (const char *) args->GetData ();
+	gint32 count = args->GetCount ();
+
+	if (IsShuttingDown ())
+		return;
+
+	//
+	// Plain xaml is parsed while it downloads (the elements are created
+	// as their chunk arrives), so that it's (mostly) parsed by the time
+	// the download completes. Xaps are loaded once they're complete.
+	//
+	if (args->GetOffset () == 0) {
+		delete source_loader;
+		source_loader = NULL;
+
+		// the zip magic header
+		if (count >= 4 && data [0] == 0x50 && data [1] == 0x4B && data [2] == 0x03 && data [3] == 0x04)
+			return;
+
+		source_loader = PluginXamlLoader::FromStream (request->GetFinalUri (), request->GetFilename (), this, surface);
+
+		// elements of managed types can't be created before the vm is loaded,
+		// fall back to parsing the downloaded file.
+		if (!source_loader->LoadVM ()) {
+			delete source_loader;
+			source_loader = NULL;
+		}
+	}
+
+	if (source_loader != NULL)
+		source_loader->ParseChunk (data, count);
+}
+
 void
 PluginInstance::SourceStopped (HttpRequest *request, HttpRequestStoppedEventArgs *args)
 {
+	PluginXamlLoader *streamed_loader = source_loader;
+
+	source_loader = NULL;
+
 	delete xaml_loader;
 	xaml_loader = NULL;
 
-	if (IsShuttingDown ())
+	if (IsShuttingDown ()) {
+		delete streamed_loader;
 		return;
+	}
 
 	if (GetSurface ()->GetToplevel ()) {
 		DependencyObject *spinner = GetSurface ()->GetToplevel ()->FindName ("Throb");
@@ -2016,7 +2072,12 @@ PluginInstance::SourceStopped (HttpRequest *request, HttpRequestStoppedEventArgs
 		if (request->GetFinalUri () != NULL && is_xap (request->GetFilename ())) {
 			LoadXAP (request->GetFinalUri (), request->GetFilename ());
 		} else {
-			xaml_loader = PluginXamlLoader::FromFilename (request->GetFinalUri (), request->GetFilename (), this, surface);
+			if (streamed_loader != NULL && streamed_loader->IsParsing ()) {
+				xaml_loader = streamed_loader;
+				streamed_loader = NULL;
+			} else {
+				xaml_loader = PluginXamlLoader::FromFilename (request->GetFinalUri (), request->GetFilename (), this, surface);
+			}
 			LoadXAML ();
 		}
 	
@@ -2029,6 +2090,8 @@ PluginInstance::SourceStopped (HttpRequest *request, HttpRequestStoppedEventArgs
 		}
 	}
 
+	delete streamed_loader;
+
 	request->RemoveAllHandlers (this);
 	request->unref ();
 	unref ();
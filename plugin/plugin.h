@@ -159,6 +159,8 @@ class PluginInstance
 	static void SourceStoppedHandler (EventObject *obj, EventArgs *args, gpointer closure);
 	void SourceProgressChanged (HttpRequest *request, HttpRequestProgressChangedEventArgs *args);
 	void SourceStopped (HttpRequest *request, HttpRequestStoppedEventArgs *args);
+	static void SourceWriteHandler (EventObject *obj, EventArgs *args, gpointer closure);
+	void SourceWrite (HttpRequest *request, HttpRequestWriteEventArgs *args);
 
 	static void SplashProgressChangedHandler (EventObject *obj, EventArgs *args, gpointer closure);
 	static void SplashStoppedHandler (EventObject *obj, EventArgs *args, gpointer closure);
@@ -271,6 +273,10 @@ private:
 	// The XAML loader, contains a handle to a MonoObject *
 	//
 	PluginXamlLoader *xaml_loader;
+	//
+	// The loader parsing the source xaml while it's downloaded
+	//
+	PluginXamlLoader *source_loader;
 	Deployment   *deployment;
 	bool LoadXAP  (const Uri *url, const char *fname);
 	void DestroyApplication ();
@@ -349,6 +355,16 @@ class PluginXamlLoader : public SL3XamlLoader
 		loader->xaml_string = g_strdup (str);
 		return loader;
 	}
+
+	// The loader parses @filename as it's written, feed it with ParseChunk.
+	static PluginXamlLoader *FromStream (const Uri *resourceBase, const char *filename, PluginInstance *plugin, Surface *surface)
+	{
+		PluginXamlLoader *loader = new PluginXamlLoader (resourceBase, plugin, surface);
+
+		loader->xaml_file = g_strdup (filename);
+		loader->BeginParse (filename, true);
+		return loader;
+	}
 	
 	virtual bool LoadVM ();
 };
@@ -1069,6 +1069,8 @@ KeySpline::KeySpline ()
 	SetObjectType (Type::KEYSPLINE);
 
 	quadraticsArray = NULL;
+	table = NULL;
+	evaluations = 0;
 }
 
 KeySpline::KeySpline (Point controlPoint1, Point controlPoint2)
@@ -1076,6 +1078,8 @@ KeySpline::KeySpline (Point controlPoint1, Point controlPoint2)
 	SetObjectType (Type::KEYSPLINE);
 
 	quadraticsArray = NULL;
+	table = NULL;
+	evaluations = 0;
 	SetControlPoint1 (&controlPoint1);
 	SetControlPoint2 (&controlPoint2);
 
@@ -1088,6 +1092,8 @@ KeySpline::KeySpline (double x1, double y1,
 	SetObjectType (Type::KEYSPLINE);
 
 	quadraticsArray = NULL;
+	table = NULL;
+	evaluations = 0;
 
 	Point p1 = Point (x1, y1);
 	Point p2 = Point (x2, y2);
@@ -1102,6 +1108,9 @@ KeySpline::~KeySpline ()
 {
 	g_free (quadraticsArray);
 	quadraticsArray = NULL;
+
+	if (table != NULL)
+		CurveTable::Unref (table);
 }
 
 
@@ -1136,11 +1145,40 @@ KeySpline::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
 	g_free (quadraticsArray);
 	quadraticsArray = NULL;
 
+	if (table != NULL) {
+		CurveTable::Unref (table);
+		table = NULL;
+	}
+	evaluations = 0;
+
 	NotifyListenersOfPropertyChange (args, error);
 }
 
 double
 KeySpline::GetSplineProgress (double linearProgress)
+{
+	if (table == NULL && evaluations < CURVE_TABLE_MIN_EVALUATIONS && ++evaluations == CURVE_TABLE_MIN_EVALUATIONS) {
+		Point c1 = *GetControlPoint1 ();
+		Point c2 = *GetControlPoint2 ();
+		CurveTableKey key (Type::KEYSPLINE, 0, c1.x, c1.y, c2.x, c2.y);
+
+		table = CurveTable::Get (&key, SampleSpline, this);
+	}
+
+	if (table != NULL && table->IsAccurate () && linearProgress >= 0.0 && linearProgress <= 1.0)
+		return table->Evaluate (linearProgress);
+
+	return SolveSpline (linearProgress);
+}
+
+double
+KeySpline::SampleSpline (gpointer closure, double linearProgress)
+{
+	return ((KeySpline *) closure)->SolveSpline (linearProgress);
+}
+
+double
+KeySpline::SolveSpline (double linearProgress)
 {
 	if (linearProgress >= 1.0)
 		return 1.0;
@@ -1203,6 +1241,7 @@ KeyFrameCollection::KeyFrameCollection ()
 	SetObjectType (Type::KEYFRAME_COLLECTION);
 
 	sorted_list = g_ptr_array_new ();
+	cursor = 0;
 	resolved = false;
 }
 
@@ -1235,9 +1274,43 @@ KeyFrameCollection::Clear ()
 {
 	resolved = false;
 	g_ptr_array_set_size (sorted_list, 0);
+	cursor = 0;
 	return DependencyObjectCollection::Clear ();
 }
 
+static inline TimeSpan
+sorted_keytime (GPtrArray *list, guint i)
+{
+	return ((KeyFrame *) list->pdata[i])->resolved_keytime;
+}
+
+guint
+KeyFrameCollection::FindSegment (TimeSpan t)
+{
+	guint len = sorted_list->len;
+	guint lo, hi;
+
+	/* Animations move forward a little every tick, so try the segment we found last time and the one after it first */
+	for (guint i = cursor; i < len && i <= cursor + 1; i++) {
+		if ((sorted_keytime (sorted_list, i) >= t || i + 1 == len) && (i == 0 || sorted_keytime (sorted_list, i - 1) < t))
+			return cursor = i;
+	}
+
+	/* The list is sorted, binary search it */
+	lo = 0;
+	hi = len - 1;
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (sorted_keytime (sorted_list, mid) >= t)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return cursor = lo;
+}
+
 KeyFrame *
 KeyFrameCollection::GetKeyFrameForTime (TimeSpan t, KeyFrame **prev_frame)
 {
@@ -1252,20 +1325,13 @@ KeyFrameCollection::GetKeyFrameForTime (TimeSpan t, KeyFrame **prev_frame)
 		return NULL;
 	}
 	
-	/* Crawl forward to figure out what segment to use (this assumes the list is sorted) */
-	for (i = 0; i < (int) sorted_list->len; i++) {
-		KeyFrame *keyframe = (KeyFrame *) sorted_list->pdata[i];
-		TimeSpan key_end_time = keyframe->resolved_keytime;
-		
-		if (key_end_time >= t || (i + 1) >= (int) sorted_list->len) 
-			break;
-	}
+	/* Figure out what segment to use */
+	i = FindSegment (t);
 
 	/* Crawl backward to find first non-null frame */
 	for (; i >= 0; i--) {
 		KeyFrame *keyframe = (KeyFrame *) sorted_list->pdata[i];
-		DependencyProperty *value_prop = keyframe->GetDependencyProperty ("Value");
-		if (keyframe->GetValue (value_prop) != NULL) {
+		if (keyframe->HasValue ()) {
 			current_keyframe = keyframe;
 			break;
 		}
@@ -1274,8 +1340,7 @@ KeyFrameCollection::GetKeyFrameForTime (TimeSpan t, KeyFrame **prev_frame)
 	/* Crawl backward some more to find first non-null prev frame */
 	for (i--; i >= 0; i--) {
 		KeyFrame *keyframe = (KeyFrame *) sorted_list->pdata[i];
-		DependencyProperty *value_prop = keyframe->GetDependencyProperty ("Value");
-		if (keyframe->GetValue (value_prop) != NULL) {
+		if (keyframe->HasValue ()) {
 			previous_keyframe = keyframe;
 			break;
 		}
@@ -1328,30 +1393,137 @@ PointKeyFrameCollection::~PointKeyFrameCollection ()
 DoubleKeyFrame::DoubleKeyFrame ()
 {
 	SetObjectType (Type::DOUBLEKEYFRAME);
+	hasCached = false;
 }
 
 DoubleKeyFrame::~DoubleKeyFrame ()
 {
 }
 
+double
+DoubleKeyFrame::GetCachedValue ()
+{
+	if (!hasCached) {
+		valueCached = GetValue ();
+		hasCached = true;
+	}
+
+	return valueCached;
+}
+
+double
+DoubleKeyFrame::Interpolate (double baseValue, double keyFrameProgress)
+{
+	g_warning ("DoubleKeyFrame::Interpolate has been called. The derived class %s should have overridden it.",
+		   GetName ());
+	return 0.0;
+}
+
+Value*
+DoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+{
+	return new Value (Interpolate (baseValue->AsDouble (), keyFrameProgress));
+}
+
+void
+DoubleKeyFrame::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
+{
+	if (args->GetId () == DoubleKeyFrame::ValueProperty)
+		hasCached = false;
+
+	KeyFrame::OnPropertyChanged (args, error);
+}
+
 ColorKeyFrame::ColorKeyFrame ()
 {
 	SetObjectType (Type::COLORKEYFRAME);
+	valueCached = NULL;
+	hasCached = false;
 }
 
 ColorKeyFrame::~ColorKeyFrame ()
 {
 }
 
+Color
+ColorKeyFrame::GetCachedValue ()
+{
+	if (!hasCached) {
+		valueCached = GetValue ();
+		hasCached = true;
+	}
+
+	return *valueCached;
+}
+
+Color
+ColorKeyFrame::Interpolate (Color baseValue, double keyFrameProgress)
+{
+	g_warning ("ColorKeyFrame::Interpolate has been called. The derived class %s should have overridden it.",
+		   GetName ());
+	return baseValue;
+}
+
+Value*
+ColorKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+{
+	return new Value (Interpolate (*baseValue->AsColor (), keyFrameProgress));
+}
+
+void
+ColorKeyFrame::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
+{
+	if (args->GetId () == ColorKeyFrame::ValueProperty)
+		hasCached = false;
+
+	KeyFrame::OnPropertyChanged (args, error);
+}
+
 PointKeyFrame::PointKeyFrame ()
 {
 	SetObjectType (Type::POINTKEYFRAME);
+	valueCached = NULL;
+	hasCached = false;
 }
 
 PointKeyFrame::~PointKeyFrame ()
 {
 }
 
+Point
+PointKeyFrame::GetCachedValue ()
+{
+	if (!hasCached) {
+		valueCached = GetValue ();
+		hasCached = true;
+	}
+
+	return *valueCached;
+}
+
+Point
+PointKeyFrame::Interpolate (Point baseValue, double keyFrameProgress)
+{
+	g_warning ("PointKeyFrame::Interpolate has been called. The derived class %s should have overridden it.",
+		   GetName ());
+	return baseValue;
+}
+
+Value*
+PointKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+{
+	return new Value (Interpolate (*baseValue->AsPoint (), keyFrameProgress));
+}
+
+void
+PointKeyFrame::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
+{
+	if (args->GetId () == PointKeyFrame::ValueProperty)
+		hasCached = false;
+
+	KeyFrame::OnPropertyChanged (args, error);
+}
+
 DiscreteDoubleKeyFrame::DiscreteDoubleKeyFrame ()
 {
 	SetObjectType(Type::DISCRETEDOUBLEKEYFRAME);
@@ -1361,15 +1533,13 @@ DiscreteDoubleKeyFrame::~DiscreteDoubleKeyFrame ()
 {
 }
 
-Value*
-DiscreteDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+double
+DiscreteDoubleKeyFrame::Interpolate (double baseValue, double keyFrameProgress)
 {
-	double to = GetValue ();
-
 	if (keyFrameProgress == 1.0)
-		return new Value(to);
+		return GetCachedValue ();
 	else
-		return new Value (baseValue->AsDouble());
+		return baseValue;
 }
 
 DiscreteColorKeyFrame::DiscreteColorKeyFrame ()
@@ -1381,13 +1551,13 @@ DiscreteColorKeyFrame::~DiscreteColorKeyFrame ()
 {
 }
 
-Value*
-DiscreteColorKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Color
+DiscreteColorKeyFrame::Interpolate (Color baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress == 1.0)
-		return new Value (*GetValue ());
+		return GetCachedValue ();
 	else
-		return new Value (*baseValue->AsColor());
+		return baseValue;
 }
 
 DiscretePointKeyFrame::DiscretePointKeyFrame ()
@@ -1399,13 +1569,13 @@ DiscretePointKeyFrame::~DiscretePointKeyFrame ()
 {
 }
 
-Value*
-DiscretePointKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Point
+DiscretePointKeyFrame::Interpolate (Point baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress == 1.0)
-		return new Value (*GetValue ());
+		return GetCachedValue ();
 	else
-		return new Value (*baseValue->AsPoint());
+		return baseValue;
 }
 
 LinearDoubleKeyFrame::LinearDoubleKeyFrame ()
@@ -1417,11 +1587,11 @@ LinearDoubleKeyFrame::~LinearDoubleKeyFrame ()
 {
 }
 
-Value*
-LinearDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+double
+LinearDoubleKeyFrame::Interpolate (double baseValue, double keyFrameProgress)
 {
-	double start = baseValue->AsDouble();
-	double end = GetValue ();
+	double start = baseValue;
+	double end = GetCachedValue ();
 
 
 	if (isnan (start))
@@ -1429,7 +1599,7 @@ LinearDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgres
 	if (isnan (end))
 		end = 0;
 
-	return new Value (LERP (start, end, keyFrameProgress));
+	return LERP (start, end, keyFrameProgress);
 }
 
 LinearColorKeyFrame::LinearColorKeyFrame ()
@@ -1441,13 +1611,13 @@ LinearColorKeyFrame::~LinearColorKeyFrame ()
 {
 }
 
-Value*
-LinearColorKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Color
+LinearColorKeyFrame::Interpolate (Color baseValue, double keyFrameProgress)
 {
-	Color start = *baseValue->AsColor();
-	Color end = *GetValue();
+	Color start = baseValue;
+	Color end = GetCachedValue ();
 
-	return new Value (LERP (start, end, keyFrameProgress));
+	return LERP (start, end, keyFrameProgress);
 }
 
 LinearPointKeyFrame::LinearPointKeyFrame ()
@@ -1459,13 +1629,13 @@ LinearPointKeyFrame::~LinearPointKeyFrame ()
 {
 }
 
-Value*
-LinearPointKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Point
+LinearPointKeyFrame::Interpolate (Point baseValue, double keyFrameProgress)
 {
-	Point start = *baseValue->AsPoint();
-	Point end = *GetValue();
+	Point start = baseValue;
+	Point end = GetCachedValue ();
 
-	return new Value (LERP (start, end, keyFrameProgress));
+	return LERP (start, end, keyFrameProgress);
 }
 
 SplineDoubleKeyFrame::SplineDoubleKeyFrame ()
@@ -1477,14 +1647,14 @@ SplineDoubleKeyFrame::~SplineDoubleKeyFrame ()
 {
 }
 
-Value *
-SplineDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+double
+SplineDoubleKeyFrame::Interpolate (double baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress >= 1.0)
-		return new Value (GetValue ());
+		return GetCachedValue ();
 
-	double start = baseValue->AsDouble();
-	double end = GetValue ();
+	double start = baseValue;
+	double end = GetCachedValue ();
 	double splineProgress = GetKeySpline ()->GetSplineProgress (keyFrameProgress);
 
 	if (isnan (start))
@@ -1492,7 +1662,7 @@ SplineDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgres
 	if (isnan (end))
 		end = 0;
 
-	return new Value (LERP (start, end, splineProgress));
+	return LERP (start, end, splineProgress);
 }
 
 SplineColorKeyFrame::SplineColorKeyFrame ()
@@ -1504,17 +1674,17 @@ SplineColorKeyFrame::~SplineColorKeyFrame ()
 {
 }
 
-Value *
-SplineColorKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Color
+SplineColorKeyFrame::Interpolate (Color baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress >= 1.0)
-		return new Value (*GetValue ());
+		return GetCachedValue ();
 
-	Color start = *baseValue->AsColor();
-	Color end = *GetValue ();
+	Color start = baseValue;
+	Color end = GetCachedValue ();
 	double splineProgress = GetKeySpline ()->GetSplineProgress (keyFrameProgress);
 
-	return new Value (LERP (start, end, splineProgress));
+	return LERP (start, end, splineProgress);
 }
 
 
@@ -1527,17 +1697,17 @@ SplinePointKeyFrame::~SplinePointKeyFrame ()
 {
 }
 
-Value *
-SplinePointKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Point
+SplinePointKeyFrame::Interpolate (Point baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress >= 1.0)
-		return new Value (*GetValue ());
+		return GetCachedValue ();
 
-	Point start = *baseValue->AsPoint();
-	Point end = *GetValue ();
+	Point start = baseValue;
+	Point end = GetCachedValue ();
 	double splineProgress = GetKeySpline ()->GetSplineProgress (keyFrameProgress);
 
-	return new Value (LERP (start, end, splineProgress));
+	return LERP (start, end, splineProgress);
 }
 
 EasingColorKeyFrame::EasingColorKeyFrame ()
@@ -1549,19 +1719,19 @@ EasingColorKeyFrame::~EasingColorKeyFrame ()
 {
 }
 
-Value *
-EasingColorKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Color
+EasingColorKeyFrame::Interpolate (Color baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress >= 1.0)
-		return new Value (*GetValue ());
+		return GetCachedValue ();
 
-	Color start = *baseValue->AsColor();
-	Color end = *GetValue ();
+	Color start = baseValue;
+	Color end = GetCachedValue ();
 
 	if (GetEasingFunction ())
 		keyFrameProgress = GetEasingFunction ()->Ease (keyFrameProgress);
 
-	return new Value (LERP (start, end, keyFrameProgress));
+	return LERP (start, end, keyFrameProgress);
 }
 
 EasingDoubleKeyFrame::EasingDoubleKeyFrame ()
@@ -1573,14 +1743,14 @@ EasingDoubleKeyFrame::~EasingDoubleKeyFrame ()
 {
 }
 
-Value *
-EasingDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+double
+EasingDoubleKeyFrame::Interpolate (double baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress >= 1.0)
-		return new Value (GetValue ());
+		return GetCachedValue ();
 
-	double start = baseValue->AsDouble();
-	double end = GetValue ();
+	double start = baseValue;
+	double end = GetCachedValue ();
 
 	if (GetEasingFunction ())
 		keyFrameProgress = GetEasingFunction ()->Ease (keyFrameProgress);
@@ -1590,7 +1760,7 @@ EasingDoubleKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgres
 	if (isnan (end))
 		end = 0;
 
-	return new Value (LERP (start, end, keyFrameProgress));
+	return LERP (start, end, keyFrameProgress);
 }
 
 
@@ -1603,19 +1773,19 @@ EasingPointKeyFrame::~EasingPointKeyFrame ()
 {
 }
 
-Value *
-EasingPointKeyFrame::InterpolateValue (Value *baseValue, double keyFrameProgress)
+Point
+EasingPointKeyFrame::Interpolate (Point baseValue, double keyFrameProgress)
 {
 	if (keyFrameProgress >= 1.0)
-		return new Value (*GetValue ());
+		return GetCachedValue ();
 
-	Point start = *baseValue->AsPoint();
-	Point end = *GetValue ();
+	Point start = baseValue;
+	Point end = GetCachedValue ();
 
 	if (GetEasingFunction ())
 		keyFrameProgress = GetEasingFunction ()->Ease (keyFrameProgress);
 
-	return new Value (LERP (start, end, keyFrameProgress));
+	return LERP (start, end, keyFrameProgress);
 }
 
 /* implements the algorithm specified at the bottom of this page:
@@ -1729,6 +1899,7 @@ KeyFrameAnimation_ResolveKeyFrames (Animation *animation, KeyFrameCollection *co
 	   with resolved keytime as primary key, declaration order as
 	   secondary key (step 8 from url) */
 	g_ptr_array_set_size (col->sorted_list, 0);
+	col->cursor = 0;
 	
 	for (int i = count; i > 0; i--) {
 		value = col->GetValueAt (i - 1);
@@ -1800,8 +1971,7 @@ DoubleAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	DoubleKeyFrame *current_keyframe;
 	DoubleKeyFrame *previous_keyframe;
 	DoubleKeyFrame** keyframep = &previous_keyframe;
-	Value *baseValue;
-	bool deleteBaseValue;
+	double baseValue;
 
 	current_keyframe = (DoubleKeyFrame*)key_frames->GetKeyFrameForTime (current_time, (KeyFrame**)keyframep);
 	if (current_keyframe == NULL) {
@@ -1814,14 +1984,15 @@ DoubleAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 
 	if (previous_keyframe == NULL) {
 		/* the first keyframe, start at the animation's base value */
-		baseValue = defaultOriginValue;
-		deleteBaseValue = false;
+		if (defaultOriginValue->Is (GetDeployment (), Type::DOUBLE))
+			baseValue = defaultOriginValue->AsDouble ();
+		else
+			baseValue = 0.0;
 		key_start_time = 0;
 	}
 	else {
 		/* start at the previous keyframe's target value */
-		baseValue = new Value (previous_keyframe->GetValue ());
-		deleteBaseValue = true;
+		baseValue = previous_keyframe->GetCachedValue ();
 		key_start_time = previous_keyframe->resolved_keytime;
 	}
 
@@ -1839,10 +2010,7 @@ DoubleAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	}
 
 	/* get the current value out of that segment */
-	Value *rv = current_keyframe->InterpolateValue (baseValue, progress);
-	if (deleteBaseValue)
-		delete baseValue;
-	return rv;
+	return new Value (current_keyframe->Interpolate (baseValue, progress));
 }
 
 Duration
@@ -1916,8 +2084,7 @@ ColorAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	ColorKeyFrame *current_keyframe;
 	ColorKeyFrame *previous_keyframe;
 	ColorKeyFrame** keyframep = &previous_keyframe;
-	Value *baseValue;
-	bool deleteBaseValue;
+	Color baseValue;
 
 	current_keyframe = (ColorKeyFrame*)key_frames->GetKeyFrameForTime (current_time, (KeyFrame**)keyframep);
 	if (current_keyframe == NULL)
@@ -1928,14 +2095,15 @@ ColorAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 
 	if (previous_keyframe == NULL) {
 		/* the first keyframe, start at the animation's base value */
-		baseValue = defaultOriginValue;
-		deleteBaseValue = false;
+		if (defaultOriginValue->Is (GetDeployment (), Type::COLOR))
+			baseValue = *defaultOriginValue->AsColor ();
+		else
+			baseValue = Color ();
 		key_start_time = 0;
 	}
 	else {
 		/* start at the previous keyframe's target value */
-		baseValue = new Value(*previous_keyframe->GetValue ());
-		deleteBaseValue = true;
+		baseValue = previous_keyframe->GetCachedValue ();
 		key_start_time = previous_keyframe->resolved_keytime;
 	}
 
@@ -1953,10 +2121,7 @@ ColorAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	}
 
 	/* get the current value out of that segment */
-	Value *rv = current_keyframe->InterpolateValue (baseValue, progress);
-	if (deleteBaseValue)
-		delete baseValue;
-	return rv;;
+	return new Value (current_keyframe->Interpolate (baseValue, progress));
 }
 
 Duration
@@ -2030,8 +2195,7 @@ PointAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	PointKeyFrame *current_keyframe;
 	PointKeyFrame *previous_keyframe;
 	PointKeyFrame** keyframep = &previous_keyframe;
-	Value *baseValue;
-	bool deleteBaseValue;
+	Point baseValue;
 
 	current_keyframe = (PointKeyFrame*)key_frames->GetKeyFrameForTime (current_time, (KeyFrame**)keyframep);
 	if (current_keyframe == NULL)
@@ -2042,14 +2206,15 @@ PointAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 
 	if (previous_keyframe == NULL) {
 		/* the first keyframe, start at the animation's base value */
-		baseValue = defaultOriginValue;
-		deleteBaseValue = false;
+		if (defaultOriginValue->Is (GetDeployment (), Type::POINT))
+			baseValue = *defaultOriginValue->AsPoint ();
+		else
+			baseValue = Point ();
 		key_start_time = 0;
 	}
 	else {
 		/* start at the previous keyframe's target value */
-		baseValue = new Value(*previous_keyframe->GetValue ());
-		deleteBaseValue = true;
+		baseValue = previous_keyframe->GetCachedValue ();
 		key_start_time = previous_keyframe->resolved_keytime;
 	}
 
@@ -2067,10 +2232,7 @@ PointAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	}
 
 	/* get the current value out of that segment */
-	Value *rv = current_keyframe->InterpolateValue (baseValue, progress);
-	if (deleteBaseValue)
-		delete baseValue;
-	return rv;
+	return new Value (current_keyframe->Interpolate (baseValue, progress));
 }
 
 Duration
@@ -2238,7 +2400,6 @@ ObjectAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	ObjectKeyFrame *previous_keyframe;
 	ObjectKeyFrame** keyframep = &previous_keyframe;
 	Value *baseValue;
-	bool deleteBaseValue;
 
 	current_keyframe = (ObjectKeyFrame*)key_frames->GetKeyFrameForTime (current_time, (KeyFrame**)keyframep);
 	if (current_keyframe == NULL)
@@ -2250,12 +2411,10 @@ ObjectAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	if (previous_keyframe == NULL) {
 		/* the first keyframe, start at the animation's base value */
 		baseValue = defaultOriginValue;
-		deleteBaseValue = false;
 		key_start_time = 0;
 	} else {
-		/* start at the previous keyframe's target value */
-		baseValue = new Value (*previous_keyframe->GetConvertedValue ());
-		deleteBaseValue = true;
+		/* start at the previous keyframe's target value, InterpolateValue copies what it needs */
+		baseValue = previous_keyframe->GetConvertedValue ();
 		key_start_time = previous_keyframe->resolved_keytime;
 	}
 
@@ -2272,12 +2431,7 @@ ObjectAnimationUsingKeyFrames::GetCurrentValue (Value *defaultOriginValue, Value
 	}
 
 	/* get the current value out of that segment */
-	Value *rv = current_keyframe->InterpolateValue (baseValue, progress);
-
-	if (deleteBaseValue)
-		delete baseValue;
-
-	return rv;;
+	return current_keyframe->InterpolateValue (baseValue, progress);
 }
 
 Duration
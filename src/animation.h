@@ -25,6 +25,7 @@
 #include "point.h"
 #include "propertypath.h"
 #include "moon-curves.h"
+#include "curve-table.h"
 #include "easing.h"
 #include "applier.h"
 
@@ -47,6 +48,11 @@ public:
 	void RegenerateQuadratics ();
 
 	double GetSplineProgress (double linearProgress);
+	// GetSplineProgress without the CurveTable
+	double SolveSpline (double linearProgress);
+	// Whether GetSplineProgress interpolates in a CurveTable
+	bool IsTabulated () { return table != NULL && table->IsAccurate (); }
+
 	/* @PropertyType=Point,ManagedPropertyType=Point,DefaultValue=Point (0\,0),ManagedFieldAccess=Internal,GenerateAccessors */
 	const static int ControlPoint1Property;
 	/* @PropertyType=Point,ManagedPropertyType=Point,DefaultValue=Point (1.0\, 1.0),ManagedFieldAccess=Internal,GenerateAccessors */
@@ -69,6 +75,10 @@ protected:
 
 private:
 	moon_quadratic *quadraticsArray;
+	CurveTable *table; // shared by the key splines with the same control points
+	int evaluations; // since the control points last changed
+
+	static double SampleSpline (gpointer closure, double linearProgress);
 };
 
 /* @Namespace=System.Windows.Media.Animation */
@@ -364,6 +374,9 @@ public:
 	bool resolved;
 	
 	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+
+	// Keyframes with a null Value (only ObjectKeyFrames can have one) are skipped
+	virtual bool HasValue () { return true; }
 	
 	//
 	// Property Accessors
@@ -384,6 +397,7 @@ protected:
 class KeyFrameCollection : public DependencyObjectCollection {
 public:
 	GPtrArray *sorted_list;
+	guint cursor; // the segment GetKeyFrameForTime found last
 	bool resolved;
 	
 	virtual Type::Kind GetElementType() { return Type::KEYFRAME; }
@@ -391,6 +405,8 @@ public:
 	virtual bool Clear ();
 	
 	KeyFrame *GetKeyFrameForTime (TimeSpan t, KeyFrame **previous_frame);
+	// The index in sorted_list of the first keyframe at or after @t, or of the last one
+	guint FindSegment (TimeSpan t);
 
 	virtual void OnSubPropertyChanged (DependencyProperty *prop, DependencyObject *obj, PropertyChangedEventArgs *subobj_args);
 
@@ -485,6 +501,15 @@ public:
 	void SetKeyTime (KeyTime keytime) { SetKeyTime (&keytime); }
 	virtual void SetKeyTime (KeyTime *keytime);
 
+	// GetValue without the property lookup, for evaluating animations every tick
+	double GetCachedValue ();
+
+	// The value @keyFrameProgress of the way from @baseValue to ours
+	virtual double Interpolate (double baseValue, double keyFrameProgress);
+	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+
+	virtual void OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error);
+
 protected:
 	/* @GeneratePInvoke,ManagedAccess=Protected */
 	DoubleKeyFrame ();
@@ -493,6 +518,10 @@ protected:
 
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
+
+private:
+	double valueCached;
+	bool hasCached;
 };
 
 /* @Namespace=System.Windows.Media.Animation */
@@ -514,6 +543,15 @@ public:
 	void SetKeyTime (KeyTime keytime) { SetKeyTime (&keytime); }
 	virtual void SetKeyTime (KeyTime *keytime);
 
+	// GetValue without the property lookup, for evaluating animations every tick
+	Color GetCachedValue ();
+
+	// The value @keyFrameProgress of the way from @baseValue to ours
+	virtual Color Interpolate (Color baseValue, double keyFrameProgress);
+	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+
+	virtual void OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error);
+
 protected:
 	/* @GeneratePInvoke,ManagedAccess=Protected */
 	ColorKeyFrame ();
@@ -522,6 +560,10 @@ protected:
 
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
+
+private:
+	Color *valueCached;
+	bool hasCached;
 };
 
 /* @Namespace=System.Windows.Media.Animation */
@@ -538,6 +580,8 @@ public:
 	void SetConvertedValue (Value *value);
 	Value *GetValue ();
 
+	virtual bool HasValue () { return GetValue () != NULL; }
+
 	virtual KeyTime *GetKeyTime ();
 	void SetKeyTime (KeyTime keytime) { SetKeyTime (&keytime); }
 	virtual void SetKeyTime (KeyTime *keytime);
@@ -571,6 +615,15 @@ public:
 	void SetKeyTime (KeyTime keytime) { SetKeyTime (&keytime); }
 	virtual void SetKeyTime (KeyTime *keytime);
 
+	// GetValue without the property lookup, for evaluating animations every tick
+	Point GetCachedValue ();
+
+	// The value @keyFrameProgress of the way from @baseValue to ours
+	virtual Point Interpolate (Point baseValue, double keyFrameProgress);
+	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+
+	virtual void OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error);
+
 protected:
 	/* @GeneratePInvoke,ManagedAccess=Protected */
 	PointKeyFrame ();
@@ -579,6 +632,10 @@ protected:
 
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
+
+private:
+	Point *valueCached;
+	bool hasCached;
 };
 
 
@@ -586,7 +643,7 @@ protected:
 /* @Namespace=System.Windows.Media.Animation */
 class DiscreteDoubleKeyFrame : public DoubleKeyFrame {
 public:
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual double Interpolate (double baseValue, double keyFrameProgress);
 
 protected:
 	/* @GeneratePInvoke */
@@ -604,7 +661,7 @@ protected:
 /* @Namespace=System.Windows.Media.Animation */
 class DiscreteColorKeyFrame : public ColorKeyFrame {
 public:
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Color Interpolate (Color baseValue, double keyFrameProgress);
 
 protected:
 	/* @GeneratePInvoke */
@@ -635,7 +692,7 @@ protected:
 /* @Namespace=System.Windows.Media.Animation */
 class DiscretePointKeyFrame : public PointKeyFrame {
 public:
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Point Interpolate (Point baseValue, double keyFrameProgress);
 
 protected:
 	/* @GeneratePInvoke */
@@ -651,7 +708,7 @@ protected:
 /* @Namespace=System.Windows.Media.Animation */
 class LinearDoubleKeyFrame : public DoubleKeyFrame {
 public:
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual double Interpolate (double baseValue, double keyFrameProgress);
 
 protected:
 	/* @GeneratePInvoke */
@@ -668,7 +725,7 @@ protected:
 /* @Namespace=System.Windows.Media.Animation */
 class LinearColorKeyFrame : public ColorKeyFrame {
 public:
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Color Interpolate (Color baseValue, double keyFrameProgress);
 
 protected:
 	/* @GeneratePInvoke */
@@ -685,7 +742,7 @@ protected:
 /* @Namespace=System.Windows.Media.Animation */
 class LinearPointKeyFrame : public PointKeyFrame {
 public:
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Point Interpolate (Point baseValue, double keyFrameProgress);
 
 protected:
 	/* @GeneratePInvoke */
@@ -705,7 +762,7 @@ public:
  	/* @PropertyType=KeySpline,AutoCreateValue,GenerateAccessors */
 	const static int KeySplineProperty;
 	
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual double Interpolate (double baseValue, double keyFrameProgress);
 	
 	//
 	// Property Accessors
@@ -731,7 +788,7 @@ public:
  	/* @PropertyType=KeySpline,AutoCreateValue,GenerateAccessors */
 	const static int KeySplineProperty;
 	
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Color Interpolate (Color baseValue, double keyFrameProgress);
 	
 	//
 	// Property Accessors
@@ -757,7 +814,7 @@ public:
  	/* @PropertyType=KeySpline,AutoCreateValue,GenerateAccessors */
 	const static int KeySplineProperty;
 	
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Point Interpolate (Point baseValue, double keyFrameProgress);
 	
 	//
 	// Property Accessors
@@ -781,7 +838,7 @@ public:
  	/* @PropertyType=EasingFunctionBase,ManagedPropertyType=IEasingFunction,GenerateAccessors */
 	const static int EasingFunctionProperty;
 	
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Color Interpolate (Color baseValue, double keyFrameProgress);
 	
 	//
 	// Property Accessors
@@ -805,7 +862,7 @@ public:
  	/* @PropertyType=EasingFunctionBase,ManagedPropertyType=IEasingFunction,GenerateAccessors */
 	const static int EasingFunctionProperty;
 	
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual double Interpolate (double baseValue, double keyFrameProgress);
 	
 	//
 	// Property Accessors
@@ -829,7 +886,7 @@ public:
  	/* @PropertyType=EasingFunctionBase,ManagedPropertyType=IEasingFunction,GenerateAccessors */
 	const static int EasingFunctionProperty;
 	
-	virtual Value *InterpolateValue (Value *baseValue, double keyFrameProgress);
+	virtual Point Interpolate (Point baseValue, double keyFrameProgress);
 	
 	//
 	// Property Accessors
@@ -27,6 +27,7 @@
 #include "runtime.h"
 #include "deployment.h"
 #include "utils.h"
+#include "zip-index.h"
 #include "uri.h"
 
 namespace Moonlight {
@@ -266,7 +267,8 @@ Application::GetResourceAsPath (const Uri *resourceBase, const Uri *uri)
 	char *dirname, *path;
 	char *canonicalized_filename;
 	ManagedStreamCallbacks stream;
-	unzFile zipfile;
+	unzFile zipfile = NULL;
+	ZipIndex *index;
 	struct stat st;
 	char buf[4096];
 	int nread;
@@ -334,14 +336,18 @@ Application::GetResourceAsPath (const Uri *resourceBase, const Uri *uri)
 	close (fd);
 	
 	// check to see if the resource is zipped
-	if (!(zipfile = unzOpen (path))) {
+	index = ZipIndex::Open (path);
+	if (!index && !(zipfile = unzOpen (path))) {
 		// nope, not zipped...
 		return path;
 	}
 	
 	// create a directory to contain our unzipped content
 	if (!(dirname = CreateTempDir (path))) {
-		unzClose (zipfile);
+		if (index)
+			delete index;
+		else
+			unzClose (zipfile);
 		g_free (dirname);
 		g_unlink (path);
 		g_free (path);
@@ -349,16 +355,22 @@ Application::GetResourceAsPath (const Uri *resourceBase, const Uri *uri)
 	}
 	
 	// unzip the contents
-	if (!ExtractAll (zipfile, dirname, CanonModeResource)) {
+	if (!(index ? ExtractAll (index, dirname, CanonModeResource) : ExtractAll (zipfile, dirname, CanonModeResource))) {
 		RemoveDir (dirname);
-		unzClose (zipfile);
+		if (index)
+			delete index;
+		else
+			unzClose (zipfile);
 		g_free (dirname);
 		g_unlink (path);
 		g_free (path);
 		return NULL;
 	}
 	
-	unzClose (zipfile);
+	if (index)
+		delete index;
+	else
+		unzClose (zipfile);
 	g_unlink (path);
 	
 	if (g_rename (dirname, path) == -1) {
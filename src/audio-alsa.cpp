@@ -51,6 +51,7 @@ typedef int               (dyn_snd_pcm_resume)                         (snd_pcm_
 typedef snd_pcm_sframes_t (dyn_snd_pcm_avail_update)                   (snd_pcm_t *pcm);
 typedef int               (dyn_snd_pcm_start)                          (snd_pcm_t *pcm);
 typedef int               (dyn_snd_pcm_delay)                          (snd_pcm_t *pcm, snd_pcm_sframes_t *delayp);
+typedef int               (dyn_snd_pcm_wait)                           (snd_pcm_t *pcm, int timeout);
 typedef const char *      (dyn_snd_strerror)                           (int errnum);
 typedef const char *      (dyn_snd_asoundlib_version)                  (void);
 
@@ -85,6 +86,7 @@ dyn_snd_pcm_resume *                         d_snd_pcm_resume = NULL;
 dyn_snd_pcm_avail_update *                   d_snd_pcm_avail_update = NULL;
 dyn_snd_pcm_start *                          d_snd_pcm_start = NULL;
 dyn_snd_pcm_delay *                          d_snd_pcm_delay = NULL;
+dyn_snd_pcm_wait *                           d_snd_pcm_wait = NULL;
 dyn_snd_asoundlib_version *                  d_snd_asoundlib_version = NULL;
 
 #define snd_pcm_open                           d_snd_pcm_open
@@ -119,8 +121,202 @@ dyn_snd_asoundlib_version *                  d_snd_asoundlib_version = NULL;
 #define snd_pcm_avail_update                   d_snd_pcm_avail_update
 #define snd_pcm_start                          d_snd_pcm_start
 #define snd_pcm_delay                          d_snd_pcm_delay
+#define snd_pcm_wait                           d_snd_pcm_wait
 #define snd_asoundlib_version                  d_snd_asoundlib_version
 
+/*
+ * AlsaSink
+ */
+
+AlsaSink::AlsaSink ()
+{
+	pcm = NULL;
+}
+
+AlsaSink::~AlsaSink ()
+{
+	Close ();
+}
+
+bool
+AlsaSink::Open (guint32 *rate, guint32 *channels)
+{
+	snd_pcm_hw_params_t *params = NULL;
+	guint32 buffer_time = 100000; // request 0.1 seconds of buffer time.
+	unsigned int actual_rate = *rate;
+	int dir = 0;
+	int err;
+
+	mutex.Lock ();
+
+	err = snd_pcm_open (&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
+	if (err != 0) {
+		LOG_AUDIO ("AlsaSink::Open (): cannot open audio device: %s\n", snd_strerror (err));
+		pcm = NULL;
+		mutex.Unlock ();
+		return false;
+	}
+
+	err = snd_pcm_hw_params_malloc (&params);
+	if (err < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (malloc): %s\n", snd_strerror (err));
+		goto cleanup;
+	}
+
+	if ((err = snd_pcm_hw_params_any (pcm, params)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (no configurations available): %s\n", snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params_set_rate_resample (pcm, params, 1)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (could not enable resampling): %s\n", snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params_set_access (pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (access type not available for playback): %s\n", snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params_set_format (pcm, params, SND_PCM_FORMAT_S16)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (sample format not available for playback): %s\n", snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params_set_channels (pcm, params, *channels)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (channels count %u not available for playback): %s\n", *channels, snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params_set_rate_near (pcm, params, &actual_rate, 0)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (sample rate %u Hz not available for playback): %s\n", *rate, snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params_set_buffer_time_near (pcm, params, &buffer_time, &dir)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (unable to set buffer time %u for playback: %s\n", buffer_time, snd_strerror (err));
+	} else if ((err = snd_pcm_hw_params (pcm, params)) < 0) {
+		LOG_AUDIO ("AlsaSink::Open (): Audio HW setup failed (unable to set hw params for playback: %s)\n", snd_strerror (err));
+	} else {
+		// the mixer resamples to whatever rate the device gave us
+		*rate = actual_rate;
+		LOG_AUDIO ("AlsaSink::Open (): Succeeded, %u Hz, %u channels, buffer time: %u us\n", *rate, *channels, buffer_time);
+	}
+
+	snd_pcm_hw_params_free (params);
+
+cleanup:
+	if (err < 0) {
+		snd_pcm_close (pcm);
+		pcm = NULL;
+	}
+	mutex.Unlock ();
+
+	return err >= 0;
+}
+
+void
+AlsaSink::Close ()
+{
+	mutex.Lock ();
+	if (pcm != NULL) {
+		snd_pcm_close (pcm);
+		pcm = NULL;
+	}
+	mutex.Unlock ();
+}
+
+bool
+AlsaSink::XrunRecovery (int err)
+{
+	// the mixer thread is the only thread which writes to the pcm,
+	// so there's no need to lock here.
+	switch (err) {
+	case -EPIPE: // under-run
+		err = snd_pcm_prepare (pcm);
+		if (err < 0)
+			LOG_AUDIO ("AlsaSink: Can't recover from underrun, prepare failed: %s.\n", snd_strerror (err));
+		break;
+	case -ESTRPIPE:
+		while ((err = snd_pcm_resume (pcm)) == -EAGAIN) {
+			LOG_AUDIO ("AlsaSink::XrunRecovery: waiting for resume\n");
+			sleep (1); // wait until the suspend flag is released
+		}
+		if (err < 0) {
+			err = snd_pcm_prepare (pcm);
+			if (err < 0)
+				LOG_AUDIO ("AlsaSink: Can't recover from suspend, prepare failed: %s.\n", snd_strerror (err));
+		}
+		break;
+	default:
+		LOG_AUDIO ("AlsaSink: Can't recover from underrun: %s\n", snd_strerror (err));
+		break;
+	}
+
+	return err >= 0;
+}
+
+guint32
+AlsaSink::Wait (guint32 max_frames)
+{
+	snd_pcm_sframes_t avail;
+
+	if (pcm == NULL)
+		return 0;
+
+	avail = snd_pcm_avail_update (pcm);
+	if (avail < 0) {
+		if (!XrunRecovery (avail))
+			return 0;
+		avail = snd_pcm_avail_update (pcm);
+	}
+
+	if (avail >= 0 && (snd_pcm_uframes_t) avail < max_frames) {
+		// Wait until the device has room for a full period. The pcm hasn't been started yet
+		// if it's in the prepared state, in which case there is room for the entire buffer.
+		if (snd_pcm_state (pcm) == SND_PCM_STATE_RUNNING)
+			snd_pcm_wait (pcm, 100);
+		avail = snd_pcm_avail_update (pcm);
+	}
+
+	if (avail < 0) {
+		XrunRecovery (avail);
+		return 0;
+	}
+
+	return MIN ((guint32) avail, max_frames);
+}
+
+bool
+AlsaSink::Write (const gint16 *samples, guint32 frames)
+{
+	snd_pcm_sframes_t result;
+
+	if (pcm == NULL)
+		return false;
+
+	result = snd_pcm_writei (pcm, samples, frames);
+	if (result < 0) {
+		if (!XrunRecovery (result))
+			return false;
+		result = snd_pcm_writei (pcm, samples, frames);
+	}
+
+	LOG_ALSA_EX ("AlsaSink::Write (%u): result: %i\n", frames, (int) result);
+
+	return result >= 0;
+}
+
+void
+AlsaSink::Drop ()
+{
+	mutex.Lock ();
+	if (pcm != NULL && snd_pcm_state (pcm) == SND_PCM_STATE_RUNNING) {
+		snd_pcm_drop (pcm);
+		snd_pcm_prepare (pcm);
+	}
+	mutex.Unlock ();
+}
+
+guint64
+AlsaSink::GetDelay ()
+{
+	snd_pcm_sframes_t delay = 0;
+	int err = -1;
+
+	mutex.Lock ();
+	if (pcm != NULL)
+		err = snd_pcm_delay (pcm, &delay);
+	mutex.Unlock ();
+
+	if (err < 0 || delay < 0)
+		return 0;
+
+	return delay;
+}
+
 /*
  * AlsaSource
  */
@@ -889,6 +1085,7 @@ AlsaPlayer::IsInstalled ()
 		result &= NULL != (d_snd_pcm_avail_update = (dyn_snd_pcm_avail_update *) dlsym (libalsa, "snd_pcm_avail_update"));
 		result &= NULL != (d_snd_pcm_start = (dyn_snd_pcm_start *) dlsym (libalsa, "snd_pcm_start"));
 		result &= NULL != (d_snd_pcm_delay = (dyn_snd_pcm_delay *) dlsym (libalsa, "snd_pcm_delay"));
+		result &= NULL != (d_snd_pcm_wait = (dyn_snd_pcm_wait *) dlsym (libalsa, "snd_pcm_wait"));
 		result &= NULL != (d_snd_asoundlib_version = (dyn_snd_asoundlib_version *) dlsym (libalsa, "snd_asoundlib_version"));
 		result &= NULL != (d_snd_strerror = (dyn_snd_strerror *) dlsym (libalsa, "snd_strerror"));
 
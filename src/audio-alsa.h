@@ -19,6 +19,7 @@
 #include <asoundlib.h>
 
 #include "audio.h"
+#include "audio-mixer.h"
 
 namespace Moonlight {
 
@@ -83,6 +84,26 @@ class AlsaSource : public AudioSource {
 	void DropAlsa ();
 };
 
+// A single pcm stream for the MixerPlayer to write the mixed audio to.
+class AlsaSink : public AudioSink {
+	snd_pcm_t *pcm;
+	MoonMutex mutex;
+
+	bool XrunRecovery (int err);
+
+ public:
+	AlsaSink ();
+	virtual ~AlsaSink ();
+
+	virtual bool Open (guint32 *rate, guint32 *channels);
+	virtual void Close ();
+	virtual guint32 Wait (guint32 max_frames);
+	virtual bool Write (const gint16 *samples, guint32 frames);
+	virtual void Drop ();
+	virtual guint64 GetDelay ();
+	virtual const char *GetName () { return "alsa"; }
+};
+
 class AlsaPlayer : public AudioPlayer {
 	// The audio thread	
 	MoonThread *audio_thread;
@@ -0,0 +1,909 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-mixer.cpp:
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#if HAVE_SSE2 && defined (__SSE2__)
+#include <emmintrin.h>
+#define MIXER_USE_SSE2 1
+#endif
+
+#include "audio-mixer.h"
+#include "timesource.h"
+#include "runtime.h"
+#include "debug.h"
+#include "cpu.h"
+
+namespace Moonlight {
+
+/*
+ * NullAudioSink
+ */
+
+NullAudioSink::NullAudioSink (bool paced)
+{
+	this->paced = paced;
+	rate = 0;
+	buffer_frames = 0;
+	start_time = 0;
+	frames_written = 0;
+}
+
+bool
+NullAudioSink::Open (guint32 *rate, guint32 *channels)
+{
+	// we accept any format
+	mutex.Lock ();
+	this->rate = *rate;
+	buffer_frames = *rate / 10; // 100 ms
+	start_time = 0;
+	frames_written = 0;
+	mutex.Unlock ();
+	return true;
+}
+
+void
+NullAudioSink::Close ()
+{
+	Drop ();
+}
+
+guint64
+NullAudioSink::GetFramesPlayed (TimeSpan now)
+{
+	guint64 played;
+
+	// must be called with the mutex held
+	if (start_time == 0)
+		return 0;
+
+	played = (guint64) (now - start_time) * rate / 10000000;
+	return MIN (played, frames_written);
+}
+
+guint32
+NullAudioSink::Wait (guint32 max_frames)
+{
+	guint64 queued;
+	guint32 space;
+
+	if (!paced)
+		return max_frames;
+
+	mutex.Lock ();
+	queued = frames_written - GetFramesPlayed (get_now ());
+	space = queued >= buffer_frames ? 0 : buffer_frames - queued;
+	mutex.Unlock ();
+
+	if (space < max_frames) {
+		// sleep until there's room for max_frames (or as close as we can get)
+		g_usleep ((guint64) (MIN (max_frames, buffer_frames) - space) * 1000000 / rate);
+
+		mutex.Lock ();
+		queued = frames_written - GetFramesPlayed (get_now ());
+		space = queued >= buffer_frames ? 0 : buffer_frames - queued;
+		mutex.Unlock ();
+	}
+
+	return MIN (space, max_frames);
+}
+
+bool
+NullAudioSink::Write (const gint16 *samples, guint32 frames)
+{
+	TimeSpan now;
+
+	if (!paced)
+		return true;
+
+	mutex.Lock ();
+	now = get_now ();
+	if (GetFramesPlayed (now) == frames_written) {
+		// underrun (or the first write), restart the clock.
+		start_time = now;
+		frames_written = 0;
+	}
+	frames_written += frames;
+	mutex.Unlock ();
+
+	return true;
+}
+
+void
+NullAudioSink::Drop ()
+{
+	mutex.Lock ();
+	start_time = 0;
+	frames_written = 0;
+	mutex.Unlock ();
+}
+
+guint64
+NullAudioSink::GetDelay ()
+{
+	guint64 result;
+
+	if (!paced)
+		return 0;
+
+	mutex.Lock ();
+	result = frames_written - GetFramesPlayed (get_now ());
+	mutex.Unlock ();
+
+	return result;
+}
+
+/*
+ * FileAudioSink
+ */
+
+FileAudioSink::FileAudioSink (const char *filename)
+	: NullAudioSink (true)
+{
+	this->filename = g_strdup (filename);
+	fd = NULL;
+	channels = 0;
+}
+
+FileAudioSink::~FileAudioSink ()
+{
+	Close ();
+	g_free (filename);
+}
+
+bool
+FileAudioSink::Open (guint32 *rate, guint32 *channels)
+{
+	if (!NullAudioSink::Open (rate, channels))
+		return false;
+
+	fd = fopen (filename, "w");
+	if (fd == NULL) {
+		LOG_AUDIO ("FileAudioSink::Open (): could not open '%s': %s\n", filename, strerror (errno));
+		return false;
+	}
+
+	this->channels = *channels;
+
+	printf ("AudioPlayer: Dumping mixed pcm data to: %s, command line to play:\n", filename);
+	printf ("play -s -t raw -2 -c %u --rate %u %s\n", *channels, *rate, filename);
+
+	return true;
+}
+
+void
+FileAudioSink::Close ()
+{
+	if (fd != NULL) {
+		fclose (fd);
+		fd = NULL;
+	}
+	NullAudioSink::Close ();
+}
+
+bool
+FileAudioSink::Write (const gint16 *samples, guint32 frames)
+{
+	if (fd != NULL && fwrite (samples, sizeof (gint16) * channels, frames, fd) != frames) {
+		LOG_AUDIO ("FileAudioSink::Write (): could not write to '%s': %s\n", filename, strerror (errno));
+		return false;
+	}
+
+	return NullAudioSink::Write (samples, frames);
+}
+
+/*
+ * MixerSource
+ */
+
+MixerSource::MixerSource (MixerPlayer *player, MediaPlayer *mplayer, AudioStream *stream)
+	: AudioSource (Type::MIXERSOURCE, player, mplayer, stream), mutex (true)
+{
+	LOG_AUDIO ("MixerSource::MixerSource (%p, %p)\n", player, stream);
+
+	this->player = player;
+
+	input = NULL;
+	input_size = 0;
+	input_frames = 0;
+	position = 0;
+	step = 0;
+	resampled = NULL;
+	resampled_size = 0;
+
+	device_rate = 0;
+	device_channels = 0;
+
+	underflowed = false;
+	resets = 0;
+	closed = false;
+
+	next = NULL;
+	mixed_period = 0;
+}
+
+MixerSource::~MixerSource ()
+{
+	LOG_AUDIO ("MixerSource::~MixerSource ()\n");
+
+	g_free (input);
+	g_free (resampled);
+}
+
+bool
+MixerSource::InitializeInternal ()
+{
+	device_rate = player->GetRate ();
+	device_channels = player->GetChannels ();
+
+	if (device_rate == 0 || device_channels == 0 || GetChannels () == 0 || GetSampleRate () == 0) {
+		LOG_AUDIO ("MixerSource::InitializeInternal (): invalid format (%u Hz, %u channels -> %u Hz, %u channels)\n",
+			GetSampleRate (), GetChannels (), device_rate, device_channels);
+		return false;
+	}
+
+	// we always mix from 16bit samples.
+	SetOutputBytesPerSample (2);
+
+	step = ((guint64) GetSampleRate () << 32) / device_rate;
+
+	LOG_AUDIO ("MixerSource::InitializeInternal (): %u Hz, %u channels -> %u Hz, %u channels\n",
+		GetSampleRate (), GetChannels (), device_rate, device_channels);
+
+	return true;
+}
+
+void
+MixerSource::CloseInternal ()
+{
+	MixerSource *queued;
+
+	Reset ();
+
+	mutex.Lock ();
+	closed = true;
+	queued = next;
+	next = NULL;
+	mutex.Unlock ();
+
+	if (queued != NULL)
+		queued->unref ();
+}
+
+bool
+MixerSource::SetNext (MixerSource *value)
+{
+	MixerSource *old;
+
+	mutex.Lock ();
+	if (closed) {
+		mutex.Unlock ();
+		return false;
+	}
+	old = next;
+	next = value;
+	if (next != NULL)
+		next->ref ();
+	mutex.Unlock ();
+
+	if (old != NULL)
+		old->unref ();
+
+	return true;
+}
+
+MixerSource *
+MixerSource::TakeNext ()
+{
+	MixerSource *result;
+
+	mutex.Lock ();
+	result = next;
+	next = NULL;
+	mutex.Unlock ();
+
+	if (result != NULL) {
+		result->mutex.Lock ();
+		if (result->closed) {
+			// removed (by the playlist giving up on its entry) before we got here
+			result->mutex.Unlock ();
+			result->unref ();
+			return NULL;
+		}
+		result->mutex.Unlock ();
+	}
+
+	return result;
+}
+
+void
+MixerSource::Reset ()
+{
+	mutex.Lock ();
+	input_frames = 0;
+	position = 0;
+	underflowed = false;
+	resets++;
+	mutex.Unlock ();
+}
+
+void
+MixerSource::Stopped ()
+{
+	Reset ();
+}
+
+void
+MixerSource::Played ()
+{
+	player->WakeUp ();
+}
+
+void
+MixerSource::EnsureInput (guint32 frames)
+{
+	// must be called with the mutex held
+	if (input_size >= frames)
+		return;
+
+	input_size = MAX (frames, input_size * 2);
+	input = (gint16 *) g_realloc (input, input_size * GetChannels () * sizeof (gint16));
+}
+
+guint64
+MixerSource::GetDelayInternal ()
+{
+	guint64 pending;
+	guint64 consumed;
+
+	mutex.Lock ();
+	consumed = position >> 32;
+	pending = input_frames > consumed ? input_frames - consumed : 0;
+	mutex.Unlock ();
+
+	// samples we've pulled but not mixed yet + mixed samples the device hasn't played yet
+	return pending * 10000000 / GetSampleRate () + player->GetSinkDelay () * 10000000 / device_rate;
+}
+
+guint32
+MixerSource::Mix (float *mix, guint32 frames)
+{
+	guint32 channels = GetChannels ();
+	gint32 *volumes = (gint32 *) g_alloca (sizeof (gint32) * channels);
+	float *gains = (float *) g_alloca (sizeof (float) * device_channels);
+	guint32 result = 0;
+	guint32 needed;
+	guint32 written = 0;
+	guint32 available;
+	guint32 reset_count;
+	guint64 consumed;
+	bool call_underflowed = false;
+
+	if (!GetChannelVolumes (volumes))
+		return 0;
+
+	// Map the source channels onto the device channels: extra device channels
+	// get the last source channel (mono is played on both speakers), extra
+	// source channels are dropped.
+	for (guint32 c = 0; c < device_channels; c++)
+		gains [c] = volumes [MIN (c, channels - 1)] / 8192.0f;
+
+	mutex.Lock ();
+
+	// Pull enough input to produce the requested output
+	// (including the neighbour sample needed for interpolation).
+	needed = (guint32) ((position + (guint64) frames * step) >> 32) + 1;
+	EnsureInput (needed);
+	available = input_frames;
+	reset_count = resets;
+
+	mutex.Unlock ();
+
+	// WriteUnscaled takes the AudioSource lock, which is held by the threads
+	// calling GetDelayInternal, so pull without holding our own lock. Only
+	// this thread touches the input buffer itself (a Reset just empties it).
+	if (available < needed)
+		written = WriteUnscaled (input + available * channels, needed - available);
+
+	mutex.Lock ();
+
+	// if the source was reset while we were pulling, the input is stale
+	if (reset_count == resets)
+		input_frames += written;
+
+	if (step == ((guint64) 1 << 32) && channels == device_channels) {
+		// Same format as the device, mix straight from the input buffer.
+		guint32 index = position >> 32;
+
+		result = index < input_frames ? MIN (frames, input_frames - index) : 0;
+		MixerPlayer::MixSamples (mix, input + index * channels, gains, channels, result * channels);
+		position += (guint64) result << 32;
+	} else {
+		guint32 samples = frames * device_channels;
+
+		if (resampled_size < samples) {
+			resampled_size = samples;
+			resampled = (float *) g_realloc (resampled, resampled_size * sizeof (float));
+		}
+
+		result = MixerPlayer::Resample (resampled, input, input_frames, channels, device_channels, &position, step, frames);
+		MixerPlayer::MixSamples (mix, resampled, gains, device_channels, result * device_channels);
+	}
+
+	// Throw away the input we've consumed
+	consumed = MIN (position >> 32, (guint64) input_frames);
+	if (consumed > 0) {
+		memmove (input, input + consumed * channels, (input_frames - consumed) * channels * sizeof (gint16));
+		input_frames -= consumed;
+		position -= consumed << 32;
+	}
+
+	// Notify once when we run dry, just like the device backends
+	// do when the device has played all the samples we wrote.
+	if (result == 0) {
+		call_underflowed = !underflowed;
+		underflowed = true;
+	} else {
+		underflowed = false;
+	}
+
+	mutex.Unlock ();
+
+	if (call_underflowed)
+		Underflowed ();
+
+	return result;
+}
+
+/*
+ * MixerPlayer
+ */
+
+MixerPlayer::MixerPlayer (AudioSink *sink)
+{
+	LOG_AUDIO ("MixerPlayer::MixerPlayer (%s)\n", sink->GetName ());
+
+	this->sink = sink;
+	audio_thread = NULL;
+	shutdown = false;
+	wakeup_pending = false;
+
+	rate = 44100;
+	channels = 2;
+	period_frames = 0;
+	mix_buffer = NULL;
+	output_buffer = NULL;
+	period = 0;
+
+	periods_mixed = 0;
+	frames_mixed = 0;
+	sources_mixed = 0;
+	mix_time = 0;
+	max_mix_time = 0;
+}
+
+MixerPlayer::~MixerPlayer ()
+{
+	LOG_AUDIO ("MixerPlayer::~MixerPlayer ()\n");
+
+	delete sink;
+	g_free (mix_buffer);
+	g_free (output_buffer);
+}
+
+bool
+MixerPlayer::Initialize ()
+{
+	int result;
+
+	if (!sink->Open (&rate, &channels)) {
+		LOG_AUDIO ("MixerPlayer::Initialize (): could not open the %s sink.\n", sink->GetName ());
+		return false;
+	}
+
+	// mix in periods of 20 ms
+	period_frames = MAX (rate / 50, 1);
+	mix_buffer = (float *) g_malloc (period_frames * channels * sizeof (float));
+	output_buffer = (gint16 *) g_malloc (period_frames * channels * sizeof (gint16));
+
+	result = MoonThread::Start (&audio_thread, Loop, this);
+	if (result != 0) {
+		LOG_AUDIO ("MixerPlayer::Initialize (): could not create audio thread (error code: %i = '%s').\n", result, strerror (result));
+		return false;
+	}
+
+	LOG_AUDIO ("MixerPlayer::Initialize (): mixing at %u Hz, %u channels into the %s sink.\n", rate, channels, sink->GetName ());
+
+	return true;
+}
+
+AudioSink *
+MixerPlayer::CreateHeadlessSink ()
+{
+	const char *env = g_getenv ("MOONLIGHT_AUDIO_SINK");
+
+	if (env == NULL)
+		return NULL;
+
+	if (!strcmp (env, "null"))
+		return new NullAudioSink (true);
+
+	if (!strcmp (env, "null-unpaced"))
+		return new NullAudioSink (false);
+
+	if (!strncmp (env, "file:", 5) && env [5] != 0)
+		return new FileAudioSink (env + 5);
+
+	g_warning ("Moonlight: Unknown audio sink in MOONLIGHT_AUDIO_SINK: '%s' (expected 'null', 'null-unpaced' or 'file:<path>').\n", env);
+
+	return NULL;
+}
+
+AudioSource *
+MixerPlayer::CreateNode (MediaPlayer *mplayer, AudioStream *stream)
+{
+	return new MixerSource (this, mplayer, stream);
+}
+
+void
+MixerPlayer::AddInternal (AudioSource *node)
+{
+	WakeUp ();
+}
+
+void
+MixerPlayer::RemoveInternal (AudioSource *node)
+{
+	WakeUp ();
+}
+
+bool
+MixerPlayer::QueueNextInternal (AudioSource *current, AudioSource *next)
+{
+	// both were created by CreateNode
+	return ((MixerSource *) current)->SetNext ((MixerSource *) next);
+}
+
+void
+MixerPlayer::WakeUp ()
+{
+	mutex.Lock ();
+	wakeup_pending = true;
+	cond.Signal ();
+	mutex.Unlock ();
+}
+
+void
+MixerPlayer::PrepareShutdownInternal ()
+{
+	LOG_AUDIO ("MixerPlayer::PrepareShutdownInternal ().\n");
+
+	mutex.Lock ();
+	shutdown = true;
+	cond.Signal ();
+	mutex.Unlock ();
+
+	if (audio_thread != NULL) {
+		if (!audio_thread->Join ())
+			LOG_AUDIO ("MixerPlayer::PrepareShutdownInternal (): failed to join the audio thread.\n");
+		audio_thread = NULL;
+	}
+}
+
+void
+MixerPlayer::FinishShutdownInternal ()
+{
+	LOG_AUDIO ("MixerPlayer::FinishShutdownInternal ().\n");
+
+	sink->Close ();
+	PrintStats ();
+}
+
+void
+MixerPlayer::PrintStats ()
+{
+	double audio_seconds = rate > 0 ? (double) frames_mixed / rate : 0;
+	double mix_seconds = (double) mix_time / 10000000;
+
+	if (periods_mixed == 0)
+		return;
+
+#define MIXER_STATS "MixerPlayer: mixed %" G_GUINT64_FORMAT " periods (%.2f s of audio, %.2f sources/period) into the %s sink, " \
+	"mix time: %.2f ms total, %.1f us/period average, %.1f us max, %.0fx realtime.\n", \
+	periods_mixed, audio_seconds, (double) sources_mixed / periods_mixed, sink->GetName (), \
+	mix_seconds * 1000, (double) mix_time / 10 / periods_mixed, (double) max_mix_time / 10, \
+	mix_seconds > 0 ? audio_seconds / mix_seconds : 0.0
+
+	// always print when running with a headless sink (the sink was chosen to measure us)
+	if (g_getenv ("MOONLIGHT_AUDIO_SINK") != NULL) {
+		printf (MIXER_STATS);
+	} else {
+		LOG_AUDIO (MIXER_STATS);
+	}
+
+#undef MIXER_STATS
+}
+
+void *
+MixerPlayer::Loop (void *data)
+{
+	((MixerPlayer *) data)->Loop ();
+	return NULL;
+}
+
+void
+MixerPlayer::Loop ()
+{
+	MixerSource *source;
+	guint32 frames;
+	guint32 mixed;
+	TimeSpan start;
+	TimeSpan elapsed;
+	bool playing;
+
+	LOG_AUDIO ("MixerPlayer: entering audio loop.\n");
+
+	mutex.Lock ();
+	while (!shutdown) {
+		mutex.Unlock ();
+
+		// Check if there's anything to play at all (paused sources
+		// and sources waiting for data aren't enumerated)
+		playing = false;
+		sources.StartEnumeration ();
+		while ((source = (MixerSource *) sources.GetNext (true)) != NULL) {
+			playing = true;
+			source->unref ();
+		}
+
+		mutex.Lock ();
+		if (!playing) {
+			while (!shutdown && !wakeup_pending)
+				cond.Wait (mutex);
+			wakeup_pending = false;
+			continue;
+		}
+		mutex.Unlock ();
+
+		frames = sink->Wait (period_frames);
+		if (frames == 0) {
+			mutex.Lock ();
+			continue;
+		}
+
+		start = get_now ();
+
+		memset (mix_buffer, 0, frames * channels * sizeof (float));
+
+		period++;
+		mixed = 0;
+		sources.StartEnumeration ();
+		while ((source = (MixerSource *) sources.GetNext (true)) != NULL) {
+			if (MixSource (source, frames))
+				mixed++;
+			source->unref ();
+		}
+
+		mutex.Lock ();
+
+		if (mixed == 0) {
+			// None of the playing sources had any data. Sources which have run
+			// dry stop playing (and are woken up with Play), until then wait
+			// for a period instead of writing silence to the sink.
+			if (!shutdown && !wakeup_pending)
+				WaitPeriod ();
+			wakeup_pending = false;
+			continue;
+		}
+
+		mutex.Unlock ();
+
+		PackSamples (output_buffer, mix_buffer, frames * channels);
+
+		elapsed = get_now () - start;
+		periods_mixed++;
+		frames_mixed += frames;
+		sources_mixed += mixed;
+		mix_time += elapsed;
+		max_mix_time = MAX (max_mix_time, elapsed);
+
+		if (!sink->Write (output_buffer, frames))
+			LOG_AUDIO ("MixerPlayer::Loop (): could not write %u frames to the %s sink.\n", frames, sink->GetName ());
+
+		mutex.Lock ();
+	}
+	mutex.Unlock ();
+
+	LOG_AUDIO ("MixerPlayer: exiting audio loop.\n");
+}
+
+bool
+MixerPlayer::MixSource (MixerSource *source, guint32 frames)
+{
+	MixerSource *next;
+	guint32 result;
+
+	if (source->GetMixedPeriod () == period)
+		return false;
+	source->SetMixedPeriod (period);
+
+	result = source->Mix (mix_buffer, frames);
+
+	// If the source ended in this period, the source queued after it starts
+	// on the next sample (instead of a tick later, when its MediaPlayer
+	// gets around to playing it after our source's MediaPlayer finished).
+	if (result < frames && source->GetFlag (AudioEOF) && (next = source->TakeNext ()) != NULL) {
+		LOG_AUDIO ("MixerPlayer::MixSource (): source %p ended after %u of %u frames, starting %p.\n", source, result, frames, next);
+		next->Play ();
+		next->SetMixedPeriod (period);
+		result += next->Mix (mix_buffer + result * channels, frames - result);
+		next->unref ();
+	}
+
+	return result > 0;
+}
+
+void
+MixerPlayer::WaitPeriod ()
+{
+	GTimeVal now;
+	timespec ts;
+
+	// must be called with the mutex held
+	g_get_current_time (&now);
+	g_time_val_add (&now, (glong) ((guint64) period_frames * G_USEC_PER_SEC / rate));
+	ts.tv_sec = now.tv_sec;
+	ts.tv_nsec = now.tv_usec * 1000;
+
+	cond.TimedWait (mutex, &ts);
+}
+
+/*
+ * Mixing primitives
+ */
+
+bool MixerPlayer::use_sse2 = true;
+
+#if MIXER_USE_SSE2
+static inline bool
+can_use_sse2 (guint32 channels)
+{
+	// the gain pattern must repeat every 4 samples
+	return (channels == 1 || channels == 2 || channels == 4) && CPU::HaveSSE2 ();
+}
+
+static inline __m128
+load_gains (const float *gains, guint32 channels)
+{
+	switch (channels) {
+	case 1: return _mm_set1_ps (gains [0]);
+	case 2: return _mm_setr_ps (gains [0], gains [1], gains [0], gains [1]);
+	default: return _mm_loadu_ps (gains);
+	}
+}
+#endif
+
+void
+MixerPlayer::MixSamples (float *mix, const float *src, const float *gains, guint32 channels, guint32 samples)
+{
+	guint32 i = 0;
+
+#if MIXER_USE_SSE2
+	if (use_sse2 && can_use_sse2 (channels)) {
+		__m128 g = load_gains (gains, channels);
+
+		for (; i + 4 <= samples; i += 4) {
+			__m128 m = _mm_loadu_ps (mix + i);
+			m = _mm_add_ps (m, _mm_mul_ps (_mm_loadu_ps (src + i), g));
+			_mm_storeu_ps (mix + i, m);
+		}
+	}
+#endif
+
+	for (; i < samples; i++)
+		mix [i] += src [i] * gains [i % channels];
+}
+
+void
+MixerPlayer::MixSamples (float *mix, const gint16 *src, const float *gains, guint32 channels, guint32 samples)
+{
+	guint32 i = 0;
+
+#if MIXER_USE_SSE2
+	if (use_sse2 && can_use_sse2 (channels)) {
+		__m128 g = load_gains (gains, channels);
+
+		for (; i + 8 <= samples; i += 8) {
+			__m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+			// sign extend to 32bit
+			__m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 16);
+			__m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (s, s), 16);
+			__m128 m0 = _mm_loadu_ps (mix + i);
+			__m128 m1 = _mm_loadu_ps (mix + i + 4);
+
+			m0 = _mm_add_ps (m0, _mm_mul_ps (_mm_cvtepi32_ps (lo), g));
+			m1 = _mm_add_ps (m1, _mm_mul_ps (_mm_cvtepi32_ps (hi), g));
+			_mm_storeu_ps (mix + i, m0);
+			_mm_storeu_ps (mix + i + 4, m1);
+		}
+	}
+#endif
+
+	for (; i < samples; i++)
+		mix [i] += src [i] * gains [i % channels];
+}
+
+void
+MixerPlayer::PackSamples (gint16 *dest, const float *mix, guint32 samples)
+{
+	guint32 i = 0;
+	float value;
+
+#if MIXER_USE_SSE2
+	// _mm_cvtps_epi32 rounds to nearest even (the default MXCSR mode), like lrintf
+	if (use_sse2 && CPU::HaveSSE2 ()) {
+		__m128 max = _mm_set1_ps (32767.0f);
+		__m128 min = _mm_set1_ps (-32768.0f);
+
+		for (; i + 8 <= samples; i += 8) {
+			// clamp before converting, out of range values convert to 0x80000000
+			__m128i a = _mm_cvtps_epi32 (_mm_max_ps (min, _mm_min_ps (max, _mm_loadu_ps (mix + i))));
+			__m128i b = _mm_cvtps_epi32 (_mm_max_ps (min, _mm_min_ps (max, _mm_loadu_ps (mix + i + 4))));
+			_mm_storeu_si128 ((__m128i *) (dest + i), _mm_packs_epi32 (a, b));
+		}
+	}
+#endif
+
+	for (; i < samples; i++) {
+		value = CLAMP (mix [i], -32768.0f, 32767.0f);
+		dest [i] = (gint16) lrintf (value);
+	}
+}
+
+guint32
+MixerPlayer::Resample (float *out, const gint16 *input, guint32 input_frames, guint32 channels,
+		       guint32 device_channels, guint64 *position, guint64 step, guint32 frames)
+{
+	guint64 pos = *position;
+	guint32 result = 0;
+
+	// Linear interpolation between the two nearest input frames
+	while (result < frames) {
+		guint32 index = pos >> 32;
+		float frac = (float) (pos & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+		const gint16 *a, *b;
+
+		if (index + 1 >= input_frames)
+			break;
+
+		a = input + index * channels;
+		b = a + channels;
+		for (guint32 c = 0; c < device_channels; c++) {
+			guint32 sc = MIN (c, channels - 1);
+			out [c] = a [sc] + (b [sc] - a [sc]) * frac;
+		}
+
+		out += device_channels;
+		pos += step;
+		result++;
+	}
+
+	*position = pos;
+
+	return result;
+}
+
+};
@@ -0,0 +1,246 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * audio-mixer.h:
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __AUDIO_MIXER_H__
+#define __AUDIO_MIXER_H__
+
+#include <stdio.h>
+
+#include "audio.h"
+
+namespace Moonlight {
+
+class MixerPlayer;
+
+/*
+ * AudioSink: the device (or device stand-in) a MixerPlayer writes its
+ * single mixed stream to. All samples are signed 16bit interleaved.
+ * All methods are called on the mixer thread, except where noted.
+ */
+class AudioSink {
+ public:
+	virtual ~AudioSink () {}
+
+	// rate and channels are the requested format, on return they
+	// must contain the format the sink actually accepts.
+	virtual bool Open (guint32 *rate, guint32 *channels) = 0;
+	virtual void Close () = 0;
+
+	// Blocks until the sink can accept more data (or a short timeout expires),
+	// returns the number of frames which can be written without blocking
+	// (never more than max_frames).
+	virtual guint32 Wait (guint32 max_frames) = 0;
+
+	// Returns false if the data couldn't be written.
+	virtual bool Write (const gint16 *samples, guint32 frames) = 0;
+
+	// Throws away any queued samples.
+	virtual void Drop () {}
+
+	// Returns the number of frames written but not played yet.
+	// May be called from any thread.
+	virtual guint64 GetDelay () = 0;
+
+	virtual const char *GetName () = 0;
+};
+
+/*
+ * NullAudioSink: discards all samples. When paced it consumes samples in
+ * real time like a device with a 100ms buffer would, otherwise it accepts
+ * data as fast as the mixer can produce it (useful to measure mixing throughput).
+ */
+class NullAudioSink : public AudioSink {
+	MoonMutex mutex;
+	guint32 rate;
+	guint32 buffer_frames;
+	bool paced;
+	TimeSpan start_time;
+	guint64 frames_written;
+
+	guint64 GetFramesPlayed (TimeSpan now);
+
+ public:
+	NullAudioSink (bool paced);
+
+	virtual bool Open (guint32 *rate, guint32 *channels);
+	virtual void Close ();
+	virtual guint32 Wait (guint32 max_frames);
+	virtual bool Write (const gint16 *samples, guint32 frames);
+	virtual void Drop ();
+	virtual guint64 GetDelay ();
+	virtual const char *GetName () { return paced ? "null" : "null (unpaced)"; }
+};
+
+/*
+ * FileAudioSink: a paced NullAudioSink which also dumps the
+ * mixed stream as raw pcm data to a file.
+ */
+class FileAudioSink : public NullAudioSink {
+	char *filename;
+	FILE *fd;
+	guint32 channels;
+
+ public:
+	FileAudioSink (const char *filename);
+	virtual ~FileAudioSink ();
+
+	virtual bool Open (guint32 *rate, guint32 *channels);
+	virtual void Close ();
+	virtual bool Write (const gint16 *samples, guint32 frames);
+	virtual const char *GetName () { return "file"; }
+};
+
+class MixerSource : public AudioSource {
+	MixerPlayer *player;
+	MoonMutex mutex;
+
+	// Resampler state. The input buffer holds unscaled 16bit interleaved
+	// samples in the source format, position is the 32.32 fixed point
+	// offset (in frames) of the next output frame into the input buffer.
+	gint16 *input;
+	guint32 input_size; // in frames
+	guint32 input_frames; // number of valid frames in input
+	guint64 position;
+	guint64 step; // source frames per device frame, 32.32 fixed point
+	float *resampled;
+	guint32 resampled_size; // in samples
+
+	guint32 device_rate;
+	guint32 device_channels;
+
+	bool underflowed;
+	guint32 resets; // the number of Reset ()s, so that Mix can tell when the input it pulled is stale
+	bool closed;
+
+	MixerSource *next; // started on the sample after this source's last one (see AudioPlayer::QueueNext)
+	guint64 mixed_period; // the last period this source was mixed in (mixer thread only)
+
+	void EnsureInput (guint32 frames);
+	void Reset ();
+
+ protected:
+	virtual ~MixerSource ();
+
+	virtual void Played ();
+	virtual void Stopped ();
+	virtual guint64 GetDelayInternal ();
+	virtual bool InitializeInternal ();
+	virtual void CloseInternal ();
+
+ public:
+	/* @SkipFactories */
+	MixerSource (MixerPlayer *player, MediaPlayer *mplayer, AudioStream *stream);
+
+	// Resamples up to 'frames' frames to the device format, and adds them
+	// (scaled by volume and balance) to the float mix buffer.
+	// Returns the number of frames mixed.
+	guint32 Mix (float *mix, guint32 frames);
+
+	// Returns false if the source has been closed already.
+	bool SetNext (MixerSource *value);
+	// Returns the queued source (reffed, unless it has been closed since) and forgets it.
+	MixerSource *TakeNext ();
+
+	// A source is mixed at most once per period, a source which was started
+	// when the source before it ended has been mixed already.
+	guint64 GetMixedPeriod () { return mixed_period; }
+	void SetMixedPeriod (guint64 value) { mixed_period = value; }
+};
+
+/*
+ * MixerPlayer: mixes all the playing sources into one buffer and writes
+ * it to a single AudioSink, instead of opening one device stream per source.
+ */
+class MixerPlayer : public AudioPlayer {
+	AudioSink *sink;
+	MoonThread *audio_thread;
+	bool shutdown;
+	bool wakeup_pending;
+
+	MoonMutex mutex;
+	MoonCond cond;
+
+	guint32 rate;
+	guint32 channels;
+	guint32 period_frames;
+	float *mix_buffer;
+	gint16 *output_buffer;
+	guint64 period; // the number of mix passes (mixer thread only)
+
+	// statistics
+	guint64 periods_mixed;
+	guint64 frames_mixed;
+	guint64 sources_mixed;
+	TimeSpan mix_time;
+	TimeSpan max_mix_time;
+
+	void Loop ();
+	static void *Loop (void *data);
+	void WaitPeriod ();
+	bool MixSource (MixerSource *source, guint32 frames);
+
+	void PrintStats ();
+
+ protected:
+	virtual ~MixerPlayer ();
+
+	virtual void AddInternal (AudioSource *node);
+	virtual void RemoveInternal (AudioSource *node);
+	virtual bool QueueNextInternal (AudioSource *current, AudioSource *next);
+	virtual void PrepareShutdownInternal ();
+	virtual void FinishShutdownInternal ();
+	virtual bool Initialize ();
+	virtual AudioSource *CreateNode (MediaPlayer *mplayer, AudioStream *stream);
+
+ public:
+	// The player takes ownership of the sink.
+	MixerPlayer (AudioSink *sink);
+
+	guint32 GetRate () { return rate; }
+	guint32 GetChannels () { return channels; }
+	// Returns the number of frames queued in the sink.
+	guint64 GetSinkDelay () { return sink->GetDelay (); }
+
+	// Wakes up the mixer thread (if it's waiting for sources to start playing)
+	void WakeUp ();
+
+	// Creates the sink selected with MOONLIGHT_AUDIO_SINK (null, null-unpaced or
+	// file:<path>). Returns NULL if the variable isn't set.
+	static AudioSink *CreateHeadlessSink ();
+
+	/*
+	 * Mixing primitives, exposed so that they can be tested and benchmarked.
+	 */
+	// mix [i] += src [i] * gains [i % channels], for i in [0, samples)
+	static void MixSamples (float *mix, const float *src, const float *gains, guint32 channels, guint32 samples);
+	static void MixSamples (float *mix, const gint16 *src, const float *gains, guint32 channels, guint32 samples);
+	// Converts the float mix buffer to 16bit samples, with saturation,
+	// rounding halfway values to even on every code path.
+	static void PackSamples (gint16 *dest, const float *mix, guint32 samples);
+	// Interpolates up to @frames frames of @device_channels channels out of
+	// @input (@input_frames frames of @channels channels) starting at
+	// *@position and advancing by @step (both 32.32 fixed point, in input
+	// frames). Extra device channels get the last input channel, extra
+	// input channels are dropped. Returns the number of frames written.
+	static guint32 Resample (float *out, const gint16 *input, guint32 input_frames, guint32 channels,
+				 guint32 device_channels, guint64 *position, guint64 step, guint32 frames);
+
+	// Lets the tests compare the SSE2 and the scalar code paths.
+	static void SetUseSSE2 (bool value) { use_sse2 = value; }
+
+ private:
+	static bool use_sse2;
+};
+
+};
+
+#endif /* __AUDIO_MIXER_H__ */
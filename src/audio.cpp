@@ -13,6 +13,7 @@
 #include <config.h>
 
 #include "audio.h"
+#include "audio-mixer.h"
 #include "audio-alsa.h"
 #include "audio-pulse.h"
 #include "audio-opensles.h"
@@ -247,9 +248,9 @@ const char *
 AudioSource::GetFlagNames (AudioFlags flags)
 {
 	static char *flag_names = NULL;
-	const char *v [5];
+	const char *v [6];
 	int i = 0;
-	v [0] = v [1] = v [2] = v [3] = v [4] = NULL;
+	v [0] = v [1] = v [2] = v [3] = v [4] = v [5] = NULL;
 	
 	if (flags & AudioInitialized)
 		v [i++] = "Initialized";
@@ -263,6 +264,9 @@ AudioSource::GetFlagNames (AudioFlags flags)
 	if (flags & AudioEnded)
 		v [i++] = "Ended";
 	
+	if (flags & AudioQueued)
+		v [i++] = "Queued";
+	
 	g_free (flag_names);
 	flag_names = (char *) g_strjoinv (",", (gchar **) v);
 
@@ -515,7 +519,8 @@ AudioSource::Underflowed ()
 	
 	SetCurrentDeployment (false);
 	
-	mplayer = GetMediaPlayerReffed ();
+	// a queued source's MediaPlayer is still playing the media before ours
+	mplayer = GetFlag (AudioQueued) ? NULL : GetMediaPlayerReffed ();
 	
 	if (GetState () == AudioPlaying) {
 		if (GetFlag (AudioEOF)) {
@@ -559,12 +564,24 @@ AudioSource::Close ()
 
 guint32
 AudioSource::Write (void *dest, guint32 samples)
+{
+	return WriteInterleaved (dest, samples, true);
+}
+
+guint32
+AudioSource::WriteUnscaled (void *dest, guint32 samples)
+{
+	return WriteInterleaved (dest, samples, false);
+}
+
+guint32
+AudioSource::WriteInterleaved (void *dest, guint32 samples, bool apply_volume)
 {
 	AudioData **data = (AudioData **) g_alloca (sizeof (AudioData *) * (channels + 1));
-	guint32 result = 0;
+	AudioData *channel_data = (AudioData *) g_alloca (sizeof (AudioData) * channels);
 	
 	for (unsigned int i = 0; i < channels; i++)
-		data [i] = (AudioData *) g_malloc (sizeof (AudioData));
+		data [i] = &channel_data [i];
 	
 	data [0]->dest = dest;
 	data [0]->distance = GetOutputBytesPerFrame ();
@@ -574,23 +591,70 @@ AudioSource::Write (void *dest, guint32 samples)
 		data [i]->distance = data [0]->distance;
 	}
 	data [channels] = NULL;
-	result = WriteFull (data, samples);
 	
-	for (int i = 0; data [i] != NULL; i++) {
-		g_free (data [i]);
+	return WriteFullInternal (data, samples, apply_volume);
+}
+
+bool
+AudioSource::ComputeVolumes (gint32 *volumes)
+{
+	gint32 volume = this->volume * 8192;
+	double balance = this->balance;
+	bool muted = false; //this->muted;
+	
+	// Set the per-channel volume
+	if (channels > 2) {
+		// TODO: how does the balance work here?
+		// We probably need a channel map to figure out left and right
+		for (unsigned int i = 0; i < channels; i++) {
+			volumes [i] = muted ? 0.0 : volume;
+		}
+	} else if (channels == 2) {
+		if (muted) {
+			volumes [0] = volumes [1] = 0;
+		} else 	if (balance < 0.0) {
+			volumes [0] = volume;
+			volumes [1] = (1.0 + balance) * volume;
+		} else if (balance > 0.0) {
+			volumes [0] = (1.0 - balance) * volume;
+			volumes [1] = volume;
+		} else {
+			volumes [0] = volumes [1] = volume;
+		}
+	} else if (channels == 1) {
+		if (muted) {
+			volumes [0] = 0;
+		} else {
+			volumes [0] = volume;
+		}
+	} else {
+		return false;
 	}
 	
+	return true;
+}
+
+bool
+AudioSource::GetChannelVolumes (gint32 *volumes)
+{
+	bool result;
+	Lock ();
+	result = ComputeVolumes (volumes);
+	Unlock ();
 	return result;
 }
 
 guint32
 AudioSource::WriteFull (AudioData **channel_data, guint32 samples)
+{
+	return WriteFullInternal (channel_data, samples, true);
+}
+
+guint32
+AudioSource::WriteFullInternal (AudioData **channel_data, guint32 samples, bool apply_volume)
 {
 	guint32 channels = GetChannels ();
 	gint32 *volumes = (gint32 *) g_alloca (sizeof (gint32) * channels);
-	gint32 volume;
-	double balance;
-	bool muted;
 	gint16 **write_ptr = (gint16 **) g_alloca (sizeof (gint16 *) * channels);
 	guint32 result = 0;
 	guint32 bytes_per_frame = input_bytes_per_sample * channels;
@@ -629,40 +693,17 @@ AudioSource::WriteFull (AudioData **channel_data, guint32 samples)
 	
 	Lock ();
 	
-	volume = this->volume * 8192;
-	balance = this->balance;
-	muted = false; //this->muted;
-	
-	// Set the per-channel volume
-	if (channels > 2) {
-		// TODO: how does the balance work here?
-		// We probably need a channel map to figure out left and right
-		for (unsigned int i = 0; i < channels; i++) {
-			volumes [i] = muted ? 0.0 : volume;
-		}
-	} else if (channels == 2) {
-		if (muted) {
-			volumes [0] = volumes [1] = 0;
-		} else 	if (balance < 0.0) {
-			volumes [0] = volume;
-			volumes [1] = (1.0 + balance) * volume;
-		} else if (balance > 0.0) {
-			volumes [0] = (1.0 - balance) * volume;
-			volumes [1] = volume;
-		} else {
-			volumes [0] = volumes [1] = volume;
-		}
-	} else if (channels == 1) {
-		if (muted) {
-			volumes [0] = 0;
-		} else {
-			volumes [0] = volume;
-		}
-	} else {
+	if (!ComputeVolumes (volumes)) {
 		SetState (AudioError);
 		goto cleanup;
 	}
 	
+	if (!apply_volume) {
+		// The caller scales the samples itself
+		for (guint32 i = 0; i < channels; i++)
+			volumes [i] = 8192;
+	}
+	
 	for (guint32 i = 0; i < channels; i++)
 		write_ptr [i] = (gint16 *) channel_data [i]->dest;
 	
@@ -1112,6 +1153,23 @@ AudioPlayer::Remove (AudioSource *source)
 	}
 }
 
+bool
+AudioPlayer::QueueNext (AudioSource *current, AudioSource *next)
+{
+	AudioPlayer *inst;
+	bool result = false;
+	
+	LOG_AUDIO ("AudioPlayer::QueueNext (%p, %p)\n", current, next);
+	
+	inst = GetInstance ();
+	if (inst != NULL) {
+		result = inst->QueueNextInternal (current, next);
+		inst->unref ();
+	}
+	
+	return result;
+}
+
 void
 AudioPlayer::Shutdown ()
 {
@@ -1172,6 +1230,30 @@ AudioPlayer::CreatePlayer ()
 	
 	overridden  = moonlight_flags & (RUNTIME_INIT_AUDIO_PULSE | RUNTIME_INIT_AUDIO_ALSA | RUNTIME_INIT_AUDIO_OPENSLES | RUNTIME_INIT_AUDIO_ALSA_RW);
 
+	// A headless sink (MOONLIGHT_AUDIO_SINK) always wins, it's used to test and benchmark the mixer.
+	AudioSink *sink = MixerPlayer::CreateHeadlessSink ();
+#if INCLUDE_ALSA
+	if (sink == NULL && (moonlight_flags & RUNTIME_INIT_AUDIO_MIXER)) {
+		if (AlsaPlayer::IsInstalled ()) {
+			sink = new AlsaSink ();
+		} else {
+			LOG_AUDIO ("AudioPlayer: Alsa is not installed or configured correctly, can't use the mixer.\n");
+		}
+	}
+#endif
+
+	if (sink != NULL) {
+		printf ("AudioPlayer: Using the mixer with the %s sink.\n", sink->GetName ());
+		result = new MixerPlayer (sink);
+		if (!result->Initialize ()) {
+			LOG_AUDIO ("AudioPlayer: Failed initialization.\n");
+			result->unref ();
+			result = NULL;
+		} else {
+			return result;
+		}
+	}
+
 #if INCLUDE_OPENSLES
 	if (result != NULL) {
 		LOG_AUDIO ("AudioPlayer: Not checking for OpenSLES support, we already found support for another configuration.\n");
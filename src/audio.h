@@ -51,6 +51,10 @@ enum AudioFlags {
 	// The audio source has run out of data to write and has played all available samples.
 	// This flag is removed when Play/Pause/Stop/AppendFrame is called.
 	AudioEnded       = 1 << 3,
+	// The audio source has been queued to start when another source ends (AudioPlayer::QueueNext),
+	// and its MediaPlayer is still playing the media before it, so it isn't told when this source
+	// underflows or ends. This flag is removed when the MediaPlayer opens the source's media.
+	AudioQueued      = 1 << 4,
 };
 
 enum AudioState {
@@ -102,6 +106,12 @@ class AudioSource : public EventObject {
 	
 	MediaPlayer *GetMediaPlayerReffed ();
 	
+	// Computes the per-channel volume (8192 = 1.0) from the volume, balance and mute state.
+	// The caller must hold the lock. Returns false if the number of channels isn't supported.
+	bool ComputeVolumes (gint32 *volumes);
+	guint32 WriteInterleaved (void *dest, guint32 samples, bool apply_volume);
+	guint32 WriteFullInternal (AudioData **channel_data, guint32 samples, bool apply_volume);
+	
 	EVENTHANDLER (AudioSource, FirstFrameEnqueued, EventObject, EventArgs);
 	
 #ifdef DUMP_AUDIO
@@ -118,6 +128,9 @@ class AudioSource : public EventObject {
 	// frame: consists of 1 audio sample of input_bytes_per_sample bytes * number of channels
 	guint32 Write (void *dest, guint32 samples);
 	guint32 WriteFull (AudioData **channel_data /* Array of info about channels, NULL ended. */, guint32 samples);
+	// Same as Write, but volume and balance are not applied, the caller is expected
+	// to scale the samples itself (see GetChannelVolumes).
+	guint32 WriteUnscaled (void *dest, guint32 samples);
 	
 	virtual void Played () { }
 	virtual void Paused () { }
@@ -194,6 +207,11 @@ class AudioSource : public EventObject {
 	
 	bool GetMuted ();
 	void SetMuted (bool value);
+	
+	// Fills in the volume (8192 = 1.0) to apply to each channel, taking
+	// volume, balance and mute into account. volumes must have room for
+	// GetChannels () values. Returns false if the channel count isn't supported.
+	bool GetChannelVolumes (gint32 *volumes);
 
 	void SetAudioStream (AudioStream *value);
 	AudioStream *GetAudioStream ();
@@ -302,6 +320,8 @@ class AudioPlayer {
 	// called after the node has been removed from the list of sources, but before the node is deleted.			
 	// not called if the node isn't in the list of sources.
 	virtual void RemoveInternal (AudioSource *node) = 0;
+	// see QueueNext. Backends which can't start a source at an exact sample return false.
+	virtual bool QueueNextInternal (AudioSource *current, AudioSource *next) { return false; }
 	 // called just after ctor. 
 	virtual bool Initialize () = 0;
 	// before all the nodes will be removedthis method is called
@@ -324,6 +344,10 @@ class AudioPlayer {
 	static AudioSource *Add (MediaPlayer *mplayer, AudioStream *stream);
 	// Removes an audio source.
 	static void Remove (AudioSource *source);
+	// Starts next (which must not be playing yet) on the sample after the last one
+	// current plays, so that there's no gap between them. Returns false if the
+	// backend can't, next is then played when its MediaPlayer plays it.
+	static bool QueueNext (AudioSource *current, AudioSource *next);
 	// Shuts down the audio engine
 	static void Shutdown ();
 	// Creates audio recorders, one per device we can record from
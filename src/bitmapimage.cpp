@@ -35,123 +35,15 @@
 
 namespace Moonlight {
 
-#ifdef WORDS_BIGENDIAN
-#define set_pixel_bgra(pixel,index,b,g,r,a) \
-	G_STMT_START { \
-		((unsigned char *)(pixel))[index]   = a; \
-		((unsigned char *)(pixel))[index+1] = r; \
-		((unsigned char *)(pixel))[index+2] = g; \
-		((unsigned char *)(pixel))[index+3] = b; \
-	} G_STMT_END
-#define get_pixel_bgr_p(p,b,g,r) \
-	G_STMT_START { \
-		r = *(p);   \
-		g = *(p+1); \
-		b = *(p+2); \
-	} G_STMT_END
-#else
-#define set_pixel_bgra(pixel,index,b,g,r,a) \
-	G_STMT_START { \
-		((unsigned char *)(pixel))[index]   = b; \
-		((unsigned char *)(pixel))[index+1] = g; \
-		((unsigned char *)(pixel))[index+2] = r; \
-		((unsigned char *)(pixel))[index+3] = a; \
-	} G_STMT_END
-#define get_pixel_bgr_p(p,b,g,r) \
-	G_STMT_START { \
-		b = *(p);   \
-		g = *(p+1); \
-		r = *(p+2); \
-	} G_STMT_END
-#endif
-#define get_pixel_bgra(color, b, g, r, a) \
-	G_STMT_START { \
-		a = *(p+3);	\
-		r = *(p+2);	\
-		g = *(p+1);	\
-		b = *(p+0);	\
-	} G_STMT_END
-#include "alpha-premul-table.inc"
-
-//
-// Expands RGB to ARGB allocating new buffer for it.
-//
-static gpointer
-expand_rgb_to_argb (MoonPixbuf *pixbuf)
-{
-	guchar *pb_pixels = pixbuf->GetPixels ();
-	guchar *p;
-	int w = pixbuf->GetWidth ();
-	int h = pixbuf->GetHeight ();
-	int stride = w * 4;
-	guchar *data = (guchar *) g_malloc (stride * h);
-	guchar *out;
-
-	for (int y = 0; y < h; y ++) {
-		p = pb_pixels + y * pixbuf->GetRowStride ();
-		out = data + y * (stride);
-		for (int x = 0; x < w; x ++) {
-			guchar r, g, b;
-
-			get_pixel_bgr_p (p, b, g, r);
-			set_pixel_bgra (out, 0, r, g, b, 255);
-
-			p += 3;
-			out += 4;
-		}
-	}
-
-	return (gpointer) data;
-}
-
-//
-// Converts RGBA unmultiplied alpha to ARGB pre-multiplied alpha.
-//
-static gpointer
-premultiply_rgba (MoonPixbuf *pixbuf)
-{
-	guchar *pb_pixels = pixbuf->GetPixels ();
-	guchar *p;
-	int w = pixbuf->GetWidth ();
-	int h = pixbuf->GetHeight ();
-	int stride = w * 4;
-	guchar *data = (guchar *) g_malloc (stride * h);
-	guchar *out;
-
-	for (int y = 0; y < h; y ++) {
-		p = pb_pixels + y * pixbuf->GetRowStride ();
-		out = data + y * (stride);
-		for (int x = 0; x < w; x ++) {
-			guchar r, g, b, a;
-
-			get_pixel_bgra (p, b, g, r, a);
-
-			/* pre-multipled alpha */
-			if (a == 0) {
-				r = g = b = 0;
-			}
-			else if (a < 255) {
-				r = pre_multiplied_table [r][a];
-				g = pre_multiplied_table [g][a];
-				b = pre_multiplied_table [b][a];
-			}
-
-			/* store it back, swapping red and blue */
-			set_pixel_bgra (out, 0, r, g, b, a);
-
-			p += 4;
-			out += 4;
-		}
-	}
-
-	return (gpointer) data;
-}
-
 BitmapImage::BitmapImage ()
 {
 	SetObjectType (Type::BITMAPIMAGE);
 	downloader = NULL;
 	loader = NULL;
+	encoded = NULL;
+	decode_job = NULL;
+	decode_width = 0;
+	decode_height = 0;
 	moon_error = NULL;
 	part_name = NULL;
 	get_res_aborter = NULL;
@@ -191,6 +83,22 @@ BitmapImage::Abort ()
 
 	if (get_res_aborter)
 		get_res_aborter->Cancel ();	
+
+	CancelDecode ();
+}
+
+void
+BitmapImage::CancelDecode ()
+{
+	if (decode_job) {
+		ImageDecoder::Cancel (decode_job);
+		decode_job = NULL;
+	}
+
+	if (encoded) {
+		g_byte_array_free (encoded, true);
+		encoded = NULL;
+	}
 }
 
 void
@@ -372,7 +280,8 @@ BitmapImage::DownloaderComplete ()
 		get_res_aborter = NULL;
 	}
 
-	PixmapComplete ();
+	// don't block the main thread while decoding downloaded images
+	Decode (true);
 
 	return;
 failed:
@@ -401,53 +310,75 @@ failed:
 void
 BitmapImage::PixmapComplete ()
 {
-	MoonPixbuf *pixbuf;
-	
+	// the managed code which calls this expects the image to have been
+	// decoded (and PixelWidth set) when it returns
+	Decode (false);
+}
+
+void
+BitmapImage::Decode (bool async)
+{
+	ImageDecodeJob *job;
+
 	SetProgress (1.0);
 
-	if (!loader) {
+	if (!loader || moon_error) {
 		if (!moon_error)
 			moon_error = new MoonError (MoonError::EXCEPTION, 4001, "no loader");
-		goto failed;
+		EmitImageFailed ();
+		return;
 	}
 
-	loader->Close (moon_error == NULL ? &moon_error : NULL);
+	if (decode_job) {
+		ImageDecoder::Cancel (decode_job);
+		decode_job = NULL;
+	}
 
-	if (moon_error)
-		goto failed;
+	job = new ImageDecodeJob (this, loader, encoded);
+	job->max_width = decode_width;
+	job->max_height = decode_height;
+	loader = NULL;
+	encoded = NULL;
 
-	if (!(pixbuf = loader->GetPixbuf ())) {
-		moon_error = new MoonError (MoonError::EXCEPTION, 4001, "failed to create image data");
-		goto failed;
+	if (async && ImageDecoder::AddWork (job)) {
+		decode_job = job;
+		return;
 	}
-	
-	SetPixelWidth (pixbuf->GetWidth ());
-	SetPixelHeight (pixbuf->GetHeight ());
-	
-	// PixelFormat has been dropped and only Pbgra32 is supported
-	// http://blogs.msdn.com/silverlight_sdk/archive/2009/07/01/breaking-changes-document-errata-silverlight-3.aspx
-	// not clear if '3' channel is still supported (converted to 4) in SL3
-	if (pixbuf->GetNumChannels () == 4) {
-		if (pixbuf->IsPremultiplied ()) {
-			SetBitmapData (pixbuf->GetPixels (), true);
-		} else {
-			SetBitmapData (premultiply_rgba (pixbuf), true);
-		}
-	} else {
-		SetBitmapData (expand_rgb_to_argb (pixbuf), true);
+
+	job->Decode ();
+	DecodeCompleted (job);
+	delete job;
+}
+
+void
+BitmapImage::DecodeCompleted (ImageDecodeJob *job)
+{
+	if (decode_job == job)
+		decode_job = NULL;
+
+	if (job->error) {
+		delete moon_error;
+		moon_error = job->error;
+		job->error = NULL;
+		EmitImageFailed ();
+		return;
 	}
-	
+
+	SetPixelWidth (job->width);
+	SetPixelHeight (job->height);
+
+	SetBitmapData (job->pixels, true);
+	job->pixels = NULL;
+
 	Invalidate ();
-	
-	delete loader;
-	loader = NULL;
-	
+
 	if (HasHandlers (ImageOpenedEvent))
 		Emit (ImageOpenedEvent, MoonUnmanagedFactory::CreateRoutedEventArgs ());
-	
-	return;
-	
-failed:
+}
+
+void
+BitmapImage::EmitImageFailed ()
+{
 	ImageErrorEventArgs *args = new ImageErrorEventArgs (this, *moon_error);
 
 	CleanupLoader ();
@@ -493,6 +424,8 @@ BitmapImage::CleanupLoader ()
 		delete loader;
 		loader = NULL;
 	}
+
+	CancelDecode ();
 	
 	if (moon_error) {
 		delete moon_error;
@@ -628,8 +561,13 @@ BitmapImage::PixbufWrite (gpointer buffer, gint32 offset, gint32 n)
 	if (loader == NULL && offset == 0)
 		CreateLoader ((unsigned char *)buffer);
 
-	if (loader != NULL && moon_error == NULL)
-		loader->Write ((const guchar *)buffer, n, &moon_error);
+	// the data is decoded all at once when it's complete, usually on
+	// ImageDecoder's threads
+	if (loader != NULL && moon_error == NULL) {
+		if (encoded == NULL)
+			encoded = g_byte_array_new ();
+		g_byte_array_append (encoded, (const guint8 *) buffer, n);
+	}
 }
 
 void
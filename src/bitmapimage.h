@@ -18,6 +18,7 @@
 #include "dependencyobject.h"
 #include "downloader.h"
 #include "bitmapsource.h"
+#include "image-decoder.h"
 
 namespace Moonlight {
 
@@ -26,11 +27,19 @@ class BitmapImage : public BitmapSource {
  private:
 	Downloader *downloader;
 	MoonPixbufLoader *loader;
+	GByteArray *encoded; // the data written to the loader, decoded once it's complete
+	ImageDecodeJob *decode_job;
+	int decode_width;
+	int decode_height;
 	MoonError *moon_error;
 	char *part_name;
 	Cancellable *get_res_aborter;
 	DownloaderAccessPolicy policy;
 
+	void Decode (bool async);
+	void CancelDecode ();
+	void EmitImageFailed ();
+
  protected:
 	/* @GeneratePInvoke */
 	BitmapImage ();
@@ -63,13 +72,26 @@ class BitmapImage : public BitmapSource {
 	{ 
 		policy = dlpolicy;
 	}
-	
+
+	// Decode images which don't fit in @max_width x @max_height (0 for no
+	// limit) at a lower resolution. PixelWidth and PixelHeight are the size
+	// of the decoded image. Only images decoded after the call are affected.
+	void SetDecodeSize (int max_width, int max_height)
+	{
+		decode_width = max_width;
+		decode_height = max_height;
+	}
+	int GetDecodeWidth () { return decode_width; }
+	int GetDecodeHeight () { return decode_height; }
+
 	void CleanupLoader ();
 	void CreateLoader (unsigned char *buffer);
 	/* @GeneratePInvoke */
 	void PixbufWrite (gpointer buffer, gint32 offset, gint32 n);
 	/* @GeneratePInvoke */
 	void PixmapComplete ();
+	// Called on the main thread when ImageDecoder is done with our image.
+	void DecodeCompleted (ImageDecodeJob *job);
 
 	virtual void OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error);
 
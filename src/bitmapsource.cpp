@@ -85,6 +85,25 @@ BitmapSource::Invalidate ()
 		GetPixelWidth (), GetPixelHeight (), GetPixelWidth () * 4);
 
 	cache.Release ();
+	dirty = Rect ();
+	Emit (BitmapSource::PixelDataChangedEvent);
+}
+
+void
+BitmapSource::InvalidateRect (Rect r)
+{
+	if (!image_surface || cairo_image_surface_get_data (image_surface) != GetBitmapData ()) {
+		BitmapSource::Invalidate ();
+		return;
+	}
+
+	r = r.RoundOut ().Intersection (Rect (0, 0, GetPixelWidth (), GetPixelHeight ()));
+	if (r.IsEmpty ())
+		return;
+
+	cairo_surface_mark_dirty_rectangle (image_surface, r.x, r.y, r.width, r.height);
+
+	dirty = dirty.Union (r);
 	Emit (BitmapSource::PixelDataChangedEvent);
 }
 
@@ -94,6 +113,37 @@ BitmapSource::GetSurface (Context *ctx)
 	MoonSurface *surface;
 	
 	surface = ctx->Lookup (&cache);
+	if (surface && !dirty.IsEmpty ()) {
+		if (cache.IsShared ()) {
+			// the other contexts would need the update too
+			cache.Release ();
+			surface = NULL;
+		}
+		else {
+			Rect        r = dirty;
+			MoonSurface *patch;
+			Color       transparent;
+
+			ctx->Push (Context::Group (r));
+			ctx->Blit ((unsigned char *) GetBitmapData () + (int) r.y * GetPixelWidth () * 4 + (int) r.x * 4,
+				   GetPixelWidth () * 4);
+			ctx->Pop (&patch);
+
+			ctx->Push (Context::Group (Rect (0, 0, GetPixelWidth (), GetPixelHeight ())), surface);
+			ctx->Push (Context::AbsoluteTransform ());
+			ctx->Push (Context::Clip (r));
+			ctx->Clear (&transparent);
+			ctx->Paint (patch, 1.0, r.x, r.y);
+			ctx->Pop ();
+			ctx->Pop ();
+			ctx->Pop (&surface);
+			surface->unref ();
+			patch->unref ();
+		}
+
+		dirty = Rect ();
+	}
+
 	if (surface)
 		return surface;
 	
@@ -30,6 +30,11 @@ class BitmapSource : public ImageSource {
  protected:
 	cairo_surface_t *image_surface;
 	Context::Cache cache;
+	Rect dirty; // the pixels which changed since the cached surface was uploaded
+
+	// Only the pixels in @r changed, the cached surface is updated
+	// instead of uploading all of them again.
+	void InvalidateRect (Rect r);
 
 	/* @GeneratePInvoke,ManagedAccess=Protected */
 	BitmapSource ();
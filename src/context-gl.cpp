@@ -105,6 +105,12 @@ GLContext::~GLContext ()
 	g_hash_table_destroy (effect_program);
 }
 
+GLuint
+GLContext::GetTexture (GLSurface *surface)
+{
+	return surface->Texture ();
+}
+
 void
 GLContext::SetFramebuffer ()
 {
@@ -574,7 +580,7 @@ GLContext::Paint (MoonSurface  *src,
 	}
 	else {
 		program = GetProjectProgram (alpha, 0);
-		texture[0] = surface->Texture ();
+		texture[0] = GetTexture (surface);
 		n_sampler = 1;
 	}
 
@@ -732,7 +738,7 @@ GLContext::Blur (MoonSurface *src,
 		 double      y)
 {
 	GLSurface    *surface = (GLSurface *) src;
-	GLuint       texture0 = surface->Texture ();
+	GLuint       texture0 = GetTexture (surface);
 	GLuint       texture1;
 	GLsizei      width0 = surface->Width ();
 	GLsizei      height0 = surface->Height ();
@@ -944,7 +950,7 @@ GLContext::DropShadow (MoonSurface *src,
 		       double      y)
 {
 	GLSurface    *surface = (GLSurface *) src;
-	GLuint       texture0 = surface->Texture ();
+	GLuint       texture0 = GetTexture (surface);
 	GLuint       texture1;
 	GLsizei      width0 = surface->Width ();
 	GLsizei      height0 = surface->Height ();
@@ -1679,7 +1685,7 @@ GLContext::ShaderEffect (MoonSurface *src,
 {
 	GLSurface *surface = (GLSurface *) src;
 	GLSurface *input[GL_TEXTURE30 - GL_TEXTURE0];
-	GLuint    texture0 = surface->Texture ();
+	GLuint    texture0 = GetTexture (surface);
 	GLuint    program = GetEffectProgram (shader);
 	GLsizei   width0 = surface->Width ();
 	GLsizei   height0 = surface->Height ();
@@ -100,6 +100,9 @@ protected:
 	PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
 #endif
 
+	// The texture of @surface, with whatever was drawn on it in
+	// software uploaded.
+	virtual GLuint GetTexture (GLSurface *surface);
 	virtual void SetFramebuffer ();
 	virtual void SetScissor ();
 	void SetViewport ();
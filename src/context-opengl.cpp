@@ -27,10 +27,34 @@ namespace Moonlight {
 
 OpenGLContext::OpenGLContext (OpenGLSurface *surface) : GLContext (surface)
 {
+	for (int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+		pixelBufferSize[i] = 0;
+	pixelBufferIndex = 0;
+	hasPixelBuffers = false;
+	hasMapBufferRange = false;
+
+#if !USE_CGL
+	glGenBuffers = (PFNGLGENBUFFERSPROC)
+		surface->GetProcAddress ("glGenBuffers");
+	glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)
+		surface->GetProcAddress ("glDeleteBuffers");
+	glBindBuffer = (PFNGLBINDBUFFERPROC)
+		surface->GetProcAddress ("glBindBuffer");
+	glBufferData = (PFNGLBUFFERDATAPROC)
+		surface->GetProcAddress ("glBufferData");
+	glMapBuffer = (PFNGLMAPBUFFERPROC)
+		surface->GetProcAddress ("glMapBuffer");
+	glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)
+		surface->GetProcAddress ("glMapBufferRange");
+	glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)
+		surface->GetProcAddress ("glUnmapBuffer");
+#endif
 }
 
 OpenGLContext::~OpenGLContext ()
 {
+	if (hasPixelBuffers)
+		glDeleteBuffers (PIXEL_BUFFER_COUNT, pixelBuffer);
 }
 
 bool
@@ -43,6 +67,8 @@ OpenGLContext::Initialize ()
 	};
 	const char *version = (const char *) glGetString (GL_VERSION);
         const char *extensions = (const char *) glGetString (GL_EXTENSIONS);
+	const char *renderer = (const char *) glGetString (GL_RENDERER);
+	const char *env;
 
 	if (!version || !extensions) {
 		g_warning ("glGetString returned NULL");
@@ -63,6 +89,39 @@ OpenGLContext::Initialize ()
 
 	glGetIntegerv (GL_MAX_TEXTURE_SIZE, &maxTextureSize);
 
+	hasPixelBuffers = atof (version) >= 2.1 ||
+		strstr (extensions, "GL_ARB_pixel_buffer_object");
+#if !USE_CGL
+	hasPixelBuffers = hasPixelBuffers &&
+		glGenBuffers && glDeleteBuffers && glBindBuffer &&
+		glBufferData && glMapBuffer && glUnmapBuffer;
+	hasMapBufferRange = glMapBufferRange &&
+		(atof (version) >= 3.0 ||
+		 strstr (extensions, "GL_ARB_map_buffer_range"));
+#endif
+
+	// software rasterizers copy out of the buffer synchronously,
+	// there's nothing to overlap the upload with and staging it
+	// only adds a copy. MOONLIGHT_GL_PIXEL_BUFFERS=0 disables staging
+	// and MOONLIGHT_GL_PIXEL_BUFFERS=1 forces it, whatever the renderer.
+	env = g_getenv ("MOONLIGHT_GL_PIXEL_BUFFERS");
+	if (env && !strcmp (env, "0")) {
+		hasPixelBuffers = false;
+	}
+	else if (env && !strcmp (env, "1")) {
+		if (!hasPixelBuffers)
+			g_warning ("MOONLIGHT_GL_PIXEL_BUFFERS=1, but the OpenGL implementation has no pixel buffer objects");
+	}
+	else if (renderer && (strstr (renderer, "llvmpipe") ||
+			      strstr (renderer, "softpipe") ||
+			      strstr (renderer, "swrast") ||
+			      strstr (renderer, "Software Rasterizer"))) {
+		hasPixelBuffers = false;
+	}
+
+	if (hasPixelBuffers)
+		glGenBuffers (PIXEL_BUFFER_COUNT, pixelBuffer);
+
 	if (maxTextureSize < 2048)
 		g_warning ("OpenGL max texture size: %d", maxTextureSize);
 
@@ -278,7 +337,7 @@ OpenGLContext::SyncDrawable ()
 	// initialize target contents with surface
 	if (target->GetInit () != ms) {
 		OpenGLSurface *src = (OpenGLSurface  *) target->GetInit ();
-		GLuint     texture0 = src->Texture ();
+		GLuint     texture0 = GetTexture (src);
 		GLuint     program = GetProjectProgram (1.0, 0);
 		GLsizei    width0 = src->Width ();
 		GLsizei    height0 = src->Height ();
@@ -334,7 +393,7 @@ OpenGLContext::SyncDrawable ()
 		MoonSurface   *mSrc;
 		Rect          rSrc = cairo->GetData (&mSrc);
 		OpenGLSurface *src = (OpenGLSurface  *) mSrc;
-		GLuint        texture0 = src->Texture ();
+		GLuint        texture0 = GetTexture (src);
 		GLuint        program = GetProjectProgram (1.0, 0);
 		GLsizei       width0 = src->Width ();
 		GLsizei       height0 = src->Height ();
@@ -475,6 +534,17 @@ OpenGLContext::Push (Cairo extents)
 		ms->unref ();
 	}
 
+	// cairo only draws in the box, only that has to be uploaded
+	Target      *dst = target->GetCairoTarget () ? target->GetCairoTarget () : target;
+	MoonSurface *ms;
+	Rect        r = dst->GetData (&ms);
+
+	((OpenGLSurface *) ms)->TrackDraw (Rect (box.x - r.x,
+						box.y - r.y,
+						box.width,
+						box.height));
+	ms->unref ();
+
 	return Context::Push (extents);
 }
 
@@ -554,6 +624,136 @@ OpenGLContext::SetScissor ()
 	ms->unref ();
 }
 
+void
+OpenGLContext::TexSubImage2D (GLuint        texture,
+			      GLint         x,
+			      GLint         y,
+			      GLsizei       width,
+			      GLsizei       height,
+			      GLenum        format,
+			      int           size,
+			      int           stride,
+			      unsigned char *data)
+{
+	int           length = width * size;
+	unsigned char *pixels = NULL;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	glBindTexture (GL_TEXTURE_2D, texture);
+
+	if (hasPixelBuffers) {
+		GLsizeiptr *allocated = &pixelBufferSize[pixelBufferIndex];
+
+		glBindBuffer (GL_PIXEL_UNPACK_BUFFER,
+			      pixelBuffer[pixelBufferIndex]);
+		pixelBufferIndex = (pixelBufferIndex + 1) % PIXEL_BUFFER_COUNT;
+
+		// orphan the storage the previous upload from this buffer
+		// may still be reading from, reallocating it only when
+		// it's too small or it can't be invalidated while mapping
+		if (!hasMapBufferRange || *allocated < length * height) {
+			glBufferData (GL_PIXEL_UNPACK_BUFFER,
+				      length * height,
+				      NULL,
+				      GL_STREAM_DRAW);
+			*allocated = length * height;
+		}
+
+#if !USE_CGL
+		if (hasMapBufferRange)
+			pixels = (unsigned char *)
+				glMapBufferRange (GL_PIXEL_UNPACK_BUFFER,
+						  0,
+						  length * height,
+						  GL_MAP_WRITE_BIT |
+						  GL_MAP_INVALIDATE_BUFFER_BIT);
+		else
+#endif
+			pixels = (unsigned char *)
+				glMapBuffer (GL_PIXEL_UNPACK_BUFFER,
+					     GL_WRITE_ONLY);
+		if (pixels) {
+			if (stride == length) {
+				memcpy (pixels, data, length * height);
+			}
+			else {
+				for (int i = 0; i < height; i++)
+					memcpy (pixels + length * i,
+						data + stride * i,
+						length);
+			}
+
+			// the contents are lost if the buffer was corrupted
+			if (!glUnmapBuffer (GL_PIXEL_UNPACK_BUFFER))
+				pixels = NULL;
+		}
+
+		if (!pixels)
+			glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	if (pixels) {
+		glPixelStorei (GL_UNPACK_ALIGNMENT, PixelAlignment (length));
+		glTexSubImage2D (GL_TEXTURE_2D,
+				 0,
+				 x,
+				 y,
+				 width,
+				 height,
+				 format,
+				 GL_UNSIGNED_BYTE,
+				 NULL);
+		glBindBuffer (GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	else {
+		glPixelStorei (GL_UNPACK_ROW_LENGTH,
+			       PixelRowLength (stride, width, size));
+		glPixelStorei (GL_UNPACK_ALIGNMENT, PixelAlignment (stride));
+		glTexSubImage2D (GL_TEXTURE_2D,
+				 0,
+				 x,
+				 y,
+				 width,
+				 height,
+				 format,
+				 GL_UNSIGNED_BYTE,
+				 data);
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	}
+
+	glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture (GL_TEXTURE_2D, 0);
+}
+
+GLuint
+OpenGLContext::GetTexture (GLSurface *surface)
+{
+	Rect          dirty;
+	unsigned char *data = surface->TakeData (&dirty);
+	GLuint        texture = surface->Texture ();
+
+	// only upload what cairo drew on, the whole surface unless the
+	// draw was tracked
+	if (data) {
+		int stride = surface->Width () * 4;
+
+		TexSubImage2D (texture,
+			       dirty.x,
+			       dirty.y,
+			       dirty.width,
+			       dirty.height,
+			       GL_BGRA,
+			       4,
+			       stride,
+			       data + (int) dirty.y * stride + (int) dirty.x * 4);
+		g_free (data);
+	}
+
+	return texture;
+}
+
 void
 OpenGLContext::Blit (unsigned char *data,
                      int           stride)
@@ -562,7 +762,7 @@ OpenGLContext::Blit (unsigned char *data,
 	MoonSurface   *ms;
 	Rect          r = target->GetData (&ms);
 	OpenGLSurface *dst = (OpenGLSurface *) ms;
-	Rect          clip;
+	Rect          dirty;
 
 	// no support for clipping
 	g_assert (GetClip () == r);
@@ -573,22 +773,18 @@ OpenGLContext::Blit (unsigned char *data,
 	// mark target as initialized
 	target->SetInit (ms);
 
-	glPixelStorei (GL_UNPACK_ROW_LENGTH,
-		       PixelRowLength (stride, dst->Width (), 4));
-	glPixelStorei (GL_UNPACK_ALIGNMENT, PixelAlignment (stride));
-	glBindTexture (GL_TEXTURE_2D, dst->Texture ());
-	glTexSubImage2D (GL_TEXTURE_2D,
-			 0,
-			 0,
-			 0,
-			 dst->Width (),
-			 dst->Height (),
-			 GL_BGRA,
-			 GL_UNSIGNED_BYTE,
-			 data);
-	glBindTexture (GL_TEXTURE_2D, 0);
-	glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
-	glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	// the blit replaces everything, don't upload what cairo drew first
+	g_free (dst->TakeData (&dirty));
+
+	TexSubImage2D (dst->Texture (),
+		       0,
+		       0,
+		       dst->Width (),
+		       dst->Height (),
+		       GL_BGRA,
+		       4,
+		       stride,
+		       data);
 
 	ms->unref ();
 }
@@ -615,24 +811,16 @@ OpenGLContext::BlitYV12 (unsigned char *data[],
 	// mark target as initialized
 	target->SetInit (ms);
 
-	for (i = 0; i < 3; i++) {
-		glPixelStorei (GL_UNPACK_ROW_LENGTH,
-			       PixelRowLength (stride[i], width[i], 1));
-		glPixelStorei (GL_UNPACK_ALIGNMENT, PixelAlignment (stride[i]));
-		glBindTexture (GL_TEXTURE_2D, dst->TextureYUV (i));
-		glTexSubImage2D (GL_TEXTURE_2D,
-				 0,
-				 0,
-				 0,
-				 width[i],
-				 height[i],
-				 GL_LUMINANCE,
-				 GL_UNSIGNED_BYTE,
-				 data[i]);
-	}
-	glBindTexture (GL_TEXTURE_2D, 0);
-	glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
-	glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	for (i = 0; i < 3; i++)
+		TexSubImage2D (dst->TextureYUV (i),
+			       0,
+			       0,
+			       width[i],
+			       height[i],
+			       GL_LUMINANCE,
+			       1,
+			       stride[i],
+			       data[i]);
 
 	ms->unref ();
 }
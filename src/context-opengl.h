@@ -14,6 +14,8 @@
 #include "context-gl.h"
 #include "surface-opengl.h"
 
+#define PIXEL_BUFFER_COUNT 4
+
 namespace Moonlight {
 
 class MOON_API OpenGLContext : public GLContext {
@@ -68,7 +70,39 @@ protected:
 	void SyncDrawable ();
 	Rect GroupBounds (Group extents);
 
+	void TexSubImage2D (GLuint        texture,
+			    GLint         x,
+			    GLint         y,
+			    GLsizei       width,
+			    GLsizei       height,
+			    GLenum        format,
+			    int           size,
+			    int           stride,
+			    unsigned char *data);
+	GLuint GetTexture (GLSurface *surface);
+
+#if !USE_CGL
+	PFNGLGENBUFFERSPROC glGenBuffers;
+	PFNGLDELETEBUFFERSPROC glDeleteBuffers;
+	PFNGLBINDBUFFERPROC glBindBuffer;
+	PFNGLBUFFERDATAPROC glBufferData;
+	PFNGLMAPBUFFERPROC glMapBuffer;
+	PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+	PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+#endif
+
 	GLint maxTextureSize;
+
+	// Pixel unpack buffers the uploads go through, in turn. Their
+	// storage is kept, but orphaned (invalidated) each time it's
+	// mapped, so writing the next upload never waits for the GL to
+	// be done with the previous one, and the copy to the texture
+	// overlaps with drawing.
+	GLuint pixelBuffer[PIXEL_BUFFER_COUNT];
+	GLsizeiptr pixelBufferSize[PIXEL_BUFFER_COUNT];
+	int pixelBufferIndex;
+	bool hasPixelBuffers;
+	bool hasMapBufferRange;
 };
 
 };
@@ -114,6 +114,9 @@ public:
 
 		void Release ();
 
+		// more than one context holds a surface for this key
+		bool IsShared () { return contexts && contexts->next; }
+
 	private:
 		GList *contexts;
 
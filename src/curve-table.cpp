@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * curve-table.cpp: easing curves and key splines sampled into lookup tables
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "curve-table.h"
+
+namespace Moonlight {
+
+CurveTableKey::CurveTableKey (int kind, int mode, double p0, double p1, double p2, double p3)
+{
+	this->kind = kind;
+	this->mode = mode;
+	parameters [0] = p0;
+	parameters [1] = p1;
+	parameters [2] = p2;
+	parameters [3] = p3;
+}
+
+static guint
+curve_table_key_hash (gconstpointer data)
+{
+	const CurveTableKey *key = (const CurveTableKey *) data;
+	guint hash = key->kind * 31 + key->mode;
+
+	for (int i = 0; i < 4; i++) {
+		guint64 bits;
+
+		memcpy (&bits, &key->parameters [i], sizeof (bits));
+		hash = hash * 31 + (guint) (bits ^ (bits >> 32));
+	}
+
+	return hash;
+}
+
+static gboolean
+curve_table_key_equal (gconstpointer a, gconstpointer b)
+{
+	const CurveTableKey *ka = (const CurveTableKey *) a;
+	const CurveTableKey *kb = (const CurveTableKey *) b;
+
+	if (ka->kind != kb->kind || ka->mode != kb->mode)
+		return false;
+
+	for (int i = 0; i < 4; i++) {
+		if (ka->parameters [i] != kb->parameters [i])
+			return false;
+	}
+
+	return true;
+}
+
+MoonMutex CurveTable::mutex;
+GHashTable *CurveTable::tables = NULL;
+int CurveTable::enabled = -1;
+
+CurveTable::CurveTable (const CurveTableKey *key)
+	: key (*key)
+{
+	samples = NULL;
+	refcount = 1;
+}
+
+CurveTable::~CurveTable ()
+{
+	g_free (samples);
+}
+
+void
+CurveTable::Sample (CurveTableFunc func, gpointer closure)
+{
+	double error = 0.0;
+
+	samples = (double *) g_malloc (sizeof (double) * (segments + 1));
+
+	for (int i = 0; i <= segments; i++)
+		samples [i] = func (closure, (double) i / segments);
+
+	for (int i = 0; i < segments; i++) {
+		double expected = func (closure, (i + 0.5) / segments);
+		double diff = fabs ((samples [i] + samples [i + 1]) / 2 - expected);
+
+		// NaN compares false, so check for it explicitly
+		if (!(diff <= CURVE_TABLE_MAX_ERROR)) {
+			error = diff;
+			break;
+		}
+
+		error = MAX (error, diff);
+	}
+
+	if (!(error <= CURVE_TABLE_MAX_ERROR)) {
+		g_free (samples);
+		samples = NULL;
+	}
+}
+
+CurveTable *
+CurveTable::Get (const CurveTableKey *key, CurveTableFunc func, gpointer closure)
+{
+	CurveTable *table;
+
+	mutex.Lock ();
+
+	if (enabled == -1) {
+		const char *env = g_getenv ("MOONLIGHT_CURVE_TABLES");
+
+		enabled = env == NULL || atoi (env) != 0;
+		tables = g_hash_table_new (curve_table_key_hash, curve_table_key_equal);
+	}
+
+	if (!enabled) {
+		mutex.Unlock ();
+		return NULL;
+	}
+
+	if ((table = (CurveTable *) g_hash_table_lookup (tables, key)) != NULL) {
+		table->refcount++;
+	} else {
+		table = new CurveTable (key);
+		table->Sample (func, closure);
+		g_hash_table_insert (tables, &table->key, table);
+	}
+
+	mutex.Unlock ();
+
+	return table;
+}
+
+void
+CurveTable::Unref (CurveTable *table)
+{
+	mutex.Lock ();
+
+	if (--table->refcount == 0) {
+		g_hash_table_remove (tables, &table->key);
+		delete table;
+	}
+
+	mutex.Unlock ();
+}
+
+};
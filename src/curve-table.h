@@ -0,0 +1,93 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * curve-table.h: easing curves and key splines sampled into lookup tables
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_CURVE_TABLE_H__
+#define __MOON_CURVE_TABLE_H__
+
+#include <glib.h>
+
+#include "pal.h"
+
+namespace Moonlight {
+
+// how far (in progress) interpolating between the samples may be from the curve
+#define CURVE_TABLE_MAX_ERROR 1e-4
+
+// how many times a curve is evaluated before it's worth sampling it
+#define CURVE_TABLE_MIN_EVALUATIONS 8
+
+/* Identifies a curve: everything its value depends on */
+struct CurveTableKey {
+	int kind; // the Type::Kind of the object the curve belongs to
+	int mode; // its EasingMode, or 0
+	double parameters [4];
+
+	CurveTableKey (int kind, int mode, double p0 = 0.0, double p1 = 0.0, double p2 = 0.0, double p3 = 0.0);
+};
+
+typedef double (*CurveTableFunc) (gpointer closure, double x);
+
+/*
+ * CurveTable: a curve on [0, 1] (an easing function, or a key spline's
+ * progress) sampled at evenly spaced points, evaluated by interpolating
+ * linearly between the samples instead of calling pow/sin/exp or solving
+ * the spline every tick. Every curve with the same key shares one table.
+ *
+ * When it's created the table is checked against the curve halfway
+ * between each pair of samples, where interpolation is furthest off for
+ * smooth curves; curves it doesn't follow within CURVE_TABLE_MAX_ERROR
+ * (sharp corners, vertical tangents) get a table without samples, and
+ * have to be evaluated as before.
+ *
+ * MOONLIGHT_CURVE_TABLES=0 disables the tables.
+ */
+class CurveTable {
+	static MoonMutex mutex;
+	static GHashTable *tables; // CurveTableKey -> CurveTable
+	static int enabled; // -1 until MOONLIGHT_CURVE_TABLES has been read
+
+	CurveTableKey key;
+	double *samples; // segments + 1 of them, NULL if the table isn't accurate enough
+	int refcount;
+
+	CurveTable (const CurveTableKey *key);
+	~CurveTable ();
+
+	void Sample (CurveTableFunc func, gpointer closure);
+
+public:
+	static const int segments = 1024;
+
+	// Returns the (reffed) table of the curve identified by @key, sampling
+	// @func into a new one if there is none yet. Returns NULL if tables are
+	// disabled.
+	static CurveTable *Get (const CurveTableKey *key, CurveTableFunc func, gpointer closure);
+	static void Unref (CurveTable *table);
+
+	bool IsAccurate () { return samples != NULL; }
+
+	// Only for accurate tables, @x must be in [0, 1]
+	double Evaluate (double x)
+	{
+		double position = x * segments;
+		int i = (int) position;
+
+		if (i >= segments)
+			return samples [segments];
+
+		return samples [i] + (samples [i + 1] - samples [i]) * (position - i);
+	}
+};
+
+};
+
+#endif /* __MOON_CURVE_TABLE_H__ */
@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "namescope.h"
@@ -122,42 +123,106 @@ private:
 	EmitContext *ctx;
 };
 
+/*
+ * The state of one event of an EventObject. It is only created once a handler
+ * is added to the event.
+ */
 struct EventList {
 	int current_token;
 	int last_foreach_generation;
-	List *context_stack;
 	EventClosure *onevent;
-	List *event_list;
+	List context_stack;
+	List event_list;
+
+	EventList ()
+	{
+		current_token = 1;
+		last_foreach_generation = -1;
+		onevent = NULL;
+	}
+
+	~EventList ()
+	{
+		delete onevent;
+	}
 };
 
+/*
+ * The per-event state of an EventObject, sparse: most objects have handlers
+ * for one or two of the (often dozens of) events their type declares, so
+ * we keep a small array sorted by event id with the first entries inline.
+ */
 class EventLists {
+	struct Entry {
+		int event_id;
+		EventList *list;
+	};
+
+	static const int inline_size = 2;
+
+	Entry inline_entries [inline_size];
+	Entry *entries;
+	int count;
+	int capacity;
+
 public:
-	int size;
 	int emitting;
-	EventList *lists;
-	
-	EventLists (int n)
+
+	EventLists ()
 	{
-		size = n;
+		entries = inline_entries;
+		count = 0;
+		capacity = inline_size;
 		emitting = 0;
-		lists = new EventList [size];
-		for (int i = 0; i < size; i++) {
-			lists [i].current_token = 1;
-			lists [i].last_foreach_generation = -1;
-			lists [i].context_stack = new List();
-			lists [i].onevent = NULL;
-			lists [i].event_list = new List ();
-		}
 	}
 
 	~EventLists ()
 	{
-		for (int i = 0; i < size; i++) {
-			delete lists [i].event_list;
-			delete lists [i].onevent;
-			delete lists [i].context_stack;
+		for (int i = 0; i < count; i++)
+			delete entries [i].list;
+		if (entries != inline_entries)
+			g_free (entries);
+	}
+
+	int GetCount () { return count; }
+	EventList *GetAt (int index) { return entries [index].list; }
+
+	/* Returns NULL if no handler has ever been added to the event */
+	EventList *Find (int event_id)
+	{
+		for (int i = 0; i < count && entries [i].event_id <= event_id; i++) {
+			if (entries [i].event_id == event_id)
+				return entries [i].list;
 		}
-		delete [] lists;
+		return NULL;
+	}
+
+	EventList *Get (int event_id)
+	{
+		int index = 0;
+
+		while (index < count && entries [index].event_id < event_id)
+			index++;
+
+		if (index < count && entries [index].event_id == event_id)
+			return entries [index].list;
+
+		if (count == capacity) {
+			capacity *= 2;
+			if (entries == inline_entries) {
+				entries = g_new (Entry, capacity);
+				memcpy (entries, inline_entries, sizeof (Entry) * count);
+			} else {
+				entries = g_renew (Entry, entries, capacity);
+			}
+		}
+
+		memmove (entries + index + 1, entries + index, sizeof (Entry) * (count - index));
+		entries [index].event_id = event_id;
+		entries [index].list = new EventList ();
+		count++;
+
+		return entries [index].list;
 	}
 };
 
@@ -708,11 +773,12 @@ EventObject::AddManagedHandler (int event_id, UnmanagedEventHandlerInvoker handl
 	}
 
 	if (events == NULL)
-		events = new EventLists (GetType ()->GetEventCount ());
+		events = new EventLists ();
 
-	int token = events->lists [event_id].current_token++;
+	EventList *list = events->Get (event_id);
+	int token = list->current_token++;
 	
-	events->lists [event_id].event_list->Append (new EventClosure (this, event_id, NULL, handler, data, handledEventsToo, data_dtor, managed_data_dtor, token));
+	list->event_list.Append (new EventClosure (this, event_id, NULL, handler, data, handledEventsToo, data_dtor, managed_data_dtor, token));
 	
 	return token;
 }
@@ -726,11 +792,12 @@ EventObject::AddHandler (int event_id, EventHandler handler, gpointer data, Dest
 	}
 	
 	if (events == NULL)
-		events = new EventLists (GetType ()->GetEventCount ());
+		events = new EventLists ();
 
-	int token = events->lists [event_id].current_token++;
+	EventList *list = events->Get (event_id);
+	int token = list->current_token++;
 	
-	events->lists [event_id].event_list->Append (new EventClosure (this, event_id, handler, NULL, data, handledEventsToo, data_dtor, managed_data_dtor, token));
+	list->event_list.Append (new EventClosure (this, event_id, handler, NULL, data, handledEventsToo, data_dtor, managed_data_dtor, token));
 	
 	return token;
 }
@@ -744,9 +811,9 @@ EventObject::AddOnEventHandler (int event_id, EventHandler handler, gpointer dat
 	}
 
 	if (events == NULL)
-		events = new EventLists (GetType ()->GetEventCount ());
+		events = new EventLists ();
 
-	events->lists [event_id].onevent = new EventClosure (this, event_id, handler, NULL, data, handledEventsToo, data_dtor, managed_data_dtor, 0);
+	events->Get (event_id)->onevent = new EventClosure (this, event_id, handler, NULL, data, handledEventsToo, data_dtor, managed_data_dtor, 0);
 }
 
 int
@@ -771,9 +838,9 @@ EventObject::AddXamlHandler (int event_id, EventHandler handler, gpointer data,
 	}
 	
 	if (events == NULL)
-		events = new EventLists (GetType ()->GetEventCount ());
+		events = new EventLists ();
 
-	events->lists [event_id].event_list->Append (new EventClosure (this, event_id, handler, NULL, data, handledEventsToo, data_dtor, managed_data_dtor, 0));
+	events->Get (event_id)->event_list.Append (new EventClosure (this, event_id, handler, NULL, data, handledEventsToo, data_dtor, managed_data_dtor, 0));
 	
 	return 0;
 }
@@ -794,7 +861,9 @@ EventObject::RemoveHandler (const char *event_name, EventHandler handler, gpoint
 int
 EventObject::FindHandlerToken (int event_id, EventHandler handler, gpointer data)
 {
-	if (events == NULL)
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL)
 		return -1;
 
 	if (GetType()->GetEventCount() <= 0) {
@@ -802,7 +871,7 @@ EventObject::FindHandlerToken (int event_id, EventHandler handler, gpointer data
 		return -1;
 	}
 
-	EventClosure *closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *closure = (EventClosure *) list->event_list.First ();
 	while (closure) {
 		if (closure->func == handler && closure->data == data)
 			return closure->token;
@@ -816,8 +885,9 @@ int
 EventObject::RemoveHandler (int event_id, EventHandler handler, gpointer data)
 {
 	int token = -1;
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
 
-	if (events == NULL)
+	if (list == NULL)
 		return token;
 
 	if (GetType()->GetEventCount() <= 0) {
@@ -826,17 +896,17 @@ EventObject::RemoveHandler (int event_id, EventHandler handler, gpointer data)
 	}
 
 	bool is_shutting_down = GetDeployment ()->IsShuttingDown ();
-	EventClosure *closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *closure = (EventClosure *) list->event_list.First ();
 	EventClosure *next;
 	while (closure) {
 		next = (EventClosure *) closure->next;
 		if (closure->func == handler && closure->data == data) {
 			token = closure->token;
- 			if (!events->lists [event_id].context_stack->IsEmpty()) {
+ 			if (!list->context_stack.IsEmpty()) {
  				closure->pending_removal = true;
  			} else {
 				closure->InvokeDataDtor (is_shutting_down);
-				events->lists [event_id].event_list->Remove (closure);
+				list->event_list.Remove (closure);
  			}
 			break;
 		}
@@ -849,7 +919,9 @@ EventObject::RemoveHandler (int event_id, EventHandler handler, gpointer data)
 void
 EventObject::RemoveHandler (int event_id, int token)
 {
-	if (events == NULL) {
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL) {
 #if SANITY
 		printf ("EventObject::RemoveHandler (%i, %i): no event handlers have been registered\n", event_id, token);
 #endif
@@ -862,16 +934,16 @@ EventObject::RemoveHandler (int event_id, int token)
 	}
 
 	bool is_shutting_down = GetDeployment ()->IsShuttingDown ();
-	EventClosure *closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *closure = (EventClosure *) list->event_list.First ();
 	EventClosure *next;
 	while (closure) {
 		next = (EventClosure *) closure->next;
 		if (closure->token == token) {
-			if (!events->lists [event_id].context_stack->IsEmpty()) {
+			if (!list->context_stack.IsEmpty()) {
 				closure->pending_removal = true;
 			} else {
 				closure->InvokeDataDtor(is_shutting_down);
-				events->lists [event_id].event_list->Remove (closure);
+				list->event_list.Remove (closure);
 			}
 			break;
 		}
@@ -887,19 +959,19 @@ EventObject::RemoveAllHandlers (gpointer data)
 		return;
 
 	bool is_shutting_down = GetDeployment ()->IsShuttingDown ();
-	int count = GetType ()->GetEventCount ();
 	
-	for (int i = 0; i < count; i++) {
-		EventClosure *closure = (EventClosure *) events->lists [i].event_list->First ();
+	for (int i = 0; i < events->GetCount (); i++) {
+		EventList *list = events->GetAt (i);
+		EventClosure *closure = (EventClosure *) list->event_list.First ();
 		EventClosure *next;
 		while (closure) {
 			next = (EventClosure *) closure->next;
 			if (closure->data == data) {
-				if (!events->lists [i].context_stack->IsEmpty()) {
+				if (!list->context_stack.IsEmpty()) {
 					closure->pending_removal = true;
 				} else {
 					closure->InvokeDataDtor(is_shutting_down);
-					events->lists [i].event_list->Remove (closure);
+					list->event_list.Remove (closure);
 				}
 				break;
 			}
@@ -912,7 +984,9 @@ EventObject::RemoveAllHandlers (gpointer data)
 void
 EventObject::RemoveMatchingHandlers (int event_id, bool (*predicate)(int token, EventHandler cb_handler, gpointer cb_data, gpointer data), gpointer closure)
 {
-	if (events == NULL) {
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL) {
 #if SANITY
 		g_warning ("EventObject::RemoveMatchingHandlers (): no handlers have been registered.\n");
 #endif		
@@ -924,17 +998,17 @@ EventObject::RemoveMatchingHandlers (int event_id, bool (*predicate)(int token,
 		return;
 	}
 
-	EventClosure *c = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *c = (EventClosure *) list->event_list.First ();
 	EventClosure *next;
 	bool is_shutting_down = GetDeployment ()->IsShuttingDown ();
 	while (c) {
 		next = (EventClosure *) c->next;
 		if (!predicate || predicate (c->token, c->func, c->data, closure)) {
-			if (!events->lists [event_id].context_stack->IsEmpty()) {
+			if (!list->context_stack.IsEmpty()) {
 				c->pending_removal = true;
 			} else {
 				c->InvokeDataDtor (is_shutting_down);
-				events->lists [event_id].event_list->Remove (c);
+				list->event_list.Remove (c);
 			}
 		}
 		
@@ -945,40 +1019,43 @@ EventObject::RemoveMatchingHandlers (int event_id, bool (*predicate)(int token,
 void
 EventObject::ForeachHandler (int event_id, bool only_new, HandlerMethod m, gpointer closure)
 {
-	if (events == NULL)
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL)
 		return;
 
-	EventClosure *event_closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *event_closure = (EventClosure *) list->event_list.First ();
 	EventClosure *next;
-	int last_foreach_generation = events->lists [event_id].last_foreach_generation;
+	int last_foreach_generation = list->last_foreach_generation;
 	while (event_closure) {
 		next = (EventClosure *) event_closure->next;
 		if (!event_closure->pending_removal && (!only_new || event_closure->token >= last_foreach_generation))
 			(*m) (this, event_closure->token, closure);
 		event_closure = next;
 	}
-	events->lists [event_id].last_foreach_generation = GetEventGeneration (event_id);
+	list->last_foreach_generation = GetEventGeneration (event_id);
 }
 
 void
 EventObject::ClearForeachGeneration (int event_id)
 {
-	if (events == NULL)
-		return;
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
 
-	if (GetType()->GetEventCount() <= 0)
+	if (list == NULL)
 		return;
 
-	events->lists [event_id].last_foreach_generation = -1;
+	list->last_foreach_generation = -1;
 }
 
 void
 EventObject::ForHandler (int event_id, int token, HandlerMethod m, gpointer closure)
 {
-	if (events == NULL)
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL)
 		return;
 
-	EventClosure *event_closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *event_closure = (EventClosure *) list->event_list.First ();
 	EventClosure *next;
 	while (event_closure) {
 		next = (EventClosure *) event_closure->next;
@@ -993,20 +1070,22 @@ EventObject::ForHandler (int event_id, int token, HandlerMethod m, gpointer clos
 bool
 EventObject::HasHandlers (int event_id, int newer_than_generation, bool ignoreOnEventHandler)
 {
-	// no events, trivially false
-	if (events == NULL)
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	// no handlers for this event, trivially false
+	if (list == NULL)
 		return false;
 
 	// if we have an onevent handler, trivially true
-	if (!ignoreOnEventHandler && events->lists [event_id].onevent != NULL)
+	if (!ignoreOnEventHandler && list->onevent != NULL)
 		return true;
 
 	// if we're not caring about generation, return true if there are any events
-	if (newer_than_generation == -1 && !events->lists [event_id].event_list->IsEmpty ())
+	if (newer_than_generation == -1 && !list->event_list.IsEmpty ())
 		return true;
 
 	// otherwise we need to loop over them to find one newer than @newer_than_generation
-	EventClosure *event_closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	EventClosure *event_closure = (EventClosure *) list->event_list.First ();
 	while (event_closure) {
 		if (event_closure->token >= newer_than_generation)
 			return true;
@@ -1018,10 +1097,12 @@ EventObject::HasHandlers (int event_id, int newer_than_generation, bool ignoreOn
 int
 EventObject::GetEventGeneration (int event_id)
 {
-	if (events == NULL)
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL)
 		return 1; /* first generation */
 
-	return events->lists [event_id].current_token;
+	return list->current_token;
 }
 
 bool
@@ -1194,6 +1275,8 @@ EventObject::Emit (int event_id, EventArgs *calldata, bool only_unemitted, int s
 bool
 EventObject::EmitOnly (int event_id, int token, EventArgs *calldata, bool only_unemitted, int starting_generation)
 {
+	EventList *list;
+
 	if (events == NULL) {
 		if (calldata)
 			calldata->unref ();
@@ -1213,7 +1296,8 @@ EventObject::EmitOnly (int event_id, int token, EventArgs *calldata, bool only_u
 		return false;
 	}
 
-	if (events->lists [event_id].event_list->IsEmpty () && events->lists [event_id].onevent == NULL) {
+	list = events->Find (event_id);
+	if (list == NULL || (list->event_list.IsEmpty () && list->onevent == NULL)) {
 		if (calldata) {
 #if DEBUG
 			if (!(GetObjectType () == Type::TEXTBOX && (event_id == TextBox::SelectionChangedEvent || event_id == TextBox::TextChangedEvent))
@@ -1259,6 +1343,8 @@ EventObject::EmitOnly (int event_id, int token, EventArgs *calldata, bool only_u
 EmitContext*
 EventObject::StartEmit (int event_id, int only_token, bool only_unemitted, int starting_generation)
 {
+	EventList *list;
+
 	if (events == NULL)
 		return NULL;
 
@@ -1267,8 +1353,10 @@ EventObject::StartEmit (int event_id, int only_token, bool only_unemitted, int s
 		return NULL;
 	}
 
-	// if (events->lists [event_id].event_list->IsEmpty ())
-	// 	return NULL;
+	// No handler has ever been added to this event, there is nothing to emit.
+	list = events->Find (event_id);
+	if (list == NULL)
+		return NULL;
 
 	EmitContext *ctx = new EmitContext();
 	ctx->only_unemitted = only_unemitted;
@@ -1277,13 +1365,13 @@ EventObject::StartEmit (int event_id, int only_token, bool only_unemitted, int s
 
 	events->emitting++;
 
-	events->lists [event_id].context_stack->Prepend (new EmitContextNode (ctx));
+	list->context_stack.Prepend (new EmitContextNode (ctx));
 
-	ctx->length = events->lists [event_id].event_list->Length();
+	ctx->length = list->event_list.Length();
 	ctx->closures = g_new (EventClosure*, ctx->length);
 
 	/* make a copy of the event list to use for emitting */
-	closure = (EventClosure *) events->lists [event_id].event_list->First ();
+	closure = (EventClosure *) list->event_list.First ();
 	for (int i = 0; closure != NULL; i ++) {
 		if (only_token == -1 || closure->token == only_token)
 			ctx->closures[i] = closure->pending_removal ? NULL : closure;
@@ -1298,21 +1386,23 @@ EventObject::StartEmit (int event_id, int only_token, bool only_unemitted, int s
 bool
 EventObject::DoEmit (int event_id, EventArgs *calldata)
 {
-	if (events == NULL) {
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL) {
 		if (calldata)
 			calldata->unref ();
 		return false;
 	}
 
-	if (events->lists [event_id].context_stack->IsEmpty ()) {
+	if (list->context_stack.IsEmpty ()) {
 		g_warning ("DoEmit called with no EmitContexts");
 		return false;
 	}
 
-	EmitContext *ctx = ((EmitContextNode*)events->lists [event_id].context_stack->First())->GetEmitContext();
+	EmitContext *ctx = ((EmitContextNode*)list->context_stack.First())->GetEmitContext();
 
-	if (events->lists [event_id].onevent) {
-		EventClosure *closure = events->lists [event_id].onevent;
+	if (list->onevent) {
+		EventClosure *closure = list->onevent;
 		closure->func (this, calldata, closure->data);
 	}
 	else {
@@ -1328,15 +1418,17 @@ EventObject::DoEmit (int event_id, EventArgs *calldata)
 void
 EventObject::DoEmitCurrentContext (int event_id, EventArgs *calldata)
 {
-	if (events == NULL)
+	EventList *list = events != NULL ? events->Find (event_id) : NULL;
+
+	if (list == NULL)
 		return;
 		
-	if (events->lists [event_id].context_stack->IsEmpty()) {
+	if (list->context_stack.IsEmpty()) {
 		g_warning ("DoEmitCurrentContext called with no EmitContexts");
 		return;
 	}
 
-	EmitContext *ctx = ((EmitContextNode*)events->lists [event_id].context_stack->First())->GetEmitContext();
+	EmitContext *ctx = ((EmitContextNode*)list->context_stack.First())->GetEmitContext();
 
 	/* emit the events using the copied list in the context*/
 	for (int i = 0; i < ctx->length; i++) {
@@ -1367,6 +1459,8 @@ EventObject::DoEmitCurrentContext (int event_id, EventArgs *calldata)
 void
 EventObject::FinishEmit (int event_id, EmitContext *ctx)
 {
+	EventList *list;
+
 	if (events == NULL || ctx == NULL)
 		return;
 
@@ -1375,12 +1469,18 @@ EventObject::FinishEmit (int event_id, EmitContext *ctx)
 		return;
 	}
 
-	if (events->lists [event_id].context_stack->IsEmpty()) {
+	list = events->Find (event_id);
+	if (list == NULL) {
+		g_warning ("FinishEmit called with no EmitContexts");
+		return;
+	}
+
+	if (list->context_stack.IsEmpty()) {
 		g_warning ("FinishEmit called with no EmitContexts");
 		return;
 	}
 
-	EmitContextNode *first_node = (EmitContextNode*)events->lists [event_id].context_stack->First();
+	EmitContextNode *first_node = (EmitContextNode*)list->context_stack.First();
 	EmitContext *first_ctx = first_node->GetEmitContext();
 
 	if (first_ctx != ctx) {
@@ -1388,20 +1488,20 @@ EventObject::FinishEmit (int event_id, EmitContext *ctx)
 		return;
 	}
 
-	events->lists [event_id].context_stack->Unlink (first_node);
+	list->context_stack.Unlink (first_node);
 
 	delete first_node;
 	events->emitting--;
 
 	bool is_shutting_down = GetDeployment ()->IsShuttingDown ();
-	if (events->lists [event_id].context_stack->IsEmpty ()) {
+	if (list->context_stack.IsEmpty ()) {
 		// Remove closures which are waiting for removal
-		EventClosure *closure = (EventClosure *) events->lists [event_id].event_list->First ();
+		EventClosure *closure = (EventClosure *) list->event_list.First ();
 		while (closure != NULL) {
 			EventClosure *next = (EventClosure *) closure->next;
 			if (closure->pending_removal) {
 				closure->InvokeDataDtor(is_shutting_down);
-				events->lists [event_id].event_list->Remove (closure);
+				list->event_list.Remove (closure);
 			}
 			closure = next;
 		}
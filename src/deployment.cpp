@@ -38,6 +38,7 @@ G_END_DECLS
 #include "security.h"
 #include "namescope.h"
 #include "pipeline.h"
+#include "image-decoder.h"
 #if HAVE_CURL
 #include "network-curl.h"
 #endif
@@ -1386,6 +1387,9 @@ Deployment::Shutdown ()
 	 * anything related to this deployment).
 	 */
 	DisposeAllMedias ();
+
+	/* Same for the images being decoded */
+	ImageDecoder::RemoveWork (this);
 	
 	// Detach all loaded handlers we may have, they cause circular refs
 	RemoveMatchingHandlers (Deployment::LoadedEvent, NULL, NULL);
@@ -28,108 +28,97 @@
 
 namespace Moonlight {
 
-class DirtyNode : public List::Node {
-public:
-	DirtyNode (UIElement *element) 
-	{
-		this->element = element;
-	}
-	UIElement *element;
-};
-
-class DirtyList : public List::Node
-{
-public:
-	DirtyList ()
-	{
-		dirty_list = new List();
-	}
-
-	~DirtyList ()
-	{
-		delete dirty_list;
-	}
-
-	List* GetDirtyNodes ()
-	{
-		return dirty_list;
-	}
-private:
-	List *dirty_list;
-};
-
 DirtyLists::DirtyLists (bool ascending)
 {
 	this->ascending = ascending;
-	this->lists = new List();
+	levels = g_ptr_array_new ();
+	first = ascending ? G_MAXINT : -1;
+	count = 0;
 }
 
 DirtyLists::~DirtyLists ()
 {
-	delete lists;
+	Clear ();
+
+	for (guint i = 0; i < levels->len; i++)
+		delete (List *) levels->pdata [i];
+	g_ptr_array_free (levels, true);
 }
 
-DirtyList*
-DirtyLists::GetList (bool create)
+void
+DirtyLists::AddDirtyNode (DirtyNode *node, int level)
 {
-	DirtyList *dl = NULL;
+	level = MAX (level, 0);
 
-	dl = (DirtyList *)lists->First ();
+	while ((guint) level >= levels->len)
+		g_ptr_array_add (levels, new List ());
 
-	if (!dl && create) {
-		lists->Append (new DirtyList ());
-		dl = (DirtyList *)lists->First ();
-	}
+	((List *) levels->pdata [level])->Append (node);
+	node->level = level;
+	count++;
 
-	return dl;
+	if (ascending ? level < first : level > first)
+		first = level;
 }
 
 void
-DirtyLists::AddDirtyNode (List::Node *node)
+DirtyLists::RemoveDirtyNode (DirtyNode *node)
 {
-	DirtyList *dl = (DirtyList*)GetList (true);
-	dl->GetDirtyNodes()->Append(node);
+	if (!node->IsLinked ())
+		return;
+
+	((List *) levels->pdata [node->level])->Unlink (node);
+	node->level = -1;
+	count--;
 }
 
 void
-DirtyLists::RemoveDirtyNode (List::Node *node)
+DirtyLists::MoveDirtyNode (DirtyNode *node, int level)
 {
-	DirtyList *dl = (DirtyList*)GetList (false);
-	if (!dl)
+	if (!node->IsLinked () || node->level == MAX (level, 0))
 		return;
-	dl->GetDirtyNodes()->Remove(node);
-	if (dl->GetDirtyNodes()->IsEmpty())
-		lists->Remove (dl);
+
+	RemoveDirtyNode (node);
+	AddDirtyNode (node, level);
 }
 
-List::Node*
+DirtyNode *
 DirtyLists::GetFirst ()
 {
-	DirtyList *dl;
+	if (count == 0) {
+		first = ascending ? G_MAXINT : -1;
+		return NULL;
+	}
 
+	// skip the buckets which were emptied since we last looked
 	if (ascending) {
-		dl = (DirtyList*)lists->First();
+		first = MAX (first, 0);
+		while (((List *) levels->pdata [first])->IsEmpty ())
+			first++;
+	} else {
+		first = MIN (first, (int) levels->len - 1);
+		while (((List *) levels->pdata [first])->IsEmpty ())
+			first--;
 	}
-	else {
-		dl = (DirtyList*)lists->Last ();
-	}
-
-	if (!dl)
-		return NULL;
 
-	return dl->GetDirtyNodes()->First();
-}
-
-bool
-DirtyLists::IsEmpty ()
-{
-	return lists->IsEmpty();
+	return (DirtyNode *) ((List *) levels->pdata [first])->First ();
 }
 
 void
-DirtyLists::Clear (bool freeNodes)
+DirtyLists::Clear ()
 {
-	lists->Clear (freeNodes);
+	for (guint i = 0; i < levels->len; i++) {
+		List *list = (List *) levels->pdata [i];
+		DirtyNode *node;
+
+		while ((node = (DirtyNode *) list->First ())) {
+			list->Unlink (node);
+			node->level = -1;
+		}
+	}
+
+	first = ascending ? G_MAXINT : -1;
+	count = 0;
 }
 
 void
@@ -150,19 +139,17 @@ Surface::AddDirtyElement (UIElement *element, DirtyType dirt)
 	//printf ("adding element %p (%s) to the dirty list\n", element, element->GetTypeName());
 
 	if (dirt & DownDirtyState) {
-		if (element->down_dirty_node)
+		if (element->down_dirty_node.IsLinked ())
 			return;
-		element->down_dirty_node = new DirtyNode (element);
 
-		down_dirty->AddDirtyNode (element->down_dirty_node);
+		down_dirty->AddDirtyNode (&element->down_dirty_node, element->GetVisualLevel ());
 	}
 
 	if (dirt & UpDirtyState) {
-		if (element->up_dirty_node)
+		if (element->up_dirty_node.IsLinked ())
 			return;
-		element->up_dirty_node = new DirtyNode (element);
 
-		up_dirty->AddDirtyNode (element->up_dirty_node);
+		up_dirty->AddDirtyNode (&element->up_dirty_node, element->GetVisualLevel ());
 	}
 
 	GetTimeManager()->NeedRedraw ();
@@ -171,13 +158,15 @@ Surface::AddDirtyElement (UIElement *element, DirtyType dirt)
 void
 Surface::RemoveDirtyElement (UIElement *element)
 {
-	if (element->up_dirty_node)
-		up_dirty->RemoveDirtyNode (element->up_dirty_node);
-	if (element->down_dirty_node)
-		down_dirty->RemoveDirtyNode (element->down_dirty_node);
+	up_dirty->RemoveDirtyNode (&element->up_dirty_node);
+	down_dirty->RemoveDirtyNode (&element->down_dirty_node);
+}
 
-	element->down_dirty_node = NULL;
-	element->up_dirty_node = NULL;
+void
+Surface::UpdateDirtyElementLevel (UIElement *element)
+{
+	up_dirty->MoveDirtyNode (&element->up_dirty_node, element->GetVisualLevel ());
+	down_dirty->MoveDirtyNode (&element->down_dirty_node, element->GetVisualLevel ());
 }
 
 
@@ -213,7 +202,7 @@ void
 Surface::ProcessDownDirtyElements ()
 {
 	/* push down the transforms opacity, and visibility changes first */
-	while (DirtyNode *node = (DirtyNode*)down_dirty->GetFirst()) {
+	while (DirtyNode *node = down_dirty->GetFirst()) {
 		UIElement* el = (UIElement*)node->element;
 
 		if (el->dirty_flags & DirtyRenderVisibility) {
@@ -312,11 +301,8 @@ Surface::ProcessDownDirtyElements ()
 			    
 		}
 
-		if (!(el->dirty_flags & DownDirtyState) && el->down_dirty_node) {
-		       
-			down_dirty->RemoveDirtyNode (el->down_dirty_node);
-			el->down_dirty_node = NULL;
-		}
+		if (!(el->dirty_flags & DownDirtyState))
+			down_dirty->RemoveDirtyNode (&el->down_dirty_node);
 	}
 	
 	if (!down_dirty->IsEmpty())
@@ -331,7 +317,7 @@ Surface::ProcessDownDirtyElements ()
 void
 Surface::ProcessUpDirtyElements ()
 {
-	while (DirtyNode *node = (DirtyNode*)up_dirty->GetFirst()) {
+	while (DirtyNode *node = up_dirty->GetFirst()) {
 		UIElement* el = (UIElement*)node->element;
 
 //   		printf ("up processing element element %p (%s)\n", el, el->GetName());
@@ -395,14 +381,11 @@ Surface::ProcessUpDirtyElements ()
 				}
 			}
 
-			delete el->dirty_region;
-			el->dirty_region = new Region ();
+			dirty->Clear ();
 		}
 
-		if (!(el->dirty_flags & UpDirtyState)) {
-			up_dirty->RemoveDirtyNode (el->up_dirty_node);
-			el->up_dirty_node = NULL;
-		}
+		if (!(el->dirty_flags & UpDirtyState))
+			up_dirty->RemoveDirtyNode (&el->up_dirty_node);
 	}
 	
 	if (!up_dirty->IsEmpty())
@@ -414,6 +397,9 @@ Surface::UpdateLayout (MoonError *error)
 {
 	if (!layers)
 		return false;
+
+	MOON_TRACE_SCOPE ("layout", "Surface::UpdateLayout");
+
 	// Caching layers->GetCount causes a crash in #869 since the # of layers can change while measuring.
 	LayoutPass *pass = new LayoutPass ();
 	bool dirty = true;
@@ -436,12 +422,18 @@ Surface::UpdateLayout (MoonError *error)
 			}
 			
 			// FIXME: Propgate this somewhere?
+			TimeSpan start = frame_timings ? get_now () : 0;
 			layer->UpdateLayer (pass, error);
+			if (frame_timings)
+				frame_timings->layout += get_now () - start;
 		}
 		
 		dirty |= down_dirty->IsEmpty() || !up_dirty->IsEmpty();
+		TimeSpan start = frame_timings ? get_now () : 0;
 		ProcessDownDirtyElements ();
 		ProcessUpDirtyElements ();
+		if (frame_timings)
+			frame_timings->dirty += get_now () - start;
 		
 		if (pass->updated && dirty) {
 			GetDeployment ()->LayoutUpdated ();		
@@ -13,29 +13,59 @@
 #ifndef __DIRTY_H__
 #define __DIRTY_H__
 
+#include <glib.h>
+
+#include "list.h"
+
 namespace Moonlight {
 
-class DirtyList;
+class UIElement;
+
+// The node linking an element into one of the surface's dirty lists, it's
+// embedded in the element.
+class DirtyNode : public List::Node {
+public:
+	DirtyNode () { element = NULL; level = -1; }
+
+	UIElement *element;
+	int level; // the depth bucket the node is in, -1 if it isn't in a list
 
+	bool IsLinked () { return level != -1; }
+};
+
+/*
+ * DirtyLists: the dirty elements, bucketed by their depth in the visual
+ * tree so that the down pass handles parents before their children and the
+ * up pass children before their parents (every ancestor of a batch of
+ * invalidated elements is then processed once per pass, with the regions
+ * of all its children already merged into its own).
+ *
+ * Adding and removing elements doesn't allocate, the nodes live in the
+ * elements and the buckets are kept around.
+ */
 class DirtyLists {
 public:
+	// @ascending: the elements closest to the root come first.
 	DirtyLists (bool ascending);
 	~DirtyLists ();
 
-	DirtyList* GetList (bool create = false);
-
-	void AddDirtyNode (List::Node *node);
-	void RemoveDirtyNode (List::Node *node);
+	void AddDirtyNode (DirtyNode *node, int level);
+	void RemoveDirtyNode (DirtyNode *node);
+	// Moves a linked node to the bucket of @level (its element was reparented).
+	void MoveDirtyNode (DirtyNode *node, int level);
 
-	List::Node *GetFirst ();
+	DirtyNode *GetFirst ();
 
-	bool IsEmpty ();
+	bool IsEmpty () { return count == 0; }
 
-	void Clear (bool freeNodes);
+	// Unlinks every node.
+	void Clear ();
 
 private:
 	bool ascending;
-	List *lists;
+	GPtrArray *levels; // a List per depth
+	int first; // the nodes are all in this bucket or after it (in processing order)
+	guint count;
 };
 
 enum DirtyType {
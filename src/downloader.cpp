@@ -26,6 +26,7 @@
 #include "downloader.h"
 #include "deployment.h"
 #include "utils.h"
+#include "zip-index.h"
 #include "debug.h"
 #include "uri.h"
 #include "factory.h"
@@ -49,6 +50,7 @@ Downloader::Downloader ()
 	filename = NULL;
 	failed_msg = NULL;
 	unzipdir = NULL;
+	zip_index = NULL;
 	unzipped = false;
 	request = NULL;
 }
@@ -75,6 +77,9 @@ Downloader::~Downloader ()
 void
 Downloader::CleanupUnzipDir ()
 {
+	delete zip_index;
+	zip_index = NULL;
+	
 	if (!unzipdir)
 		return;
 	
@@ -84,6 +89,15 @@ Downloader::CleanupUnzipDir ()
 	unzipdir = NULL;
 }
 
+ZipIndex *
+Downloader::GetZipIndex ()
+{
+	if (!zip_index && filename)
+		zip_index = ZipIndex::Open (filename);
+	
+	return zip_index;
+}
+
 bool
 Downloader::DownloadedFileIsZipped ()
 {
@@ -92,6 +106,9 @@ Downloader::DownloadedFileIsZipped ()
 	if (!filename)
 		return false;
 	
+	if (GetZipIndex ())
+		return true;
+	
 	if (!(zipfile = unzOpen (filename)))
 		return false;
 	
@@ -125,6 +142,8 @@ Downloader::GetDownloadedFilename (const char *partname)
 	
 	char *dirname, *path, *part;
 	unzFile zipfile;
+	ZipEntry *entry;
+	ZipIndex *zip;
 	struct stat st;
 	int rv, fd;
 	
@@ -153,6 +172,19 @@ Downloader::GetDownloadedFilename (const char *partname)
 				goto exception1;
 		}
 		
+		// extract just this part, straight from the central directory
+		if ((zip = GetZipIndex ())) {
+			bool existed;
+			
+			// it may have been extracted since we checked
+			if (!(entry = zip->Find (partname)) || (!zip->ExtractToFile (entry, path, &existed) && !existed))
+				goto exception1;
+			
+			g_free (part);
+			
+			return path;
+		}
+		
 		// open the zip archive...
 		if (!(zipfile = unzOpen (filename)))
 			goto exception1;
@@ -204,6 +236,64 @@ exception0:
 	return NULL;
 }
 
+bool
+Downloader::UnzipAll (ZipIndex *zip)
+{
+	ZipExtraction *files;
+	GHashTable *names;
+	ZipEntry *entry;
+	char *dirname;
+	bool rv = true;
+	guint n = 0;
+	
+	files = g_new0 (ZipExtraction, zip->GetCount ());
+	names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	
+	for (guint i = 0; i < zip->GetCount (); i++) {
+		entry = zip->GetEntry (i);
+		
+		if (entry->is_directory)
+			continue;
+		
+		// entries must stay inside unzipdir
+		if (!ZipIndex::IsSafeName (entry->name)) {
+			LOG_DOWNLOADER ("Downloader::UnzipAll (): not extracting '%s'\n", entry->name);
+			rv = false;
+			continue;
+		}
+		
+		// the names are lowercased, so only the first of the entries with the same
+		// name (in any case) is extracted (it's also the one ZipIndex::Find returns)
+		char *name = g_ascii_strdown (entry->name, -1);
+		if (g_hash_table_lookup (names, name) != NULL) {
+			g_free (name);
+			continue;
+		}
+		g_hash_table_insert (names, name, entry);
+		
+		char *path = g_build_filename (unzipdir, name, NULL);
+		
+		dirname = g_path_get_dirname (path);
+		g_mkdir_with_parents (dirname, 0700);
+		g_free (dirname);
+		
+		files [n].entry = entry;
+		files [n].path = path;
+		n++;
+	}
+	
+	// parts which have already been extracted are left alone
+	if (!zip->ExtractFiles (files, n))
+		rv = false;
+	
+	for (guint i = 0; i < n; i++)
+		g_free ((char *) files [i].path);
+	g_free (files);
+	g_hash_table_destroy (names);
+	
+	return rv;
+}
+
 const char *
 Downloader::GetUnzippedPath ()
 {
@@ -227,6 +317,11 @@ Downloader::GetUnzippedPath ()
 	if (unzipped)
 		return unzipdir;
 	
+	if (GetZipIndex ()) {
+		unzipped = UnzipAll (GetZipIndex ());
+		return unzipdir;
+	}
+	
 	// open the zip archive...
 	if (!(zip = unzOpen (this->filename)))
 		return NULL;
@@ -289,9 +384,21 @@ Downloader::GetResponseText (const char *partname, gint64 *size)
 	GByteArray *buf;
 	struct stat st;
 	ssize_t nread;
+	ZipEntry *entry;
+	ZipIndex *zip;
 	char *data;
 	char *path;
 	
+	// parts are served straight from the zip file, without going through a temporary file
+	if (partname && partname[0] && (zip = GetZipIndex ())) {
+		if (!(entry = zip->Find (partname)) || !(data = (char *) zip->ExtractToBuffer (entry)))
+			return NULL;
+		
+		*size = entry->size;
+		
+		return data;
+	}
+	
 	if (!(path = GetDownloadedFilename (partname)))
 		return NULL;
 	
@@ -544,6 +651,8 @@ Downloader::SetFilename (const char *fname)
 	LOG_DOWNLOADER ("Downloader::SetFilename (%s)\n", fname);
 	
 	g_free (filename);
+	delete zip_index;
+	zip_index = NULL;
 
 	filename = g_strdup (fname);
 }
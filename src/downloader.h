@@ -38,6 +38,8 @@ enum DownloaderAccessPolicy {
 
 namespace Moonlight {
 
+class ZipIndex;
+
 /* @Namespace=None */
 /* @ManagedDependencyProperties=None */
 /* @ManagedEvents=Manual */
@@ -47,6 +49,7 @@ class Downloader : public DependencyObject {
 	char *filename;
 	char *failed_msg;
 	char *unzipdir;
+	ZipIndex *zip_index;
 	
 	int send_queued:1;
 	int completed:1;
@@ -55,6 +58,8 @@ class Downloader : public DependencyObject {
 	int unzipped:1;
 	
 	bool DownloadedFileIsZipped ();
+	ZipIndex *GetZipIndex ();
+	bool UnzipAll (ZipIndex *zip);
 	void CleanupUnzipDir ();
 
 	EVENTHANDLER (Downloader, ProgressChanged, HttpRequest, HttpRequestProgressChangedEventArgs);
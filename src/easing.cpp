@@ -35,10 +35,13 @@ EasingFunctionBase::EasingFunctionBase ()
 {
 	SetObjectType (Type::EASINGFUNCTIONBASE);
 	easing_function_callback = NULL;
+	table = NULL;
+	evaluations = 0;
 }
 
 EasingFunctionBase::~EasingFunctionBase ()
 {
+	DropTable ();
 }
 
 
@@ -48,6 +51,32 @@ EasingFunctionBase::Ease (double normalizedTime)
 	if (easing_function_callback)
 		return easing_function_callback (this, normalizedTime);
 
+	// only sample curves which are evaluated more than a couple of times,
+	// not the ones whose properties are animated themselves
+	if (table == NULL && evaluations < CURVE_TABLE_MIN_EVALUATIONS && ++evaluations == CURVE_TABLE_MIN_EVALUATIONS) {
+		double parameters [2] = { 0.0, 0.0 };
+
+		if (GetTableParameters (parameters)) {
+			CurveTableKey key (GetObjectType (), GetEasingMode (), parameters [0], parameters [1]);
+			table = CurveTable::Get (&key, SampleEase, this);
+		}
+	}
+
+	if (table != NULL && table->IsAccurate () && normalizedTime >= 0.0 && normalizedTime <= 1.0)
+		return table->Evaluate (normalizedTime);
+
+	return EaseWithMode (normalizedTime);
+}
+
+double
+EasingFunctionBase::SampleEase (gpointer closure, double normalizedTime)
+{
+	return ((EasingFunctionBase *) closure)->EaseWithMode (normalizedTime);
+}
+
+double
+EasingFunctionBase::EaseWithMode (double normalizedTime)
+{
 	switch (GetEasingMode()) {
 	case EasingModeIn:
 		return EaseInCore (normalizedTime);
@@ -67,6 +96,27 @@ void
 EasingFunctionBase::SetEasingFunction (EasingFunction easing_function)
 {
 	easing_function_callback = easing_function;
+	DropTable ();
+}
+
+void
+EasingFunctionBase::DropTable ()
+{
+	if (table != NULL) {
+		CurveTable::Unref (table);
+		table = NULL;
+	}
+
+	evaluations = 0;
+}
+
+void
+EasingFunctionBase::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
+{
+	// the curve depends on the easing mode and the properties of the subclasses
+	DropTable ();
+
+	DependencyObject::OnPropertyChanged (args, error);
 }
 
 // Back
@@ -88,6 +138,13 @@ BackEase::EaseInCore (double normalizedTime)
 	return t_cubed - normalizedTime * GetAmplitude () * sin (normalizedTime * M_PI);
 }
 
+bool
+BackEase::GetTableParameters (double *parameters)
+{
+	parameters [0] = GetAmplitude ();
+	return true;
+}
+
 // Bounce
 
 BounceEase::BounceEase ()
@@ -183,6 +240,14 @@ ElasticEase::EaseInCore (double normalizedTime)
 	return normalizedTime * -(pow (2.0, spring * t)) * sin (((t - offset) * M_PI * 2) / period);
 }
 
+bool
+ElasticEase::GetTableParameters (double *parameters)
+{
+	parameters [0] = GetOscillations ();
+	parameters [1] = GetSpringiness ();
+	return true;
+}
+
 // Exponential
 
 ExponentialEase::ExponentialEase ()
@@ -200,6 +265,13 @@ ExponentialEase::EaseInCore (double normalizedTime)
 	return (exp (GetExponent () * normalizedTime) - 1) /  (exp (GetExponent ()) - 1);
 }
 
+bool
+ExponentialEase::GetTableParameters (double *parameters)
+{
+	parameters [0] = GetExponent ();
+	return true;
+}
+
 // Power
 
 PowerEase::PowerEase ()
@@ -217,6 +289,13 @@ PowerEase::EaseInCore (double normalizedTime)
 	return pow (normalizedTime, GetPower ());
 }
 
+bool
+PowerEase::GetTableParameters (double *parameters)
+{
+	parameters [0] = GetPower ();
+	return true;
+}
+
 // Quadratic
 
 QuadraticEase::QuadraticEase ()
@@ -288,5 +367,11 @@ SineEase::EaseInCore (double normalizedTime)
 	return 1.0 - sin ((1.0 - normalizedTime) * M_PI_2);
 }
 
+bool
+SineEase::GetTableParameters (double *parameters)
+{
+	return true;
+}
+
 
 };
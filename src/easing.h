@@ -13,6 +13,7 @@
 
 #include "dependencyobject.h"
 #include "enums.h"
+#include "curve-table.h"
 
 namespace Moonlight {
 
@@ -27,6 +28,10 @@ public:
 	const static int EasingModeProperty;
 
 	double Ease (double normalizedTime);
+	// Ease without the CurveTable
+	double EaseWithMode (double normalizedTime);
+	// Whether Ease interpolates in a CurveTable
+	bool IsTabulated () { return table != NULL && table->IsAccurate (); }
 	
 	/* @GeneratePInvoke */
 	virtual double EaseInCore (double normalizedTime) { return normalizedTime; }
@@ -37,17 +42,29 @@ public:
 	/* @GeneratePInvoke */
 	void SetEasingFunction (EasingFunction value);
 
+	virtual void OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error);
+
 protected:
 	/* @GeneratePInvoke,ManagedAccess=Protected */
 	EasingFunctionBase ();
 
 	virtual ~EasingFunctionBase ();
 
+	// Easing functions which are expensive enough to be sampled into a
+	// CurveTable return true, with the (up to 2) properties their curve
+	// depends on in @parameters.
+	virtual bool GetTableParameters (double *parameters) { return false; }
+
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
 
 private:
 	EasingFunction easing_function_callback;
+	CurveTable *table;
+	int evaluations; // since the curve last changed
+
+	void DropTable ();
+	static double SampleEase (gpointer closure, double normalizedTime);
 };
 
 /* @Namespace=System.Windows.Media.Animation */
@@ -68,6 +85,8 @@ protected:
 
 	virtual ~BackEase();
 
+	virtual bool GetTableParameters (double *parameters);
+
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
 };
@@ -154,6 +173,8 @@ protected:
 
 	virtual ~ElasticEase();
 
+	virtual bool GetTableParameters (double *parameters);
+
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
 };
@@ -176,6 +197,8 @@ protected:
 
 	virtual ~ExponentialEase();
 
+	virtual bool GetTableParameters (double *parameters);
+
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
 };
@@ -198,6 +221,8 @@ protected:
 
 	virtual ~PowerEase();
 
+	virtual bool GetTableParameters (double *parameters);
+
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
 };
@@ -262,6 +287,8 @@ protected:
 	
 	virtual ~SineEase ();
 
+	virtual bool GetTableParameters (double *parameters);
+
 	friend class MoonUnmanagedFactory;
 	friend class MoonManagedFactory;
 };
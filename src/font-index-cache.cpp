@@ -0,0 +1,298 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * font-index-cache.cpp: on-disk cache of the faces found in font files
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+#include <glib.h>
+#if !GLIB_IS_EGLIB
+#include <glib/gstdio.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "font-index-cache.h"
+#include "debug.h"
+
+namespace Moonlight {
+
+#define FONT_INDEX_CACHE_HEADER "moonlight-font-index 1"
+
+// the table directory of a font (or of every font in a collection) is at the start of the file
+#define FONT_INDEX_KEY_BYTES 16384
+
+// entries which weren't used in a while are dropped when there are more than this
+#define FONT_INDEX_CACHE_MAX_ENTRIES 4096
+
+static void
+entry_free (gpointer data)
+{
+	FontIndexCacheEntry *entry = (FontIndexCacheEntry *) data;
+
+	for (int i = 0; i < entry->nfaces; i++)
+		g_free (entry->faces[i].style.family_name);
+
+	g_free (entry->faces);
+	g_free (entry);
+}
+
+FontIndexCache::FontIndexCache (const char *filename)
+{
+	entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, entry_free);
+	this->filename = g_strdup (filename);
+	dirty = false;
+
+	Load ();
+}
+
+FontIndexCache::~FontIndexCache ()
+{
+	g_hash_table_destroy (entries);
+	g_free (filename);
+}
+
+char *
+FontIndexCache::GetDefaultFilename ()
+{
+	const char *env = g_getenv ("MOONLIGHT_FONT_INDEX");
+
+	if (env != NULL)
+		return env[0] ? g_strdup (env) : NULL;
+
+	return g_build_filename (g_get_user_cache_dir (), "moonlight", "font-index", NULL);
+}
+
+char *
+FontIndexCache::CreateKey (const char *path, const char *name)
+{
+	guint8 buf[FONT_INDEX_KEY_BYTES];
+	guint64 hash = 14695981039346656037ULL;
+	struct stat st;
+	ssize_t nread;
+	size_t len;
+	int fd;
+
+	if ((fd = open (path, O_RDONLY)) == -1)
+		return NULL;
+
+	if (fstat (fd, &st) == -1) {
+		close (fd);
+		return NULL;
+	}
+
+	do {
+		nread = read (fd, buf, sizeof (buf));
+	} while (nread == -1 && errno == EINTR);
+
+	close (fd);
+
+	if (nread == -1)
+		return NULL;
+
+	// FNV-1a
+	for (ssize_t i = 0; i < nread; i++) {
+		hash ^= buf[i];
+		hash *= 1099511628211ULL;
+	}
+
+	// obfuscated fonts are decoded with the guid in their name
+	len = name ? strlen (name) : 0;
+	if (len > 6 && !g_ascii_strcasecmp (name + len - 6, ".odttf"))
+		return g_strdup_printf ("%" G_GINT64_FORMAT "-%016" G_GINT64_MODIFIER "x-%s", (gint64) st.st_size, hash, name);
+
+	return g_strdup_printf ("%" G_GINT64_FORMAT "-%016" G_GINT64_MODIFIER "x", (gint64) st.st_size, hash);
+}
+
+FontIndexCacheEntry *
+FontIndexCache::Lookup (const char *key)
+{
+	FontIndexCacheEntry *entry;
+
+	if ((entry = (FontIndexCacheEntry *) g_hash_table_lookup (entries, key)))
+		entry->used = true;
+
+	return entry;
+}
+
+void
+FontIndexCache::Add (const char *key, bool obfuscated, FontIndexCacheFace *faces, int nfaces)
+{
+	FontIndexCacheEntry *entry = g_new0 (FontIndexCacheEntry, 1);
+
+	entry->obfuscated = obfuscated;
+	entry->nfaces = nfaces;
+	entry->used = true;
+
+	if (nfaces > 0) {
+		entry->faces = g_new (FontIndexCacheFace, nfaces);
+		for (int i = 0; i < nfaces; i++) {
+			entry->faces[i] = faces[i];
+			entry->faces[i].style.family_name = g_strdup (faces[i].style.family_name);
+		}
+	}
+
+	g_hash_table_replace (entries, g_strdup (key), entry);
+	dirty = true;
+}
+
+void
+FontIndexCache::Load ()
+{
+	FontIndexCacheEntry *entry = NULL;
+	char **lines, **fields;
+	char *contents;
+	int face = 0;
+
+	if (filename == NULL || !g_file_get_contents (filename, &contents, NULL, NULL))
+		return;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	if (lines[0] == NULL || strcmp (lines[0], FONT_INDEX_CACHE_HEADER) != 0) {
+		LOG_FONT ("FontIndexCache: ignoring '%s', unknown format\n", filename);
+		g_strfreev (lines);
+		return;
+	}
+
+	for (int i = 1; lines[i] != NULL; i++) {
+		if (lines[i][0] == '\0')
+			continue;
+
+		fields = g_strsplit (lines[i], "\t", -1);
+
+		if (lines[i][0] != '\t') {
+			// <key> <obfuscated> <number of faces>
+			if (entry != NULL && face < entry->nfaces)
+				entry->nfaces = face;
+
+			entry = NULL;
+
+			if (g_strv_length (fields) == 3) {
+				entry = g_new0 (FontIndexCacheEntry, 1);
+				entry->obfuscated = atoi (fields[1]) != 0;
+				entry->nfaces = CLAMP (atoi (fields[2]), 0, 1024);
+				entry->faces = entry->nfaces ? g_new0 (FontIndexCacheFace, entry->nfaces) : NULL;
+				g_hash_table_replace (entries, g_strdup (fields[0]), entry);
+				face = 0;
+			}
+		} else if (entry != NULL && face < entry->nfaces && g_strv_length (fields) == 7) {
+			// <index> <stretch> <weight> <style> <set> <family name>
+			FontIndexCacheFace *fi = &entry->faces[face++];
+
+			fi->index = atoi (fields[1]);
+			fi->style.stretch = (FontStretches) atoi (fields[2]);
+			fi->style.weight = (FontWeights) atoi (fields[3]);
+			fi->style.style = (FontStyles) atoi (fields[4]);
+			fi->style.set = atoi (fields[5]);
+			fi->style.family_name = g_strdup (fields[6]);
+		}
+
+		g_strfreev (fields);
+	}
+
+	// a truncated cache file
+	if (entry != NULL && face < entry->nfaces)
+		entry->nfaces = face;
+
+	g_strfreev (lines);
+
+	LOG_FONT ("FontIndexCache: loaded %u entries from '%s'\n", g_hash_table_size (entries), filename);
+}
+
+static void
+write_entry (FILE *fp, const char *key, FontIndexCacheEntry *entry)
+{
+	fprintf (fp, "%s\t%d\t%d\n", key, entry->obfuscated ? 1 : 0, entry->nfaces);
+
+	for (int i = 0; i < entry->nfaces; i++) {
+		FontIndexCacheFace *face = &entry->faces[i];
+
+		fprintf (fp, "\t%d\t%d\t%d\t%d\t%d\t", face->index, (int) face->style.stretch,
+			 (int) face->style.weight, (int) face->style.style, face->style.set);
+
+		for (const char *p = face->style.family_name ? face->style.family_name : ""; *p; p++)
+			fputc (*p == '\t' || *p == '\n' || *p == '\r' ? ' ' : *p, fp);
+
+		fputc ('\n', fp);
+	}
+}
+
+bool
+FontIndexCache::Save ()
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	char *dirname, *tmpname;
+	guint written = 0;
+	FILE *fp;
+	int fd;
+
+	if (filename == NULL || !dirty)
+		return true;
+
+	dirname = g_path_get_dirname (filename);
+	if (g_mkdir_with_parents (dirname, 0700) == -1 && errno != EEXIST) {
+		g_free (dirname);
+		return false;
+	}
+	g_free (dirname);
+
+	// write to a temporary file and rename it, so that other processes
+	// never read a partially written cache
+	tmpname = g_strdup_printf ("%s.XXXXXX", filename);
+	if ((fd = g_mkstemp (tmpname)) == -1) {
+		g_free (tmpname);
+		return false;
+	}
+
+	if (!(fp = fdopen (fd, "w"))) {
+		close (fd);
+		g_unlink (tmpname);
+		g_free (tmpname);
+		return false;
+	}
+
+	fputs (FONT_INDEX_CACHE_HEADER "\n", fp);
+
+	// the entries used by this process first, then whatever fits of the rest
+	for (int pass = 0; pass < 2; pass++) {
+		g_hash_table_iter_init (&iter, entries);
+		while (written < FONT_INDEX_CACHE_MAX_ENTRIES && g_hash_table_iter_next (&iter, &key, &value)) {
+			FontIndexCacheEntry *entry = (FontIndexCacheEntry *) value;
+
+			if (entry->used == (pass == 0)) {
+				write_entry (fp, (const char *) key, entry);
+				written++;
+			}
+		}
+	}
+
+	if (fclose (fp) != 0 || g_rename (tmpname, filename) == -1) {
+		g_unlink (tmpname);
+		g_free (tmpname);
+		return false;
+	}
+
+	g_free (tmpname);
+	dirty = false;
+
+	LOG_FONT ("FontIndexCache: saved %u entries to '%s'\n", written, filename);
+
+	return true;
+}
+
+};
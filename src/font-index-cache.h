@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * font-index-cache.h: on-disk cache of the faces found in font files
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __FONT_INDEX_CACHE_H__
+#define __FONT_INDEX_CACHE_H__
+
+#include <glib.h>
+
+#include "font-utils.h"
+
+namespace Moonlight {
+
+struct FontIndexCacheFace {
+	int index;
+	FontStyleInfo style;
+};
+
+struct FontIndexCacheEntry {
+	// files which aren't fonts are cached too, with no faces
+	FontIndexCacheFace *faces;
+	int nfaces;
+	bool obfuscated;
+	bool used;
+};
+
+/*
+ * FontIndexCache: what FontManager learns about a font file when indexing a
+ * font resource (the family and style of each face in it), persisted across
+ * runs so that a font file is only opened with FreeType when one of its
+ * faces is actually used.
+ *
+ * Font resources usually live in temporary directories (extracted from a
+ * xap or a downloaded zip), so the files are keyed by their content instead
+ * of their path: the size of the file and a digest of its first bytes,
+ * which hold the table directory of the font (with a checksum of every
+ * table).
+ */
+class FontIndexCache {
+	GHashTable *entries;
+	char *filename;
+	bool dirty;
+
+	void Load ();
+
+public:
+	// @filename may be NULL, in which case nothing is persisted.
+	FontIndexCache (const char *filename);
+	~FontIndexCache ();
+
+	// The default location of the cache ($XDG_CACHE_HOME/moonlight/font-index),
+	// MOONLIGHT_FONT_INDEX overrides it (set it to an empty string to disable
+	// the cache).
+	static char *GetDefaultFilename ();
+
+	// Returns NULL if the file can't be read. @name is the name the file
+	// was given in the resource (obfuscated fonts are decoded with it).
+	static char *CreateKey (const char *path, const char *name);
+
+	FontIndexCacheEntry *Lookup (const char *key);
+	void Add (const char *key, bool obfuscated, FontIndexCacheFace *faces, int nfaces);
+
+	// Writes the cache to disk, if anything was added since it was loaded.
+	bool Save ();
+
+	guint GetCount () { return g_hash_table_size (entries); }
+};
+
+};
+
+#endif /* __FONT_INDEX_CACHE_H__ */
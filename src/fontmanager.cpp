@@ -24,6 +24,7 @@
 
 #include "fontmanager.h"
 #include "font-utils.h"
+#include "font-index-cache.h"
 #include "zip/unzip.h"
 #include "factory.h"
 #include "debug.h"
@@ -268,6 +269,7 @@ struct FaceInfo {
 	int index;
 	
 	FaceInfo (FontFile *file, FT_Face face, int index);
+	FaceInfo (FontFile *file, const FontIndexCacheFace *cached);
 	~FaceInfo ();
 };
 
@@ -293,6 +295,19 @@ FaceInfo::FaceInfo (FontFile *file, FT_Face face, int index)
 	this->file = file;
 }
 
+FaceInfo::FaceInfo (FontFile *file, const FontIndexCacheFace *cached)
+{
+	style = cached->style;
+	style.family_name = g_strdup (cached->style.family_name);
+	family_name = style.family_name;
+	
+	LOG_FONT ("      * cached %s[%d] as %s; %s\n", path_get_basename (file->path), cached->index,
+		  family_name, font_style_info_to_string (style.stretch, style.weight, style.style));
+	
+	this->index = cached->index;
+	this->file = file;
+}
+
 FaceInfo::~FaceInfo ()
 {
 	g_free (family_name);
@@ -339,8 +354,6 @@ struct FontIndex {
 	
 	FontIndex (const char *name);
 	~FontIndex ();
-	
-	void CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid);
 };
 
 FontIndex::FontIndex (const char *name)
@@ -357,8 +370,8 @@ FontIndex::~FontIndex ()
 	delete fonts;
 }
 
-void
-FontIndex::CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid)
+static FontFile *
+CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream stream, FT_Face face, const char *guid)
 {
 	int i = 0, nfaces = face->num_faces;
 	FT_Open_Args args;
@@ -387,7 +400,92 @@ FontIndex::CacheFontInfo (FT_Library libft2, const char *filename, FT_Stream str
 		i++;
 	} while (i < nfaces);
 	
-	fonts->Append (file);
+	return file;
+}
+
+static FontFile *
+IndexFont (FT_Library libft2, FontIndexCache *cache, const char *path, const char *name)
+{
+	FontIndexCacheEntry *entry;
+	FontIndexCacheFace *faces;
+	FT_Open_Args args;
+	FT_Stream stream;
+	bool obfuscated;
+	FontFile *file;
+	FT_Face face;
+	char *key;
+	
+	// the faces in this file may already be known from a previous run
+	key = cache ? FontIndexCache::CreateKey (path, name) : NULL;
+	if (key && (entry = cache->Lookup (key))) {
+		g_free (key);
+		
+		if (entry->nfaces == 0)
+			return NULL;
+		
+		file = new FontFile (path, entry->obfuscated ? name : NULL);
+		file->faces = g_ptr_array_new ();
+		
+		for (int i = 0; i < entry->nfaces; i++)
+			g_ptr_array_add (file->faces, new FaceInfo (file, &entry->faces[i]));
+		
+		return file;
+	}
+	
+	if (!(stream = font_stream_new (path, NULL))) {
+		g_free (key);
+		return NULL;
+	}
+	
+	args.flags = FT_OPEN_STREAM;
+	args.stream = stream;
+	
+	obfuscated = false;
+	
+	if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
+		// not a valid font file... is it maybe an obfuscated font?
+		if (!is_odttf (name) || !font_stream_set_guid (stream, name))
+			goto not_a_font;
+		
+		font_stream_reset (stream);
+		
+		args.flags = FT_OPEN_STREAM;
+		args.stream = stream;
+		
+		if (FT_Open_Face (libft2, &args, 0, &face) != 0)
+			goto not_a_font;
+		
+		obfuscated = true;
+	}
+	
+	// cache font info
+	file = CacheFontInfo (libft2, path, stream, face, obfuscated ? name : NULL);
+	
+	font_stream_destroy (stream);
+	
+	if (key) {
+		faces = g_new (FontIndexCacheFace, file->faces->len);
+		for (guint i = 0; i < file->faces->len; i++) {
+			faces[i].index = ((FaceInfo *) file->faces->pdata[i])->index;
+			faces[i].style = ((FaceInfo *) file->faces->pdata[i])->style;
+		}
+		
+		cache->Add (key, obfuscated, faces, file->faces->len);
+		g_free (faces);
+		g_free (key);
+	}
+	
+	return file;
+	
+ not_a_font:
+	font_stream_destroy (stream);
+	
+	if (key) {
+		cache->Add (key, false, NULL, 0);
+		g_free (key);
+	}
+	
+	return NULL;
 }
 
 static void
@@ -1023,6 +1121,7 @@ FontManager::FontManager ()
 	system_faces = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	
 	known_typefaces = NULL;
+	index_cache = NULL;
 	typefaces = NULL;
 	root = NULL;
 }
@@ -1036,6 +1135,11 @@ FontManager::~FontManager ()
 	g_hash_table_destroy (resources);
 	g_hash_table_destroy (faces);
 	
+	if (index_cache) {
+		index_cache->Save ();
+		delete index_cache;
+	}
+	
 	if (root) {
 		RemoveDir (root);
 		g_free (root);
@@ -1043,15 +1147,12 @@ FontManager::~FontManager ()
 }
 
 static bool
-IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontIndex **out)
+IndexFontSubdirectory (FT_Library libft2, FontIndexCache *cache, const char *name, GString *path, FontIndex **out)
 {
 	FontIndex *fontdir = *out;
 	const gchar *dirname;
-	FT_Open_Args args;
-	FT_Stream stream;
-	bool obfuscated;
+	FontFile *file;
 	struct stat st;
-	FT_Face face;
 	size_t len;
 	GDir *dir;
 	
@@ -1074,45 +1175,17 @@ IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontI
 			goto next;
 		
 		if (S_ISDIR (st.st_mode)) {
-			IndexFontSubdirectory (libft2, name, path, &fontdir);
+			IndexFontSubdirectory (libft2, cache, name, path, &fontdir);
 			goto next;
 		}
 		
-		if (!(stream = font_stream_new (path->str, NULL)))
+		if (!(file = IndexFont (libft2, cache, path->str, dirname)))
 			goto next;
 		
-		args.flags = FT_OPEN_STREAM;
-		args.stream = stream;
-		
-		obfuscated = false;
-		
-		if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
-			// not a valid font file... is it maybe an obfuscated font?
-			if (!is_odttf (dirname) || !font_stream_set_guid (stream, dirname)) {
-				font_stream_destroy (stream);
-				goto next;
-			}
-			
-			font_stream_reset (stream);
-			
-			args.flags = FT_OPEN_STREAM;
-			args.stream = stream;
-			
-			if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
-				font_stream_destroy (stream);
-				goto next;
-			}
-			
-			obfuscated = true;
-		}
-		
 		if (fontdir == NULL)
 			fontdir = new FontIndex (name);
 		
-		// cache font info
-		fontdir->CacheFontInfo (libft2, path->str, stream, face, obfuscated ? dirname : NULL);
-		
-		font_stream_destroy (stream);
+		fontdir->fonts->Append (file);
 		
 	 next:
 		g_string_truncate (path, len);
@@ -1126,7 +1199,7 @@ IndexFontSubdirectory (FT_Library libft2, const char *name, GString *path, FontI
 }
 
 static FontIndex *
-IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname)
+IndexFontDirectory (FT_Library libft2, FontIndexCache *cache, const char *name, const char *dirname)
 {
 	FontIndex *fontdir = NULL;
 	GString *path;
@@ -1135,7 +1208,7 @@ IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname)
 	path = g_string_new (dirname);
 	len = path->len;
 	
-	if (!IndexFontSubdirectory (libft2, name, path, &fontdir)) {
+	if (!IndexFontSubdirectory (libft2, cache, name, path, &fontdir)) {
 		g_string_free (path, true);
 		return NULL;
 	}
@@ -1149,54 +1222,35 @@ IndexFontDirectory (FT_Library libft2, const char *name, const char *dirname)
 }
 
 static FontIndex *
-IndexFontFile (FT_Library libft2, const char *name, const char *path)
+IndexFontFile (FT_Library libft2, FontIndexCache *cache, const char *name, const char *path)
 {
-	const char *filename = path_get_basename (name);
-	FontIndex *index = NULL;
-	FT_Open_Args args;
-	FT_Stream stream;
-	bool obfuscated;
-	FT_Face face;
+	FontIndex *index;
+	FontFile *file;
 	
 	LOG_FONT ("  * indexing font file `%s'...\n", path);
 	
-	if (!(stream = font_stream_new (path, NULL)))
+	if (!(file = IndexFont (libft2, cache, path, path_get_basename (name))))
 		return NULL;
 	
-	args.flags = FT_OPEN_STREAM;
-	args.stream = stream;
-	
-	obfuscated = false;
-	
-	if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
-		// not a valid font file... is it maybe an obfuscated font?
-		if (!is_odttf (filename) || !font_stream_set_guid (stream, filename)) {
-			font_stream_destroy (stream);
-			return NULL;
-		}
-		
-		font_stream_reset (stream);
-		
-		args.flags = FT_OPEN_STREAM;
-		args.stream = stream;
-		
-		if (FT_Open_Face (libft2, &args, 0, &face) != 0) {
-			font_stream_destroy (stream);
-			return NULL;
-		}
-		
-		obfuscated = true;
-	}
-	
 	index = new FontIndex (name);
 	index->path = g_strdup (path);
+	index->fonts->Append (file);
 	
-	// cache font info
-	index->CacheFontInfo (libft2, path, stream, face, obfuscated ? filename : NULL);
+	return index;
+}
+
+FontIndexCache *
+FontManager::GetIndexCache ()
+{
+	char *filename;
 	
-	font_stream_destroy (stream);
+	if (index_cache == NULL) {
+		filename = FontIndexCache::GetDefaultFilename ();
+		index_cache = new FontIndexCache (filename);
+		g_free (filename);
+	}
 	
-	return index;
+	return index_cache;
 }
 
 void
@@ -1215,9 +1269,9 @@ FontManager::AddResource (const char *resource_id, const char *path)
 		return;
 	
 	if (S_ISDIR (st.st_mode))
-		index = IndexFontDirectory (libft2, resource_id, path);
+		index = IndexFontDirectory (libft2, GetIndexCache (), resource_id, path);
 	else if (S_ISREG (st.st_mode))
-		index = IndexFontFile (libft2, resource_id, path);
+		index = IndexFontFile (libft2, GetIndexCache (), resource_id, path);
 	else
 		return;
 	
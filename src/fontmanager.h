@@ -26,6 +26,7 @@ namespace Moonlight {
 struct ManagedStreamCallbacks;
 class FontManager;
 class FontFace;
+class FontIndexCache;
 
 struct GlyphMetrics {
 	double horiBearingX;
@@ -179,8 +180,10 @@ class FontManager {
 	GHashTable *system_faces;
 	GHashTable *resources;
 	GHashTable *faces;
+	FontIndexCache *index_cache;
 	char *root;
 	
+	FontIndexCache *GetIndexCache ();
 	FontFace *OpenFontResource (const char *resource, const char *family, int index, FontStretches stretch, FontWeights weight, FontStyles style);
 	FontFace *OpenSystemFont (const char *family, FontStretches stretch, FontWeights weight, FontStyles style);
 	FontFace *OpenFontFace (const char *filename, const char *guid, int index);
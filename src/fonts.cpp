@@ -29,8 +29,11 @@ namespace Moonlight {
 // TextFont
 //
 
+gint TextFont::next_serial = 1;
+
 TextFont::TextFont (FontFace **faces, int n_faces, int master, bool gapless, double size)
 {
+	this->serial = NextSerial ();
 	this->simulate = StyleSimulationsNone;
 	this->n_faces = n_faces;
 	this->gapless = gapless;
@@ -473,6 +476,7 @@ TextFont::SetSize (double size)
 		return false;
 	
 	this->size = size;
+	this->serial = NextSerial ();
 	
 	UpdateFaceExtents ();
 	ClearGlyphCache ();
@@ -493,6 +497,7 @@ TextFont::SetStyleSimulations (StyleSimulations simulate)
 		return false;
 	
 	this->simulate = simulate;
+	this->serial = NextSerial ();
 	
 	ClearGlyphCache ();
 	
@@ -40,6 +40,13 @@ class TextFont {
 	GlyphInfo glyphs[GLYPH_CACHE_SIZE];
 	int n_glyphs;
 	
+	// changes whenever the glyph metrics might have changed
+	guint32 serial;
+	static gint next_serial;
+	
+	// fonts are created and resized on more than one thread
+	static guint32 NextSerial () { return (guint32) g_atomic_int_exchange_and_add (&next_serial, 1); }
+	
 	TextFont (FontFace **faces, int n_faces, int master, bool gapless, double size);
 	
 	GlyphInfo *GetGlyphInfo (FontFace *face, gunichar unichar, guint32 index);
@@ -62,6 +69,10 @@ class TextFont {
 	GlyphInfo *GetGlyphInfo (gunichar unichar);
 	GlyphInfo *GetGlyphInfoByIndex (guint32 index);
 	
+	// Text layouts cache glyph metrics, and check this value to
+	// know if they are still valid (no two fonts share a serial).
+	guint32 GetSerial () const { return serial; }
+	
 	double Kerning (GlyphInfo *left, GlyphInfo *right);
 	double Descender () const;
         double Ascender () const;
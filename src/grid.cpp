@@ -28,13 +28,25 @@ namespace Moonlight {
 Grid::Grid ()
 {
 	SetObjectType (Type::GRID);
-	row_matrix = NULL;
-	col_matrix = NULL;
+	row_segments = NULL;
+	col_segments = NULL;
+	row_segments_count = 0;
+	col_segments_count = 0;
+	row_spans = g_array_new (false, false, sizeof (SegmentSpan));
+	col_spans = g_array_new (false, false, sizeof (SegmentSpan));
+	arrange_valid = false;
+	measure_valid = false;
+	measure_steps = g_array_new (false, false, sizeof (GridMeasureStep));
+	measured_actual_sizes = g_array_new (false, false, sizeof (double));
 }
 
 Grid::~Grid ()
 {
-	DestroyMatrices ();
+	DestroySegments ();
+	g_array_free (row_spans, true);
+	g_array_free (col_spans, true);
+	g_array_free (measure_steps, true);
+	g_array_free (measured_actual_sizes, true);
 }
 
 double
@@ -59,6 +71,7 @@ Grid::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
 		Invalidate ();
 	}
 
+	measure_valid = false;
 	InvalidateMeasure ();
 
 	NotifyListenersOfPropertyChange (args, error);
@@ -81,6 +94,9 @@ Grid::GetColumnDefinitionsNoAutoCreate ()
 void
 Grid::OnCollectionChanged (Collection *col, CollectionChangedEventArgs *args)
 {
+	// the children, or the definitions
+	measure_valid = false;
+
 	if (PropertyHasValueNoAutoCreate (Grid::ColumnDefinitionsProperty, col)
 	    || PropertyHasValueNoAutoCreate (Grid::RowDefinitionsProperty, col)) {
 		InvalidateMeasure ();
@@ -97,6 +113,7 @@ Grid::OnCollectionItemChanged (Collection *col, DependencyObject *obj, PropertyC
 		    || args->GetId () == Grid::RowProperty
 		    || args->GetId () == Grid::ColumnSpanProperty
 		    || args->GetId () == Grid::RowSpanProperty) {
+			measure_valid = false;
 			InvalidateMeasure ();
 
 			// SL invalidates the measure on the child when these properties change.
@@ -107,6 +124,7 @@ Grid::OnCollectionItemChanged (Collection *col, DependencyObject *obj, PropertyC
 	} else if (col == GetColumnDefinitionsNoAutoCreate () || col == GetRowDefinitionsNoAutoCreate ()) {
 		if (args->GetId() != ColumnDefinition::ActualWidthProperty 
 		    && args->GetId() != RowDefinition::ActualHeightProperty) {
+			measure_valid = false;
 			InvalidateMeasure ();
 		}
 		return;
@@ -115,6 +133,39 @@ Grid::OnCollectionItemChanged (Collection *col, DependencyObject *obj, PropertyC
 	Panel::OnCollectionItemChanged (col, obj, args);
 }
 
+// Adds (or grows) the size needed by the children spanning @start to @end,
+// keeping @spans sorted by end and start, descending.
+static void
+AddSpan (GArray *spans, int start, int end, double size)
+{
+	guint lo = 0, hi = spans->len;
+	SegmentSpan span;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+		SegmentSpan *s = &g_array_index (spans, SegmentSpan, mid);
+
+		if (s->end > end || (s->end == end && s->start > start))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < spans->len) {
+		SegmentSpan *s = &g_array_index (spans, SegmentSpan, lo);
+
+		if (s->start == start && s->end == end) {
+			s->desired_size = MAX (s->desired_size, size);
+			return;
+		}
+	}
+
+	span.start = start;
+	span.end = end;
+	span.desired_size = size;
+	g_array_insert_val (spans, lo, span);
+}
+
 Size
 Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 {
@@ -134,11 +185,21 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 	if (empty_rows) row_count = 1;
 	if (empty_cols) col_count = 1;
 
-	CreateMatrices (row_count, col_count);
+	arrange_valid = false;
+
+	if (ReplayMeasure (availableSize, error))
+		return measured_result;
+	if (error->number)
+		return Size (0, 0);
+
+	measure_valid = false;
+	g_array_set_size (measure_steps, 0);
+
+	CreateSegments (row_count, col_count);
 
 	if (empty_rows) {
-		row_matrix [0][0] = Segment (0.0, 0, INFINITY, GridUnitTypeStar);
-		row_matrix [0][0].stars = 1.0;
+		row_segments [0] = Segment (0.0, 0, INFINITY, GridUnitTypeStar);
+		row_segments [0].stars = 1.0;
 		total_stars.height += 1.0;
 	}
 	else {
@@ -147,25 +208,25 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 			GridLength* height = rowdef->GetHeight();
 
 			rowdef->SetActualHeight (INFINITY);
-			row_matrix [i][i] = Segment (0.0, rowdef->GetMinHeight (), rowdef->GetMaxHeight (), height->type);
+			row_segments [i] = Segment (0.0, rowdef->GetMinHeight (), rowdef->GetMaxHeight (), height->type);
 
 			if (height->type == GridUnitTypePixel) {
-				row_matrix [i][i].offered_size = Grid::Clamp (height->val, row_matrix [i][i].min, row_matrix [i][i].max);
-				row_matrix [i][i].desired_size = row_matrix [i][i].offered_size;
-				rowdef->SetActualHeight (row_matrix [i][i].offered_size );
+				row_segments [i].offered_size = Grid::Clamp (height->val, row_segments [i].min, row_segments [i].max);
+				row_segments [i].desired_size = row_segments [i].offered_size;
+				rowdef->SetActualHeight (row_segments [i].offered_size );
 			} else if (height->type == GridUnitTypeStar) {
-				row_matrix [i][i].stars = height->val;
+				row_segments [i].stars = height->val;
 				total_stars.height += height->val;
 			} else if (height->type == GridUnitTypeAuto) {
-				row_matrix [i][i].offered_size = Grid::Clamp (0, row_matrix [i][i].min, row_matrix [i][i].max);
-				row_matrix [i][i].desired_size = row_matrix [i][i].offered_size;
+				row_segments [i].offered_size = Grid::Clamp (0, row_segments [i].min, row_segments [i].max);
+				row_segments [i].desired_size = row_segments [i].offered_size;
 			}
 		}
 	}
 
 	if (empty_cols) {
-		col_matrix [0][0] = Segment (0.0, 0, INFINITY, GridUnitTypeStar);
-		col_matrix [0][0].stars = 1.0;
+		col_segments [0] = Segment (0.0, 0, INFINITY, GridUnitTypeStar);
+		col_segments [0].stars = 1.0;
 		total_stars.width += 1.0;
 	}
 	else {
@@ -174,30 +235,31 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 			GridLength *width = coldef->GetWidth ();
 
 			coldef->SetActualWidth (INFINITY);
-			col_matrix [i][i] = Segment (0.0, coldef->GetMinWidth (), coldef->GetMaxWidth (), width->type);
+			col_segments [i] = Segment (0.0, coldef->GetMinWidth (), coldef->GetMaxWidth (), width->type);
 
 			if (width->type == GridUnitTypePixel) {
-				col_matrix [i][i].offered_size = Grid::Clamp (width->val, col_matrix [i][i].min, col_matrix [i][i].max);
-				col_matrix [i][i].desired_size = col_matrix [i][i].offered_size;
-				coldef->SetActualWidth (col_matrix [i][i].offered_size);
+				col_segments [i].offered_size = Grid::Clamp (width->val, col_segments [i].min, col_segments [i].max);
+				col_segments [i].desired_size = col_segments [i].offered_size;
+				coldef->SetActualWidth (col_segments [i].offered_size);
 			} else if (width->type == GridUnitTypeStar) {
-				col_matrix [i][i].stars = width->val;
+				col_segments [i].stars = width->val;
 				total_stars.width += width->val;
 			} else if (width->type == GridUnitTypeAuto) {
-				col_matrix [i][i].offered_size = Grid::Clamp (0, col_matrix [i][i].min, col_matrix [i][i].max);
-				col_matrix [i][i].desired_size = col_matrix [i][i].offered_size;
+				col_segments [i].offered_size = Grid::Clamp (0, col_segments [i].min, col_segments [i].max);
+				col_segments [i].desired_size = col_segments [i].offered_size;
 			}
 		}
 	}
 
 	List sizes;
 	GridNode *node;
-	GridNode *separator = new GridNode (NULL, 0, 0, 0);
+	GridNode *separator = new GridNode (NULL, NULL, 0, 0, 0);
+	bool sizes_changed = true;
 	sizes.Append (separator);
 	
 	// Pre-process the grid children so that we know what types of elements we have so
 	// we can apply our special measuring rules.
-	GridWalker grid_walker (this, row_matrix, row_matrix_dim, col_matrix, col_matrix_dim);
+	GridWalker grid_walker (this, row_segments, row_segments_count, col_segments, col_segments_count);
 	for (int i = 0; i < 6; i++) {
 		// These bools tell us which grid element type we should be measuring. i.e.
 		// 'star/auto' means we should measure elements with a star row and auto col
@@ -208,9 +270,12 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 		bool non_star = i == 4;
 		bool remaining_star = i == 5;
 
-		if (hasChildren) {
+		// the star segments only need to be expanded again if the
+		// sizes of the other segments changed in the previous phase
+		if (hasChildren && sizes_changed) {
 			ExpandStarCols (totalSize);
 			ExpandStarRows (totalSize);
+			sizes_changed = false;
 		}
 
 		VisualTreeWalker walker = VisualTreeWalker (this);
@@ -229,12 +294,12 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 			rowspan = MIN (Grid::GetRowSpan (child), row_count - row);
 
 			for (int r = row; r < row + rowspan; r++) {
-				star_row |= row_matrix [r][r].type == GridUnitTypeStar;
-				auto_row |= row_matrix [r][r].type == GridUnitTypeAuto;
+				star_row |= row_segments [r].type == GridUnitTypeStar;
+				auto_row |= row_segments [r].type == GridUnitTypeAuto;
 			}
 			for (int c = col; c < col + colspan; c++) {
-				star_col |= col_matrix [c][c].type == GridUnitTypeStar;
-				auto_col |= col_matrix [c][c].type == GridUnitTypeAuto;
+				star_col |= col_segments [c].type == GridUnitTypeStar;
+				auto_col |= col_segments [c].type == GridUnitTypeAuto;
 			}
 
 			// This series of if statements checks whether or not we should measure
@@ -280,14 +345,20 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 			}
 
 			for (int r = row; r < row + rowspan; r++) {
-				child_size.height += row_matrix [r][r].offered_size;
+				child_size.height += row_segments [r].offered_size;
 			}
 			for (int c = col; c < col + colspan; c++) {
-				child_size.width += col_matrix [c][c].offered_size;
+				child_size.width += col_segments [c].offered_size;
 			}
 
 			child->MeasureWithError (child_size, error);
 			Size desired = child->GetDesiredSize();
+
+			GridMeasureStep step;
+			step.child = child;
+			step.available = child_size;
+			step.desired = desired;
+			g_array_append_val (measure_steps, step);
 	
 			// Elements distribute their height based on two rules:
 			// 1) Elements with rowspan/colspan == 1 distribute their height first
@@ -296,19 +367,32 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 			// the list and everything else before it. Then to process, just keep popping
 			// elements off the end of the list.
 			if (!star_auto) {
-				node = new GridNode (row_matrix, row + rowspan - 1, row, desired.height);
-				sizes.InsertBefore (node, node->row == node->col ? separator->next : separator);
+				node = new GridNode (row_segments, row_spans, row, row + rowspan - 1, desired.height);
+				sizes.InsertBefore (node, node->start == node->end ? separator->next : separator);
 			}
-			node = new GridNode (col_matrix, col + colspan  - 1, col, desired.width);
-			sizes.InsertBefore (node, node->row == node->col ? separator->next : separator);
+			node = new GridNode (col_segments, col_spans, col, col + colspan - 1, desired.width);
+			sizes.InsertBefore (node, node->start == node->end ? separator->next : separator);
 		}
 		
 		sizes.Unlink (separator);
 
+		bool allocated = false;
 		while (GridNode *node= (GridNode *) sizes.Last ()) {
-			node->matrix [node->row][node->col].desired_size = MAX (node->matrix [node->row][node->col].desired_size, node->size);
-			AllocateDesiredSize (row_count, col_count);
+			if (node->start == node->end)
+				node->segments [node->start].desired_size = MAX (node->segments [node->start].desired_size, node->size);
+			else
+				AddSpan (node->spans, node->start, node->end, node->size);
+			AllocateDesiredSize ();
 			sizes.Remove (node);
+			allocated = true;
+		}
+
+		if (allocated) {
+			sizes_changed = true;
+			for (int r = 0; r < row_segments_count; r++)
+				row_segments [r].offered_size = row_segments [r].desired_size;
+			for (int c = 0; c < col_segments_count; c++)
+				col_segments [c].offered_size = col_segments [c].desired_size;
 		}
 
 		sizes.Append (separator);
@@ -323,13 +407,75 @@ Grid::MeasureOverrideWithError (Size availableSize, MoonError *error)
 
 	Size grid_size = Size (0, 0);
 	for (int c = 0; c < col_count; c ++)
-		grid_size.width += col_matrix [c][c].desired_size;
+		grid_size.width += col_segments [c].desired_size;
 	for (int r = 0; r < row_count; r ++)
-		grid_size.height += row_matrix [r][r].desired_size;
+		grid_size.height += row_segments [r].desired_size;
+
+	if (!error->number) {
+		SaveActualSizes ();
+		measured_size = availableSize;
+		measured_result = grid_size;
+		measure_valid = true;
+	}
 
 	return grid_size;
 }
 
+// Measures the children the way the last measure did. Unless one of them
+// desires another size than it did then, the rest of the measure would
+// come to the same segments, which are still there.
+bool
+Grid::ReplayMeasure (Size availableSize, MoonError *error)
+{
+	if (!measure_valid || availableSize != measured_size)
+		return false;
+
+	for (guint i = 0; i < measure_steps->len; i++) {
+		GridMeasureStep *step = &g_array_index (measure_steps, GridMeasureStep, i);
+
+		step->child->MeasureWithError (step->available, error);
+		if (error->number || step->child->GetDesiredSize () != step->desired)
+			return false;
+	}
+
+	RestoreActualSizes ();
+
+	return true;
+}
+
+void
+Grid::SaveActualSizes ()
+{
+	ColumnDefinitionCollection *columns = GetColumnDefinitionsNoAutoCreate ();
+	RowDefinitionCollection *rows = GetRowDefinitionsNoAutoCreate ();
+	int col_count = columns ? columns->GetCount () : 0;
+	int row_count = rows ? rows->GetCount () : 0;
+
+	g_array_set_size (measured_actual_sizes, 0);
+	for (int r = 0; r < row_count; r++) {
+		double height = rows->GetValueAt (r)->AsRowDefinition ()->GetActualHeight ();
+		g_array_append_val (measured_actual_sizes, height);
+	}
+	for (int c = 0; c < col_count; c++) {
+		double width = columns->GetValueAt (c)->AsColumnDefinition ()->GetActualWidth ();
+		g_array_append_val (measured_actual_sizes, width);
+	}
+}
+
+void
+Grid::RestoreActualSizes ()
+{
+	ColumnDefinitionCollection *columns = GetColumnDefinitionsNoAutoCreate ();
+	RowDefinitionCollection *rows = GetRowDefinitionsNoAutoCreate ();
+	int col_count = columns ? columns->GetCount () : 0;
+	int row_count = rows ? rows->GetCount () : 0;
+
+	for (int r = 0; r < row_count; r++)
+		rows->GetValueAt (r)->AsRowDefinition ()->SetActualHeight (g_array_index (measured_actual_sizes, double, r));
+	for (int c = 0; c < col_count; c++)
+		columns->GetValueAt (c)->AsColumnDefinition ()->SetActualWidth (g_array_index (measured_actual_sizes, double, row_count + c));
+}
+
 void
 Grid::ExpandStarRows (Size availableSize)
 {
@@ -339,18 +485,18 @@ Grid::ExpandStarRows (Size availableSize)
 	// When expanding star rows, we need to zero out their height before
 	// calling AssignSize. AssignSize takes care of distributing the 
 	// available size when there are Mins and Maxs applied.
-	for (int i = 0; i < row_matrix_dim; i++) {
-		if (row_matrix [i][i].type == GridUnitTypeStar)
-			row_matrix [i][i].offered_size = 0.0;
+	for (int i = 0; i < row_segments_count; i++) {
+		if (row_segments [i].type == GridUnitTypeStar)
+			row_segments [i].offered_size = 0.0;
 		else
-			availableSize.height = MAX (availableSize.height - row_matrix [i][i].offered_size, 0);
+			availableSize.height = MAX (availableSize.height - row_segments [i].offered_size, 0);
 	}
 
-	AssignSize (row_matrix, 0, row_matrix_dim - 1, &availableSize.height, GridUnitTypeStar, false);
+	AssignSize (row_segments, 0, row_segments_count - 1, &availableSize.height, GridUnitTypeStar, false);
 	if (row_count > 0) {
-		for (int i = 0; i < row_matrix_dim; i++)
-		if (row_matrix [i][i].type == GridUnitTypeStar)
-				rows->GetValueAt (i)->AsRowDefinition ()->SetActualHeight (row_matrix [i][i].offered_size);
+		for (int i = 0; i < row_segments_count; i++)
+		if (row_segments [i].type == GridUnitTypeStar)
+				rows->GetValueAt (i)->AsRowDefinition ()->SetActualHeight (row_segments [i].offered_size);
 	}
 }
 
@@ -360,73 +506,67 @@ Grid::ExpandStarCols (Size availableSize)
 	ColumnDefinitionCollection *columns = GetColumnDefinitionsNoAutoCreate ();
 	int columns_count = columns ? columns->GetCount () : 0;
 
-	for (int i = 0; i < col_matrix_dim; i++) {
-		if (col_matrix [i][i].type == GridUnitTypeStar)
-			col_matrix [i][i].offered_size = 0;
+	for (int i = 0; i < col_segments_count; i++) {
+		if (col_segments [i].type == GridUnitTypeStar)
+			col_segments [i].offered_size = 0;
 		else
-			availableSize.width = MAX (availableSize.width - col_matrix [i][i].offered_size, 0);
+			availableSize.width = MAX (availableSize.width - col_segments [i].offered_size, 0);
 	}
 
-	AssignSize (col_matrix, 0, col_matrix_dim - 1, &availableSize.width, GridUnitTypeStar, false);
+	AssignSize (col_segments, 0, col_segments_count - 1, &availableSize.width, GridUnitTypeStar, false);
 		
 	if (columns_count > 0) {
-		for (int i = 0; i < col_matrix_dim; i++)
-			if (col_matrix [i][i].type == GridUnitTypeStar)
-				columns->GetValueAt (i)->AsColumnDefinition ()->SetActualWidth (col_matrix [i][i].offered_size);
+		for (int i = 0; i < col_segments_count; i++)
+			if (col_segments [i].type == GridUnitTypeStar)
+				columns->GetValueAt (i)->AsColumnDefinition ()->SetActualWidth (col_segments [i].offered_size);
 	}
 }
 
 void
-Grid::AllocateDesiredSize  (int row_count, int col_count)
+Grid::AllocateDesiredSize ()
 {
 	// First allocate the heights of the RowDefinitions, then allocate
 	// the widths of the ColumnDefinitions.
 	for (int i = 0; i < 2; i ++) {
-		Segment **matrix = i == 0 ? row_matrix : col_matrix;
-		int count = i == 0 ? row_count : col_count;
-
-		for (int row = count - 1; row >= 0; row--) {
-			for (int col = row; col >= 0; col--) {
-					bool spans_star = false;
-					for (int j = row; j >= col; j --)
-						spans_star |= matrix [j][j].type == GridUnitTypeStar;
-			
-				// This is the amount of pixels which must be available between the grid rows
-				// at index 'col' and 'row'. i.e. if 'row' == 0 and 'col' == 2, there must
-				// be at least 'matrix [row][col].size' pixels of height allocated between
-				// all the rows in the range col -> row.
-				double current = matrix [row][col].desired_size;
-
-				// Count how many pixels have already been allocated between the grid rows
-				// in the range col -> row. The amount of pixels allocated to each grid row/column
-				// is found on the diagonal of the matrix.
-				double total_allocated = 0;
-				for (int i = row; i >= col; i--)
-					total_allocated += matrix [i][i].desired_size;
-
-				// If the size requirement has not been met, allocate the additional required
-				// size between 'pixel' rows, then 'star' rows, finally 'auto' rows, until all
-				// height has been assigned.
-				if (total_allocated < current) {
-					double additional = current - total_allocated;
-					if (spans_star) {
-						AssignSize (matrix, col, row, &additional, GridUnitTypeStar, true);
-					} else {
-						AssignSize (matrix, col, row, &additional, GridUnitTypePixel, true);
-						AssignSize (matrix, col, row, &additional, GridUnitTypeAuto, true);
-					}
+		Segment *segments = i == 0 ? row_segments : col_segments;
+		GArray *spans = i == 0 ? row_spans : col_spans;
+
+		for (guint s = 0; s < spans->len; s++) {
+			SegmentSpan *span = &g_array_index (spans, SegmentSpan, s);
+			bool spans_star = false;
+
+			// This is the amount of pixels which must be available between the grid rows
+			// at index 'start' and 'end'. i.e. if 'start' == 0 and 'end' == 2, there must
+			// be at least 'span->desired_size' pixels of height allocated between
+			// all the rows in the range start -> end.
+			double current = span->desired_size;
+
+			// Count how many pixels have already been allocated between the grid rows
+			// in the range start -> end.
+			double total_allocated = 0;
+			for (int j = span->end; j >= span->start; j--) {
+				spans_star |= segments [j].type == GridUnitTypeStar;
+				total_allocated += segments [j].desired_size;
+			}
+
+			// If the size requirement has not been met, allocate the additional required
+			// size between 'pixel' rows, then 'star' rows, finally 'auto' rows, until all
+			// height has been assigned.
+			if (total_allocated < current) {
+				double additional = current - total_allocated;
+				if (spans_star) {
+					AssignSize (segments, span->start, span->end, &additional, GridUnitTypeStar, true);
+				} else {
+					AssignSize (segments, span->start, span->end, &additional, GridUnitTypePixel, true);
+					AssignSize (segments, span->start, span->end, &additional, GridUnitTypeAuto, true);
 				}
 			}
 		}
 	}
-	for (int r = 0; r < row_matrix_dim; r++)
-		row_matrix [r][r].offered_size = row_matrix [r][r].desired_size;
-	for (int c = 0; c < col_matrix_dim; c++)
-		col_matrix [c][c].offered_size = col_matrix [c][c].desired_size;
 }
 
 void
-Grid::AssignSize (Segment **matrix, int start, int end, double *size, GridUnitType type, bool desired_size)
+Grid::AssignSize (Segment *segments, int start, int end, double *size, GridUnitType type, bool desired_size)
 {
 	double count = 0;
 	bool assigned;
@@ -434,74 +574,65 @@ Grid::AssignSize (Segment **matrix, int start, int end, double *size, GridUnitTy
 	// Count how many segments are of the correct type. If we're measuring Star rows/cols
 	// we need to count the number of stars instead.
 	for (int i = start; i <= end; i++) {
-		double segment_size = desired_size ? matrix [i][i].desired_size : matrix[i][i].offered_size;
-		if (segment_size < matrix [i][i].max)
-			count += type == GridUnitTypeStar ? matrix [i][i].stars : 1;
+		double segment_size = desired_size ? segments [i].desired_size : segments [i].offered_size;
+		if (segment_size < segments [i].max)
+			count += type == GridUnitTypeStar ? segments [i].stars : 1;
 	}
 	do {
 		assigned = false;
 		double contribution = *size / count;
 		
 		for (int i = start; i <= end; i++) {
-			double segment_size = desired_size ? matrix [i][i].desired_size : matrix [i][i].offered_size;
-			if (!(matrix [i][i].type == type && segment_size < matrix [i][i].max))
+			double segment_size = desired_size ? segments [i].desired_size : segments [i].offered_size;
+			if (!(segments [i].type == type && segment_size < segments [i].max))
 				continue;
 
 			double newsize = segment_size;
-			newsize += contribution * (type == GridUnitTypeStar ? matrix [i][i].stars : 1);
-			newsize = MIN (newsize, matrix [i][i].max);
+			newsize += contribution * (type == GridUnitTypeStar ? segments [i].stars : 1);
+			newsize = MIN (newsize, segments [i].max);
 			assigned |= newsize > segment_size;
 			*size -= newsize - segment_size;
 			if (desired_size)
-				matrix [i][i].desired_size = newsize;
+				segments [i].desired_size = newsize;
 			else
-				matrix [i][i].offered_size = newsize;
+				segments [i].offered_size = newsize;
 		}
 	} while (assigned);
 }
 
 void
-Grid::DestroyMatrices ()
+Grid::DestroySegments ()
 {
-	if (row_matrix != NULL) {
-		for (int i = 0; i < row_matrix_dim; i++)
-			delete [] row_matrix [i];
-		delete [] row_matrix;
-		row_matrix = NULL;
-	}
+	delete [] row_segments;
+	row_segments = NULL;
+	row_segments_count = 0;
 
-	if (col_matrix != NULL) {
-		for (int i = 0; i < col_matrix_dim; i++)
-			delete [] col_matrix [i];
-		delete [] col_matrix;
-		col_matrix = NULL;
-	}
+	delete [] col_segments;
+	col_segments = NULL;
+	col_segments_count = 0;
 }
 
 void
-Grid::CreateMatrices (int row_count, int col_count)
+Grid::CreateSegments (int row_count, int col_count)
 {
-	if (!row_matrix || !col_matrix || row_matrix_dim != row_count || col_matrix_dim != col_count) {
-		DestroyMatrices ();
+	if (!row_segments || !col_segments || row_segments_count != row_count || col_segments_count != col_count) {
+		DestroySegments ();
 
-		row_matrix_dim = row_count;
-		row_matrix = new Segment *[row_count];
-		for (int i = 0; i < row_count; i++)
-			row_matrix [i] = new Segment [row_count];
+		row_segments_count = row_count;
+		row_segments = new Segment [row_count];
 
-		col_matrix_dim = col_count;
-		col_matrix = new Segment *[col_count];
-		for (int i = 0; i < col_count; i++)
-			col_matrix [i] = new Segment [col_count];
+		col_segments_count = col_count;
+		col_segments = new Segment [col_count];
 	}
 	
 	for (int r = 0; r < row_count; r ++)
-		for (int rr = 0; rr <= r; rr ++)
-			row_matrix [r][rr] = Segment ();
+		row_segments [r] = Segment ();
 
 	for (int c = 0; c < col_count; c ++)
-		for (int cc = 0; cc <= c; cc ++)
-			col_matrix [c][cc] = Segment ();
+		col_segments [c] = Segment ();
+
+	g_array_set_size (row_spans, 0);
+	g_array_set_size (col_spans, 0);
 }
 
 void
@@ -586,44 +717,57 @@ Grid::ArrangeOverrideWithError (Size finalSize, MoonError *error)
 	int col_count = columns ? columns->GetCount () : 0;
 	int row_count = rows ? rows->GetCount () : 0;
 
-	RestoreMeasureResults ();
+	// nothing was measured since we were last arranged at this size,
+	// the segments (and the definitions' actual sizes) are still right
+	if (!arrange_valid || finalSize != arranged_size) {
+		RestoreMeasureResults ();
+
+		Size total_consumed = Size (0, 0);
+		for (int c = 0; c < col_segments_count; c++) {
+			col_segments [c].offered_size = col_segments [c].desired_size;
+			total_consumed.width += col_segments [c].offered_size;
+		} for (int r = 0; r < row_segments_count; r++) {
+			row_segments [r].offered_size = row_segments [r].desired_size;
+			total_consumed.height += row_segments [r].offered_size;
+		}
 
-	Size total_consumed = Size (0, 0);
-	for (int c = 0; c < col_matrix_dim; c++) {
-		col_matrix [c][c].offered_size = col_matrix [c][c].desired_size;
-		total_consumed.width += col_matrix [c][c].offered_size;
-	} for (int r = 0; r < row_matrix_dim; r++) {
-		row_matrix [r][r].offered_size = row_matrix [r][r].desired_size;
-		total_consumed.height += row_matrix [r][r].offered_size;
-	}
+		if (total_consumed.width != finalSize.width)
+			ExpandStarCols (finalSize);
+		if (total_consumed.height != finalSize.height)
+			ExpandStarRows (finalSize);
 
-	if (total_consumed.width != finalSize.width)
-		ExpandStarCols (finalSize);
-	if (total_consumed.height != finalSize.height)
-		ExpandStarRows (finalSize);
+		for (int c = 0; c < col_count; c++)
+			columns->GetValueAt (c)->AsColumnDefinition ()->SetActualWidth (col_segments [c].offered_size);
+		for (int r = 0; r < row_count; r++)
+			rows->GetValueAt (r)->AsRowDefinition ()->SetActualHeight (row_segments [r].offered_size);
 
-	for (int c = 0; c < col_count; c++)
-		columns->GetValueAt (c)->AsColumnDefinition ()->SetActualWidth (col_matrix [c][c].offered_size);
-	for (int r = 0; r < row_count; r++)
-		rows->GetValueAt (r)->AsRowDefinition ()->SetActualHeight (row_matrix [r][r].offered_size);
+		double offset = 0;
+		for (int c = 0; c < col_segments_count; c++) {
+			col_segments [c].offset = offset;
+			offset += col_segments [c].offered_size;
+		}
+		offset = 0;
+		for (int r = 0; r < row_segments_count; r++) {
+			row_segments [r].offset = offset;
+			offset += row_segments [r].offered_size;
+		}
+
+		arranged_size = finalSize;
+		arrange_valid = true;
+	}
 
 	VisualTreeWalker walker = VisualTreeWalker (this);
 	while (UIElement *child = walker.Step ()) {
-		gint32 col = MIN (Grid::GetColumn (child), col_matrix_dim - 1);
-		gint32 row = MIN (Grid::GetRow (child), row_matrix_dim - 1);
-		gint32 colspan = MIN (Grid::GetColumnSpan (child), col_matrix_dim - col);
-		gint32 rowspan = MIN (Grid::GetRowSpan (child), row_matrix_dim - row);
-
-		Rect child_final = Rect (0, 0, 0, 0);
-		for (int c = 0; c < col; c++)
-			child_final.x += col_matrix [c][c].offered_size;
-		for (int c = col; c < col + colspan; c++)
-			child_final.width += col_matrix [c][c].offered_size;
+		gint32 col = MIN (Grid::GetColumn (child), col_segments_count - 1);
+		gint32 row = MIN (Grid::GetRow (child), row_segments_count - 1);
+		gint32 colspan = MIN (Grid::GetColumnSpan (child), col_segments_count - col);
+		gint32 rowspan = MIN (Grid::GetRowSpan (child), row_segments_count - row);
 
-		for (int r = 0; r < row; r++)
-			child_final.y += row_matrix [r][r].offered_size;
+		Rect child_final = Rect (col_segments [col].offset, row_segments [row].offset, 0, 0);
+		for (int c = col; c < col + colspan; c++)
+			child_final.width += col_segments [c].offered_size;
 		for (int r = row; r < row + rowspan; r++)
-			child_final.height += row_matrix [r][r].offered_size;
+			child_final.height += row_segments [r].offered_size;
 
 		child->ArrangeWithError (child_final, error);
 	}
@@ -634,25 +778,23 @@ Grid::ArrangeOverrideWithError (Size finalSize, MoonError *error)
 void
 Grid::SaveMeasureResults ()
 {
-	for (int i = 0; i < row_matrix_dim; i++)
-		for (int j = 0; j < row_matrix_dim; j++)
-			row_matrix [i][j].original_size = row_matrix [i][j].offered_size;
+	for (int i = 0; i < row_segments_count; i++)
+		row_segments [i].original_size = row_segments [i].offered_size;
 
-	for (int i = 0; i < col_matrix_dim; i++)
-		for (int j = 0; j < col_matrix_dim; j++)
-			col_matrix [i][j].original_size = col_matrix [i][j].offered_size;
+	for (int i = 0; i < col_segments_count; i++)
+		col_segments [i].original_size = col_segments [i].offered_size;
 }
+
 void
 Grid::RestoreMeasureResults ()
 {
-	for (int i = 0; i < row_matrix_dim; i++)
-		for (int j = 0; j < row_matrix_dim; j++)
-			row_matrix [i][j].offered_size = row_matrix [i][j].original_size;
+	for (int i = 0; i < row_segments_count; i++)
+		row_segments [i].offered_size = row_segments [i].original_size;
 
-	for (int i = 0; i < col_matrix_dim; i++)
-		for (int j = 0; j < col_matrix_dim; j++)
-			col_matrix [i][j].offered_size = col_matrix [i][j].original_size;
+	for (int i = 0; i < col_segments_count; i++)
+		col_segments [i].offered_size = col_segments [i].original_size;
 }
+
 //
 // ColumnDefinitionCollection
 //
@@ -738,6 +880,7 @@ Segment::Segment (double offered_size, double min, double max, GridUnitType type
 void
 Segment::Init (double offered_size, double min, double max, GridUnitType type)
 {
+	this->offset = 0;
 	this->desired_size = 0;
 	this->max = max;
 	this->min = min;
@@ -748,7 +891,7 @@ Segment::Init (double offered_size, double min, double max, GridUnitType type)
 	this->original_size = this->offered_size;
 }
 
-GridWalker::GridWalker (Grid *grid, Segment **row_matrix, int row_count, Segment **col_matrix, int col_count)
+GridWalker::GridWalker (Grid *grid, Segment *row_segments, int row_count, Segment *col_segments, int col_count)
 {
 	has_auto_auto = false;
 	has_star_auto = false;
@@ -767,12 +910,12 @@ GridWalker::GridWalker (Grid *grid, Segment **row_matrix, int row_count, Segment
 		gint32 rowspan = MIN (Grid::GetRowSpan (child), row_count - row);
 
 		for (int r = row; r < row + rowspan; r++) {
-			star_row |= row_matrix [r][r].type == GridUnitTypeStar;
-			auto_row |= row_matrix [r][r].type == GridUnitTypeAuto;
+			star_row |= row_segments [r].type == GridUnitTypeStar;
+			auto_row |= row_segments [r].type == GridUnitTypeAuto;
 		}
 		for (int c = col; c < col + colspan; c++) {
-			star_col |= col_matrix [c][c].type == GridUnitTypeStar;
-			auto_col |= col_matrix [c][c].type == GridUnitTypeAuto;
+			star_col |= col_segments [c].type == GridUnitTypeStar;
+			auto_col |= col_segments [c].type == GridUnitTypeAuto;
 		}
 
 		has_auto_auto |= auto_row && auto_col && !star_row && !star_col;
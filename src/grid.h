@@ -151,6 +151,7 @@ class RowDefinitionCollection : public DependencyObjectCollection {
 };
 
 struct Segment {
+	double offset; // where the segment starts, once the grid is arranged
 	double original_size;
 	double max;
 	double min;
@@ -166,20 +167,62 @@ struct Segment {
 	void Init (double offered_size, double min, double max, GridUnitType type);
 };
 
+// The size needed by the children which span the segments @start to @end.
+struct SegmentSpan {
+	int start;
+	int end;
+	double desired_size;
+};
+
+// A child measured by the grid, the size it was offered and the size it desired.
+struct GridMeasureStep {
+	UIElement *child;
+	Size available;
+	Size desired;
+};
+
 /* @Namespace=System.Windows.Controls */
 class Grid : public Panel {
-	int row_matrix_dim;
-	int col_matrix_dim;
-	Segment **row_matrix;
-	Segment **col_matrix;
+	// One segment per row (column), and the sizes needed by the children
+	// spanning several of them, sorted by their end, then their start,
+	// descending (the order in which they're allocated). This is what used
+	// to be a rows x rows (columns x columns) matrix, with the segments on
+	// its diagonal and the spans below it.
+	int row_segments_count;
+	int col_segments_count;
+	Segment *row_segments;
+	Segment *col_segments;
+	GArray *row_spans;
+	GArray *col_spans;
+
+	// The segments haven't changed since they were arranged at
+	// arranged_size, arranging again at that size only positions the
+	// children.
+	bool arrange_valid;
+	Size arranged_size;
+
+	// The children measured by the last measure, in order. Measuring
+	// again at measured_size with the same definitions and children
+	// measures them the same way, and if each of them desires the same
+	// size, the star and auto sizes (the segments, and the definitions'
+	// actual sizes) are those of the last measure.
+	bool measure_valid;
+	Size measured_size;
+	Size measured_result;
+	GArray *measure_steps;
+	GArray *measured_actual_sizes;
+
+	bool ReplayMeasure (Size availableSize, MoonError *error);
+	void SaveActualSizes ();
+	void RestoreActualSizes ();
 	
 	RowDefinitionCollection* GetRowDefinitionsNoAutoCreate ();
 	ColumnDefinitionCollection* GetColumnDefinitionsNoAutoCreate ();
 
-	void AllocateDesiredSize (int row_count, int col_count);
-	void AssignSize (Segment **matrix, int start, int end, double *size, GridUnitType type, bool desired_size);
-	void CreateMatrices (int row_count, int col_count);
-	void DestroyMatrices ();
+	void AllocateDesiredSize ();
+	void AssignSize (Segment *segments, int start, int end, double *size, GridUnitType type, bool desired_size);
+	void CreateSegments (int row_count, int col_count);
+	void DestroySegments ();
 	void ExpandStarRows (Size availableSize);
 	void ExpandStarCols (Size availableSize);
 
@@ -259,7 +302,7 @@ class GridWalker {
 	bool HasAutoAuto () { return has_auto_auto; }
 	bool HasStarAuto () { return has_star_auto; }
 	bool HasAutoStar () { return has_auto_star; }
-	GridWalker (Grid *grid, Segment **row_matrix, int row_count, Segment **col_matrix, int col_count);
+	GridWalker (Grid *grid, Segment *row_segments, int row_count, Segment *col_segments, int col_count);
 
  private:
 	bool has_auto_auto;
@@ -269,15 +312,17 @@ class GridWalker {
 
 class GridNode : public List::Node {
 public:
-	int row;
-	int col;
+	int start;
+	int end;
 	double size;
-	Segment ** matrix;
-
-	GridNode (Segment **matrix, int row, int col, double size) {
-		this->matrix = matrix;
-		this->row = row;
-		this->col = col;
+	Segment *segments;
+	GArray *spans;
+
+	GridNode (Segment *segments, GArray *spans, int start, int end, double size) {
+		this->segments = segments;
+		this->spans = spans;
+		this->start = start;
+		this->end = end;
 		this->size = size;
 	}
 };
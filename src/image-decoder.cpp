@@ -0,0 +1,551 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * image-decoder.cpp: decodes images on a pool of worker threads
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image-decoder.h"
+#include "bitmapimage.h"
+#include "deployment.h"
+#include "runtime.h"
+#include "debug.h"
+#include "trace.h"
+
+namespace Moonlight {
+
+// the memory the images being decoded may use before the next one has to wait
+#define IMAGE_DECODE_MEMORY_LIMIT (64 * 1024 * 1024)
+
+#ifdef WORDS_BIGENDIAN
+#define set_pixel_bgra(pixel,index,b,g,r,a) \
+	G_STMT_START { \
+		((unsigned char *)(pixel))[index]   = a; \
+		((unsigned char *)(pixel))[index+1] = r; \
+		((unsigned char *)(pixel))[index+2] = g; \
+		((unsigned char *)(pixel))[index+3] = b; \
+	} G_STMT_END
+#define get_pixel_bgr_p(p,b,g,r) \
+	G_STMT_START { \
+		r = *(p);   \
+		g = *(p+1); \
+		b = *(p+2); \
+	} G_STMT_END
+#else
+#define set_pixel_bgra(pixel,index,b,g,r,a) \
+	G_STMT_START { \
+		((unsigned char *)(pixel))[index]   = b; \
+		((unsigned char *)(pixel))[index+1] = g; \
+		((unsigned char *)(pixel))[index+2] = r; \
+		((unsigned char *)(pixel))[index+3] = a; \
+	} G_STMT_END
+#define get_pixel_bgr_p(p,b,g,r) \
+	G_STMT_START { \
+		b = *(p);   \
+		g = *(p+1); \
+		r = *(p+2); \
+	} G_STMT_END
+#endif
+#define get_pixel_bgra(color, b, g, r, a) \
+	G_STMT_START { \
+		a = *(p+3);	\
+		r = *(p+2);	\
+		g = *(p+1);	\
+		b = *(p+0);	\
+	} G_STMT_END
+#include "alpha-premul-table.inc"
+
+//
+// Expands RGB to ARGB allocating new buffer for it.
+//
+static gpointer
+expand_rgb_to_argb (MoonPixbuf *pixbuf)
+{
+	guchar *pb_pixels = pixbuf->GetPixels ();
+	guchar *p;
+	int w = pixbuf->GetWidth ();
+	int h = pixbuf->GetHeight ();
+	int stride = w * 4;
+	guchar *data = (guchar *) g_malloc (stride * h);
+	guchar *out;
+
+	for (int y = 0; y < h; y ++) {
+		p = pb_pixels + y * pixbuf->GetRowStride ();
+		out = data + y * (stride);
+		for (int x = 0; x < w; x ++) {
+			guchar r, g, b;
+
+			get_pixel_bgr_p (p, b, g, r);
+			set_pixel_bgra (out, 0, r, g, b, 255);
+
+			p += 3;
+			out += 4;
+		}
+	}
+
+	return (gpointer) data;
+}
+
+//
+// Converts RGBA unmultiplied alpha to ARGB pre-multiplied alpha.
+//
+static gpointer
+premultiply_rgba (MoonPixbuf *pixbuf)
+{
+	guchar *pb_pixels = pixbuf->GetPixels ();
+	guchar *p;
+	int w = pixbuf->GetWidth ();
+	int h = pixbuf->GetHeight ();
+	int stride = w * 4;
+	guchar *data = (guchar *) g_malloc (stride * h);
+	guchar *out;
+
+	for (int y = 0; y < h; y ++) {
+		p = pb_pixels + y * pixbuf->GetRowStride ();
+		out = data + y * (stride);
+		for (int x = 0; x < w; x ++) {
+			guchar r, g, b, a;
+
+			get_pixel_bgra (p, b, g, r, a);
+
+			/* pre-multipled alpha */
+			if (a == 0) {
+				r = g = b = 0;
+			}
+			else if (a < 255) {
+				r = pre_multiplied_table [r][a];
+				g = pre_multiplied_table [g][a];
+				b = pre_multiplied_table [b][a];
+			}
+
+			/* store it back, swapping red and blue */
+			set_pixel_bgra (out, 0, r, g, b, a);
+
+			p += 4;
+			out += 4;
+		}
+	}
+
+	return (gpointer) data;
+}
+
+/*
+ * ImageDecodeJob
+ */
+
+ImageDecodeJob::ImageDecodeJob (BitmapImage *image, MoonPixbufLoader *loader, GByteArray *data)
+{
+	int w, h;
+
+	this->image = image;
+	this->image->ref ();
+	this->loader = loader;
+	this->data = data;
+	max_width = 0;
+	max_height = 0;
+	pixels = NULL;
+	width = 0;
+	height = 0;
+	error = NULL;
+	state = ImageDecodeQueued;
+	cancelled = false;
+
+	// the loader's pixbuf plus our premultiplied copy of it
+	if (data != NULL && ImageDecoder::GetImageSize (data->data, data->len, &w, &h))
+		cost = (gsize) w * h * 8;
+	else
+		cost = data != NULL ? data->len * 10 : 0;
+}
+
+ImageDecodeJob::~ImageDecodeJob ()
+{
+	image->unref ();
+	delete loader;
+	if (data)
+		g_byte_array_free (data, true);
+	g_free (pixels);
+	delete error;
+}
+
+void
+ImageDecodeJob::Decode ()
+{
+	MoonPixbuf *pixbuf;
+
+	if (max_width > 0 || max_height > 0)
+		loader->SetMaxSize (max_width, max_height);
+
+	if (data != NULL && data->len > 0)
+		loader->Write (data->data, data->len, &error);
+
+	loader->Close (error == NULL ? &error : NULL);
+
+	// the encoded data isn't needed anymore
+	if (data != NULL) {
+		g_byte_array_free (data, true);
+		data = NULL;
+	}
+
+	if (error)
+		return;
+
+	if (!(pixbuf = loader->GetPixbuf ())) {
+		error = new MoonError (MoonError::EXCEPTION, 4001, "failed to create image data");
+		return;
+	}
+
+	width = pixbuf->GetWidth ();
+	height = pixbuf->GetHeight ();
+
+	// PixelFormat has been dropped and only Pbgra32 is supported
+	// http://blogs.msdn.com/silverlight_sdk/archive/2009/07/01/breaking-changes-document-errata-silverlight-3.aspx
+	// not clear if '3' channel is still supported (converted to 4) in SL3
+	if (pixbuf->GetNumChannels () == 4) {
+		if (pixbuf->IsPremultiplied ()) {
+			pixels = pixbuf->GetPixels ();
+		} else {
+			pixels = premultiply_rgba (pixbuf);
+		}
+	} else {
+		pixels = expand_rgb_to_argb (pixbuf);
+	}
+}
+
+/*
+ * ImageDecoder
+ */
+
+MoonMutex ImageDecoder::mutex;
+MoonCond ImageDecoder::condition;
+MoonCond ImageDecoder::completed_condition;
+MoonThread *ImageDecoder::threads [max_threads];
+ImageDecodeJob *ImageDecoder::running [max_threads];
+int ImageDecoder::count = -1;
+List *ImageDecoder::queue = NULL;
+List *ImageDecoder::completed = NULL;
+gsize ImageDecoder::memory_used = 0;
+bool ImageDecoder::shutting_down = false;
+bool ImageDecoder::delivery_pending = false;
+
+bool
+ImageDecoder::AddWork (ImageDecodeJob *job)
+{
+	bool rv;
+
+	mutex.Lock ();
+
+	if (count == -1 && !shutting_down) {
+		const char *env = g_getenv ("MOONLIGHT_IMAGE_DECODE_THREADS");
+		int wanted;
+
+		if (env != NULL)
+			wanted = atoi (env);
+		else
+			wanted = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+
+		wanted = CLAMP (wanted, 0, max_threads);
+
+		queue = new List ();
+		completed = new List ();
+
+		for (count = 0; count < wanted; count++) {
+			running [count] = NULL;
+			if (MoonThread::StartJoinable (&threads [count], WorkerLoop, GINT_TO_POINTER (count)) != 0) {
+				g_warning ("Moonlight: could not create an image decoding thread");
+				break;
+			}
+		}
+
+		LOG_DOWNLOADER ("ImageDecoder: decoding images on %i threads\n", count);
+	}
+
+	rv = count > 0 && !shutting_down;
+
+	if (rv) {
+		job->state = ImageDecodeQueued;
+		queue->Append (job);
+		condition.Signal ();
+	}
+
+	mutex.Unlock ();
+
+	return rv;
+}
+
+void
+ImageDecoder::Cancel (ImageDecodeJob *job)
+{
+	bool destroy = false;
+
+	VERIFY_MAIN_THREAD;
+
+	mutex.Lock ();
+	if (job->state == ImageDecodeQueued) {
+		queue->Unlink (job);
+		destroy = true;
+	} else {
+		// Deliver will destroy it once it has been decoded
+		job->cancelled = true;
+	}
+	mutex.Unlock ();
+
+	if (destroy)
+		delete job;
+}
+
+void
+ImageDecoder::Destroy (ImageDecodeJob *job)
+{
+	if (job->state != ImageDecodeQueued) {
+		mutex.Lock ();
+		memory_used -= job->cost;
+		condition.Broadcast ();
+		mutex.Unlock ();
+	}
+
+	delete job;
+}
+
+bool
+ImageDecoder::DeliverCallback (gpointer data)
+{
+	Deliver ();
+	return false;
+}
+
+void
+ImageDecoder::Deliver ()
+{
+	ImageDecodeJob *job;
+	List jobs;
+
+	VERIFY_MAIN_THREAD;
+
+	mutex.Lock ();
+	delivery_pending = false;
+	while (completed != NULL && (job = (ImageDecodeJob *) completed->First ()) != NULL) {
+		completed->Unlink (job);
+		jobs.Append (job);
+	}
+	mutex.Unlock ();
+
+	while ((job = (ImageDecodeJob *) jobs.First ()) != NULL) {
+		jobs.Unlink (job);
+		if (!job->cancelled) {
+			job->image->SetCurrentDeployment ();
+			job->image->DecodeCompleted (job);
+		}
+		Destroy (job);
+	}
+}
+
+gsize
+ImageDecoder::GetMemoryUsed ()
+{
+	gsize rv;
+
+	mutex.Lock ();
+	rv = memory_used;
+	mutex.Unlock ();
+
+	return rv;
+}
+
+void
+ImageDecoder::RemoveWork (Deployment *deployment)
+{
+	ImageDecodeJob *job, *next;
+	List jobs;
+	bool busy;
+
+	VERIFY_MAIN_THREAD;
+
+	mutex.Lock ();
+
+	if (queue == NULL) {
+		mutex.Unlock ();
+		return;
+	}
+
+	for (job = (ImageDecodeJob *) queue->First (); job != NULL; job = next) {
+		next = (ImageDecodeJob *) job->next;
+		if (job->image->GetUnsafeDeployment () == deployment) {
+			queue->Unlink (job);
+			jobs.Append (job);
+		}
+	}
+
+	do {
+		busy = false;
+		for (int i = 0; i < count; i++) {
+			if (running [i] != NULL && running [i]->image->GetUnsafeDeployment () == deployment)
+				busy = true;
+		}
+		if (busy)
+			completed_condition.Wait (mutex);
+	} while (busy);
+
+	for (job = (ImageDecodeJob *) completed->First (); job != NULL; job = next) {
+		next = (ImageDecodeJob *) job->next;
+		if (job->image->GetUnsafeDeployment () == deployment) {
+			completed->Unlink (job);
+			jobs.Append (job);
+		}
+	}
+
+	mutex.Unlock ();
+
+	/* Don't delete with the lock held, unreffing the image may reenter */
+	while ((job = (ImageDecodeJob *) jobs.First ()) != NULL) {
+		jobs.Unlink (job);
+		Destroy (job);
+	}
+}
+
+void
+ImageDecoder::Shutdown ()
+{
+	ImageDecodeJob *job;
+	int n;
+
+	mutex.Lock ();
+	shutting_down = true;
+	n = MAX (count, 0);
+	condition.Broadcast ();
+	mutex.Unlock ();
+
+	for (int i = 0; i < n; i++)
+		threads [i]->Join ();
+
+	for (int l = 0; l < 2; l++) {
+		List *list = l == 0 ? queue : completed;
+
+		if (list == NULL)
+			continue;
+
+		while ((job = (ImageDecodeJob *) list->First ()) != NULL) {
+			list->Unlink (job);
+			Destroy (job);
+		}
+		delete list;
+	}
+
+	queue = NULL;
+	completed = NULL;
+}
+
+void *
+ImageDecoder::WorkerLoop (void *data)
+{
+	int self = GPOINTER_TO_INT (data);
+	ImageDecodeJob *job;
+
+	Deployment::RegisterThread ();
+
+	mutex.Lock ();
+	while (!shutting_down) {
+		job = (ImageDecodeJob *) queue->First ();
+
+		// the image which has waited the longest is always decoded
+		// once nothing else is using memory, however large it is
+		if (job == NULL || (memory_used > 0 && memory_used + job->cost > IMAGE_DECODE_MEMORY_LIMIT)) {
+			condition.Wait (mutex);
+			continue;
+		}
+
+		queue->Unlink (job);
+		job->state = ImageDecodeRunning;
+		running [self] = job;
+		memory_used += job->cost;
+		mutex.Unlock ();
+
+		{
+			MOON_TRACE_SCOPE ("image", "ImageDecoder::Decode");
+			job->Decode ();
+		}
+
+		mutex.Lock ();
+		running [self] = NULL;
+		job->state = ImageDecodeCompleted;
+		completed->Append (job);
+
+		// one idle callback delivers all the jobs completed until it runs
+		if (!delivery_pending) {
+			delivery_pending = true;
+			Runtime::GetWindowingSystem ()->AddIdle (DeliverCallback, NULL);
+		}
+
+		completed_condition.Broadcast ();
+	}
+	mutex.Unlock ();
+
+	Deployment::UnregisterThread ();
+
+	return NULL;
+}
+
+static inline guint32
+read_uint32_be (const guint8 *p)
+{
+	return ((guint32) p [0] << 24) | (p [1] << 16) | (p [2] << 8) | p [3];
+}
+
+bool
+ImageDecoder::GetImageSize (const guint8 *data, gsize length, int *width, int *height)
+{
+	static const guint8 png_signature [8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	// the IHDR chunk comes first
+	if (length >= 24 && !memcmp (data, png_signature, 8)) {
+		if (memcmp (data + 12, "IHDR", 4) != 0)
+			return false;
+
+		*width = read_uint32_be (data + 16);
+		*height = read_uint32_be (data + 20);
+
+		return *width > 0 && *height > 0;
+	}
+
+	// the segments before the frame header (SOFn) all have a length
+	if (length >= 4 && data [0] == 0xff && data [1] == 0xd8) {
+		gsize i = 2;
+
+		while (i + 9 <= length) {
+			guint8 marker = data [i + 1];
+
+			if (data [i] != 0xff)
+				return false;
+
+			if (marker == 0xff) {
+				// fill byte
+				i++;
+				continue;
+			}
+
+			if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+				*height = (data [i + 5] << 8) | data [i + 6];
+				*width = (data [i + 7] << 8) | data [i + 8];
+
+				return *width > 0 && *height > 0;
+			}
+
+			i += 2 + ((data [i + 2] << 8) | data [i + 3]);
+		}
+	}
+
+	return false;
+}
+
+};
@@ -0,0 +1,121 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * image-decoder.h: decodes images on a pool of worker threads
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_IMAGE_DECODER_H__
+#define __MOON_IMAGE_DECODER_H__
+
+#include <glib.h>
+
+#include "pal.h"
+#include "list.h"
+
+namespace Moonlight {
+
+class BitmapImage;
+class Deployment;
+class EventObject;
+class MoonError;
+
+enum ImageDecodeState {
+	ImageDecodeQueued,
+	ImageDecodeRunning,
+	ImageDecodeCompleted,
+};
+
+/*
+ * ImageDecodeJob: the encoded data of an image, and once it has been
+ * decoded either its pixels (premultiplied ARGB32, what BitmapSource wants)
+ * or the error which prevented decoding it.
+ */
+class ImageDecodeJob : public List::Node {
+public:
+	BitmapImage *image; // reffed, and only unreffed on the main thread
+	MoonPixbufLoader *loader;
+	GByteArray *data;
+	int max_width; // 0 for no limit
+	int max_height;
+
+	// the result
+	gpointer pixels;
+	int width;
+	int height;
+	MoonError *error;
+
+	gsize cost; // an estimate of the memory used while decoding
+	ImageDecodeState state;
+	bool cancelled;
+
+	// takes ownership of @loader and @data
+	ImageDecodeJob (BitmapImage *image, MoonPixbufLoader *loader, GByteArray *data);
+	virtual ~ImageDecodeJob ();
+
+	// Decodes the image on the calling thread.
+	void Decode ();
+};
+
+/*
+ * ImageDecoder: decodes (and premultiplies) images on up to 4 threads,
+ * handing the pixels back to their BitmapImage from an idle callback on the
+ * main thread (not a tick call, which is dropped when the deployment has no
+ * surface or time manager, leaking the job and its memory budget). Images are decoded in the order they were added, but the next
+ * image waits while the images being decoded (and the decoded images not
+ * yet handed back) use more than the memory budget, so that a page full of
+ * large images doesn't have them all decoded at the same time.
+ *
+ * MOONLIGHT_IMAGE_DECODE_THREADS sets the number of threads, 0 decodes every
+ * image synchronously on the main thread.
+ */
+class ImageDecoder {
+	static MoonMutex mutex;
+	static MoonCond condition; // signalled when work has been added or memory released
+	static MoonCond completed_condition; // signalled when a job finished decoding
+	static const int max_threads = 4;
+	static MoonThread *threads [max_threads];
+	static ImageDecodeJob *running [max_threads];
+	static int count; // the number of threads, -1 until they've been created
+	static List *queue; // waiting to be decoded
+	static List *completed; // decoded, waiting for the main thread
+	static gsize memory_used;
+	static bool shutting_down;
+	static bool delivery_pending; // an idle callback will deliver the completed jobs
+
+	static void *WorkerLoop (void *data);
+	static bool DeliverCallback (gpointer data);
+	static void Destroy (ImageDecodeJob *job); /* Main thread only */
+
+public:
+	// Returns false if the job wasn't queued (images are decoded
+	// synchronously, or we're shutting down), in which case the caller
+	// decodes it itself. Otherwise BitmapImage::DecodeCompleted is called
+	// on the main thread once the job has been decoded, unless it's
+	// cancelled first. Main thread only.
+	static bool AddWork (ImageDecodeJob *job);
+	// The job is freed, either now or once its thread is done with it. Main thread only.
+	static void Cancel (ImageDecodeJob *job);
+	// Drops the jobs of the images of @deployment, waiting for the ones being decoded. Main thread only.
+	static void RemoveWork (Deployment *deployment);
+	static void Shutdown ();
+
+	// Hands the decoded images back to their BitmapImage. Called from an idle
+	// callback after images have been decoded. Main thread only.
+	static void Deliver ();
+	// The memory budget used by the images being decoded and the decoded
+	// images not handed back yet.
+	static gsize GetMemoryUsed ();
+
+	// Reads the size of a png or jpeg image from its headers.
+	static bool GetImageSize (const guint8 *data, gsize length, int *width, int *height);
+};
+
+};
+
+#endif /* __MOON_IMAGE_DECODER_H__ */
@@ -674,6 +674,11 @@ Image::OnSubPropertyChanged (DependencyProperty *prop, DependencyObject *obj, Pr
 void
 Image::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
 {
+	if (args->GetId () == FrameworkElement::WidthProperty
+	    || args->GetId () == FrameworkElement::HeightProperty
+	    || args->GetId () == Image::StretchProperty)
+		UpdateDecodeSize ();
+	
 	if (args->GetProperty ()->GetOwnerType() != Type::IMAGE) {
 		MediaBase::OnPropertyChanged (args, error);
 		return;
@@ -706,6 +711,8 @@ Image::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
 				source->AddHandler (BitmapImage::ImageFailedEvent, image_failed, this);
 			}
 
+			UpdateDecodeSize ();
+
 			if (source->GetPixelWidth () > 0 && source->GetPixelHeight () > 0) {
 				RoutedEventArgs *args = MoonUnmanagedFactory::CreateRoutedEventArgs ();
 				ImageOpened (args);
@@ -723,6 +730,38 @@ Image::OnPropertyChanged (PropertyChangedEventArgs *args, MoonError *error)
 	NotifyListenersOfPropertyChange (args, error);
 }
 
+void
+Image::UpdateDecodeSize ()
+{
+	ImageSource *source = GetSource ();
+	BitmapImage *image;
+	double width = GetWidth ();
+	double height = GetHeight ();
+	double scale;
+	int max_width, max_height;
+
+	// a Uniform image with a fixed size is never drawn bigger than that (on
+	// the current transform), so there's no need to decode more pixels
+	if (!source || !source->Is (Type::BITMAPIMAGE) || GetStretch () != StretchUniform)
+		return;
+	if (isnan (width) || isnan (height) || width <= 0.0 || height <= 0.0)
+		return;
+
+	scale = MAX (sqrt (absolute_xform.xx * absolute_xform.xx + absolute_xform.yx * absolute_xform.yx),
+		     sqrt (absolute_xform.xy * absolute_xform.xy + absolute_xform.yy * absolute_xform.yy));
+	max_width = (int) ceil (width * MAX (scale, 1.0));
+	max_height = (int) ceil (height * MAX (scale, 1.0));
+
+	// images shared with bigger Images are decoded big enough for all of them
+	image = (BitmapImage *) source;
+	if (image->GetDecodeWidth () > 0 || image->GetDecodeHeight () > 0) {
+		max_width = MAX (max_width, image->GetDecodeWidth ());
+		max_height = MAX (max_height, image->GetDecodeHeight ());
+	}
+
+	image->SetDecodeSize (max_width, max_height);
+}
+
 bool
 Image::InsideObject (cairo_t *cr, double x, double y)
 {
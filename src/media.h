@@ -162,6 +162,8 @@ class Image : public MediaBase {
 	void ImageOpened (RoutedEventArgs *args);
 	void ImageFailed (ImageErrorEventArgs *args);
 	void SourcePixelDataChanged ();
+	// Decodes the source at most at the size it's shown at
+	void UpdateDecodeSize ();
 
 	static void download_progress (EventObject *sender, EventArgs *calldata, gpointer closure);
 	static void image_opened (EventObject *sender, EventArgs *calldata, gpointer closure);
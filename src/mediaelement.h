@@ -132,7 +132,6 @@ class MediaElement : public FrameworkElement {
 	
 	void PlayOrStop (); // Not thread-safe. To the right thing if we can pause, if we have to autoplay, etc.
 		
-	void CreatePlaylist ();
 	void SetPlaylist (Playlist *playlist); // Adds/removes event handlers
 
  protected:
@@ -280,6 +279,7 @@ class MediaElement : public FrameworkElement {
 	static const char *GetStateName (MediaElementState state); // Thread-safe
 	static const char *GetFlagNames (guint32 flags); // Not thread-safe.
 	
+	void CreatePlaylist (); // an empty playlist and its media player, the Set*Source methods fill it
 	Playlist *GetPlaylist () { return playlist; }
 	TimeSpan GetStartTime ();
 	
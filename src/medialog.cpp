@@ -35,6 +35,7 @@ MediaLog::MediaLog ()
 	cs_user_agent = g_strdup ("");
 	c_quality = 100;
 	x_duration = 0;
+	memset (&frame_pool_stats, 0, sizeof (frame_pool_stats));
 	filelength = g_strdup ("");
 	filesize = g_strdup ("");
 }
@@ -278,6 +279,17 @@ MediaLog::GetLog (bool include_user_name)
 	g_ptr_array_add (keys, (void *) "cs-media-role");
 	g_ptr_array_add (values, g_strdup ("-"));
 
+	if (frame_pool_stats.allocations > 0) {
+		g_ptr_array_add (keys, (void *) "x-framebuffer-allocations");
+		g_ptr_array_add (values, g_strdup_printf ("%" G_GUINT64_FORMAT, frame_pool_stats.allocations));
+		g_ptr_array_add (keys, (void *) "x-framebuffer-reuses");
+		g_ptr_array_add (values, g_strdup_printf ("%" G_GUINT64_FORMAT, frame_pool_stats.reuses));
+		g_ptr_array_add (keys, (void *) "x-framebuffer-trims");
+		g_ptr_array_add (values, g_strdup_printf ("%" G_GUINT64_FORMAT, frame_pool_stats.trims));
+		g_ptr_array_add (keys, (void *) "x-framebuffer-peakbytes");
+		g_ptr_array_add (values, g_strdup_printf ("%" G_GUINT64_FORMAT, frame_pool_stats.peak_bytes));
+	}
+
 	g_ptr_array_add (keys, NULL);
 	g_ptr_array_add (values, NULL);
 
@@ -437,4 +449,23 @@ MediaLog::SetDuration (guint64 value)
 	mutex.Unlock ();
 }
 
+void
+MediaLog::AddFramePoolStats (const MediaFramePoolStats *stats)
+{
+	mutex.Lock ();
+	frame_pool_stats.allocations += stats->allocations;
+	frame_pool_stats.reuses += stats->reuses;
+	frame_pool_stats.trims += stats->trims;
+	frame_pool_stats.peak_bytes += stats->peak_bytes;
+	mutex.Unlock ();
+}
+
+void
+MediaLog::GetFramePoolStats (MediaFramePoolStats *stats)
+{
+	mutex.Lock ();
+	*stats = frame_pool_stats;
+	mutex.Unlock ();
+}
+
 };
@@ -17,6 +17,7 @@
 #include <glib.h>
 
 #include "eventargs.h"
+#include "pipeline.h"
 
 namespace Moonlight {
 
@@ -33,6 +34,7 @@ class MediaLog {
 	char *filesize;
 	char *filelength;
 	guint64 x_duration;
+	MediaFramePoolStats frame_pool_stats; // accumulated over all the streams of the media
 
 public:
 	MediaLog ();
@@ -53,6 +55,8 @@ public:
 	void SetQuality (guint32 value);
 	void SetReferrer (const char *value);
 	void SetDuration (guint64 duration);
+	void AddFramePoolStats (const MediaFramePoolStats *stats);
+	void GetFramePoolStats (MediaFramePoolStats *stats);
 };
 
 };
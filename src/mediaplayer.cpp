@@ -172,58 +172,24 @@ MediaPlayer::AudioFailed (AudioSource *source)
 	mutex.Unlock ();
 }
 
-bool
-MediaPlayer::Open (Media *media, PlaylistEntry *entry)
+void
+MediaPlayer::FindStreams (IMediaDemuxer *demuxer, gint32 *audio_stream_index, AudioStream **audio, VideoStream **video, int *audio_stream_count)
 {
-	IMediaDecoder *encoding;
-	IMediaStream *stream;
-	guint64 asx_duration;
-	gint32 *audio_stream_index = NULL;
-	AudioSource *audio;
-	
-	LOG_MEDIAPLAYER ("MediaPlayer::Open (%p), current media: %p\n", media, this->media);
-	VERIFY_MAIN_THREAD;
-	
-	Close ();
-
-	if (media == NULL) {
-		printf ("MediaPlayer::Open (): media is NULL.\n");
-		return false;
-	}
-	
-	if (!media->IsOpened ()) {
-		printf ("MediaPlayer::Open (): media isn't opened.\n");
-		return false;
-	}
-	
-	this->media = media;
-	this->media->ref ();
-	
-	SetState (Opened);
-	
-	// Find audio/video streams
-	IMediaDemuxer *demuxer = media->GetDemuxerReffed ();
-	VideoStream *vstream = NULL;
 	AudioStream *astream = NULL, *astream2 = NULL;
-	
-	if (demuxer == NULL) {
-		g_warning ("MediaPlayer::Open (): media doesn't have a demuxer.\n");
-		return false;
-	}
-
-	audio_stream_index = element->GetAudioStreamIndex ();
+	VideoStream *vstream = NULL, *video_stream = NULL;
+	IMediaStream *stream;
+	int count = 0;
 
 	for (int i = 0; i < demuxer->GetStreamCount (); i++) {
 		stream = demuxer->GetStream (i);
-		encoding = stream->GetDecoder (); //stream->codec;
 		
-		if (encoding == NULL)
+		if (stream->GetDecoder () == NULL)
 			continue; // No encoding was found for the stream.
 		
 		if (stream->IsAudio ()) {
-			audio_stream_count++;
+			count++;
 			if (audio_stream_index != NULL){
-				if (*audio_stream_index == audio_stream_count - 1) {
+				if (*audio_stream_index == count - 1) {
 					astream = (AudioStream *) stream;
 				}
 			} else {
@@ -239,37 +205,88 @@ MediaPlayer::Open (Media *media, PlaylistEntry *entry)
 			if (video_stream != NULL) {
 				if (vstream->GetBitRate () == 0 && video_stream->GetBitRate () == 0) {
 					if (vstream->GetHeight () * vstream->GetWidth () < video_stream->GetHeight () * video_stream->GetWidth ()) {
-						LOG_MEDIAPLAYER ("MediaPlayer::Open (): discarded video stream #%i height*width: %ix%i=%i\n",
+						LOG_MEDIAPLAYER ("MediaPlayer::FindStreams (): discarded video stream #%i height*width: %ix%i=%i\n",
 								i, vstream->GetWidth (), vstream->GetHeight (), vstream->GetWidth () * vstream->GetHeight ());
 						break;
 					}
 				} else if (vstream->GetBitRate () < video_stream->GetBitRate ()) {
-						LOG_MEDIAPLAYER ("MediaPlayer::Open (): discarded video stream #%i bitrate: %i\n",
+						LOG_MEDIAPLAYER ("MediaPlayer::FindStreams (): discarded video stream #%i bitrate: %i\n",
 								i, vstream->GetBitRate ());
 					break;
 				}
 			}
 
-			LOG_MEDIAPLAYER ("MediaPlayer::Open (): selected video stream #%i with height*width: %ix%i=%i and bitrate %i\n",
+			LOG_MEDIAPLAYER ("MediaPlayer::FindStreams (): selected video stream #%i with height*width: %ix%i=%i and bitrate %i\n",
 				i, vstream->GetWidth (), vstream->GetHeight (), vstream->GetWidth () * vstream->GetHeight (), vstream->GetBitRate ());
 			video_stream = vstream;
-			
-			height = video_stream->GetHeight ();
-			width = video_stream->GetWidth ();
-
-			SetVideoBufferSize (width, height);
-			
-			// printf ("video size: %i, %i\n", video_stream->width, video_stream->height);
 		} else if (stream->IsMarker ()) {
-			LOG_MEDIAPLAYER ("MediaPlayer::Open (): Found a marker stream, selecting it.\n");
+			LOG_MEDIAPLAYER ("MediaPlayer::FindStreams (): Found a marker stream, selecting it.\n");
 			stream->SetSelected (true);
 		} else {
 			/* Do nothing */
 		}
 	}
 
+	*audio = astream;
+	*video = video_stream;
+	if (audio_stream_count != NULL)
+		*audio_stream_count = count;
+}
+
+bool
+MediaPlayer::Open (Media *media, PlaylistEntry *entry)
+{
+	guint64 asx_duration;
+	gint32 *audio_stream_index = NULL;
+	AudioSource *audio;
+	
+	LOG_MEDIAPLAYER ("MediaPlayer::Open (%p), current media: %p\n", media, this->media);
+	VERIFY_MAIN_THREAD;
+	
+	Close ();
+
+	if (media == NULL) {
+		printf ("MediaPlayer::Open (): media is NULL.\n");
+		return false;
+	}
+	
+	if (!media->IsOpened ()) {
+		printf ("MediaPlayer::Open (): media isn't opened.\n");
+		return false;
+	}
+	
+	this->media = media;
+	this->media->ref ();
+	
+	SetState (Opened);
+	
+	// Find audio/video streams
+	IMediaDemuxer *demuxer = media->GetDemuxerReffed ();
+	AudioStream *astream = NULL;
+	
+	if (demuxer == NULL) {
+		g_warning ("MediaPlayer::Open (): media doesn't have a demuxer.\n");
+		return false;
+	}
+
+	audio_stream_index = element->GetAudioStreamIndex ();
+
+	FindStreams (demuxer, audio_stream_index, &astream, &video_stream, &audio_stream_count);
+
+	if (video_stream != NULL) {
+		height = video_stream->GetHeight ();
+		width = video_stream->GetWidth ();
+
+		SetVideoBufferSize (width, height);
+		
+		// printf ("video size: %i, %i\n", video_stream->width, video_stream->height);
+	}
+
 	if (astream != NULL) {
-		audio = AudioPlayer::Add (this, astream);
+		// the playlist may have queued it to start when the previous entry ended
+		audio = entry != NULL ? entry->TakeQueuedAudio (astream) : NULL;
+		if (audio == NULL)
+			audio = AudioPlayer::Add (this, astream);
 		if (audio != NULL) {
 			// Only select the audio stream if we can actually play it
 			astream->SetSelected (true);
@@ -299,6 +316,9 @@ MediaPlayer::Open (Media *media, PlaylistEntry *entry)
 			mutex.Lock ();
 			this->audio_unlocked = audio;
 			mutex.Unlock ();
+		} else if (astream->GetSelected ()) {
+			// the playlist may have prebuffered it
+			astream->SetSelected (false);
 		}
 	}
 	if (video_stream != NULL) {
@@ -127,6 +127,11 @@ class MediaPlayer : public EventObject {
 	bool Open (Media *media, PlaylistEntry *entry);
 	void Close ();
 
+	// Finds the audio and video streams Open would play (the audio stream
+	// @audio_stream_index if it isn't NULL, otherwise the one with the
+	// highest bitrate). Marker streams are selected right away.
+	static void FindStreams (IMediaDemuxer *demuxer, gint32 *audio_stream_index, AudioStream **audio, VideoStream **video, int *audio_stream_count);
+
 	// Thread-safe.
 	// Returns a refcounted AudioStream.
 	// Caller must call unref when done with it.
@@ -36,6 +36,8 @@
 #include "ptr.h"
 #include "factory.h"
 #include "deployment.h"
+#include "timesource.h"
+#include "trace.h"
 
 namespace Moonlight {
 
@@ -50,6 +52,11 @@ namespace Moonlight {
 
 #define MAX_DOWNLOADERS 6
 
+// how far ahead of the viewport's motion tiles are prefetched
+#define PREFETCH_LOOKAHEAD 0.5
+// viewport samples further apart than this (in seconds) say nothing about its velocity
+#define VELOCITY_MAX_INTERVAL 0.25
+
 static inline guint64
 pow2 (int pow)
 {
@@ -76,10 +83,12 @@ blur_factor_get_offset (double factor)
 struct QTreeTile {
 	BitmapImage *image;
 	double opacity;
+	double scale; // the image was decoded at this fraction of the tile's size
 };
 
 struct QTree {
 	QTreeTile *tile;
+	BitmapImageContext *download; // of the tile, while it's in flight
 	QTree *parent;
 	QTree *l0; //N-E
 	QTree *l1; //N-W
@@ -147,7 +156,7 @@ qtree_insert (QTree *root, int level, guint64 x, guint64 y)
 }
 
 static void
-qtree_set_tile (QTree *node, BitmapImage *image, double opacity)
+qtree_set_tile (QTree *node, BitmapImage *image, double opacity, double scale)
 {
 	if (image)
 		image->ref ();
@@ -159,6 +168,7 @@ qtree_set_tile (QTree *node, BitmapImage *image, double opacity)
 		node->tile = g_new (QTreeTile, 1);
 	
 	node->tile->opacity = opacity;
+	node->tile->scale = scale;
 	node->tile->image = image;
 }
 
@@ -268,8 +278,71 @@ struct BitmapImageContext : public List::Node {
 	BitmapImage *image;
 	QTree *node;
 	int retry;
+	double scale; // the tile is decoded at this fraction of its size
+	bool wanted; // requested by the last render
+};
+
+/*
+ * TileRequest
+ *
+ * Rendering doesn't start downloads by itself, it requests every missing
+ * tile it could use (and the ones it will need next if the viewport keeps
+ * moving), ScheduleTiles () then downloads the most urgent ones.
+ */
+
+struct TileRequest {
+	get_image_uri_func get_tile_func;
+	MultiScaleTileSource *source;
+	QTree *node;
+	guint64 x, y;
+	int level;
+	double distance; // from the center of the viewport, in viewport widths
+	double scale; // the tile is decoded at this fraction of its size, a power of 2
+	MultiScaleSubImage *sub_image; // if not NULL, the DZI of this subimage is requested instead of a tile
+	bool prefetch;
+	bool cache_missing;
+	bool in_flight;
 };
 
+/* The size of tile (@x, @y) of @layer in pixels, with its overlap */
+static void
+get_tile_size (MultiScaleTileSource *source, int layer, guint64 x, guint64 y, int *width, int *height)
+{
+	double im_w = source->GetImageWidth ();
+	double im_h = source->GetImageHeight ();
+	int tile_width = source->GetTileWidth ();
+	int tile_height = source->GetTileHeight ();
+	int overlap = source->GetTileOverlap ();
+	guint64 layer_w, layer_h;
+	int layers;
+	
+	if (frexp (MAX (im_w, im_h), &layers) == 0.5)
+		layers--;
+	
+	layer_w = (guint64) ceil (im_w / pow2 (layers - layer));
+	layer_h = (guint64) ceil (im_h / pow2 (layers - layer));
+	
+	*width = (int) (MIN (layer_w, (x + 1) * tile_width + overlap) - (x * tile_width - (x > 0 ? overlap : 0)));
+	*height = (int) (MIN (layer_h, (y + 1) * tile_height + overlap) - (y * tile_height - (y > 0 ? overlap : 0)));
+}
+
+static int
+tile_request_compare (const TileRequest *ra, const TileRequest *rb)
+{
+	// visible tiles first, then the coarser layers (which cover the
+	// most ground), then from the center of the viewport out
+	if (ra->prefetch != rb->prefetch)
+		return ra->prefetch ? 1 : -1;
+	
+	if (ra->level != rb->level)
+		return ra->level - rb->level;
+	
+	if (ra->distance != rb->distance)
+		return ra->distance < rb->distance ? -1 : 1;
+	
+	return 0;
+}
+
 /*
  * Morton layout
  */
@@ -331,10 +404,21 @@ MultiScaleImage::MultiScaleImage ()
 	// Note: cairo_user_data_key_t's do not need to be initialized
 	
 	cache = g_hash_table_new_full (g_int_hash, g_int_equal, int_free, (GDestroyNotify) qtree_destroy);
+	tile_requests = g_array_new (false, false, sizeof (TileRequest));
+	subimage_downloads = g_ptr_array_new ();
 	subimages_sorted = false;
 	pan_target = Point (0, 0);
 	zoom_target = 1.0;
 	motion = 0;
+	
+	memset (&stats, 0, sizeof (stats));
+	last_viewport_origin = Point (0, 0);
+	last_viewport_width = 0.0;
+	last_viewport_time = 0;
+	viewport_velocity = Point (0, 0);
+	viewport_width_velocity = 0.0;
+	sharp_pending_since = 0;
+	rendered_sharp = false;
 }
 
 MultiScaleImage::~MultiScaleImage ()
@@ -355,7 +439,14 @@ MultiScaleImage::~MultiScaleImage ()
 	if (source)
 		DisconnectSourceEvents (source);
 	
+	LOG_MSI ("MSI tiles: %d requested, %d prefetched, %d downscaled, %d cancelled, %d wasted; sharp %d times, in %.1f ms on average, %.1f ms at most\n",
+		 stats.tiles_requested, stats.tiles_prefetched, stats.tiles_downscaled, stats.tiles_cancelled, stats.tiles_wasted, stats.sharp_count,
+		 stats.sharp_count ? (double) stats.total_time_to_sharp / stats.sharp_count / 10000 : 0.0,
+		 (double) stats.max_time_to_sharp / 10000);
+	
 	g_hash_table_destroy (cache);
+	g_array_free (tile_requests, true);
+	g_ptr_array_free (subimage_downloads, true);
 }
 
 void
@@ -410,21 +501,19 @@ MultiScaleImage::LogicalToElementPoint (Point logicalPoint)
 bool
 MultiScaleImage::CanDownloadMoreTiles ()
 {
-	return downloaders.Length () < MAX_DOWNLOADERS && !GetDeployment ()->IsShuttingDown ();
+	return GetDownloadCount () < MAX_DOWNLOADERS && !GetDeployment ()->IsShuttingDown ();
 }
 
-void
-MultiScaleImage::DownloadTile (Uri *tile, void *user_data)
+bool
+MultiScaleImage::DownloadTile (Uri *tile, void *user_data, double scale, int decode_width, int decode_height)
 {
+	QTree *node = (QTree *) user_data;
 	BitmapImageContext *ctx;
 	
 	// Check that we aren't already downloading this tile
-	for (ctx = static_cast<BitmapImageContext *> (downloaders.First ());
-	     ctx; ctx = static_cast<BitmapImageContext *> (ctx->next)) {
-		if (*ctx->image->GetUriSource () == *tile) {
-			//LOG_MSI ("Tile %s is already being downloaded\n", tile->ToString ());
-			return;
-		}
+	if (node->download != NULL) {
+		//LOG_MSI ("Tile %s is already being downloaded\n", tile->ToString ());
+		return false;
 	}
 	
 	//LOG_MSI ("downloading tile %s\n", tile->ToString ());
@@ -438,15 +527,172 @@ MultiScaleImage::DownloadTile (Uri *tile, void *user_data)
 	ctx->image->AddHandler (ctx->image->ImageFailedEvent,
 				tile_failed,
 				ctx);
-	ctx->node = (QTree *) user_data;
+	ctx->node = node;
 	ctx->retry = 0;
+	ctx->scale = scale;
+	ctx->wanted = true;
+	node->download = ctx;
+	
+	if (scale < 1.0) {
+		ctx->image->SetDecodeSize (decode_width, decode_height);
+		stats.tiles_downscaled++;
+	}
 
 	downloaders.Append (ctx);
+	stats.tiles_requested++;
 	
 	SetIsDownloading (true);
 	ctx->image->SetDownloadPolicy (MsiPolicy);
 	ctx->image->SetUriSource (tile);
 	SetIsIdle (false);
+	
+	return true;
+}
+
+void
+MultiScaleImage::RequestTile (MultiScaleTileSource *source, QTree *node, int level, guint64 x, guint64 y, double distance, double scale, bool prefetch, bool cache_missing)
+{
+	TileRequest request;
+	
+	// the tiles of the shared layers of a collection are requested once per subimage tile
+	if (tile_requests->len > 0 && g_array_index (tile_requests, TileRequest, tile_requests->len - 1).node == node)
+		return;
+	
+	request.get_tile_func = GetSource ()->get_tile_func;
+	request.source = source;
+	request.node = node;
+	request.level = level;
+	request.x = x;
+	request.y = y;
+	request.distance = distance;
+	request.scale = scale;
+	request.sub_image = NULL;
+	request.prefetch = prefetch;
+	request.cache_missing = cache_missing;
+	request.in_flight = false;
+	
+	g_array_append_val (tile_requests, request);
+}
+
+void
+MultiScaleImage::RequestSubImage (MultiScaleSubImage *sub_image, int level, double distance)
+{
+	TileRequest request;
+	
+	memset (&request, 0, sizeof (TileRequest));
+	request.source = sub_image->source;
+	request.sub_image = sub_image;
+	request.level = level;
+	request.distance = distance;
+	
+	g_array_append_val (tile_requests, request);
+}
+
+void
+MultiScaleImage::DownloadSubImage (MultiScaleSubImage *sub_image)
+{
+	DeepZoomImageTileSource *dzits = (DeepZoomImageTileSource *) sub_image->source;
+	
+	dzits->Download ();
+	
+	// without an application there's nothing to download it with
+	if (!dzits->IsDownloaded ())
+		return;
+	
+	dzits->ref ();
+	g_ptr_array_add (subimage_downloads, dzits);
+	SetIsIdle (false);
+}
+
+void
+MultiScaleImage::SubImageDownloaded (DeepZoomImageTileSource *dzits)
+{
+	if (g_ptr_array_remove (subimage_downloads, dzits))
+		dzits->unref ();
+}
+
+void
+MultiScaleImage::ScheduleTiles ()
+{
+	TileRequest *requests = (TileRequest *) tile_requests->data;
+	BitmapImageContext *ctx, *next;
+	guint n = tile_requests->len;
+	int pending = 0;
+	int slots;
+	
+	MOON_TRACE_SCOPE ("MultiScaleImage", "ScheduleTiles");
+	
+	// the tiles being downloaded which are still wanted
+	for (ctx = static_cast<BitmapImageContext *> (downloaders.First ());
+	     ctx; ctx = static_cast<BitmapImageContext *> (ctx->next))
+		ctx->wanted = false;
+	
+	for (guint i = 0; i < n; i++) {
+		if (requests[i].node && requests[i].node->download) {
+			requests[i].node->download->wanted = true;
+			requests[i].in_flight = true;
+		} else {
+			pending++;
+		}
+	}
+	
+	// abort the downloads of tiles which went out of view (a fast pan or
+	// zoom), when their slot is needed for a tile which is in view now
+	slots = MAX_DOWNLOADERS - GetDownloadCount ();
+	for (ctx = static_cast<BitmapImageContext *> (downloaders.First ()); ctx && pending > slots; ctx = next) {
+		next = static_cast<BitmapImageContext *> (ctx->next);
+		
+		if (ctx->wanted)
+			continue;
+		
+		LOG_MSI ("cancelling obsolete tile %s\n", ctx->image->GetUriSource ()->ToString ());
+		stats.tiles_cancelled++;
+		stats.tiles_wasted++;
+		AbortTile (ctx);
+		slots++;
+	}
+	
+	// there are only a few free slots for a lot of requests, so rather
+	// than sorting all of them, pick the most urgent one for each slot
+	while (CanDownloadMoreTiles ()) {
+		TileRequest *request = NULL;
+		Uri *tile = NULL;
+		
+		for (guint i = 0; i < n; i++) {
+			if (!requests[i].in_flight && (request == NULL || tile_request_compare (&requests[i], request) < 0))
+				request = &requests[i];
+		}
+		
+		if (request == NULL)
+			break;
+		
+		request->in_flight = true;
+		
+		if (request->sub_image) {
+			DownloadSubImage (request->sub_image);
+			continue;
+		}
+		
+		if (request->get_tile_func (request->source, request->level, request->x, request->y, &tile) && tile != NULL) {
+			int width = 0, height = 0;
+			
+			// the size the tile is decoded at, if it's shown a lot smaller than it is
+			if (request->scale < 1.0) {
+				get_tile_size (request->source, request->level, request->x, request->y, &width, &height);
+				width = MAX (1, (int) ceil (width * request->scale));
+				height = MAX (1, (int) ceil (height * request->scale));
+			}
+			
+			if (DownloadTile (tile, request->node, request->scale, width, height) && request->prefetch)
+				stats.tiles_prefetched++;
+		} else if (request->cache_missing) {
+			qtree_set_tile (request->node, NULL, 0.0, 1.0);
+		}
+		
+		delete tile;
+	}
+	
+	g_array_set_size (tile_requests, 0);
 }
 
 // Only used for DeepZoom sources
@@ -491,7 +737,7 @@ MultiScaleImage::HandleDzParsed ()
 			QTree *node;
 			
 			if ((node = qtree_insert (shared_cache, layer, 0, 0)))
-				DownloadTile (tile, node);
+				DownloadTile (tile, node, 1.0, 0, 0);
 		}
 		
 		delete tile;
@@ -563,8 +809,12 @@ MultiScaleImage::tile_opened (EventObject *sender, EventArgs *calldata, gpointer
 void
 MultiScaleImage::TileOpened (BitmapImageContext *ctx)
 {
+	if (!ctx->wanted)
+		stats.tiles_wasted++;
+	
 	ProcessTile (ctx);
 
+	ctx->node->download = NULL;
 	downloaders.Unlink (ctx);
 	ctx->image->unref ();
 	ctx->image->RemoveHandler (ctx->image->ImageOpenedEvent,
@@ -599,7 +849,8 @@ MultiScaleImage::TileFailed (BitmapImageContext *ctx)
 		ctx->retry++;
 	} else {
 		LOG_MSI ("caching a NULL for %s\n", ctx->image->GetUriSource()->ToString ());
-		qtree_set_tile (ctx->node, NULL, 0.0);
+		qtree_set_tile (ctx->node, NULL, 0.0, 1.0);
+		ctx->node->download = NULL;
 		downloaders.Unlink (ctx);
 		ctx->image->unref ();
 		ctx->image->RemoveHandler (ctx->image->ImageOpenedEvent,
@@ -616,34 +867,42 @@ MultiScaleImage::TileFailed (BitmapImageContext *ctx)
 }
 
 void
-MultiScaleImage::StopDownloading ()
+MultiScaleImage::AbortTile (BitmapImageContext *ctx)
 {
-	BitmapImageContext *ctx;
+	ctx->image->RemoveHandler (ctx->image->ImageOpenedEvent,
+				   tile_opened,
+				   ctx);
+	ctx->image->RemoveHandler (ctx->image->ImageFailedEvent,
+				   tile_failed,
+				   ctx);
+	// we need to attach an ImageFailedHandler, otherwise
+	// the abort -> download failed error will end up
+	// in the app unhandled exception handler (or the plugin
+	// error handler). #2004.
+	ctx->image->AddHandler (ctx->image->ImageFailedEvent,
+				void_handler,
+				ctx);
+	ctx->node->download = NULL;
+	downloaders.Unlink (ctx);
+	ctx->image->Abort ();
+	ctx->image->RemoveHandler (ctx->image->ImageFailedEvent,
+				   void_handler,
+				   ctx);
+	ctx->image->Dispose ();
+	ctx->image->unref ();
+	delete ctx;
+}
 
-	while (!downloaders.IsEmpty ()) {
-		ctx = static_cast<BitmapImageContext *> (downloaders.First ());
-		ctx->image->RemoveHandler (ctx->image->ImageOpenedEvent,
-					   tile_opened,
-					   ctx);
-		ctx->image->RemoveHandler (ctx->image->ImageFailedEvent,
-					   tile_failed,
-					   ctx);
-		// we need to attach an ImageFailedHandler, otherwise
-		// the abort -> download failed error will end up
-		// in the app unhandled exception handler (or the plugin
-		// error handler). #2004.
-		ctx->image->AddHandler (ctx->image->ImageFailedEvent,
-					   void_handler,
-					   ctx);
-		downloaders.Unlink (ctx);
-		ctx->image->Abort ();
-		ctx->image->RemoveHandler (ctx->image->ImageFailedEvent,
-					   void_handler,
-					   ctx);
-		ctx->image->Dispose ();
-		ctx->image->unref ();
-		delete ctx;
-	}
+void
+MultiScaleImage::StopDownloading ()
+{
+	while (!downloaders.IsEmpty ())
+		AbortTile (static_cast<BitmapImageContext *> (downloaders.First ()));
+	
+	// the subimages' DZIs are left to finish, they'll be used again
+	for (guint i = 0; i < subimage_downloads->len; i++)
+		((DeepZoomImageTileSource *) subimage_downloads->pdata[i])->unref ();
+	g_ptr_array_set_size (subimage_downloads, 0);
 }
 
 void
@@ -702,13 +961,19 @@ MultiScaleImage::ConnectSourceEvents (MultiScaleTileSource *source)
 void
 MultiScaleImage::subdownloader_completed (EventObject *sender, EventArgs *calldata, gpointer closure)
 {
-	((UIElement *) closure)->Invalidate ();
+	MultiScaleImage *msi = (MultiScaleImage *) closure;
+	
+	msi->SubImageDownloaded ((DeepZoomImageTileSource *) sender);
+	msi->Invalidate ();
 }
 
 void
 MultiScaleImage::subdownloader_failed (EventObject *sender, EventArgs *calldata, gpointer closure)
 {
-	((MultiScaleImage *) closure)->EmitImageFailed ();
+	MultiScaleImage *msi = (MultiScaleImage *) closure;
+	
+	msi->SubImageDownloaded ((DeepZoomImageTileSource *) sender);
+	msi->EmitImageFailed ();
 }
 
 void
@@ -718,6 +983,9 @@ MultiScaleImage::DisconnectSubImageEvents (MultiScaleSubImage *subimage)
 	
 	dzits->RemoveHandler (DeepZoomImageTileSource::DownloaderCompletedEvent, subdownloader_completed, this);
 	dzits->RemoveHandler (DeepZoomImageTileSource::DownloaderFailedEvent, subdownloader_failed, this);
+	
+	// its download won't tell us when it's done anymore
+	SubImageDownloaded (dzits);
 }
 
 void
@@ -809,7 +1077,7 @@ MultiScaleImage::ProcessTile (BitmapImageContext *ctx)
 	UpdateIdleStatus ();
 	
 	LOG_MSI ("caching %s\n", ctx->image->GetUriSource ()->ToString ());
-	qtree_set_tile (ctx->node, ctx->image, tile_fade + 0.9);
+	qtree_set_tile (ctx->node, ctx->image, tile_fade + 0.9, ctx->scale);
 }
 
 void
@@ -831,6 +1099,8 @@ MultiScaleImage::Render (Context *ctx, Region *region)
 	else
 		dzits = NULL;
 	
+	UpdateViewportMotion ();
+	
 	bool is_collection = dzits && dzits->IsCollection () && GetSubImages ();
 	
 	if (source->GetImageWidth () < 0 && !is_collection) {
@@ -849,14 +1119,85 @@ MultiScaleImage::Render (Context *ctx, Region *region)
 	}
 #endif
 	
+	rendered_sharp = false;
+	
 	if (is_collection)
 		RenderCollection (ctx, region);
 	else
 		RenderSingle (ctx, region);
 	
+	if (rendered_sharp && sharp_pending_since != 0) {
+		TimeSpan elapsed = get_now () - sharp_pending_since;
+		
+		stats.sharp_count++;
+		stats.last_time_to_sharp = elapsed;
+		stats.total_time_to_sharp += elapsed;
+		stats.max_time_to_sharp = MAX (stats.max_time_to_sharp, elapsed);
+		sharp_pending_since = 0;
+		
+		LOG_MSI ("viewport became sharp in %.1f ms\n", (double) elapsed / 10000);
+	}
+	
+	ScheduleTiles ();
 	UpdateIdleStatus ();
 }
 
+void
+MultiScaleImage::UpdateViewportMotion ()
+{
+	Point *origin = GetAnimatedViewportOrigin ();
+	double width = GetAnimatedViewportWidth ();
+	TimeSpan now = get_now ();
+	double dt = TimeSpan_ToSecondsFloat (now - last_viewport_time);
+	
+	if (last_viewport_time != 0 && origin->x == last_viewport_origin.x &&
+	    origin->y == last_viewport_origin.y && width == last_viewport_width) {
+		// rendering twice in a frame doesn't mean that the viewport stopped
+		if (dt > VELOCITY_MAX_INTERVAL) {
+			viewport_velocity = Point (0, 0);
+			viewport_width_velocity = 0.0;
+		}
+		return;
+	}
+	
+	if (last_viewport_time != 0 && dt > 0.0 && dt <= VELOCITY_MAX_INTERVAL) {
+		// average with the previous sample, frame times are jittery
+		viewport_velocity.x = (viewport_velocity.x + (origin->x - last_viewport_origin.x) / dt) / 2;
+		viewport_velocity.y = (viewport_velocity.y + (origin->y - last_viewport_origin.y) / dt) / 2;
+		viewport_width_velocity = (viewport_width_velocity + (width - last_viewport_width) / dt) / 2;
+	} else {
+		viewport_velocity = Point (0, 0);
+		viewport_width_velocity = 0.0;
+	}
+	
+	if (sharp_pending_since == 0)
+		sharp_pending_since = now;
+	
+	last_viewport_origin = *origin;
+	last_viewport_width = width;
+	last_viewport_time = now;
+}
+
+bool
+MultiScaleImage::GetPredictedViewport (Point *origin, double *width)
+{
+	Point *current = GetAnimatedViewportOrigin ();
+	double current_width = GetAnimatedViewportWidth ();
+	double dx = viewport_velocity.x * PREFETCH_LOOKAHEAD;
+	double dy = viewport_velocity.y * PREFETCH_LOOKAHEAD;
+	double dw = viewport_width_velocity * PREFETCH_LOOKAHEAD;
+	double epsilon = current_width / 100;
+	
+	// not moving fast enough to need any other tiles
+	if (fabs (dx) < epsilon && fabs (dy) < epsilon && fabs (dw) < epsilon)
+		return false;
+	
+	*origin = Point (current->x + dx, current->y + dy);
+	*width = CLAMP (current_width + dw, current_width / 4, current_width * 4);
+	
+	return true;
+}
+
 void
 MultiScaleImage::RenderCollection (Context *ctx, Region *region)
 {
@@ -893,6 +1234,7 @@ MultiScaleImage::RenderCollection (Context *ctx, Region *region)
 	cairo_t *cr = ctx->Push (Context::Cairo ());
 	
 	blur_offset = blur_factor_get_offset (blur_factor);
+	rendered_sharp = true;
 	
 	Rect viewport = Rect (msivp_ox, msivp_oy, msivp_w, msivp_w/msi_ar);
 
@@ -1100,67 +1442,48 @@ MultiScaleImage::RenderCollection (Context *ctx, Region *region)
 			cairo_restore (cr);
 		}
 		
-		if (!GetAllowDownloading () || !CanDownloadMoreTiles ())
+		if (from_layer != optimal_layer)
+			rendered_sharp = false;
+		
+		if (!GetAllowDownloading ())
 			continue;
 		
-		// Download the next set of tiles..
-		while (from_layer < optimal_layer) {
-			from_layer ++;
+		// Request the next set of tiles..
+		RequestCollectionTiles (sub_image, subimage_cache, shared_cache, sub_vp, layers, from_layer + 1, optimal_layer,
+					msivp_ox, msivp_oy, msivp_w, false);
+	}
+	
+	// ..and the ones we'll need if the viewport keeps moving the way it does
+	Point predicted_origin;
+	double predicted_width;
+	
+	if (GetAllowDownloading () && GetPredictedViewport (&predicted_origin, &predicted_width)) {
+		Rect predicted = Rect (predicted_origin.x, predicted_origin.y, predicted_width, predicted_width / msi_ar);
+		
+		for (int i = 0; i < subs_count; i++) {
+			MultiScaleSubImage *sub_image = (MultiScaleSubImage *) subs->z_sorted->pdata[i];
+			double subvp_w = sub_image->GetViewportWidth ();
+			double sub_ar = sub_image->GetAspectRatio ();
+			Rect sub_vp = Rect (-sub_image->GetViewportOrigin ()->x / subvp_w, -sub_image->GetViewportOrigin ()->y / subvp_w,
+					    1.0 / subvp_w, 1.0 / (sub_ar * subvp_w));
+			int layers, optimal_layer;
 			
-			// if the subimage is unparsed, trigger the download
-			if (from_layer > max_level && !sub_dzits->IsDownloaded ()) {
-				sub_dzits->Download ();
-				break;
-			}
+			if (!sub_vp.IntersectsWith (predicted))
+				continue;
 			
-			bool parsed = (from_layer > max_level && sub_dzits->IsParsed ());
-			int tile_width = parsed ? sub_image->source->GetTileWidth () : dzits->GetTileWidth ();
-			int tile_height = parsed ? sub_image->source->GetTileHeight () : dzits->GetTileHeight ();
-			guint64 layers2 = pow2 (layers - from_layer);
-			double v_scale = (double) layers2 * sub_vp.width / sub_w;
-			double v_tile_w = tile_width * v_scale;
-			double v_tile_h = tile_height * v_scale;
-			double minx = (MAX (msivp_ox, sub_vp.x) - sub_vp.x) / v_tile_w;
-			double maxx = MIN (msivp_ox + msivp_w, sub_vp.x + sub_vp.width) - sub_vp.x;
-			double miny = (MAX (msivp_oy, sub_vp.y) - sub_vp.y) / v_tile_h;
-			double maxy = MIN (msivp_oy + msivp_w / msi_ar, sub_vp.y + sub_vp.width / sub_ar) - sub_vp.y;
-			MultiScaleTileSource *tile_source;
-			QTree *tile_cache, *node;
-			guint64 x, y;
-			Uri *tile;
+			if (frexp (MAX (sub_image->source->GetImageWidth (), sub_image->source->GetImageHeight ()), &layers) == 0.5)
+				layers--;
 			
-			for (int i = (int) minx; i * v_tile_w < maxx; i++) {
-				if (!CanDownloadMoreTiles ())
-					break;
-				
-				for (int j = (int) miny; j * v_tile_h < maxy; j++) {
-					if (!CanDownloadMoreTiles ())
-						break;
-					
-					if (from_layer <= max_level) {
-						guint64 from_layer2 = pow2 (from_layer);
-						x = morton_x (sub_image->n) * from_layer2 / tile_width;
-						y = morton_y (sub_image->n) * from_layer2 / tile_height;
-						tile_cache = shared_cache;
-						tile_source = dzits;
-					} else {
-						tile_source = sub_image->source;
-						tile_cache = subimage_cache;
-						x = i;
-						y = j;
-					}
-					
-					if (!(node = qtree_insert (tile_cache, from_layer, x, y)))
-						continue;
-					
-					if (!qtree_has_tile (node)) {
-						tile = NULL;
-						if (dzits->get_tile_func (tile_source, from_layer, x, y, &tile))
-							DownloadTile (tile, node);
-						delete tile;
-					}
-				}
-			}
+			frexp (msi_w / (subvp_w * predicted_width * MIN (1.0, sub_ar)), &optimal_layer);
+			optimal_layer = MIN (optimal_layer + blur_offset, layers);
+			
+			int index = sub_image->GetId ();
+			QTree *subimage_cache = (QTree *) g_hash_table_lookup (cache, &index);
+			if (!subimage_cache)
+				g_hash_table_insert (cache, new int(index), (subimage_cache = qtree_new ()));
+			
+			RequestCollectionTiles (sub_image, subimage_cache, shared_cache, sub_vp, layers, 0, optimal_layer,
+						predicted.x, predicted.y, predicted.width, true);
 		}
 	}
 
@@ -1262,6 +1585,8 @@ MultiScaleImage::RenderSingle (Context *ctx, Region *region)
 		
 		from_layer --;
 	}
+	
+	rendered_sharp = from_layer == optimal_layer;
 
 	//render here
 	//cairo_push_group (cr);
@@ -1318,6 +1643,10 @@ MultiScaleImage::RenderSingle (Context *ctx, Region *region)
 				
 				cairo_translate (cr, i * tile_width, j * tile_height);
 				
+				// tiles decoded at a lower resolution
+				if (tile->scale < 1.0)
+					cairo_scale (cr, 1.0 / tile->scale, 1.0 / tile->scale);
+				
 				cairo_set_source_surface (cr, tile->image->GetImageSurface (), 0, 0);
 				
 				double combined = 1.0;
@@ -1342,44 +1671,164 @@ MultiScaleImage::RenderSingle (Context *ctx, Region *region)
 
 	ctx->Pop ();
 	
-	if (!GetAllowDownloading () || !CanDownloadMoreTiles ())
+	if (!GetAllowDownloading ())
 		return;
 	
-	// Download the next set of tiles...
-	while (from_layer < optimal_layer) {
-		from_layer++;
+	// Request the next set of tiles...
+	RequestSingleTiles (subimage_cache, layers, from_layer + 1, optimal_layer, vp_ox, vp_oy, vp_w, false);
+	
+	// ...and the ones we'll need if the viewport keeps moving the way it does
+	Point predicted_origin;
+	double predicted_width;
+	
+	if (GetPredictedViewport (&predicted_origin, &predicted_width)) {
+		int predicted_layer;
 		
-		guint64 layers2 = pow2 (layers - from_layer);
+		if (frexp (msi_w / (predicted_width * MIN (1.0, msi_ar)), &predicted_layer) == 0.5)
+			predicted_layer--;
+		
+		predicted_layer = MIN (predicted_layer + blur_offset, layers);
+		
+		RequestSingleTiles (subimage_cache, layers, 0, predicted_layer, predicted_origin.x, predicted_origin.y, predicted_width, true);
+	}
+}
+
+void
+MultiScaleImage::RequestSingleTiles (int from_layer, int to_layer, double vp_ox, double vp_oy, double vp_w, bool prefetch)
+{
+	MultiScaleTileSource *source = GetSource ();
+	int index = -1;
+	int layers;
+	
+	if (!source || source->GetImageWidth () < 0)
+		return;
+	
+	if (frexp (MAX (source->GetImageWidth (), source->GetImageHeight ()), &layers) == 0.5)
+		layers--;
+	
+	QTree *subimage_cache = (QTree *) g_hash_table_lookup (cache, &index);
+	if (!subimage_cache)
+		g_hash_table_insert (cache, new int(index), (subimage_cache = qtree_new ()));
+	
+	RequestSingleTiles (subimage_cache, layers, from_layer, to_layer, vp_ox, vp_oy, vp_w, prefetch);
+}
+
+void
+MultiScaleImage::RequestSingleTiles (QTree *subimage_cache, int layers, int from_layer, int to_layer, double vp_ox, double vp_oy, double vp_w, bool prefetch)
+{
+	MultiScaleTileSource *source = GetSource ();
+	double msi_w = GetActualWidth ();
+	double msi_h = GetActualHeight ();
+	double msi_ar = GetAspectRatio ();
+	double im_w = source->GetImageWidth ();
+	int tile_width = source->GetTileWidth ();
+	int tile_height = source->GetTileHeight ();
+	double vp_h = vp_w / msi_w * msi_h;
+	QTree *node;
+	
+	for (int layer = MAX (0, from_layer); layer <= to_layer; layer++) {
+		guint64 layers2 = pow2 (layers - layer);
 		double v_scale = (double) layers2 / im_w;
+		double screen_scale = msi_w / vp_w * v_scale;
+		double scale = 1.0;
+		int exp;
+		
+		// with a small BlurFactor the tiles are shown a lot smaller than they
+		// are. They're decoded at the power of 2 above twice the size they're
+		// shown at, the most they're zoomed in before the next layer replaces them
+		if (screen_scale > 0.0 && screen_scale < 0.25) {
+			if (frexp (2 * screen_scale, &exp) == 0.5)
+				exp--;
+			scale = ldexp (1.0, exp);
+		}
 		double v_tile_w = tile_width * v_scale;
 		double v_tile_h = tile_height * v_scale;
 		double minx = MAX (0, (vp_ox / v_tile_w));
 		double maxx = MIN (vp_ox + vp_w, 1.0);
 		double miny = MAX (0, (vp_oy / v_tile_h));
-		double maxy = MIN (vp_oy + vp_w / msi_w * msi_h, 1.0 / msi_ar);
-		QTree *node;
+		double maxy = MIN (vp_oy + vp_h, 1.0 / msi_ar);
 		
 		for (int i = (int) minx; i * v_tile_w < maxx; i++) {
-			if (!CanDownloadMoreTiles ())
-				return;
-			
 			for (int j = (int) miny; j * v_tile_h < maxy; j++) {
-				if (!CanDownloadMoreTiles ())
-					return;
+				if (!(node = qtree_insert (subimage_cache, layer, i, j)))
+					continue;
 				
-				if (!(node = qtree_insert (subimage_cache, from_layer, i, j)))
+				if (qtree_has_tile (node))
 					continue;
 				
-				if (!qtree_has_tile (node)) {
-					Uri *tile = NULL;
-					
-					if (source->get_tile_func (source, from_layer, i, j, &tile))
-						DownloadTile (tile, node);
-					else
-						qtree_set_tile (node, NULL, 0.0);
-					
-					delete tile;
+				double dx = (i + 0.5) * v_tile_w - (vp_ox + vp_w / 2);
+				double dy = (j + 0.5) * v_tile_h - (vp_oy + vp_h / 2);
+				
+				RequestTile (source, node, layer, i, j, sqrt (dx * dx + dy * dy) / vp_w, scale, prefetch, true);
+			}
+		}
+	}
+}
+
+void
+MultiScaleImage::RequestCollectionTiles (MultiScaleSubImage *sub_image, QTree *subimage_cache, QTree *shared_cache, Rect sub_vp, int layers,
+					 int from_layer, int to_layer, double vp_ox, double vp_oy, double vp_w, bool prefetch)
+{
+	DeepZoomImageTileSource *dzits = (DeepZoomImageTileSource *) GetSource ();
+	DeepZoomImageTileSource *sub_dzits = (DeepZoomImageTileSource *) sub_image->source;
+	double sub_w = sub_image->source->GetImageWidth ();
+	double sub_ar = sub_image->GetAspectRatio ();
+	double vp_h = vp_w / GetAspectRatio ();
+	int max_level = dzits->GetMaxLevel ();
+	
+	for (int layer = MAX (0, from_layer); layer <= to_layer; layer++) {
+		// if the subimage is unparsed, request its DZI, which is downloaded in
+		// one of the tile slots, and only once the subimage is in view
+		if (layer > max_level && !sub_dzits->IsDownloaded ()) {
+			if (!prefetch) {
+				double dx = sub_vp.x + sub_vp.width / 2 - (vp_ox + vp_w / 2);
+				double dy = sub_vp.y + sub_vp.height / 2 - (vp_oy + vp_h / 2);
+				
+				RequestSubImage (sub_image, layer, sqrt (dx * dx + dy * dy) / vp_w);
+			}
+			break;
+		}
+		
+		bool parsed = (layer > max_level && sub_dzits->IsParsed ());
+		int tile_width = parsed ? sub_image->source->GetTileWidth () : dzits->GetTileWidth ();
+		int tile_height = parsed ? sub_image->source->GetTileHeight () : dzits->GetTileHeight ();
+		guint64 layers2 = pow2 (layers - layer);
+		double v_scale = (double) layers2 * sub_vp.width / sub_w;
+		double v_tile_w = tile_width * v_scale;
+		double v_tile_h = tile_height * v_scale;
+		double minx = (MAX (vp_ox, sub_vp.x) - sub_vp.x) / v_tile_w;
+		double maxx = MIN (vp_ox + vp_w, sub_vp.x + sub_vp.width) - sub_vp.x;
+		double miny = (MAX (vp_oy, sub_vp.y) - sub_vp.y) / v_tile_h;
+		double maxy = MIN (vp_oy + vp_h, sub_vp.y + sub_vp.width / sub_ar) - sub_vp.y;
+		MultiScaleTileSource *tile_source;
+		QTree *tile_cache, *node;
+		guint64 x, y;
+		
+		for (int i = (int) minx; i * v_tile_w < maxx; i++) {
+			for (int j = (int) miny; j * v_tile_h < maxy; j++) {
+				if (layer <= max_level) {
+					guint64 layer2 = pow2 (layer);
+					x = morton_x (sub_image->n) * layer2 / tile_width;
+					y = morton_y (sub_image->n) * layer2 / tile_height;
+					tile_cache = shared_cache;
+					tile_source = dzits;
+				} else {
+					tile_source = sub_image->source;
+					tile_cache = subimage_cache;
+					x = i;
+					y = j;
 				}
+				
+				if (!(node = qtree_insert (tile_cache, layer, x, y)))
+					continue;
+				
+				if (qtree_has_tile (node))
+					continue;
+				
+				double dx = sub_vp.x + (i + 0.5) * v_tile_w - (vp_ox + vp_w / 2);
+				double dy = sub_vp.y + (j + 0.5) * v_tile_h - (vp_oy + vp_h / 2);
+				
+				RequestTile (tile_source, node, layer, x, y, sqrt (dx * dx + dy * dy) / vp_w, 1.0, prefetch, false);
 			}
 		}
 	}
@@ -28,6 +28,20 @@
 namespace Moonlight {
 
 struct BitmapImageContext;
+struct QTree;
+
+// What the tile scheduler did, for benchmarking against a tile server.
+struct MultiScaleImageStats {
+	int tiles_requested;          // downloads started
+	int tiles_prefetched;         // of which for where the viewport was heading
+	int tiles_downscaled;         // of which decoded at a lower resolution
+	int tiles_cancelled;          // downloads aborted because the tile went out of view
+	int tiles_wasted;             // cancelled, or downloaded after going out of view
+	int sharp_count;              // times the viewport became sharp after moving
+	TimeSpan last_time_to_sharp;  // from the first move until all the visible tiles are
+	TimeSpan max_time_to_sharp;   // at the optimal layer
+	TimeSpan total_time_to_sharp;
+};
 
 /* @Namespace=System.Windows.Controls */
 class MultiScaleImage : public MediaBase {
@@ -41,7 +55,17 @@ class MultiScaleImage : public MediaBase {
 	cairo_user_data_key_t full_opacity_at_key;
 	bool subimages_sorted;
 	List downloaders;
+	GPtrArray *subimage_downloads; // the DZIs of subimages being downloaded, each one takes a downloader
 	GHashTable *cache;
+	GArray *tile_requests;
+	MultiScaleImageStats stats;
+	Point last_viewport_origin;
+	double last_viewport_width;
+	TimeSpan last_viewport_time;
+	Point viewport_velocity;
+	double viewport_width_velocity;
+	TimeSpan sharp_pending_since;
+	bool rendered_sharp;
 	double zoom_target;
 	Point pan_target;
 	int motion;
@@ -57,6 +81,7 @@ class MultiScaleImage : public MediaBase {
 	
 	static void subdownloader_completed (EventObject *sender, EventArgs *calldata, gpointer closure);
 	static void subdownloader_failed (EventObject *sender, EventArgs *calldata, gpointer closure);
+	void SubImageDownloaded (DeepZoomImageTileSource *dzits);
 	
 	static void downloader_completed (EventObject *sender, EventArgs *calldata, gpointer closure);
 	static void downloader_failed (EventObject *sender, EventArgs *calldata, gpointer closure);
@@ -76,6 +101,15 @@ class MultiScaleImage : public MediaBase {
 	void ConnectSourceEvents (MultiScaleTileSource *source);
 	
 	void ProcessTile (BitmapImageContext *ctx);
+	void AbortTile (BitmapImageContext *ctx);
+	void RequestTile (MultiScaleTileSource *source, QTree *node, int level, guint64 x, guint64 y, double distance, double scale, bool prefetch, bool cache_missing);
+	void RequestSubImage (MultiScaleSubImage *sub_image, int level, double distance);
+	void DownloadSubImage (MultiScaleSubImage *sub_image);
+	void RequestSingleTiles (QTree *subimage_cache, int layers, int from_layer, int to_layer, double vp_ox, double vp_oy, double vp_w, bool prefetch);
+	void RequestCollectionTiles (MultiScaleSubImage *sub_image, QTree *subimage_cache, QTree *shared_cache, Rect sub_vp, int layers,
+				     int from_layer, int to_layer, double vp_ox, double vp_oy, double vp_w, bool prefetch);
+	void UpdateViewportMotion ();
+	bool GetPredictedViewport (Point *origin, double *width);
 	void RenderSingle (Context *ctx, Region *region);
 	void RenderCollection (Context *ctx, Region *region);
 	void UpdateIdleStatus ();
@@ -217,9 +251,18 @@ class MultiScaleImage : public MediaBase {
 	/* @DelegateType=RoutedEventHandler */
 	const static int ViewportChangedEvent;
 	
-	void DownloadTile (Uri *tile, void *user_data);
+	// @scale < 1 decodes the tile in @decode_width x @decode_height
+	bool DownloadTile (Uri *tile, void *user_data, double scale, int decode_width, int decode_height);
 	bool CanDownloadMoreTiles ();
 	void StopDownloading ();
+	int GetDownloadCount () { return downloaders.Length () + subimage_downloads->len; }
+	
+	// Requests the tiles of a single image for a viewport (Render does this), they
+	// are downloaded, the most urgent first, by the next ScheduleTiles ()
+	void RequestSingleTiles (int from_layer, int to_layer, double vp_ox, double vp_oy, double vp_w, bool prefetch);
+	void ScheduleTiles ();
+	
+	MultiScaleImageStats *GetTileStats () { return &stats; }
 	
 	void InvalidateTileLayer (int level, int tilePositionX, int tilePositionY, int tileLayer);
 };
@@ -22,6 +22,7 @@
 #include "deployment.h"
 #include "utils.h"
 #include "uri.h"
+#include "trace.h"
 
 namespace Moonlight {
 
@@ -385,6 +386,8 @@ HttpRequest::NotifySize (gint64 size)
 void
 HttpRequest::Write (gint64 offset, void *buffer, gint32 length)
 {
+	MOON_TRACE_SCOPE ("network", "HttpRequest::Write");
+
 	gint64 reported_offset = offset;
 
 	VERIFY_MAIN_THREAD;
@@ -417,6 +420,8 @@ HttpRequest::Write (gint64 offset, void *buffer, gint32 length)
 void
 HttpRequest::Started (HttpResponse *response)
 {
+	MOON_TRACE_SCOPE ("network", "HttpRequest::Started");
+
 	VERIFY_MAIN_THREAD;
 	LOG_DOWNLOADER ("HttpRequest::Started ()\n");
 
@@ -443,6 +448,8 @@ HttpRequest::Started (HttpResponse *response)
 void
 HttpRequest::Failed (const char *msg)
 {
+	MOON_TRACE_SCOPE ("network", "HttpRequest::Failed");
+
 	VERIFY_MAIN_THREAD;
 	LOG_DOWNLOADER ("HttpRequest::Failed (%s) HasHandlers: %i uri: %s\n", msg, HasHandlers (StoppedEvent), GetUri () != NULL ? GetUri ()->ToString () : NULL);
 
@@ -534,6 +541,8 @@ HttpRequest::NotifyFinalUri (const Uri *value)
 void
 HttpRequest::Succeeded ()
 {
+	MOON_TRACE_SCOPE ("network", "HttpRequest::Succeeded");
+
 	VERIFY_MAIN_THREAD;
 	LOG_DOWNLOADER ("HttpRequest::Succeeded (%s) HasHandlers: %i\n", request_uri ? request_uri->ToString () : NULL, HasHandlers (StoppedEvent));
 
@@ -1002,9 +1002,15 @@ MoonWindowingSystemGtk::MoonWindowingSystemGtk (bool out_of_browser)
 		g_thread_init (NULL);
 		gdk_threads_init ();
 	}
-	gtk_init (NULL, NULL);
 
-	LoadSystemColors ();
+	if (gtk_init_check (NULL, NULL)) {
+		LoadSystemColors ();
+	} else {
+		// no display (the headless benchmark harness runs like
+		// this), so there are no gtk styles to get the colors from.
+		g_warning ("Moonlight: Could not open a display, using the default system colors.");
+		LoadDefaultSystemColors ();
+	}
 
 #ifdef USE_GALLIUM
 	gscreen = swrast_screen_create (null_sw_create ());
@@ -1376,6 +1382,36 @@ color_from_gdk (GdkColor color)
 	return new Color ((color.red >> 8) & 0xff, (color.green >> 8) & 0xff, (color.blue >> 8) & 0xff, 255);
 }
 
+void
+MoonWindowingSystemGtk::LoadDefaultSystemColors ()
+{
+	for (int i = 0; i < (int) NumSystemColors; i++) {
+		switch (i) {
+		case ActiveCaptionTextColor:
+		case ControlTextColor:
+		case InactiveCaptionTextColor:
+		case InfoTextColor:
+		case MenuTextColor:
+		case WindowTextColor:
+			system_colors[i] = new Color (0xff000000);
+			break;
+		case HighlightTextColor:
+		case WindowColor:
+			system_colors[i] = new Color (0xffffffff);
+			break;
+		case HighlightColor:
+			system_colors[i] = new Color (0xff316ac5);
+			break;
+		case GrayTextColor:
+			system_colors[i] = new Color (0xff808080);
+			break;
+		default:
+			system_colors[i] = new Color (0xffd4d0c8);
+			break;
+		}
+	}
+}
+
 void
 MoonWindowingSystemGtk::LoadSystemColors ()
 {
@@ -71,6 +71,7 @@ private:
 #endif
 	
 	void LoadSystemColors ();
+	void LoadDefaultSystemColors ();
 	
 	void RegisterWindow (MoonWindow *window);
 
@@ -15,11 +15,16 @@ MoonPixbufLoaderGtk::MoonPixbufLoaderGtk (const char *imageType)
 {
 	gdk_loader = gdk_pixbuf_loader_new_with_type (imageType, NULL);
 	crc_error = false;
+	max_width = 0;
+	max_height = 0;
 }
 
 MoonPixbufLoaderGtk::MoonPixbufLoaderGtk ()
 {
 	gdk_loader = gdk_pixbuf_loader_new ();
+	crc_error = false;
+	max_width = 0;
+	max_height = 0;
 }
 
 MoonPixbufLoaderGtk::~MoonPixbufLoaderGtk ()
@@ -67,6 +72,32 @@ MoonPixbufLoaderGtk::Close (MoonError **error)
 	}
 }
 
+void
+MoonPixbufLoaderGtk::SetMaxSize (int max_width, int max_height)
+{
+	if (this->max_width == 0 && this->max_height == 0)
+		g_signal_connect (gdk_loader, "size-prepared", G_CALLBACK (size_prepared), this);
+
+	this->max_width = max_width;
+	this->max_height = max_height;
+}
+
+void
+MoonPixbufLoaderGtk::size_prepared (GdkPixbufLoader *loader, int width, int height, gpointer user_data)
+{
+	MoonPixbufLoaderGtk *self = (MoonPixbufLoaderGtk *) user_data;
+	double scale = 1.0;
+
+	if (self->max_width > 0 && width > self->max_width)
+		scale = (double) self->max_width / width;
+	if (self->max_height > 0 && height * scale > self->max_height)
+		scale = (double) self->max_height / height;
+
+	// jpegs are scaled while they're decoded, so this saves both time and memory
+	if (scale < 1.0)
+		gdk_pixbuf_loader_set_size (loader, MAX (1, (int) (width * scale + 0.5)), MAX (1, (int) (height * scale + 0.5)));
+}
+
 MoonPixbuf*
 MoonPixbufLoaderGtk::GetPixbuf ()
 {
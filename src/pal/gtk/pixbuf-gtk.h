@@ -35,10 +35,15 @@ public:
 	virtual void Write (const guchar *buffer, int buflen, MoonError **error);
 	virtual void Close (MoonError **error);
 	virtual MoonPixbuf *GetPixbuf ();
+	virtual void SetMaxSize (int max_width, int max_height);
 
 private:
 	GdkPixbufLoader *gdk_loader;
 	bool crc_error;
+	int max_width;
+	int max_height;
+
+	static void size_prepared (GdkPixbufLoader *loader, int width, int height, gpointer user_data);
 };
 
 };
@@ -23,6 +23,7 @@
 #include "install-dialog-gtk.h"
 #include "deployment.h"
 #include "timemanager.h"
+#include "trace.h"
 #include "enums.h"
 #include "context-cairo.h"
 #ifdef USE_GALLIUM
@@ -1293,10 +1294,9 @@ MoonWindowGtk::PaintToDrawable (GdkVisual *visual, cairo_t *cr_t, GtkAllocation
 {
 	SetCurrentDeployment ();
 
+	MOON_TRACE_SCOPE ("render", "MoonWindowGtk::PaintToDrawable");
+
 #if 0
-#if TIME_REDRAW
-	STARTTIMER (expose, "redraw");
-#endif
 	if (cache_size_multiplier == -1)
 	{
 		cache_size_multiplier = gdk_drawable_get_depth (drawable) / 8 + 1;
@@ -1397,10 +1397,6 @@ MoonWindowGtk::PaintToDrawable (GdkVisual *visual, cairo_t *cr_t, GtkAllocation
 	    delete ctx;
 
         delete region;
-
-#if TIME_REDRAW
-        ENDTIMER (expose, "redraw");
-#endif
 }
 
 #else
@@ -1413,10 +1409,9 @@ MoonWindowGtk::PaintToDrawable (GdkDrawable *drawable, GdkVisual *visual, GdkEve
 	
 	SetCurrentDeployment ();
 
+	MOON_TRACE_SCOPE ("render", "MoonWindowGtk::PaintToDrawable");
+
 #if 0
-#if TIME_REDRAW
-	STARTTIMER (expose, "redraw");
-#endif
 	if (cache_size_multiplier == -1)
 		cache_size_multiplier = gdk_drawable_get_depth (drawable) / 8 + 1;
 #endif
@@ -1510,10 +1505,6 @@ MoonWindowGtk::PaintToDrawable (GdkDrawable *drawable, GdkVisual *visual, GdkEve
 
 	delete region;
 
-#if TIME_REDRAW
-	ENDTIMER (expose, "redraw");
-#endif
-
 }
 #endif
 
@@ -264,6 +264,10 @@ public:
 	virtual void Write (const guchar *buffer, int buflen, MoonError **error = NULL) = 0;
 	virtual void Close (MoonError **error = NULL) = 0;
 	virtual MoonPixbuf *GetPixbuf () = 0;
+	// Asks the loader to scale the image down (keeping its aspect ratio) so
+	// that it fits in @max_width x @max_height while decoding it. Must be
+	// called before the first Write, loaders which can't do it ignore it.
+	virtual void SetMaxSize (int max_width, int max_height) {}
 	virtual ~MoonPixbufLoader () {}
 };
 
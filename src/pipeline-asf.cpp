@@ -24,6 +24,8 @@
 
 // according to http://msdn.microsoft.com/en-us/library/cc307965(VS.85).aspx the maximum size is 10 MB
 #define ASF_OBJECT_MAX_SIZE (10 * 1024 * 1024)
+// how much we read after the data object looking for index objects (a simple index entry takes 6 bytes per second)
+#define ASF_INDEX_MAX_SIZE (4 * 1024 * 1024)
 
 namespace Moonlight {
 
@@ -84,6 +86,9 @@ ASFDemuxer::Init (MemoryBuffer *initial_buffer, MmsPlaylistEntry *playlist_entry
 	memset (extended_stream_properties, 0, sizeof (ASFExtendedStreamProperties *) * 127);
 	marker = NULL;
 	script_command = NULL;
+	memset (seek_indices, 0, sizeof (ASFSeekIndex *) * 127);
+	index_requested = false;
+	index_seek_pending = false;
 	stream_to_asf_index = NULL;
 	header_read = false;
 	this->playlist_entry = playlist_entry;
@@ -115,6 +120,7 @@ ASFDemuxer::~ASFDemuxer ()
 		delete readers [i];
 		delete stream_properties [i];
 		delete extended_stream_properties [i];
+		delete seek_indices [i];
 	}
 	delete file_properties;
 	delete marker;
@@ -179,6 +185,19 @@ guint64
 ASFDemuxer::EstimatePacketIndexOfPts (guint64 pts)
 {
 	guint64 result = G_MAXUINT64;
+
+	/* The index objects point straight at the key frames */
+	for (int i = 1; i < 127; i++) {
+		if (readers [i] == NULL || seek_indices [i - 1] == NULL)
+			continue;
+
+		result = MIN (seek_indices [i - 1]->Lookup (pts + MilliSeconds_ToPts (GetPreroll ())), result);
+	}
+	if (result != G_MAXUINT64) {
+		LOG_ASF ("ASFDemuxer::EstimatePacketIndexOfPts (%" G_GUINT64_FORMAT "): found packet %" G_GUINT64_FORMAT " in the index objects\n", pts, result);
+		return MIN (result, GetPacketCount () - 1);
+	}
+
 	for (int i = 0; i < 127; i++) {
 		if (readers [i] == NULL)
 			continue;
@@ -374,6 +393,11 @@ ASFDemuxer::SeekAsyncInternal (guint64 pts)
 		return;
 	}
 
+	/* The index objects (if there are any) follow the data object, read them on the first seek they are available for */
+	index_seek_pending = false;
+	if (!index_requested && RequestIndexObjects (pts))
+		return;
+
 	/* Now we can only guess which packet we should seek to */
 	next_packet_index = EstimatePacketIndexOfPts (pts);
 	LOG_ASF ("ASFDemuxer::SeekAsyncInternal (): Seeking to packet index: %" G_GUINT64_FORMAT ")\n", next_packet_index);
@@ -382,6 +406,94 @@ ASFDemuxer::SeekAsyncInternal (guint64 pts)
 	RequestMorePayloadData ();
 }
 
+bool
+ASFDemuxer::RequestIndexObjects (guint64 pts)
+{
+	MediaReadClosure *closure;
+	gint64 start, size, count;
+	Media *media;
+
+	if (file_properties->IsBroadcast () || data_object_size == 0) {
+		index_requested = true;
+		return false;
+	}
+
+	start = header_size + data_object_size;
+	size = source->GetSize ();
+	if (size <= start + 24) {
+		LOG_ASF ("ASFDemuxer::RequestIndexObjects (): no index objects (file size: %" G_GINT64_FORMAT ", end of data object: %" G_GINT64_FORMAT ")\n", size, start);
+		index_requested = true;
+		return false;
+	}
+	count = MIN (size - start, ASF_INDEX_MAX_SIZE);
+
+	/* Never make a download fetch (or wait for) the end of the file just for the index objects:
+	 * they're only read from local files, or once they've been downloaded. Until then the seeks
+	 * use estimates, and the next seek checks again. */
+	if (!source->Is (Type::FILESOURCE) &&
+	    !(source->Is (Type::PROGRESSIVESOURCE) && ((ProgressiveSource *) source)->IsRangeDownloaded (start, count))) {
+		LOG_ASF ("ASFDemuxer::RequestIndexObjects (): the index objects haven't been downloaded yet\n");
+		return false;
+	}
+
+	media = GetMediaReffed ();
+	if (media == NULL)
+		return false;
+
+	index_requested = true;
+
+	closure = new MediaReadClosure (media, ReadIndexObjectsCallback, this, start, count);
+	source->ReadAsync (closure);
+	closure->unref ();
+	media->unref ();
+
+	/* the data is there, the read doesn't wait for anything */
+	seeked_to_pts = pts;
+	index_seek_pending = true;
+
+	return true;
+}
+
+MediaResult
+ASFDemuxer::ReadIndexObjectsCallback (MediaClosure *c)
+{
+	MediaReadClosure *closure = (MediaReadClosure *) c;
+	((ASFDemuxer *) closure->GetContext ())->ReadIndexObjects (closure->GetData ());
+	return MEDIA_SUCCESS;
+}
+
+void
+ASFDemuxer::ReadIndexObjects (MemoryBuffer *buffer)
+{
+	ASFSeekIndex::StreamKind streams [127];
+
+	VERIFY_MEDIA_THREAD;
+
+	if (IsDisposed ())
+		return;
+
+	if (buffer != NULL) {
+		for (int i = 0; i < 127; i++) {
+			if (!IsValidStream (i + 1))
+				streams [i] = ASFSeekIndex::NoStream;
+			else if (GetStreamProperties (i + 1)->IsVideo ())
+				streams [i] = ASFSeekIndex::VideoStream;
+			else
+				streams [i] = ASFSeekIndex::OtherStream;
+		}
+
+		ASFSeekIndex::ReadObjects ((const guint8 *) buffer->GetCurrentPtr (), buffer->GetRemainingSize (), GetPacketSize (), streams, seek_indices);
+	}
+
+	if (!index_seek_pending)
+		return;
+
+	index_seek_pending = false;
+	next_packet_index = EstimatePacketIndexOfPts (seeked_to_pts);
+	LOG_ASF ("ASFDemuxer::ReadIndexObjects (): Seeking to packet index: %" G_GUINT64_FORMAT ")\n", next_packet_index);
+	RequestMorePayloadData ();
+}
+
 guint64
 ASFDemuxer::GetPacketCount ()
 {
@@ -5079,6 +5191,295 @@ ASFPacket::Read ()
 	return true;
 }
 
+/*
+ *	ASFSeekIndex
+ */
+
+static inline guint16
+asf_read_uint16 (const guint8 *p)
+{
+	return p [0] | (p [1] << 8);
+}
+
+static inline guint32
+asf_read_uint32 (const guint8 *p)
+{
+	return p [0] | (p [1] << 8) | (p [2] << 16) | ((guint32) p [3] << 24);
+}
+
+static inline guint64
+asf_read_uint64 (const guint8 *p)
+{
+	return asf_read_uint32 (p) | ((guint64) asf_read_uint32 (p + 4) << 32);
+}
+
+ASFSeekIndex::ASFSeekIndex (guint64 interval, guint32 count)
+{
+	this->interval = interval;
+	this->count = count;
+	packets = (guint32 *) g_malloc (sizeof (guint32) * count);
+}
+
+ASFSeekIndex::~ASFSeekIndex ()
+{
+	g_free (packets);
+}
+
+guint64
+ASFSeekIndex::Lookup (guint64 time)
+{
+	guint64 i = MIN (time / interval, count - 1);
+
+	/* Index objects may have entries without a key frame */
+	while (packets [i] == G_MAXUINT32) {
+		if (i == 0)
+			return G_MAXUINT64;
+		i--;
+	}
+
+	return packets [i];
+}
+
+ASFSeekIndex *
+ASFSeekIndex::ReadSimpleIndex (const guint8 *data, guint64 size)
+{
+	ASFSeekIndex *index;
+	guint64 interval;
+	guint32 count;
+
+	/* file id (guid), index entry time interval, maximum packet count, index entries count */
+	if (size < 32)
+		return NULL;
+
+	interval = asf_read_uint64 (data + 16);
+	count = asf_read_uint32 (data + 28);
+	data += 32;
+
+	if (interval == 0 || count == 0 || (guint64) count * 6 > size - 32) {
+		LOG_ASF ("ASFSeekIndex::ReadSimpleIndex (): invalid simple index (interval: %" G_GUINT64_FORMAT ", count: %u, size: %" G_GUINT64_FORMAT ")\n", interval, count, size);
+		return NULL;
+	}
+
+	index = new ASFSeekIndex (interval, count);
+	for (guint32 i = 0; i < count; i++, data += 6) {
+		/* packet number, packet count */
+		index->packets [i] = asf_read_uint32 (data);
+	}
+
+	LOG_ASF ("ASFSeekIndex::ReadSimpleIndex (): %u entries, one every %" G_GUINT64_FORMAT " ms\n", count, MilliSeconds_FromPts (interval));
+
+	return index;
+}
+
+int
+ASFSeekIndex::ReadIndex (const guint8 *data, guint64 size, guint32 packet_size, ASFSeekIndex **indices)
+{
+	const guint8 *end = data + size;
+	guint16 *streams = NULL;
+	guint64 *positions = NULL;
+	GArray **packets = NULL;
+	guint16 specifiers;
+	guint32 interval;
+	guint32 blocks;
+	int result = 0;
+
+	/* index entry time interval (ms), index specifiers count, index blocks count */
+	if (size < 10 || packet_size == 0)
+		return 0;
+
+	interval = asf_read_uint32 (data);
+	specifiers = asf_read_uint16 (data + 4);
+	blocks = asf_read_uint32 (data + 6);
+	data += 10;
+
+	if (interval == 0 || specifiers == 0 || (guint64) specifiers * 4 > (guint64) (end - data))
+		return 0;
+
+	streams = (guint16 *) g_malloc (sizeof (guint16) * specifiers);
+	positions = (guint64 *) g_malloc (sizeof (guint64) * specifiers);
+	packets = (GArray **) g_malloc (sizeof (GArray *) * specifiers);
+	for (guint16 s = 0; s < specifiers; s++, data += 4) {
+		/* stream number, index type */
+		streams [s] = asf_read_uint16 (data);
+		packets [s] = g_array_new (false, false, sizeof (guint32));
+	}
+
+	/* Each block has the entries following the previous block's, a truncated index keeps the complete blocks */
+	for (guint32 b = 0; b < blocks; b++) {
+		guint32 entries;
+
+		if ((guint64) (end - data) < 4 + (guint64) specifiers * 8)
+			break;
+
+		entries = asf_read_uint32 (data);
+		data += 4;
+		for (guint16 s = 0; s < specifiers; s++, data += 8)
+			positions [s] = asf_read_uint64 (data);
+
+		if ((guint64) entries * specifiers * 4 > (guint64) (end - data))
+			break;
+
+		for (guint32 e = 0; e < entries; e++) {
+			for (guint16 s = 0; s < specifiers; s++, data += 4) {
+				guint32 offset = asf_read_uint32 (data);
+				guint32 packet = G_MAXUINT32;
+
+				/* the offsets are relative to the block position, which is relative to the first packet */
+				if (offset != G_MAXUINT32)
+					packet = MIN ((positions [s] + offset) / packet_size, G_MAXUINT32 - 1);
+
+				g_array_append_val (packets [s], packet);
+			}
+		}
+	}
+
+	for (guint16 s = 0; s < specifiers; s++) {
+		ASFSeekIndex *index;
+		GArray *array = packets [s];
+
+		if (streams [s] < 1 || streams [s] > 127 || array->len == 0 || indices [streams [s] - 1] != NULL) {
+			g_array_free (array, true);
+			continue;
+		}
+
+		index = new ASFSeekIndex (MilliSeconds_ToPts ((guint64) interval), 0);
+		g_free (index->packets);
+		index->count = array->len;
+		index->packets = (guint32 *) g_array_free (array, false);
+		indices [streams [s] - 1] = index;
+		result++;
+
+		LOG_ASF ("ASFSeekIndex::ReadIndex (): %u entries for stream %u, one every %u ms\n", index->count, streams [s], interval);
+	}
+
+	g_free (streams);
+	g_free (positions);
+	g_free (packets);
+
+	return result;
+}
+
+void
+ASFSeekIndex::ReadObjects (const guint8 *data, guint64 size, guint32 packet_size, const StreamKind *streams, ASFSeekIndex **indices)
+{
+	const guint8 *end = data + size;
+	guint32 video_stream = 0;
+	ASFGuid guid;
+
+	while (end - data >= 24) {
+		guint64 object_size;
+
+		guid.a = asf_read_uint32 (data);
+		guid.b = asf_read_uint16 (data + 4);
+		guid.c = asf_read_uint16 (data + 6);
+		memcpy (guid.d, data + 8, 8);
+		object_size = asf_read_uint64 (data + 16);
+
+		if (object_size < 24 || object_size > (guint64) (end - data)) {
+			LOG_ASF ("ASFSeekIndex::ReadObjects (): object %s is truncated or invalid (size: %" G_GUINT64_FORMAT ")\n", guid.ToString (), object_size);
+			break;
+		}
+
+		if (asf_guids_simple_index == guid) {
+			/* Simple Index objects don't say which stream they index, there's one for each video stream, in order */
+			do {
+				video_stream++;
+			} while (video_stream <= 127 && streams [video_stream - 1] != VideoStream);
+
+			/* An Index object for the same stream is better */
+			if (video_stream <= 127 && indices [video_stream - 1] == NULL)
+				indices [video_stream - 1] = ReadSimpleIndex (data + 24, object_size - 24);
+		} else if (asf_guids_index == guid) {
+			ASFSeekIndex *read [127];
+
+			memset (read, 0, sizeof (ASFSeekIndex *) * 127);
+			ReadIndex (data + 24, object_size - 24, packet_size, read);
+
+			for (int i = 0; i < 127; i++) {
+				if (read [i] == NULL)
+					continue;
+
+				if (streams [i] == NoStream) {
+					delete read [i];
+					continue;
+				}
+
+				delete indices [i];
+				indices [i] = read [i];
+			}
+		} else {
+			LOG_ASF ("ASFSeekIndex::ReadObjects (): skipping object %s\n", guid.ToString ());
+		}
+
+		data += object_size;
+	}
+}
+
+/*
+ *	ASFKeyFrameTable
+ */
+
+ASFKeyFrameTable::ASFKeyFrameTable ()
+{
+	key_frames = g_array_new (false, false, sizeof (ASFFrameReaderKeyFrame));
+}
+
+ASFKeyFrameTable::~ASFKeyFrameTable ()
+{
+	g_array_free (key_frames, true);
+}
+
+guint
+ASFKeyFrameTable::Search (guint64 pts)
+{
+	guint lo = 0, hi = key_frames->len;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (g_array_index (key_frames, ASFFrameReaderKeyFrame, mid).pts > pts)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+void
+ASFKeyFrameTable::Add (guint64 pts, guint64 packet_index)
+{
+	ASFFrameReaderKeyFrame key_frame;
+	guint next = Search (pts);
+
+	/* Keep them at least ASF_KEY_FRAME_INTERVAL apart */
+	if (next > 0 && pts - g_array_index (key_frames, ASFFrameReaderKeyFrame, next - 1).pts < ASF_KEY_FRAME_INTERVAL)
+		return;
+	if (next < key_frames->len && g_array_index (key_frames, ASFFrameReaderKeyFrame, next).pts - pts < ASF_KEY_FRAME_INTERVAL)
+		return;
+
+	key_frame.pts = pts;
+	key_frame.packet_index = packet_index;
+	g_array_insert_val (key_frames, next, key_frame);
+}
+
+guint64
+ASFKeyFrameTable::Find (guint64 pts)
+{
+	guint next = Search (pts);
+
+	/* If we haven't read around pts, there may be a much closer key frame we don't know about.
+	 * Otherwise there may still be one between the two we know about, but the seek reads
+	 * forward to it. */
+	if (next == 0 || next == key_frames->len)
+		return G_MAXUINT64;
+
+	if (g_array_index (key_frames, ASFFrameReaderKeyFrame, next).pts - g_array_index (key_frames, ASFFrameReaderKeyFrame, next - 1).pts > ASF_KEY_FRAME_MAX_GAP)
+		return G_MAXUINT64;
+
+	return g_array_index (key_frames, ASFFrameReaderKeyFrame, next - 1).packet_index;
+}
+
 /*
  *	ASFFrameReader
  */
@@ -5188,6 +5589,21 @@ ASFFrameReader::AddFrameIndex ()
 	//printf ("ASFFrameReader::AddFrameIndex (%" G_GUINT64_FORMAT "). k = %u, start_pts = %" G_GUINT64_FORMAT ", end_pts = %" G_GUINT64_FORMAT ", stream = %i\n", packet_index, k, index [k].start_pts, index [k].end_pts, stream_number);
 }
 
+void
+ASFFrameReader::AddKeyFrame ()
+{
+	if (packet_index == G_MAXUINT64 || !(IsKeyFrame () || stream->IsAudio ()))
+		return;
+
+	key_frames.Add (pts, packet_index);
+}
+
+guint64
+ASFFrameReader::FindKeyFrame (guint64 pts)
+{
+	return key_frames.Find (pts);
+}
+
 guint32
 ASFFrameReader::FrameSearch (guint64 pts)
 {
@@ -5429,6 +5845,7 @@ ASFFrameReader::Advance ()
 */
 
 	AddFrameIndex ();
+	AddKeyFrame ();
 }
 
 gint64
@@ -5460,6 +5877,11 @@ ASFFrameReader::EstimatePacketIndexOfPts (guint64 pts)
 		return demuxer->GetPacketCount () - 1;
 	}
 	
+	packet_index = FindKeyFrame (pts);
+
+	if (packet_index != G_MAXUINT64)
+		return packet_index;
+
 	packet_index = FrameSearch (pts);
 	
 	if (packet_index != G_MAXUINT32) {
@@ -29,6 +29,7 @@ class ASFMarkerDecoder;
 class ASFMarkerDecoderInfo;
 class ASFMultiplePayloads;
 class ASFScriptCommand;
+class ASFSeekIndex;
 class ASFSinglePayload;
 class ASFStreamProperties;
 class MmsSource;
@@ -425,6 +426,11 @@ private:
 	ASFMarker *marker;
 	ASFScriptCommand *script_command;
 
+	/* The Simple Index and Index objects after the data object, by stream index - 1 */
+	ASFSeekIndex *seek_indices [127];
+	bool index_requested; /* if we've read them (or know there are none), checked again on every seek until then */
+	bool index_seek_pending; /* if a seek is waiting for them */
+
 	guint32 *stream_to_asf_index;
 	MemoryBuffer *initial_buffer;
 
@@ -438,6 +444,11 @@ private:
 	void ReadMarkers ();
 	void OpenDemuxer (MemoryBuffer *buffer);
 
+	/* Starts reading the index objects, returns true if the seek to @pts must wait for them */
+	bool RequestIndexObjects (guint64 pts);
+	void ReadIndexObjects (MemoryBuffer *buffer);
+	static MediaResult ReadIndexObjectsCallback (MediaClosure *closure);
+
 	static MediaResult OpenDemuxerCallback (MediaClosure *closure);
 
 	/* Resets all readers */
@@ -462,7 +473,8 @@ private:
 	ASFFrameReader *GetFrameReader (guint32 asf_stream_index);
 
 	/* Estimate the packet index of the specified pts.
-	 * Calls EstimatePacketIndexOfPts on all readers and returns the lowest value. */
+	 * Looks up the pts in the index objects of the selected streams if the file has any,
+	 * otherwise calls EstimatePacketIndexOfPts on all readers and returns the lowest value. */
 	guint64 EstimatePacketIndexOfPts (guint64 pts);
 
 	static MediaResult DeliverDataCallback (MediaClosure *closure);
@@ -1147,6 +1159,78 @@ struct ASFFrameReaderIndex {
 	guint64 end_pts;
 };
 
+/*
+ * ASFFrameReaderKeyFrame
+ */
+struct ASFFrameReaderKeyFrame {
+	guint64 pts;
+	guint64 packet_index;
+};
+
+// the minimum pts between the key frames an ASFKeyFrameTable remembers (1 second)
+#define ASF_KEY_FRAME_INTERVAL 10000000
+// the most pts between two remembered key frames for us to assume we've read what's between them (30 seconds)
+#define ASF_KEY_FRAME_MAX_GAP 300000000
+
+/*
+ * ASFKeyFrameTable: the packets of the key frames a frame reader has
+ * read, sorted by pts, at most one every ASF_KEY_FRAME_INTERVAL (a few
+ * hours of video shouldn't take more than a few hundred kb).
+ */
+class ASFKeyFrameTable {
+	GArray *key_frames; // ASFFrameReaderKeyFrames
+
+	/* The index of the first key frame after @pts */
+	guint Search (guint64 pts);
+
+public:
+	ASFKeyFrameTable ();
+	~ASFKeyFrameTable ();
+
+	void Add (guint64 pts, guint64 packet_index);
+	/* Returns the packet index of the last key frame at or before @pts if there is also one
+	 * shortly after it, otherwise G_MAXUINT64. */
+	guint64 Find (guint64 pts);
+
+	guint GetCount () { return key_frames->len; }
+};
+
+/*
+ * ASFSeekIndex: the packet with the key frame at or before every
+ * interval of a stream, from a Simple Index object (one for each video
+ * stream) or an Index object (any stream). Times are presentation times,
+ * preroll included.
+ */
+class ASFSeekIndex {
+public:
+	guint64 interval; /* in pts */
+	guint32 count;
+	guint32 *packets; /* G_MAXUINT32 if the entry has no key frame */
+
+	ASFSeekIndex (guint64 interval, guint32 count);
+	~ASFSeekIndex ();
+
+	/* Returns the packet to read to find the key frame at or before @time, or G_MAXUINT64 if there is none. */
+	guint64 Lookup (guint64 time);
+
+	/* These parse the objects after their guid and size. */
+	/* Returns NULL if the object is invalid or empty. */
+	static ASFSeekIndex *ReadSimpleIndex (const guint8 *data, guint64 size);
+	/* Stores the index of each stream in @indices (by stream index - 1), returns the number of indices read. */
+	static int ReadIndex (const guint8 *data, guint64 size, guint32 packet_size, ASFSeekIndex **indices);
+
+	enum StreamKind {
+		NoStream,
+		OtherStream,
+		VideoStream
+	};
+
+	/* Parses the objects following the data object (guid and size included) into @indices (by stream index - 1),
+	 * given the kind of each stream in @streams (by stream index - 1). Index objects replace the indices already
+	 * in @indices, Simple Index objects only fill in the video streams without one. */
+	static void ReadObjects (const guint8 *data, guint64 size, guint32 packet_size, const StreamKind *streams, ASFSeekIndex **indices);
+};
+
 /*
  *	The data in an ASF file has the following structure:
  *		Data
@@ -1196,6 +1280,7 @@ private:
 	// Index data
 	guint32 index_size; // The number of items in the index.
 	ASFFrameReaderIndex *index; // A table of ASFFrameReaderIndexes.
+	ASFKeyFrameTable key_frames; // The key frames we've read.
 
 	bool ResizeList (guint32 size); // Resizes the list of payloads to the requested size. 
 	void RemoveAll (); // Deletes the entire queue of payloads (and deletes every element)
@@ -1241,6 +1326,11 @@ public:
 
 	/* Adds the current frame to the index. */
 	void AddFrameIndex ();
+	/* Adds the current frame to the key frames, if it's a key frame. */
+	void AddKeyFrame ();
+	/* Returns the packet index of the last key frame we've read at or before @pts if we've also
+	 * read one shortly after it, otherwise G_MAXUINT64. */
+	guint64 FindKeyFrame (guint64 pts);
 	void Reset ();
 
 	guint32 GetDataCounter () { return data_counter; }
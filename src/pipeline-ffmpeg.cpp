@@ -33,6 +33,7 @@
 namespace Moonlight {
 
 #define AUDIO_BUFFER_SIZE (AVCODEC_MAX_AUDIO_FRAME_SIZE * 2)
+#define MAX_VIDEO_THREADS 8
 
 MoonMutex ffmpeg_mutex;
 
@@ -68,11 +69,71 @@ FfmpegDecoder::FfmpegDecoder (Media* media, IMediaStream* stream)
 	frame_buffer = NULL;
 	frame_buffer_length = 0;
 	last_pts = G_MAXUINT64;
+	thread_count = 1;
+	frame_threads = false;
+	draining = false;
+}
+
+int
+FfmpegDecoder::GetVideoThreadCount ()
+{
+	const char *env = g_getenv ("MOONLIGHT_FFMPEG_THREADS");
+	long count;
+
+	if (env != NULL) {
+		count = strtol (env, NULL, 10);
+	} else {
+		count = sysconf (_SC_NPROCESSORS_ONLN);
+		if (count > MAX_VIDEO_THREADS)
+			count = MAX_VIDEO_THREADS;
+	}
+
+	return count < 1 ? 1 : (int) count;
 }
 
 void
 FfmpegDecoder::InputEnded ()
 {
+	AVPacket packet;
+	AVFrame *frame;
+	MediaFrame *mf;
+	int got_picture;
+	int length;
+
+	/* Reporting the delayed frames below may end up calling us again */
+	if (draining)
+		return;
+
+	if (frame_threads && context != NULL) {
+		/* With frame threading ffmpeg holds on to several frames, get them out by decoding empty packets */
+		draining = true;
+		while (!IsDisposed ()) {
+			frame = avcodec_alloc_frame ();
+			got_picture = 0;
+			av_init_packet (&packet);
+			packet.data = NULL;
+			packet.size = 0;
+			length = avcodec_decode_video2 (context, frame, &got_picture, &packet);
+
+			if (length < 0 || !got_picture) {
+				av_free (frame);
+				break;
+			}
+
+			mf = new MediaFrame (GetStream ());
+			mf->pts = frame->reordered_opaque;
+			LOG_FFMPEG ("FfmpegDecoder::InputEnded (): got delayed picture, pts: %" G_GUINT64_FORMAT " ms\n", MilliSeconds_FromPts (mf->pts));
+			if (!SetPicture (mf, frame)) {
+				mf->unref ();
+				break;
+			}
+			mf->AddState (MediaFrameDecoded);
+			ReportDecodeFrameCompleted (mf);
+			mf->unref ();
+		}
+		draining = false;
+	}
+
 	GetStream ()->SetOutputEnded (true);
 }
 
@@ -150,6 +211,7 @@ FfmpegDecoder::OpenDecoderAsyncInternal ()
 			 * so I'm not entirely sure what I made it encode to. */
 			context->pix_fmt = PIX_FMT_YUV420P;
 		}
+		thread_count = GetVideoThreadCount ();
 	} else if (stream->IsAudio ()) {
 		AudioStream *as = (AudioStream*) stream;
 		context->sample_rate = as->GetSampleRate ();
@@ -163,6 +225,18 @@ FfmpegDecoder::OpenDecoderAsyncInternal ()
 		return;
 	}
 
+	if (thread_count > 1) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(52, 112, 0)
+		/* avcodec_open starts the threads, picking frame threading if the codec supports it */
+		context->thread_count = thread_count;
+		context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+#else
+		/* slice threading only, which doesn't delay the output */
+		if (avcodec_thread_init (context, thread_count) < 0)
+			thread_count = 1;
+#endif
+	}
+
 	ffmpeg_mutex.Lock();
 	ffmpeg_result = avcodec_open (context, codec);
 	ffmpeg_mutex.Unlock();
@@ -174,6 +248,12 @@ FfmpegDecoder::OpenDecoderAsyncInternal ()
 		return;
 	}
 	
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(52, 112, 0)
+	frame_threads = context->thread_count > 1 && (context->active_thread_type & FF_THREAD_FRAME);
+#endif
+
+	LOG_FFMPEG ("FfmpegDecoder::Open (): decoding with %i thread(s), frame threading: %i\n", thread_count, frame_threads);
+	
 	SetPixelFormat (FfmpegDecoder::ToMoonPixFmt (context->pix_fmt));
 	
 	ReportOpenDecoderCompleted ();
@@ -206,11 +286,8 @@ FfmpegDecoder::Cleanup (MediaFrame *frame)
 	AVFrame *av_frame = (AVFrame *) frame->decoder_specific_data;
 	
 	if (av_frame != NULL) {
-		if (av_frame->data[0] != frame->data_stride[0]) {
-			for (int i = 0; i < 4; i++)
-				free (frame->data_stride[i]);
-		}
-		
+		// The planes we copied live in the frame's buffer (freed by the frame itself),
+		// any other planes point into ffmpeg's buffers.
 		frame->decoder_specific_data = NULL;
 		av_free (av_frame);
 	}
@@ -247,6 +324,77 @@ FfmpegDecoder::CleanState ()
 	}		
 }
 
+bool
+FfmpegDecoder::SetPicture (MediaFrame *mf, AVFrame *frame)
+{
+	IMediaStream *stream = GetStream ();
+	guint32 plane_offset [4];
+	guint32 size = 0;
+
+	mf->AddState (MediaFramePlanar);
+	mf->FreeBuffer ();
+	mf->SetBufLen (0);
+	
+	mf->srcSlideY = 0;
+	mf->srcSlideH = context->height;
+	
+	mf->width = context->width;
+	mf->height = context->height;
+
+	int height = context->height;
+	int plane_bytes [4];
+	
+	switch (GetPixelFormat ()) {
+	case MoonPixelFormatYUV420P:
+		plane_bytes [0] = height * frame->linesize [0];
+		plane_bytes [1] = height * frame->linesize [1] / 2;
+		plane_bytes [2] = height * frame->linesize [2] / 2;
+		plane_bytes [3] = 0;
+		break;
+	default:
+		LOG_FFMPEG ("FfmpegDecoder::DecodeFrame (): Unknown output format, can't calculate byte number.\n");
+		plane_bytes [0] = 0;
+		plane_bytes [1] = 0;
+		plane_bytes [2] = 0;
+		plane_bytes [3] = 0;
+		break;
+	}
+	
+	// Copy all the planes into one (16 byte aligned, padded) buffer from the stream's frame pool.
+	for (int i = 0; i < 4; i++) {
+		plane_offset [i] = size;
+		if (plane_bytes [i] != 0)
+			size += (plane_bytes [i] + stream->GetMinPadding () + 15) & ~15;
+	}
+
+	if (size > 0 && !mf->AllocateBuffer (size, 16)) {
+		/* Error has already been reported */
+		av_free (frame);
+		return false;
+	}
+	mf->SetBufLen (0);
+
+	for (int i = 0; i < 4; i++) {
+		if (plane_bytes [i] != 0) {
+			mf->data_stride[i] = mf->GetBuffer () + plane_offset [i];
+			memcpy (mf->data_stride[i], frame->data[i], plane_bytes[i]);
+		} else {
+			mf->data_stride[i] = frame->data[i];
+		}
+		
+		mf->srcStride[i] = frame->linesize[i];
+	}
+	
+	// We can't free the frame until the data has been used, 
+	// so save the frame in decoder_specific_data. 
+	// This will cause FfmpegDecoder::Cleanup to be called 
+	// when the MediaFrame is deleted.
+	// TODO: check if we can free this now, given that we always copy data out from ffmpeg's buffers
+	mf->decoder_specific_data = frame;
+
+	return true;
+}
+
 void
 FfmpegDecoder::DecodeFrameAsyncInternal (MediaFrame *mf)
 {
@@ -273,6 +421,8 @@ FfmpegDecoder::DecodeFrameAsyncInternal (MediaFrame *mf)
 		av_init_packet (&packet);
 		packet.data = mf->GetBuffer ();
 		packet.size = mf->GetBufLen ();
+		/* ffmpeg hands this back in the AVFrame the picture ends up in */
+		context->reordered_opaque = mf->pts;
 		length = avcodec_decode_video2 (context, frame, &got_picture, &packet);
 		
 		if (length < 0 || !got_picture) {
@@ -280,9 +430,11 @@ FfmpegDecoder::DecodeFrameAsyncInternal (MediaFrame *mf)
 			// This is normally because the codec is a delayed codec,
 			// the first decoding request doesn't give any result,
 			// then every subsequent request returns the previous frame.
-			// TODO: Find a way to get the last frame out of ffmpeg
-			// (requires passing NULL as buffer and 0 as buflen)
-			if (has_delayed_frame) {
+			// With frame threading the first thread_count requests may not
+			// give any result, InputEnded gets the delayed frames out.
+			// TODO: Find a way to get the last frame out of ffmpeg when
+			// not frame threading (requires passing NULL as buffer and 0 as buflen)
+			if (has_delayed_frame && (length < 0 || !frame_threads)) {
 				char *str = g_strdup_printf ("FfmpegDecoder: error while decoding frame (got length: %d)", length);
 				ReportErrorOccurred (str);
 				g_free (str);
@@ -294,62 +446,17 @@ FfmpegDecoder::DecodeFrameAsyncInternal (MediaFrame *mf)
 			}
 		}
 		
-		if (prev_pts != G_MAXUINT64 && has_delayed_frame)
+		if (frame_threads) {
+			mf->pts = frame->reordered_opaque;
+		} else if (prev_pts != G_MAXUINT64 && has_delayed_frame) {
 			mf->pts = prev_pts;
+		}
 
 		LOG_FFMPEG ("FfmpegDecoder::DecodeFrame (%p): got picture, actual pts: %" G_GUINT64_FORMAT ", has delayed frame: %i, prev_pts: %" G_GUINT64_FORMAT " ms\n", 
 			mf, MilliSeconds_FromPts (mf->pts), has_delayed_frame, MilliSeconds_FromPts (prev_pts));
 
-		mf->AddState (MediaFramePlanar);
-		mf->FreeBuffer ();
-		mf->SetBufLen (0);
-		
-		mf->srcSlideY = 0;
-		mf->srcSlideH = context->height;
-		
-		mf->width = context->width;
-		mf->height = context->height;
-
-		int height = context->height;
-		int plane_bytes [4];
-		
-		switch (GetPixelFormat ()) {
-		case MoonPixelFormatYUV420P:
-			plane_bytes [0] = height * frame->linesize [0];
-			plane_bytes [1] = height * frame->linesize [1] / 2;
-			plane_bytes [2] = height * frame->linesize [2] / 2;
-			plane_bytes [3] = 0;
-			break;
-		default:
-			LOG_FFMPEG ("FfmpegDecoder::DecodeFrame (): Unknown output format, can't calculate byte number.\n");
-			plane_bytes [0] = 0;
-			plane_bytes [1] = 0;
-			plane_bytes [2] = 0;
-			plane_bytes [3] = 0;
-			break;
-		}
-		
-		for (int i = 0; i < 4; i++) {
-			if (plane_bytes [i] != 0) {
-				if (posix_memalign ((void **)&mf->data_stride [i], 16, plane_bytes[i] + stream->GetMinPadding ())) {
-					av_free (frame);
-					ReportErrorOccurred ("FfmpegDecoder: out of memory");
-					return;
-				}
-				memcpy (mf->data_stride[i], frame->data[i], plane_bytes[i]);
-			} else {
-				mf->data_stride[i] = frame->data[i];
-			}
-			
-			mf->srcStride[i] = frame->linesize[i];
-		}
-		
-		// We can't free the frame until the data has been used, 
-		// so save the frame in decoder_specific_data. 
-		// This will cause FfmpegDecoder::Cleanup to be called 
-		// when the MediaFrame is deleted.
-		// TODO: check if we can free this now, given that we always copy data out from ffmpeg's buffers
-		mf->decoder_specific_data = frame;
+		if (!SetPicture (mf, frame))
+			return;
 	} else if (stream->IsAudio ()) {
 		MpegFrameHeader mpeg;
 		int remain = mf->GetBufLen ();
@@ -125,11 +125,22 @@ private:
 	guint32 frame_buffer_length;
 	guint64 last_pts;
 	bool has_delayed_frame;
+	int thread_count; // the number of threads ffmpeg decodes with
+	bool frame_threads; // if ffmpeg decodes several frames in parallel (and may delay output by up to thread_count frames)
+	bool draining;
+
+	// Copies the decoded picture into the frame. Reports an error and returns false on failure.
+	bool SetPicture (MediaFrame *mf, AVFrame *frame);
+
+	// The number of threads video decoders use: MOONLIGHT_FFMPEG_THREADS if set,
+	// otherwise the number of processors (max 8).
+	static int GetVideoThreadCount ();
 
 protected:
 	virtual ~FfmpegDecoder () {}
 	virtual void DecodeFrameAsyncInternal (MediaFrame* frame);
 	virtual void OpenDecoderAsyncInternal ();
+	virtual bool CanDecodeConcurrently () { return true; }
 	
 public:
 	/* @SkipFactories */
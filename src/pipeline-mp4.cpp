@@ -26,6 +26,7 @@
 #endif
 
 #include "clock.h"
+#include "timesource.h"
 #include "pipeline-mp4.h"
 
 namespace Moonlight {
@@ -71,6 +72,19 @@ namespace Moonlight {
 #define AVCC_4CC GETBETYPE('a', 'v', 'c', 'C')
 #define QT_4CC GETBETYPE('q', 't', ' ', ' ')
 #define ISOM_4CC GETBETYPE('i', 's', 'o', 'm')
+#define ISO2_4CC GETBETYPE('i', 's', 'o', '2')
+#define ISO5_4CC GETBETYPE('i', 's', 'o', '5')
+#define ISO6_4CC GETBETYPE('i', 's', 'o', '6')
+#define DASH_4CC GETBETYPE('d', 'a', 's', 'h')
+#define MVEX_4CC GETBETYPE('m', 'v', 'e', 'x')
+#define MEHD_4CC GETBETYPE('m', 'e', 'h', 'd')
+#define TREX_4CC GETBETYPE('t', 'r', 'e', 'x')
+#define MOOF_4CC GETBETYPE('m', 'o', 'o', 'f')
+#define MFHD_4CC GETBETYPE('m', 'f', 'h', 'd')
+#define TRAF_4CC GETBETYPE('t', 'r', 'a', 'f')
+#define TFHD_4CC GETBETYPE('t', 'f', 'h', 'd')
+#define TFDT_4CC GETBETYPE('t', 'f', 'd', 't')
+#define TRUN_4CC GETBETYPE('t', 'r', 'u', 'n')
 
 #define FORMAT_4CC "'%c%c%c%c'"
 #define VALUES_4CC(x) (char) ((x) >> 24), (char) (((x) >> 16) & 0xFF), (char) (((x) >> 8) & 0xFF), (char) ((x) & 0xFF)
@@ -131,6 +145,7 @@ MoovBox::MoovBox (guint32 type, guint64 size)
 	: Box (type, size)
 {
 	mvhd = NULL;
+	mvex = NULL;
 	trak = NULL;
 	trak_count = 0;
 }
@@ -138,6 +153,7 @@ MoovBox::MoovBox (guint32 type, guint64 size)
 MoovBox::~MoovBox ()
 {
 	delete mvhd;
+	delete mvex;
 	for (guint32 i = 0; i < trak_count; i++)
 		delete trak [i];
 	g_free (trak);
@@ -162,21 +178,72 @@ TrakBox::TrakBox (guint32 type, guint64 size)
 	tkhd = NULL;
 	mdia = NULL;
 	stream = NULL;
-	stsc_index = 0;
-	stsc_sample_index = 0;
-	stsc_sample_count = 0;
-	stsc_samples_size = 0;
+	index = NULL;
 	current_sample = 0;
+	trex = NULL;
+	fragment_samples = NULL;
+	fragment_sample_head = 0;
+	fragment_sample_count = 0;
+	fragment_sample_capacity = 0;
+	fragment_time = 0;
+	fragment_seek_time = 0;
+	fragment_seeking = false;
+	fragment_key_time = G_MAXUINT64;
 }
 
 TrakBox::~TrakBox ()
 {
 	delete tkhd;
 	delete mdia;
+	delete index;
+	g_free (fragment_samples);
 	if (stream)
 		stream->unref ();
 }
 
+void
+TrakBox::ResetFragments ()
+{
+	ClearFragmentSamples ();
+
+	/* The first fragment continues where the samples in the moov box end */
+	fragment_time = index != NULL ? index->GetDecodingTime (index->sample_count, NULL) : 0;
+}
+
+void
+TrakBox::ClearFragmentSamples ()
+{
+	fragment_sample_head = 0;
+	fragment_sample_count = 0;
+}
+
+void
+TrakBox::QueueFragmentSample (const Mp4FragmentSample *sample)
+{
+	if (fragment_seeking) {
+		if (sample->decoding_time > fragment_seek_time) {
+			fragment_seeking = false;
+		} else if (sample->key_frame) {
+			/* Everything before this key frame can be dropped */
+			ClearFragmentSamples ();
+		}
+	}
+
+	if (fragment_sample_count == fragment_sample_capacity) {
+		if (fragment_sample_head > 0) {
+			/* Move the queued samples to the start instead of growing the queue */
+			fragment_sample_count -= fragment_sample_head;
+			memmove (fragment_samples, fragment_samples + fragment_sample_head, fragment_sample_count * sizeof (Mp4FragmentSample));
+			fragment_sample_head = 0;
+		} else {
+			fragment_sample_capacity = MAX (fragment_sample_capacity * 2, 64);
+			fragment_samples = (Mp4FragmentSample *) g_realloc (fragment_samples, fragment_sample_capacity * sizeof (Mp4FragmentSample));
+		}
+	}
+
+	fragment_samples [fragment_sample_count++] = *sample;
+}
+
 /*
  * TkhdBox
  */
@@ -496,6 +563,211 @@ Co64Box::~Co64Box ()
 	g_free (chunk_offset);
 }
 
+/*
+ * MvexBox
+ */
+MvexBox::MvexBox (guint32 type, guint64 size)
+	: Box (type, size)
+{
+	mehd = NULL;
+	trex = NULL;
+	trex_count = 0;
+}
+
+MvexBox::~MvexBox ()
+{
+	delete mehd;
+	for (guint32 i = 0; i < trex_count; i++)
+		delete trex [i];
+	g_free (trex);
+}
+
+/*
+ * MehdBox
+ */
+MehdBox::MehdBox (guint32 type, guint64 size)
+	: FullBox (type, size)
+{
+	fragment_duration = 0;
+}
+
+/*
+ * TrexBox
+ */
+TrexBox::TrexBox (guint32 type, guint64 size)
+	: FullBox (type, size)
+{
+	track_ID = 0;
+	default_sample_description_index = 0;
+	default_sample_duration = 0;
+	default_sample_size = 0;
+	default_sample_flags = 0;
+}
+
+/*
+ * MoofBox
+ */
+MoofBox::MoofBox (guint32 type, guint64 size)
+	: Box (type, size)
+{
+	position = 0;
+	traf = NULL;
+	traf_count = 0;
+}
+
+MoofBox::~MoofBox ()
+{
+	for (guint32 i = 0; i < traf_count; i++)
+		delete traf [i];
+	g_free (traf);
+}
+
+/*
+ * TrafBox
+ */
+TrafBox::TrafBox (guint32 type, guint64 size)
+	: Box (type, size)
+{
+	tfhd = NULL;
+	tfdt = NULL;
+	trun = NULL;
+	trun_count = 0;
+}
+
+TrafBox::~TrafBox ()
+{
+	delete tfhd;
+	delete tfdt;
+	for (guint32 i = 0; i < trun_count; i++)
+		delete trun [i];
+	g_free (trun);
+}
+
+guint64
+TrafBox::QueueSamples (TrakBox *trak, guint64 moof_position, guint64 data_end, bool queue)
+{
+	TrexBox *trex = trak->trex;
+	guint64 base;
+	guint64 offset;
+	guint64 time;
+	guint32 default_duration;
+	guint32 default_size;
+	guint32 default_flags;
+
+	/* Find the offset the data offsets in the trun boxes are relative to */
+	if (tfhd->flags & TFHD_BASE_DATA_OFFSET_PRESENT) {
+		base = tfhd->base_data_offset;
+	} else if (tfhd->flags & TFHD_DEFAULT_BASE_IS_MOOF) {
+		base = moof_position;
+	} else {
+		/* The data of this track fragment follows the data of the previous one */
+		base = data_end;
+	}
+
+	default_duration = (tfhd->flags & TFHD_DEFAULT_SAMPLE_DURATION_PRESENT) ? tfhd->default_sample_duration : (trex != NULL ? trex->default_sample_duration : 0);
+	default_size = (tfhd->flags & TFHD_DEFAULT_SAMPLE_SIZE_PRESENT) ? tfhd->default_sample_size : (trex != NULL ? trex->default_sample_size : 0);
+	default_flags = (tfhd->flags & TFHD_DEFAULT_SAMPLE_FLAGS_PRESENT) ? tfhd->default_sample_flags : (trex != NULL ? trex->default_sample_flags : 0);
+
+	time = tfdt != NULL ? tfdt->base_media_decode_time : trak->fragment_time;
+	offset = base;
+
+	for (guint32 r = 0; r < trun_count; r++) {
+		TrunBox *run = trun [r];
+
+		/* Without a data offset the run follows the previous run */
+		if (run->flags & TRUN_DATA_OFFSET_PRESENT)
+			offset = base + run->data_offset;
+
+		for (guint32 k = 0; k < run->sample_count; k++) {
+			Mp4FragmentSample sample;
+			guint32 flags;
+
+			if (run->sample_flags != NULL) {
+				flags = run->sample_flags [k];
+			} else if (k == 0 && (run->flags & TRUN_FIRST_SAMPLE_FLAGS_PRESENT)) {
+				flags = run->first_sample_flags;
+			} else {
+				flags = default_flags;
+			}
+
+			sample.offset = offset;
+			sample.decoding_time = time;
+			sample.size = run->sample_size != NULL ? run->sample_size [k] : default_size;
+			sample.duration = run->sample_duration != NULL ? run->sample_duration [k] : default_duration;
+			sample.composition_offset = run->sample_composition_time_offset != NULL ? run->sample_composition_time_offset [k] : 0;
+			sample.key_frame = (flags & SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE) == 0;
+
+			if (sample.key_frame && trak->fragment_key_time == G_MAXUINT64)
+				trak->fragment_key_time = time;
+
+			offset += sample.size;
+			time += sample.duration;
+
+			if (queue)
+				trak->QueueFragmentSample (&sample);
+		}
+	}
+
+	trak->fragment_time = time;
+
+	return offset;
+}
+
+/*
+ * TfhdBox
+ */
+TfhdBox::TfhdBox (guint32 type, guint64 size)
+	: FullBox (type, size)
+{
+	track_ID = 0;
+	base_data_offset = 0;
+	sample_description_index = 0;
+	default_sample_duration = 0;
+	default_sample_size = 0;
+	default_sample_flags = 0;
+}
+
+/*
+ * TfdtBox
+ */
+TfdtBox::TfdtBox (guint32 type, guint64 size)
+	: FullBox (type, size)
+{
+	base_media_decode_time = 0;
+}
+
+/*
+ * TrunBox
+ */
+TrunBox::TrunBox (guint32 type, guint64 size)
+	: FullBox (type, size)
+{
+	sample_count = 0;
+	data_offset = 0;
+	first_sample_flags = 0;
+	sample_duration = NULL;
+	sample_size = NULL;
+	sample_flags = NULL;
+	sample_composition_time_offset = NULL;
+}
+
+TrunBox::~TrunBox ()
+{
+	g_free (sample_duration);
+	g_free (sample_size);
+	g_free (sample_flags);
+	g_free (sample_composition_time_offset);
+}
+
+gint32
+TrunBox::ToCompositionOffset (guint8 version, guint32 value)
+{
+	if (version == 0)
+		return (gint32) MIN (value, (guint32) G_MAXINT32);
+
+	return (gint32) value;
+}
+
 /*
  * EsdsBox
  */
@@ -575,6 +847,356 @@ AudioSampleEntry::AudioSampleEntry (guint32 type, guint64 size)
 	samplerate.lo = 0;
 }
 
+/*
+ * Mp4SampleIndex
+ */
+
+/* Returns the index of the last element in the sorted array which is <= value, or 0 if there are none */
+template <typename T>
+static guint32
+find_last_at_or_before (const T *array, guint32 count, T value)
+{
+	guint32 low = 0;
+	guint32 high = count;
+
+	/* Invariant: array [low - 1] <= value < array [high] */
+	while (low < high) {
+		guint32 mid = low + (high - low) / 2;
+		if (array [mid] <= value) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low > 0 ? low - 1 : 0;
+}
+
+static int
+compare_guint32 (const void *a, const void *b)
+{
+	guint32 va = *(const guint32 *) a;
+	guint32 vb = *(const guint32 *) b;
+	return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+Mp4SampleIndex::Mp4SampleIndex ()
+{
+	sample_count = 0;
+	offset = NULL;
+	size = NULL;
+	fixed_size = 0;
+	time_run_count = 0;
+	time_run_sample = NULL;
+	time_run_time = NULL;
+	time_run_delta = NULL;
+	ctts_run_count = 0;
+	ctts_run_sample = NULL;
+	ctts_run_offset = NULL;
+	keyframe_count = 0;
+	keyframes = NULL;
+	keyframe_bitmap = NULL;
+}
+
+Mp4SampleIndex::~Mp4SampleIndex ()
+{
+	g_free (offset);
+	g_free (size);
+	g_free (time_run_sample);
+	g_free (time_run_time);
+	g_free (time_run_delta);
+	g_free (ctts_run_sample);
+	g_free (ctts_run_offset);
+	g_free (keyframes);
+	g_free (keyframe_bitmap);
+}
+
+const char *
+Mp4SampleIndex::Build (StblBox *stbl)
+{
+	SttsBox *stts = stbl->stts;
+	CttsBox *ctts = stbl->ctts;
+	StscBox *stsc = stbl->stsc;
+	StszBox *stsz = stbl->stsz;
+	Stz2Box *stz2 = stbl->stz2;
+	StssBox *stss = stbl->stss;
+	guint32 chunk_count;
+	guint64 covered = 0;
+	guint64 time = 0;
+	guint32 sample;
+
+	if (stsz != NULL) {
+		sample_count = stsz->sample_count;
+	} else if (stz2 != NULL) {
+		sample_count = stz2->sample_count;
+	} else {
+		return "either a stsz box or a stz2 box is required";
+	}
+
+	if (stbl->stco != NULL) {
+		chunk_count = stbl->stco->entry_count;
+	} else if (stbl->co64 != NULL) {
+		chunk_count = stbl->co64->entry_count;
+	} else {
+		return "either a stco box or a co64 box is required";
+	}
+
+	/* Find out how many samples the chunks actually contain, we can't read more than that */
+	for (guint32 i = 0; i < stsc->entry_count; i++) {
+		guint32 last = i + 1 < stsc->entry_count ? stsc->first_chunk [i + 1] : chunk_count + 1;
+
+		if (stsc->first_chunk [i] < 1)
+			return "invalid first chunk in stsc table";
+		if (stsc->first_chunk [i] > chunk_count + 1)
+			return "too many chunks in stsc table";
+		/* When parsing the stsc box we verify that first_chunk has sequential values, so this can't end up negative */
+		covered += (guint64) (MIN (last, chunk_count + 1) - stsc->first_chunk [i]) * stsc->samples_per_chunk [i];
+	}
+	if (covered < sample_count) {
+		LOG_MP4 ("Mp4SampleIndex::Build (): the chunks only contain %" G_GUINT64_FORMAT " of %u samples\n", covered, sample_count);
+		sample_count = (guint32) covered;
+	}
+
+	/* Sample sizes */
+	if (stsz != NULL && stsz->sample_size != 0) {
+		fixed_size = stsz->sample_size;
+	} else if (stsz != NULL) {
+		/* Take over the sizes instead of duplicating them */
+		size = stsz->entry_size;
+		stsz->entry_size = NULL;
+	} else {
+		size = (guint32 *) g_try_malloc (sizeof (guint32) * MAX (sample_count, 1));
+		if (size == NULL)
+			return "too many samples";
+		for (guint32 i = 0; i < sample_count; i++) {
+			switch (stz2->field_size) {
+			case 4:
+				size [i] = (i % 2 == 0) ? (stz2->samples [i / 2] >> 4) : (stz2->samples [i / 2] & 0x0F);
+				break;
+			case 8:
+				size [i] = stz2->samples [i];
+				break;
+			case 16:
+				size [i] = ((guint16 *) stz2->samples) [i];
+				break;
+			default:
+				return "invalid field size in stz2";
+			}
+		}
+	}
+
+	/* Sample offsets */
+	offset = (guint64 *) g_try_malloc (sizeof (guint64) * MAX (sample_count, 1));
+	if (offset == NULL)
+		return "too many samples";
+
+	sample = 0;
+	for (guint32 i = 0; i < stsc->entry_count && sample < sample_count; i++) {
+		guint32 last = i + 1 < stsc->entry_count ? stsc->first_chunk [i + 1] : chunk_count + 1;
+
+		/* chunks are 1-based in the stsc table */
+		for (guint32 chunk = stsc->first_chunk [i]; chunk < last && chunk <= chunk_count && sample < sample_count; chunk++) {
+			guint64 chunk_offset = stbl->stco != NULL ? stbl->stco->chunk_offset [chunk - 1] : stbl->co64->chunk_offset [chunk - 1];
+			for (guint32 k = 0; k < stsc->samples_per_chunk [i] && sample < sample_count; k++) {
+				offset [sample] = chunk_offset;
+				chunk_offset += GetSize (sample);
+				sample++;
+			}
+		}
+	}
+
+	/* Decoding times */
+	time_run_count = stts->entry_count;
+	time_run_sample = (guint32 *) g_malloc (sizeof (guint32) * MAX (time_run_count, 1));
+	time_run_time = (guint64 *) g_malloc (sizeof (guint64) * MAX (time_run_count, 1));
+	time_run_delta = (guint32 *) g_malloc (sizeof (guint32) * MAX (time_run_count, 1));
+	sample = 0;
+	for (guint32 i = 0; i < time_run_count; i++) {
+		time_run_sample [i] = sample;
+		time_run_time [i] = time;
+		time_run_delta [i] = stts->sample_delta [i];
+		sample += stts->sample_count [i];
+		time += (guint64) stts->sample_count [i] * stts->sample_delta [i];
+	}
+
+	/* Composition offsets. There's one extra run start to mark the end of the table */
+	if (ctts != NULL) {
+		ctts_run_count = ctts->entry_count;
+		ctts_run_sample = (guint32 *) g_malloc (sizeof (guint32) * (ctts_run_count + 1));
+		ctts_run_offset = (gint32 *) g_malloc (sizeof (gint32) * MAX (ctts_run_count, 1));
+		sample = 0;
+		for (guint32 i = 0; i < ctts_run_count; i++) {
+			ctts_run_sample [i] = sample;
+			ctts_run_offset [i] = ctts->sample_offset [i];
+			sample += ctts->sample_count [i];
+		}
+		ctts_run_sample [ctts_run_count] = sample;
+	}
+
+	/* Key frames. A missing (or empty) stss box means that every sample is a key frame */
+	if (stss != NULL && stss->entry_count > 0) {
+		bool sorted = true;
+
+		keyframes = (guint32 *) g_malloc (sizeof (guint32) * stss->entry_count);
+		keyframe_bitmap = (guint8 *) g_malloc0 (sample_count / 8 + 1);
+		for (guint32 i = 0; i < stss->entry_count; i++) {
+			/* sample_number is 1-based */
+			guint32 s = stss->sample_number [i] - 1;
+			if (stss->sample_number [i] == 0 || s >= sample_count)
+				continue;
+			if (keyframe_count > 0 && keyframes [keyframe_count - 1] >= s)
+				sorted = false;
+			keyframes [keyframe_count++] = s;
+			keyframe_bitmap [s / 8] |= 1 << (s % 8);
+		}
+		if (!sorted)
+			qsort (keyframes, keyframe_count, sizeof (guint32), compare_guint32);
+		if (keyframe_count == 0)
+			return "no valid key frames in stss table";
+	}
+
+	LOG_MP4 ("Mp4SampleIndex::Build (): %u samples, %u time runs, %u ctts runs, %u key frames\n", sample_count, time_run_count, ctts_run_count, keyframe_count);
+
+	return NULL;
+}
+
+guint64
+Mp4SampleIndex::GetDecodingTime (guint32 sample, guint32 *delta)
+{
+	guint32 run;
+
+	if (time_run_count == 0) {
+		if (delta)
+			*delta = 0;
+		return 0;
+	}
+
+	/* Samples after the end of the stts table continue with the last delta */
+	run = find_last_at_or_before<guint32> (time_run_sample, time_run_count, sample);
+	if (delta)
+		*delta = time_run_delta [run];
+
+	return time_run_time [run] + (guint64) (sample - time_run_sample [run]) * time_run_delta [run];
+}
+
+gint32
+Mp4SampleIndex::GetCompositionOffset (guint32 sample)
+{
+	guint32 run;
+
+	if (ctts_run_count == 0)
+		return 0;
+
+	run = find_last_at_or_before<guint32> (ctts_run_sample, ctts_run_count + 1, sample);
+
+	/* Samples after the end of the ctts table don't have any composition offset */
+	return run < ctts_run_count ? ctts_run_offset [run] : 0;
+}
+
+guint32
+Mp4SampleIndex::GetSampleAt (guint64 time)
+{
+	guint32 run;
+	guint64 sample;
+
+	if (sample_count == 0 || time_run_count == 0)
+		return 0;
+
+	run = find_last_at_or_before<guint64> (time_run_time, time_run_count, time);
+	sample = time_run_sample [run];
+	if (time_run_delta [run] != 0)
+		sample += (time - time_run_time [run]) / time_run_delta [run];
+
+	return (guint32) MIN (sample, (guint64) sample_count - 1);
+}
+
+guint32
+Mp4SampleIndex::GetKeyFrameBefore (guint32 sample)
+{
+	if (keyframes == NULL)
+		return sample;
+
+	if (sample < keyframes [0])
+		return keyframes [0];
+
+	return keyframes [find_last_at_or_before<guint32> (keyframes, keyframe_count, sample)];
+}
+
+bool
+Mp4SampleIndex::IsKeyFrame (guint32 sample)
+{
+	if (keyframe_bitmap == NULL)
+		return true;
+
+	return sample < sample_count && (keyframe_bitmap [sample / 8] & (1 << (sample % 8))) != 0;
+}
+
+/*
+ * Mp4FragmentTable
+ */
+
+Mp4FragmentTable::Mp4FragmentTable (guint32 trak_count)
+{
+	this->trak_count = trak_count;
+	count = 0;
+	capacity = 0;
+	position = NULL;
+	start_time = NULL;
+	key_time = NULL;
+}
+
+Mp4FragmentTable::~Mp4FragmentTable ()
+{
+	g_free (position);
+	g_free (start_time);
+	g_free (key_time);
+}
+
+void
+Mp4FragmentTable::Add (guint64 position, const guint64 *start_time, const guint64 *key_time)
+{
+	if (count > 0 && position <= this->position [count - 1])
+		return;
+
+	if (count == capacity) {
+		capacity = MAX (capacity * 2, 64);
+		this->position = (guint64 *) g_realloc (this->position, capacity * sizeof (guint64));
+		this->start_time = (guint64 *) g_realloc (this->start_time, capacity * trak_count * sizeof (guint64));
+		this->key_time = (guint64 *) g_realloc (this->key_time, capacity * trak_count * sizeof (guint64));
+	}
+
+	this->position [count] = position;
+	memcpy (this->start_time + count * trak_count, start_time, trak_count * sizeof (guint64));
+	memcpy (this->key_time + count * trak_count, key_time, trak_count * sizeof (guint64));
+	count++;
+}
+
+gint32
+Mp4FragmentTable::FindKeyFragment (guint32 trak, guint64 time)
+{
+	guint32 low = 0;
+	guint32 high = count;
+
+	/* The last fragment starting at or before the time (the start times of a track only go up) */
+	while (low < high) {
+		guint32 mid = low + (high - low) / 2;
+		if (start_time [mid * trak_count + trak] <= time) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	/* and back to the last one with a key frame at or before it */
+	while (low > 0) {
+		low--;
+		if (key_time [low * trak_count + trak] <= time)
+			return low;
+	}
+
+	return -1;
+}
+
 /*
  * Mp4Demuxer
  */
@@ -614,11 +1236,19 @@ Mp4Demuxer::Mp4Demuxer (Media *media, IMediaSource *source, MemoryBuffer *initia
 	moov = NULL;
 	buffer_position = 0;
 	nal_size_length = 0;
+	fragmented = false;
+	fragments_done = false;
+	first_fragment_position = 0;
+	next_fragment_position = 0;
+	fragment_table = NULL;
+	open_time = get_now ();
+	first_frame_demuxed = false;
 }
 
 Mp4Demuxer::~Mp4Demuxer ()
 {
 	delete moov;
+	delete fragment_table;
 }
 
 void
@@ -654,6 +1284,10 @@ Mp4Demuxer::IsCompatibleType (guint32 type)
 	case MP42_4CC:
 	case QT_4CC:
 	case ISOM_4CC:
+	case ISO2_4CC:
+	case ISO5_4CC:
+	case ISO6_4CC:
+	case DASH_4CC:
 		return true;
 	default:
 		return false;
@@ -669,18 +1303,10 @@ Mp4Demuxer::UpdateSelected (IMediaStream *stream)
 void
 Mp4Demuxer::SeekAsyncInternal (guint64 pts)
 {
-	guint64 time, acc_time;
-	guint32 sample, samples_left;
-	guint32 chunk_count;
+	guint32 sample;
+	guint64 time;
+	gint32 fragment = G_MAXINT32; /* the fragment to start reading at, -1 for the first one */
 	TrakBox *trak;
-	StblBox *stbl;
-	StscBox *stsc;
-	StszBox *stsz;
-	Stz2Box *stz2;
-	StcoBox *stco;
-	Co64Box *co64;
-	SttsBox *stts;
-	StssBox *stss;
 
 	LOG_MP4 ("Mp4Demuxer::SeekAsyncInternal (%" G_GUINT64_FORMAT " ms)\n", MilliSeconds_FromPts (pts));
 
@@ -694,98 +1320,49 @@ Mp4Demuxer::SeekAsyncInternal (guint64 pts)
 		if (trak->stream == NULL)
 			continue; /* Moonlight doesn't understand this stream, no need to seek in it either */
 
-		stbl = trak->mdia->minf->stbl;
-		stsc = trak->mdia->minf->stbl->stsc;
-		stsz = trak->mdia->minf->stbl->stsz;
-		stz2 = trak->mdia->minf->stbl->stz2;
-		stco = trak->mdia->minf->stbl->stco;
-		co64 = trak->mdia->minf->stbl->co64;
-		stts = trak->mdia->minf->stbl->stts;
-		stss = trak->mdia->minf->stbl->stss;
-
-		trak->stsc_index = 0;
-		trak->stsc_sample_index = 0;
-		trak->stsc_sample_count = 0;
-		trak->stsc_samples_size = 0;
-		trak->current_sample = 0;
-
-		/* Find the sample corresponding to the requested pts */
+		/* Find the sample corresponding to the requested pts, and then the first key frame before it */
 		time = FromPts (pts, trak);
-		acc_time = 0;
-		sample = 0;
-		for (guint32 i = 0; i < stts->entry_count; i++) {
-			if (stts->sample_count [i] * stts->sample_delta [i] + acc_time > time) {
-				sample += (time - acc_time) / stts->sample_delta [i];
+		sample = trak->index->GetSampleAt (time);
+		trak->current_sample = trak->index->GetKeyFrameBefore (sample);
+
+		if (fragmented) {
+			if (time >= trak->index->GetDecodingTime (trak->index->sample_count, NULL)) {
+				/* The requested time is in the fragments, none of the samples in the moov box are needed */
+				trak->current_sample = trak->index->sample_count;
+				if (trak->stream->GetSelected ())
+					fragment = MIN (fragment, fragment_table->FindKeyFragment (i, time));
 			} else {
-				acc_time += stts->sample_count [i] * stts->sample_delta [i];
-				sample += stts->sample_count [i];
+				fragment = -1;
 			}
-		}
 
-		/* Find the first key frame before the exact sample */
-		if (stss != NULL) {
-			if (sample >= stss->sample_number [stss->entry_count - 1]) {
-				/* After the last key frame, seek to the last key frame */
-				trak->current_sample = stss->sample_number [stss->entry_count - 1] - 1;
-			} else {
-				trak->current_sample = sample;
-				for (guint32 i = 0; i < stss->entry_count; i++) {
-					if (sample >= stss->sample_number [i] && sample < stss->sample_number [i + 1]) {
-						trak->current_sample = stss->sample_number [i] - 1;
-						break;
-					}
-				}
-			}
-		} else {
-			/* All samples are key-frames */
-			trak->current_sample = sample;
+			/* Drop the samples before the last key frame at or before the requested time */
+			trak->fragment_seek_time = time;
+			trak->fragment_seeking = true;
 		}
-		LOG_MP4 ("Mp4Demuxer::SeekAsyncInternal (%" G_GUINT64_FORMAT " ms): %s: exact sample: #%u key frame sample: #%u\n", MilliSeconds_FromPts (pts), trak->stream->GetTypeName (), sample, trak->current_sample);
 
-		if (!GetChunkCount (stbl, &chunk_count))
-			return;
+		LOG_MP4 ("Mp4Demuxer::SeekAsyncInternal (%" G_GUINT64_FORMAT " ms): %s: exact sample: #%u key frame sample: #%u\n", MilliSeconds_FromPts (pts), trak->stream->GetTypeName (), sample, trak->current_sample);
+	}
 
-		/* Now we need to update all the cached info in the TrakBox */
-		samples_left = trak->current_sample;
-		for (guint32 i = 0; i < stsc->entry_count; i++) {
-			if (i + 1 == stsc->entry_count) {
-				if (stsc->first_chunk [i] > chunk_count) {
-					char *msg = g_strdup_printf ("Mp4Demuxer: last entry in 'stsc' table has invalid first_chunk value = %u (>chunk_count = %u)", stsc->first_chunk [i], chunk_count);
-					ReportErrorOccurred (msg);
-					g_free (msg);
-					return;
-				}
-				trak->stsc_index = i;
-				trak->stsc_sample_count = (chunk_count - stsc->first_chunk [i] + 1) * stsc->samples_per_chunk [i];
-				if (samples_left >= trak->stsc_sample_count) {
-					trak->stsc_sample_index = trak->stsc_sample_count - 1;
-				} else {
-					trak->stsc_sample_index = samples_left;
-				}
-				break;
-			}
+	if (fragmented) {
+		if (fragment == G_MAXINT32)
+			fragment = -1;
 
-			/* When parsing the stsc box we verify that first_chunk has sequential values, so 'n' can never end up negative here */
-			guint32 n = (stsc->first_chunk [i + 1] - stsc->first_chunk [i]) * stsc->samples_per_chunk [i];
-			if (n > samples_left) {
-				trak->stsc_index = i;
-				trak->stsc_sample_index = samples_left;
-				trak->stsc_sample_count = n;
-				break;
+		/* Start over at the last fragment we've read which every selected stream can start from */
+		for (guint32 i = 0; i < moov->trak_count; i++) {
+			trak = moov->trak [i];
+			if (fragment >= 0) {
+				trak->ClearFragmentSamples ();
+				trak->fragment_time = fragment_table->GetStartTime (fragment, i);
 			} else {
-				samples_left -= n;
+				trak->ResetFragments ();
 			}
 		}
-		trak->stsc_samples_size = 0;
-		for (guint32 i = trak->current_sample - (trak->stsc_sample_index % stsc->samples_per_chunk [trak->stsc_index]); i < trak->current_sample; i++) {
-			guint32 s;
-			if (!GetSampleSize (stbl, i, &s))
-				return;
-			trak->stsc_samples_size += s;
-		}
 
-		LOG_MP4 ("Mp4Demuxer::SeekAsyncInternal (%" G_GUINT64_FORMAT " ms): %s: current_sample: %u stsc_index: %u stsc_sample_index: %u stsc_sample_count: %u stsc_sample_size: %u\n",
-			MilliSeconds_FromPts (pts), trak->stream->GetTypeName (), trak->current_sample, trak->stsc_index, trak->stsc_sample_index, trak->stsc_sample_count, trak->stsc_samples_size);
+		next_fragment_position = fragment >= 0 ? fragment_table->position [fragment] : first_fragment_position;
+		fragments_done = false;
+
+		LOG_MP4 ("Mp4Demuxer::SeekAsyncInternal (%" G_GUINT64_FORMAT " ms): reading fragments from #%i at %" G_GUINT64_FORMAT " (%u fragments read so far)\n",
+			MilliSeconds_FromPts (pts), fragment, next_fragment_position, fragment_table->count);
 	}
 
 	ReportSeekCompleted (pts);
@@ -794,22 +1371,13 @@ Mp4Demuxer::SeekAsyncInternal (guint64 pts)
 void
 Mp4Demuxer::GetFrameAsyncInternal (IMediaStream *stream)
 {
-	guint32 sample_count;
-	guint32 chunk;
-	guint32 chunk_sample;
-	guint32 chunk_count;
-	guint64 chunk_offset;
 	guint64 sample_offset;
 	guint32 sample_size;
 	TrakBox *trak = NULL;
-	StscBox *stsc;
-	StszBox *stsz;
-	Stz2Box *stz2;
-	StcoBox *stco;
-	Co64Box *co64;
-	SttsBox *stts;
-	StblBox *stbl;
+	Mp4SampleIndex *index;
+	Mp4FragmentSample *fragment_sample = NULL;
 	CttsBox *ctts;
+	bool key_frame;
 
 	LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (%s)\n", stream->GetTypeName ());
 
@@ -822,109 +1390,69 @@ Mp4Demuxer::GetFrameAsyncInternal (IMediaStream *stream)
 
 	g_return_if_fail (trak != NULL);
 
-	stbl = trak->mdia->minf->stbl;
-	stsc = trak->mdia->minf->stbl->stsc;
-	stsz = trak->mdia->minf->stbl->stsz;
-	stz2 = trak->mdia->minf->stbl->stz2;
-	stco = trak->mdia->minf->stbl->stco;
-	co64 = trak->mdia->minf->stbl->co64;
-	stts = trak->mdia->minf->stbl->stts;
+	index = trak->index;
 	ctts = trak->mdia->minf->stbl->ctts;
 
-	if (!GetSampleCount (stbl, &sample_count))
-		return;
-
-	if (!GetChunkCount (stbl, &chunk_count))
-		return;
+	if (fragmented && trak->current_sample >= index->sample_count) {
+		/* Read fragments until we have a sample for this stream (or there are no more fragments) */
+		while (NeedsFragment (trak)) {
+			if (ReadNextFragment (stream) != MEDIA_SUCCESS)
+				return; /* Either we've requested more data, or an error has been reported */
+		}
 
-	if (trak->current_sample >= sample_count) {
-		LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (): no more frames, sample_count: %u current sample: %u\n", sample_count, trak->current_sample);
-		/* No more frames for this stream */
-		ReportGetFrameCompleted (NULL);
-		return;
-	}
+		if (trak->fragment_sample_head == trak->fragment_sample_count) {
+			LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (): no more frames in the fragments\n");
+			/* No more frames for this stream */
+			ReportGetFrameCompleted (NULL);
+			return;
+		}
 
-	chunk = stsc->first_chunk [trak->stsc_index] + trak->stsc_sample_index / stsc->samples_per_chunk [trak->stsc_index];
-	chunk_sample = trak->stsc_sample_index % stsc->samples_per_chunk [trak->stsc_index];
+		fragment_sample = &trak->fragment_samples [trak->fragment_sample_head];
+		sample_offset = fragment_sample->offset;
+		sample_size = fragment_sample->size;
+	} else {
+		if (trak->current_sample >= index->sample_count) {
+			LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (): no more frames, sample_count: %u current sample: %u\n", index->sample_count, trak->current_sample);
+			/* No more frames for this stream */
+			ReportGetFrameCompleted (NULL);
+			return;
+		}
 
-	if (chunk < 1) {
-		ReportErrorOccurred ("Mp4Demuxer: corrupted mp4 file (invalid first chunk in first stsc entry)");
-		return;
+		sample_offset = index->GetOffset (trak->current_sample);
+		sample_size = index->GetSize (trak->current_sample);
 	}
 
-	/* chunk is 1-based in the stsc->first_chunk array, while we need it to be 0 based */
-	chunk--;
-
-	/* Get the offset of the chunk we want */
-	if (!GetChunkOffset (stbl, chunk, &chunk_offset))
-		return;
-
-	/* Calculate sample size */
-	if (!GetSampleSize (stbl, trak->current_sample, &sample_size))
-		return;
-
-	/* Calculate the sample offset */
-	sample_offset = chunk_offset + trak->stsc_samples_size;
-
 	/* Check if we have buffered enough data */
 	if (!(buffer_position <= sample_offset && buffer_position + buffer->GetSize () >= sample_offset + sample_size)) {
-		Media *media = GetMediaReffed ();
-		if (media != NULL) {
-			if (get_frame_stream != NULL)
-				get_frame_stream->unref ();
-			get_frame_stream = stream;
-			get_frame_stream->ref ();
-			
-			MediaReadClosure *closure = new MediaReadClosure (media, ReadSampleDataAsyncCallback, this, sample_offset, MAX (sample_size, 4096));
-			source->ReadAsync (closure);
-			closure->unref ();
-			media->unref ();
-		}
+		RequestSampleData (stream, sample_offset, MAX (sample_size, 4096));
 		LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (%s): not enough data buffered, requesting more.\n", stream->GetTypeName ());
 		return;
 	}
 
 	/* Calculate pts */
 	guint64 pts = 0;
-	guint64 time = 0;
-	guint32 samples_left = trak->current_sample;
 	guint32 sample_delta = 0;
 	guint64 duration; /* sample_delta in pts */
-
-	if (trak->current_sample == 0 && stts->entry_count > 0) {
-		sample_delta = stts->sample_delta [0];
-	}
-
-	/* Note that in most cases the stts table is composed of a single entry for all samples, so caching values would likely not be faster */
-	for (guint32 i = 0; i < stts->entry_count && samples_left > 0; i++) {
-		if (stts->sample_count [i] >= samples_left) {
-			sample_delta = stts->sample_delta [i];
-			time += sample_delta * samples_left;
-			break;
+	guint64 time;
+
+	if (fragment_sample != NULL) {
+		time = fragment_sample->decoding_time;
+		sample_delta = fragment_sample->duration;
+		key_frame = fragment_sample->key_frame;
+		/* Negative composition offsets are allowed in version 1 trun boxes, clamp the result at 0 */
+		if (fragment_sample->composition_offset < 0 && (guint64) -fragment_sample->composition_offset > time) {
+			time = 0;
 		} else {
-			sample_delta = stts->sample_delta [i];
-			time += sample_delta * stts->sample_count [i];
-			samples_left -= stts->sample_count [i];
+			time += fragment_sample->composition_offset;
 		}
+	} else {
+		time = index->GetDecodingTime (trak->current_sample, &sample_delta);
+		key_frame = index->IsKeyFrame (trak->current_sample);
 	}
 
 	/* Add composition time delta from ctts if applicable */
-	if (ctts != NULL) {
-		gint32 ctts_value = 0;
-		if (ctts->entry_count == sample_count) {
-			/* We can enter the array by sample index */
-			ctts_value = ctts->sample_offset [trak->current_sample];
-		} else {
-			samples_left = trak->current_sample;
-			for (guint32 i = 0; i < ctts->entry_count && samples_left > 0; i++) {
-				if (ctts->sample_count [i] >= samples_left) {
-					ctts_value = ctts->sample_offset [i];
-					break;
-				} else {
-					samples_left -= ctts->sample_count [i];
-				}
-			}
-		}
+	if (fragment_sample == NULL && ctts != NULL) {
+		gint32 ctts_value = index->GetCompositionOffset (trak->current_sample);
 		LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (%s): sample %u has decoding time %" G_GUINT64_FORMAT " and composition time %i and min_offset %i => time: %" G_GUINT64_FORMAT " = %" G_GUINT64_FORMAT " ms\n",
 			stream->GetTypeName (), trak->current_sample, time, ctts_value, ctts->min_offset, time + ctts_value - ctts->min_offset, ToPts (time + ctts_value - ctts->min_offset, trak) / 10000);
 
@@ -961,8 +1489,8 @@ Mp4Demuxer::GetFrameAsyncInternal (IMediaStream *stream)
 	/* We now have what we need (pts, sample offset and sample size), create the frame */
 	buffer->SeekSet (sample_offset - buffer_position);
 
-	LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (%s): sample %u at offset %" G_GUINT64_FORMAT " and size %u (chunk index: %u, stsc index: %u) pts: %" G_GUINT64_FORMAT " duration: %" G_GUINT64_FORMAT "\n",
-		stream->GetTypeName (), trak->current_sample, sample_offset, sample_size, trak->current_sample, trak->stsc_index, pts, duration);
+	LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (%s): sample %u at offset %" G_GUINT64_FORMAT " and size %u pts: %" G_GUINT64_FORMAT " duration: %" G_GUINT64_FORMAT " key frame: %i\n",
+		stream->GetTypeName (), trak->current_sample, sample_offset, sample_size, pts, duration, key_frame);
 
 	MediaFrame *frame = new MediaFrame (stream);
 	frame->pts = pts;
@@ -972,37 +1500,22 @@ Mp4Demuxer::GetFrameAsyncInternal (IMediaStream *stream)
 		goto cleanup;
 	}
 	frame->AddState (MediaFrameDemuxed);
+	if (key_frame)
+		frame->AddState (MediaFrameKeyFrame);
 	
 	/* Frame read successfully, advance to the next frame */
-	trak->current_sample++;
-	trak->stsc_sample_index++;
-	trak->stsc_samples_size += sample_size;
-	if (trak->stsc_sample_index >= trak->stsc_sample_count) {
-		/* Advance to next stsc entry */
-		trak->stsc_index++;
-		trak->stsc_sample_index = 0;
-		trak->stsc_samples_size = 0;
-		
-		/* Find out how many samples in next stsc entry */
-		if (trak->stsc_index >= stsc->entry_count) {
-			LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (): reached end of stsc table.\n");
-			trak->current_sample = G_MAXUINT32;
-		} else if (trak->stsc_index + 1 == stsc->entry_count) {
-			/* last stsc entry */
-			if (chunk_count < stsc->first_chunk [trak->stsc_index]) {
-				/* Corrupted file */
-				LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (): corrupted mp4 file, too many chunks in stsc table (last entry has %u has first chunk, chunk_count = %u).\n",
-					stsc->first_chunk [trak->stsc_index], chunk_count);
-				trak->current_sample = G_MAXUINT32;
-			} else {
-				trak->stsc_sample_count = (chunk_count - stsc->first_chunk [trak->stsc_index] + 1) * stsc->samples_per_chunk [trak->stsc_index];
-			}
-		} else {
-			/* We check that first_chunk are sequential when parsing, so the subtraction can't end up with a negative answer here */
-			trak->stsc_sample_count = (stsc->first_chunk [trak->stsc_index + 1] - stsc->first_chunk [trak->stsc_index]) * stsc->samples_per_chunk [trak->stsc_index];
-		}
-	} else if (trak->stsc_sample_index % stsc->samples_per_chunk [trak->stsc_index] == 0) {
-		trak->stsc_samples_size = 0;
+	if (fragment_sample != NULL) {
+		trak->fragment_sample_head++;
+		if (trak->fragment_sample_head == trak->fragment_sample_count)
+			trak->ClearFragmentSamples ();
+	} else {
+		trak->current_sample++;
+	}
+
+	if (!first_frame_demuxed) {
+		first_frame_demuxed = true;
+		LOG_MP4 ("Mp4Demuxer::GetFrameAsyncInternal (%s): first frame demuxed %" G_GINT64_FORMAT " ms after the demuxer was created (fragmented: %i)\n",
+			stream->GetTypeName (), MilliSeconds_FromPts (get_now () - open_time), fragmented);
 	}
 
 	ReportGetFrameCompleted (frame);
@@ -1012,6 +1525,155 @@ cleanup:
 		frame->unref ();
 }
 
+void
+Mp4Demuxer::RequestSampleData (IMediaStream *stream, guint64 offset, guint32 size)
+{
+	Media *media = GetMediaReffed ();
+
+	if (media == NULL)
+		return; /* We've probably been disposed */
+
+	if (get_frame_stream != NULL)
+		get_frame_stream->unref ();
+	get_frame_stream = stream;
+	get_frame_stream->ref ();
+
+	MediaReadClosure *closure = new MediaReadClosure (media, ReadSampleDataAsyncCallback, this, offset, size);
+	source->ReadAsync (closure);
+	closure->unref ();
+	media->unref ();
+}
+
+bool
+Mp4Demuxer::NeedsFragment (TrakBox *trak)
+{
+	if (fragments_done)
+		return false;
+
+	if (trak->fragment_sample_head == trak->fragment_sample_count)
+		return true;
+
+	/* When seeking we need to find a sample after the seek time, so that we know
+	 * there are no more key frames before it */
+	return trak->fragment_seeking && trak->fragment_samples [trak->fragment_sample_count - 1].decoding_time <= trak->fragment_seek_time;
+}
+
+bool
+Mp4Demuxer::OpenFragment (MoofBox *moof)
+{
+	guint64 data_end = moof->position;
+	guint64 *start_time = (guint64 *) g_alloca (moov->trak_count * sizeof (guint64));
+	guint64 *key_time = (guint64 *) g_alloca (moov->trak_count * sizeof (guint64));
+
+	for (guint32 t = 0; t < moov->trak_count; t++) {
+		start_time [t] = moov->trak [t]->fragment_time;
+		moov->trak [t]->fragment_key_time = G_MAXUINT64;
+	}
+
+	for (guint32 i = 0; i < moof->traf_count; i++) {
+		TrafBox *traf = moof->traf [i];
+		TfhdBox *tfhd = traf->tfhd;
+		TrakBox *trak = NULL;
+
+		for (guint32 t = 0; t < moov->trak_count; t++) {
+			if (moov->trak [t]->tkhd->track_ID == tfhd->track_ID) {
+				trak = moov->trak [t];
+				break;
+			}
+		}
+
+		if (trak == NULL) {
+			char *msg = g_strdup_printf ("Mp4Demuxer: corrupted mp4 file, fragment for unknown track %u", tfhd->track_ID);
+			ReportErrorOccurred (msg);
+			g_free (msg);
+			return false;
+		}
+
+		/* Don't queue samples nobody will read */
+		data_end = traf->QueueSamples (trak, moof->position, data_end, trak->stream != NULL && trak->stream->GetSelected ());
+
+		LOG_MP4 ("Mp4Demuxer::OpenFragment (): track %u has %u queued samples, next fragment time: %" G_GUINT64_FORMAT "\n",
+			tfhd->track_ID, trak->fragment_sample_count - trak->fragment_sample_head, trak->fragment_time);
+	}
+
+	for (guint32 t = 0; t < moov->trak_count; t++)
+		key_time [t] = moov->trak [t]->fragment_key_time;
+	fragment_table->Add (moof->position, start_time, key_time);
+
+	return true;
+}
+
+MediaResult
+Mp4Demuxer::ReadNextFragment (IMediaStream *stream)
+{
+	MemoryBuffer *source = buffer;
+	guint64 buffer_end = buffer_position + buffer->GetSize ();
+	guint64 start;
+	guint64 size;
+	guint32 type;
+	bool buffered = buffer_position <= next_fragment_position && buffer_end >= next_fragment_position;
+
+	/* Make sure we have the box header (32 bytes is the maximum ReadBox can read) */
+	if (!buffered || (buffer_end - next_fragment_position < 32 && !last_buffer)) {
+		RequestSampleData (stream, next_fragment_position, 4096);
+		return MEDIA_NOT_ENOUGH_DATA;
+	}
+
+	if (buffer_end - next_fragment_position < 8) {
+		LOG_MP4 ("Mp4Demuxer::ReadNextFragment (): reached the end of the file at %" G_GUINT64_FORMAT "\n", next_fragment_position);
+		fragments_done = true;
+		return MEDIA_SUCCESS;
+	}
+
+	source->SeekSet (next_fragment_position - buffer_position);
+	start = source->GetPosition ();
+
+	if (!ReadBox (&size, &type))
+		return MEDIA_FAIL;
+
+	if (size == 0) {
+		/* The last box in the file */
+		fragments_done = true;
+		return MEDIA_SUCCESS;
+	}
+
+	switch (type) {
+	case MOOF_4CC: {
+		if (buffer_end < next_fragment_position + size) {
+			if (last_buffer) {
+				LOG_MP4 ("Mp4Demuxer::ReadNextFragment (): the file ends in the middle of a 'moof' box\n");
+				fragments_done = true;
+				return MEDIA_SUCCESS;
+			}
+			if (size > G_MAXUINT32) {
+				ReportErrorOccurred ("Mp4Demuxer: corrupted mp4 file, 'moof' box too big");
+				return MEDIA_FAIL;
+			}
+			RequestSampleData (stream, next_fragment_position, (guint32) size);
+			return MEDIA_NOT_ENOUGH_DATA;
+		}
+
+		MoofBox *moof = new MoofBox (type, size);
+		moof->position = next_fragment_position;
+		bool result = ReadMoof (type, start, size, moof) && OpenFragment (moof);
+		/* We've got everything we need from the moof box, no need to keep it around */
+		delete moof;
+
+		if (!result)
+			return MEDIA_FAIL;
+		break;
+	}
+	default:
+		/* mdat (the samples are read separately), free, sidx, etc. */
+		LOG_MP4 ("Mp4Demuxer::ReadNextFragment (): skipping top-level box " FORMAT_4CC " with size %" G_GUINT64_FORMAT "\n", VALUES_4CC (type), size);
+		break;
+	}
+
+	next_fragment_position += size;
+
+	return MEDIA_SUCCESS;
+}
+
 bool
 Mp4Demuxer::ParseAVCFrame (MediaFrame *frame, MemoryBuffer *memory_buffer, guint32 sample_size)
 {
@@ -1029,27 +1691,13 @@ Mp4Demuxer::ParseAVCFrame (MediaFrame *frame, MemoryBuffer *memory_buffer, guint
 	}
 
 	if (frame->GetStream ()->IsAudio ()) {
-		if (!frame->AllocateBuffer (sample_size)) {
-			ReportErrorOccurred ("Mp4Demuxer: could not allocate frame buffer");
-			return false;
-		}
-		if (!memory_buffer->Read (frame->GetBuffer (), sample_size)) {
-			ReportErrorOccurred ("Mp4Demuxer: could not read from memory buffer");
-			return false;
-		}
-		return true;
+		/* Errors have already been reported */
+		return frame->FetchData (sample_size, memory_buffer);
 	}
 
-	if (needs_raw_frames) {
-		if (!frame->AllocateBuffer (sample_size)) {
-			ReportErrorOccurred ("Mp4Demuxer: could not allocate frame buffer");
-			return false;
-		}
-		if (!memory_buffer->Read (frame->GetBuffer (), sample_size)) {
-			ReportErrorOccurred ("Mp4Demuxer: could not read from memory buffer");
-			return false;
-		}
-		return true;
+	if (needs_raw_frames) {
+		/* Errors have already been reported */
+		return frame->FetchData (sample_size, memory_buffer);
 	}
 
 	guint8 *out;
@@ -1213,113 +1861,6 @@ Mp4Demuxer::FromPts (guint64 pts, TrakBox *trak)
 	return (guint64) ((double) pts * (double) trak->mdia->mdhd->timescale / (double) 10000000);
 }
 
-bool
-Mp4Demuxer::GetChunkCount (StblBox *stbl, guint32 *result)
-{
-	if (stbl->stco != NULL) {
-		*result = stbl->stco->entry_count;
-		return true;
-	}
-
-	if (stbl->co64 != NULL) {
-		*result = stbl->co64->entry_count;
-		return true;
-	}
-
-	ReportErrorOccurred ("Mp4Demuxer: corrupted mp4 file, either a stco box or a co64 box is required");
-	return false;
-}
-
-bool
-Mp4Demuxer::GetChunkOffset (StblBox *stbl, guint32 chunk_index, guint64 *result)
-{
-	/* Get the offset of the chunk we want */
-	if (stbl->stco != NULL) {
-		*result = stbl->stco->chunk_offset [chunk_index];
-		return true;
-	} else if (stbl->co64 != NULL) {
-		*result = stbl->co64->chunk_offset [chunk_index];
-		return true;
-	}
-
-	ReportErrorOccurred ("Mp4Demuxer: corrupted mp4 file, either a stco box or a co64 box is required");
-	return false;
-}
-
-bool
-Mp4Demuxer::GetSampleCount (StblBox *stbl, guint32 *result)
-{
-	if (stbl->stsz != NULL) {
-		*result = stbl->stsz->sample_count;
-		return true;
-	}
-
-	if (stbl->stz2 != NULL) {
-		*result = stbl->stz2->sample_count;
-		return true;
-	}
-
-	ReportErrorOccurred ("Mp4Demuxer: corrupted mp4 file, either a stsz box or a stz2 box is required");
-	return false;
-}
-
-bool
-Mp4Demuxer::GetSampleSize (StblBox *stbl, guint32 sample_index, guint32 *result)
-{
-	StszBox *stsz = stbl->stsz;
-	Stz2Box *stz2 = stbl->stz2;
-
-	if (stsz != NULL) {
-		g_return_val_if_fail (sample_index < stsz->sample_count, 0);
-		if (stsz->sample_size != 0) {
-			*result = stsz->sample_size;
-			return true;
-		} else if (sample_index < stsz->sample_count) {
-			*result = stsz->entry_size [sample_index];
-			return true;
-		} else {
-			char *msg = g_strdup_printf ("Mp4Demuxer: corrupted mp4 file, invalid sample index %u (>=sample count %u)", sample_index, stsz->sample_count);
-			ReportErrorOccurred (msg);
-			g_free (msg);
-			return false;
-		}
-	}
-
-	if (stz2 != NULL) {
-		if (sample_index >= stsz->sample_count) {
-			char *msg = g_strdup_printf ("Mp4Demuxer: corrupted mp4 file, invalid sample index %u (>=sample count %u)", sample_index, stsz->sample_count);
-			ReportErrorOccurred (msg);
-			g_free (msg);
-			return false;
-		}
-
-		switch (stz2->field_size) {
-		case 4: {
-			guint32 si = sample_index;
-			guint8 b = stz2->samples [si / 2];
-			if (si % 2 == 0) {
-				*result = b >> 4;
-			} else {
-				*result = b & 0x0F;
-			}
-			return true;
-		}
-		case 8:
-			*result = stz2->samples [sample_index];
-			return true;
-		case 16:
-			*result = ((guint16 *) stz2->samples) [sample_index];
-			return true;
-		default:
-			ReportErrorOccurred ("Mp4Demuxer: invalid field size in stz2");
-			return false;
-		}
-	}
-
-	ReportErrorOccurred ("Mp4Demuxer: corrupted mp4 file, either a stsz box or a stz2 box is required");
-	return false;
-}
-
 bool
 Mp4Demuxer::OpenMoov ()
 {
@@ -1353,6 +1894,7 @@ Mp4Demuxer::OpenMoov ()
 		AudioStream *audio;
 		VideoStream *video;
 		guint64 pts_per_frame = 0;
+		guint64 duration;
 
 		LOG_MP4 ("Mp4Demuxer::OpenMoov () trak #%i has %i sample entries.\n", i, stsd->entry_count);
 		if (stsd->entry_count == 0) {
@@ -1404,10 +1946,34 @@ Mp4Demuxer::OpenMoov ()
 		streams [stream_count] = stream;
 		stream_count++;
 
+		if (moov->mvex != NULL) {
+			for (guint32 t = 0; t < moov->mvex->trex_count; t++) {
+				if (moov->mvex->trex [t]->track_ID == tkhd->track_ID)
+					trak->trex = moov->mvex->trex [t];
+			}
+		}
+
+		if (pts_per_frame == 0 && trak->trex != NULL && trak->trex->default_sample_duration != 0 && mdhd != NULL)
+			pts_per_frame = (guint64) trak->trex->default_sample_duration * 10000000ULL / (guint64) mdhd->timescale;
+
+		trak->index = new Mp4SampleIndex ();
+		const char *error = trak->index->Build (stbl);
+		if (error != NULL) {
+			char *msg = g_strdup_printf ("Mp4Demuxer: corrupted mp4 file, %s", error);
+			ReportErrorOccurred (msg);
+			g_free (msg);
+			goto cleanup;
+		}
+		trak->ResetFragments ();
+
 		ParseAVCExtraData (stream, entry);
 		stream->SetCodecId (GINT32_FROM_BE (entry->type));
+		/* The track header of fragmented files usually only covers the samples in the moov box (if any) */
+		duration = tkhd->duration;
+		if (duration == 0 && moov->mvex != NULL && moov->mvex->mehd != NULL)
+			duration = moov->mvex->mehd->fragment_duration;
 		/* MS seems to only have ms accuracy on duration - the remaining microseconds are stripped off (/10000*10000). #7000 */
-		stream->SetDuration ((ToPts (tkhd->duration, moov->mvhd->timescale) / 10000) * 10000);
+		stream->SetDuration ((ToPts (duration, moov->mvhd->timescale) / 10000) * 10000);
 		stream->SetPtsPerFrame (pts_per_frame);
 		LOG_MP4 ("Mp4Demuxer::OpenMoov (): codec_id: %i = %s, duration: %" G_GUINT64_FORMAT " = %" G_GUINT64_FORMAT " pts = %" G_GUINT64_FORMAT "ms pts_per_frame = %" G_GUINT64_FORMAT " ms\n",
 			stream->GetCodecId (), stream->GetCodec (), tkhd->duration, stream->GetDuration (), MilliSeconds_FromPts (stream->GetDuration ()), MilliSeconds_FromPts (pts_per_frame));
@@ -1585,6 +2151,15 @@ Mp4Demuxer::OpenDemuxerAsyncInternal ()
 			if (!ReadMoov (type, start, size))
 				return;
 
+			if (moov->mvex != NULL) {
+				/* A fragmented file, the samples are described by the moof boxes following the moov box */
+				fragmented = true;
+				first_fragment_position = buffer_position + start + size;
+				next_fragment_position = first_fragment_position;
+				fragment_table = new Mp4FragmentTable (moov->trak_count);
+				LOG_MP4 ("Mp4DemuxerInfo::OpenDemuxerAsyncInternal (): fragmented file, first fragment at %" G_GUINT64_FORMAT "\n", first_fragment_position);
+			}
+
 			if (OpenMoov ())
 				ReportOpenDemuxerCompleted ();
 
@@ -1766,6 +2341,10 @@ Mp4Demuxer::ReadLoop (guint64 start, guint64 size, Box *container)
 				if (!ReadTrak (sub_type, sub_start, sub_size, (MoovBox *) container))
 					return false;
 				break;
+			case MVEX_4CC:
+				if (!ReadMvex (sub_type, sub_start, sub_size, (MoovBox *) container))
+					return false;
+				break;
 			default:
 				handled = false;
 				break;
@@ -1882,6 +2461,52 @@ Mp4Demuxer::ReadLoop (guint64 start, guint64 size, Box *container)
 				break;
 			}
 			break;
+		case MVEX_4CC:
+			switch (sub_type) {
+			case MEHD_4CC:
+				if (!ReadMehd (sub_type, sub_start, sub_size, (MvexBox *) container))
+					return false;
+				break;
+			case TREX_4CC:
+				if (!ReadTrex (sub_type, sub_start, sub_size, (MvexBox *) container))
+					return false;
+				break;
+			default:
+				handled = false;
+				break;
+			}
+			break;
+		case MOOF_4CC:
+			switch (sub_type) {
+			case TRAF_4CC:
+				if (!ReadTraf (sub_type, sub_start, sub_size, (MoofBox *) container))
+					return false;
+				break;
+			case MFHD_4CC:
+			default:
+				handled = false;
+				break;
+			}
+			break;
+		case TRAF_4CC:
+			switch (sub_type) {
+			case TFHD_4CC:
+				if (!ReadTfhd (sub_type, sub_start, sub_size, (TrafBox *) container))
+					return false;
+				break;
+			case TFDT_4CC:
+				if (!ReadTfdt (sub_type, sub_start, sub_size, (TrafBox *) container))
+					return false;
+				break;
+			case TRUN_4CC:
+				if (!ReadTrun (sub_type, sub_start, sub_size, (TrafBox *) container))
+					return false;
+				break;
+			default:
+				handled = false;
+				break;
+			}
+			break;
 		case MP4A_4CC:
 		case MP4V_4CC:
 		case AVC1_4CC:
@@ -2785,7 +3410,7 @@ Mp4Demuxer::ReadStz2 (guint32 type, guint64 start, guint64 size, StblBox *stbl)
 		switch (stz2->field_size) {
 		case 4:
 			if (i % 2 == 0) {
-				stz2->samples [i] = source->ReadBE_U8 ();
+				stz2->samples [i / 2] = source->ReadBE_U8 ();
 			}
 			break;
 		case 8:
@@ -3090,6 +3715,302 @@ Mp4Demuxer::ReadHdlr (guint32 type, guint64 start, guint64 size, MdiaBox *mdia)
 	return true;
 }
 
+bool
+Mp4Demuxer::ReadMvex (guint32 type, guint64 start, guint64 size, MoovBox *moov)
+{
+	MemoryBuffer *source = buffer;
+	MvexBox *mvex;
+
+	LOG_MP4 ("Mp4Demuxer::ReadMvex (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	VERIFY_EXISTING_BOX (moov, mvex);
+
+	moov->mvex = new MvexBox (type, size);
+	mvex = moov->mvex;
+
+	if (!ReadLoop (start, size, mvex))
+		return false;
+
+	mvex->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadMvex (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") %u trex boxes found [Done]\n", start, size, mvex->trex_count);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadMehd (guint32 type, guint64 start, guint64 size, MvexBox *mvex)
+{
+	MemoryBuffer *source = buffer;
+	MehdBox *mehd;
+
+	LOG_MP4 ("Mp4Demuxer::ReadMehd (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	VERIFY_EXISTING_BOX (mvex, mehd);
+
+	mvex->mehd = new MehdBox (type, size);
+	mehd = mvex->mehd;
+
+	if (!ReadFullBox (mehd))
+		return false;
+
+	if (mehd->version == 1) {
+		VERIFY_BOX_SIZE (8, "mehd");
+		mehd->fragment_duration = source->ReadBE_U64 ();
+	} else {
+		VERIFY_BOX_SIZE (4, "mehd");
+		mehd->fragment_duration = source->ReadBE_U32 ();
+	}
+
+	mehd->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadMehd (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") fragment_duration: %" G_GUINT64_FORMAT " [Done]\n", start, size, mehd->fragment_duration);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadTrex (guint32 type, guint64 start, guint64 size, MvexBox *mvex)
+{
+	MemoryBuffer *source = buffer;
+	TrexBox *trex;
+
+	LOG_MP4 ("Mp4Demuxer::ReadTrex (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	mvex->trex_count++;
+	mvex->trex = (TrexBox **) g_realloc (mvex->trex, mvex->trex_count * sizeof (TrexBox *));
+	mvex->trex [mvex->trex_count - 1] = new TrexBox (type, size);
+
+	trex = mvex->trex [mvex->trex_count - 1];
+
+	if (!ReadFullBox (trex))
+		return false;
+
+	VERIFY_BOX_SIZE (20, "trex");
+
+	trex->track_ID = source->ReadBE_U32 ();
+	trex->default_sample_description_index = source->ReadBE_U32 ();
+	trex->default_sample_duration = source->ReadBE_U32 ();
+	trex->default_sample_size = source->ReadBE_U32 ();
+	trex->default_sample_flags = source->ReadBE_U32 ();
+
+	trex->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadTrex (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") track_ID: %u default_sample_duration: %u default_sample_size: %u default_sample_flags: 0x%x [Done]\n",
+		start, size, trex->track_ID, trex->default_sample_duration, trex->default_sample_size, trex->default_sample_flags);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadMoof (guint32 type, guint64 start, guint64 size, MoofBox *moof)
+{
+	MemoryBuffer *source = buffer;
+
+	LOG_MP4 ("Mp4Demuxer::ReadMoof (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	if (!ReadLoop (start, size, moof))
+		return false;
+
+	moof->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadMoof (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") %u traf boxes found [Done]\n", start, size, moof->traf_count);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadTraf (guint32 type, guint64 start, guint64 size, MoofBox *moof)
+{
+	MemoryBuffer *source = buffer;
+	TrafBox *traf;
+
+	LOG_MP4 ("Mp4Demuxer::ReadTraf (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	moof->traf_count++;
+	moof->traf = (TrafBox **) g_realloc (moof->traf, moof->traf_count * sizeof (TrafBox *));
+	moof->traf [moof->traf_count - 1] = new TrafBox (type, size);
+
+	traf = moof->traf [moof->traf_count - 1];
+
+	if (!ReadLoop (start, size, traf))
+		return false;
+
+	VERIFY_REQUIRED_BOX (traf, tfhd);
+
+	traf->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadTraf (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") %u trun boxes found [Done]\n", start, size, traf->trun_count);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadTfhd (guint32 type, guint64 start, guint64 size, TrafBox *traf)
+{
+	MemoryBuffer *source = buffer;
+	TfhdBox *tfhd;
+
+	LOG_MP4 ("Mp4Demuxer::ReadTfhd (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	VERIFY_EXISTING_BOX (traf, tfhd);
+
+	traf->tfhd = new TfhdBox (type, size);
+	tfhd = traf->tfhd;
+
+	if (!ReadFullBox (tfhd))
+		return false;
+
+	VERIFY_BOX_SIZE (4, "tfhd");
+	tfhd->track_ID = source->ReadBE_U32 ();
+
+	if (tfhd->flags & TFHD_BASE_DATA_OFFSET_PRESENT) {
+		VERIFY_BOX_SIZE (8, "tfhd");
+		tfhd->base_data_offset = source->ReadBE_U64 ();
+	}
+	if (tfhd->flags & TFHD_SAMPLE_DESCRIPTION_INDEX_PRESENT) {
+		VERIFY_BOX_SIZE (4, "tfhd");
+		tfhd->sample_description_index = source->ReadBE_U32 ();
+	}
+	if (tfhd->flags & TFHD_DEFAULT_SAMPLE_DURATION_PRESENT) {
+		VERIFY_BOX_SIZE (4, "tfhd");
+		tfhd->default_sample_duration = source->ReadBE_U32 ();
+	}
+	if (tfhd->flags & TFHD_DEFAULT_SAMPLE_SIZE_PRESENT) {
+		VERIFY_BOX_SIZE (4, "tfhd");
+		tfhd->default_sample_size = source->ReadBE_U32 ();
+	}
+	if (tfhd->flags & TFHD_DEFAULT_SAMPLE_FLAGS_PRESENT) {
+		VERIFY_BOX_SIZE (4, "tfhd");
+		tfhd->default_sample_flags = source->ReadBE_U32 ();
+	}
+
+	tfhd->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadTfhd (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") flags: 0x%x track_ID: %u base_data_offset: %" G_GUINT64_FORMAT " [Done]\n",
+		start, size, tfhd->flags, tfhd->track_ID, tfhd->base_data_offset);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadTfdt (guint32 type, guint64 start, guint64 size, TrafBox *traf)
+{
+	MemoryBuffer *source = buffer;
+	TfdtBox *tfdt;
+
+	LOG_MP4 ("Mp4Demuxer::ReadTfdt (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	VERIFY_EXISTING_BOX (traf, tfdt);
+
+	traf->tfdt = new TfdtBox (type, size);
+	tfdt = traf->tfdt;
+
+	if (!ReadFullBox (tfdt))
+		return false;
+
+	if (tfdt->version == 1) {
+		VERIFY_BOX_SIZE (8, "tfdt");
+		tfdt->base_media_decode_time = source->ReadBE_U64 ();
+	} else {
+		VERIFY_BOX_SIZE (4, "tfdt");
+		tfdt->base_media_decode_time = source->ReadBE_U32 ();
+	}
+
+	tfdt->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadTfdt (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") base_media_decode_time: %" G_GUINT64_FORMAT " [Done]\n", start, size, tfdt->base_media_decode_time);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
+bool
+Mp4Demuxer::ReadTrun (guint32 type, guint64 start, guint64 size, TrafBox *traf)
+{
+	MemoryBuffer *source = buffer;
+	TrunBox *trun;
+	guint32 entry_size = 0;
+
+	LOG_MP4 ("Mp4Demuxer::ReadTrun (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", start, size);
+
+	traf->trun_count++;
+	traf->trun = (TrunBox **) g_realloc (traf->trun, traf->trun_count * sizeof (TrunBox *));
+	traf->trun [traf->trun_count - 1] = new TrunBox (type, size);
+
+	trun = traf->trun [traf->trun_count - 1];
+
+	if (!ReadFullBox (trun))
+		return false;
+
+	VERIFY_BOX_SIZE (4, "trun");
+	trun->sample_count = source->ReadBE_U32 ();
+
+	if (trun->flags & TRUN_DATA_OFFSET_PRESENT) {
+		VERIFY_BOX_SIZE (4, "trun");
+		trun->data_offset = source->ReadBE_I32 ();
+	}
+	if (trun->flags & TRUN_FIRST_SAMPLE_FLAGS_PRESENT) {
+		VERIFY_BOX_SIZE (4, "trun");
+		trun->first_sample_flags = source->ReadBE_U32 ();
+	}
+
+	if (trun->flags & TRUN_SAMPLE_DURATION_PRESENT)
+		entry_size += 4;
+	if (trun->flags & TRUN_SAMPLE_SIZE_PRESENT)
+		entry_size += 4;
+	if (trun->flags & TRUN_SAMPLE_FLAGS_PRESENT)
+		entry_size += 4;
+	if (trun->flags & TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT)
+		entry_size += 4;
+
+	VERIFY_BOX_SIZE ((guint64) trun->sample_count * entry_size, "trun");
+
+	if (trun->flags & TRUN_SAMPLE_DURATION_PRESENT)
+		trun->sample_duration = (guint32 *) g_malloc (sizeof (guint32) * trun->sample_count);
+	if (trun->flags & TRUN_SAMPLE_SIZE_PRESENT)
+		trun->sample_size = (guint32 *) g_malloc (sizeof (guint32) * trun->sample_count);
+	if (trun->flags & TRUN_SAMPLE_FLAGS_PRESENT)
+		trun->sample_flags = (guint32 *) g_malloc (sizeof (guint32) * trun->sample_count);
+	if (trun->flags & TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT)
+		trun->sample_composition_time_offset = (gint32 *) g_malloc (sizeof (gint32) * trun->sample_count);
+
+	LOG_MP4 ("Mp4Demuxer::ReadTrun (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") flags: 0x%x sample_count: %u data_offset: %i\n", start, size, trun->flags, trun->sample_count, trun->data_offset);
+
+	for (guint32 i = 0; i < trun->sample_count; i++) {
+		if (trun->sample_duration != NULL)
+			trun->sample_duration [i] = source->ReadBE_U32 ();
+		if (trun->sample_size != NULL)
+			trun->sample_size [i] = source->ReadBE_U32 ();
+		if (trun->sample_flags != NULL)
+			trun->sample_flags [i] = source->ReadBE_U32 ();
+		if (trun->sample_composition_time_offset != NULL) {
+			trun->sample_composition_time_offset [i] = TrunBox::ToCompositionOffset (trun->version, source->ReadBE_U32 ());
+		}
+	}
+
+	trun->parsed = true;
+	LOG_MP4 ("Mp4Demuxer::ReadTrun (%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ") [Done]\n", start, size);
+
+	/* Skip whatever data is left */
+	source->SeekSet (start + size);
+
+	return true;
+}
+
 void
 Mp4Demuxer::SwitchMediaStreamAsyncInternal (IMediaStream *stream)
 {
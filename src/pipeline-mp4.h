@@ -42,6 +42,17 @@ struct StssBox;
 struct SampleEntry;
 struct VisualSampleEntry;
 struct AudioSampleEntry;
+struct Mp4SampleIndex;
+struct MvexBox;
+struct MehdBox;
+struct TrexBox;
+struct MoofBox;
+struct TrafBox;
+struct TfhdBox;
+struct TfdtBox;
+struct TrunBox;
+struct Mp4FragmentSample;
+struct Mp4FragmentTable;
 
 struct Fixed16_16 {
 	guint16 hi;
@@ -66,6 +77,7 @@ struct FullBox : public Box {
 
 struct MoovBox : public Box {
 	MvhdBox *mvhd;
+	MvexBox *mvex; /* only in fragmented files */
 	TrakBox **trak;
 	guint32 trak_count;
 	MoovBox (guint32 type, guint64 size);
@@ -84,14 +96,28 @@ struct TrakBox : public Box {
 
 	/* The following fields are not defined in the trak box, but are values cached by the demuxer */
 	IMediaStream *stream;
-	guint32 stsc_index;
-	guint32 stsc_sample_index;
-	guint32 stsc_sample_count;
-	guint32 stsc_samples_size;
+	Mp4SampleIndex *index;
 	guint32 current_sample;
 
+	/* Fragmented files: the samples read from movie fragments which haven't been demuxed yet.
+	 * Samples are appended at fragment_sample_count and consumed from fragment_sample_head. */
+	TrexBox *trex;
+	Mp4FragmentSample *fragment_samples;
+	guint32 fragment_sample_head;
+	guint32 fragment_sample_count;
+	guint32 fragment_sample_capacity;
+	guint64 fragment_time; /* the decoding time of the first sample in the next fragment (unless it has a tfdt box) */
+	guint64 fragment_seek_time; /* drop queued samples before the last key frame at or before this time */
+	bool fragment_seeking;
+	guint64 fragment_key_time; /* the decoding time of the first key frame in the last fragment read, G_MAXUINT64 if it had none */
+
 	TrakBox (guint32 type, guint64 size);
 	virtual ~TrakBox ();
+
+	/* Drops the queued fragment samples, and starts over with the fragment following the moov box */
+	void ResetFragments ();
+	void QueueFragmentSample (const Mp4FragmentSample *sample);
+	void ClearFragmentSamples ();
 };
 
 struct TkhdBox : public FullBox {
@@ -257,6 +283,137 @@ struct Co64Box : public FullBox {
 	virtual ~Co64Box ();
 };
 
+/*
+ * Movie fragments (ISO/IEC 14496-12 section 8.8)
+ */
+
+struct MvexBox : public Box {
+	MehdBox *mehd;
+	TrexBox **trex;
+	guint32 trex_count;
+	MvexBox (guint32 type, guint64 size);
+	virtual ~MvexBox ();
+};
+
+struct MehdBox : public FullBox {
+	guint64 fragment_duration;
+	MehdBox (guint32 type, guint64 size);
+};
+
+struct TrexBox : public FullBox {
+	guint32 track_ID;
+	guint32 default_sample_description_index;
+	guint32 default_sample_duration;
+	guint32 default_sample_size;
+	guint32 default_sample_flags;
+	TrexBox (guint32 type, guint64 size);
+};
+
+struct MoofBox : public Box {
+	guint64 position; /* the file offset of the moof box */
+	TrafBox **traf;
+	guint32 traf_count;
+	MoofBox (guint32 type, guint64 size);
+	virtual ~MoofBox ();
+};
+
+struct TrafBox : public Box {
+	TfhdBox *tfhd;
+	TfdtBox *tfdt;
+	TrunBox **trun;
+	guint32 trun_count;
+	TrafBox (guint32 type, guint64 size);
+	virtual ~TrafBox ();
+
+	/* Resolves the samples in the trun boxes with the defaults from the tfhd box and the trex box
+	 * of @trak, and queues them in @trak if @queue is true. @moof_position is the offset of the moof
+	 * box, @data_end the end of the data of the previous track fragment in it (or @moof_position).
+	 * Returns the end of the data of this track fragment. */
+	guint64 QueueSamples (TrakBox *trak, guint64 moof_position, guint64 data_end, bool queue);
+};
+
+#define TFHD_BASE_DATA_OFFSET_PRESENT			0x000001
+#define TFHD_SAMPLE_DESCRIPTION_INDEX_PRESENT		0x000002
+#define TFHD_DEFAULT_SAMPLE_DURATION_PRESENT		0x000008
+#define TFHD_DEFAULT_SAMPLE_SIZE_PRESENT		0x000010
+#define TFHD_DEFAULT_SAMPLE_FLAGS_PRESENT		0x000020
+#define TFHD_DURATION_IS_EMPTY				0x010000
+#define TFHD_DEFAULT_BASE_IS_MOOF			0x020000
+
+struct TfhdBox : public FullBox {
+	guint32 track_ID;
+	guint64 base_data_offset;
+	guint32 sample_description_index;
+	guint32 default_sample_duration;
+	guint32 default_sample_size;
+	guint32 default_sample_flags;
+	TfhdBox (guint32 type, guint64 size);
+};
+
+struct TfdtBox : public FullBox {
+	guint64 base_media_decode_time;
+	TfdtBox (guint32 type, guint64 size);
+};
+
+#define TRUN_DATA_OFFSET_PRESENT			0x000001
+#define TRUN_FIRST_SAMPLE_FLAGS_PRESENT			0x000004
+#define TRUN_SAMPLE_DURATION_PRESENT			0x000100
+#define TRUN_SAMPLE_SIZE_PRESENT			0x000200
+#define TRUN_SAMPLE_FLAGS_PRESENT			0x000400
+#define TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT	0x000800
+
+/* sample_is_difference_sample in the sample flags */
+#define SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE			0x010000
+
+struct TrunBox : public FullBox {
+	guint32 sample_count;
+	gint32 data_offset;
+	guint32 first_sample_flags;
+	/* The following arrays are NULL if the corresponding values aren't present */
+	guint32 *sample_duration;
+	guint32 *sample_size;
+	guint32 *sample_flags;
+	gint32 *sample_composition_time_offset;
+	TrunBox (guint32 type, guint64 size);
+	virtual ~TrunBox ();
+
+	/* The composition offsets are unsigned in version 0 boxes and signed in version 1 boxes */
+	static gint32 ToCompositionOffset (guint8 version, guint32 value);
+};
+
+/*
+ * The movie fragments read so far, so that a seek can start reading at the
+ * fragment with the key frame it needs instead of at the first fragment.
+ * Fragments are added in file order, as they're read.
+ */
+struct Mp4FragmentTable {
+	guint32 trak_count;
+	guint32 count;
+	guint32 capacity;
+	guint64 *position; /* the file offset of every moof box */
+	guint64 *start_time; /* [fragment * trak_count + trak]: the track's fragment_time before the fragment */
+	guint64 *key_time; /* [fragment * trak_count + trak]: the track's fragment_key_time after the fragment */
+
+	Mp4FragmentTable (guint32 trak_count);
+	~Mp4FragmentTable ();
+
+	/* Fragments at or before the last one added (read again after a seek) are ignored */
+	void Add (guint64 position, const guint64 *start_time, const guint64 *key_time);
+	/* Returns the last fragment with a key frame of @trak at or before @time, -1 if there is none */
+	gint32 FindKeyFragment (guint32 trak, guint64 time);
+	guint64 GetStartTime (guint32 fragment, guint32 trak) { return start_time [fragment * trak_count + trak]; }
+};
+
+/* A sample from a movie fragment, with all the defaults resolved */
+struct Mp4FragmentSample {
+	guint64 offset;
+	guint64 decoding_time;
+	guint32 size;
+	guint32 duration;
+	gint32 composition_offset;
+	bool key_frame;
+};
+
 struct EsdsBox : public FullBox {
 	guint16 ES_ID; /* 16 bits */
 	bool streamDependenceFlag; /* 1 bit */
@@ -307,6 +464,56 @@ struct AudioSampleEntry : public SampleEntry {
 	AudioSampleEntry (guint32 type, guint64 size);
 };
 
+/*
+ * Mp4SampleIndex
+ *
+ * The sample tables of a track (stts, ctts, stsc, stco/co64, stsz/stz2 and stss)
+ * resolved once when the moov box has been parsed, so that reading a sample
+ * or seeking is a lookup or a binary search instead of a walk through the
+ * tables from the first sample.
+ */
+struct Mp4SampleIndex {
+	guint32 sample_count;
+	guint64 *offset; /* the file offset of every sample */
+	guint32 *size; /* the size of every sample, NULL if all samples have the same size */
+	guint32 fixed_size;
+
+	/* One run per stts entry */
+	guint32 time_run_count;
+	guint32 *time_run_sample; /* the first sample of the run */
+	guint64 *time_run_time; /* the decoding time of the first sample of the run */
+	guint32 *time_run_delta;
+
+	/* One run per ctts entry, no runs if there's no ctts box */
+	guint32 ctts_run_count;
+	guint32 *ctts_run_sample; /* the first sample of the run */
+	gint32 *ctts_run_offset;
+
+	/* 0-based and sorted, NULL if all samples are key frames (there's no stss box) */
+	guint32 keyframe_count;
+	guint32 *keyframes;
+	guint8 *keyframe_bitmap;
+
+	Mp4SampleIndex ();
+	~Mp4SampleIndex ();
+
+	/* Returns NULL if successful, otherwise a description of what's wrong with the sample tables.
+	 * Takes over the per-sample sizes from the stsz box (if any). */
+	const char *Build (StblBox *stbl);
+
+	guint64 GetOffset (guint32 sample) { return offset [sample]; }
+	guint32 GetSize (guint32 sample) { return size != NULL ? size [sample] : fixed_size; }
+	/* delta: the duration of the sample (optional) */
+	guint64 GetDecodingTime (guint32 sample, guint32 *delta);
+	gint32 GetCompositionOffset (guint32 sample);
+	/* Returns the sample being decoded at the specified time (clamped to the last sample) */
+	guint32 GetSampleAt (guint64 time);
+	/* Returns the last key frame at or before the specified sample
+	 * (or the first key frame if there are none before it) */
+	guint32 GetKeyFrameBefore (guint32 sample);
+	bool IsKeyFrame (guint32 sample);
+};
+
 /*
  * Mp4Demuxer
  */
@@ -320,6 +527,15 @@ private:
 	bool ftyp_validated;
 	int8_t nal_size_length; // the length of the size field before each nal unit (in bytes)
 
+	/* Fragmented files */
+	bool fragmented;
+	bool fragments_done; /* we've reached the end of the file */
+	guint64 first_fragment_position; /* the file offset of the first top-level box after the moov box */
+	guint64 next_fragment_position; /* the file offset of the next top-level box to read */
+	Mp4FragmentTable *fragment_table;
+	TimeSpan open_time;
+	bool first_frame_demuxed;
+
 	MoovBox *moov;
 
 	static MediaResult ReadHeaderDataAsyncCallback (MediaClosure *closure);
@@ -359,18 +575,30 @@ private:
 	bool ReadSampleEntry (SampleEntry *entry);
 	bool ReadVisualSampleEntry (VisualSampleEntry **entry);
 	bool ReadAudioSampleEntry (AudioSampleEntry **entry);
+	bool ReadMvex (guint32 type, guint64 start, guint64 size, MoovBox *moov);
+	bool ReadMehd (guint32 type, guint64 start, guint64 size, MvexBox *mvex);
+	bool ReadTrex (guint32 type, guint64 start, guint64 size, MvexBox *mvex);
+	bool ReadMoof (guint32 type, guint64 start, guint64 size, MoofBox *moof);
+	bool ReadTraf (guint32 type, guint64 start, guint64 size, MoofBox *moof);
+	bool ReadTfhd (guint32 type, guint64 start, guint64 size, TrafBox *traf);
+	bool ReadTfdt (guint32 type, guint64 start, guint64 size, TrafBox *traf);
+	bool ReadTrun (guint32 type, guint64 start, guint64 size, TrafBox *traf);
 	bool ReadLoop (guint64 start, guint64 size, Box *container);
 	bool ReadDescriptorLength (guint32 *length);
 
 	bool OpenMoov ();
 
+	/* Reads the next top-level box after the moov box in a fragmented file.
+	 * Returns MEDIA_SUCCESS if a box was read (or the end of the file was reached),
+	 * MEDIA_NOT_ENOUGH_DATA if more data has been requested and MEDIA_FAIL on errors. */
+	MediaResult ReadNextFragment (IMediaStream *stream);
+	bool OpenFragment (MoofBox *moof);
+	bool NeedsFragment (TrakBox *trak);
+	void RequestSampleData (IMediaStream *stream, guint64 offset, guint32 size);
+
 	guint64 ToPts (guint64 time, TrakBox *trak);
 	guint64 ToPts (guint64 time, guint64 timescale);
 	guint64 FromPts (guint64 pts, TrakBox *trak);
-	bool GetSampleSize (StblBox *stbl, guint32 sample_index, guint32 *result);
-	bool GetSampleCount (StblBox *stbl, guint32 *result);
-	bool GetChunkOffset (StblBox *stbl, guint32 chunk_index, guint64 *result);
-	bool GetChunkCount (StblBox *stbl, guint32 *result);
 
 protected:
 	virtual ~Mp4Demuxer ();
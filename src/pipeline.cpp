@@ -20,6 +20,7 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -42,6 +43,9 @@
 #include "factory.h"
 #include "medialog.h"
 #include "cpu.h"
+#include "trace.h"
+
+#include <mono/io-layer/atomic.h>
 
 #if CODECS_SUPPORTED
 #include "pipeline-ui.h"
@@ -430,7 +434,8 @@ Media::Shutdown ()
 bool
 Media::InMediaThread ()
 {
-	return MediaThreadPool::IsThreadPoolThread ();
+	/* Closures executing in a lane don't have exclusive access to the media */
+	return MediaThreadPool::IsLaneThread (NULL);
 }
 
 MediaResult
@@ -1502,7 +1507,9 @@ FileSource::FileSource (Media *media, const char *filename) : IMediaSource (Type
 {
 	this->filename = g_strdup (filename);
 	fd = NULL;
+	mapping = NULL;
 	size = 0;
+	position = 0;
 }
 
 FileSource::~FileSource ()
@@ -1514,6 +1521,10 @@ FileSource::~FileSource ()
 void
 FileSource::Dispose ()
 {
+	if (mapping != NULL) {
+		mapping->unref ();
+		mapping = NULL;
+	}
 	if (fd != NULL) {
 		fclose (fd);
 		fd = NULL;
@@ -1545,6 +1556,11 @@ FileSource::Initialize ()
 	} else {
 		size = 0;
 	}
+
+	/* Reads are served straight from the page cache, without copying, if we can map the file */
+	mapping = MediaMapping::Create (fileno (fd), size);
+
+	LOG_PIPELINE ("FileSource::Initialize () size: %" G_GINT64_FORMAT " mapped: %i\n", size, mapping != NULL);
 		
 	return MEDIA_SUCCESS;
 }
@@ -1563,7 +1579,7 @@ FileSource::GetPositionInternal ()
 	if (fd == NULL)
 		return -1;
 	
-	result = ftell (fd);
+	result = mapping != NULL ? position : ftell (fd);
 
 	LOG_PIPELINE_EX ("FileSource::GetPositionInternal (): result: %" G_GINT64_FORMAT "\n", result);
 
@@ -1573,7 +1589,14 @@ FileSource::GetPositionInternal ()
 void
 FileSource::ReadAsyncInternal (MediaReadClosure *closure)
 {
+	if (ReadMapping (mapping, closure)) {
+		position = MIN (closure->GetOffset () + closure->GetCount (), size);
+		return;
+	}
+
 	ReadFD (fd, closure);
+	if (mapping != NULL)
+		position = ftell (fd);
 }
 
 bool
@@ -1581,6 +1604,9 @@ FileSource::Eof ()
 {
 	if (fd == NULL)
 		return false;
+
+	if (mapping != NULL)
+		return position >= size;
 	
 	return feof (fd);
 }
@@ -1747,6 +1773,8 @@ ProgressiveSource::ProgressiveSource (Media *media, const Uri *resource_base, co
 	size = -1;
 	write_fd = NULL;
 	read_fd = NULL;
+	mapping = NULL;
+	read_position = 0;
 	cancellable = NULL;
 	filename = NULL;
 	bytes_received = 0;
@@ -1766,6 +1794,10 @@ ProgressiveSource::~ProgressiveSource ()
 		fclose (write_fd);
 		write_fd = NULL;
 	}
+	if (mapping) {
+		mapping->unref ();
+		mapping = NULL;
+	}
 	if (read_fd) {
 		fclose (read_fd);
 		read_fd = NULL;
@@ -1833,13 +1865,57 @@ ProgressiveSource::DeleteCancellable (EventObject *data)
 bool
 ProgressiveSource::Eof ()
 {
-	if (!complete)
-		return false;
+	bool is_complete;
+	gint64 length;
 
-	if (read_fd == NULL)
+	mutex.Lock ();
+	is_complete = complete;
+	length = size;
+	mutex.Unlock ();
+
+	if (!is_complete || read_fd == NULL)
 		return false;
 
-	return feof (read_fd);
+	return IsEof (read_position, length, read_fd);
+}
+
+bool
+ProgressiveSource::IsDownloadComplete ()
+{
+	bool result;
+
+	mutex.Lock ();
+	result = complete;
+	mutex.Unlock ();
+
+	return result;
+}
+
+bool
+ProgressiveSource::IsRangeDownloaded (guint64 offset, guint64 length)
+{
+	bool result;
+
+	mutex.Lock ();
+	result = complete || ranges.Contains (offset, length);
+	mutex.Unlock ();
+
+	return result;
+}
+
+bool
+ProgressiveSource::IsEof (gint64 read_position, gint64 size, FILE *fd)
+{
+	struct stat st;
+
+	/* The server didn't tell us the size, everything that was downloaded is in the file */
+	if (size < 0) {
+		if (fstat (fileno (fd), &st) == -1)
+			return feof (fd);
+		size = st.st_size;
+	}
+
+	return read_position >= size;
 }
 
 MediaResult
@@ -2364,12 +2440,50 @@ ProgressiveSource::CheckPendingReads ()
 	/* Loop over the read closures we've collected and do the actual read */
 	node = (MediaReadClosureNode *) pending_reads.First ();
 	while (node != NULL) {
-		ReadFD (read_fd, node->GetClosure ());
+		Read (node->GetClosure ());
 		/* The list (and all the nodes) will be deleted at function exit */
 		node = (MediaReadClosureNode *) node->next;
 	}
 }
 
+void
+ProgressiveSource::Read (MediaReadClosure *closure)
+{
+	gint64 end = closure->GetOffset () + closure->GetCount ();
+	gint64 length;
+	struct stat st;
+
+	VERIFY_MEDIA_THREAD;
+
+	g_return_if_fail (read_fd != NULL);
+
+	/* The closure's range has been downloaded (or the download is complete and the read goes
+	 * past the end of the file), so it's either within the mapping or we need a bigger one.
+	 * Only map what has been written: touching pages past the end of the file raises SIGBUS,
+	 * even if the download will fill them in later. */
+	if (mapping == NULL || end > mapping->GetLength ()) {
+		length = fstat (fileno (read_fd), &st) != -1 ? st.st_size : 0;
+
+		if (length > 0 && (mapping == NULL || length > mapping->GetLength ())) {
+			MediaMapping *new_mapping = MediaMapping::Create (fileno (read_fd), length);
+			if (new_mapping != NULL) {
+				LOG_PIPELINE ("ProgressiveSource::Read (): mapped %" G_GINT64_FORMAT " bytes\n", length);
+				if (mapping != NULL)
+					mapping->unref ();
+				mapping = new_mapping;
+			}
+		}
+	}
+
+	if (ReadMapping (mapping, closure)) {
+		read_position = MIN (end, mapping->GetLength ());
+		return;
+	}
+
+	ReadFD (read_fd, closure);
+	read_position = ftell (read_fd);
+}
+
 void
 ProgressiveSource::ReadAsyncInternal (MediaReadClosure *closure)
 {
@@ -2451,12 +2565,72 @@ MemoryBuffer::MemoryBuffer (Media *media, void *memory, gint32 size, bool owner)
 	this->size = size;
 	this->pos = 0;
 	this->owner = owner;
+	this->mapping = NULL;
+}
+
+MemoryBuffer::MemoryBuffer (Media *media, MediaMapping *mapping, gint64 offset, gint32 size)
+	: IMediaObject (Type::MEMORYBUFFER, media)
+{
+	this->memory = mapping->GetData () + offset;
+	this->size = size;
+	this->pos = 0;
+	this->owner = false;
+	this->mapping = mapping;
+	this->mapping->ref ();
 }
 
 MemoryBuffer::~MemoryBuffer ()
 {
 	if (owner)
 		g_free (memory);
+	if (mapping != NULL)
+		mapping->unref ();
+}
+
+/*
+ * MediaMapping
+ */
+
+MediaMapping::MediaMapping (guint8 *data, gint64 length)
+{
+	this->refcount = 1;
+	this->data = data;
+	this->length = length;
+}
+
+MediaMapping::~MediaMapping ()
+{
+	munmap (data, length);
+}
+
+MediaMapping *
+MediaMapping::Create (int fd, gint64 length)
+{
+	void *data;
+
+	if (length <= 0 || (guint64) length > G_MAXSIZE)
+		return NULL;
+
+	data = mmap (NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		LOG_PIPELINE ("MediaMapping::Create (%i, %" G_GINT64_FORMAT "): %s\n", fd, length, strerror (errno));
+		return NULL;
+	}
+
+	return new MediaMapping ((guint8 *) data, length);
+}
+
+void
+MediaMapping::ref ()
+{
+	InterlockedIncrement (&refcount);
+}
+
+void
+MediaMapping::unref ()
+{
+	if (InterlockedExchangeAdd (&refcount, -1) == 1)
+		delete this;
 }
 
 bool
@@ -2504,6 +2678,7 @@ int MediaThreadPool::count = 0;
 MoonThread* MediaThreadPool::threads [max_threads];
 Media *MediaThreadPool::medias [max_threads];
 Deployment *MediaThreadPool::deployments [max_threads];
+const void *MediaThreadPool::lanes [max_threads];
 bool MediaThreadPool::shutting_down = false;
 List *MediaThreadPool::queue = NULL;
 bool MediaThreadPool::valid [max_threads];
@@ -2522,15 +2697,15 @@ MediaThreadPool::AddWork (MediaClosure *closure)
 			queue = new List ();
 		queue->Append (new MediaWork (closure));
 		
-		// check if all threads are busy with other Media objects
+		// check if all threads are busy with other Media objects (or other lanes of this media)
 		bool spawn = true;
 		if (count == 0) {
 			spawn = true;
 		} else if (count < max_threads) {
 			Media *media = closure->GetMedia ();
 			for (int i = 0; i < count; i++) {
-				if (medias [i] == NULL || medias [i] == media) {
-					spawn = false; // there is a thread working on this media or not working at all.
+				if (medias [i] == NULL || Conflicts (i, media, closure->GetLane ())) {
+					spawn = false; // there is a thread working on this media (and lane) or not working at all.
 					break;
 				}
 			}
@@ -2549,6 +2724,7 @@ MediaThreadPool::AddWork (MediaClosure *closure)
 				valid [i] = false;
 				medias [i] = NULL;
 				deployments [i] = NULL;
+				lanes [i] = NULL;
 
 				result = MoonThread::StartJoinable (&threads [i], WorkerLoop);
 
@@ -2659,6 +2835,30 @@ MediaThreadPool::RemoveWork (Media *media)
 	}
 }
 
+bool
+MediaThreadPool::Conflicts (int index, Media *media, const void *lane)
+{
+	/* mutex must be locked */
+	if (medias [index] != media)
+		return false;
+	return lane == NULL || lanes [index] == NULL || lanes [index] == lane;
+}
+
+bool
+MediaThreadPool::IsLaneThread (const void *lane)
+{
+	bool result = false;
+	mutex.Lock();
+	for (int i = 0; i < count; i++) {
+		if (MoonThread::IsThread (threads [i])) {
+			result = lanes [i] == lane;
+			break;
+		}
+	}
+	mutex.Unlock();
+	return result;
+}
+
 bool
 MediaThreadPool::IsThreadPoolThread ()
 {
@@ -2805,25 +3005,39 @@ MediaThreadPool::WorkerLoop (void *data)
 		
 		medias [self_index] = NULL;
 		deployments [self_index] = NULL;
+		lanes [self_index] = NULL;
 		/* if anybody was waiting for us to finish working, notify them */
-		if (media != NULL)
+		if (media != NULL) {
 			completed_condition.Signal();
+			/* we may have been blocking work in another lane of the same media
+			 * which an idle thread can pick up now */
+			if (queue != NULL && !queue->IsEmpty ())
+				condition.Signal();
+		}
 
 		media = NULL;		
 		node = (MediaWork *) (queue != NULL ? queue->First () : NULL);
 		
 		while (node != NULL) {
+			const void *lane = node->closure->GetLane ();
 			media = node->closure->GetMedia ();
 			
 			for (int i = 0; i < count; i++) {
-				if (medias [i] == media) {
-					// another thread is working for the same media object.
+				if (Conflicts (i, media, lane)) {
+					// another thread is working for the same media object (and lane).
 					// we need to find something else to do.
 					media = NULL;
 					break;
 				}
 			}
 			
+			// work for the same media (and lane) enqueued before this node must execute first
+			for (MediaWork *prev = (MediaWork *) queue->First (); media != NULL && prev != node; prev = (MediaWork *) prev->next) {
+				const void *prev_lane = prev->closure->GetLane ();
+				if (prev->closure->GetMedia () == media && (lane == NULL || prev_lane == NULL || prev_lane == lane))
+					media = NULL;
+			}
+			
 			if (media != NULL)
 				break;
 			
@@ -2838,6 +3052,7 @@ MediaThreadPool::WorkerLoop (void *data)
 		
 		if (node != NULL) {
 			medias [self_index] = media;
+			lanes [self_index] = node->closure->GetLane ();
 			/* At this point the current deployment might be wrong, so avoid
 			 * the warnings in GetDeployment. Do not move the call to SetCurrenDeployment
 			 * here, since it might end up doing a lot of work with the mutex
@@ -2854,7 +3069,9 @@ MediaThreadPool::WorkerLoop (void *data)
 
 		LOG_PIPELINE_EX ("MediaThreadLoop::WorkerLoop () %p: got %s %p for media %p on deployment %p, there are %d nodes left.\n", MoonThread::Self(), node->closure->GetDescription (), node, media, media->GetDeployment (), queue ? queue->Length () : -1);
 		
+		MOON_TRACE_BEGIN ("media", node->closure->GetDescription ());
 		node->closure->Call ();
+		MOON_TRACE_END ("media", node->closure->GetDescription ());
 		
 		LOG_PIPELINE_EX ("MediaThreadLoop::WorkerLoop () %p: processed node %p\n", MoonThread::Self(), node);
 		
@@ -2866,6 +3083,7 @@ MediaThreadPool::WorkerLoop (void *data)
 	mutex.Lock();
 	deployments [self_index] = NULL;
 	medias [self_index] = NULL;
+	lanes [self_index] = NULL;
 	/* if anybody was waiting for us to finish working, notify them */
 	if (media != NULL)
 		completed_condition.Signal();
@@ -2901,6 +3119,7 @@ MediaClosure::Init (Media *media, MediaCallback *callback, EventObject *context)
 {
 	result = MEDIA_INVALID;
 	description = NULL;
+	lane = NULL;
 	this->callback = callback;
 	this->context = context;
 	if (this->context)
@@ -3076,6 +3295,10 @@ MediaReportDecodeFrameCompletedClosure::MediaReportDecodeFrameCompletedClosure (
 void
 MediaReportDecodeFrameCompletedClosure::Dispose ()
 {
+	/* dropped without being delivered (the media seeked, or was disposed) */
+	if (!CallExecuted () && GetDecoder () != NULL)
+		GetDecoder ()->EndPendingResult (false);
+
 	if (frame) {
 		frame->unref ();
 		frame = NULL;
@@ -3134,6 +3357,18 @@ IMediaStream::Dispose ()
 	codec = NULL;
 
 	ClearQueue ();
+
+	Media *media = GetMediaReffed ();
+	if (media != NULL) {
+		MediaFramePoolStats stats;
+		frame_pool.GetStats (&stats);
+		LOG_PIPELINE ("IMediaStream::Dispose (): %s frame pool: %" G_GUINT64_FORMAT " allocations, %" G_GUINT64_FORMAT " reuses, %" G_GUINT64_FORMAT " trims, %" G_GUINT64_FORMAT " peak bytes\n",
+			GetTypeName (), stats.allocations, stats.reuses, stats.trims, stats.peak_bytes);
+		media->GetLog ()->AddFramePoolStats (&stats);
+		media->unref ();
+	}
+	frame_pool.Trim ();
+
 	IMediaObject::Dispose ();
 }
 
@@ -4440,6 +4675,188 @@ IMediaDemuxer::GetStream (int index)
 	return (index < 0 || index >= stream_count) ? NULL : streams [index];
 }
 
+/*
+ * MediaFramePool
+ */
+
+#define FRAME_POOL_CLASS_COUNT 80 /* 4 classes per power of two, from 4KB to 2GB */
+
+static gint frame_pool_enabled = -1; /* -1 until the environment has been checked */
+
+bool
+MediaFramePool::IsEnabled ()
+{
+	gint enabled = g_atomic_int_get (&frame_pool_enabled);
+
+	if (enabled == -1) {
+		const char *env = g_getenv ("MOONLIGHT_FRAME_POOL");
+
+		enabled = env == NULL || strcmp (env, "0") != 0;
+		g_atomic_int_set (&frame_pool_enabled, enabled);
+	}
+
+	return enabled;
+}
+
+void
+MediaFramePool::SetEnabled (bool value)
+{
+	g_atomic_int_set (&frame_pool_enabled, value);
+}
+
+MediaFramePool::MediaFramePool ()
+{
+	classes = NULL;
+	class_count = 0;
+	operations = 0;
+	bytes = 0;
+	memset (&stats, 0, sizeof (stats));
+}
+
+MediaFramePool::~MediaFramePool ()
+{
+	if (classes == NULL)
+		return;
+
+	for (guint32 i = 0; i < class_count; i++) {
+		for (guint32 k = 0; k < classes [i].count; k++)
+			free (classes [i].buffers [k]);
+		g_free (classes [i].buffers);
+	}
+	g_free (classes);
+}
+
+guint32
+MediaFramePool::GetClass (guint32 size)
+{
+	/* the smallest 2^k * (4 + j) / 4 (0 <= j < 4) which is >= size */
+	guint32 n = size - 1;
+	guint32 k = g_bit_storage (n) - 1;
+	guint32 j = n >> (k - 2);
+
+	return (k - 11) * 4 + (j - 4);
+}
+
+guint32
+MediaFramePool::GetClassSize (guint32 index)
+{
+	guint32 k = index / 4 + 11;
+	guint32 j = index % 4 + 4;
+
+	return (j + 1) << (k - 2);
+}
+
+guint8 *
+MediaFramePool::Allocate (guint32 size, guint32 *pooled_size)
+{
+	guint8 *result = NULL;
+	SizeClass *sc;
+	guint32 index;
+
+	*pooled_size = 0;
+
+	if (!CanPool (size, 0))
+		return NULL;
+
+	index = GetClass (size);
+
+	mutex.Lock ();
+
+	if (classes == NULL) {
+		class_count = FRAME_POOL_CLASS_COUNT;
+		classes = g_new0 (SizeClass, class_count);
+	}
+
+	sc = &classes [index];
+	if (sc->count > 0) {
+		result = sc->buffers [--sc->count];
+		stats.reuses++;
+	} else if (posix_memalign ((void **) &result, MAX_ALIGNMENT, GetClassSize (index)) == 0) {
+		bytes += GetClassSize (index);
+		stats.allocations++;
+		stats.peak_bytes = MAX (stats.peak_bytes, bytes);
+	} else {
+		result = NULL;
+	}
+
+	if (result != NULL) {
+		*pooled_size = GetClassSize (index);
+		sc->in_use++;
+		sc->high_water = MAX (sc->high_water, sc->in_use);
+	}
+
+	if (++operations >= TRIM_INTERVAL)
+		TrimLocked ();
+
+	mutex.Unlock ();
+
+	return result;
+}
+
+void
+MediaFramePool::Release (guint8 *buffer, guint32 pooled_size)
+{
+	SizeClass *sc;
+
+	g_return_if_fail (buffer != NULL);
+	g_return_if_fail (pooled_size != 0 && GetClassSize (GetClass (pooled_size)) == pooled_size);
+
+	mutex.Lock ();
+
+	sc = &classes [GetClass (pooled_size)];
+	sc->in_use--;
+
+	if (sc->count == sc->capacity) {
+		sc->capacity = MAX (4, sc->capacity * 2);
+		sc->buffers = g_renew (guint8 *, sc->buffers, sc->capacity);
+	}
+	sc->buffers [sc->count++] = buffer;
+
+	if (++operations >= TRIM_INTERVAL)
+		TrimLocked ();
+
+	mutex.Unlock ();
+}
+
+void
+MediaFramePool::TrimLocked ()
+{
+	/* mutex must be locked */
+	for (guint32 i = 0; i < class_count; i++) {
+		SizeClass *sc = &classes [i];
+		/* keep enough free buffers to get back to the high-water mark of the last interval */
+		guint32 keep = sc->high_water - sc->in_use;
+		while (sc->count > keep) {
+			free (sc->buffers [--sc->count]);
+			bytes -= GetClassSize (i);
+			stats.trims++;
+		}
+		sc->high_water = sc->in_use;
+	}
+	operations = 0;
+}
+
+void
+MediaFramePool::Trim ()
+{
+	mutex.Lock ();
+	for (guint32 i = 0; i < class_count; i++)
+		classes [i].high_water = classes [i].in_use;
+	TrimLocked ();
+	mutex.Unlock ();
+}
+
+void
+MediaFramePool::GetStats (MediaFramePoolStats *stats)
+{
+	mutex.Lock ();
+	*stats = this->stats;
+	stats->in_use = 0;
+	for (guint32 i = 0; i < class_count; i++)
+		stats->in_use += classes [i].in_use;
+	mutex.Unlock ();
+}
+
 /*
  * MediaFrame
  */ 
@@ -4496,11 +4913,14 @@ MediaFrame::AllocateBuffer (guint32 size, guint32 alignment)
 	g_return_val_if_fail (stream != NULL, false);
 
 	buflen = size;
-	if (alignment == 0 || Media::IsMSCodecs1Installed ()) {
+	if (!Media::IsMSCodecs1Installed () && MediaFramePool::IsEnabled () && MediaFramePool::CanPool (buflen + stream->GetMinPadding (), alignment)) {
+		buffer = stream->GetFramePool ()->Allocate (buflen + stream->GetMinPadding (), &pooled_size);
+		RemoveState (MediaFramePosixAlloc);
+	} else if (alignment == 0 || Media::IsMSCodecs1Installed ()) {
 		buffer = (guint8 *) g_try_malloc (buflen + stream->GetMinPadding ());
 		RemoveState (MediaFramePosixAlloc);
 	} else {
-		if (posix_memalign ((void **) &buffer, alignment, size) != 0) {
+		if (posix_memalign ((void **) &buffer, alignment, size + stream->GetMinPadding ()) != 0) {
 			stream->ReportErrorOccurred ("Moonlight: could not allcoate memory for next frame");
 			return false;
 		}
@@ -4516,10 +4936,40 @@ MediaFrame::AllocateBuffer (guint32 size, guint32 alignment)
 	return true;
 }
 
+void
+MediaFrame::ReleaseMapping ()
+{
+	if (mapping != NULL) {
+		mapping->unref ();
+		mapping = NULL;
+	}
+}
+
+void
+MediaFrame::SetBuffer (guint8 *value)
+{
+	if (value == buffer)
+		return;
+
+	if (pooled_size != 0 && buffer != NULL) {
+		stream->GetFramePool ()->Release (buffer, pooled_size);
+		pooled_size = 0;
+	}
+
+	ReleaseMapping ();
+	buffer = value;
+}
+
 void
 MediaFrame::FreeBuffer ()
 {
-	if ((state & MediaFramePosixAlloc) == MediaFramePosixAlloc) {
+	if (mapping != NULL) {
+		/* the buffer points into the mapping, there's nothing to free */
+		ReleaseMapping ();
+	} else if (pooled_size != 0) {
+		stream->GetFramePool ()->Release (buffer, pooled_size);
+		pooled_size = 0;
+	} else if ((state & MediaFramePosixAlloc) == MediaFramePosixAlloc) {
 		free (buffer);
 	} else {
 		g_free (buffer);
@@ -4537,13 +4987,56 @@ MediaFrame::FetchData (guint32 size, void *data)
 	return true;
 }
 
+bool
+MediaFrame::FetchData (guint32 size, MemoryBuffer *source)
+{
+	IMediaDecoder *decoder;
+
+	g_return_val_if_fail (buffer == NULL, false);
+	g_return_val_if_fail (stream != NULL, false);
+
+	if (source->GetRemainingSize () < size) {
+		stream->ReportErrorOccurred ("Moonlight: not enough data for the current frame");
+		return false;
+	}
+
+	decoder = stream->GetDecoder ();
+
+	/* The decoder may read up to min_padding bytes past the end of the frame, and those bytes
+	 * must be zero (ffmpeg's bitstream readers rely on it). In the file they're the start of the
+	 * next frame, so only frames of streams without padding can point into the mapping. */
+	if (source->GetMapping () != NULL && decoder != NULL && decoder->CanUseMappedFrames () && !Media::IsMSCodecs1Installed () &&
+	    stream->GetMinPadding () == 0) {
+		mapping = source->GetMapping ();
+		mapping->ref ();
+		buffer = (guint8 *) source->GetCurrentPtr ();
+		buflen = size;
+		source->SeekOffset (size);
+		return true;
+	}
+
+	if (!AllocateBuffer (size))
+		return false;
+
+	return source->Read (buffer, size);
+}
+
 bool
 MediaFrame::PrependData (guint32 size, void *data)
 {
 	g_return_val_if_fail (buffer != NULL, false);
 	g_return_val_if_fail (stream != NULL, false);
 
-	buffer = (guint8 *) g_realloc (buffer, buflen + stream->GetMinPadding () + size);
+	if (pooled_size == 0 && mapping == NULL) {
+		buffer = (guint8 *) g_realloc (buffer, buflen + stream->GetMinPadding () + size);
+	} else if (mapping != NULL || pooled_size < buflen + stream->GetMinPadding () + size) {
+		/* pooled and mapped buffers can't be realloc'ed, move the data into a malloc'ed buffer */
+		guint8 *copy = (guint8 *) g_try_malloc (buflen + stream->GetMinPadding () + size);
+		if (copy != NULL)
+			memcpy (copy, buffer, buflen);
+		FreeBuffer ();
+		buffer = copy;
+	}
 	if (buffer == NULL) {
 		stream->ReportErrorOccurred ("Moonlight: Could not realloacte memory for current frame");
 		return false;
@@ -4567,6 +5060,8 @@ MediaFrame::Initialize ()
 	
 	buffer = NULL;
 	buflen = 0;
+	pooled_size = 0;
+	mapping = NULL;
 	state = 0;
 	event = 0;
 	
@@ -4613,8 +5108,12 @@ MediaFrame::Dispose ()
 		if (decoder != NULL)
 			decoder->Cleanup (this);
 	}
-	g_free (buffer);
-	buffer = NULL;
+	if (stream != NULL) {
+		FreeBuffer ();
+	} else {
+		g_free (buffer);
+		buffer = NULL;
+	}
 	if (marker) {
 		marker->unref ();
 		marker = NULL;
@@ -5013,6 +5512,39 @@ IMediaSource::ReadFD (FILE *read_fd, MediaReadClosure *closure)
 	media->unref ();
 }
 
+bool
+IMediaSource::ReadMapping (MediaMapping *mapping, MediaReadClosure *closure)
+{
+	Media *media;
+	MemoryBuffer *mem;
+	gint64 count;
+
+	VERIFY_MEDIA_THREAD;
+
+	if (mapping == NULL || closure->GetOffset () > mapping->GetLength ())
+		return false;
+
+	LOG_PIPELINE ("IMediaSource::ReadMapping (%p, %p offset: %" G_GINT64_FORMAT " count: %" G_GUINT32_FORMAT ")\n", mapping, closure, closure->GetOffset (), closure->GetCount ());
+
+	media = GetMediaReffed ();
+	if (media == NULL) {
+		/* We're most likely disposed */
+		LOG_PIPELINE ("IMediaSource::ReadMapping (): no media, disposed?\n");
+		return true;
+	}
+
+	count = MIN ((gint64) closure->GetCount (), mapping->GetLength () - closure->GetOffset ());
+	mem = new MemoryBuffer (media, mapping, closure->GetOffset (), (gint32) count);
+	closure->SetData (mem);
+	mem->unref ();
+
+	media->EnqueueWork (closure);
+
+	media->unref ();
+
+	return true;
+}
+
 void
 IMediaSource::ReadAsync (MediaReadClosure *closure)
 {
@@ -5103,6 +5635,7 @@ IMediaDecoder::IMediaDecoder (Type::Kind kind, Media *media, IMediaStream *strea
 	opening = false;
 	opened = false;
 	input_ended = false;
+	pending_results = 0;
 }
 
 void
@@ -5147,10 +5680,23 @@ IMediaDecoder::ReportDecodeFrameCompletedCallback (MediaClosure *closure)
 	g_return_val_if_fail (c->GetDecoder () != NULL, MEDIA_FAIL);
 
 	c->GetDecoder ()->ReportDecodeFrameCompleted (c->GetFrame ());
+	c->GetDecoder ()->EndPendingResult (true);
 	
 	return MEDIA_SUCCESS;
 }
 
+/*
+ * A marshalled frame was delivered (on the media thread), or dropped with
+ * the rest of the media's work (on any thread). If it was the last pending
+ * result of a decoder whose input has ended, the decoder can drain now.
+ */
+void
+IMediaDecoder::EndPendingResult (bool delivered)
+{
+	if (g_atomic_int_dec_and_test (&pending_results) && delivered && input_ended && IsDecoderQueueEmpty ())
+		InputEnded ();
+}
+
 void
 IMediaDecoder::ReportDecodeFrameCompleted (MediaFrame *frame)
 {
@@ -5167,7 +5713,8 @@ IMediaDecoder::ReportDecodeFrameCompleted (MediaFrame *frame)
 	g_return_if_fail (media != NULL);
 	
 	if (!Media::InMediaThread ()) {
-		LOG_PIPELINE ("IMediaDecoder::ReportOpenDecoderCompleted (): Not in media thread, marshalling...\n");
+		LOG_PIPELINE ("IMediaDecoder::ReportDecodeFrameCompleted (): Not in media thread, marshalling...\n");
+		g_atomic_int_inc (&pending_results);
 		MediaClosure *closure = new MediaReportDecodeFrameCompletedClosure (media, ReportDecodeFrameCompletedCallback, this, frame);
 		media->EnqueueWork (closure);
 		closure->unref ();
@@ -5220,11 +5767,39 @@ MediaResult
 IMediaDecoder::DecodeFrameCallback (MediaClosure *closure)
 {
 	IMediaDecoder *decoder = (IMediaDecoder *) closure->GetContext ();
-	IMediaDecoder::FrameNode *node = (IMediaDecoder::FrameNode *) decoder->queue.Pop ();
-	
-	if (node != NULL) {
-		decoder->DecodeFrameAsync (node->frame, false);
-		delete node;
+	IMediaDecoder::FrameNode *node;
+	
+	if (closure->GetLane () != NULL) {
+		/* the frame stays pending until the frames it decodes to have been
+		 * marshalled, so that the media thread never sees an empty decoder
+		 * in between */
+		decoder->queue.Lock ();
+		node = (IMediaDecoder::FrameNode *) decoder->queue.LinkedList ()->First ();
+		if (node != NULL) {
+			decoder->queue.LinkedList ()->Unlink (node);
+			g_atomic_int_inc (&decoder->pending_results);
+		}
+		decoder->queue.Unlock ();
+
+		if (node != NULL) {
+			/* DecodeFrameAsync would marshal us back to the exclusive media thread */
+			if (!decoder->IsDisposed ()) {
+				MOON_TRACE_BEGIN ("decode", decoder->GetTypeName ());
+				decoder->DecodeFrameAsyncInternal (node->frame);
+				MOON_TRACE_END ("decode", decoder->GetTypeName ());
+			}
+			/* the frames it decoded to (if any) are pending now, and are
+			 * delivered in an exclusive closure, which can't execute before
+			 * this one is done */
+			g_atomic_int_add (&decoder->pending_results, -1);
+			delete node;
+		}
+	} else {
+		node = (IMediaDecoder::FrameNode *) decoder->queue.Pop ();
+		if (node != NULL) {
+			decoder->DecodeFrameAsync (node->frame, false);
+			delete node;
+		}
 	}
 
 	return MEDIA_SUCCESS;
@@ -5246,15 +5821,19 @@ IMediaDecoder::DecodeFrameAsync (MediaFrame *frame, bool enqueue_always)
 	
 	g_return_if_fail (media != NULL);
 	
-	if (enqueue_always || !Media::InMediaThread ()) {
+	if (enqueue_always || !Media::InMediaThread () || CanDecodeConcurrently ()) {
 		MediaClosure *closure = new MediaClosure (media, DecodeFrameCallback, this, "IMediaDecoder::DecodeFrameCallback");
+		if (CanDecodeConcurrently ())
+			closure->SetLane (this);
 		queue.Push (new FrameNode (frame));
 		media->EnqueueWork (closure);
 		closure->unref ();
 		goto cleanup;
 	}
 	
+	MOON_TRACE_BEGIN ("decode", GetTypeName ());
 	DecodeFrameAsyncInternal (frame);
+	MOON_TRACE_END ("decode", GetTypeName ());
 
 cleanup:
 	media->unref ();
@@ -5574,6 +6153,13 @@ PassThroughDecoder::OpenDecoderAsyncInternal ()
 
 void
 PassThroughDecoder::DecodeFrameAsyncInternal (MediaFrame *frame)
+{
+	DecodeFrame (frame);
+	ReportDecodeFrameCompleted (frame);
+}
+
+void
+PassThroughDecoder::DecodeFrame (MediaFrame *frame)
 {
 	frame->AddState (MediaFrameDecoded);
 	if (GetPixelFormat () == MoonPixelFormatYUV420P) {
@@ -5585,14 +6171,13 @@ PassThroughDecoder::DecodeFrameAsyncInternal (MediaFrame *frame)
 		frame->data_stride [0] = frame->GetBuffer ();
 		frame->data_stride [1] = frame->GetBuffer () + (frame->width*frame->height);
 		frame->data_stride [2] = frame->GetBuffer () + (frame->width*frame->height)+(frame->width/2*frame->height/2);
-		frame->SetBuffer (NULL);
+		/* The planes point into the buffer, which the frame keeps (and frees or returns to the pool) */
 		frame->srcStride[0] = frame->width;
 		frame->srcSlideY = frame->width;
 		frame->srcSlideH = frame->height;
 
 		frame->AddState (MediaFramePlanar);
 	}
-	ReportDecodeFrameCompleted (frame);
 }
 
 void
@@ -71,6 +71,7 @@ class ProgressiveSource;
 class MediaMarkerFoundClosure;
 class Playlist;
 class MemoryBuffer;
+class MediaMapping;
 class MediaLog;
 
 /* @CBindingRequisite */
@@ -150,6 +151,72 @@ public:
 	guint64 GetFirstNotInRange (guint64 offset, guint64 length);
 };
 
+/*
+ * MediaFramePool: recycles the (large) buffers of the frames of a stream.
+ *
+ * Buffers are grouped in size classes (4 per power of two), and returned
+ * buffers are kept for reuse by later frames of the same class. Every
+ * TRIM_INTERVAL operations the free buffers above the high-water mark of the
+ * buffers in use during the last interval are freed, so that the pool shrinks
+ * when the working set does (after a resolution change for instance).
+ * All buffers are aligned to MAX_ALIGNMENT bytes and can be freed with free ().
+ * Thread-safe.
+ */
+struct MediaFramePoolStats {
+	guint64 allocations; // buffers allocated from the system
+	guint64 reuses; // buffers handed out again from the pool
+	guint64 trims; // free buffers released back to the system
+	guint64 peak_bytes; // the maximum number of bytes in buffers (used or free) at any time
+	guint64 in_use; // buffers handed out and not released yet
+};
+
+class MediaFramePool {
+public:
+	static const guint32 MIN_SIZE = 4096; // smaller buffers aren't worth pooling
+	static const guint32 MAX_ALIGNMENT = 64;
+	static const guint32 TRIM_INTERVAL = 256;
+
+	MediaFramePool ();
+	~MediaFramePool ();
+
+	// Returns a buffer of at least 'size' bytes, or NULL if out of memory or if
+	// the size can't be pooled. The size of the buffer is stored in 'pooled_size',
+	// which must be passed back to Release.
+	guint8 *Allocate (guint32 size, guint32 *pooled_size);
+	void Release (guint8 *buffer, guint32 pooled_size);
+	// Frees all the buffers not in use.
+	void Trim ();
+
+	void GetStats (MediaFramePoolStats *stats);
+
+	static bool CanPool (guint32 size, guint32 alignment) { return size >= MIN_SIZE && size <= G_MAXUINT32 / 2 && alignment <= MAX_ALIGNMENT; }
+	// Whether frames take their buffers from the pools of their streams,
+	// MOONLIGHT_FRAME_POOL=0 turns it off. Buffers already handed out are
+	// still returned to their pool.
+	static bool IsEnabled ();
+	static void SetEnabled (bool value);
+
+private:
+	struct SizeClass {
+		guint8 **buffers; // the free buffers
+		guint32 count;
+		guint32 capacity;
+		guint32 in_use;
+		guint32 high_water; // the maximum value of in_use during the current trim interval
+	};
+
+	MoonMutex mutex;
+	SizeClass *classes;
+	guint32 class_count;
+	guint32 operations;
+	guint64 bytes; // in buffers currently allocated from the system
+	MediaFramePoolStats stats;
+
+	static guint32 GetClass (guint32 size);
+	static guint32 GetClassSize (guint32 index);
+	void TrimLocked ();
+};
+
 /*
  * MediaClosure: 
  */ 
@@ -161,6 +228,7 @@ private:
 	Media *media;
 	EventObject *context; // The property of whoever creates the closure.
 	const char *description;
+	const void *lane;
 	void Init (Media *media, MediaCallback *callback, EventObject *context);
 	
 protected:
@@ -184,6 +252,16 @@ public:
 	EventObject *GetContext () { return context; }
 	const char *GetDescription () { return description != NULL ? description : GetTypeName (); }
 
+	// By default a closure has exclusive access to its media: no other closure
+	// for the same media executes at the same time. Closures with a lane
+	// (any non-NULL value identifying an object which can work independently
+	// of the rest of the pipeline, such as a decoder) may execute concurrently
+	// with closures in other lanes of the same media. Closures in the same lane
+	// (and all closures with respect to exclusive closures) still execute in
+	// the order they were enqueued.
+	void SetLane (const void *value) { lane = value; }
+	const void *GetLane () { return lane; }
+
 	class Node : public List::Node {
 	public:
 		MediaClosure *closure;
@@ -486,6 +564,7 @@ private:
 	List demuxed_queue; // Our queue of demuxed frames
 	List decoded_queue; // Our queue of decoded frames
 	IMediaDecoder *decoder;
+	MediaFramePool frame_pool;
 
 	void *extra_data;
 	gint32 extra_data_size;
@@ -569,6 +648,7 @@ public:
 	void SetIndex (gint32 value) { index = value; }
 
 	gint32 GetMinPadding () { return min_padding; }
+	MediaFramePool *GetFramePool () { return &frame_pool; }
 	void SetMinPadding (gint32 value) { min_padding = MAX (min_padding, value); }
 
 	/* @GenerateCBinding */
@@ -830,10 +910,13 @@ private:
 	static bool valid [max_threads]; // specifies which thread indices are valid.
 	static Media *medias [max_threads]; // array of medias currently being worked on (indices corresponds to the threads array). Only one media can be worked on at the same time.
 	static Deployment *deployments [max_threads]; // array of deployments currently being worked on.
+	static const void *lanes [max_threads]; // the lane of the closure each thread is executing (NULL if exclusive).
 	static bool shutting_down; // flag telling if we're shutting down (in which case no new threads should be created) - it's also used to check if we've been shut down already (i.e. it's not set to false when the shutdown has finished).
 	static List *queue;
 	
 	static void *WorkerLoop (void *data);
+	// checks if a closure for the specified media and lane can't execute while thread 'index' is working
+	static bool Conflicts (int index, Media *media, const void *lane);
 	
 public:
 	// Removes all enqueued work for the specified media.
@@ -849,6 +932,9 @@ public:
 
 	// this method checks if the current thread is a thread-pool thread
 	static bool IsThreadPoolThread ();
+	// checks if the current thread is a thread-pool thread executing a closure in the specified lane
+	// (NULL for closures with exclusive access to their media)
+	static bool IsLaneThread (const void *lane);
 };
  
 class MediaFrame : public EventObject {
@@ -860,8 +946,11 @@ private:
 	guint32 generation;
 	guint64 duration;
 	guint16 state; // Current state of the frame
+	guint32 pooled_size; // if non-0 the buffer belongs to the stream's frame pool
+	MediaMapping *mapping; // if non-NULL the buffer points into this (read-only) file mapping
 
 	void Initialize ();
+	void ReleaseMapping ();
 	
 protected:
 	virtual ~MediaFrame ();
@@ -921,6 +1010,9 @@ public:
 
 	/* Allocates the buffer and reads 'size' bytes from data into it. Reports any errors and returns false in case of errors. */
 	bool FetchData (guint32 size, void *data);
+	/* Reads 'size' bytes from the memory buffer into the frame. If the memory buffer references a file mapping
+	 * and the decoder can use it, the frame points into the mapping instead of copying the data. */
+	bool FetchData (guint32 size, MemoryBuffer *source);
 	/* Creates a new buffer which is 'size' bytes bigger, copies 'data' into it and then the previous buffer after that */
 	bool PrependData (guint32 size, void *data);
 
@@ -936,8 +1028,9 @@ public:
 	void SetBufLen (guint32 value) { buflen = value; }
 	/* @GeneratePInvoke */
 	guint8* GetBuffer () { return buffer; }
+	/* Replaces the buffer. A pooled or mapped buffer is released, any other buffer is left to the caller. */
 	/* @GenerateCBinding */
-	void SetBuffer (guint8 *value) { buffer = value; }
+	void SetBuffer (guint8 *value);
 	/* @GenerateCBinding */
 	guint64 GetPts () { return pts; }
 	/* @GenerateCBinding */
@@ -1148,7 +1241,14 @@ private:
 	MoonPixelFormat pixel_format; // The pixel format this codec outputs. Open () should fill this in.
 	IMediaStream *stream;
 	Queue queue; // the list of frames to decode.
+	// Frames taken off the queue by a lane which is still decoding them, and
+	// decoded frames marshalled to the media thread which haven't been
+	// delivered yet. The input hasn't ended for the decoder until both the
+	// queue and this are empty.
+	gint pending_results;
 		
+	void EndPendingResult (bool delivered);
+
 	static MediaResult DecodeFrameCallback (MediaClosure *closure);
 	static MediaResult ReportOpenDecoderCompletedCallback (MediaClosure *closure);
 	static MediaResult ReportDecodeFrameCompletedCallback (MediaClosure *closure);
@@ -1184,11 +1284,23 @@ protected:
 	// InputEnded is called when there is no more input. If the codec has delayed frames,
 	// it must call ReportDecodeFrameCompleted with those frames (all of them).
 	virtual void InputEnded () { };
+
+	// Decoders which return true here have DecodeFrameAsyncInternal executed in
+	// their own lane of the media thread pool, concurrently with the decoders of
+	// other streams of the same media (demuxing and everything else is still
+	// serialized). DecodeFrameAsyncInternal must then only touch the decoder's
+	// own state, results are marshalled back by ReportDecodeFrameCompleted.
+	virtual bool CanDecodeConcurrently () { return false; }
 	
 public:
 	/* @SkipFactories */
 	IMediaDecoder (Type::Kind kind, Media *media, IMediaStream *stream);
 	virtual void Dispose ();
+
+	// Decoders which only read the encoded data (and free it with MediaFrame::FreeBuffer
+	// or replace it with MediaFrame::SetBuffer) can be given frames pointing directly
+	// into read-only file mappings, if the stream doesn't need zeroed padding after them.
+	virtual bool CanUseMappedFrames () { return false; }
 	
 	// If MediaFrame->decoder_specific_data is non-NULL, this method is called in ~MediaFrame.
 	virtual void Cleanup (MediaFrame *frame) {}
@@ -1216,7 +1328,9 @@ public:
 	MoonPixelFormat GetPixelFormat () { return pixel_format; }
 	IMediaStream *GetStream () { return stream; }	
 	
-	bool IsDecoderQueueEmpty () { return queue.IsEmpty (); }
+	bool IsDecoderQueueEmpty () { return queue.IsEmpty () && g_atomic_int_get (&pending_results) == 0; }
+
+	friend class MediaReportDecodeFrameCompletedClosure;
 };
 
 
@@ -1266,6 +1380,10 @@ protected:
 	virtual void ReadAsyncInternal (MediaReadClosure *closure) = 0;
 	
 	void ReadFD (FILE *read_fd, MediaReadClosure *closure);
+	// Serves the read from the mapping without copying, reads are cut short
+	// at the end of the mapping. Returns false (and does nothing) if the read
+	// starts past the end of the mapping.
+	bool ReadMapping (MediaMapping *mapping, MediaReadClosure *closure);
 	
 public:
 	/* @SkipFactories */
@@ -1324,7 +1442,9 @@ public:
 class FileSource : public IMediaSource {
 private:
 	gint64 size;
+	gint64 position; /* only used when reading from the mapping */
 	FILE *fd;
+	MediaMapping *mapping; /* NULL if the file couldn't be mapped */
 	char *filename;
 
 protected:
@@ -1358,6 +1478,10 @@ private:
 	// handlers, one for reading and one for writing.
 	FILE *write_fd;
 	FILE *read_fd;
+	// Downloaded ranges are read from a mapping of the temporary file, which is
+	// replaced by a bigger one when needed (buffers keep older mappings alive). Media thread only.
+	MediaMapping *mapping;
+	gint64 read_position; /* Media thread only */
 	char *filename;
 	Uri *uri;
 	Uri *resource_base;
@@ -1414,6 +1538,13 @@ public:
 	virtual void Dispose ();
 
 	virtual bool Eof ();
+	// Whether the whole file has been downloaded
+	bool IsDownloadComplete ();
+	// Whether @length bytes at @offset have been downloaded (reading them won't wait for the network)
+	bool IsRangeDownloaded (guint64 offset, guint64 length);
+	// Whether @read_position is at the end of a complete download of @size bytes (-1 if the
+	// size is unknown) into @fd
+	static bool IsEof (gint64 read_position, gint64 size, FILE *fd);
 		
 	virtual MediaResult Initialize (); 
 	
@@ -1427,12 +1558,40 @@ public:
 /*
  * MemoryBuffer
  */
+/*
+ * MediaMapping: a read-only, reference counted mmap of a file. MemoryBuffers
+ * and MediaFrames point directly into the mapped pages and keep the mapping
+ * alive, so a source can drop or replace its mapping at any time.
+ */
+class MediaMapping {
+private:
+	gint32 refcount;
+	guint8 *data;
+	gint64 length;
+
+	MediaMapping (guint8 *data, gint64 length);
+	~MediaMapping ();
+
+public:
+	// Maps the first 'length' bytes of the file, returns NULL if the file can't
+	// be mapped. Pages past the current end of the file must not be touched
+	// until they've been written.
+	static MediaMapping *Create (int fd, gint64 length);
+
+	void ref ();
+	void unref ();
+
+	guint8 *GetData () { return data; }
+	gint64 GetLength () { return length; }
+};
+
 class MemoryBuffer : public IMediaObject {
 private:
 	void *memory;
 	gint32 size;
 	gint32 pos;
 	bool owner;
+	MediaMapping *mapping;
 
 protected:
 	virtual ~MemoryBuffer ();
@@ -1440,6 +1599,10 @@ protected:
 public:
 	/* @SkipFactories */
 	MemoryBuffer (Media *media, void *memory, gint32 size, bool owner);
+	/* @SkipFactories */
+	MemoryBuffer (Media *media, MediaMapping *mapping, gint64 offset, gint32 size);
+
+	MediaMapping *GetMapping () { return mapping; }
 
 	void *GetCurrentPtr () { return pos + (guint8 *) memory; }
 	gint64 GetSize () { return size; }
@@ -1931,6 +2094,10 @@ protected:
 public:
 	PassThroughDecoder (Media *media, IMediaStream *stream);
 	virtual void Dispose ();
+	virtual bool CanUseMappedFrames () { return true; }
+
+	/* Marks the frame as decoded, pointing the planes of YV12 frames into the frame's buffer */
+	void DecodeFrame (MediaFrame *frame);
 };
 
 class PassThroughDecoderInfo : public DecoderInfo {
@@ -58,6 +58,9 @@ PlaylistEntry::PlaylistEntry (Playlist *root, PlaylistEntry *parent)
 	this->root = root;
 	media = NULL;
 	opened = false;
+	preopened = false;
+	preopen_error = NULL;
+	queued_audio = NULL;
 
 	current_node = NULL;
 
@@ -98,6 +101,13 @@ PlaylistEntry::Dispose ()
 		params = NULL;
 	}
 
+	if (preopen_error != NULL) {
+		preopen_error->unref ();
+		preopen_error = NULL;
+	}
+
+	DiscardQueuedAudio ();
+
 	delete full_source_name;
 	full_source_name = NULL;
 
@@ -274,6 +284,163 @@ PlaylistEntry::OpenMediaPlayer ()
 	mplayer->Open (media, this);
 	
 	root->Emit (Playlist::OpenCompletedEvent, NULL);
+
+	if (preopened) {
+		preopened = false;
+		/* We didn't forward the buffering progress while the previous entry was playing */
+		if (media->GetBufferingProgress () > 0.0)
+			root->Emit (Playlist::BufferingProgressChangedEvent, new ProgressEventArgs (media->GetBufferingProgress (), 0.0));
+	}
+
+	if (media->GetDownloadProgress () >= 1.0)
+		OpenNextInAdvance ();
+}
+
+PlaylistEntry *
+PlaylistEntry::GetNextEntryLeaf ()
+{
+	PlaylistEntry *entry = this;
+	PlaylistNode *node = NULL;
+
+	/* Find the closest ancestor with an entry after its current one */
+	while (node == NULL && entry->parent != NULL) {
+		entry = entry->parent;
+		if (entry->GetIsDynamic ())
+			return NULL; /* the server decides what comes next */
+		node = entry->current_node != NULL ? (PlaylistNode *) entry->current_node->next : NULL;
+	}
+
+	/* skipping elements with a zero duration like PlayNext does */
+	while (node != NULL) {
+		entry = node->GetElement ();
+		if (!entry->HasDuration () || !entry->GetDuration ()->HasTimeSpan () || entry->GetDuration ()->GetTimeSpan () != 0)
+			break;
+		node = (PlaylistNode *) node->next;
+	}
+
+	/* Nested playlists are opened when we get to them */
+	if (node == NULL || entry->IsPlaylist ())
+		return NULL;
+
+	return entry;
+}
+
+void
+PlaylistEntry::OpenNextInAdvance ()
+{
+	MediaElement *element = GetElement ();
+	PlaylistEntry *next;
+
+	if (element == NULL || is_live)
+		return;
+
+	next = GetNextEntryLeaf ();
+
+	/* Entry refs and live entries are left alone, they may be playlists or streams themselves */
+	if (next == NULL || next->media != NULL || next->GetIsEntryRef () || next->GetIsLive () || next->GetFullSourceName () == NULL)
+		return;
+
+	LOG_PLAYLIST ("PlaylistEntry::OpenNextInAdvance () id: %i opening %i (%s)\n", GET_OBJ_ID (this), GET_OBJ_ID (next), next->GetFullSourceName ()->GetOriginalString ());
+
+	next->preopened = true;
+	next->InitializeWithUri (element->GetResourceBase (), next->GetFullSourceName ());
+}
+
+void
+PlaylistEntry::Prebuffer ()
+{
+	MediaElement *element = GetElement ();
+	IMediaDemuxer *demuxer;
+	AudioStream *audio = NULL;
+	VideoStream *video = NULL;
+
+	if (element == NULL || media == NULL)
+		return;
+
+	demuxer = media->GetDemuxerReffed ();
+	if (demuxer == NULL)
+		return;
+
+	/* Select the streams MediaPlayer::Open will select, so that they're buffered once we get there */
+	MediaPlayer::FindStreams (demuxer, element->GetAudioStreamIndex (), &audio, &video, NULL);
+
+	LOG_PLAYLIST ("PlaylistEntry::Prebuffer () id: %i audio: %i video: %i\n", GET_OBJ_ID (this), GET_OBJ_ID (audio), GET_OBJ_ID (video));
+
+	if (audio != NULL) {
+		MediaPlayer *mplayer = GetMediaPlayer ();
+		AudioSource *current = mplayer != NULL ? mplayer->GetAudio () : NULL;
+
+		audio->SetSelected (true);
+		if (current != NULL) {
+			QueueAudio (current, audio);
+			current->unref ();
+		}
+	}
+	if (video != NULL)
+		video->SetSelected (true);
+
+	media->SetBufferingTime (element->GetBufferingTime ());
+	demuxer->FillBuffers ();
+	demuxer->unref ();
+}
+
+void
+PlaylistEntry::QueueAudio (AudioSource *current, AudioStream *stream)
+{
+	MediaPlayer *mplayer = GetMediaPlayer ();
+
+	if (mplayer == NULL || queued_audio != NULL)
+		return;
+
+	queued_audio = AudioPlayer::Add (mplayer, stream);
+	if (queued_audio == NULL)
+		return;
+
+	/* The media player is still playing the current entry */
+	queued_audio->SetFlag (AudioQueued, true);
+
+	if (!AudioPlayer::QueueNext (current, queued_audio)) {
+		LOG_PLAYLIST ("PlaylistEntry::QueueAudio () id: %i the audio player can't queue sources, the audio starts when the media player plays it.\n", GET_OBJ_ID (this));
+		DiscardQueuedAudio ();
+	}
+}
+
+AudioSource *
+PlaylistEntry::TakeQueuedAudio (AudioStream *stream)
+{
+	AudioSource *result = queued_audio;
+	AudioStream *queued_stream;
+
+	if (result == NULL)
+		return NULL;
+
+	queued_stream = result->GetStreamReffed ();
+	if (queued_stream != stream) {
+		DiscardQueuedAudio ();
+		result = NULL;
+	} else {
+		queued_audio = NULL;
+		result->SetFlag (AudioQueued, false);
+	}
+
+	if (queued_stream != NULL)
+		queued_stream->unref ();
+
+	return result;
+}
+
+void
+PlaylistEntry::DiscardQueuedAudio ()
+{
+	AudioSource *audio = queued_audio;
+
+	if (audio == NULL)
+		return;
+
+	queued_audio = NULL;
+	AudioPlayer::Remove (audio);
+	audio->Dispose ();
+	audio->unref ();
 }
 
 void
@@ -302,10 +469,12 @@ PlaylistEntry::OpenCompletedHandler (Media *media, EventArgs *args)
 
 		opened = true;
 
-		if (parent == NULL || parent->GetCurrentEntry () == this) {
+		if (IsCurrent ()) {
 			OpenMediaPlayer ();
 		} else {
 			LOG_PLAYLIST ("PlaylistEntry::OpenCompletedHandler (%p = %i, %p): id: %i opened entry in advance, waiting for current entry to finish.\n", media, GET_OBJ_ID (media), args, GET_OBJ_ID (this));
+			if (preopened)
+				Prebuffer ();
 		}
 	} else {
 		// check for too many nested playlists
@@ -336,6 +505,12 @@ PlaylistEntry::OpenCompletedHandler (Media *media, EventArgs *args)
 		}
 
 		opened = true;
+
+		if (!IsCurrent ()) {
+			/* A preopened entry turned out to be a playlist, PlayNext opens its elements once we get there */
+			return;
+		}
+
 		Open (); // open any nested elements
 	}
 }
@@ -347,7 +522,7 @@ PlaylistEntry::SeekingHandler (Media *media, EventArgs *args)
 	
 	LOG_PLAYLIST ("PlaylistEntry::SeekingHandler (%p, %p)\n", media, args);
 
-	if (root == NULL)
+	if (root == NULL || (preopened && !IsCurrent ()))
 		return;
 	
 	if (args)
@@ -362,7 +537,7 @@ PlaylistEntry::SeekCompletedHandler (Media *media, EventArgs *args)
 	
 	LOG_PLAYLIST ("PlaylistEntry::SeekCompletedHandler (%p, %p)\n", media, args);
 
-	if (root == NULL)
+	if (root == NULL || (preopened && !IsCurrent ()))
 		return;
 
 	if (args)
@@ -381,6 +556,16 @@ PlaylistEntry::MediaErrorHandler (Media *media, ErrorEventArgs *args)
 {
 	LOG_PLAYLIST ("PlaylistEntry::MediaErrorHandler (%p, %p): %s '%s'\n", media, args, GetFullSourceName () != NULL ? GetFullSourceName ()->GetOriginalString () : NULL, args ? args->GetErrorMessage() : "?");
 
+	if (preopened && !IsCurrent ()) {
+		/* Don't interrupt the current entry, Open reports it */
+		if (preopen_error == NULL && args != NULL) {
+			args->ref ();
+			preopen_error = args;
+		}
+		DiscardQueuedAudio ();
+		return;
+	}
+
 	OnEntryFailed (args);
 }
 
@@ -406,6 +591,9 @@ PlaylistEntry::DownloadProgressChangedHandler (Media *media, EventArgs *args)
 		return;
 	}
 
+	if (opened && args && ((ProgressEventArgs *) args)->progress >= 1.0)
+		OpenNextInAdvance ();
+
 	if (args)
 		args->ref ();
 	root->Emit (Playlist::DownloadProgressChangedEvent, args);
@@ -420,6 +608,9 @@ PlaylistEntry::BufferingProgressChangedHandler (Media *media, EventArgs *args)
 	
 	if (root == NULL)
 		return; // this might happen if the media is still buffering and we're in the process of getting cleaned up
+
+	if (preopened && !IsCurrent ())
+		return; // OpenMediaPlayer reports it once we're current
 	
 	if (args)
 		args->ref ();
@@ -746,6 +937,15 @@ PlaylistEntry::Open ()
 
 	LOG_PLAYLIST ("PlaylistEntry::Open () id: %i media = %p entries: %i FullSourceName = %s\n", GET_OBJ_ID (this), media, entries.Length (), GetFullSourceName () != NULL ? GetFullSourceName ()->GetOriginalString () : NULL);
 
+	if (preopen_error != NULL) {
+		ErrorEventArgs *args = preopen_error;
+		preopen_error = NULL;
+		preopened = false;
+		OnEntryFailed (args);
+		args->unref ();
+		return;
+	}
+
 	if (entries.Length () == 0) {
 		if (!media) {
 			if (GetFullSourceName () == NULL) {
@@ -755,10 +955,14 @@ PlaylistEntry::Open ()
 			InitializeWithUri (GetElement ()->GetResourceBase (), GetFullSourceName ());
 		} else if (opened) {
 			OpenMediaPlayer ();
+		} else if (preopened) {
+			LOG_PLAYLIST ("PlaylistEntry::Open () id: %i still opening in advance, OpenCompletedHandler opens the media player.\n", GET_OBJ_ID (this));
 		} else {
 			media->OpenAsync ();
 		}
 	} else {
+		preopened = false;
+
 		current_node = (PlaylistNode *) entries.First ();
 		current_entry = current_node->GetElement ();
 
@@ -840,7 +1044,7 @@ PlaylistEntry::PlayNext ()
 		return false;
 	}
 
-	if (!current_entry->IsPlaylist ()) {
+	if (!current_entry->IsPlaylist () || current_entry->preopened) {
 		LOG_PLAYLIST ("PlaylistEntry::PlayNext () %i playing next entry: %i\n", GET_OBJ_ID (this), GET_OBJ_ID (current_entry));
 		GetElement ()->SetPlayRequested ();
 		root->Emit (Playlist::EntryChangedEvent);
@@ -22,6 +22,8 @@
 
 namespace Moonlight {
 
+class AudioSource;
+
 class PlaylistKind {
 public:
 	enum Kind {
@@ -98,6 +100,9 @@ private:
 	Playlist *root;
 	Media *media;
 	bool opened; // if OpenCompleted event has been received
+	bool preopened; // if the media was opened while the previous entry was playing
+	ErrorEventArgs *preopen_error; // an error raised while preopened, reported once we're current
+	AudioSource *queued_audio; // started by the audio player when the current entry's audio ends
 
 	List entries; // list of child elements
 	PlaylistNode *current_node; // current node
@@ -107,6 +112,8 @@ private:
 	bool dynamic_waiting; /* if we finished playing what we have in the playlist, and are waiting for more playlist entries */
 
 	void OpenMediaPlayer ();
+	void Prebuffer ();
+	void DiscardQueuedAudio ();
 
 	void EmitMediaEnded ();
 	bool HasMediaSource ();
@@ -242,6 +249,20 @@ public:
 	bool IsASXDemuxer ();
 	bool IsCurrent ();
 
+	// Opens the entry after the current one (if it's a plain media entry)
+	// and fills its buffers, so that PlayNext doesn't have to wait for it.
+	void OpenNextInAdvance ();
+	/* the entry PlayNext plays after this one, NULL if there is none, it is a nested playlist or the server decides */
+	PlaylistEntry *GetNextEntryLeaf ();
+	bool GetIsPreopened () { return preopened; }
+	bool HasPreopenError () { return preopen_error != NULL; }
+	// Creates the audio source of the (preopened) stream and queues it to start on
+	// the sample after current's last one, so that there's no gap between the entries.
+	void QueueAudio (AudioSource *current, AudioStream *stream);
+	// Returns the queued audio source if it plays stream (MediaPlayer::Open takes it
+	// over instead of creating a new one), NULL otherwise.
+	AudioSource *TakeQueuedAudio (AudioStream *stream);
+
 #if DEBUG
 	void Dump (int tabs, bool is_current, GString *fmt, bool html);
 #endif
@@ -48,6 +48,14 @@ Region::~Region ()
 	cairo_region = NULL;
 }
 
+void
+Region::Clear ()
+{
+	cairo_rectangle_int_t empty = { 0, 0, 0, 0 };
+
+	status = cairo_region_intersect_rectangle (cairo_region, &empty);
+}
+
 bool
 Region::IsEmpty ()
 {
@@ -31,6 +31,8 @@ public:
 	~Region ();
 
 	bool IsEmpty ();
+	// Empties the region, without reallocating it.
+	void Clear ();
 
 	void Union (Rect rect);
 	void Union (Region *region);
@@ -2721,12 +2721,10 @@ RichTextBoxView::SetTextBox (RichTextBox *textbox)
 void
 RichTextBoxView::DocumentChanged (TextElement *onElement)
 {
-	// for now just relayout the entire RTB.  in the future, bump
-	// up to onElement's parent Paragraph and just relayout that
-	// paragraph.
-
-	layout->ResetState();
-	GetChildren()->Clear(); // FIXME: pretty sure we need to ElementRemoved for all the children here.
+	// onElement has bumped the content version of the blocks it is
+	// in, so only those get laid out again, the lines of the others
+	// are just moved.
+	layout->ContentChanged ();
 	InvalidateMeasure ();
 	UpdateBounds (true);
 }
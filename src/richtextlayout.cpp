@@ -1000,6 +1000,7 @@ RichTextLayout::RichTextLayout ()
 	actual_height = NAN;
 	actual_width = NAN;
 	lines = g_ptr_array_new ();
+	block_lines = g_array_new (false, false, sizeof (RichTextLayoutBlock));
 	is_wrapped = true;
 	blocks = NULL;
 }
@@ -1008,6 +1009,7 @@ RichTextLayout::~RichTextLayout ()
 {
 	ClearLines ();
 	g_ptr_array_free (lines, true);
+	g_array_free (block_lines, true);
 }
 
 void
@@ -1017,10 +1019,21 @@ RichTextLayout::ClearLines ()
 		delete (RichTextLayoutLine *) lines->pdata[i];
 	
 	g_ptr_array_set_size (lines, 0);
+	g_array_set_size (block_lines, 0);
 }
 
 void
 RichTextLayout::ResetState ()
+{
+	actual_height = NAN;
+	actual_width = NAN;
+
+	// forget which lines belong to which block, so that none are reused
+	g_array_set_size (block_lines, 0);
+}
+
+void
+RichTextLayout::ContentChanged ()
 {
 	actual_height = NAN;
 	actual_width = NAN;
@@ -1257,20 +1270,111 @@ RichTextLayout::GetLocationFromXY (const Point &offset, double x, double y)
 void
 RichTextLayout::Layout (RichTextBoxView *rtbview)
 {
+	RichTextLayoutBlock **reuse = NULL;
+	GPtrArray *old_lines;
+	GArray *old_blocks;
+	GHashTable *cached;
+	bool *keep;
+	int count;
+	
 	if (!isnan (actual_width))
 		return;
 	
 	actual_height = 0.0;
 	actual_width = 0.0;
 	is_wrapped = false;
-	ClearLines ();
 	
 	d(printf ("RichTextLayout::Layout(): wrap mode = %s, wrapping to %f pixels\n", wrap_modes[wrapping], max_width));
 
-	if (blocks) {
-		for (int i = 0; i < blocks->GetCount(); i ++)
-			LayoutBlock (rtbview, blocks->GetValueAt(i)->AsBlock());
+	old_lines = lines;
+	old_blocks = block_lines;
+	lines = g_ptr_array_new ();
+	block_lines = g_array_new (false, false, sizeof (RichTextLayoutBlock));
+	count = blocks ? blocks->GetCount () : 0;
+
+	// find the blocks which haven't changed since they were laid out
+	// at this width, their lines are only moved.
+	cached = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (guint i = 0; i < old_blocks->len; i++) {
+		RichTextLayoutBlock *block = &g_array_index (old_blocks, RichTextLayoutBlock, i);
+
+		if (block->max_width == max_width)
+			g_hash_table_insert (cached, block->block, block);
 	}
+
+	keep = g_new0 (bool, old_lines->len);
+	if (count > 0)
+		reuse = g_new0 (RichTextLayoutBlock *, count);
+
+	for (int i = 0; i < count; i++) {
+		Block *b = blocks->GetValueAt (i)->AsBlock ();
+		RichTextLayoutBlock *block = (RichTextLayoutBlock *) g_hash_table_lookup (cached, b);
+
+		if (block == NULL || block->version != b->GetContentVersion ())
+			continue;
+
+		for (guint j = block->first; j < block->first + block->count; j++)
+			keep[j] = true;
+		reuse[i] = block;
+	}
+
+	g_hash_table_destroy (cached);
+
+	// drop the lines of the other blocks before laying anything out,
+	// so that the UIElements of the InlineUIContainers which are still
+	// in the document get added back
+	for (guint i = 0; i < old_lines->len; i++) {
+		RichTextLayoutLine *line = (RichTextLayoutLine *) old_lines->pdata[i];
+
+		if (keep[i])
+			continue;
+
+		for (guint j = 0; j < line->inlines->len; j++) {
+			UIElement *ui = ((RichTextLayoutInline *) line->inlines->pdata[j])->GetUIElement ();
+
+			if (ui && ui->GetVisualParent () == rtbview)
+				rtbview->GetChildren()->Remove (Value (ui));
+		}
+
+		delete line;
+	}
+
+	for (int i = 0; i < count; i++) {
+		Block *b = blocks->GetValueAt (i)->AsBlock ();
+		RichTextLayoutBlock block;
+
+		block.block = b;
+		block.version = b->GetContentVersion ();
+		block.max_width = max_width;
+		block.first = lines->len;
+
+		if (reuse[i]) {
+			for (guint j = reuse[i]->first; j < reuse[i]->first + reuse[i]->count; j++) {
+				RichTextLayoutLine *line = (RichTextLayoutLine *) old_lines->pdata[j];
+
+				line->SetY (actual_height);
+				AddLine (line);
+			}
+
+			block.wrapped = reuse[i]->wrapped;
+			is_wrapped = is_wrapped || block.wrapped;
+		} else {
+			bool was_wrapped = is_wrapped;
+
+			is_wrapped = false;
+			LayoutBlock (rtbview, b);
+			block.wrapped = is_wrapped;
+			is_wrapped = is_wrapped || was_wrapped;
+		}
+
+		block.count = lines->len - block.first;
+		g_array_append_val (block_lines, block);
+	}
+
+	g_ptr_array_free (old_lines, true);
+	g_array_free (old_blocks, true);
+	g_free (reuse);
+	g_free (keep);
 }
 
 const char*
@@ -1544,48 +1648,84 @@ RichTextLayout::AddLine (RichTextLayoutLine *line)
 }
 
 
+// Returns the index of the first line whose bottom is below @y (relative
+// to the top of the first line), or lines->len if there's none.
+int
+RichTextLayout::GetLineIndexFromY (double y)
+{
+	guint lo = 0, hi = lines->len;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+		RichTextLayoutLine *line = (RichTextLayoutLine *) lines->pdata[mid];
+
+		if (y < line->y + line->size.height)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+// Returns the index of the first line which starts at or after @tp, or
+// lines->len if there's none.
+int
+RichTextLayout::GetLineIndexFromPointer (const TextPointer& tp)
+{
+	guint lo = 0, hi = lines->len;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+		RichTextLayoutLine *line = (RichTextLayoutLine *) lines->pdata[mid];
+
+		if (tp.CompareTo_np (line->start) <= 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
 RichTextLayoutLine *
 RichTextLayout::GetLineFromY (const Point &offset, double y, int *index)
 {
-	RichTextLayoutLine *line = NULL;
-	double y0, y1;
-	
-	y0 = offset.y;
+	int i = GetLineIndexFromY (y - offset.y);
 
-	for (guint i = 0; i < lines->len; i++) {
-		line = (RichTextLayoutLine *) lines->pdata[i];
+	if (i == (int) lines->len)
+		return NULL;
 
-		// set y1 the top of the next line
-		y1 = y0 + line->size.height;
-		
-		if (y < y1) {
-			// we found the line that the point is located on
-			if (index)
-				*index = (int) i;
-			
-			return line;
-		}
-		
-		y0 = y1;
-	}
-	
-	return NULL;
+	if (index)
+		*index = i;
+
+	return (RichTextLayoutLine *) lines->pdata[i];
 }
 
 void
 RichTextLayout::Render (cairo_t *cr, const Point &origin, const Point &offset)
 {
 	RichTextLayoutLine *line;
-	double x, y;
-	
-	y = offset.y;
-	
-	for (guint i = 0; i < lines->len; i++) {
+	double x1, y1, x2, y2;
+	double x;
+	guint i;
+
+	// only render the lines within the clip, and the lines right
+	// above and below it in case their glyphs reach into it
+	cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+
+	i = GetLineIndexFromY (y1 - offset.y);
+	if (i > 0)
+		i--;
+
+	for (; i < lines->len; i++) {
 		line = (RichTextLayoutLine *) lines->pdata[i];
-		
+
 		x = offset.x + HorizontalAlignment (line->size.width);
-		line->Render (cr, origin, x, y);
-		y += line->size.height;
+		line->Render (cr, origin, x, offset.y + line->y);
+
+		if (offset.y + line->y >= y2)
+			break;
 	}
 	
 	if (moonlight_flags & RUNTIME_INIT_SHOW_TEXTBOXES) {
@@ -1605,8 +1745,16 @@ Rect
 RichTextLayout::GetCursor (const Point &offset, const TextPointer& tp)
 {
 	Rect r (offset, Size (1.0, 0.0));
+	guint first;
+
+	// lines don't overlap, so the cursor is either at the end of (or
+	// within) the line before the first one starting at or after it,
+	// or at the start of that one
+	first = GetLineIndexFromPointer (tp);
+	if (first > 0)
+		first--;
 
-	for (guint i = 0; i < lines->len; i ++) {
+	for (guint i = first; i < lines->len && i <= first + 1; i ++) {
 		RichTextLayoutLine *line = (RichTextLayoutLine*)lines->pdata[i];
 
 		int start_compare, end_compare;
@@ -1891,6 +2039,29 @@ RichTextLayoutLine::GetLocationFromX (const Point &offset, double x)
 	}
 }
 
+void
+RichTextLayoutLine::SetY (double new_y)
+{
+	double dy = new_y - y;
+
+	if (dy == 0.0)
+		return;
+
+	y = new_y;
+
+	for (guint i = 0; i < inlines->len; i++) {
+		RichTextLayoutInline *inline_ = (RichTextLayoutInline *) inlines->pdata[i];
+		UIElement *ui = inline_->GetUIElement ();
+
+		inline_->position.y += dy;
+
+		if (ui) {
+			MoonError error;
+			ui->ArrangeWithError (Rect (inline_->position, inline_->size), &error);
+		}
+	}
+}
+
 void
 RichTextLayoutLine::AddInline (RichTextLayoutInline *inline_)
 {
@@ -42,13 +42,16 @@ public:
 
 	void AddInline (RichTextLayoutInline *inline_);
 
+	// moves the line (and its inlines) to @y
+	void SetY (double y);
+
 	TextPointer start;
 	TextPointer end;
 
 	RichTextLayout *layout;
 	GPtrArray *inlines;
 	double descend;
-	double y;
+	double y; // the sum of the heights of the lines above, lines are looked up by it
 	Size size;
 };
 
@@ -71,6 +74,8 @@ public:
 	virtual int GetIndexByXOffset (double xoffset) { return 0; }
 	virtual double GetXOffsetByIndex (int index) { return 0.0; }
 
+	virtual UIElement *GetUIElement () { return NULL; }
+
 	TextLayoutAttributes *attrs;
 	RichTextLayoutLine *line;
 	TextPointer start;
@@ -123,9 +128,21 @@ public:
 
 	virtual ~RichTextLayoutInlineUIElement () {}
 
+	virtual UIElement *GetUIElement () { return uielement; }
+
 	UIElement *uielement;
 };
 
+// the lines a block was laid out to, and what they depend on
+struct RichTextLayoutBlock {
+	Block *block; // only compared, never dereferenced
+	guint32 version;
+	double max_width;
+	guint first; // the index of its first line in RichTextLayout::lines
+	guint count;
+	bool wrapped;
+};
+
 class RichTextLayout {
  public:
 	TextPointer selection_start;
@@ -144,6 +161,7 @@ class RichTextLayout {
 	double actual_height;
 	double actual_width;
 	GPtrArray *lines;
+	GArray *block_lines; // RichTextLayoutBlock, in the order of the blocks
 	
 	void ClearCache ();
 	void ClearLines ();
@@ -182,6 +200,10 @@ class RichTextLayout {
 	void Render (cairo_t *cr, const Point &origin, const Point &offset);
 	void Select (TextSelection *selection);
 	void ResetState ();
+	// Like ResetState, but the next Layout only lays out again the
+	// blocks whose content version changed, and moves the lines of
+	// the others.
+	void ContentChanged ();
 
 
 	const char* AddWordsToLine (RichTextLayoutLine *line, TextLayoutAttributes *attrs, const char *inptr, const char *inend, TextPointer start, TextPointer end, TextPointer *endpoint);
@@ -206,6 +228,10 @@ class RichTextLayout {
 	Rect GetRenderExtents ();
 
 	void AddLine (RichTextLayoutLine *line);
+
+	// binary searches of the lines, by their top and by their start
+	int GetLineIndexFromY (double y);
+	int GetLineIndexFromPointer (const TextPointer& tp);
 };
 
 };
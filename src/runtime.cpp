@@ -75,6 +75,7 @@
 #endif
 
 #include "pipeline.h"
+#include "image-decoder.h"
 #include "context.h"
 
 namespace Moonlight {
@@ -85,7 +86,6 @@ namespace Moonlight {
 
 #define CAIRO_CLIP 0
 #define TIME_CLIP 0
-#define TIME_REDRAW 1
 
 #define NO_EVENT_ID -1
 
@@ -130,6 +130,7 @@ static MoonlightRuntimeOption options [] = {
 	{ RUNTIME_INIT_AUDIO_ALSA,            "alsa",              "yes",        "no" },
 	{ RUNTIME_INIT_AUDIO_OPENSLES,        "opensles",          "yes",        "no" },
 	{ RUNTIME_INIT_AUDIO_ALSA_RW,         "alsa-rw",           "yes",        "no" },
+	{ RUNTIME_INIT_AUDIO_MIXER,           "audio-mixer",       "yes",        "no" },
 	{ RUNTIME_INIT_USE_IDLE_HINT,         "idlehint",          "yes",        "no" },
 	{ RUNTIME_INIT_KEEP_MEDIA,            "keepmedia",         "yes",        "no",     true,            "Don't remove media files from /tmp after download" },
 	{ RUNTIME_INIT_ALL_IMAGE_FORMATS,     "allimages",         "yes",        "no" },
@@ -424,6 +425,8 @@ Surface::Surface (MoonWindow *window)
 	expose_handoff = NULL;
 	expose_handoff_data = NULL;
 	expose_handoff_last_timespan = G_MAXINT64; 
+
+	frame_timings = NULL;
 	
 	enable_redraw_regions = false;
 	
@@ -435,8 +438,8 @@ Surface::Surface (MoonWindow *window)
 	debug_selected_element = NULL;
 #endif
 
-	up_dirty = new DirtyLists (true);
-	down_dirty = new DirtyLists (false);
+	up_dirty = new DirtyLists (false);
+	down_dirty = new DirtyLists (true);
 	
 	surface_list = g_list_append (surface_list, this);
 
@@ -912,6 +915,11 @@ Surface::Paint (Context *ctx, Region *region, bool transparent, bool clear_trans
 
 	frames++;
 
+	MOON_TRACE_SCOPE ("render", "Surface::Paint");
+
+	TimeSpan paint_start = frame_timings ? get_now () : 0;
+	TimeSpan front_to_back_time = 0;
+
 #if OCCLUSION_CULLING_STATS
 	uielements_rendered_with_occlusion_culling = 0;
 	uielements_rendered_with_painters = 0;
@@ -935,11 +943,16 @@ Surface::Paint (Context *ctx, Region *region, bool transparent, bool clear_trans
 	if (moonlight_flags & RUNTIME_INIT_OCCLUSION_CULLING) {
 		Region *copy = new Region (region);
 
+		MOON_TRACE_BEGIN ("render", "Surface::FrontToBack");
 		for (int i = layer_count - 1; i >= 0; i --) {
 			UIElement *layer = layers->GetValueAt (i)->AsUIElement ();
 
 			layer->FrontToBack (copy, render_list);
 		}
+		MOON_TRACE_END ("render", "Surface::FrontToBack");
+
+		if (frame_timings)
+			front_to_back_time = get_now () - paint_start;
 
 		if (!render_list->IsEmpty ()) {
 			if (!copy->IsEmpty())
@@ -1007,6 +1020,11 @@ Surface::Paint (Context *ctx, Region *region, bool transparent, bool clear_trans
 
 	delete render_list;
 
+	if (frame_timings) {
+		frame_timings->front_to_back += front_to_back_time;
+		frame_timings->render += get_now () - paint_start - front_to_back_time;
+	}
+
 	// GetDeployment()->EnableToggleRefs ();
 	// mono_gc_enable ();
 
@@ -1609,8 +1627,8 @@ Surface::render_cb (EventObject *sender, EventArgs *calldata, gpointer closure)
 	GDK_THREADS_ENTER ();
 #endif
 	if (s->zombie) {
-		s->up_dirty->Clear (true);
-		s->down_dirty->Clear (true);
+		s->up_dirty->Clear ();
+		s->down_dirty->Clear ();
 	} else {
 		dirty = s->ProcessDirtyElements ();
 	}
@@ -1725,6 +1743,8 @@ RenderNode::Render (Context *ctx)
 {
 	bool use_occlusion_culling = uielement->UseOcclusionCulling ();
 
+	MOON_TRACE_SCOPE ("render", MoonTrace::IsEnabled () ? uielement->GetTypeName () : NULL);
+
 #if OCCLUSION_CULLING_STATS
 	if (use_occlusion_culling)
 		uielements_rendered_with_occlusion_culling ++;
@@ -2858,6 +2878,8 @@ Runtime::Init (const char *platform_dir, RuntimeInitFlag flags, bool out_of_brow
 	
 	inited = true;
 
+	MoonTrace::Initialize ();
+
 // FIXME: We have glib in the darwin pal:
 // 	#1: Why is this missing?
 // 	#2: Why is this not palized?
@@ -2962,6 +2984,7 @@ Runtime::Shutdown (void)
 		return;
 
 	Media::Shutdown ();
+	ImageDecoder::Shutdown ();
 	
 	inited = false;
 
@@ -2970,6 +2993,8 @@ Runtime::Shutdown (void)
 
 	delete messaging_service;
 	messaging_service = NULL;
+
+	MoonTrace::Shutdown ();
 }
 
 void
@@ -26,6 +26,7 @@
 #include "error.h"
 
 #include "pal.h"
+#include "trace.h"
 
 namespace Moonlight {
 
@@ -33,15 +34,7 @@ namespace Moonlight {
 
 #define OCCLUSION_CULLING_STATS 0
 
-#define TIMERS 0
 #define DEBUG_MARKER_KEY 0
-#if TIMERS
-#define STARTTIMER(id,str) TimeSpan id##_t_start = get_now(); printf ("timing of '%s' started at %" G_GINT64_FORMAT "\n", str, id##_t_start)
-#define ENDTIMER(id,str) TimeSpan id##_t_end = get_now(); printf ("timing of '%s' ended at %" G_GINT64_FORMAT " (%f seconds)\n", str, id##_t_end, (double)(id##_t_end - id##_t_start) / 10000000)
-#else
-#define STARTTIMER(id,str)
-#define ENDTIMER(id,str)
-#endif
 
 #if SANITY
 #define VERIFY_MAIN_THREAD \
@@ -69,6 +62,7 @@ enum RuntimeInitFlag {
 	RUNTIME_INIT_USE_UPDATE_POSITION   = 1 << 12,
 	RUNTIME_INIT_ALLOW_WINDOWLESS      = 1 << 13,
 	RUNTIME_INIT_AUDIO_ALSA_RW         = 1 << 14,
+	RUNTIME_INIT_AUDIO_MIXER           = 1 << 15,
 	RUNTIME_INIT_AUDIO_ALSA            = 1 << 16,
 	RUNTIME_INIT_AUDIO_PULSE           = 1 << 17,
 	RUNTIME_INIT_AUDIO_OPENSLES        = 1 << 18,
@@ -174,6 +168,16 @@ typedef void (* MoonlightFPSReportFunc) (Surface *surface, int nframes, float ns
 typedef void (* MoonlightCacheReportFunc) (Surface *surface, long size, void *user_data);
 typedef void (* MoonlightExposeHandoffFunc) (Surface *surface, TimeSpan time, void *user_data);
 
+// Time spent in each phase of the frames a surface processes, accumulated
+// only while a set of timings has been set with SetFrameTimings (the
+// headless benchmark harness in perf/ does this).
+struct SurfaceFrameTimings {
+	TimeSpan layout;	// UIElement::UpdateLayer (measure/arrange)
+	TimeSpan dirty;		// down and up dirty processing
+	TimeSpan front_to_back;	// building the occlusion culled render list
+	TimeSpan render;	// the rest of Surface::Paint
+};
+
 /* @Namespace=None,ManagedEvents=Manual */
 class MOON_API Surface : public EventObject {
 public:
@@ -296,6 +300,7 @@ public:
 
 	void SetCacheReportFunc (MoonlightCacheReportFunc report, void *user_data);
 	void SetExposeHandoffFunc (MoonlightExposeHandoffFunc func, void *user_data);
+	void SetFrameTimings (SurfaceFrameTimings *timings) { frame_timings = timings; }
 
 	bool VerifyWithCacheSizeCounter (int w, int h);
 	gint64 AddToCacheSizeCounter (int w, int h);
@@ -336,6 +341,8 @@ public:
 	void AddDirtyElement (UIElement *element, DirtyType dirt);
         bool UpdateLayout (MoonError *error);
 	void RemoveDirtyElement (UIElement *element);
+	// Moves a dirty element to the buckets of its current visual level.
+	void UpdateDirtyElementLevel (UIElement *element);
 	bool ProcessDirtyElements ();
 	void PropagateDirtyFlagToChildren (UIElement *element, DirtyType dirt);
 
@@ -471,6 +478,8 @@ private:
 	TimeSpan expose_handoff_last_timespan;
 	MoonlightExposeHandoffFunc expose_handoff;
 	void *expose_handoff_data;
+
+	SurfaceFrameTimings *frame_timings;
 	
 	void Realloc ();
 
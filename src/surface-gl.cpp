@@ -23,6 +23,8 @@ GLSurface::GLSurface ()
 	textureYUV[1] = 0;
 	textureYUV[2] = 0;
 	data          = NULL;
+	dirty         = Rect ();
+	tracked       = Rect ();
 }
 
 GLSurface::GLSurface (GLsizei width, GLsizei height)
@@ -34,6 +36,8 @@ GLSurface::GLSurface (GLsizei width, GLsizei height)
 	textureYUV[1] = 0;
 	textureYUV[2] = 0;
 	data          = NULL;
+	dirty         = Rect ();
+	tracked       = Rect ();
 }
 
 GLSurface::~GLSurface ()
@@ -55,11 +59,20 @@ GLSurface::Cairo ()
 
 	if (!data) {
 		data = (unsigned char *) g_malloc0 (stride * size[1]);
+		tracked = Rect ();
 
 		// derived class should implement read back of texture image
 		g_assert (texture == 0 && !IsPlanar ());
 	}
 
+	// anything cairo draws with the surface handed out has to be
+	// uploaded, only a draw announced with TrackDraw is smaller
+	if (tracked.IsEmpty ())
+		dirty = Rect (0, 0, size[0], size[1]);
+	else
+		dirty = dirty.Union (tracked);
+	tracked = Rect ();
+
 	return cairo_image_surface_create_for_data (data,
 						    CAIRO_FORMAT_ARGB32,
 						    size[0],
@@ -125,6 +138,25 @@ GLSurface::Height ()
 	return size[1];
 }
 
+void
+GLSurface::TrackDraw (Rect r)
+{
+	tracked = r.RoundOut ().Intersection (Rect (0, 0, size[0], size[1]));
+}
+
+unsigned char *
+GLSurface::TakeData (Rect *dirty)
+{
+	unsigned char *pixels = data;
+
+	*dirty = this->dirty;
+	this->dirty = Rect ();
+	tracked = Rect ();
+	data = NULL;
+
+	return pixels;
+}
+
 __GLFuncPtr
 GLSurface::GetProcAddress (const char *procname)
 {
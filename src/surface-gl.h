@@ -12,6 +12,7 @@
 #define __MOON_SURFACE_GL_H__
 
 #include "surface.h"
+#include "rect.h"
 
 #if defined(__APPLE__)
 #include <OpenGL/OpenGL.h>
@@ -44,6 +45,15 @@ public:
 	GLsizei Width ();
 	GLsizei Height ();
 
+	// Announces that cairo only draws in @r (in surface coordinates)
+	// with the surface Cairo hands out next. Without it, whatever Cairo
+	// hands out may draw anywhere and the whole surface is dirty.
+	void TrackDraw (Rect r);
+
+	// The pixels drawn with cairo which haven't been uploaded to the
+	// texture yet, the caller owns them and has to upload @dirty.
+	unsigned char *TakeData (Rect *dirty);
+
 	virtual __GLFuncPtr GetProcAddress (const char *procname);
 
 protected:
@@ -53,6 +63,8 @@ protected:
 	GLuint textureYUV[3];
 
 	unsigned char *data;
+	Rect          dirty;
+	Rect          tracked;
 };
 
 };
@@ -41,6 +41,9 @@ OpenGLSurface::Reshape (int width, int height)
 		g_free (data);
 		data = NULL;
 	}
+
+	dirty = Rect ();
+	tracked = Rect ();
 }
 
 cairo_surface_t *
@@ -71,7 +74,7 @@ OpenGLSurface::Texture ()
 	if (!texture)
 		glGenTextures (1, &texture);
 
-	if (name != texture || data) {
+	if (name != texture) {
 		glBindTexture (GL_TEXTURE_2D, texture);
 		glTexImage2D (GL_TEXTURE_2D,
 			      0,
@@ -84,10 +87,28 @@ OpenGLSurface::Texture ()
 			      data);
 		glBindTexture (GL_TEXTURE_2D, 0);
 	}
+	else if (data && !dirty.IsEmpty ()) {
+		// keep the storage, it's already the right size, and only
+		// upload what was drawn on
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, size[0]);
+		glBindTexture (GL_TEXTURE_2D, texture);
+		glTexSubImage2D (GL_TEXTURE_2D,
+				 0,
+				 dirty.x,
+				 dirty.y,
+				 dirty.width,
+				 dirty.height,
+				 GL_BGRA,
+				 GL_UNSIGNED_BYTE,
+				 data + ((int) dirty.y * size[0] + (int) dirty.x) * 4);
+		glBindTexture (GL_TEXTURE_2D, 0);
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	}
 
 	if (data) {
 		g_free (data);
 		data = NULL;
+		dirty = Rect ();
 	}
 
 	return texture;
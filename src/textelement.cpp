@@ -88,6 +88,9 @@ TextElement::NotifyLayoutContainerOnPropertyChanged (PropertyChangedEventArgs *a
 {
 	DependencyObject *el = this;
 	while (el) {
+		if (el->Is (Type::BLOCK))
+			((Block*)el)->ContentChanged ();
+
 		if (el->Is (Type::TEXTBLOCK)) {
 			((TextBlock*)el)->DocumentPropertyChanged (this, args);
 			return;
@@ -108,6 +111,9 @@ TextElement::NotifyLayoutContainerOnCollectionChanged (Collection *col, Collecti
 {
 	DependencyObject *el = this;
 	while (el) {
+		if (el->Is (Type::BLOCK))
+			((Block*)el)->ContentChanged ();
+
 		if (el->Is (Type::TEXTBLOCK)) {
 			((TextBlock*)el)->DocumentCollectionChanged (this, col, args);
 			return;
@@ -691,9 +697,18 @@ Run::CoerceText (DependencyObject *obj, DependencyProperty *p, const Value *valu
 // Block
 //
 
+static guint32 block_content_version = 0;
+
 Block::Block ()
 {
 	SetObjectType (Type::BLOCK);
+	content_version = ++block_content_version;
+}
+
+void
+Block::ContentChanged ()
+{
+	content_version = ++block_content_version;
 }
 
 void
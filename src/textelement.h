@@ -286,6 +286,8 @@ class Run : public Inline {
 
 /* @Namespace=System.Windows.Documents */
 class Block : public TextElement {
+	guint32 content_version;
+
  protected:
 	/* @GeneratePInvoke,ManagedAccess=Protected */
 	Block ();
@@ -309,6 +311,12 @@ class Block : public TextElement {
 	//
 	void SetTextAlignment (TextAlignment alignment);
 	TextAlignment GetTextAlignment ();
+
+	// Changes whenever the block or anything inside it changes. The
+	// versions are unique across blocks, so a layout which cached the
+	// lines of a block can't mistake a new block for it.
+	guint32 GetContentVersion () { return content_version; }
+	void ContentChanged ();
 };
 
 /* @Namespace=System.Windows.Documents */
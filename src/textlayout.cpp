@@ -273,6 +273,11 @@ TextLayout::TextLayout ()
 	text = NULL;
 	length = 0;
 	count = 0;
+	shaped = NULL;
+	shaped_serials = NULL;
+	n_shaped_serials = 0;
+	n_results = 0;
+	memset (&stats, 0, sizeof (stats));
 }
 
 TextLayout::~TextLayout ()
@@ -282,6 +287,8 @@ TextLayout::~TextLayout ()
 		delete attributes;
 	}
 	
+	ClearResults ();
+	ClearShaping ();
 	ClearLines ();
 	g_ptr_array_free (lines, true);
 	
@@ -302,6 +309,84 @@ TextLayout::ResetState ()
 {
 	actual_height = NAN;
 	actual_width = NAN;
+	
+	ClearResults ();
+}
+
+void
+TextLayout::SaveResult ()
+{
+	TextLayoutResult *result;
+	
+	if (isnan (actual_width))
+		return;
+	
+	if (n_results == TEXT_LAYOUT_MAX_RESULTS) {
+		// drop the least recently used result
+		result = &results[--n_results];
+		for (guint i = 0; i < result->lines->len; i++)
+			delete (TextLayoutLine *) result->lines->pdata[i];
+		g_ptr_array_free (result->lines, true);
+	}
+	
+	memmove (results + 1, results, sizeof (TextLayoutResult) * n_results);
+	n_results++;
+	
+	result = &results[0];
+	result->lines = lines;
+	result->max_width = max_width;
+	result->actual_height = actual_height;
+	result->actual_width = actual_width;
+	result->is_wrapped = is_wrapped;
+	result->count = count;
+	
+	lines = g_ptr_array_new ();
+}
+
+bool
+TextLayout::RestoreResult ()
+{
+	TextLayoutResult *result;
+	
+	for (int i = 0; i < n_results; i++) {
+		result = &results[i];
+		
+		if (result->max_width != max_width)
+			continue;
+		
+		ClearLines ();
+		g_ptr_array_free (lines, true);
+		
+		lines = result->lines;
+		actual_height = result->actual_height;
+		actual_width = result->actual_width;
+		is_wrapped = result->is_wrapped;
+		count = result->count;
+		
+		n_results--;
+		memmove (results + i, results + i + 1, sizeof (TextLayoutResult) * (n_results - i));
+		stats.restored++;
+		
+		return true;
+	}
+	
+	return false;
+}
+
+void
+TextLayout::ClearResults ()
+{
+	TextLayoutResult *result;
+	
+	for (int i = 0; i < n_results; i++) {
+		result = &results[i];
+		
+		for (guint j = 0; j < result->lines->len; j++)
+			delete (TextLayoutLine *) result->lines->pdata[j];
+		g_ptr_array_free (result->lines, true);
+	}
+	
+	n_results = 0;
 }
 
 void
@@ -419,9 +504,13 @@ TextLayout::SetMaxWidth (double width)
 		return false;
 	}
 	
+	// keep the current layout around, we might get asked for this width again
+	SaveResult ();
+	
 	max_width = width;
 	
-	ResetState ();
+	actual_height = NAN;
+	actual_width = NAN;
 	
 	return true;
 }
@@ -436,6 +525,7 @@ TextLayout::SetTextAttributes (List *attrs)
 	
 	attributes = attrs;
 	
+	ClearShaping ();
 	ResetState ();
 	
 	return true;
@@ -458,6 +548,7 @@ TextLayout::SetText (const char *str, int len)
 	
 	count = -1;
 	
+	ClearShaping ();
 	ResetState ();
 	
 	return true;
@@ -618,6 +709,9 @@ TextLayout::Select (int start, int length, bool byte_offsets)
 	
 	UpdateSelection (lines, &pre, &post);
 	
+	// the cached results of other widths still have the old selection
+	ClearResults ();
+	
 	selection_length = new_selection_length;
 	selection_start = new_selection_start;
 #else
@@ -668,11 +762,28 @@ enum WordType {
 	WORD_TYPE_HANGUL,
 };
 
+//
+// The width-independent part of the layout: everything we need to know
+// about a character to measure it and to find break opportunities. The
+// array is indexed by byte offset into the text, only the entries of the
+// first byte of each character are used.
+//
+struct TextLayoutShapedChar {
+	gunichar c;            // (gunichar) -1 for invalid sequences
+	guint8 n_bytes;
+	guint8 btype;          // GUnicodeBreakType
+	guint8 ctype;          // GUnicodeType
+	guint8 combining_class;
+	bool has_glyph;        // false if the font doesn't contain the glyph (or for line breaks)
+	double advance;        // advance of the glyph at the start of a line
+	double kerned_advance; // advance of the glyph following the previous glyph of the attribute run
+};
+
 struct WordBreakOpportunity {
+	const TextLayoutShapedChar *glyph;
 	GUnicodeBreakType btype;
 	const char *inptr;
 	double advance;
-	guint32 index;
 	gunichar c;
 	int count;
 };
@@ -686,9 +797,11 @@ struct LayoutWord {
 	// <input>
 	double line_advance;
 	TextFont *font;
+	const char *text;
+	const TextLayoutShapedChar *shaped;
 	
 	// <input/output>
-	GlyphInfo *prev;       // previous glyph; used for kerning
+	const TextLayoutShapedChar *prev; // previous glyph; used for kerning
 	
 	// <output>
 	double advance;        // the advance-width of the 'word'
@@ -722,12 +835,21 @@ IsLineBreak (const char *text, size_t left, size_t *n_bytes, size_t *n_chars)
 }
 
 static inline void
-layout_word_init (LayoutWord *word, double line_advance, GlyphInfo *prev)
+layout_word_init (LayoutWord *word, double line_advance, const TextLayoutShapedChar *prev)
 {
 	word->line_advance = line_advance;
 	word->prev = prev;
 }
 
+static inline gunichar
+shaped_getc (LayoutWord *word, const char **in, const TextLayoutShapedChar **sc)
+{
+	*sc = word->shaped + (*in - word->text);
+	*in += (*sc)->n_bytes;
+	
+	return (*sc)->c;
+}
+
 /**
  * layout_lwsp:
  * @word: #LayoutWord context
@@ -739,11 +861,11 @@ layout_word_init (LayoutWord *word, double line_advance, GlyphInfo *prev)
 static void
 layout_lwsp (LayoutWord *word, const char *in, const char *inend)
 {
-	GlyphInfo *prev = word->prev;
+	const TextLayoutShapedChar *prev = word->prev;
 	GUnicodeBreakType btype;
 	const char *inptr = in;
 	const char *start;
-	GlyphInfo *glyph;
+	const TextLayoutShapedChar *sc;
 	double advance;
 	gunichar c;
 	
@@ -754,7 +876,7 @@ layout_lwsp (LayoutWord *word, const char *in, const char *inend)
 	
 	while (inptr < inend) {
 		start = inptr;
-		if ((c = utf8_getc (&inptr, inend - inptr)) == (gunichar) -1) {
+		if ((c = shaped_getc (word, &inptr, &sc)) == (gunichar) -1) {
 			// ignore invalid chars
 			continue;
 		}
@@ -764,7 +886,7 @@ layout_lwsp (LayoutWord *word, const char *in, const char *inend)
 			break;
 		}
 		
-		btype = g_unichar_break_type (c);
+		btype = (GUnicodeBreakType) sc->btype;
 		if (!BreakSpace (c, btype)) {
 			inptr = start;
 			break;
@@ -783,24 +905,16 @@ layout_lwsp (LayoutWord *word, const char *in, const char *inend)
 		
 		word->count++;
 		
-		// treat tab as a single space
-		if (c == '\t')
-			c = ' ';
-		
-		// ignore glyphs the font doesn't contain...
-		if (!(glyph = word->font->GetGlyphInfo (c)))
+		// ignore glyphs the font doesn't contain (tabs are measured as a single space)...
+		if (!sc->has_glyph)
 			continue;
 		
 		// calculate total glyph advance
-		advance = glyph->metrics.horiAdvance;
-		if ((prev != NULL) && APPLY_KERNING (c))
-			advance += word->font->Kerning (prev, glyph);
-		else if (glyph->metrics.horiBearingX < 0)
-			advance -= glyph->metrics.horiBearingX;
+		advance = prev != NULL ? sc->kerned_advance : sc->advance;
 		
 		word->line_advance += advance;
 		word->advance += advance;
-		prev = glyph;
+		prev = sc;
 	}
 	
 	word->length = (inptr - in);
@@ -823,10 +937,10 @@ static bool
 layout_word_nowrap (LayoutWord *word, const char *in, const char *inend, double max_width)
 {
 	GUnicodeBreakType btype = G_UNICODE_BREAK_UNKNOWN;
-	GlyphInfo *prev = word->prev;
+	const TextLayoutShapedChar *prev = word->prev;
 	const char *inptr = in;
 	const char *start;
-	GlyphInfo *glyph;
+	const TextLayoutShapedChar *sc;
 	double advance;
 	gunichar c;
 	
@@ -837,7 +951,7 @@ layout_word_nowrap (LayoutWord *word, const char *in, const char *inend, double
 	
 	while (inptr < inend) {
 		start = inptr;
-		if ((c = utf8_getc (&inptr, inend - inptr)) == (gunichar) -1) {
+		if ((c = shaped_getc (word, &inptr, &sc)) == (gunichar) -1) {
 			// ignore invalid chars
 			continue;
 		}
@@ -849,10 +963,10 @@ layout_word_nowrap (LayoutWord *word, const char *in, const char *inend, double
 		
 		if (btype == G_UNICODE_BREAK_COMBINING_MARK) {
 			// ignore zero-width spaces
-			if ((btype = g_unichar_break_type (c)) == G_UNICODE_BREAK_ZERO_WIDTH_SPACE)
+			if ((btype = (GUnicodeBreakType) sc->btype) == G_UNICODE_BREAK_ZERO_WIDTH_SPACE)
 				btype = G_UNICODE_BREAK_COMBINING_MARK;
 		} else {
-			btype = g_unichar_break_type (c);
+			btype = (GUnicodeBreakType) sc->btype;
 		}
 		
 		if (BreakSpace (c, btype)) {
@@ -863,19 +977,15 @@ layout_word_nowrap (LayoutWord *word, const char *in, const char *inend, double
 		word->count++;
 		
 		// ignore glyphs the font doesn't contain...
-		if (!(glyph = word->font->GetGlyphInfo (c)))
+		if (!sc->has_glyph)
 			continue;
 		
 		// calculate total glyph advance
-		advance = glyph->metrics.horiAdvance;
-		if ((prev != NULL) && APPLY_KERNING (c))
-			advance += word->font->Kerning (prev, glyph);
-		else if (glyph->metrics.horiBearingX < 0)
-			advance -= glyph->metrics.horiBearingX;
+		advance = prev != NULL ? sc->kerned_advance : sc->advance;
 		
 		word->line_advance += advance;
 		word->advance += advance;
-		prev = glyph;
+		prev = sc;
 	}
 	
 	word->length = (inptr - in);
@@ -955,7 +1065,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 {
 	GUnicodeBreakType btype = G_UNICODE_BREAK_UNKNOWN;
 	bool line_start = word->line_advance == 0.0;
-	GlyphInfo *prev = word->prev;
+	const TextLayoutShapedChar *prev = word->prev;
 	WordBreakOpportunity op;
 	const char *inptr = in;
 	const char *start;
@@ -963,7 +1073,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 	bool force = false;
 	bool fixed = false;
 	bool wrap = false;
-	GlyphInfo *glyph;
+	const TextLayoutShapedChar *sc;
 #if DEBUG
 	GString *debug;
 #endif
@@ -982,7 +1092,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 	
 	while (inptr < inend) {
 		start = inptr;
-		if ((c = utf8_getc (&inptr, inend - inptr)) == (gunichar) -1) {
+		if ((c = shaped_getc (word, &inptr, &sc)) == (gunichar) -1) {
 			// ignore invalid chars
 			continue;
 		}
@@ -995,13 +1105,13 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		// check the previous break-type
 		if (btype == G_UNICODE_BREAK_CLOSE_PUNCTUATION) {
 			// if anything other than an infix separator come after a close-punctuation, then the 'word' is done
-			btype = g_unichar_break_type (c);
+			btype = (GUnicodeBreakType) sc->btype;
 			if (btype != G_UNICODE_BREAK_INFIX_SEPARATOR) {
 				inptr = start;
 				break;
 			}
 		} else if (btype == G_UNICODE_BREAK_INFIX_SEPARATOR) {
-			btype = g_unichar_break_type (c);
+			btype = (GUnicodeBreakType) sc->btype;
 			if (word->type == WORD_TYPE_NUMERIC) {
 				// only accept numbers after the infix
 				if (btype != G_UNICODE_BREAK_NUMERIC) {
@@ -1018,10 +1128,10 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 				fixed = true;
 			}
 		} else if (btype == G_UNICODE_BREAK_WORD_JOINER) {
-			btype = g_unichar_break_type (c);
+			btype = (GUnicodeBreakType) sc->btype;
 			fixed = true;
 		} else {
-			btype = g_unichar_break_type (c);
+			btype = (GUnicodeBreakType) sc->btype;
 		}
 		
 		if (BreakSpace (c, btype)) {
@@ -1029,7 +1139,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 			break;
 		}
 		
-		ctype = g_unichar_type (c);
+		ctype = (GUnicodeType) sc->ctype;
 		
 		if (word->type == WORD_TYPE_UNKNOWN) {
 			// record our word-type
@@ -1049,7 +1159,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		word->count++;
 		
 		// a Combining Class of 0 means start of a new glyph
-		if (glyphs > 0 && unichar_combining_class (c) != 0) {
+		if (glyphs > 0 && sc->combining_class != 0) {
 			// this char gets combined with the previous glyph
 			new_glyph = false;
 		} else {
@@ -1070,23 +1180,19 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		}
 #endif
 		
-		if ((glyph = word->font->GetGlyphInfo (c))) {
+		if (sc->has_glyph) {
 			// calculate total glyph advance
-			advance = glyph->metrics.horiAdvance;
-			if ((prev != NULL) && APPLY_KERNING (c))
-				advance += word->font->Kerning (prev, glyph);
-			else if (glyph->metrics.horiBearingX < 0)
-				advance -= glyph->metrics.horiBearingX;
+			advance = prev != NULL ? sc->kerned_advance : sc->advance;
 			
 			word->line_advance += advance;
 			word->advance += advance;
-			prev = glyph;
+			prev = sc;
 		} else {
 			advance = 0.0;
 		}
 		
 		if (new_glyph) {
-			op.index = glyph ? glyph->index : 0;
+			op.glyph = sc->has_glyph ? sc : NULL;
 			op.advance = word->advance;
 			op.count = word->count;
 			op.inptr = inptr;
@@ -1126,7 +1232,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 	// exceeded the width limit.
 	while (inptr < inend) {
 		start = inptr;
-		if ((c = utf8_getc (&inptr, inend - inptr)) == (gunichar) -1) {
+		if ((c = shaped_getc (word, &inptr, &sc)) == (gunichar) -1) {
 			// ignore invalid chars
 			continue;
 		}
@@ -1137,8 +1243,8 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 			break;
 		}
 		
-		btype = g_unichar_break_type (c);
-		if (BreakSpace (c, btype) || unichar_combining_class (c) == 0) {
+		btype = (GUnicodeBreakType) sc->btype;
+		if (BreakSpace (c, btype) || sc->combining_class == 0) {
 			inptr = start;
 			break;
 		}
@@ -1146,17 +1252,13 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		d(g_string_append_unichar (debug, c));
 		word->count++;
 		
-		if ((glyph = word->font->GetGlyphInfo (c))) {
+		if (sc->has_glyph) {
 			// calculate total glyph advance
-			advance = glyph->metrics.horiAdvance;
-			if ((prev != NULL) && APPLY_KERNING (c))
-				advance += word->font->Kerning (prev, glyph);
-			else if (glyph->metrics.horiBearingX < 0)
-				advance -= glyph->metrics.horiBearingX;
+			advance = prev != NULL ? sc->kerned_advance : sc->advance;
 			
 			word->line_advance += advance;
 			word->advance += advance;
-			prev = glyph;
+			prev = sc;
 		} else {
 			advance = 0.0;
 		}
@@ -1204,7 +1306,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 			if (i > 1 && i == word->break_ops->len) {
 				// break after the previous glyph
 				op = g_array_index (word->break_ops, WordBreakOpportunity, i - 2);
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1212,7 +1314,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 				return true;
 			} else if (i < word->break_ops->len) {
 				// break after this glyph
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1223,7 +1325,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_WORD_JOINER:
 			// cannot break before or after this character (unless forced)
 			if (force && i < word->break_ops->len) {
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1240,7 +1342,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_INSEPARABLE:
 			// only restriction is no breaking between inseparables unless we have to
 			if (line_start && i < word->break_ops->len) {
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1252,7 +1354,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 			if (i > 1) {
 				// break after the previous glyph
 				op = g_array_index (word->break_ops, WordBreakOpportunity, i - 2);
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1263,7 +1365,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_CLOSE_PUNCTUATION:
 			if (i < word->break_ops->len && (force || btype != G_UNICODE_BREAK_INFIX_SEPARATOR)) {
 				// we can safely break after this character
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1280,7 +1382,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_INFIX_SEPARATOR:
 			if (i < word->break_ops->len && (force || btype != G_UNICODE_BREAK_NUMERIC)) {
 				// we can safely break after this character
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1303,7 +1405,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_ALPHABETIC:
 			// only break if we have no choice...
 			if ((line_start || fixed || force) && i < word->break_ops->len) {
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1314,7 +1416,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_IDEOGRAPHIC:
 			if (i < word->break_ops->len && btype != G_UNICODE_BREAK_NON_STARTER) {
 				// we can safely break after this character
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1325,7 +1427,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_NUMERIC:
 			// only break if we have no choice...
 			if (line_start && i < word->break_ops->len && (force || btype != G_UNICODE_BREAK_INFIX_SEPARATOR)) {
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1341,7 +1443,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_PREFIX:
 			// do not break after characters with these break-types (unless forced)
 			if (force && i < word->break_ops->len) {
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1370,7 +1472,7 @@ layout_word_wrap (LayoutWord *word, const char *in, const char *inend, double ma
 		case G_UNICODE_BREAK_AFTER:
 			if (i < word->break_ops->len) {
 				// we can safely break after this character
-				word->prev = word->font->GetGlyphInfo (op.c);
+				word->prev = op.glyph;
 				word->length = (op.inptr - in);
 				word->advance = op.advance;
 				word->count = op.count;
@@ -1500,6 +1602,116 @@ validate_attrs (List *attributes)
 	return true;
 }
 
+bool
+TextLayout::IsShapingValid ()
+{
+	TextLayoutAttributes *attrs;
+	int i = 0;
+	
+	if (shaped_serials == NULL)
+		return false;
+	
+	attrs = (TextLayoutAttributes *) attributes->First ();
+	while (attrs != NULL) {
+		if (i == n_shaped_serials || attrs->Font ()->GetSerial () != shaped_serials[i])
+			return false;
+		
+		attrs = (TextLayoutAttributes *) attrs->next;
+		i++;
+	}
+	
+	return i == n_shaped_serials;
+}
+
+void
+TextLayout::ClearShaping ()
+{
+	g_free (shaped);
+	shaped = NULL;
+	g_free (shaped_serials);
+	shaped_serials = NULL;
+	n_shaped_serials = 0;
+}
+
+//
+// Decodes the text and looks up the glyph metrics, break types and kerning
+// of each character, i.e. everything Layout() needs which doesn't depend on
+// the max width. Kerning is computed against the previous glyph of the
+// attribute run, which is what Layout() uses unless the glyph starts a line.
+//
+void
+TextLayout::Shape ()
+{
+	TextLayoutAttributes *attrs, *nattrs;
+	const char *inptr, *inend, *start;
+	TextLayoutShapedChar *sc;
+	GlyphInfo *prev, *glyph;
+	TextFont *font;
+	gunichar c;
+	int i = 0;
+	
+	ClearShaping ();
+	stats.shaped++;
+	
+	shaped = g_new0 (TextLayoutShapedChar, length + 1);
+	shaped_serials = g_new (guint32, attributes->Length ());
+	n_shaped_serials = attributes->Length ();
+	
+	attrs = (TextLayoutAttributes *) attributes->First ();
+	inptr = text;
+	
+	while (attrs != NULL) {
+		nattrs = (TextLayoutAttributes *) attrs->next;
+		inend = text + (nattrs ? nattrs->start : length);
+		font = attrs->Font ();
+		shaped_serials[i++] = font->GetSerial ();
+		prev = NULL;
+		
+		while (inptr < inend) {
+			start = inptr;
+			sc = &shaped[start - text];
+			c = utf8_getc (&inptr, inend - inptr);
+			sc->n_bytes = inptr - start;
+			sc->c = c;
+			
+			if (c == (gunichar) -1)
+				continue;
+			
+			sc->btype = g_unichar_break_type (c);
+			sc->ctype = g_unichar_type (c);
+			sc->combining_class = unichar_combining_class (c);
+			
+			if (UnicharIsLineBreak (c)) {
+				// the next glyph starts a new line
+				prev = NULL;
+				continue;
+			}
+			
+			// treat tab as a single space
+			if (c == '\t')
+				c = ' ';
+			
+			// ignore glyphs the font doesn't contain...
+			if (!(glyph = font->GetGlyphInfo (c)))
+				continue;
+			
+			sc->has_glyph = true;
+			sc->advance = glyph->metrics.horiAdvance;
+			if (glyph->metrics.horiBearingX < 0)
+				sc->advance -= glyph->metrics.horiBearingX;
+			
+			if (APPLY_KERNING (c))
+				sc->kerned_advance = glyph->metrics.horiAdvance + (prev != NULL ? font->Kerning (prev, glyph) : 0.0);
+			else
+				sc->kerned_advance = sc->advance;
+			
+			prev = glyph;
+		}
+		
+		attrs = nattrs;
+	}
+}
+
 void
 TextLayout::Layout ()
 {
@@ -1508,9 +1720,9 @@ TextLayout::Layout ()
 	LayoutWordCallback layout_word;
 	const char *inptr, *inend;
 	size_t n_bytes, n_chars;
+	const TextLayoutShapedChar *prev;
 	TextLayoutLine *line;
 	TextLayoutRun *run;
-	GlyphInfo *prev;
 	LayoutWord word;
 	TextFont *font;
 	bool linebreak;
@@ -1520,6 +1732,16 @@ TextLayout::Layout ()
 	if (!isnan (actual_width))
 		return;
 	
+	if (text && validate_attrs (attributes)) {
+		if (!IsShapingValid ()) {
+			// any cached results were laid out with the old glyph metrics
+			ClearResults ();
+			Shape ();
+		} else if (RestoreResult ()) {
+			return;
+		}
+	}
+	
 	actual_height = 0.0;
 	actual_width = 0.0;
 	is_wrapped = false;
@@ -1529,6 +1751,10 @@ TextLayout::Layout ()
 	if (!text || !validate_attrs (attributes))
 		return;
 	
+	stats.laid_out++;
+	word.text = text;
+	word.shaped = shaped;
+	
 	d(printf ("TextLayout::Layout(): wrap mode = %s, wrapping to %f pixels\n", wrap_modes[wrapping], max_width));
 	
 	if (wrapping == TextWrappingWrap)
@@ -25,6 +25,7 @@
 namespace Moonlight {
 
 class TextLayout;
+struct TextLayoutShapedChar;
 
 class ITextAttributes {
  public:
@@ -118,6 +119,25 @@ struct TextLayoutRun {
 	void ClearCache ();
 };
 
+// The result of laying out the text with a particular max width
+struct TextLayoutResult {
+	GPtrArray *lines;
+	double max_width;
+	double actual_height;
+	double actual_width;
+	bool is_wrapped;
+	int count;
+};
+
+#define TEXT_LAYOUT_MAX_RESULTS 4
+
+// How often the text was shaped and laid out
+struct TextLayoutStats {
+	guint32 shaped; // Shape() runs
+	guint32 laid_out; // layouts which broke the text into lines
+	guint32 restored; // layouts which took a saved result instead
+};
+
 class TextLayout {
 	LineStackingStrategy strategy;
 	TextAlignment alignment;
@@ -142,6 +162,21 @@ class TextLayout {
 	double actual_width;
 	GPtrArray *lines;
 	
+	// Glyph metrics and break types of the text, which don't depend on
+	// the max width. Valid until the text or the attributes change, or
+	// until the serial of any of the attributes' fonts changes.
+	TextLayoutShapedChar *shaped;
+	guint32 *shaped_serials;
+	int n_shaped_serials;
+	
+	// The results of the most recent layouts with other max widths
+	// (most recent first), so that alternating between a few widths
+	// (as measure and arrange often do) doesn't need a new layout.
+	TextLayoutResult results[TEXT_LAYOUT_MAX_RESULTS];
+	int n_results;
+	
+	TextLayoutStats stats;
+	
 	bool OverrideLineHeight () { return (strategy == LineStackingStrategyBlockLineHeight && line_height != 0); }
 	double LineHeightOverride ();
 	double DescendOverride ();
@@ -149,6 +184,14 @@ class TextLayout {
 	void ClearCache ();
 	void ClearLines ();
 	
+	bool IsShapingValid ();
+	void ClearShaping ();
+	void Shape ();
+	
+	void SaveResult ();
+	bool RestoreResult ();
+	void ClearResults ();
+	
  public:
 	TextLayout ();
 	~TextLayout ();
@@ -217,6 +260,8 @@ class TextLayout {
 	
 	void GetActualExtents (double *width, double *height);
 	Rect GetRenderExtents ();
+	
+	const TextLayoutStats *GetStats () { return &stats; }
 };
 
 };
@@ -21,14 +21,6 @@ namespace Moonlight {
 
 #define PUT_TIME_MANAGER_TO_SLEEP 0
 
-#if TIMERS
-#define STARTTICKTIMER(id,str) STARTTIMER(id,str)
-#define ENDTICKTIMER(id,str) ENDTIMER(id,str)
-#else
-#define STARTTICKTIMER(id,str)
-#define ENDTICKTIMER(id,str)
-#endif
-
 
 #define MINIMUM_FPS 5
 #define DEFAULT_FPS 50
@@ -481,6 +473,8 @@ TimeManager::SourceTick ()
 
 	TimeManagerOp current_flags = flags;
 
+	MOON_TRACE_SCOPE ("tick", "TimeManager::Tick");
+
 #if PUT_TIME_MANAGER_TO_SLEEP
 	flags = (TimeManagerOp)0;
 #endif
@@ -489,13 +483,13 @@ TimeManager::SourceTick ()
 	current_global_time_usec = current_global_time / 10;
 
 	if (current_flags & TIME_MANAGER_TICK_CALL) {
-		STARTTICKTIMER (tm_tick_call, "TimeManager::Tick - Call");
+		MOON_TRACE_BEGIN ("tick", "TimeManager::Tick - Call");
 		InvokeTickCalls ();
-		ENDTICKTIMER (tm_tick_call, "TimeManager::Tick - Call");
+		MOON_TRACE_END ("tick", "TimeManager::Tick - Call");
 	}
 
 	if (current_flags & TIME_MANAGER_UPDATE_CLOCKS) {
-		STARTTICKTIMER (tick_update_clocks, "TimeManager::Tick - UpdateClocks");
+		MOON_TRACE_BEGIN ("tick", "TimeManager::Tick - UpdateClocks");
 
 		bool need_another_tick = root_clock->UpdateFromParentTime (GetCurrentTime());
 
@@ -514,22 +508,22 @@ TimeManager::SourceTick ()
 		if (need_another_tick)
 			ListClocks ();
 #endif
-		ENDTICKTIMER (tick_update_clocks, "TimeManager::Tick - UpdateClocks");
+		MOON_TRACE_END ("tick", "TimeManager::Tick - UpdateClocks");
 	}
 
 	if (current_flags & TIME_MANAGER_UPDATE_INPUT) {
-		STARTTICKTIMER (tick_input, "TimeManager::Tick - Input");
+		MOON_TRACE_BEGIN ("tick", "TimeManager::Tick - Input");
 		Emit (UpdateInputEvent);
-		ENDTICKTIMER (tick_input, "TimeManager::Tick - Input");
+		MOON_TRACE_END ("tick", "TimeManager::Tick - Input");
 	}
 
 	if (current_flags & TIME_MANAGER_RENDER) {
 		// g_warning ("rendering\n"); fflush (stderr);
-		STARTTICKTIMER (tick_render, "TimeManager::Tick - Render");
+		MOON_TRACE_BEGIN ("tick", "TimeManager::Tick - Render");
 		rendering_args->SetRenderingTime (get_now());
 		rendering_args->ref (); // to keep Emit from destroying the object
 		Emit (RenderEvent, rendering_args);
-		ENDTICKTIMER (tick_render, "TimeManager::Tick - Render");
+		MOON_TRACE_END ("tick", "TimeManager::Tick - Render");
 	}
 
 	last_global_time = current_global_time;
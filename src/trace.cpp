@@ -0,0 +1,186 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * trace.cpp: low overhead tracing of what the runtime spends its time on
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "pal.h"
+#include "trace.h"
+#include "timesource.h"
+
+namespace Moonlight {
+
+struct TraceEvent {
+	/* the number of the event + 1 once it's been written, 0 while it's being (over)written */
+	volatile gint sequence;
+	gint64 time;
+	const char *category;
+	const char *name;
+	char phase;
+};
+
+struct TraceBuffer {
+	TraceBuffer *next;
+	int thread_id;
+	/* the number of events ever recorded, only the owning thread changes it */
+	volatile gint head;
+	TraceEvent events [MOON_TRACE_BUFFER_EVENTS];
+};
+
+volatile gint MoonTrace::enabled = 0;
+char *MoonTrace::filename = NULL;
+
+/* all the buffers ever created, buffers are never freed (a thread which has
+ * exited may still have events in its buffer) */
+static TraceBuffer *buffers = NULL;
+static int thread_count = 0;
+static MoonMutex buffers_mutex;
+static MoonTlsKey buffer_key;
+
+void
+MoonTrace::Initialize ()
+{
+	const char *env = g_getenv ("MOONLIGHT_TRACE");
+
+	if (env == NULL || env [0] == 0 || filename != NULL)
+		return;
+
+	filename = g_strdup (env);
+	Enable ();
+}
+
+void
+MoonTrace::Shutdown ()
+{
+	if (filename == NULL)
+		return;
+
+	Disable ();
+	if (Write (filename))
+		printf ("Moonlight: wrote trace to '%s'.\n", filename);
+
+	g_free (filename);
+	filename = NULL;
+}
+
+void
+MoonTrace::Record (char phase, const char *category, const char *name)
+{
+	TraceBuffer *buffer = (TraceBuffer *) MoonThread::GetSpecific (buffer_key);
+	TraceEvent *event;
+	gint head;
+
+	if (G_UNLIKELY (buffer == NULL)) {
+		buffer = g_new0 (TraceBuffer, 1);
+		MoonThread::SetSpecific (buffer_key, buffer);
+
+		buffers_mutex.Lock ();
+		buffer->thread_id = ++thread_count;
+		buffer->next = buffers;
+		buffers = buffer;
+		buffers_mutex.Unlock ();
+	}
+
+	head = buffer->head;
+	event = &buffer->events [head & (MOON_TRACE_BUFFER_EVENTS - 1)];
+
+	/* Write may be copying the event we're overwriting, tell it the event is changing */
+	g_atomic_int_set (&event->sequence, 0);
+	event->time = get_now ();
+	event->category = category;
+	event->name = name;
+	event->phase = phase;
+
+	/* publish the event before moving the head past it */
+	g_atomic_int_set (&event->sequence, head + 1);
+	g_atomic_int_set (&buffer->head, head + 1);
+}
+
+static void
+write_json_string (FILE *fp, const char *str)
+{
+	fputc ('"', fp);
+	for (const char *p = str ? str : ""; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			fputc ('\\', fp);
+		if ((unsigned char) *p >= 0x20)
+			fputc (*p, fp);
+	}
+	fputc ('"', fp);
+}
+
+bool
+MoonTrace::Write (const char *filename)
+{
+	bool was_enabled = IsEnabled ();
+	const char *separator = "";
+	int pid = getpid ();
+	FILE *fp;
+
+	Disable ();
+
+	if (!(fp = fopen (filename, "w"))) {
+		g_warning ("Moonlight: could not write the trace to '%s'", filename);
+		if (was_enabled)
+			Enable ();
+		return false;
+	}
+
+	fputs ("{\"traceEvents\":[", fp);
+
+	buffers_mutex.Lock ();
+	for (TraceBuffer *buffer = buffers; buffer != NULL; buffer = buffer->next) {
+		guint32 head = (guint32) g_atomic_int_get (&buffer->head);
+		guint32 first = head > MOON_TRACE_BUFFER_EVENTS ? head - MOON_TRACE_BUFFER_EVENTS : 0;
+
+		for (guint32 i = first; i < head; i++) {
+			TraceEvent *event = &buffer->events [i & (MOON_TRACE_BUFFER_EVENTS - 1)];
+			const char *category, *name;
+			gint64 time;
+			char phase;
+
+			/* A thread still recording (tracing is only disabled for new events) may be
+			 * overwriting the event: copy it, and skip it unless it's the same event
+			 * before and after the copy. */
+			if ((guint32) g_atomic_int_get (&event->sequence) != i + 1)
+				continue;
+			time = event->time;
+			category = event->category;
+			name = event->name;
+			phase = event->phase;
+			if ((guint32) g_atomic_int_get (&event->sequence) != i + 1)
+				continue;
+
+			fprintf (fp, "%s\n{\"cat\":", separator);
+			write_json_string (fp, category);
+			fputs (",\"name\":", fp);
+			write_json_string (fp, name);
+			/* timestamps are in microseconds */
+			fprintf (fp, ",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ".%i,\"pid\":%i,\"tid\":%i}",
+				 phase, time / 10, (int) (time % 10), pid, buffer->thread_id);
+			separator = ",";
+		}
+	}
+	buffers_mutex.Unlock ();
+
+	fputs ("\n],\"displayTimeUnit\":\"ms\"}\n", fp);
+	fclose (fp);
+
+	if (was_enabled)
+		Enable ();
+
+	return true;
+}
+
+};
@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * trace.h: low overhead tracing of what the runtime spends its time on
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_TRACE_H__
+#define __MOON_TRACE_H__
+
+#include <glib.h>
+
+namespace Moonlight {
+
+#define MOON_TRACE_BUFFER_EVENTS 16384 /* must be a power of two */
+
+/*
+ * MoonTrace: records begin/end events into a ring buffer per thread (only
+ * the thread itself writes to its buffer, so recording doesn't take any
+ * locks), and writes them out in Chrome's trace event format (load the
+ * file in chrome://tracing).
+ *
+ * Tracing is always compiled in, but disabled by default: a disabled trace
+ * point costs a load and a branch. It's enabled at startup by setting
+ * MOONLIGHT_TRACE to the file to write the trace to (at shutdown), or at
+ * any time with Enable/Disable.
+ *
+ * The category and name of an event must outlive the trace (string
+ * literals, type names, or strings from Intern).
+ *
+ * Each thread keeps its last MOON_TRACE_BUFFER_EVENTS events.
+ */
+class MoonTrace {
+public:
+	static void Initialize ();
+	static void Shutdown ();
+
+	static void Enable () { g_atomic_int_set (&enabled, 1); }
+	static void Disable () { g_atomic_int_set (&enabled, 0); }
+	static bool IsEnabled () { return G_UNLIKELY (enabled != 0); }
+
+	static void Begin (const char *category, const char *name) { Record ('B', category, name); }
+	static void End (const char *category, const char *name) { Record ('E', category, name); }
+
+	static const char *Intern (const char *str) { return g_intern_string (str); }
+
+	// Writes all the recorded events to the file, tracing is
+	// suspended meanwhile. Returns false if the file couldn't be written.
+	static bool Write (const char *filename);
+
+	// do not use directly, use the MOON_TRACE_* macros below.
+	static volatile gint enabled;
+
+private:
+	static char *filename;
+
+	static void Record (char phase, const char *category, const char *name);
+};
+
+/* Ends the event it began (if tracing was enabled then) when it goes out of scope. */
+class MoonTraceScope {
+	const char *category;
+	const char *name;
+
+public:
+	MoonTraceScope (const char *category, const char *name)
+	{
+		if (MoonTrace::IsEnabled ()) {
+			this->category = category;
+			this->name = name;
+			MoonTrace::Begin (category, name);
+		} else {
+			this->category = NULL;
+		}
+	}
+
+	~MoonTraceScope ()
+	{
+		if (category != NULL)
+			MoonTrace::End (category, name);
+	}
+};
+
+#define MOON_TRACE_BEGIN(category, name) G_STMT_START { if (MoonTrace::IsEnabled ()) MoonTrace::Begin (category, name); } G_STMT_END
+#define MOON_TRACE_END(category, name) G_STMT_START { if (MoonTrace::IsEnabled ()) MoonTrace::End (category, name); } G_STMT_END
+
+#define MOON_TRACE_SCOPE_NAME2(line) moon_trace_scope_##line
+#define MOON_TRACE_SCOPE_NAME(line) MOON_TRACE_SCOPE_NAME2(line)
+#define MOON_TRACE_SCOPE(category, name) MoonTraceScope MOON_TRACE_SCOPE_NAME(__LINE__) (category, name)
+
+};
+
+#endif /* __MOON_TRACE_H__ */
@@ -36,7 +36,7 @@ Type::Type (Deployment *deployment, Type::Kind type, Type::Kind parent, bool is_
 	this->is_enum = is_enum;
 	this->is_value_type = is_value_type;
 	this->is_interface = is_interface;
-	this->name = g_strdup (name);
+	this->name = g_intern_string (name);
 	this->full_name = g_strdup (full_name);
 	this->event_count = event_count;
 	this->total_event_count = total_event_count;
@@ -73,7 +73,6 @@ Types::SetFastPaths ()
 		
 Type::~Type ()
 {
-	g_free (name);
 	g_free (full_name);
 	g_free (content_property);
 
@@ -81,7 +81,8 @@ UIElement::Init ()
 
 	dirty_flags = DirtyMeasure;
 	PropagateFlagUp (DIRTY_MEASURE_HINT);
-	up_dirty_node = down_dirty_node = NULL;
+	up_dirty_node.element = this;
+	down_dirty_node.element = this;
 	force_invalidate_of_new_bounds = false;
 	dirty_region = new Region ();
 
@@ -195,6 +196,10 @@ UIElement::Dispose()
 void
 UIElement::OnIsAttachedChanged (bool value)
 {
+	// our children are attached after us, so their parent's level is up to date
+	if (value)
+		visual_level = GetVisualParent () ? GetVisualParent ()->visual_level + 1 : 0;
+
 	if (subtree_object)
 		subtree_object->SetIsAttached (value);
 	
@@ -811,7 +816,17 @@ UIElement::CacheInvalidateHint ()
 void
 UIElement::SetVisualParent (UIElement *visual_parent)
 {
+	int level = visual_parent ? visual_parent->visual_level + 1 : 0;
+
 	this->visual_parent = visual_parent;
+	if (level != visual_level) {
+		visual_level = level;
+
+		// if we're dirty, we have to be processed at our new depth
+		Surface *surface = GetDeployment ()->GetSurface ();
+		if (surface)
+			surface->UpdateDirtyElementLevel (this);
+	}
 	SetIsAttached (visual_parent && visual_parent->IsAttached());
 }
 
@@ -1375,7 +1390,7 @@ UIElement::DoRender (Context *ctx, Region *parent_region)
 	GetDeployment ()->GetSurface ()->uielements_rendered_with_painters ++;
 #endif
 
-	STARTTIMER (UIElement_render, Type::Find (GetObjectType())->name);
+	MOON_TRACE_SCOPE ("render", MoonTrace::IsEnabled () ? GetTypeName () : NULL);
 
 	PreRender (ctx, region, false);
 
@@ -1384,8 +1399,6 @@ UIElement::DoRender (Context *ctx, Region *parent_region)
 
 	PostRender (ctx, region, false);
 
-	ENDTIMER (UIElement_render, Type::Find (GetObjectType())->name);
-
 	delete region;
 }
 
@@ -1866,6 +1879,27 @@ UIElement::Paint (Context *ctx,  Rect bounds, cairo_matrix_t *xform)
 #endif
 }
 
+bool
+UIElement::GetPaintExtents (cairo_matrix_t *xform, Rect *extents)
+{
+	if (RenderToIntermediate ())
+		return false;
+
+	cairo_matrix_t inverse = layout_xform;
+
+	// the transform Paint pushes, followed by the one DoRender pushes
+	cairo_matrix_invert (&inverse);
+
+	if (xform)
+		cairo_matrix_multiply (&inverse, &inverse, xform);
+
+	cairo_matrix_multiply (&inverse, &render_xform, &inverse);
+
+	*extents = GetSubtreeExtents ().GrowBy (effect_padding).Transform (&inverse);
+
+	return true;
+}
+
 void
 UIElement::CallPreRender (Context *ctx, UIElement *element, Region *region, bool skip_children)
 {
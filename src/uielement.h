@@ -22,6 +22,7 @@
 #include "rect.h"
 #include "region.h"
 #include "list.h"
+#include "dirty.h"
 #include "size.h"
 #include "layoutinformation.h"
 #include "context-cairo.h"
@@ -51,8 +52,8 @@ public:
 	virtual void Dispose ();
 	
 	int dirty_flags;
-	List::Node *up_dirty_node;
-	List::Node *down_dirty_node;
+	DirtyNode up_dirty_node;
+	DirtyNode down_dirty_node;
 
 	bool force_invalidate_of_new_bounds;
 
@@ -105,6 +106,8 @@ public:
 	virtual void SetVisualParent (UIElement *visual_parent);
 	/* @GeneratePInvoke */
 	UIElement *GetVisualParent () { return visual_parent; }
+	// The depth of the element in the visual tree (valid while it's attached).
+	int GetVisualLevel () { return visual_level; }
 
 	/* @GeneratePInvoke,ManagedAccess=Internal */
 	virtual void SetSubtreeObject (DependencyObject *value);
@@ -195,6 +198,13 @@ public:
 	//
 	void Paint (Context *ctx, Rect bounds, cairo_matrix_t *matrix);
 
+	//
+	// GetPaintExtents:
+	//   The area Paint (..., matrix) draws on, false if it can't
+	//   tell (the subtree is rendered to an intermediate surface).
+	//
+	bool GetPaintExtents (cairo_matrix_t *matrix, Rect *extents);
+
 	// a non virtual method for use when we want to wrap render
 	// with debugging and/or timing info
 	void FrontToBack (Region *surface_region, List *render_list);
@@ -24,6 +24,7 @@
 #include <errno.h>
 
 #include "utils.h"
+#include "zip-index.h"
 #include "runtime.h"
 #include "application.h"
 #include "deployment.h"
@@ -795,6 +796,73 @@ ExtractAll (unzFile zip, const char *dir, CanonMode mode)
 	return true;
 }
 
+bool
+ExtractAll (ZipIndex *zip, const char *dir, CanonMode mode)
+{
+	ZipExtraction *files;
+	char **filenames;
+	char *dirname;
+	guint n = 0;
+	bool rv = true;
+	
+	files = g_new0 (ZipExtraction, zip->GetCount ());
+	filenames = g_new0 (char *, zip->GetCount ());
+	
+	// the assemblies are extracted first (they're needed first), the
+	// canonicalization and directory creation is done on this thread
+	// (it calls into managed code), only the extraction is parallel.
+	for (int pass = 0; pass < 2 && rv; pass++) {
+		for (guint i = 0; i < zip->GetCount () && rv; i++) {
+			ZipEntry *entry = zip->GetEntry (i);
+			char *canonicalized_filename, *path;
+			
+			if (entry->is_directory)
+				continue;
+			
+			if (is_dll_exe_or_mdb (entry->name, strlen (entry->name)) != (pass == 0))
+				continue;
+			
+			canonicalized_filename = Deployment::GetCurrent ()->CanonicalizeFileName (entry->name, mode == CanonModeXap);
+			path = g_build_filename (dir, canonicalized_filename, NULL);
+			g_free (canonicalized_filename);
+			
+			dirname = g_path_get_dirname (path);
+			if (g_mkdir_with_parents (dirname, 0700) == -1 && errno != EEXIST)
+				rv = false;
+			g_free (dirname);
+			
+			files [n].entry = entry;
+			files [n].path = path;
+			filenames [n] = path;
+			n++;
+		}
+	}
+	
+	if (rv)
+		rv = zip->ExtractFiles (files, n);
+	
+	for (guint i = 0; i < n && rv; i++) {
+		char *canonicalized_filename, *altpath;
+		
+		if (mode != CanonModeXap || !is_dll_exe_or_mdb (files [i].entry->name, strlen (files [i].entry->name)))
+			continue;
+		
+		canonicalized_filename = Deployment::GetCurrent ()->CanonicalizeFileName (files [i].entry->name, false);
+		altpath = g_build_filename (dir, canonicalized_filename, NULL);
+		if (strcmp (files [i].path, altpath) != 0)
+			symlink (files [i].path, altpath);
+		g_free (canonicalized_filename);
+		g_free (altpath);
+	}
+	
+	for (guint i = 0; i < n; i++)
+		g_free (filenames [i]);
+	g_free (filenames);
+	g_free (files);
+	
+	return rv;
+}
+
 char *
 MakeTempDir (char *tmpdir)
 {
@@ -1052,47 +1120,40 @@ TextStream::OpenFile (const char *filename, bool force)
 	return ReadBOM (force);
 }
 
-bool
-TextStream::ReadBOM (bool force)
+const char *
+TextStream::DetectEncoding (const char *buf, gsize length, gsize *bom_length)
 {
 	Encoding encoding = UNKNOWN;
 	gunichar2 bom;
-	ssize_t nread;
 	
-	// prefetch the first chunk of data in order to determine encoding
-	if ((nread = ReadInternal (buffer, sizeof (buffer))) == -1) {
-		Close ();
-		
-		return false;
-	}
+	*bom_length = 0;
 	
-	bufptr = buffer;
-	buflen = nread;
-	
-	if (nread >= 2) {
-		memcpy (&bom, buffer, 2);
+	if (length >= 2) {
+		memcpy (&bom, buf, 2);
 		switch (bom) {
 		case ANTIBOM:
 			encoding = UTF16_BE;
-			buflen -= 2;
-			bufptr += 2;
+			*bom_length = 2;
 			break;
 		case BOM:
-			encoding = UTF16_LE;
-			buflen -= 2;
-			bufptr += 2;
+			// FF FE 00 00 is the UTF-32LE mark (text can't start with U+0000)
+			if (length >= 4 && buf[2] == 0 && buf[3] == 0) {
+				encoding = UTF32_LE;
+				*bom_length = 4;
+			} else {
+				encoding = UTF16_LE;
+				*bom_length = 2;
+			}
 			break;
 		case 0:
-			if (nread >= 4) {
-				memcpy (&bom, buffer + 2, 2);
+			if (length >= 4) {
+				memcpy (&bom, buf + 2, 2);
 				if (bom == ANTIBOM) {
 					encoding = UTF32_BE;
-					buflen -= 4;
-					bufptr += 4;
+					*bom_length = 4;
 				} else if (bom == BOM) {
 					encoding = UTF32_LE;
-					buflen -= 4;
-					bufptr += 4;
+					*bom_length = 4;
 				}
 			}
 			break;
@@ -1105,17 +1166,38 @@ TextStream::ReadBOM (bool force)
 		encoding = UTF8;
 	}
 	
-	if (encoding == UNKNOWN) {
+	return encoding == UNKNOWN ? NULL : encoding_names[encoding];
+}
+
+bool
+TextStream::ReadBOM (bool force)
+{
+	const char *encoding;
+	gsize bom_length;
+	ssize_t nread;
+	
+	// prefetch the first chunk of data in order to determine encoding
+	if ((nread = ReadInternal (buffer, sizeof (buffer))) == -1) {
+		Close ();
+		
+		return false;
+	}
+	
+	encoding = DetectEncoding (buffer, nread, &bom_length);
+	bufptr = buffer + bom_length;
+	buflen = nread - bom_length;
+	
+	if (encoding == NULL) {
 		if (!force) {
 			Close ();
 			
 			return false;
 		}
 		
-		encoding = UTF8;
+		encoding = encoding_names[UTF8];
 	}
 	
-	if (encoding != UTF8 && (cd = g_iconv_open ("UTF-8", encoding_names[encoding])) == (GIConv) -1) {
+	if (strcmp (encoding, encoding_names[UTF8]) != 0 && (cd = g_iconv_open ("UTF-8", encoding)) == (GIConv) -1) {
 		Close ();
 		
 		return false;
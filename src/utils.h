@@ -23,6 +23,8 @@
 
 namespace Moonlight {
 
+class ZipIndex;
+
 G_BEGIN_DECLS
 
 typedef gboolean (*Stream_CanSeek)  (void *handle);
@@ -73,6 +75,7 @@ bool UnzipByteArrayToDir (GByteArray *array, const char *dir, CanonMode mode);
 
 bool ExtractFile (unzFile zip, int fd);
 bool ExtractAll (unzFile zip, const char *dir, CanonMode mode);
+bool ExtractAll (ZipIndex *zip, const char *dir, CanonMode mode);
 
 char *MakeTempDir (char *tmpdir);
 char *CreateTempDir (const char *filename);
@@ -145,6 +148,13 @@ class TextStream {
 	bool Eof ();
 	
 	ssize_t Read (char *buf, size_t n);
+
+	// The encoding of text starting with the @length bytes at @buf (the
+	// first 4 bytes, if there are that many), from its byte order mark.
+	// Returns the name of the encoding for g_iconv_open, "UTF-8" if the
+	// text doesn't need converting, or NULL if it starts with a NUL and no
+	// mark. The size of the mark is returned in @bom_length.
+	static const char *DetectEncoding (const char *buf, gsize length, gsize *bom_length);
 };
 
 typedef void (*CancelCallback) (HttpRequest *request, void *context);
@@ -71,6 +71,10 @@ namespace Moonlight {
 WriteableBitmap::WriteableBitmap ()
 {
 	SetObjectType (Type::WRITEABLEBITMAP);
+	render_ctx = NULL;
+	render_surface = NULL;
+	render_screen = NULL;
+	pixels_shared = false;
 }
 
 gpointer
@@ -97,6 +101,15 @@ WriteableBitmap::InitializeFromBitmapSource (BitmapSource *source)
 
 WriteableBitmap::~WriteableBitmap ()
 {
+	if (render_surface)
+		render_surface->unref ();
+
+	delete render_ctx;
+
+#ifdef USE_GALLIUM
+	if (render_screen)
+		render_screen->destroy (render_screen);
+#endif
 }
 
 void
@@ -112,25 +125,32 @@ WriteableBitmap::Unlock ()
 }
 
 void
-WriteableBitmap::Render (UIElement *element, Transform *transform)
+WriteableBitmap::SetPixelsShared ()
 {
-	MoonSurface *src;
-	Context     *ctx;
-
-	if (!element)
-		return;
-
-	cairo_surface_t *surface = GetImageSurface ();
-	if (!surface)
-		return;
+	pixels_shared = true;
+}
 
-	Rect bounds (0, 0, GetPixelWidth (), GetPixelHeight ());
+void
+WriteableBitmap::Invalidate ()
+{
+	// unless the pixels may have been written to directly, only
+	// what Render painted needs to be uploaded again
+	if (pixels_shared)
+		BitmapSource::Invalidate ();
+	else
+		InvalidateRect (rendered);
+
+	rendered = Rect ();
+}
 
+void
+WriteableBitmap::CreateRenderContext ()
+{
 #ifdef USE_GALLIUM
 	struct pipe_resource pt, *texture;
 	GalliumSurface       *target;
-	struct pipe_screen   *screen =
-		swrast_screen_create (null_sw_create ());
+
+	render_screen = swrast_screen_create (null_sw_create ());
 
 	memset (&pt, 0, sizeof (pt));
 	pt.target = PIPE_TEXTURE_2D;
@@ -142,21 +162,35 @@ WriteableBitmap::Render (UIElement *element, Transform *transform)
 	pt.bind = PIPE_BIND_RENDER_TARGET | PIPE_BIND_TRANSFER_WRITE |
 		PIPE_BIND_TRANSFER_READ;
 
-	texture = (*screen->resource_create) (screen, &pt);
+	texture = (*render_screen->resource_create) (render_screen, &pt);
 
 	target = new GalliumSurface (texture);
 	pipe_resource_reference (&texture, NULL);
-	ctx = new GalliumContext (target);
+	render_ctx = new GalliumContext (target);
 	target->unref ();
 #else
 	CairoSurface *target;
 
 	target = new CairoSurface (1, 1);
-	ctx = new CairoContext (target);
+	render_ctx = new CairoContext (target);
 	target->unref ();
 #endif
+}
+
+void
+WriteableBitmap::Render (UIElement *element, Transform *transform)
+{
+	MoonSurface *src;
+	Rect        area;
+
+	if (!element)
+		return;
 
-	ctx->Push (Context::Group (bounds));
+	cairo_surface_t *surface = GetImageSurface ();
+	if (!surface)
+		return;
+
+	Rect bounds (0, 0, GetPixelWidth (), GetPixelHeight ());
 
 	cairo_matrix_t xform;
 	cairo_matrix_init_identity (&xform);
@@ -170,26 +204,51 @@ WriteableBitmap::Render (UIElement *element, Transform *transform)
 		cairo_matrix_scale (&xform, -1, 1);
 	}
 
-	element->Paint (ctx, bounds, &xform);
+	// only clear, paint and copy back what the element covers
+	if (element->GetPaintExtents (&xform, &area))
+		area = area.RoundOut ().Intersection (bounds);
+	else
+		area = bounds;
+
+	if (area.IsEmpty ())
+		return;
+
+	if (!render_ctx)
+		CreateRenderContext ();
+
+	if (render_surface) {
+		Color transparent;
+
+		render_ctx->Push (Context::Group (bounds), render_surface);
+		render_ctx->Push (Context::Clip (area));
+		render_ctx->Clear (&transparent);
+	}
+	else {
+		render_ctx->Push (Context::Group (bounds));
+		render_ctx->Push (Context::Clip (area));
+	}
+
+	element->Paint (render_ctx, area, &xform);
 
-	bounds = ctx->Pop (&src);
+	render_ctx->Pop ();
+	bounds = render_ctx->Pop (&src);
 	if (!bounds.IsEmpty ()) {
 		cairo_surface_t *image = src->Cairo ();
 		cairo_t         *cr = cairo_create (surface);
 
+		cairo_rectangle (cr, area.x, area.y, area.width, area.height);
+		cairo_clip (cr);
 		cairo_set_source_surface (cr, image, 0, 0);
 		cairo_paint (cr);
 		cairo_destroy (cr);
 		cairo_surface_destroy (image);
-		src->unref ();
-	}
-
-	delete ctx;
 
-#ifdef USE_GALLIUM
-	screen->destroy (screen);
-#endif
+		if (render_surface)
+			render_surface->unref ();
+		render_surface = src;
 
+		rendered = rendered.Union (area);
+	}
 }
 
 };
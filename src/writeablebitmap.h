@@ -19,6 +19,8 @@
 #include "dependencyobject.h"
 #include "bitmapsource.h"
 
+struct pipe_screen;
+
 namespace Moonlight {
 
 /* @Namespace=System.Windows.Media.Imaging */
@@ -26,6 +28,16 @@ class WriteableBitmap : public BitmapSource {
 private:
 	MoonMutex surface_mutex;
 
+	// Render paints into render_surface with render_ctx, both are
+	// kept around for the next call.
+	Context *render_ctx;
+	MoonSurface *render_surface;
+	struct pipe_screen *render_screen;
+	Rect rendered; // painted by Render since the last Invalidate
+	bool pixels_shared;
+
+	void CreateRenderContext ();
+
 protected:
 	virtual ~WriteableBitmap ();
 
@@ -38,6 +50,12 @@ public:
 
 	/* @GeneratePInvoke */
 	virtual void Render (UIElement *element, Transform *transform);
+	virtual void Invalidate ();
+
+	// The managed pixel array was handed out, any pixel may change
+	// without Render knowing about it.
+	/* @GeneratePInvoke */
+	void SetPixelsShared ();
 	/* @GeneratePInvoke */
 	virtual void Lock ();
 	/* @GeneratePInvoke */
@@ -58,6 +58,7 @@
 #include "grid.h"
 #include "deepzoomimagetilesource.h"
 #include "managedtypeinfo.h"
+#include "timesource.h"
 #include "bitmapcache.h"
 #include "usercontrol.h"
 #include "factory.h"
@@ -701,6 +702,7 @@ class XamlParserInfo {
 	GList *created_elements;
 	GList *created_namespaces;
 	const char* xml_buffer;
+	int xml_buffer_length;
 	int multi_buffer_offset;
 	int xml_buffer_start_index;
 
@@ -729,6 +731,7 @@ class XamlParserInfo {
 		buffer_depth = -1;
 		buffer = NULL;
 		xml_buffer = NULL;
+		xml_buffer_length = 0;
 		multi_buffer_offset = 0;
 		validate_templates = false;
 
@@ -820,10 +823,11 @@ class XamlParserInfo {
 
 	void AppendCurrentXml ()
 	{
-		if (!buffer)
+		if (!buffer || !xml_buffer)
 			return;
 		int pos = XML_GetCurrentByteIndex (parser) - multi_buffer_offset;
-		g_string_append_len (buffer, xml_buffer + xml_buffer_start_index, pos - xml_buffer_start_index);
+		if (pos > xml_buffer_start_index)
+			g_string_append_len (buffer, xml_buffer + xml_buffer_start_index, pos - xml_buffer_start_index);
 	}
 	
 	char* ClearBuffer ()
@@ -842,16 +846,24 @@ class XamlParserInfo {
 		return res;
 	}
 
-	void SetXmlBuffer (const char* xml_buffer)
+	// @xml_buffer is the data handed to the next XML_Parse call, it only
+	// has to stay valid until ReleaseXmlBuffer is called after it.
+	void SetXmlBuffer (const char* xml_buffer, int length)
+	{
+		this->xml_buffer = xml_buffer;
+		xml_buffer_length = length;
+		xml_buffer_start_index = 0;
+	}
+
+	void ReleaseXmlBuffer ()
 	{
+		// copy out what we're buffering before the data goes away
 		if (InBufferingMode ())
 			AppendCurrentXml ();
 
-		if (this->xml_buffer)
-			multi_buffer_offset += strlen (this->xml_buffer);
-
-		this->xml_buffer = xml_buffer;
-		xml_buffer_start_index = 0;
+		multi_buffer_offset += xml_buffer_length;
+		xml_buffer = NULL;
+		xml_buffer_length = 0;
 	}
 
 	void ValidateTemplate (const char* buffer, XamlContext* context, FrameworkTemplate *binding_source)
@@ -1605,6 +1617,15 @@ SL3XamlLoader::Initialize (const Uri *resourceBase, Surface* surface, XamlContex
 	this->expanding_template = false;
 	this->template_owner = NULL;
 	this->import_default_xmlns = false;
+	this->stream_info = NULL;
+	this->stream_file_name = NULL;
+	this->stream_first_chunk = false;
+	this->stream_failed = false;
+	this->parsed_bytes = 0;
+	this->parse_time = 0;
+	this->stream_encoding_known = false;
+	this->stream_cd = (GIConv) -1;
+	this->stream_input = NULL;
 
 	if (context) {
 		this->vm_loaded = true;
@@ -1623,6 +1644,7 @@ SL3XamlLoader::Initialize (const Uri *resourceBase, Surface* surface, XamlContex
 
 SL3XamlLoader::~SL3XamlLoader ()
 {
+	AbortParse ();
 	if (surface)
 		surface->unref ();
 	surface = NULL;
@@ -2417,43 +2439,40 @@ Xaml::ParseXmlns (const char* xmlns, char** type_name, char** ns, char** assembl
 	g_free (buffer);
 }
 
-Value *
-SL3XamlLoader::CreateFromFile (const char *xaml_file, bool create_namescope,
-			    Type::Kind *element_type)
+bool
+SL3XamlLoader::BeginParse (const char *file_name, bool create_namescope)
 {
-	Value *res = NULL;
-	XamlParserInfo *parser_info = NULL;
-	XML_Parser p = NULL;
-	bool first_read = true;
-	const char *inptr, *inend;
-	TextStream *stream;
-	char buffer[4096];
-	ssize_t nread, n;
+	XML_Parser p;
 
-	LOG_XAML ("attemtping to load xaml file: %s\n", xaml_file);
-	
-	stream = new TextStream ();
-	if (!stream->OpenFile (xaml_file, false)) {
-		LOG_XAML ("can not open file\n");
-		goto cleanup_and_return;
+	if (stream_info != NULL) {
+		g_warning ("SL3XamlLoader::BeginParse (): a document is already being parsed");
+		return false;
 	}
-	
+
 	if (!(p = XML_ParserCreateNS ("UTF-8", '|'))) {
 		LOG_XAML ("can not create parser\n");
-		goto cleanup_and_return;
+		error_args = new ParserErrorEventArgs (NULL, "Error opening xaml file", file_name, 0, 0, 1, "", "");
+		return false;
 	}
 
-	parser_info = new XamlParserInfo (p, xaml_file);
-	
-	parser_info->namescope->SetTemporary (!create_namescope);
+	stream_file_name = g_strdup (file_name);
+	stream_info = new XamlParserInfo (p, stream_file_name);
+	stream_first_chunk = true;
+	stream_failed = false;
+	stream_encoding_known = false;
+	stream_input = g_byte_array_new ();
+	parsed_bytes = 0;
+	parse_time = 0;
 
-	parser_info->loader = this;
+	stream_info->namescope->SetTemporary (!create_namescope);
+
+	stream_info->loader = this;
 
 	// TODO: This is just in here temporarily, to make life less difficult for everyone
 	// while we are developing.  
-	add_default_namespaces (parser_info, false);
+	add_default_namespaces (stream_info, false);
 
-	XML_SetUserData (p, parser_info);
+	XML_SetUserData (p, stream_info);
 
 	XML_SetElementHandler (p, start_element_handler, end_element_handler);
 	XML_SetCharacterDataHandler (p, char_data_handler);
@@ -2463,35 +2482,173 @@ SL3XamlLoader::CreateFromFile (const char *xaml_file, bool create_namescope,
 	/*
 	XML_SetProcessingInstructionHandler (p, proc_handler);
 	*/
-	
-	while ((nread = stream->Read (buffer, sizeof (buffer))) >= 0) {
-		inptr = buffer;
-		n = nread;
-		
-		if (first_read && nread > 0) {
-			// Remove preceding white space
-			inend = buffer + nread;
-			
-			while (inptr < inend && g_ascii_isspace (*inptr))
-				inptr++;
-			
-			if (inptr == inend)
-				continue;
-			
-			n = (inend - inptr);
-			first_read = false;
-		}
 
-		parser_info->SetXmlBuffer (inptr);
-		if (!XML_Parse (p, inptr, n, nread == 0)) {
-			expat_parser_error (parser_info, XML_GetErrorCode (p));
-			goto cleanup_and_return;
+	return true;
+}
+
+bool
+SL3XamlLoader::ParseChunk (const char *data, gint32 length)
+{
+	MOON_TRACE_SCOPE ("xaml", "SL3XamlLoader::ParseChunk");
+
+	if (stream_info == NULL || stream_failed)
+		return false;
+
+	if (stream_encoding_known && stream_cd == (GIConv) -1)
+		return ParseUtf8Chunk (data, length);
+
+	g_byte_array_append (stream_input, (const guint8 *) data, length);
+
+	// the byte order mark is in the first 4 bytes
+	if (!stream_encoding_known) {
+		if (stream_input->len < 4)
+			return true;
+		return DetectStreamEncoding ();
+	}
+
+	return ConvertStreamInput ();
+}
+
+// Looks for a byte order mark at the start of stream_input (like
+// TextStream::ReadBOM does for files), and parses what it can of it.
+bool
+SL3XamlLoader::DetectStreamEncoding ()
+{
+	const char *encoding;
+	gsize bom_length;
+
+	encoding = TextStream::DetectEncoding ((const char *) stream_input->data, stream_input->len, &bom_length);
+	stream_encoding_known = true;
+
+	// no mark: the parser reports anything which isn't UTF-8
+	if (encoding == NULL || !g_ascii_strcasecmp (encoding, "UTF-8")) {
+		bool parsed = ParseUtf8Chunk ((const char *) stream_input->data, stream_input->len);
+		g_byte_array_set_size (stream_input, 0);
+		return parsed;
+	}
+
+	if ((stream_cd = g_iconv_open ("UTF-8", encoding)) == (GIConv) -1) {
+		parser_error (stream_info, NULL, NULL, XML_ERROR_UNKNOWN_ENCODING, "unsupported encoding %s", encoding);
+		stream_failed = true;
+		return false;
+	}
+
+	g_byte_array_remove_range (stream_input, 0, bom_length);
+
+	return ConvertStreamInput ();
+}
+
+// Converts and parses stream_input, up to an incomplete multibyte sequence
+// at its end (which is left for the next chunk).
+bool
+SL3XamlLoader::ConvertStreamInput ()
+{
+	char *inbuf = (char *) stream_input->data;
+	gsize inleft = stream_input->len;
+	char buffer [4096];
+	bool done = false;
+
+	while (!done && inleft > 0) {
+		char *outbuf = buffer;
+		gsize outleft = sizeof (buffer);
+
+		if (g_iconv (stream_cd, &inbuf, &inleft, &outbuf, &outleft) != (size_t) -1) {
+			done = true;
+		} else if (errno == EINVAL) {
+			// incomplete multibyte sequence
+			done = true;
+		} else if (errno != E2BIG) {
+			// illegal multibyte sequence
+			expat_parser_error (stream_info, XML_ERROR_INVALID_TOKEN);
+			stream_failed = true;
+			return false;
 		}
-		
-		if (nread == 0)
-			break;
+
+		if (outbuf > buffer && !ParseUtf8Chunk (buffer, outbuf - buffer))
+			return false;
 	}
-	
+
+	g_byte_array_remove_range (stream_input, 0, stream_input->len - inleft);
+
+	return true;
+}
+
+bool
+SL3XamlLoader::ParseUtf8Chunk (const char *data, gint32 length)
+{
+	const char *inend = data + length;
+	TimeSpan start;
+	bool parsed;
+
+	if (stream_first_chunk) {
+		// Remove preceding white space
+		while (data < inend && g_ascii_isspace (*data))
+			data++;
+
+		if (data == inend)
+			return true;
+
+		stream_first_chunk = false;
+	}
+
+	start = get_now ();
+
+	stream_info->SetXmlBuffer (data, inend - data);
+	parsed = XML_Parse (stream_info->parser, data, inend - data, false);
+	stream_info->ReleaseXmlBuffer ();
+
+	parse_time += get_now () - start;
+	parsed_bytes += inend - data;
+
+	if (!parsed) {
+		expat_parser_error (stream_info, XML_GetErrorCode (stream_info->parser));
+		stream_failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+Value *
+SL3XamlLoader::EndParse (Type::Kind *element_type)
+{
+	MOON_TRACE_SCOPE ("xaml", "SL3XamlLoader::EndParse");
+
+	XamlParserInfo *parser_info = stream_info;
+	Value *res = NULL;
+	TimeSpan start;
+
+	if (parser_info == NULL)
+		return NULL;
+
+	// a document shorter than a byte order mark
+	if (!stream_failed && !stream_encoding_known)
+		DetectStreamEncoding ();
+
+	// the document ends in the middle of a multibyte sequence
+	if (!stream_failed && stream_input->len > 0) {
+		expat_parser_error (parser_info, XML_ERROR_PARTIAL_CHAR);
+		stream_failed = true;
+	}
+
+	if (!stream_failed) {
+		start = get_now ();
+		parser_info->SetXmlBuffer ("", 0);
+		stream_failed = !XML_Parse (parser_info->parser, "", 0, true);
+		parser_info->ReleaseXmlBuffer ();
+		parse_time += get_now () - start;
+
+		if (stream_failed)
+			expat_parser_error (parser_info, XML_GetErrorCode (parser_info->parser));
+	}
+
+	LOG_XAML ("parsed %" G_GINT64_FORMAT " bytes of %s in %.2f ms (%.2f MB/s)\n", parsed_bytes,
+		  stream_file_name ? stream_file_name : "xaml", parse_time / 10000.0,
+		  parse_time > 0 ? (parsed_bytes / 1048576.0) / (parse_time / 10000000.0) : 0.0);
+
+	if (stream_failed)
+		goto cleanup_and_return;
+
 	print_tree (parser_info->top_element, 0);
 	
 	if (parser_info->top_element) {
@@ -2503,27 +2660,75 @@ SL3XamlLoader::CreateFromFile (const char *xaml_file, bool create_namescope,
 			*element_type = parser_info->top_element->info->GetKind ();
 
 		if (parser_info->error_args) {
-			*element_type = Type::INVALID;
+			if (element_type)
+				*element_type = Type::INVALID;
 			goto cleanup_and_return;
 		}	
 	}
 	
  cleanup_and_return:
 	
-	if (!parser_info)
-		error_args = new ParserErrorEventArgs (NULL, "Error opening xaml file", xaml_file, 0, 0, 1, "", "");
-	else if (parser_info->error_args) {
+	if (parser_info->error_args) {
 		error_args = parser_info->error_args;
 		error_args->ref ();
 	}
+
+	AbortParse ();
+
+	return res;
+}
+
+void
+SL3XamlLoader::AbortParse ()
+{
+	if (stream_info == NULL)
+		return;
+
+	XML_ParserFree (stream_info->parser);
+	delete stream_info;
+	stream_info = NULL;
+
+	if (stream_cd != (GIConv) -1) {
+		g_iconv_close (stream_cd);
+		stream_cd = (GIConv) -1;
+	}
+
+	g_byte_array_free (stream_input, true);
+	stream_input = NULL;
+
+	g_free (stream_file_name);
+	stream_file_name = NULL;
+}
+
+Value *
+SL3XamlLoader::CreateFromFile (const char *xaml_file, bool create_namescope,
+			    Type::Kind *element_type)
+{
+	Value *res = NULL;
+	TextStream *stream;
+	char buffer[4096];
+	ssize_t nread;
+
+	LOG_XAML ("attemtping to load xaml file: %s\n", xaml_file);
 	
-	delete stream;
+	stream = new TextStream ();
+	if (!stream->OpenFile (xaml_file, false)) {
+		LOG_XAML ("can not open file\n");
+		error_args = new ParserErrorEventArgs (NULL, "Error opening xaml file", xaml_file, 0, 0, 1, "", "");
+		delete stream;
+		return NULL;
+	}
 	
-	if (p)
-		XML_ParserFree (p);
+	if (BeginParse (xaml_file, create_namescope)) {
+		while ((nread = stream->Read (buffer, sizeof (buffer))) > 0) {
+			if (!ParseChunk (buffer, nread))
+				break;
+		}
+
+		res = EndParse (element_type);
+	}
 	
-	if (parser_info)
-		delete parser_info;
+	delete stream;
 	
 	return res;
 }
@@ -2560,6 +2765,23 @@ XamlLoader::CreateDependencyObjectFromFile (const char *xaml, bool create_namesc
 	return obj;
 }
 
+DependencyObject *
+SL3XamlLoader::EndParseDependencyObject (Type::Kind *element_type)
+{
+	Value *v = EndParse (element_type);
+
+	if (error_args && error_args->GetErrorCode () != -1) {
+		delete v;
+		return NULL;
+	}
+
+	DependencyObject *obj = value_to_dependency_object (v);
+	if (obj)
+		obj->ref ();
+	delete v;
+	return obj;
+}
+
 DependencyObject *
 XamlLoader::CreateDependencyObjectFromString (const char *xaml, bool create_namescope, Type::Kind *element_type)
 {
@@ -2661,13 +2883,19 @@ SL3XamlLoader::HydrateFromString (const char *xaml, Value *object, bool create_n
 
 	for (int i = 0; inputs [i]; i++) {
 		char *start = inputs [i];
+		int length;
+		bool parsed;
 
 		// don't freak out if the <?xml ... ?> isn't on the first line (see #328907)
 		while (g_ascii_isspace (*start))
 			start++;
 
-		parser_info->SetXmlBuffer (start);
-		if (!XML_Parse (p, start, strlen (start), inputs [i + 1] == NULL)) {
+		length = strlen (start);
+		parser_info->SetXmlBuffer (start, length);
+		parsed = XML_Parse (p, start, length, inputs [i + 1] == NULL);
+		parser_info->ReleaseXmlBuffer ();
+
+		if (!parsed) {
 			expat_parser_error (parser_info, XML_GetErrorCode (p));
 			LOG_XAML ("error parsing:  %s\n\n", xaml);
 			goto cleanup_and_return;
@@ -24,6 +24,7 @@ namespace Moonlight {
 
 class XamlLoader;
 class SL3XamlLoader;
+class XamlParserInfo;
 
 struct XamlCallbackData {
 	void *loader;
@@ -197,7 +198,25 @@ class SL3XamlLoader : public XamlLoader {
 	XamlContext *context;
 	bool import_default_xmlns;
 
+	// the document being parsed incrementally (see BeginParse)
+	XamlParserInfo *stream_info;
+	char *stream_file_name;
+	bool stream_first_chunk;
+	bool stream_failed;
+	gint64 parsed_bytes;
+	TimeSpan parse_time;
+	// the parser is fed UTF-8: documents starting with a UTF-16 or UTF-32
+	// byte order mark are converted as they arrive, stream_input holds
+	// what hasn't been (the first bytes until the encoding is known, and
+	// multibyte sequences split between chunks).
+	bool stream_encoding_known;
+	GIConv stream_cd;
+	GByteArray *stream_input;
+
 	void Initialize (const Uri *resourceBase, Surface *surface, XamlContext *context);
+	bool DetectStreamEncoding ();
+	bool ConvertStreamInput ();
+	bool ParseUtf8Chunk (const char *data, gint32 length);
 
  public:
 
@@ -234,6 +253,22 @@ class SL3XamlLoader : public XamlLoader {
 	Value* CreateFromString  (const char *xaml, bool create_namescope, Type::Kind *element_type, int flags);
 	Value* HydrateFromString (const char *xaml, Value *object, bool create_namescope, Type::Kind *element_type, int flags);
 
+	// Incremental parsing, for documents which are still being downloaded:
+	// the elements are created as soon as the chunk they're in is parsed.
+	// ParseChunk returns false once there has been an error (error_args is
+	// set by EndParse), and EndParse returns what CreateFromFile would have.
+	bool BeginParse (const char *file_name, bool create_namescope);
+	bool ParseChunk (const char *data, gint32 length);
+	Value* EndParse (Type::Kind *element_type);
+	DependencyObject* EndParseDependencyObject (Type::Kind *element_type);
+	void AbortParse ();
+	bool IsParsing () { return stream_info != NULL; }
+
+	// the number of bytes fed to the parser and the time spent parsing
+	// them, for the document currently (or last) parsed incrementally.
+	gint64 GetParsedBytes () { return parsed_bytes; }
+	TimeSpan GetParseTime () { return parse_time; }
+
 	/* @GeneratePInvoke */
 	Value* CreateFromFileWithError (const char *xaml, bool create_namescope, Type::Kind *element_type, MoonError *error);
 	/* @GeneratePInvoke */
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 
 #include "zip/unzip.h"
+#include "zip-index.h"
 #include "xaml.h"
 #include "error.h"
 #include "utils.h"
@@ -30,6 +31,7 @@ namespace Moonlight {
 char *
 Xap::Unpack (const char *fname)
 {
+	ZipIndex *index;
 	unzFile zipfile;
 	char *xap_dir;
 	
@@ -38,6 +40,22 @@ Xap::Unpack (const char *fname)
 		return NULL;
 	}
 	
+	// extract straight from the central directory (in parallel), falling
+	// back to minizip for the archives ZipIndex doesn't support.
+	if ((index = ZipIndex::Open (fname))) {
+		if (!ExtractAll (index, xap_dir, CanonModeXap)) {
+			g_warning ("Moonlight: Failed to extract zip contents from %s.\n", fname);
+			RemoveDir (xap_dir);
+			delete index;
+			g_free (xap_dir);
+			return NULL;
+		}
+		
+		delete index;
+		
+		return xap_dir;
+	}
+	
 	if (!(zipfile = unzOpen (fname))) {
 		g_warning ("Moonlight: Failed to open %s as zip file.\n", fname);
 		RemoveDir (xap_dir);
@@ -0,0 +1,440 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * zip-index.cpp: random access to the entries of a zip archive
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+#if !GLIB_IS_EGLIB
+#include <glib/gstdio.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+#include <mono/io-layer/atomic.h>
+
+#include "zip-index.h"
+#include "utils.h"
+#include "debug.h"
+#include "pal.h"
+
+namespace Moonlight {
+
+#define ZIP_END_OF_CENTRAL_DIRECTORY 0x06054b50
+#define ZIP_CENTRAL_DIRECTORY_HEADER 0x02014b50
+#define ZIP_LOCAL_HEADER 0x04034b50
+
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIZE 22
+#define ZIP_CENTRAL_DIRECTORY_HEADER_SIZE 46
+#define ZIP_LOCAL_HEADER_SIZE 30
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+#define ZIP_FLAG_ENCRYPTED (1 << 0)
+
+// the most threads ExtractFiles will use, extraction is mostly io bound after a few
+#define ZIP_MAX_THREADS 4
+
+// deflate can't compress better than about 1032:1
+#define ZIP_MAX_DEFLATE_RATIO 1032
+
+static inline guint16
+read_uint16 (const guint8 *p)
+{
+	return p [0] | (p [1] << 8);
+}
+
+static inline guint32
+read_uint32 (const guint8 *p)
+{
+	return p [0] | (p [1] << 8) | (p [2] << 16) | ((guint32) p [3] << 24);
+}
+
+static void
+zip_entry_free (ZipEntry *entry)
+{
+	g_free (entry->name);
+	g_free (entry);
+}
+
+ZipIndex::ZipIndex ()
+{
+	entries = g_ptr_array_new ();
+	names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	data = NULL;
+	length = 0;
+}
+
+ZipIndex::~ZipIndex ()
+{
+	for (guint i = 0; i < entries->len; i++)
+		zip_entry_free ((ZipEntry *) entries->pdata [i]);
+	g_ptr_array_free (entries, true);
+	g_hash_table_destroy (names);
+
+	if (data != NULL)
+		munmap (data, length);
+}
+
+ZipIndex *
+ZipIndex::Open (const char *filename)
+{
+	ZipIndex *index;
+	struct stat st;
+	void *mapping;
+	int fd;
+
+	if ((fd = open (filename, O_RDONLY)) == -1)
+		return NULL;
+
+	if (fstat (fd, &st) == -1 || st.st_size < ZIP_END_OF_CENTRAL_DIRECTORY_SIZE || (guint64) st.st_size > G_MAXUINT32) {
+		close (fd);
+		return NULL;
+	}
+
+	mapping = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+
+	if (mapping == MAP_FAILED)
+		return NULL;
+
+	index = new ZipIndex ();
+	index->data = (guint8 *) mapping;
+	index->length = st.st_size;
+
+	if (!index->Load ()) {
+		delete index;
+		return NULL;
+	}
+
+	return index;
+}
+
+bool
+ZipIndex::Load ()
+{
+	const guint8 *eocd = NULL, *p, *end;
+	guint32 cd_offset, cd_size;
+	guint16 count;
+	gsize min;
+
+	// the end of central directory record is followed by a comment of up to 64k
+	min = length > 65535 + ZIP_END_OF_CENTRAL_DIRECTORY_SIZE ? length - 65535 - ZIP_END_OF_CENTRAL_DIRECTORY_SIZE : 0;
+	for (gsize offset = length - ZIP_END_OF_CENTRAL_DIRECTORY_SIZE + 1; offset-- > min; ) {
+		if (read_uint32 (data + offset) == ZIP_END_OF_CENTRAL_DIRECTORY) {
+			eocd = data + offset;
+			break;
+		}
+	}
+
+	if (eocd == NULL)
+		return false;
+
+	// multi-disk archives aren't supported, and zip64 ones set these to their maximum
+	if (read_uint16 (eocd + 4) != 0 || read_uint16 (eocd + 6) != 0)
+		return false;
+
+	count = read_uint16 (eocd + 10);
+	cd_size = read_uint32 (eocd + 12);
+	cd_offset = read_uint32 (eocd + 16);
+
+	if (count == 0xffff || cd_offset == 0xffffffff || (guint64) cd_offset + cd_size > (guint64) (eocd - data))
+		return false;
+
+	p = data + cd_offset;
+	end = p + cd_size;
+
+	g_ptr_array_set_size (entries, 0);
+
+	for (guint i = 0; i < count; i++) {
+		guint16 name_length, extra_length, comment_length, flags;
+		ZipEntry *entry;
+		char *key;
+
+		if (p + ZIP_CENTRAL_DIRECTORY_HEADER_SIZE > end || read_uint32 (p) != ZIP_CENTRAL_DIRECTORY_HEADER)
+			return false;
+
+		flags = read_uint16 (p + 8);
+		name_length = read_uint16 (p + 28);
+		extra_length = read_uint16 (p + 30);
+		comment_length = read_uint16 (p + 32);
+
+		if (p + ZIP_CENTRAL_DIRECTORY_HEADER_SIZE + name_length > end)
+			return false;
+
+		if (flags & ZIP_FLAG_ENCRYPTED)
+			return false;
+
+		entry = g_new0 (ZipEntry, 1);
+		entry->method = read_uint16 (p + 10);
+		entry->crc = read_uint32 (p + 16);
+		entry->compressed_size = read_uint32 (p + 20);
+		entry->size = read_uint32 (p + 24);
+		entry->offset = read_uint32 (p + 42);
+		entry->name = g_strndup ((const char *) p + ZIP_CENTRAL_DIRECTORY_HEADER_SIZE, name_length);
+
+		// ExtractAll has always skipped entries with the MS-DOS directory attribute
+		entry->is_directory = (read_uint32 (p + 38) & (1 << 4)) || (name_length > 0 && entry->name [name_length - 1] == '/');
+
+		g_ptr_array_add (entries, entry);
+
+		if (entry->compressed_size == 0xffffffff || entry->size == 0xffffffff || entry->offset == 0xffffffff)
+			return false;
+
+		if (entry->method != ZIP_METHOD_STORED && entry->method != ZIP_METHOD_DEFLATED && !entry->is_directory)
+			return false;
+
+		// the sizes are bounded by the archive, so a corrupt entry can't make us allocate gigabytes
+		if (entry->compressed_size > length || (guint64) entry->size > (guint64) entry->compressed_size * ZIP_MAX_DEFLATE_RATIO)
+			return false;
+
+		// the first entry with a name wins, like unzLocateFile
+		key = g_ascii_strdown (entry->name, -1);
+		if (g_hash_table_lookup (names, key) == NULL)
+			g_hash_table_insert (names, key, entry);
+		else
+			g_free (key);
+
+		p += ZIP_CENTRAL_DIRECTORY_HEADER_SIZE + name_length + extra_length + comment_length;
+	}
+
+	LOG_DOWNLOADER ("ZipIndex::Load (): indexed %u entries\n", entries->len);
+
+	return true;
+}
+
+bool
+ZipIndex::IsSafeName (const char *name)
+{
+	const char *component = name;
+
+	if (name [0] == 0 || name [0] == '/' || name [0] == '\\' || g_path_is_absolute (name))
+		return false;
+
+	// no ".." components, with either separator
+	for (const char *p = name; ; p++) {
+		if (*p == '/' || *p == '\\' || *p == 0) {
+			if (p - component == 2 && component [0] == '.' && component [1] == '.')
+				return false;
+			if (*p == 0)
+				break;
+			component = p + 1;
+		}
+	}
+
+	return true;
+}
+
+ZipEntry *
+ZipIndex::Find (const char *name)
+{
+	ZipEntry *entry;
+	char *key;
+
+	key = g_ascii_strdown (name, -1);
+	entry = (ZipEntry *) g_hash_table_lookup (names, key);
+	g_free (key);
+
+	return entry;
+}
+
+const guint8 *
+ZipIndex::GetEntryData (ZipEntry *entry)
+{
+	const guint8 *header = data + entry->offset;
+
+	if (entry->offset + ZIP_LOCAL_HEADER_SIZE > length || read_uint32 (header) != ZIP_LOCAL_HEADER)
+		return NULL;
+
+	// the local header's name and extra field may differ from the central directory's
+	guint64 start = entry->offset + ZIP_LOCAL_HEADER_SIZE + read_uint16 (header + 26) + read_uint16 (header + 28);
+
+	if (start + entry->compressed_size > length)
+		return NULL;
+
+	return data + start;
+}
+
+const guint8 *
+ZipIndex::GetStoredData (ZipEntry *entry)
+{
+	if (entry->method != ZIP_METHOD_STORED || entry->is_directory)
+		return NULL;
+
+	return GetEntryData (entry);
+}
+
+bool
+ZipIndex::Extract (ZipEntry *entry, guint8 *buffer)
+{
+	const guint8 *compressed;
+	z_stream stream;
+	int rv;
+
+	if (entry->is_directory || !(compressed = GetEntryData (entry)))
+		return false;
+
+	if (entry->method == ZIP_METHOD_STORED) {
+		if (entry->compressed_size != entry->size)
+			return false;
+		memcpy (buffer, compressed, entry->size);
+	} else {
+		memset (&stream, 0, sizeof (stream));
+
+		// raw deflate data, without a zlib header
+		if (inflateInit2 (&stream, -MAX_WBITS) != Z_OK)
+			return false;
+
+		stream.next_in = (Bytef *) compressed;
+		stream.avail_in = entry->compressed_size;
+		stream.next_out = buffer;
+		stream.avail_out = entry->size;
+
+		rv = inflate (&stream, Z_FINISH);
+		inflateEnd (&stream);
+
+		if (rv != Z_STREAM_END || stream.total_out != entry->size)
+			return false;
+	}
+
+	return crc32 (crc32 (0, Z_NULL, 0), buffer, entry->size) == entry->crc;
+}
+
+guint8 *
+ZipIndex::ExtractToBuffer (ZipEntry *entry)
+{
+	guint8 *buffer;
+
+	if (!(buffer = (guint8 *) g_try_malloc ((gsize) entry->size + 1)))
+		return NULL;
+
+	if (!Extract (entry, buffer)) {
+		g_free (buffer);
+		return NULL;
+	}
+
+	buffer [entry->size] = 0;
+
+	return buffer;
+}
+
+bool
+ZipIndex::ExtractToFile (ZipEntry *entry, const char *path, bool *existed)
+{
+	const guint8 *stored;
+	guint8 *buffer;
+	bool rv;
+	int fd;
+
+	if (existed != NULL)
+		*existed = false;
+
+	if (entry->is_directory)
+		return false;
+
+	// O_EXCL: never write through a file (or symlink) which is already there
+	if ((fd = g_open (path, O_CREAT | O_WRONLY | O_EXCL, 0600)) == -1) {
+		if (existed != NULL)
+			*existed = errno == EEXIST;
+		return false;
+	}
+
+	if ((stored = GetStoredData (entry)) != NULL) {
+		// write stored entries straight from the mapping
+		rv = entry->compressed_size == entry->size &&
+			crc32 (crc32 (0, Z_NULL, 0), stored, entry->size) == entry->crc &&
+			write_all (fd, (const char *) stored, entry->size) != -1;
+	} else if ((buffer = ExtractToBuffer (entry)) != NULL) {
+		rv = write_all (fd, (const char *) buffer, entry->size) != -1;
+		g_free (buffer);
+	} else {
+		rv = false;
+	}
+
+	if (close (fd) == -1)
+		rv = false;
+
+	// don't leave a partial file behind, it would be taken for an extracted one
+	if (!rv)
+		g_unlink (path);
+
+	return rv;
+}
+
+struct ZipExtractionJob {
+	ZipIndex *index;
+	ZipExtraction *files;
+	gint32 count;
+	volatile gint32 next;
+	volatile gint32 failed;
+};
+
+static gpointer
+extract_files_worker (gpointer data)
+{
+	ZipExtractionJob *job = (ZipExtractionJob *) data;
+	gint32 i;
+
+	while ((i = InterlockedIncrement (&job->next) - 1) < job->count) {
+		ZipExtraction *file = &job->files [i];
+		bool existed;
+
+		// files which have already been extracted are left alone
+		if (!job->index->ExtractToFile (file->entry, file->path, &existed) && !existed) {
+			LOG_DOWNLOADER ("ZipIndex::ExtractFiles (): failed to extract %s to %s\n", file->entry->name, file->path);
+			InterlockedExchange (&job->failed, 1);
+		}
+	}
+
+	return NULL;
+}
+
+bool
+ZipIndex::ExtractFiles (ZipExtraction *files, guint n, int max_threads)
+{
+	MoonThread *threads [ZIP_MAX_THREADS];
+	ZipExtractionJob job;
+	int nthreads = 0;
+	int wanted;
+
+	job.index = this;
+	job.files = files;
+	job.count = n;
+	job.next = 0;
+	job.failed = 0;
+
+	if (max_threads <= 0)
+		max_threads = sysconf (_SC_NPROCESSORS_ONLN);
+
+	// the calling thread extracts files too
+	wanted = MIN (MIN (max_threads, ZIP_MAX_THREADS), (int) n) - 1;
+
+	for (int i = 0; i < wanted; i++) {
+		if (MoonThread::StartJoinable (&threads [nthreads], extract_files_worker, &job) != 0)
+			break;
+		nthreads++;
+	}
+
+	extract_files_worker (&job);
+
+	for (int i = 0; i < nthreads; i++)
+		threads [i]->Join ();
+
+	return job.failed == 0;
+}
+
+};
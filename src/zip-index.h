@@ -0,0 +1,94 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/*
+ * zip-index.h: random access to the entries of a zip archive
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ */
+
+#ifndef __MOON_ZIP_INDEX_H__
+#define __MOON_ZIP_INDEX_H__
+
+#include <glib.h>
+
+namespace Moonlight {
+
+struct ZipEntry {
+	char *name;
+	guint64 offset; // of the local header
+	guint32 compressed_size;
+	guint32 size;
+	guint32 crc;
+	guint16 method;
+	bool is_directory;
+};
+
+struct ZipExtraction {
+	ZipEntry *entry;
+	const char *path;
+};
+
+/*
+ * ZipIndex: reads the central directory of a zip file once (into a hash
+ * table keyed by the case folded name of the entries), and extracts
+ * entries straight out of a read-only mapping of the file. Looking up an
+ * entry doesn't scan the central directory like unzLocateFile does, and
+ * extracting entries doesn't touch any shared state, so independent
+ * entries can be extracted in parallel.
+ *
+ * Only the stored and deflated methods are supported, and neither zip64
+ * nor encrypted archives (Open fails, fall back to minizip for those).
+ */
+class ZipIndex {
+	GPtrArray *entries;
+	GHashTable *names;
+	guint8 *data;
+	gsize length;
+
+	ZipIndex ();
+
+	bool Load ();
+	const guint8 *GetEntryData (ZipEntry *entry);
+
+public:
+	~ZipIndex ();
+
+	// Returns NULL if @filename can't be mapped or isn't a zip file we support.
+	static ZipIndex *Open (const char *filename);
+
+	guint GetCount () { return entries->len; }
+	ZipEntry *GetEntry (guint i) { return (ZipEntry *) entries->pdata [i]; }
+
+	// case-insensitive, like unzLocateFile (..., 2)
+	ZipEntry *Find (const char *name);
+
+	// The contents of a stored (uncompressed) entry, without copying them
+	// (valid for the lifetime of the index). NULL if the entry is compressed.
+	const guint8 *GetStoredData (ZipEntry *entry);
+
+	// @buffer must be entry->size bytes. Verifies the crc.
+	bool Extract (ZipEntry *entry, guint8 *buffer);
+	// Returns a nul terminated copy of the contents (which may contain nuls),
+	// NULL if it can't be extracted or there isn't enough memory.
+	guint8 *ExtractToBuffer (ZipEntry *entry);
+	// Doesn't touch @path if it already exists: fails, and sets @existed if given.
+	bool ExtractToFile (ZipEntry *entry, const char *path, bool *existed = NULL);
+
+	// Extracts the entries to their paths (the directories must exist),
+	// inflating on up to @max_threads threads (0 to use all the cores).
+	// The files are processed in the given order, files which already
+	// exist are left alone.
+	bool ExtractFiles (ZipExtraction *files, guint n, int max_threads = 0);
+
+	// Whether @name can be extracted below a directory: it's relative and
+	// has no ".." components.
+	static bool IsSafeName (const char *name);
+};
+
+};
+
+#endif /* __MOON_ZIP_INDEX_H__ */
@@ -0,0 +1,354 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <stdlib.h>
+
+#include "pipeline-asf.h"
+#include "clock.h"
+
+using namespace Moonlight;
+
+#define PACKET_SIZE 3200
+#define KEY_FRAME_INTERVAL 5000 /* ms */
+
+static void
+put_uint16 (GByteArray *array, guint16 v)
+{
+	guint8 b [2] = { (guint8) v, (guint8) (v >> 8) };
+	g_byte_array_append (array, b, 2);
+}
+
+static void
+put_uint32 (GByteArray *array, guint32 v)
+{
+	guint8 b [4] = { (guint8) v, (guint8) (v >> 8), (guint8) (v >> 16), (guint8) (v >> 24) };
+	g_byte_array_append (array, b, 4);
+}
+
+static void
+put_uint64 (GByteArray *array, guint64 v)
+{
+	put_uint32 (array, (guint32) v);
+	put_uint32 (array, (guint32) (v >> 32));
+}
+
+/*
+ * The packets of a variable bitrate file: packet_times [i] is the time (in ms)
+ * of the first frame in packet i, the bitrate goes up and down every few minutes.
+ */
+static guint32 *
+create_packet_times (guint32 duration, guint32 *packet_count)
+{
+	GArray *times = g_array_new (false, false, sizeof (guint32));
+	guint32 time = 0;
+
+	while (time < duration) {
+		g_array_append_val (times, time);
+		time += (time / 180000) % 2 == 0 ? 20 : 180;
+	}
+
+	*packet_count = times->len;
+	return (guint32 *) g_array_free (times, false);
+}
+
+/* The packet with the last key frame at or before @time */
+static guint32
+key_frame_packet (guint32 *packet_times, guint32 packet_count, guint32 time)
+{
+	guint32 key_frame = time - time % KEY_FRAME_INTERVAL;
+	guint32 lo = 0, hi = packet_count;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+		if (packet_times [mid] > key_frame)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo - 1;
+}
+
+/* A Simple Index object (without its guid and size), with an entry every second */
+static GByteArray *
+create_simple_index (guint32 *packet_times, guint32 packet_count, guint32 duration)
+{
+	GByteArray *array = g_byte_array_new ();
+	guint32 count = duration / 1000;
+
+	for (int i = 0; i < 4; i++)
+		put_uint32 (array, 0); /* file id */
+	put_uint64 (array, MilliSeconds_ToPts (1000));
+	put_uint32 (array, 1); /* maximum packet count */
+	put_uint32 (array, count);
+
+	for (guint32 i = 0; i < count; i++) {
+		put_uint32 (array, key_frame_packet (packet_times, packet_count, i * 1000));
+		put_uint16 (array, 1);
+	}
+
+	return array;
+}
+
+TEST(ASFSeekIndex, SimpleIndex)
+{
+	guint32 duration = 3 * 60 * 60 * 1000;
+	guint32 packet_count;
+	guint32 *packet_times = create_packet_times (duration, &packet_count);
+	GByteArray *array = create_simple_index (packet_times, packet_count, duration);
+	ASFSeekIndex *index;
+
+	index = ASFSeekIndex::ReadSimpleIndex (array->data, array->len);
+	ASSERT_TRUE (index != NULL);
+	ASSERT_EQ (duration / 1000, index->count);
+	ASSERT_EQ (MilliSeconds_ToPts (1000), index->interval);
+
+	for (guint32 time = 0; time < duration; time += 777) {
+		/* the key frames are on whole seconds, so the entry at or before time points at the right one */
+		ASSERT_EQ (key_frame_packet (packet_times, packet_count, time), index->Lookup (MilliSeconds_ToPts (time)));
+	}
+
+	/* Past the end */
+	ASSERT_EQ (key_frame_packet (packet_times, packet_count, duration - 1), index->Lookup (G_MAXUINT64));
+
+	/* Truncated */
+	ASSERT_TRUE (ASFSeekIndex::ReadSimpleIndex (array->data, array->len - 1) == NULL);
+	ASSERT_TRUE (ASFSeekIndex::ReadSimpleIndex (array->data, 20) == NULL);
+
+	delete index;
+	g_byte_array_free (array, true);
+	g_free (packet_times);
+}
+
+TEST(ASFSeekIndex, Index)
+{
+	GByteArray *array = g_byte_array_new ();
+	ASFSeekIndex *indices [127];
+	guint32 interval = 2000;
+
+	memset (indices, 0, sizeof (indices));
+
+	put_uint32 (array, interval);
+	put_uint16 (array, 2); /* index specifiers */
+	put_uint32 (array, 2); /* index blocks */
+	put_uint16 (array, 1); /* stream 1 */
+	put_uint16 (array, 1); /* nearest past data packet */
+	put_uint16 (array, 3); /* stream 3 */
+	put_uint16 (array, 3); /* nearest past cleanpoint */
+
+	/* block 1: 3 entries, starting at packets 0 and 1 */
+	put_uint32 (array, 3);
+	put_uint64 (array, 0);
+	put_uint64 (array, PACKET_SIZE);
+	for (guint32 e = 0; e < 3; e++) {
+		put_uint32 (array, e * 10 * PACKET_SIZE);
+		put_uint32 (array, e == 1 ? G_MAXUINT32 : e * 10 * PACKET_SIZE);
+	}
+
+	/* block 2: 2 entries, starting at packet 100 */
+	put_uint32 (array, 2);
+	put_uint64 (array, 100 * PACKET_SIZE);
+	put_uint64 (array, 100 * PACKET_SIZE);
+	for (guint32 e = 0; e < 2; e++) {
+		put_uint32 (array, e * 10 * PACKET_SIZE + 5);
+		put_uint32 (array, e * 10 * PACKET_SIZE + 5);
+	}
+
+	ASSERT_EQ (2, ASFSeekIndex::ReadIndex (array->data, array->len, PACKET_SIZE, indices));
+	ASSERT_TRUE (indices [0] != NULL);
+	ASSERT_TRUE (indices [1] == NULL);
+	ASSERT_TRUE (indices [2] != NULL);
+	ASSERT_EQ (5u, indices [0]->count);
+	ASSERT_EQ (MilliSeconds_ToPts (interval), indices [0]->interval);
+
+	ASSERT_EQ (0u, indices [0]->Lookup (0));
+	ASSERT_EQ (10u, indices [0]->Lookup (MilliSeconds_ToPts (2000)));
+	ASSERT_EQ (20u, indices [0]->Lookup (MilliSeconds_ToPts (5999)));
+	ASSERT_EQ (100u, indices [0]->Lookup (MilliSeconds_ToPts (6000)));
+	ASSERT_EQ (110u, indices [0]->Lookup (G_MAXUINT64));
+
+	/* the entry without a key frame falls back to the previous one */
+	ASSERT_EQ (1u, indices [2]->Lookup (MilliSeconds_ToPts (3000)));
+	ASSERT_EQ (21u, indices [2]->Lookup (MilliSeconds_ToPts (4000)));
+
+	delete indices [0];
+	delete indices [2];
+	memset (indices, 0, sizeof (indices));
+
+	/* A truncated index keeps the complete blocks */
+	ASSERT_EQ (2, ASFSeekIndex::ReadIndex (array->data, array->len - 1, PACKET_SIZE, indices));
+	ASSERT_EQ (3u, indices [0]->count);
+
+	delete indices [0];
+	delete indices [2];
+	g_byte_array_free (array, true);
+}
+
+/*
+ * A file with an Index object for its audio (1) and video (3) streams and
+ * a stream which isn't in the file (2), followed by a Simple Index object
+ * for the video stream.
+ */
+#define ELEPHANTS_DREAM TEST_MEDIA_DIR "/video/ElephantsDream.en_fr.wmv"
+#define ELEPHANTS_DREAM_PACKET_SIZE 12850
+
+/* The objects after the data object */
+static const guint8 *
+get_index_objects (const guint8 *file, gsize length, guint64 *size)
+{
+	guint64 header_size, data_size;
+
+	memcpy (&header_size, file + 16, 8);
+	header_size = GUINT64_FROM_LE (header_size);
+	memcpy (&data_size, file + header_size + 16, 8);
+	data_size = GUINT64_FROM_LE (data_size);
+	*size = length - header_size - data_size;
+
+	return file + header_size + data_size;
+}
+
+TEST(ASFSeekIndex, ReadObjects)
+{
+	ASFSeekIndex::StreamKind streams [127];
+	ASFSeekIndex *indices [127];
+	ASFSeekIndex *simple [127];
+	const guint8 *objects;
+	guint64 size;
+	gchar *file;
+	gsize length;
+
+	ASSERT_TRUE (g_file_get_contents (ELEPHANTS_DREAM, &file, &length, NULL));
+	objects = get_index_objects ((const guint8 *) file, length, &size);
+
+	for (int i = 0; i < 127; i++)
+		streams [i] = ASFSeekIndex::NoStream;
+	streams [0] = ASFSeekIndex::OtherStream;
+	streams [2] = ASFSeekIndex::VideoStream;
+
+	memset (indices, 0, sizeof (indices));
+	ASFSeekIndex::ReadObjects (objects, size, ELEPHANTS_DREAM_PACKET_SIZE, streams, indices);
+
+	for (int i = 0; i < 127; i++)
+		ASSERT_EQ (i == 0 || i == 2, indices [i] != NULL) << "stream " << i + 1;
+
+	ASSERT_EQ (36u, indices [0]->count);
+	ASSERT_EQ (0u, indices [0]->Lookup (0));
+	ASSERT_EQ (2u, indices [0]->Lookup (MilliSeconds_ToPts (6000)));
+	ASSERT_EQ (5u, indices [0]->Lookup (MilliSeconds_ToPts (7999)));
+	ASSERT_EQ (146u, indices [0]->Lookup (G_MAXUINT64));
+
+	ASSERT_EQ (36u, indices [2]->count);
+	ASSERT_EQ (0u, indices [2]->Lookup (MilliSeconds_ToPts (14999)));
+	ASSERT_EQ (54u, indices [2]->Lookup (MilliSeconds_ToPts (15000)));
+	ASSERT_EQ (138u, indices [2]->Lookup (G_MAXUINT64));
+
+	/* Just the Simple Index object (the second one): it's assigned to the first video stream and agrees with the Index object */
+	memset (simple, 0, sizeof (simple));
+	ASFSeekIndex::ReadObjects (objects + 506, size - 506, ELEPHANTS_DREAM_PACKET_SIZE, streams, simple);
+	for (int i = 0; i < 127; i++)
+		ASSERT_EQ (i == 2, simple [i] != NULL) << "stream " << i + 1;
+	ASSERT_EQ (MilliSeconds_ToPts (1000), simple [2]->interval);
+	for (guint32 i = 0; i < 36; i++)
+		ASSERT_EQ (indices [2]->packets [i], simple [2]->packets [i]) << "entry " << i;
+
+	/* An Index object replaces a simple index, a Simple Index object doesn't replace an index */
+	for (int i = 0; i < 127; i++)
+		delete simple [i];
+	memset (simple, 0, sizeof (simple));
+	streams [0] = ASFSeekIndex::VideoStream;
+	ASFSeekIndex::ReadObjects (objects + 506, size - 506, ELEPHANTS_DREAM_PACKET_SIZE, streams, simple);
+	ASSERT_TRUE (simple [0] != NULL);
+	ASSERT_EQ (0u, simple [0]->Lookup (MilliSeconds_ToPts (6000)));
+	ASFSeekIndex::ReadObjects (objects, size, ELEPHANTS_DREAM_PACKET_SIZE, streams, simple);
+	ASSERT_EQ (2u, simple [0]->Lookup (MilliSeconds_ToPts (6000)));
+	ASSERT_EQ (54u, simple [2]->Lookup (MilliSeconds_ToPts (15000)));
+
+	/* A truncated object ends the parsing */
+	for (int i = 0; i < 127; i++) {
+		delete indices [i];
+		delete simple [i];
+	}
+	memset (indices, 0, sizeof (indices));
+	ASFSeekIndex::ReadObjects (objects, 505, ELEPHANTS_DREAM_PACKET_SIZE, streams, indices);
+	for (int i = 0; i < 127; i++)
+		ASSERT_TRUE (indices [i] == NULL);
+
+	g_free (file);
+}
+
+TEST(ASFSeekIndex, KeyFrameTable)
+{
+	ASFKeyFrameTable table;
+
+	/* Nothing read yet */
+	ASSERT_EQ (G_MAXUINT64, table.Find (0));
+
+	/* Key frames every 5 seconds from 10s to 60s, added out of order like after a seek */
+	for (guint64 s = 35; s <= 60; s += 5)
+		table.Add (MilliSeconds_ToPts (s * 1000), s * 10);
+	for (guint64 s = 10; s < 35; s += 5)
+		table.Add (MilliSeconds_ToPts (s * 1000), s * 10);
+	ASSERT_EQ (11u, table.GetCount ());
+
+	/* Key frames closer than ASF_KEY_FRAME_INTERVAL to a known one aren't kept */
+	table.Add (MilliSeconds_ToPts (12500), 125);
+	table.Add (MilliSeconds_ToPts (14500), 145);
+	table.Add (MilliSeconds_ToPts (10000), 100);
+	ASSERT_EQ (12u, table.GetCount ());
+
+	/* Before the first and after the last known key frame there may be closer ones we haven't read */
+	ASSERT_EQ (G_MAXUINT64, table.Find (MilliSeconds_ToPts (9999)));
+	ASSERT_EQ (G_MAXUINT64, table.Find (MilliSeconds_ToPts (60000)));
+	ASSERT_EQ (G_MAXUINT64, table.Find (MilliSeconds_ToPts (70000)));
+
+	ASSERT_EQ (100u, table.Find (MilliSeconds_ToPts (10000)));
+	ASSERT_EQ (100u, table.Find (MilliSeconds_ToPts (12499)));
+	ASSERT_EQ (125u, table.Find (MilliSeconds_ToPts (12500)));
+	ASSERT_EQ (150u, table.Find (MilliSeconds_ToPts (15000)));
+	ASSERT_EQ (550u, table.Find (MilliSeconds_ToPts (59999)));
+
+	/* Too far apart for us to have read what's between them */
+	table.Add (MilliSeconds_ToPts (100000), 1000);
+	ASSERT_EQ (G_MAXUINT64, table.Find (MilliSeconds_ToPts (60000)));
+	ASSERT_EQ (G_MAXUINT64, table.Find (MilliSeconds_ToPts (99999)));
+	table.Add (MilliSeconds_ToPts (90000), 900);
+	ASSERT_EQ (600u, table.Find (MilliSeconds_ToPts (89999)));
+}
+
+/*
+ * Random seeks through a three hour variable bitrate file: the index finds
+ * the key frame's packet every time.
+ */
+TEST(ASFSeekIndex, RandomSeeks)
+{
+	guint32 duration = 3 * 60 * 60 * 1000;
+	guint32 packet_count;
+	guint32 *packet_times = create_packet_times (duration, &packet_count);
+	GByteArray *array = create_simple_index (packet_times, packet_count, duration);
+	ASFSeekIndex *index = ASFSeekIndex::ReadSimpleIndex (array->data, array->len);
+
+	ASSERT_TRUE (index != NULL);
+
+	srand (0);
+	for (guint32 i = 0; i < 10000; i++) {
+		guint32 time = MIN (((guint64) rand () * duration) / RAND_MAX, duration - 1);
+
+		ASSERT_EQ (key_frame_packet (packet_times, packet_count, time), index->Lookup (MilliSeconds_ToPts (time)));
+	}
+
+	delete index;
+	g_byte_array_free (array, true);
+	g_free (packet_times);
+}
@@ -0,0 +1,144 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <math.h>
+
+#include "audio-mixer.h"
+
+using namespace Moonlight;
+
+TEST(AudioMixer, MixSamples)
+{
+	gint16 src [37];
+	float gains [2] = { 0.5f, 2.0f };
+	float mix [37];
+	float expected [37];
+
+	// an odd number of samples so that both the vectorised and the scalar tail are used
+	for (int i = 0; i < 37; i++) {
+		src [i] = (i * 1234) % 30000 - 15000;
+		mix [i] = expected [i] = i;
+	}
+
+	MixerPlayer::MixSamples (mix, src, gains, 1, 37);
+	for (int i = 0; i < 37; i++)
+		expected [i] += src [i] * gains [0];
+	for (int i = 0; i < 37; i++)
+		EXPECT_FLOAT_EQ (expected [i], mix [i]);
+
+	MixerPlayer::MixSamples (mix, src, gains, 2, 36);
+	for (int i = 0; i < 36; i++)
+		expected [i] += src [i] * gains [i % 2];
+	for (int i = 0; i < 37; i++)
+		EXPECT_FLOAT_EQ (expected [i], mix [i]);
+
+	// float input
+	MixerPlayer::MixSamples (mix, expected, gains, 2, 37);
+	for (int i = 0; i < 37; i++)
+		EXPECT_FLOAT_EQ (expected [i] + expected [i] * gains [i % 2], mix [i]);
+}
+
+TEST(AudioMixer, PackSamples)
+{
+	float mix [19];
+	gint16 dest [19];
+
+	for (int i = 0; i < 19; i++)
+		mix [i] = i * 100.25f;
+	mix [0] = 1e9f;
+	mix [1] = -1e9f;
+	mix [2] = 32767.4f;
+	mix [3] = -32768.6f;
+	mix [17] = -1e9f;
+	mix [18] = 1e9f;
+
+	MixerPlayer::PackSamples (dest, mix, 19);
+
+	EXPECT_EQ (32767, dest [0]);
+	EXPECT_EQ (-32768, dest [1]);
+	EXPECT_EQ (32767, dest [2]);
+	EXPECT_EQ (-32768, dest [3]);
+	EXPECT_EQ (401, dest [4]);
+	EXPECT_EQ (-32768, dest [17]);
+	EXPECT_EQ (32767, dest [18]);
+}
+
+TEST(AudioMixer, PackSamplesRounding)
+{
+	float mix [16] = { 0.5f, 1.5f, 2.5f, -0.5f, -1.5f, -2.5f, 0.49f, -0.51f,
+			   0.5f, 1.5f, 2.5f, -0.5f, -1.5f, -2.5f, 0.49f, -0.51f };
+	gint16 expected [8] = { 0, 2, 2, 0, -2, -2, 0, -1 };
+	gint16 dest [16];
+
+	// the first 8 go through the vectorised path (if there is one), the rest through the scalar one
+	for (int sse2 = 0; sse2 < 2; sse2++) {
+		MixerPlayer::SetUseSSE2 (sse2);
+		MixerPlayer::PackSamples (dest, mix, 16);
+		for (int i = 0; i < 16; i++)
+			EXPECT_EQ (expected [i % 8], dest [i]) << "sample " << i << " sse2 " << sse2;
+	}
+
+	MixerPlayer::SetUseSSE2 (true);
+}
+
+/* A 22050Hz mono source mixed with some balance into a 44100Hz stereo device */
+static guint32
+mix_resampled (gint16 *dest, const gint16 *input, guint32 input_frames, guint32 frames)
+{
+	float gains [2] = { 0.25f, 1.75f };
+	float *resampled = (float *) g_malloc0 (sizeof (float) * frames * 2);
+	float *mix = (float *) g_malloc0 (sizeof (float) * frames * 2);
+	guint64 position = 0;
+	guint32 result;
+
+	result = MixerPlayer::Resample (resampled, input, input_frames, 1, 2, &position, ((guint64) 22050 << 32) / 44100, frames);
+	MixerPlayer::MixSamples (mix, resampled, gains, 2, result * 2);
+	// and the source again, as if it was a stereo one at the device rate
+	MixerPlayer::MixSamples (mix, input, gains, 2, MIN (input_frames, result * 2));
+	MixerPlayer::PackSamples (dest, mix, result * 2);
+
+	g_free (resampled);
+	g_free (mix);
+
+	return result;
+}
+
+TEST(AudioMixer, MixResampled)
+{
+	gint16 input [501];
+	gint16 scalar [2000];
+	gint16 sse2 [2000];
+	guint32 n;
+
+	for (int i = 0; i < 501; i++)
+		input [i] = (gint16) ((i * 7919) % 65536 - 32768);
+
+	MixerPlayer::SetUseSSE2 (false);
+	n = mix_resampled (scalar, input, 501, 1000);
+	MixerPlayer::SetUseSSE2 (true);
+	ASSERT_EQ (n, mix_resampled (sse2, input, 501, 1000));
+
+	// every input frame but the last one (which is only interpolated towards) yields 2 output frames
+	ASSERT_EQ (1000u, n);
+
+	// the first frame is the first input sample, mapped onto both channels
+	EXPECT_EQ ((gint16) lrintf (CLAMP (input [0] * 0.25f + input [0] * 0.25f, -32768.0f, 32767.0f)), scalar [0]);
+	EXPECT_EQ ((gint16) lrintf (CLAMP (input [0] * 1.75f + input [1] * 1.75f, -32768.0f, 32767.0f)), scalar [1]);
+	// the second one is halfway between the first two
+	EXPECT_EQ ((gint16) lrintf (CLAMP ((input [0] + input [1]) / 2.0f * 0.25f + input [2] * 0.25f, -32768.0f, 32767.0f)), scalar [2]);
+
+	for (guint32 i = 0; i < n * 2; i++)
+		ASSERT_EQ (scalar [i], sse2 [i]) << "sample " << i;
+}
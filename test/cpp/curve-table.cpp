@@ -0,0 +1,327 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <math.h>
+
+#include "curve-table.h"
+#include "easing.h"
+#include "animation.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define ERROR_POINTS 100003
+
+struct TestEase {
+	Type::Kind kind;
+	EasingMode mode;
+	double p0;
+	double p1;
+	bool accurate;
+};
+
+static TestEase test_eases [] = {
+	{ Type::BACKEASE, EasingModeIn, 1.0, 0.0, true },
+	{ Type::BACKEASE, EasingModeOut, 1.0, 0.0, true },
+	{ Type::BACKEASE, EasingModeInOut, 0.5, 0.0, true },
+	{ Type::ELASTICEASE, EasingModeOut, 3, 3.0, true },
+	{ Type::ELASTICEASE, EasingModeIn, 3, 3.0, true },
+	{ Type::EXPONENTIALEASE, EasingModeOut, 2.0, 0.0, true },
+	{ Type::EXPONENTIALEASE, EasingModeInOut, 6.0, 0.0, true },
+	{ Type::POWEREASE, EasingModeIn, 2.0, 0.0, true },
+	{ Type::POWEREASE, EasingModeOut, 3.0, 0.0, true },
+	{ Type::SINEEASE, EasingModeInOut, 0.0, 0.0, true },
+	/* vertical tangent at 0 */
+	{ Type::POWEREASE, EasingModeIn, 0.5, 0.0, false },
+	/* too many oscillations for the samples */
+	{ Type::ELASTICEASE, EasingModeOut, 10, 1.0, false },
+	/* 0 / 0 */
+	{ Type::EXPONENTIALEASE, EasingModeIn, 0.0, 0.0, false },
+};
+
+static EasingFunctionBase *
+create_ease (TestEase *test)
+{
+	EasingFunctionBase *ease = NULL;
+
+	unit_init_runtime ();
+
+	switch (test->kind) {
+	case Type::BACKEASE: {
+		BackEase *back = MoonUnmanagedFactory::CreateBackEase ();
+		back->SetAmplitude (test->p0);
+		ease = back;
+		break;
+	}
+	case Type::ELASTICEASE: {
+		ElasticEase *elastic = MoonUnmanagedFactory::CreateElasticEase ();
+		elastic->SetOscillations ((int) test->p0);
+		elastic->SetSpringiness (test->p1);
+		ease = elastic;
+		break;
+	}
+	case Type::EXPONENTIALEASE: {
+		ExponentialEase *exponential = MoonUnmanagedFactory::CreateExponentialEase ();
+		exponential->SetExponent (test->p0);
+		ease = exponential;
+		break;
+	}
+	case Type::POWEREASE: {
+		PowerEase *power = MoonUnmanagedFactory::CreatePowerEase ();
+		power->SetPower (test->p0);
+		ease = power;
+		break;
+	}
+	case Type::SINEEASE:
+		ease = MoonUnmanagedFactory::CreateSineEase ();
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	ease->SetEasingMode (test->mode);
+
+	return ease;
+}
+
+static KeySpline *
+create_spline (double x1, double y1, double x2, double y2)
+{
+	KeySpline *spline;
+	Point c1 (x1, y1);
+	Point c2 (x2, y2);
+
+	unit_init_runtime ();
+
+	spline = MoonUnmanagedFactory::CreateKeySpline ();
+	spline->SetControlPoint1 (&c1);
+	spline->SetControlPoint2 (&c2);
+
+	return spline;
+}
+
+/* NaN (0 / 0) included */
+static bool
+same_value (double a, double b)
+{
+	return a == b || (isnan (a) && isnan (b));
+}
+
+/* Evaluates @ease as often as an animation has to before it gets a table */
+static void
+warm_up (EasingFunctionBase *ease)
+{
+	for (int i = 0; i < CURVE_TABLE_MIN_EVALUATIONS; i++)
+		ease->Ease (i / (double) CURVE_TABLE_MIN_EVALUATIONS);
+}
+
+static void
+warm_up (KeySpline *spline)
+{
+	for (int i = 0; i < CURVE_TABLE_MIN_EVALUATIONS; i++)
+		spline->GetSplineProgress (i / (double) CURVE_TABLE_MIN_EVALUATIONS);
+}
+
+static double
+get_max_error (EasingFunctionBase *ease)
+{
+	double max = 0.0;
+
+	for (int i = 0; i <= ERROR_POINTS; i++) {
+		double t = i / (double) ERROR_POINTS;
+		max = MAX (max, fabs (ease->Ease (t) - ease->EaseWithMode (t)));
+	}
+
+	return max;
+}
+
+static double
+get_max_error (KeySpline *spline)
+{
+	double max = 0.0;
+
+	for (int i = 0; i <= ERROR_POINTS; i++) {
+		double t = i / (double) ERROR_POINTS;
+		max = MAX (max, fabs (spline->GetSplineProgress (t) - spline->SolveSpline (t)));
+	}
+
+	return max;
+}
+
+TEST(CurveTable, EasingAccuracy)
+{
+	for (guint i = 0; i < G_N_ELEMENTS (test_eases); i++) {
+		TestEase *test = &test_eases [i];
+		EasingFunctionBase *ease = create_ease (test);
+
+		warm_up (ease);
+		ASSERT_EQ (test->accurate, ease->IsTabulated ()) << "ease " << i;
+
+		if (ease->IsTabulated ()) {
+			ASSERT_LE (get_max_error (ease), CURVE_TABLE_MAX_ERROR) << "ease " << i;
+			ASSERT_EQ (ease->EaseWithMode (0.0), ease->Ease (0.0)) << "ease " << i;
+			ASSERT_EQ (ease->EaseWithMode (1.0), ease->Ease (1.0)) << "ease " << i;
+		} else {
+			ASSERT_TRUE (same_value (ease->EaseWithMode (0.3), ease->Ease (0.3))) << "ease " << i;
+		}
+
+		/* outside of [0, 1] the curve is always evaluated */
+		ASSERT_TRUE (same_value (ease->EaseWithMode (1.25), ease->Ease (1.25))) << "ease " << i;
+
+		ease->unref ();
+	}
+}
+
+TEST(CurveTable, SplineAccuracy)
+{
+	struct {
+		double x1, y1, x2, y2;
+		bool accurate;
+	} splines [] = {
+		{ 0.25, 0.1, 0.25, 1.0, true },
+		{ 0.42, 0.0, 0.58, 1.0, true },
+		{ 0.6, 0.0, 0.4, 1.0, true },
+		/* vertical tangent at 0 */
+		{ 0.0, 1.0, 0.0, 1.0, false },
+	};
+
+	for (guint i = 0; i < G_N_ELEMENTS (splines); i++) {
+		KeySpline *spline = create_spline (splines [i].x1, splines [i].y1, splines [i].x2, splines [i].y2);
+
+		warm_up (spline);
+		ASSERT_EQ (splines [i].accurate, spline->IsTabulated ()) << "spline " << i;
+
+		if (spline->IsTabulated ())
+			ASSERT_LE (get_max_error (spline), CURVE_TABLE_MAX_ERROR) << "spline " << i;
+		else
+			ASSERT_EQ (spline->SolveSpline (0.3), spline->GetSplineProgress (0.3)) << "spline " << i;
+
+		spline->unref ();
+	}
+}
+
+/* A curve is only sampled once it has been evaluated CURVE_TABLE_MIN_EVALUATIONS times */
+TEST(CurveTable, MinEvaluations)
+{
+	EasingFunctionBase *ease = create_ease (&test_eases [3]);
+	KeySpline *spline = create_spline (0.25, 0.1, 0.25, 1.0);
+
+	for (int i = 1; i < CURVE_TABLE_MIN_EVALUATIONS; i++) {
+		ASSERT_EQ (ease->EaseWithMode (0.3), ease->Ease (0.3));
+		ASSERT_FALSE (ease->IsTabulated ()) << "after " << i << " evaluations";
+
+		ASSERT_EQ (spline->SolveSpline (0.3), spline->GetSplineProgress (0.3));
+		ASSERT_FALSE (spline->IsTabulated ()) << "after " << i << " evaluations";
+	}
+
+	ease->Ease (0.3);
+	ASSERT_TRUE (ease->IsTabulated ());
+
+	spline->GetSplineProgress (0.3);
+	ASSERT_TRUE (spline->IsTabulated ());
+
+	ease->unref ();
+	spline->unref ();
+}
+
+/* Changing a property the curve depends on drops the table, and the count starts over */
+TEST(CurveTable, InvalidateEase)
+{
+	BackEase *back = (BackEase *) create_ease (&test_eases [0]);
+	double before;
+
+	warm_up (back);
+	ASSERT_TRUE (back->IsTabulated ());
+	before = back->Ease (0.3);
+
+	back->SetAmplitude (0.5);
+	ASSERT_FALSE (back->IsTabulated ());
+	ASSERT_EQ (back->EaseWithMode (0.3), back->Ease (0.3));
+	ASSERT_GT (fabs (before - back->Ease (0.3)), CURVE_TABLE_MAX_ERROR);
+
+	warm_up (back);
+	ASSERT_TRUE (back->IsTabulated ());
+	ASSERT_LE (get_max_error (back), CURVE_TABLE_MAX_ERROR);
+
+	/* so does the easing mode */
+	back->SetEasingMode (EasingModeOut);
+	ASSERT_FALSE (back->IsTabulated ());
+	ASSERT_EQ (back->EaseWithMode (0.3), back->Ease (0.3));
+
+	warm_up (back);
+	ASSERT_TRUE (back->IsTabulated ());
+	ASSERT_LE (get_max_error (back), CURVE_TABLE_MAX_ERROR);
+
+	back->unref ();
+}
+
+TEST(CurveTable, InvalidateSpline)
+{
+	KeySpline *spline = create_spline (0.25, 0.1, 0.25, 1.0);
+	Point c1 (0.6, 0.0);
+	double before;
+
+	warm_up (spline);
+	ASSERT_TRUE (spline->IsTabulated ());
+	before = spline->GetSplineProgress (0.3);
+
+	spline->SetControlPoint1 (&c1);
+	ASSERT_FALSE (spline->IsTabulated ());
+	ASSERT_EQ (spline->SolveSpline (0.3), spline->GetSplineProgress (0.3));
+	ASSERT_GT (fabs (before - spline->GetSplineProgress (0.3)), CURVE_TABLE_MAX_ERROR);
+
+	warm_up (spline);
+	ASSERT_TRUE (spline->IsTabulated ());
+	ASSERT_LE (get_max_error (spline), CURVE_TABLE_MAX_ERROR);
+
+	spline->unref ();
+}
+
+/* Curves with the same key share a table, which is only sampled once */
+
+static int samples_taken;
+
+static double
+count_samples (gpointer closure, double x)
+{
+	samples_taken++;
+	return x * x;
+}
+
+TEST(CurveTable, Shared)
+{
+	CurveTableKey key (Type::KEYSPLINE, 0, 0.1, 0.2, 0.3, 0.4);
+	CurveTableKey other (Type::KEYSPLINE, 0, 0.1, 0.2, 0.3, 0.5);
+	CurveTable *a, *b, *c;
+	int taken;
+
+	samples_taken = 0;
+	a = CurveTable::Get (&key, count_samples, NULL);
+	ASSERT_TRUE (a != NULL);
+	ASSERT_GT (samples_taken, CurveTable::segments);
+	taken = samples_taken;
+
+	b = CurveTable::Get (&key, count_samples, NULL);
+	ASSERT_TRUE (a == b);
+	ASSERT_EQ (taken, samples_taken);
+
+	c = CurveTable::Get (&other, count_samples, NULL);
+	ASSERT_TRUE (a != c);
+	ASSERT_GT (samples_taken, taken);
+
+	CurveTable::Unref (a);
+	CurveTable::Unref (b);
+	CurveTable::Unref (c);
+}
@@ -0,0 +1,181 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "dirty.h"
+
+using namespace Moonlight;
+
+#define NODE_COUNT 6
+
+/* The levels of the nodes, in the order they're added */
+static const int levels [NODE_COUNT] = { 2, 0, 5, 2, 1, 5 };
+
+static void
+add_nodes (DirtyLists *lists, DirtyNode *nodes)
+{
+	for (int i = 0; i < NODE_COUNT; i++)
+		lists->AddDirtyNode (&nodes [i], levels [i]);
+}
+
+/* Pops the nodes in processing order, checking their levels are sorted */
+static void
+check_order (DirtyLists *lists, bool ascending, int expected_count)
+{
+	int count = 0;
+	int last = ascending ? -1 : G_MAXINT;
+
+	while (DirtyNode *node = lists->GetFirst ()) {
+		if (ascending)
+			ASSERT_LE (last, node->level);
+		else
+			ASSERT_GE (last, node->level);
+		last = node->level;
+
+		lists->RemoveDirtyNode (node);
+		ASSERT_FALSE (node->IsLinked ());
+		count++;
+	}
+
+	ASSERT_EQ (expected_count, count);
+	ASSERT_TRUE (lists->IsEmpty ());
+}
+
+/* The up pass handles children (the deepest elements) before their parents */
+TEST(DirtyLists, UpDescending)
+{
+	DirtyLists lists (false);
+	DirtyNode nodes [NODE_COUNT];
+
+	add_nodes (&lists, nodes);
+	ASSERT_EQ (5, lists.GetFirst ()->level);
+	ASSERT_EQ (&nodes [2], lists.GetFirst ());
+	check_order (&lists, false, NODE_COUNT);
+}
+
+/* The down pass handles parents before their children */
+TEST(DirtyLists, DownAscending)
+{
+	DirtyLists lists (true);
+	DirtyNode nodes [NODE_COUNT];
+
+	add_nodes (&lists, nodes);
+	ASSERT_EQ (&nodes [1], lists.GetFirst ());
+	check_order (&lists, true, NODE_COUNT);
+}
+
+/* Nodes in the same bucket keep the order they were added in */
+TEST(DirtyLists, SameLevelFifo)
+{
+	DirtyLists lists (true);
+	DirtyNode nodes [NODE_COUNT];
+
+	add_nodes (&lists, nodes);
+	lists.RemoveDirtyNode (&nodes [1]);
+	lists.RemoveDirtyNode (&nodes [4]);
+	ASSERT_EQ (&nodes [0], lists.GetFirst ());
+	lists.RemoveDirtyNode (&nodes [0]);
+	ASSERT_EQ (&nodes [3], lists.GetFirst ());
+}
+
+/* Buckets emptied behind the cursor are skipped, and adding a node to an
+ * earlier bucket (while the pass runs) moves the cursor back */
+TEST(DirtyLists, SkipEmptyBuckets)
+{
+	DirtyLists up (false), down (true);
+	DirtyNode up_nodes [NODE_COUNT], down_nodes [NODE_COUNT];
+
+	add_nodes (&up, up_nodes);
+	add_nodes (&down, down_nodes);
+
+	/* empty the first bucket of each list */
+	up.RemoveDirtyNode (&up_nodes [2]);
+	up.RemoveDirtyNode (&up_nodes [5]);
+	ASSERT_EQ (2, up.GetFirst ()->level);
+	down.RemoveDirtyNode (&down_nodes [1]);
+	ASSERT_EQ (1, down.GetFirst ()->level);
+
+	/* and the next ones (levels 3 and 4 never had anything) */
+	up.RemoveDirtyNode (&up_nodes [0]);
+	up.RemoveDirtyNode (&up_nodes [3]);
+	ASSERT_EQ (&up_nodes [4], up.GetFirst ());
+
+	down.RemoveDirtyNode (&down_nodes [4]);
+	down.RemoveDirtyNode (&down_nodes [0]);
+	down.RemoveDirtyNode (&down_nodes [3]);
+	ASSERT_EQ (5, down.GetFirst ()->level);
+
+	/* a node added before the cursor comes first */
+	up.AddDirtyNode (&up_nodes [2], 7);
+	ASSERT_EQ (&up_nodes [2], up.GetFirst ());
+	down.AddDirtyNode (&down_nodes [1], 0);
+	ASSERT_EQ (&down_nodes [1], down.GetFirst ());
+
+	check_order (&up, false, 3);
+	check_order (&down, true, 3);
+
+	/* an emptied list starts over */
+	ASSERT_TRUE (up.GetFirst () == NULL);
+	up.AddDirtyNode (&up_nodes [0], 1);
+	ASSERT_EQ (&up_nodes [0], up.GetFirst ());
+	check_order (&up, false, 1);
+}
+
+/* A dirty element which is reparented is processed at its new depth */
+TEST(DirtyLists, MoveAfterReparent)
+{
+	DirtyLists up (false), down (true);
+	DirtyNode up_nodes [NODE_COUNT], down_nodes [NODE_COUNT];
+
+	add_nodes (&up, up_nodes);
+	add_nodes (&down, down_nodes);
+
+	/* from the deepest level to the root, and the other way around */
+	up.MoveDirtyNode (&up_nodes [2], 0);
+	ASSERT_EQ (0, up_nodes [2].level);
+	ASSERT_EQ (&up_nodes [5], up.GetFirst ());
+	down.MoveDirtyNode (&down_nodes [1], 6);
+	ASSERT_EQ (6, down_nodes [1].level);
+	ASSERT_EQ (&down_nodes [4], down.GetFirst ());
+
+	/* moving to the same level keeps the position in the bucket */
+	down.MoveDirtyNode (&down_nodes [0], 2);
+	up.RemoveDirtyNode (&up_nodes [5]);
+	up.RemoveDirtyNode (&up_nodes [0]);
+	down.RemoveDirtyNode (&down_nodes [4]);
+	ASSERT_EQ (&down_nodes [0], down.GetFirst ());
+
+	/* unlinked nodes aren't added */
+	up.MoveDirtyNode (&up_nodes [0], 3);
+	ASSERT_FALSE (up_nodes [0].IsLinked ());
+
+	ASSERT_EQ (&up_nodes [3], up.GetFirst ());
+	check_order (&up, false, 4);
+
+	check_order (&down, true, 5);
+}
+
+/* Clear unlinks everything */
+TEST(DirtyLists, Clear)
+{
+	DirtyLists lists (true);
+	DirtyNode nodes [NODE_COUNT];
+
+	add_nodes (&lists, nodes);
+	lists.Clear ();
+	ASSERT_TRUE (lists.IsEmpty ());
+	ASSERT_TRUE (lists.GetFirst () == NULL);
+	for (int i = 0; i < NODE_COUNT; i++)
+		ASSERT_FALSE (nodes [i].IsLinked ());
+}
@@ -0,0 +1,279 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "uielement.h"
+#include "border.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+/* What a handler does when it's called, and how often it was */
+struct Handler {
+	EventObject *sender;
+	int event_id;
+	int calls;
+	int destroyed; // how often its data dtor ran
+	int remove_token; // removed from the event when called, if not 0
+	Handler *add; // added to the event when called, if not NULL
+	int added_token;
+	bool emit; // emits the event again (once) when called
+};
+
+static void
+init_handler (Handler *handler, EventObject *sender, int event_id)
+{
+	memset (handler, 0, sizeof (Handler));
+	handler->sender = sender;
+	handler->event_id = event_id;
+}
+
+static void
+handler_called (EventObject *sender, EventArgs *args, gpointer closure)
+{
+	Handler *handler = (Handler *) closure;
+
+	handler->calls++;
+
+	if (handler->emit) {
+		handler->emit = false;
+		sender->Emit (handler->event_id);
+	}
+
+	if (handler->remove_token != 0)
+		sender->RemoveHandler (handler->event_id, handler->remove_token);
+
+	if (handler->add != NULL) {
+		handler->added_token = sender->AddHandler (handler->event_id, handler_called, handler->add);
+		handler->add = NULL;
+	}
+}
+
+static void
+handler_destroyed (EventObject *sender, int event_id, int token, void *closure)
+{
+	((Handler *) closure)->destroyed++;
+}
+
+static int
+add_handler (Handler *handler)
+{
+	return handler->sender->AddHandler (handler->event_id, handler_called, handler, handler_destroyed);
+}
+
+/*
+ * Handlers for more events than fit inline, added out of order: every
+ * event only reaches its own handlers, and the events nobody handles
+ * behave as if they had never been touched.
+ */
+TEST(EventLists, Sparse)
+{
+	int events [] = { UIElement::LostFocusEvent, UIElement::MouseEnterEvent, UIElement::KeyDownEvent, UIElement::GotFocusEvent };
+	Handler handlers [G_N_ELEMENTS (events)];
+	Border *border;
+
+	unit_init_runtime ();
+	border = MoonUnmanagedFactory::CreateBorder ();
+
+	for (guint i = 0; i < G_N_ELEMENTS (events); i++) {
+		init_handler (&handlers [i], border, events [i]);
+		ASSERT_EQ (1, add_handler (&handlers [i])) << "event " << events [i];
+	}
+
+	for (guint i = 0; i < G_N_ELEMENTS (events); i++) {
+		ASSERT_TRUE (border->HasHandlers (events [i])) << "event " << events [i];
+		ASSERT_TRUE (border->Emit (events [i])) << "event " << events [i];
+
+		for (guint j = 0; j < G_N_ELEMENTS (events); j++)
+			ASSERT_EQ (j <= i ? 1 : 0, handlers [j].calls) << "event " << events [j] << " after emitting " << events [i];
+	}
+
+	ASSERT_FALSE (border->HasHandlers (UIElement::MouseLeaveEvent));
+	ASSERT_FALSE (border->Emit (UIElement::MouseLeaveEvent));
+	ASSERT_EQ (1, border->GetEventGeneration (UIElement::MouseLeaveEvent));
+	border->RemoveHandler (UIElement::MouseLeaveEvent, 1);
+	ASSERT_EQ (1, border->GetEventGeneration (UIElement::MouseLeaveEvent));
+
+	border->unref ();
+
+	for (guint i = 0; i < G_N_ELEMENTS (events); i++)
+		ASSERT_EQ (1, handlers [i].destroyed) << "event " << events [i];
+}
+
+/*
+ * A handler removing another one during the emit: the removed handler is
+ * only destroyed once the emit is over, and isn't called by later emits.
+ * A handler added during the emit is only called by the next one.
+ */
+TEST(EventLists, ChangesDuringEmit)
+{
+	int event_id = UIElement::MouseEnterEvent;
+	Handler first, second, added;
+	Border *border;
+	int token;
+
+	unit_init_runtime ();
+	border = MoonUnmanagedFactory::CreateBorder ();
+
+	init_handler (&first, border, event_id);
+	init_handler (&second, border, event_id);
+	init_handler (&added, border, event_id);
+
+	add_handler (&first);
+	token = add_handler (&second);
+	first.remove_token = token;
+	first.add = &added;
+
+	ASSERT_TRUE (border->Emit (event_id));
+	ASSERT_EQ (1, first.calls);
+	ASSERT_EQ (0, added.calls);
+	ASSERT_EQ (1, second.destroyed);
+	ASSERT_EQ (token + 1, first.added_token);
+
+	first.remove_token = 0;
+	ASSERT_TRUE (border->Emit (event_id));
+	ASSERT_EQ (2, first.calls);
+	ASSERT_EQ (1, added.calls);
+	ASSERT_LE (second.calls, 1);
+
+	border->unref ();
+}
+
+/*
+ * A handler removed from an emit nested in another one is only destroyed
+ * once the outer emit is over too, the outer emit still holds on to it.
+ */
+TEST(EventLists, NestedEmit)
+{
+	int event_id = UIElement::MouseEnterEvent;
+	Handler nesting, removing, removed;
+	Border *border;
+
+	unit_init_runtime ();
+	border = MoonUnmanagedFactory::CreateBorder ();
+
+	init_handler (&nesting, border, event_id);
+	init_handler (&removing, border, event_id);
+	init_handler (&removed, border, event_id);
+
+	add_handler (&nesting);
+	add_handler (&removing);
+	removing.remove_token = add_handler (&removed);
+	nesting.emit = true;
+
+	ASSERT_TRUE (border->Emit (event_id));
+	ASSERT_EQ (2, nesting.calls);
+	ASSERT_EQ (2, removing.calls);
+	ASSERT_EQ (1, removed.destroyed);
+
+	removing.remove_token = 0;
+	ASSERT_TRUE (border->Emit (event_id));
+	ASSERT_EQ (3, nesting.calls);
+	ASSERT_EQ (3, removing.calls);
+	ASSERT_LE (removed.calls, 2);
+
+	border->unref ();
+}
+
+/*
+ * Tokens count up per event and aren't handed out again once their handler
+ * is removed, and the same token on another event is another handler.
+ */
+TEST(EventLists, Tokens)
+{
+	Handler enter [3], leave;
+	Border *border;
+
+	unit_init_runtime ();
+	border = MoonUnmanagedFactory::CreateBorder ();
+
+	for (int i = 0; i < 3; i++) {
+		init_handler (&enter [i], border, UIElement::MouseEnterEvent);
+		ASSERT_EQ (i + 1, add_handler (&enter [i]));
+	}
+	ASSERT_EQ (4, border->GetEventGeneration (UIElement::MouseEnterEvent));
+
+	init_handler (&leave, border, UIElement::MouseLeaveEvent);
+	ASSERT_EQ (1, add_handler (&leave));
+
+	/* removing token 1 of one event leaves token 1 of the other alone */
+	border->RemoveHandler (UIElement::MouseEnterEvent, 1);
+	ASSERT_EQ (1, enter [0].destroyed);
+	ASSERT_EQ (0, leave.destroyed);
+
+	ASSERT_TRUE (border->Emit (UIElement::MouseLeaveEvent));
+	ASSERT_EQ (1, leave.calls);
+
+	/* the removed token isn't reused */
+	init_handler (&enter [0], border, UIElement::MouseEnterEvent);
+	ASSERT_EQ (4, add_handler (&enter [0]));
+	ASSERT_EQ (5, border->GetEventGeneration (UIElement::MouseEnterEvent));
+
+	/* only the handlers older than a generation */
+	ASSERT_TRUE (border->Emit (UIElement::MouseEnterEvent, NULL, false, 4));
+	ASSERT_EQ (0, enter [0].calls);
+	ASSERT_EQ (1, enter [1].calls);
+	ASSERT_EQ (1, enter [2].calls);
+	ASSERT_TRUE (border->HasHandlers (UIElement::MouseEnterEvent, 4));
+	ASSERT_FALSE (border->HasHandlers (UIElement::MouseEnterEvent, 5));
+
+	border->unref ();
+}
+
+/*
+ * Once its last handler is removed (outside of an emit or from the handler
+ * itself) an event has no handlers, but its tokens carry on.
+ */
+TEST(EventLists, RemoveLast)
+{
+	int event_id = UIElement::GotFocusEvent;
+	Handler handler;
+	Border *border;
+	int token;
+
+	unit_init_runtime ();
+	border = MoonUnmanagedFactory::CreateBorder ();
+
+	init_handler (&handler, border, event_id);
+	token = add_handler (&handler);
+	border->RemoveHandler (event_id, token);
+
+	ASSERT_EQ (1, handler.destroyed);
+	ASSERT_FALSE (border->HasHandlers (event_id));
+	ASSERT_FALSE (border->Emit (event_id));
+	ASSERT_EQ (0, handler.calls);
+	ASSERT_EQ (token + 1, border->GetEventGeneration (event_id));
+
+	/* a handler removing itself */
+	init_handler (&handler, border, event_id);
+	token = add_handler (&handler);
+	ASSERT_EQ (2, token);
+	handler.remove_token = token;
+
+	ASSERT_TRUE (border->Emit (event_id));
+	ASSERT_EQ (1, handler.calls);
+	ASSERT_EQ (1, handler.destroyed);
+	ASSERT_FALSE (border->HasHandlers (event_id));
+	ASSERT_FALSE (border->Emit (event_id));
+	ASSERT_EQ (1, handler.calls);
+
+	/* and the event works as before when a handler comes back */
+	init_handler (&handler, border, event_id);
+	ASSERT_EQ (3, add_handler (&handler));
+	ASSERT_TRUE (border->Emit (event_id));
+	ASSERT_EQ (1, handler.calls);
+
+	border->unref ();
+	ASSERT_EQ (1, handler.destroyed);
+}
@@ -0,0 +1,145 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#include "font-index-cache.h"
+
+using namespace Moonlight;
+
+static char *
+create_temp_file (const char *contents)
+{
+	return unit_create_temp_file ("MoonlightFontIndexCache", contents, contents != NULL ? strlen (contents) : 0);
+}
+
+TEST(FontIndexCache, Keys)
+{
+	char *a = create_temp_file ("a font");
+	char *b = create_temp_file ("b font");
+	char *ka, *kb, *kc, *ko;
+
+	ASSERT_TRUE (a != NULL && b != NULL);
+
+	ka = FontIndexCache::CreateKey (a, "a.ttf");
+	kb = FontIndexCache::CreateKey (b, "b.ttf");
+	kc = FontIndexCache::CreateKey (a, "c.ttf");
+	ko = FontIndexCache::CreateKey (a, "{6A5D0E15-FA4C-4C3E-9D64-3F1A5E7A0F2C}.odttf");
+
+	/* the key depends on the contents, not the path or name */
+	ASSERT_TRUE (ka != NULL && kb != NULL);
+	ASSERT_STRNE (ka, kb);
+	ASSERT_STREQ (ka, kc);
+
+	/* except for obfuscated fonts, which are decoded with their name */
+	ASSERT_STRNE (ka, ko);
+
+	ASSERT_TRUE (FontIndexCache::CreateKey ("/this/does/not/exist", "a.ttf") == NULL);
+
+	g_free (ka);
+	g_free (kb);
+	g_free (kc);
+	g_free (ko);
+	g_unlink (a);
+	g_unlink (b);
+	g_free (a);
+	g_free (b);
+}
+
+TEST(FontIndexCache, SaveAndLoad)
+{
+	char *filename = create_temp_file (NULL);
+	FontIndexCacheFace faces [2];
+	FontIndexCacheEntry *entry;
+	FontIndexCache *cache;
+
+	ASSERT_TRUE (filename != NULL);
+
+	cache = new FontIndexCache (filename);
+	ASSERT_EQ (0u, cache->GetCount ());
+
+	faces [0].index = 0;
+	faces [0].style.family_name = (char *) "Some\tFamily";
+	faces [0].style.stretch = FontStretchesCondensed;
+	faces [0].style.weight = FontWeightsBold;
+	faces [0].style.style = FontStylesItalic;
+	faces [0].style.set = FontPropertyWeight | FontPropertyStyle;
+	faces [1] = faces [0];
+	faces [1].index = 1;
+	faces [1].style.family_name = (char *) "Other Family";
+
+	cache->Add ("font", false, faces, 2);
+	cache->Add ("not-a-font", false, NULL, 0);
+	cache->Add ("obfuscated", true, faces, 1);
+	ASSERT_TRUE (cache->Save ());
+	delete cache;
+
+	cache = new FontIndexCache (filename);
+	ASSERT_EQ (3u, cache->GetCount ());
+
+	entry = cache->Lookup ("font");
+	ASSERT_TRUE (entry != NULL);
+	ASSERT_FALSE (entry->obfuscated);
+	ASSERT_EQ (2, entry->nfaces);
+	ASSERT_STREQ ("Some Family", entry->faces [0].style.family_name);
+	ASSERT_STREQ ("Other Family", entry->faces [1].style.family_name);
+	ASSERT_EQ (1, entry->faces [1].index);
+	ASSERT_EQ (FontStretchesCondensed, entry->faces [1].style.stretch);
+	ASSERT_EQ (FontWeightsBold, entry->faces [1].style.weight);
+	ASSERT_EQ (FontStylesItalic, entry->faces [1].style.style);
+	ASSERT_EQ (FontPropertyWeight | FontPropertyStyle, entry->faces [1].style.set);
+
+	entry = cache->Lookup ("not-a-font");
+	ASSERT_TRUE (entry != NULL);
+	ASSERT_EQ (0, entry->nfaces);
+
+	entry = cache->Lookup ("obfuscated");
+	ASSERT_TRUE (entry != NULL);
+	ASSERT_TRUE (entry->obfuscated);
+	ASSERT_EQ (1, entry->nfaces);
+
+	ASSERT_TRUE (cache->Lookup ("unknown") == NULL);
+	delete cache;
+
+	g_unlink (filename);
+	g_free (filename);
+}
+
+TEST(FontIndexCache, Corrupt)
+{
+	char *truncated = create_temp_file ("moonlight-font-index 1\nfont\t0\t3\n\t0\t5\t400\t0\t0\tFamily\n");
+	char *garbage = create_temp_file ("garbage\nfont\t0\t0\n");
+	FontIndexCacheEntry *entry;
+	FontIndexCache *cache;
+
+	/* only the faces which made it to disk are used */
+	cache = new FontIndexCache (truncated);
+	entry = cache->Lookup ("font");
+	ASSERT_TRUE (entry != NULL);
+	ASSERT_EQ (1, entry->nfaces);
+	ASSERT_STREQ ("Family", entry->faces [0].style.family_name);
+	delete cache;
+
+	/* files in an unknown format are ignored */
+	cache = new FontIndexCache (garbage);
+	ASSERT_EQ (0u, cache->GetCount ());
+	delete cache;
+
+	g_unlink (truncated);
+	g_unlink (garbage);
+	g_free (truncated);
+	g_free (garbage);
+}
@@ -0,0 +1,190 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#ifdef USE_GLX
+
+#define Visual _XxVisual
+#define Region _XxRegion
+#define Window _XxWindow
+#include <GL/glx.h>
+#undef Visual
+#undef Region
+#undef Window
+
+#include "context-opengl.h"
+
+using namespace Moonlight;
+
+#define SIZE 64
+
+#define RED   0xffff0000
+#define GREEN 0xff00ff00
+#define BLUE  0xff0000ff
+
+class UploadSurface : public OpenGLSurface {
+public:
+	UploadSurface () : OpenGLSurface () {}
+	__GLFuncPtr GetProcAddress (const char *procname) { return glXGetProcAddressARB ((const GLubyte *) procname); }
+};
+
+class UploadContext : public OpenGLContext {
+public:
+	UploadContext (OpenGLSurface *surface) : OpenGLContext (surface) {}
+	bool HasPixelBuffers () { return hasPixelBuffers; }
+	GLuint Upload (GLSurface *surface) { return GetTexture (surface); }
+};
+
+struct Offscreen {
+	Display *display;
+	GLXPbuffer pbuffer;
+	GLXContext context;
+};
+
+/* Makes a GL context on a pbuffer current, returns false without a display or pbuffers */
+static bool
+create_offscreen (Offscreen *offscreen)
+{
+	int config_attribs [] = {
+		GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT,
+		GLX_RENDER_TYPE, GLX_RGBA_BIT,
+		GLX_RED_SIZE, 8, GLX_GREEN_SIZE, 8, GLX_BLUE_SIZE, 8, GLX_ALPHA_SIZE, 8,
+		None
+	};
+	int pbuffer_attribs [] = { GLX_PBUFFER_WIDTH, SIZE, GLX_PBUFFER_HEIGHT, SIZE, None };
+	GLXFBConfig *configs;
+	int n = 0;
+
+	memset (offscreen, 0, sizeof (Offscreen));
+
+	if (!(offscreen->display = XOpenDisplay (NULL)))
+		return false;
+
+	configs = glXChooseFBConfig (offscreen->display, DefaultScreen (offscreen->display), config_attribs, &n);
+	if (configs != NULL && n > 0) {
+		offscreen->pbuffer = glXCreatePbuffer (offscreen->display, configs [0], pbuffer_attribs);
+		offscreen->context = glXCreateNewContext (offscreen->display, configs [0], GLX_RGBA_TYPE, NULL, True);
+	}
+	if (configs != NULL)
+		XFree (configs);
+
+	if (!offscreen->pbuffer || !offscreen->context ||
+	    !glXMakeContextCurrent (offscreen->display, offscreen->pbuffer, offscreen->pbuffer, offscreen->context)) {
+		if (offscreen->context)
+			glXDestroyContext (offscreen->display, offscreen->context);
+		if (offscreen->pbuffer)
+			glXDestroyPbuffer (offscreen->display, offscreen->pbuffer);
+		XCloseDisplay (offscreen->display);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+destroy_offscreen (Offscreen *offscreen)
+{
+	glXMakeContextCurrent (offscreen->display, None, None, NULL);
+	glXDestroyContext (offscreen->display, offscreen->context);
+	glXDestroyPbuffer (offscreen->display, offscreen->pbuffer);
+	XCloseDisplay (offscreen->display);
+}
+
+/* Fills a rectangle of @surface with cairo */
+static void
+fill (OpenGLSurface *surface, int x, int y, int width, int height, double r, double g, double b)
+{
+	cairo_surface_t *dst = surface->Cairo ();
+	cairo_t *cr = cairo_create (dst);
+
+	cairo_set_source_rgb (cr, r, g, b);
+	cairo_rectangle (cr, x, y, width, height);
+	cairo_fill (cr);
+	cairo_destroy (cr);
+	cairo_surface_destroy (dst);
+}
+
+static guint32
+texture_pixel (GLuint texture, int x, int y)
+{
+	guint32 pixels [SIZE * SIZE];
+
+	glBindTexture (GL_TEXTURE_2D, texture);
+	glGetTexImage (GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+	glBindTexture (GL_TEXTURE_2D, 0);
+
+	return pixels [y * SIZE + x];
+}
+
+/*
+ * What cairo draws ends up in the texture, through the pixel buffers or
+ * straight from memory: a draw Push didn't track uploads the whole surface,
+ * a tracked one only its box.
+ */
+TEST(GLUpload, Uploads)
+{
+	static const char *modes [] = { "1", "0" };
+	Offscreen offscreen;
+
+	if (!create_offscreen (&offscreen)) {
+		printf ("[  SKIPPED ] no display with GLX pbuffers\n");
+		return;
+	}
+
+	for (guint i = 0; i < G_N_ELEMENTS (modes); i++) {
+		UploadSurface *target = new UploadSurface ();
+		UploadContext *context = new UploadContext (target);
+		OpenGLSurface *surface = new OpenGLSurface (SIZE, SIZE);
+		GLuint texture;
+
+		/* forced on even for the software rasterizers */
+		g_setenv ("MOONLIGHT_GL_PIXEL_BUFFERS", modes [i], TRUE);
+		ASSERT_TRUE (context->Initialize ());
+		ASSERT_EQ (modes [i][0] == '1', context->HasPixelBuffers ()) << "MOONLIGHT_GL_PIXEL_BUFFERS=" << modes [i];
+
+		/* a fresh surface */
+		fill (surface, 0, 0, SIZE, SIZE, 1.0, 0.0, 0.0);
+		texture = context->Upload (surface);
+		ASSERT_EQ (RED, texture_pixel (texture, 0, 0));
+		ASSERT_EQ (RED, texture_pixel (texture, SIZE - 1, SIZE - 1));
+
+		/* read back from the texture and drawn on without Push */
+		fill (surface, 40, 40, 8, 8, 0.0, 1.0, 0.0);
+		texture = context->Upload (surface);
+		ASSERT_EQ (GREEN, texture_pixel (texture, 44, 44)) << "MOONLIGHT_GL_PIXEL_BUFFERS=" << modes [i];
+		ASSERT_EQ (RED, texture_pixel (texture, 0, 0));
+
+		/* a tracked draw */
+		surface->TrackDraw (Rect (0, 0, 8, 8));
+		fill (surface, 0, 0, 8, 8, 0.0, 0.0, 1.0);
+		texture = context->Upload (surface);
+		ASSERT_EQ (BLUE, texture_pixel (texture, 4, 4));
+		ASSERT_EQ (GREEN, texture_pixel (texture, 44, 44));
+		ASSERT_EQ (RED, texture_pixel (texture, SIZE - 1, SIZE - 1));
+
+		/* handed out without drawing, uploaded as it was */
+		cairo_surface_destroy (surface->Cairo ());
+		texture = context->Upload (surface);
+		ASSERT_EQ (BLUE, texture_pixel (texture, 4, 4));
+
+		surface->unref ();
+		delete context;
+		target->unref ();
+	}
+
+	g_unsetenv ("MOONLIGHT_GL_PIXEL_BUFFERS");
+	destroy_offscreen (&offscreen);
+}
+
+#endif /* USE_GLX */
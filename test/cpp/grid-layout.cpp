@@ -0,0 +1,375 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <math.h>
+
+#include "grid.h"
+#include "border.h"
+#include "layoutinformation.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define ROW_COUNT 4
+#define COL_COUNT 2
+#define CHILD_COUNT 4
+
+/* The row and column sizes, and where the children ended up */
+struct GridLayout {
+	double heights [ROW_COUNT];
+	double widths [COL_COUNT];
+	Rect slots [CHILD_COUNT];
+};
+
+static void
+add_child (Grid *grid, Border **children, int i, int row, int col, int rowspan, int colspan, double width, double height)
+{
+	Border *child = MoonUnmanagedFactory::CreateBorder ();
+
+	child->SetWidth (width);
+	child->SetHeight (height);
+	Grid::SetRow (child, row);
+	Grid::SetColumn (child, col);
+	Grid::SetRowSpan (child, rowspan);
+	Grid::SetColumnSpan (child, colspan);
+	grid->GetChildren ()->Add (Value (child));
+
+	children [i] = child;
+	child->unref ();
+}
+
+/*
+ * Rows: Auto, 1*, 30 pixels, 2*. Columns: Auto, 1*.
+ * An auto/auto child, a star/star child, a child spanning the last two rows
+ * and both columns, and a star/auto child.
+ */
+static Grid *
+create_grid (Border **children)
+{
+	Grid *grid = MoonUnmanagedFactory::CreateGrid ();
+	static const GridLength heights [ROW_COUNT] = {
+		GridLength (0, GridUnitTypeAuto),
+		GridLength (1, GridUnitTypeStar),
+		GridLength (30, GridUnitTypePixel),
+		GridLength (2, GridUnitTypeStar),
+	};
+	static const GridLength widths [COL_COUNT] = {
+		GridLength (0, GridUnitTypeAuto),
+		GridLength (1, GridUnitTypeStar),
+	};
+
+	for (int r = 0; r < ROW_COUNT; r++) {
+		RowDefinition *def = MoonUnmanagedFactory::CreateRowDefinition ();
+		GridLength height = heights [r];
+
+		def->SetHeight (&height);
+		grid->GetRowDefinitions ()->Add (Value (def));
+		def->unref ();
+	}
+
+	for (int c = 0; c < COL_COUNT; c++) {
+		ColumnDefinition *def = MoonUnmanagedFactory::CreateColumnDefinition ();
+		GridLength width = widths [c];
+
+		def->SetWidth (&width);
+		grid->GetColumnDefinitions ()->Add (Value (def));
+		def->unref ();
+	}
+
+	add_child (grid, children, 0, 0, 0, 1, 1, 40, 20);
+	add_child (grid, children, 1, 1, 1, 1, 1, 100, 10);
+	add_child (grid, children, 2, 2, 0, 2, 2, 50, 80);
+	add_child (grid, children, 3, 3, 0, 1, 1, 10, 10);
+
+	return grid;
+}
+
+static void
+measure (Grid *grid, Size size)
+{
+	MoonError error;
+
+	grid->MeasureOverrideWithError (size, &error);
+	ASSERT_EQ (0, error.number);
+}
+
+static void
+arrange (Grid *grid, Border **children, Size size, GridLayout *layout)
+{
+	MoonError error;
+
+	grid->ArrangeOverrideWithError (size, &error);
+	ASSERT_EQ (0, error.number);
+
+	for (int r = 0; r < ROW_COUNT; r++)
+		layout->heights [r] = grid->GetRowDefinitions ()->GetValueAt (r)->AsRowDefinition ()->GetActualHeight ();
+	for (int c = 0; c < COL_COUNT; c++)
+		layout->widths [c] = grid->GetColumnDefinitions ()->GetValueAt (c)->AsColumnDefinition ()->GetActualWidth ();
+	for (int i = 0; i < CHILD_COUNT; i++) {
+		Rect *slot = LayoutInformation::GetLayoutSlot (children [i]);
+		ASSERT_TRUE (slot != NULL);
+		layout->slots [i] = *slot;
+	}
+}
+
+static void
+assert_same_layout (GridLayout *expected, GridLayout *actual)
+{
+	for (int r = 0; r < ROW_COUNT; r++)
+		ASSERT_DOUBLE_EQ (expected->heights [r], actual->heights [r]);
+	for (int c = 0; c < COL_COUNT; c++)
+		ASSERT_DOUBLE_EQ (expected->widths [c], actual->widths [c]);
+	for (int i = 0; i < CHILD_COUNT; i++)
+		ASSERT_TRUE (expected->slots [i] == actual->slots [i]);
+}
+
+/* Arranging again at the size the segments were arranged at reuses them */
+TEST(GridLayout, ArrangeCache)
+{
+	Border *children [CHILD_COUNT];
+	GridLayout first, cached, other, again;
+	Size size (200, 300);
+
+	unit_init_runtime ();
+
+	Grid *grid = create_grid (children);
+
+	measure (grid, size);
+	arrange (grid, children, size, &first);
+
+	ASSERT_DOUBLE_EQ (20, first.heights [0]);
+	ASSERT_DOUBLE_EQ (30, first.heights [2]);
+	ASSERT_DOUBLE_EQ (first.heights [1] * 2, first.heights [3]);
+	ASSERT_DOUBLE_EQ (300, first.heights [0] + first.heights [1] + first.heights [2] + first.heights [3]);
+	ASSERT_DOUBLE_EQ (40, first.widths [0]);
+	ASSERT_DOUBLE_EQ (160, first.widths [1]);
+	/* the slots are rounded (UseLayoutRounding) */
+	ASSERT_DOUBLE_EQ (round (first.heights [0] + first.heights [1]), first.slots [2].y);
+
+	/* the cache is hit */
+	arrange (grid, children, size, &cached);
+	assert_same_layout (&first, &cached);
+
+	/* a different size, then back */
+	arrange (grid, children, Size (150, 250), &other);
+	ASSERT_DOUBLE_EQ (110, other.widths [1]);
+	ASSERT_DOUBLE_EQ (250, other.heights [0] + other.heights [1] + other.heights [2] + other.heights [3]);
+
+	arrange (grid, children, size, &again);
+	assert_same_layout (&first, &again);
+
+	/* measuring again doesn't change anything either */
+	measure (grid, size);
+	arrange (grid, children, size, &again);
+	assert_same_layout (&first, &again);
+
+	grid->unref ();
+}
+
+/* A measure drops the arranged segments, even at the same size */
+TEST(GridLayout, MeasureInvalidatesArrange)
+{
+	Border *children [CHILD_COUNT];
+	GridLayout first, changed;
+	Size size (200, 300);
+
+	unit_init_runtime ();
+
+	Grid *grid = create_grid (children);
+
+	measure (grid, size);
+	arrange (grid, children, size, &first);
+
+	children [0]->SetHeight (50);
+	measure (grid, size);
+	arrange (grid, children, size, &changed);
+
+	ASSERT_DOUBLE_EQ (50, changed.heights [0]);
+	ASSERT_DOUBLE_EQ (300, changed.heights [0] + changed.heights [1] + changed.heights [2] + changed.heights [3]);
+	ASSERT_DOUBLE_EQ (50, changed.slots [1].y);
+
+	children [0]->SetHeight (20);
+	measure (grid, size);
+	arrange (grid, children, size, &changed);
+	assert_same_layout (&first, &changed);
+
+	grid->unref ();
+}
+
+static void
+get_actual_sizes (Grid *grid, GridLayout *layout)
+{
+	for (int r = 0; r < ROW_COUNT; r++)
+		layout->heights [r] = grid->GetRowDefinitions ()->GetValueAt (r)->AsRowDefinition ()->GetActualHeight ();
+	for (int c = 0; c < COL_COUNT; c++)
+		layout->widths [c] = grid->GetColumnDefinitions ()->GetValueAt (c)->AsColumnDefinition ()->GetActualWidth ();
+}
+
+/* Measuring again with nothing changed comes to the same sizes as the last measure */
+TEST(GridLayout, MeasureCache)
+{
+	Border *children [CHILD_COUNT];
+	GridLayout measured, arranged, replayed;
+	Size size (200, 300);
+	MoonError error;
+	Size desired, again;
+
+	unit_init_runtime ();
+
+	Grid *grid = create_grid (children);
+
+	desired = grid->MeasureOverrideWithError (size, &error);
+	ASSERT_EQ (0, error.number);
+	get_actual_sizes (grid, &measured);
+
+	/* the auto row isn't given an actual size until it's arranged */
+	ASSERT_TRUE (isinf (measured.heights [0]));
+	ASSERT_DOUBLE_EQ (30, measured.heights [2]);
+
+	arrange (grid, children, size, &arranged);
+	ASSERT_DOUBLE_EQ (20, arranged.heights [0]);
+
+	/* the measure is replayed, and the definitions are back to what it left them at */
+	again = grid->MeasureOverrideWithError (size, &error);
+	ASSERT_EQ (0, error.number);
+	ASSERT_TRUE (desired == again);
+	get_actual_sizes (grid, &replayed);
+	ASSERT_TRUE (isinf (replayed.heights [0]));
+	for (int r = 1; r < ROW_COUNT; r++)
+		ASSERT_DOUBLE_EQ (measured.heights [r], replayed.heights [r]);
+	for (int c = 0; c < COL_COUNT; c++)
+		ASSERT_DOUBLE_EQ (measured.widths [c], replayed.widths [c]);
+
+	arrange (grid, children, size, &replayed);
+	assert_same_layout (&arranged, &replayed);
+
+	grid->unref ();
+}
+
+typedef void (*GridChange) (Grid *grid, Border **children);
+
+static void
+change_definition (Grid *grid, Border **children)
+{
+	GridLength height (60, GridUnitTypePixel);
+	grid->GetRowDefinitions ()->GetValueAt (2)->AsRowDefinition ()->SetHeight (&height);
+}
+
+static void
+change_max_width (Grid *grid, Border **children)
+{
+	grid->GetColumnDefinitions ()->GetValueAt (0)->AsColumnDefinition ()->SetMaxWidth (25);
+}
+
+static void
+change_column (Grid *grid, Border **children)
+{
+	Grid::SetColumn (children [3], 1);
+}
+
+static void
+change_row_span (Grid *grid, Border **children)
+{
+	Grid::SetRowSpan (children [0], 2);
+}
+
+static void
+remove_child (Grid *grid, Border **children)
+{
+	grid->GetChildren ()->RemoveAt (2);
+}
+
+static void
+add_row (Grid *grid, Border **children)
+{
+	RowDefinition *def = MoonUnmanagedFactory::CreateRowDefinition ();
+	grid->GetRowDefinitions ()->Add (Value (def));
+	def->unref ();
+}
+
+/*
+ * What the measure depends on, other than the children's desired sizes:
+ * after each change, the grid measures the same as a new grid which never
+ * measured before the change.
+ */
+TEST(GridLayout, MeasureCacheInvalidation)
+{
+	GridChange changes [] = {
+		change_definition,
+		change_max_width,
+		change_column,
+		change_row_span,
+		remove_child,
+		add_row,
+	};
+	Size size (200, 300);
+
+	unit_init_runtime ();
+
+	for (guint i = 0; i < G_N_ELEMENTS (changes); i++) {
+		Border *children [CHILD_COUNT];
+		Border *fresh_children [CHILD_COUNT];
+		GridLayout cached, fresh;
+		MoonError error;
+		Size desired, expected;
+
+		Grid *grid = create_grid (children);
+		Grid *fresh_grid = create_grid (fresh_children);
+
+		grid->MeasureOverrideWithError (size, &error);
+		changes [i] (grid, children);
+		desired = grid->MeasureOverrideWithError (size, &error);
+		ASSERT_EQ (0, error.number);
+
+		changes [i] (fresh_grid, fresh_children);
+		expected = fresh_grid->MeasureOverrideWithError (size, &error);
+		ASSERT_EQ (0, error.number);
+
+		ASSERT_TRUE (expected == desired) << "change " << i;
+
+		get_actual_sizes (grid, &cached);
+		get_actual_sizes (fresh_grid, &fresh);
+		for (int r = 0; r < ROW_COUNT; r++)
+			ASSERT_EQ (fresh.heights [r], cached.heights [r]) << "change " << i << ", row " << r;
+		for (int c = 0; c < COL_COUNT; c++)
+			ASSERT_EQ (fresh.widths [c], cached.widths [c]) << "change " << i << ", column " << c;
+
+		grid->unref ();
+		fresh_grid->unref ();
+	}
+}
+
+/* Measuring at another size isn't a replay */
+TEST(GridLayout, MeasureCacheSize)
+{
+	Border *children [CHILD_COUNT];
+	MoonError error;
+
+	unit_init_runtime ();
+
+	Grid *grid = create_grid (children);
+
+	grid->MeasureOverrideWithError (Size (200, 300), &error);
+	ASSERT_DOUBLE_EQ (160, grid->GetColumnDefinitions ()->GetValueAt (1)->AsColumnDefinition ()->GetActualWidth ());
+
+	grid->MeasureOverrideWithError (Size (100, 300), &error);
+	ASSERT_EQ (0, error.number);
+	ASSERT_DOUBLE_EQ (60, grid->GetColumnDefinitions ()->GetValueAt (1)->AsColumnDefinition ()->GetActualWidth ());
+
+	grid->MeasureOverrideWithError (Size (200, 300), &error);
+	ASSERT_DOUBLE_EQ (160, grid->GetColumnDefinitions ()->GetValueAt (1)->AsColumnDefinition ()->GetActualWidth ());
+
+	grid->unref ();
+}
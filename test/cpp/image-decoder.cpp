@@ -0,0 +1,283 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "image-decoder.h"
+#include "bitmapimage.h"
+#include "media.h"
+#include "runtime.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+TEST(ImageDecoder, PngSize)
+{
+	static const guint8 png [] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+		0x00, 0x00, 0x00, 0x0d, 'I', 'H', 'D', 'R',
+		0x00, 0x00, 0x01, 0x40, 0x00, 0x00, 0x00, 0xf0,
+		0x08, 0x06, 0x00, 0x00, 0x00,
+	};
+	int width, height;
+
+	ASSERT_TRUE (ImageDecoder::GetImageSize (png, sizeof (png), &width, &height));
+	ASSERT_EQ (320, width);
+	ASSERT_EQ (240, height);
+
+	/* truncated before the size */
+	ASSERT_FALSE (ImageDecoder::GetImageSize (png, 20, &width, &height));
+}
+
+TEST(ImageDecoder, JpegSize)
+{
+	static const guint8 jpeg [] = {
+		0xff, 0xd8,
+		/* APP0, with a fill byte before it */
+		0xff, 0xff, 0xe0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+		/* DHT, which is in the SOFn range */
+		0xff, 0xc4, 0x00, 0x03, 0x00,
+		/* SOF2 */
+		0xff, 0xc2, 0x00, 0x11, 0x08, 0x04, 0x38, 0x07, 0x80, 0x03,
+	};
+	static const guint8 garbage [] = { 0xff, 0xd8, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x00 };
+	int width, height;
+
+	ASSERT_TRUE (ImageDecoder::GetImageSize (jpeg, sizeof (jpeg), &width, &height));
+	ASSERT_EQ (1920, width);
+	ASSERT_EQ (1080, height);
+
+	ASSERT_FALSE (ImageDecoder::GetImageSize (jpeg, sizeof (jpeg) - 4, &width, &height));
+	ASSERT_FALSE (ImageDecoder::GetImageSize (garbage, sizeof (garbage), &width, &height));
+	ASSERT_FALSE (ImageDecoder::GetImageSize ((const guint8 *) "GIF89a", 6, &width, &height));
+}
+
+/* 3x2 red RGBA png */
+static const guint8 red_png [] = {
+	0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+	0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x02, 0x08, 0x06, 0x00, 0x00, 0x00, 0x9d, 0x74, 0x66,
+	0x1a, 0x00, 0x00, 0x00, 0x11, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0xf8, 0xcf, 0xc0, 0xf0,
+	0x1f, 0x86, 0x19, 0x90, 0x39, 0x00, 0x9b, 0x7e, 0x0b, 0xf5, 0x0f, 0x5f, 0x26, 0x22, 0x00, 0x00,
+	0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82,
+};
+
+/* 8x4 red RGBA png */
+static const guint8 wide_png [] = {
+	0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+	0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x08, 0x06, 0x00, 0x00, 0x00, 0xb3, 0xcd, 0x7e,
+	0xf0, 0x00, 0x00, 0x00, 0x12, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0xf8, 0xcf, 0xc0, 0xf0,
+	0x1f, 0x1f, 0x66, 0xa0, 0xbd, 0x02, 0x00, 0x70, 0xf4, 0x3f, 0xc1, 0x84, 0x72, 0xfa, 0xc2, 0x00,
+	0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82,
+};
+
+static ImageDecodeJob *
+create_job (BitmapImage *image, const guint8 *png = red_png, gsize length = sizeof (red_png))
+{
+	GByteArray *data = g_byte_array_new ();
+
+	g_byte_array_append (data, png, length);
+
+	return new ImageDecodeJob (image, Runtime::GetWindowingSystem ()->CreatePixbufLoader ("png"), data);
+}
+
+/* Runs the main loop (where decoded images are delivered) until @done returns true, for up to 5 seconds */
+static bool
+run_main_loop (bool (*done) (BitmapImage *image), BitmapImage *image)
+{
+	for (int i = 0; i < 5000; i++) {
+		while (g_main_context_iteration (NULL, false))
+			;
+		if (done (image))
+			return true;
+		g_usleep (1000);
+	}
+
+	return false;
+}
+
+static bool
+is_decoded (BitmapImage *image)
+{
+	return image->GetPixelWidth () != 0;
+}
+
+static bool
+is_memory_released (BitmapImage *image)
+{
+	return ImageDecoder::GetMemoryUsed () == 0;
+}
+
+/* Decoded images are handed back on the main thread even without a surface, and release their memory budget */
+TEST(ImageDecoder, Completion)
+{
+	BitmapImage *image;
+
+	g_setenv ("MOONLIGHT_IMAGE_DECODE_THREADS", "2", true);
+	unit_init_runtime ();
+
+	image = MoonUnmanagedFactory::CreateBitmapImage ();
+	ASSERT_TRUE (ImageDecoder::AddWork (create_job (image)));
+
+	ASSERT_TRUE (run_main_loop (is_decoded, image));
+	ASSERT_EQ (3, image->GetPixelWidth ());
+	ASSERT_EQ (2, image->GetPixelHeight ());
+	ASSERT_EQ (0u, ImageDecoder::GetMemoryUsed ());
+
+	image->unref ();
+}
+
+/* Cancelled jobs release their memory budget too, whether they were being decoded or not */
+TEST(ImageDecoder, Cancel)
+{
+	BitmapImage *image;
+
+	g_setenv ("MOONLIGHT_IMAGE_DECODE_THREADS", "2", true);
+	unit_init_runtime ();
+
+	image = MoonUnmanagedFactory::CreateBitmapImage ();
+	for (int i = 0; i < 8; i++) {
+		ImageDecodeJob *job = create_job (image);
+
+		ASSERT_TRUE (ImageDecoder::AddWork (job));
+		if (i % 2 == 0)
+			g_usleep (1000);
+		ImageDecoder::Cancel (job);
+	}
+
+	ASSERT_TRUE (run_main_loop (is_memory_released, image));
+	ASSERT_EQ (0, image->GetPixelWidth ());
+
+	image->unref ();
+}
+
+/* Decodes the 8x4 png synchronously in at most @max_width x @max_height */
+static void
+decode_wide (int max_width, int max_height, int *width, int *height)
+{
+	BitmapImage *image = MoonUnmanagedFactory::CreateBitmapImage ();
+	ImageDecodeJob *job = create_job (image, wide_png, sizeof (wide_png));
+
+	job->max_width = max_width;
+	job->max_height = max_height;
+	job->Decode ();
+
+	EXPECT_TRUE (job->error == NULL);
+	*width = job->width;
+	*height = job->height;
+
+	delete job;
+	image->unref ();
+}
+
+/* Images which don't fit in the decode size are scaled down while they're decoded, keeping their aspect ratio */
+TEST(ImageDecoder, DecodeSize)
+{
+	int width, height;
+
+	unit_init_runtime ();
+
+	/* no limit */
+	decode_wide (0, 0, &width, &height);
+	ASSERT_EQ (8, width);
+	ASSERT_EQ (4, height);
+
+	/* bigger than the image */
+	decode_wide (16, 16, &width, &height);
+	ASSERT_EQ (8, width);
+	ASSERT_EQ (4, height);
+
+	/* the width limits the size */
+	decode_wide (4, 4, &width, &height);
+	ASSERT_EQ (4, width);
+	ASSERT_EQ (2, height);
+
+	/* the height does */
+	decode_wide (8, 1, &width, &height);
+	ASSERT_EQ (2, width);
+	ASSERT_EQ (1, height);
+
+	/* only one of them is limited */
+	decode_wide (2, 0, &width, &height);
+	ASSERT_EQ (2, width);
+	ASSERT_EQ (1, height);
+}
+
+/* A BitmapImage decodes at its decode size, PixelWidth and PixelHeight are the decoded size */
+TEST(ImageDecoder, BitmapImageDecodeSize)
+{
+	BitmapImage *image;
+
+	unit_init_runtime ();
+
+	image = MoonUnmanagedFactory::CreateBitmapImage ();
+	image->SetDecodeSize (4, 4);
+	image->PixbufWrite ((gpointer) wide_png, 0, sizeof (wide_png));
+	image->PixmapComplete ();
+
+	ASSERT_EQ (4, image->GetPixelWidth ());
+	ASSERT_EQ (2, image->GetPixelHeight ());
+
+	image->unref ();
+}
+
+/*
+ * Image asks its source to be decoded at its size when it has a fixed size
+ * and keeps the aspect ratio of the source, and not otherwise.
+ */
+TEST(ImageDecoder, ImageDecodeSize)
+{
+	BitmapImage *source;
+	Image *image, *other;
+
+	unit_init_runtime ();
+
+	source = MoonUnmanagedFactory::CreateBitmapImage ();
+	image = MoonUnmanagedFactory::CreateImage ();
+
+	/* no size yet */
+	image->SetSource (source);
+	ASSERT_EQ (0, source->GetDecodeWidth ());
+	ASSERT_EQ (0, source->GetDecodeHeight ());
+
+	image->SetWidth (40.5);
+	ASSERT_EQ (0, source->GetDecodeWidth ());
+	image->SetHeight (30.0);
+	ASSERT_EQ (41, source->GetDecodeWidth ());
+	ASSERT_EQ (30, source->GetDecodeHeight ());
+
+	/* a bigger Image showing the same source */
+	other = MoonUnmanagedFactory::CreateImage ();
+	other->SetWidth (100.0);
+	other->SetHeight (20.0);
+	other->SetSource (source);
+	ASSERT_EQ (100, source->GetDecodeWidth ());
+	ASSERT_EQ (30, source->GetDecodeHeight ());
+	other->unref ();
+	image->unref ();
+	source->unref ();
+
+	/* the other stretches show more of the source than fits */
+	Stretch stretches [] = { StretchNone, StretchFill, StretchUniformToFill };
+	for (guint i = 0; i < G_N_ELEMENTS (stretches); i++) {
+		source = MoonUnmanagedFactory::CreateBitmapImage ();
+		image = MoonUnmanagedFactory::CreateImage ();
+		image->SetStretch (stretches [i]);
+		image->SetWidth (40.0);
+		image->SetHeight (30.0);
+		image->SetSource (source);
+		ASSERT_EQ (0, source->GetDecodeWidth ()) << "stretch " << stretches [i];
+		ASSERT_EQ (0, source->GetDecodeHeight ()) << "stretch " << stretches [i];
+		image->unref ();
+		source->unref ();
+	}
+}
@@ -0,0 +1,160 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "animation.h"
+#include "clock.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define MS(ms) TimeSpan_FromPts ((ms) * PTS_PER_MILLISECOND)
+
+/* Key times in milliseconds, the keyframes are resolved (sorted) by Validate */
+static DoubleAnimationUsingKeyFrames *
+create_animation (const int *times, int count)
+{
+	DoubleAnimationUsingKeyFrames *animation;
+	MoonError error;
+
+	unit_init_runtime ();
+
+	animation = MoonUnmanagedFactory::CreateDoubleAnimationUsingKeyFrames ();
+
+	for (int i = 0; i < count; i++) {
+		LinearDoubleKeyFrame *frame = MoonUnmanagedFactory::CreateLinearDoubleKeyFrame ();
+
+		frame->SetKeyTime (KeyTime::FromTimeSpan (MS (times [i])));
+		frame->SetValue (i);
+		animation->AddKeyFrame (frame);
+		frame->unref ();
+	}
+
+	EXPECT_TRUE (animation->Validate (&error));
+	EXPECT_EQ ((guint) count, animation->GetKeyFrames ()->sorted_list->len);
+
+	return animation;
+}
+
+static TimeSpan
+keytime (KeyFrameCollection *frames, guint i)
+{
+	return ((KeyFrame *) frames->sorted_list->pdata [i])->resolved_keytime;
+}
+
+/* What GetKeyFrameForTime used to do: crawl forward to the first keyframe at or after @t */
+static guint
+find_segment_linear (KeyFrameCollection *frames, TimeSpan t)
+{
+	guint i;
+
+	for (i = 0; i + 1 < frames->sorted_list->len; i++) {
+		if (keytime (frames, i) >= t)
+			break;
+	}
+
+	return i;
+}
+
+TEST(KeyFrameSegments, KeyTimes)
+{
+	static const int times [] = { 1000, 2000, 3000, 4000 };
+	DoubleAnimationUsingKeyFrames *animation = create_animation (times, G_N_ELEMENTS (times));
+	KeyFrameCollection *frames = animation->GetKeyFrames ();
+
+	/* exactly at a key time is that keyframe's segment, just after it the next one */
+	for (guint i = 0; i < G_N_ELEMENTS (times); i++) {
+		ASSERT_EQ (i, frames->FindSegment (MS (times [i])));
+		ASSERT_EQ (i, frames->cursor);
+	}
+	for (guint i = 0; i + 1 < G_N_ELEMENTS (times); i++)
+		ASSERT_EQ (i + 1, frames->FindSegment (MS (times [i]) + 1));
+
+	/* the same, without the cursor's help */
+	for (guint i = 0; i < G_N_ELEMENTS (times); i++) {
+		frames->cursor = (i + 2) % G_N_ELEMENTS (times);
+		ASSERT_EQ (i, frames->FindSegment (MS (times [i])));
+	}
+
+	animation->unref ();
+}
+
+TEST(KeyFrameSegments, OutOfRange)
+{
+	static const int times [] = { 1000, 2000, 3000 };
+	DoubleAnimationUsingKeyFrames *animation = create_animation (times, G_N_ELEMENTS (times));
+	KeyFrameCollection *frames = animation->GetKeyFrames ();
+
+	/* before the first key time is the first segment */
+	ASSERT_EQ (0u, frames->FindSegment (0));
+	frames->cursor = 2;
+	ASSERT_EQ (0u, frames->FindSegment (MS (999)));
+
+	/* after the last one is the last segment */
+	frames->cursor = 0;
+	ASSERT_EQ (2u, frames->FindSegment (MS (3001)));
+	ASSERT_EQ (2u, frames->FindSegment (MS (60000)));
+	ASSERT_EQ (2u, frames->cursor);
+
+	animation->unref ();
+}
+
+/* Keyframes with the same key time: the first one wins, like the linear crawl */
+TEST(KeyFrameSegments, DuplicateKeyTimes)
+{
+	static const int times [] = { 0, 1000, 2000, 2000, 2000, 3000 };
+	DoubleAnimationUsingKeyFrames *animation = create_animation (times, G_N_ELEMENTS (times));
+	KeyFrameCollection *frames = animation->GetKeyFrames ();
+	KeyFrame *prev;
+
+	for (guint cursor = 0; cursor < G_N_ELEMENTS (times); cursor++) {
+		frames->cursor = cursor;
+		ASSERT_EQ (2u, frames->FindSegment (MS (2000)));
+		frames->cursor = cursor;
+		ASSERT_EQ (2u, frames->FindSegment (MS (1500)));
+		frames->cursor = cursor;
+		ASSERT_EQ (5u, frames->FindSegment (MS (2001)));
+	}
+
+	ASSERT_EQ (frames->sorted_list->pdata [2], frames->GetKeyFrameForTime (MS (2000), &prev));
+	ASSERT_EQ (frames->sorted_list->pdata [1], prev);
+
+	animation->unref ();
+}
+
+/* An animation ticking forward (and seeking back) finds the same segments as the linear crawl */
+TEST(KeyFrameSegments, Ticks)
+{
+	static const int times [] = { 0, 250, 500, 500, 1000, 1100, 1200, 2000 };
+	DoubleAnimationUsingKeyFrames *animation = create_animation (times, G_N_ELEMENTS (times));
+	KeyFrameCollection *frames = animation->GetKeyFrames ();
+	guint segment;
+
+	for (int ms = 0; ms <= 2500; ms += 16) {
+		segment = frames->FindSegment (MS (ms));
+		ASSERT_EQ (find_segment_linear (frames, MS (ms)), segment) << "at " << ms << " ms";
+		ASSERT_EQ (segment, frames->cursor);
+	}
+
+	/* a seek back to the start, and forward a few segments at once */
+	ASSERT_EQ (0u, frames->FindSegment (0));
+	ASSERT_EQ (find_segment_linear (frames, MS (1150)), frames->FindSegment (MS (1150)));
+	ASSERT_EQ (find_segment_linear (frames, MS (300)), frames->FindSegment (MS (300)));
+
+	/* Clear forgets the cursor */
+	frames->Clear ();
+	ASSERT_EQ (0u, frames->cursor);
+
+	animation->unref ();
+}
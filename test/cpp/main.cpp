@@ -13,6 +13,69 @@
 #include "config.h"
 #include "main.h"
 
+#include <errno.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "runtime.h"
+
+using namespace Moonlight;
+
+void
+unit_init_runtime ()
+{
+	static bool inited = false;
+
+	if (inited)
+		return;
+
+	inited = true;
+	gtk_init_check (NULL, NULL);
+	Runtime::InitDesktop ();
+}
+
+char *
+unit_create_temp_file (const char *prefix, const void *contents, gsize length)
+{
+	char *name = g_strdup_printf ("%s.XXXXXX", prefix);
+	char *filename = g_build_filename (g_get_tmp_dir (), name, NULL);
+	const char *data = (const char *) contents;
+	int fd;
+
+	g_free (name);
+
+	if ((fd = g_mkstemp (filename)) == -1) {
+		g_free (filename);
+		return NULL;
+	}
+
+	while (length > 0) {
+		ssize_t n = write (fd, data, length);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n <= 0) {
+			close (fd);
+			g_unlink (filename);
+			g_free (filename);
+			return NULL;
+		}
+
+		data += n;
+		length -= n;
+	}
+
+	if (close (fd) == -1) {
+		g_unlink (filename);
+		g_free (filename);
+		return NULL;
+	}
+
+	return filename;
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
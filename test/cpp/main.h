@@ -10,4 +10,12 @@
  *
  */
 
-#include <gtest/gtest.h>
\ No newline at end of file
+#include <glib.h>
+#include <gtest/gtest.h>
+
+/* Initializes the desktop runtime (once), for tests that need a deployment */
+void unit_init_runtime ();
+
+/* Creates a file named after @prefix in the temporary directory containing @length bytes of
+ * @contents. Returns the (g_free'd) name of the file, or NULL if it couldn't be written. */
+char *unit_create_temp_file (const char *prefix, const void *contents, gsize length);
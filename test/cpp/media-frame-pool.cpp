@@ -0,0 +1,218 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "pipeline.h"
+
+using namespace Moonlight;
+
+/* 1080p YV12 */
+#define FRAME_SIZE (1920 * 1080 * 3 / 2)
+#define FRAME_COUNT 600
+#define FRAMES_QUEUED 4
+
+TEST(MediaFramePool, Reuse)
+{
+	MediaFramePool *pool = new MediaFramePool ();
+	MediaFramePoolStats stats;
+	guint32 size_a, size_b;
+	guint8 *a, *b;
+
+	a = pool->Allocate (FRAME_SIZE, &size_a);
+	ASSERT_TRUE (a != NULL);
+	ASSERT_TRUE (size_a >= FRAME_SIZE);
+	ASSERT_TRUE (size_a < FRAME_SIZE + FRAME_SIZE / 4);
+	ASSERT_EQ (0, ((gsize) a) % MediaFramePool::MAX_ALIGNMENT);
+	memset (a, 0xff, size_a);
+	pool->Release (a, size_a);
+
+	/* A slightly different size in the same class gets the same buffer back */
+	b = pool->Allocate (FRAME_SIZE - 100, &size_b);
+	ASSERT_EQ (a, b);
+	ASSERT_EQ (size_a, size_b);
+	pool->Release (b, size_b);
+
+	/* Small buffers aren't pooled */
+	ASSERT_TRUE (pool->Allocate (100, &size_b) == NULL);
+	ASSERT_EQ (0, size_b);
+	ASSERT_FALSE (MediaFramePool::CanPool (FRAME_SIZE, 128));
+
+	pool->GetStats (&stats);
+	ASSERT_EQ (1, stats.allocations);
+	ASSERT_EQ (1, stats.reuses);
+	ASSERT_EQ (size_a, stats.peak_bytes);
+
+	delete pool;
+}
+
+TEST(MediaFramePool, SizeClasses)
+{
+	MediaFramePool *pool = new MediaFramePool ();
+	guint32 prev = 0;
+
+	for (guint32 size = MediaFramePool::MIN_SIZE; size < 64 * 1024 * 1024; size += size / 7 + 1) {
+		guint32 pooled_size;
+		guint8 *buffer = pool->Allocate (size, &pooled_size);
+		ASSERT_TRUE (buffer != NULL);
+		/* at most 25% waste, and classes don't shrink as sizes grow */
+		ASSERT_TRUE (pooled_size >= size);
+		ASSERT_TRUE (pooled_size - size <= size / 4);
+		ASSERT_TRUE (pooled_size >= prev);
+		prev = pooled_size;
+		pool->Release (buffer, pooled_size);
+	}
+
+	delete pool;
+}
+
+TEST(MediaFramePool, Trim)
+{
+	MediaFramePool *pool = new MediaFramePool ();
+	MediaFramePoolStats stats;
+	guint8 *buffers [16];
+	guint32 sizes [16];
+
+	/* A burst of 16 buffers in use at the same time */
+	for (int i = 0; i < 16; i++)
+		buffers [i] = pool->Allocate (FRAME_SIZE, &sizes [i]);
+	for (int i = 0; i < 16; i++)
+		pool->Release (buffers [i], sizes [i]);
+
+	/* Then the working set drops to 2 buffers for more than two trim intervals */
+	for (guint32 i = 0; i < MediaFramePool::TRIM_INTERVAL * 2; i++) {
+		buffers [0] = pool->Allocate (FRAME_SIZE, &sizes [0]);
+		buffers [1] = pool->Allocate (FRAME_SIZE, &sizes [1]);
+		pool->Release (buffers [0], sizes [0]);
+		pool->Release (buffers [1], sizes [1]);
+	}
+
+	pool->GetStats (&stats);
+	ASSERT_EQ (16, stats.allocations);
+	ASSERT_EQ (14, stats.trims);
+
+	pool->Trim ();
+	pool->GetStats (&stats);
+	ASSERT_EQ (16, stats.trims);
+
+	delete pool;
+}
+
+/*
+ * A decoder producing 1080p frames with a few of them queued for
+ * rendering only allocates the queued frames, every other frame reuses
+ * one of them.
+ */
+TEST(MediaFramePool, PlaybackChurn)
+{
+	MediaFramePool *pool = new MediaFramePool ();
+	MediaFramePoolStats stats;
+	guint8 *queue [FRAMES_QUEUED];
+	guint32 sizes [FRAMES_QUEUED];
+
+	memset (queue, 0, sizeof (queue));
+	for (int i = 0; i < FRAME_COUNT; i++) {
+		int k = i % FRAMES_QUEUED;
+		if (queue [k] != NULL)
+			pool->Release (queue [k], sizes [k]);
+		queue [k] = pool->Allocate (FRAME_SIZE, &sizes [k]);
+		ASSERT_TRUE (queue [k] != NULL);
+	}
+
+	pool->GetStats (&stats);
+	ASSERT_EQ (FRAMES_QUEUED, stats.in_use);
+
+	for (int i = 0; i < FRAMES_QUEUED; i++)
+		pool->Release (queue [i], sizes [i]);
+
+	pool->GetStats (&stats);
+	ASSERT_EQ (FRAMES_QUEUED, stats.allocations);
+	ASSERT_EQ (FRAME_COUNT - FRAMES_QUEUED, stats.reuses);
+	ASSERT_EQ (0, stats.in_use);
+
+	delete pool;
+}
+
+/* The pass-through decoder leaves the planes in the frame's pooled buffer, which goes back to the pool with the frame */
+TEST(MediaFramePool, PassThroughDecoder)
+{
+	MediaFramePoolStats stats;
+	PassThroughDecoder *decoder;
+	VideoStream *stream;
+	Media *media;
+
+	unit_init_runtime ();
+
+	media = new Media (NULL);
+	stream = new VideoStream (media, CODEC_YV12, 1920, 1080, 0, NULL, 0);
+	decoder = new PassThroughDecoder (media, stream);
+	decoder->SetPixelFormat (MoonPixelFormatYUV420P);
+
+	for (int i = 0; i < 8; i++) {
+		MediaFrame *frame = new MediaFrame (stream);
+
+		ASSERT_TRUE (frame->AllocateBuffer (FRAME_SIZE));
+		decoder->DecodeFrame (frame);
+		ASSERT_TRUE (frame->IsPlanar ());
+		ASSERT_EQ (frame->GetBuffer (), frame->data_stride [0]);
+
+		stream->GetFramePool ()->GetStats (&stats);
+		ASSERT_EQ (1, stats.in_use);
+
+		frame->unref ();
+	}
+
+	stream->GetFramePool ()->GetStats (&stats);
+	ASSERT_EQ (0, stats.in_use);
+	ASSERT_EQ (1, stats.allocations);
+	ASSERT_EQ (7, stats.reuses);
+
+	decoder->unref ();
+	stream->unref ();
+	media->Dispose ();
+	media->unref ();
+}
+
+/* Replacing a pooled buffer returns it to the pool, the new buffer belongs to the frame */
+TEST(MediaFramePool, SetBuffer)
+{
+	MediaFramePoolStats stats;
+	VideoStream *stream;
+	MediaFrame *frame;
+	Media *media;
+
+	unit_init_runtime ();
+
+	media = new Media (NULL);
+	stream = new VideoStream (media, CODEC_YV12, 1920, 1080, 0, NULL, 0);
+	frame = new MediaFrame (stream);
+
+	ASSERT_TRUE (frame->AllocateBuffer (FRAME_SIZE));
+	stream->GetFramePool ()->GetStats (&stats);
+	ASSERT_EQ (1, stats.in_use);
+
+	frame->SetBuffer ((guint8 *) g_malloc (FRAME_SIZE));
+	stream->GetFramePool ()->GetStats (&stats);
+	ASSERT_EQ (0, stats.in_use);
+
+	/* frees the g_malloc'ed buffer */
+	frame->unref ();
+
+	stream->GetFramePool ()->GetStats (&stats);
+	ASSERT_EQ (0, stats.in_use);
+	ASSERT_EQ (1, stats.allocations);
+
+	stream->unref ();
+	media->Dispose ();
+	media->unref ();
+}
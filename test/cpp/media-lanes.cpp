@@ -0,0 +1,293 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "pipeline.h"
+
+using namespace Moonlight;
+
+#define MAX_STEPS 16
+
+/* Polls (for up to 5 seconds) until @value is @expected */
+static bool
+wait_for (gint *value, gint expected)
+{
+	for (int i = 0; i < 5000; i++) {
+		if (g_atomic_int_get (value) == expected)
+			return true;
+		g_usleep (1000);
+	}
+	return false;
+}
+
+/* What the closures of a test did, in the order they did it */
+struct LaneLog {
+	MoonMutex mutex;
+	gint running;
+	gint max_running;
+	gint done;
+	int count;
+	int steps [MAX_STEPS * 2];
+};
+
+static LaneLog *lane_log;
+
+struct LaneStep {
+	int id;
+	gint *wait; /* if not NULL, wait until this is 1 before finishing */
+	gulong sleep;
+};
+
+class LaneStepClosure : public MediaClosure {
+protected:
+	virtual ~LaneStepClosure () {}
+
+public:
+	LaneStep *step;
+
+	LaneStepClosure (Media *media, MediaCallback *callback, LaneStep *step)
+		: MediaClosure (media, callback, media, "lane step")
+	{
+		this->step = step;
+	}
+};
+
+static void
+log_step (int step)
+{
+	lane_log->mutex.Lock ();
+	lane_log->steps [lane_log->count++] = step;
+	lane_log->mutex.Unlock ();
+}
+
+static int
+log_index (int step)
+{
+	for (int i = 0; i < lane_log->count; i++) {
+		if (lane_log->steps [i] == step)
+			return i;
+	}
+	return -1;
+}
+
+static MediaResult
+lane_step_callback (MediaClosure *closure)
+{
+	LaneStep *step = ((LaneStepClosure *) closure)->step;
+
+	lane_log->mutex.Lock ();
+	g_atomic_int_inc (&lane_log->running);
+	lane_log->max_running = MAX (lane_log->max_running, lane_log->running);
+	lane_log->mutex.Unlock ();
+
+	/* the start of a step is its id, the end its negated id */
+	log_step (step->id);
+	if (step->wait != NULL)
+		wait_for (step->wait, 1);
+	if (step->sleep)
+		g_usleep (step->sleep);
+	log_step (-step->id);
+
+	g_atomic_int_add (&lane_log->running, -1);
+	g_atomic_int_inc (&lane_log->done);
+
+	return MEDIA_SUCCESS;
+}
+
+static Media *
+create_media (LaneLog *log)
+{
+	unit_init_runtime ();
+
+	lane_log = log;
+	log->running = 0;
+	log->max_running = 0;
+	log->done = 0;
+	log->count = 0;
+
+	return new Media (NULL);
+}
+
+static void
+enqueue (Media *media, LaneStep *step, const void *lane)
+{
+	MediaClosure *closure = new LaneStepClosure (media, lane_step_callback, step);
+
+	closure->SetLane (lane);
+	media->EnqueueWork (closure);
+	closure->unref ();
+}
+
+/* Closures in different lanes of the same media execute at the same time */
+TEST(MediaLanes, Concurrent)
+{
+	LaneLog log;
+	Media *media = create_media (&log);
+	gint release = 0;
+	LaneStep a = { 1, &release, 0 };
+	LaneStep b = { 2, NULL, 0 };
+	int lane_a, lane_b;
+
+	enqueue (media, &a, &lane_a);
+	ASSERT_TRUE (wait_for (&log.running, 1));
+	enqueue (media, &b, &lane_b);
+
+	/* b finishes while a is still waiting */
+	ASSERT_TRUE (wait_for (&log.done, 1));
+	g_atomic_int_set (&release, 1);
+	ASSERT_TRUE (wait_for (&log.done, 2));
+
+	ASSERT_EQ (2, log.max_running);
+	ASSERT_LT (log_index (-2), log_index (-1));
+
+	media->unref ();
+}
+
+/* Closures in the same lane execute one at a time, in the order they were enqueued */
+TEST(MediaLanes, SameLane)
+{
+	LaneLog log;
+	Media *media = create_media (&log);
+	LaneStep steps [] = { { 1, NULL, 5000 }, { 2, NULL, 5000 }, { 3, NULL, 5000 } };
+	int lane;
+
+	for (guint i = 0; i < G_N_ELEMENTS (steps); i++)
+		enqueue (media, &steps [i], &lane);
+
+	ASSERT_TRUE (wait_for (&log.done, G_N_ELEMENTS (steps)));
+
+	ASSERT_EQ (1, log.max_running);
+	for (guint i = 0; i < G_N_ELEMENTS (steps); i++) {
+		ASSERT_EQ (steps [i].id, log.steps [i * 2]);
+		ASSERT_EQ (-steps [i].id, log.steps [i * 2 + 1]);
+	}
+
+	media->unref ();
+}
+
+/*
+ * An exclusive closure waits for the lanes enqueued before it, and the
+ * lanes enqueued after it wait for it.
+ */
+TEST(MediaLanes, Exclusive)
+{
+	LaneLog log;
+	Media *media = create_media (&log);
+	LaneStep before = { 1, NULL, 20000 };
+	LaneStep exclusive = { 2, NULL, 20000 };
+	LaneStep after = { 3, NULL, 0 };
+	int lane_a, lane_b;
+
+	enqueue (media, &before, &lane_a);
+	enqueue (media, &exclusive, NULL);
+	enqueue (media, &after, &lane_b);
+
+	ASSERT_TRUE (wait_for (&log.done, 3));
+
+	ASSERT_EQ (1, log.max_running);
+	ASSERT_LT (log_index (-1), log_index (2));
+	ASSERT_LT (log_index (-2), log_index (3));
+
+	media->unref ();
+}
+
+/*
+ * A decoder which decodes in its own lane. Each frame is held up until the
+ * test releases it, and is then reported decoded (and marshalled to the
+ * media thread).
+ */
+class LaneDecoder : public IMediaDecoder {
+protected:
+	virtual ~LaneDecoder () {}
+
+	virtual void DecodeFrameAsyncInternal (MediaFrame *frame)
+	{
+		g_atomic_int_set (&decoding, 1);
+		wait_for (&release, 1);
+		frame->AddState (MediaFrameDecoded);
+		ReportDecodeFrameCompleted (frame);
+	}
+
+	virtual void OpenDecoderAsyncInternal () {}
+
+	virtual void InputEnded ()
+	{
+		delivered_at_input_ended = GetStream ()->GetDecodedQueueLength ();
+		g_atomic_int_inc (&input_ended);
+	}
+
+	virtual bool CanDecodeConcurrently () { return true; }
+
+public:
+	gint decoding;
+	gint release;
+	gint input_ended;
+	gint32 delivered_at_input_ended;
+
+	LaneDecoder (Media *media, IMediaStream *stream)
+		: IMediaDecoder (Type::IMEDIADECODER, media, stream)
+	{
+		decoding = 0;
+		release = 0;
+		input_ended = 0;
+		delivered_at_input_ended = -1;
+	}
+};
+
+static MediaResult
+report_input_ended_callback (MediaClosure *closure)
+{
+	((IMediaDecoder *) closure->GetContext ())->ReportInputEnded ();
+	return MEDIA_SUCCESS;
+}
+
+/*
+ * The input ends (in an exclusive closure) after a lane has taken the last
+ * frame off the decoder's queue, but before the decoded frame has been
+ * delivered. The decoder is only told once the frame has been delivered.
+ */
+TEST(MediaLanes, InputEndedWhileDecoding)
+{
+	LaneLog log;
+	Media *media = create_media (&log);
+	AudioStream *stream = new AudioStream (media);
+	LaneDecoder *decoder = new LaneDecoder (media, stream);
+	MediaFrame *frame = new MediaFrame (stream);
+	MediaClosure *closure;
+
+	stream->SetDecoder (decoder);
+
+	decoder->DecodeFrameAsync (frame, true);
+	ASSERT_TRUE (wait_for (&decoder->decoding, 1));
+
+	/* the queue is empty, but the frame is still being decoded */
+	ASSERT_FALSE (decoder->IsDecoderQueueEmpty ());
+
+	closure = new MediaClosure (media, report_input_ended_callback, decoder, "report input ended");
+	media->EnqueueWork (closure);
+	closure->unref ();
+
+	/* the decoded frame is marshalled behind the closure reporting the end of the input */
+	g_atomic_int_set (&decoder->release, 1);
+	ASSERT_TRUE (wait_for (&decoder->input_ended, 1));
+
+	ASSERT_EQ (1, decoder->delivered_at_input_ended);
+	ASSERT_TRUE (decoder->IsDecoderQueueEmpty ());
+
+	frame->unref ();
+	decoder->Dispose ();
+	decoder->unref ();
+	stream->unref ();
+	media->unref ();
+}
@@ -0,0 +1,122 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <stdio.h>
+#include <glib/gstdio.h>
+
+#include "pipeline.h"
+
+using namespace Moonlight;
+
+#define CHUNK_SIZE 65536
+#define CHUNK_COUNT 16
+
+static FILE *
+create_temp_file (char **filename)
+{
+	*filename = unit_create_temp_file ("MoonlightMediaMapping", NULL, 0);
+	if (*filename == NULL)
+		return NULL;
+
+	return fopen (*filename, "r+");
+}
+
+TEST(MediaMapping, EmptyFile)
+{
+	char *filename;
+	FILE *fd = create_temp_file (&filename);
+
+	ASSERT_TRUE (fd != NULL);
+	ASSERT_TRUE (MediaMapping::Create (fileno (fd), 0) == NULL);
+
+	fclose (fd);
+	g_unlink (filename);
+	g_free (filename);
+}
+
+/*
+ * A mapping can be longer than the file, the pages become readable as they
+ * are written (with stdio, through a different handle). Only touching pages
+ * that haven't been written raises SIGBUS.
+ */
+TEST(MediaMapping, ProgressiveWrites)
+{
+	guint8 chunk [CHUNK_SIZE];
+	MediaMapping *mapping;
+	FILE *read_fd, *write_fd;
+	char *filename;
+
+	read_fd = create_temp_file (&filename);
+	ASSERT_TRUE (read_fd != NULL);
+	write_fd = fopen (filename, "w");
+	ASSERT_TRUE (write_fd != NULL);
+
+	mapping = MediaMapping::Create (fileno (read_fd), CHUNK_SIZE * CHUNK_COUNT);
+	ASSERT_TRUE (mapping != NULL);
+	ASSERT_EQ (CHUNK_SIZE * CHUNK_COUNT, mapping->GetLength ());
+
+	for (int i = 0; i < CHUNK_COUNT; i++) {
+		memset (chunk, i, CHUNK_SIZE);
+		ASSERT_EQ ((size_t) CHUNK_SIZE, fwrite (chunk, 1, CHUNK_SIZE, write_fd));
+		fflush (write_fd);
+
+		guint8 *data = mapping->GetData () + i * CHUNK_SIZE;
+		ASSERT_EQ (i, data [0]);
+		ASSERT_EQ (i, data [CHUNK_SIZE - 1]);
+	}
+
+	/* A second reference keeps the pages mapped */
+	mapping->ref ();
+	mapping->unref ();
+	ASSERT_EQ (CHUNK_COUNT - 1, mapping->GetData () [CHUNK_SIZE * CHUNK_COUNT - 1]);
+	mapping->unref ();
+
+	fclose (write_fd);
+	fclose (read_fd);
+	g_unlink (filename);
+	g_free (filename);
+}
+
+/* A download of unknown size is over when everything written to the file has been read */
+TEST(MediaMapping, ProgressiveEofUnknownSize)
+{
+	guint8 chunk [CHUNK_SIZE];
+	FILE *read_fd, *write_fd;
+	char *filename;
+
+	read_fd = create_temp_file (&filename);
+	ASSERT_TRUE (read_fd != NULL);
+	write_fd = fopen (filename, "w");
+	ASSERT_TRUE (write_fd != NULL);
+
+	ASSERT_TRUE (ProgressiveSource::IsEof (0, -1, read_fd));
+
+	memset (chunk, 1, CHUNK_SIZE);
+	ASSERT_EQ ((size_t) CHUNK_SIZE, fwrite (chunk, 1, CHUNK_SIZE, write_fd));
+	fflush (write_fd);
+
+	ASSERT_FALSE (ProgressiveSource::IsEof (0, -1, read_fd));
+	ASSERT_FALSE (ProgressiveSource::IsEof (CHUNK_SIZE - 1, -1, read_fd));
+	ASSERT_TRUE (ProgressiveSource::IsEof (CHUNK_SIZE, -1, read_fd));
+
+	/* A known size wins over the length of the file */
+	ASSERT_FALSE (ProgressiveSource::IsEof (CHUNK_SIZE, CHUNK_SIZE * 2, read_fd));
+	ASSERT_TRUE (ProgressiveSource::IsEof (CHUNK_SIZE * 2, CHUNK_SIZE * 2, read_fd));
+
+	fclose (write_fd);
+	fclose (read_fd);
+	g_unlink (filename);
+	g_free (filename);
+}
@@ -0,0 +1,528 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "pipeline-mp4.h"
+
+using namespace Moonlight;
+
+#define TIME_RUNS 4
+#define CHUNK_SAMPLES 10
+
+/*
+ * Builds the sample tables of a two hour, 25fps video track:
+ * - the frame rate changes a few times (several stts entries)
+ * - a key frame every 50 frames
+ * - B frames with a composition offset on every other frame (ctts)
+ * - 10 samples per chunk, except the first chunk which has 5
+ */
+static StblBox *
+create_stbl (guint32 sample_count)
+{
+	StblBox *stbl = new StblBox (NULL, 0, 0);
+	guint32 chunk_count = (sample_count - 5 + CHUNK_SAMPLES - 1) / CHUNK_SAMPLES + 1;
+	guint64 offset = 1024;
+	guint32 sample = 0;
+
+	stbl->stts = new SttsBox (0, 0);
+	stbl->stts->entry_count = TIME_RUNS;
+	stbl->stts->sample_count = (guint32 *) g_malloc (sizeof (guint32) * TIME_RUNS);
+	stbl->stts->sample_delta = (guint32 *) g_malloc (sizeof (guint32) * TIME_RUNS);
+	for (guint32 i = 0; i < TIME_RUNS; i++) {
+		stbl->stts->sample_count [i] = sample_count / TIME_RUNS + (i == TIME_RUNS - 1 ? sample_count % TIME_RUNS : 0);
+		stbl->stts->sample_delta [i] = 1000 + i;
+	}
+
+	stbl->ctts = new CttsBox (0, 0);
+	stbl->ctts->entry_count = sample_count;
+	stbl->ctts->sample_count = (guint32 *) g_malloc (sizeof (guint32) * sample_count);
+	stbl->ctts->sample_offset = (gint32 *) g_malloc (sizeof (gint32) * sample_count);
+	for (guint32 i = 0; i < sample_count; i++) {
+		stbl->ctts->sample_count [i] = 1;
+		stbl->ctts->sample_offset [i] = (i % 2) * 2000;
+	}
+
+	stbl->stsc = new StscBox (0, 0);
+	stbl->stsc->entry_count = 2;
+	stbl->stsc->first_chunk = (guint32 *) g_malloc (sizeof (guint32) * 2);
+	stbl->stsc->samples_per_chunk = (guint32 *) g_malloc (sizeof (guint32) * 2);
+	stbl->stsc->first_chunk [0] = 1;
+	stbl->stsc->samples_per_chunk [0] = 5;
+	stbl->stsc->first_chunk [1] = 2;
+	stbl->stsc->samples_per_chunk [1] = CHUNK_SAMPLES;
+
+	stbl->stsz = new StszBox (0, 0);
+	stbl->stsz->sample_count = sample_count;
+	stbl->stsz->entry_size = (guint32 *) g_malloc (sizeof (guint32) * sample_count);
+	for (guint32 i = 0; i < sample_count; i++)
+		stbl->stsz->entry_size [i] = 100 + (i * 7919) % 5000;
+
+	stbl->stco = new StcoBox (0, 0);
+	stbl->stco->entry_count = chunk_count;
+	stbl->stco->chunk_offset = (guint32 *) g_malloc (sizeof (guint32) * chunk_count);
+	for (guint32 i = 0; i < chunk_count; i++) {
+		guint32 n = i == 0 ? 5 : CHUNK_SAMPLES;
+		stbl->stco->chunk_offset [i] = (guint32) offset;
+		for (guint32 k = 0; k < n && sample < sample_count; k++)
+			offset += stbl->stsz->entry_size [sample++];
+		offset += 16; /* some interleaved data from another track */
+	}
+
+	stbl->stss = new StssBox (0, 0);
+	stbl->stss->entry_count = (sample_count + 49) / 50;
+	stbl->stss->sample_number = (guint32 *) g_malloc (sizeof (guint32) * stbl->stss->entry_count);
+	for (guint32 i = 0; i < stbl->stss->entry_count; i++)
+		stbl->stss->sample_number [i] = i * 50 + 1;
+
+	return stbl;
+}
+
+/* The straight-forward walk through the tables the index replaces */
+static guint64
+linear_decoding_time (SttsBox *stts, guint32 sample)
+{
+	guint64 time = 0;
+	for (guint32 i = 0; i < stts->entry_count; i++) {
+		if (sample < stts->sample_count [i])
+			return time + (guint64) sample * stts->sample_delta [i];
+		time += (guint64) stts->sample_count [i] * stts->sample_delta [i];
+		sample -= stts->sample_count [i];
+	}
+	return time;
+}
+
+static guint32
+linear_key_frame_before (StssBox *stss, guint32 sample)
+{
+	guint32 result = stss->sample_number [0] - 1;
+	for (guint32 i = 0; i < stss->entry_count && stss->sample_number [i] - 1 <= sample; i++)
+		result = stss->sample_number [i] - 1;
+	return result;
+}
+
+TEST(Mp4SampleIndex, Lookups)
+{
+	guint32 sample_count = 2 * 60 * 60 * 25;
+	StblBox *stbl = create_stbl (sample_count);
+	Mp4SampleIndex *index = new Mp4SampleIndex ();
+	guint64 offset = stbl->stco->chunk_offset [0];
+	guint32 chunk = 0;
+	guint32 chunk_sample = 0;
+
+	ASSERT_TRUE (index->Build (stbl) == NULL);
+	ASSERT_EQ (sample_count, index->sample_count);
+
+	for (guint32 i = 0; i < sample_count; i++) {
+		guint32 delta;
+		guint64 time = index->GetDecodingTime (i, &delta);
+
+		if (chunk_sample == (chunk == 0 ? 5 : CHUNK_SAMPLES)) {
+			chunk++;
+			chunk_sample = 0;
+			offset = stbl->stco->chunk_offset [chunk];
+		}
+
+		ASSERT_EQ (offset, index->GetOffset (i));
+		ASSERT_EQ (stbl->ctts->sample_offset [i], index->GetCompositionOffset (i));
+		ASSERT_EQ (linear_decoding_time (stbl->stts, i), time);
+		ASSERT_EQ (1000 + (i / (sample_count / TIME_RUNS)), delta);
+		ASSERT_EQ (i, index->GetSampleAt (time));
+		ASSERT_EQ (i, index->GetSampleAt (time + delta - 1));
+		ASSERT_EQ (i % 50 == 0, index->IsKeyFrame (i));
+		ASSERT_EQ (linear_key_frame_before (stbl->stss, i), index->GetKeyFrameBefore (i));
+
+		offset += index->GetSize (i);
+		chunk_sample++;
+	}
+
+	/* Past the end */
+	ASSERT_EQ (sample_count - 1, index->GetSampleAt (G_MAXUINT64));
+	ASSERT_EQ (0, index->GetCompositionOffset (sample_count));
+
+	delete index;
+	delete stbl;
+}
+
+TEST(Mp4SampleIndex, TruncatedChunks)
+{
+	StblBox *stbl = create_stbl (1000);
+	Mp4SampleIndex *index = new Mp4SampleIndex ();
+
+	/* Drop the last chunk, the samples in it can't be read */
+	stbl->stco->entry_count--;
+	ASSERT_TRUE (index->Build (stbl) == NULL);
+	ASSERT_EQ (995, index->sample_count);
+
+	delete index;
+	delete stbl;
+}
+
+TEST(Mp4SampleIndex, Seeks)
+{
+	guint32 sample_count = 2 * 60 * 60 * 25;
+	StblBox *stbl = create_stbl (sample_count);
+	Mp4SampleIndex *index = new Mp4SampleIndex ();
+	guint64 total = linear_decoding_time (stbl->stts, sample_count);
+	guint32 seeks = 1000;
+
+	ASSERT_TRUE (index->Build (stbl) == NULL);
+
+	/* Seeking to a time lands on the same key frame as walking the stss table like the demuxer used to */
+	for (guint32 i = 0; i <= seeks; i++) {
+		guint64 time = (total / seeks) * i;
+		guint32 sample = index->GetSampleAt (time);
+		guint32 key = index->GetKeyFrameBefore (sample);
+
+		ASSERT_LE (index->GetDecodingTime (sample, NULL), time);
+		ASSERT_EQ (linear_key_frame_before (stbl->stss, sample), key);
+		ASSERT_TRUE (index->IsKeyFrame (key));
+		ASSERT_LE (index->GetDecodingTime (key, NULL), time);
+	}
+
+	delete index;
+	delete stbl;
+}
+
+/* Movie fragments */
+
+static TrunBox *
+add_trun (TrafBox *traf, guint32 flags, guint32 sample_count)
+{
+	TrunBox *trun = new TrunBox (0, 0);
+
+	trun->flags = flags;
+	trun->sample_count = sample_count;
+	if (flags & TRUN_SAMPLE_DURATION_PRESENT)
+		trun->sample_duration = (guint32 *) g_malloc0 (sizeof (guint32) * sample_count);
+	if (flags & TRUN_SAMPLE_SIZE_PRESENT)
+		trun->sample_size = (guint32 *) g_malloc0 (sizeof (guint32) * sample_count);
+	if (flags & TRUN_SAMPLE_FLAGS_PRESENT)
+		trun->sample_flags = (guint32 *) g_malloc0 (sizeof (guint32) * sample_count);
+	if (flags & TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT)
+		trun->sample_composition_time_offset = (gint32 *) g_malloc0 (sizeof (gint32) * sample_count);
+
+	traf->trun_count++;
+	traf->trun = (TrunBox **) g_realloc (traf->trun, traf->trun_count * sizeof (TrunBox *));
+	traf->trun [traf->trun_count - 1] = trun;
+
+	return trun;
+}
+
+static TrafBox *
+create_traf (guint32 tfhd_flags)
+{
+	TrafBox *traf = new TrafBox (0, 0);
+
+	traf->tfhd = new TfhdBox (0, 0);
+	traf->tfhd->flags = tfhd_flags;
+
+	return traf;
+}
+
+/* A track with 100 samples in the moov box */
+static TrakBox *
+create_fragmented_trak (TrexBox *trex)
+{
+	TrakBox *trak = new TrakBox (0, 0);
+	StblBox *stbl = create_stbl (100);
+
+	trak->index = new Mp4SampleIndex ();
+	trak->index->Build (stbl);
+	trak->trex = trex;
+	trak->ResetFragments ();
+	delete stbl;
+
+	return trak;
+}
+
+TEST(Mp4Fragments, Defaults)
+{
+	TrexBox *trex = new TrexBox (0, 0);
+	TrakBox *trak;
+	TrafBox *traf;
+	TrunBox *trun;
+	Mp4FragmentSample *samples;
+
+	trex->default_sample_duration = 1000;
+	trex->default_sample_size = 500;
+	trex->default_sample_flags = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trak = create_fragmented_trak (trex);
+
+	/* The trex box provides the defaults the tfhd box doesn't override */
+	traf = create_traf (TFHD_DEFAULT_SAMPLE_SIZE_PRESENT);
+	traf->tfhd->default_sample_size = 300;
+
+	/* The first run has a key frame and overrides the duration of each sample */
+	trun = add_trun (traf, TRUN_FIRST_SAMPLE_FLAGS_PRESENT | TRUN_SAMPLE_DURATION_PRESENT, 3);
+	trun->first_sample_flags = 0;
+	trun->sample_duration [0] = 10;
+	trun->sample_duration [1] = 20;
+	trun->sample_duration [2] = 30;
+
+	/* The second run overrides the size and the flags of each sample */
+	trun = add_trun (traf, TRUN_SAMPLE_SIZE_PRESENT | TRUN_SAMPLE_FLAGS_PRESENT, 2);
+	trun->sample_size [0] = 7;
+	trun->sample_size [1] = 8;
+	trun->sample_flags [0] = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trun->sample_flags [1] = 0;
+
+	traf->QueueSamples (trak, 0, 0, true);
+	ASSERT_EQ (5u, trak->fragment_sample_count);
+	samples = trak->fragment_samples;
+
+	ASSERT_EQ (10u, samples [0].duration);
+	ASSERT_EQ (30u, samples [2].duration);
+	ASSERT_EQ (1000u, samples [3].duration);
+	ASSERT_EQ (300u, samples [0].size);
+	ASSERT_EQ (300u, samples [2].size);
+	ASSERT_EQ (7u, samples [3].size);
+	ASSERT_EQ (8u, samples [4].size);
+	ASSERT_TRUE (samples [0].key_frame);
+	ASSERT_FALSE (samples [1].key_frame);
+	ASSERT_FALSE (samples [3].key_frame);
+	ASSERT_TRUE (samples [4].key_frame);
+	ASSERT_EQ (0, samples [0].composition_offset);
+
+	/* Without a trex box everything not in the fragment is 0, and every sample is a key frame */
+	trak->ClearFragmentSamples ();
+	trak->trex = NULL;
+	traf->QueueSamples (trak, 0, 0, true);
+	samples = trak->fragment_samples;
+	ASSERT_EQ (0u, samples [3].duration);
+	ASSERT_TRUE (samples [1].key_frame);
+	ASSERT_EQ (300u, samples [1].size);
+
+	/* Samples nobody reads aren't queued, but the time still advances */
+	trak->ClearFragmentSamples ();
+	trak->ResetFragments ();
+	traf->QueueSamples (trak, 0, 0, false);
+	ASSERT_EQ (0u, trak->fragment_sample_count);
+	ASSERT_EQ (trak->index->GetDecodingTime (100, NULL) + 60, trak->fragment_time);
+
+	delete traf;
+	delete trak;
+	delete trex;
+}
+
+TEST(Mp4Fragments, DataOffsets)
+{
+	TrexBox *trex = new TrexBox (0, 0);
+	TrakBox *trak;
+	TrafBox *traf;
+	TrunBox *trun;
+	guint64 moof_position = 100000;
+	guint64 data_end;
+
+	trex->default_sample_duration = 1000;
+	trex->default_sample_size = 100;
+	trak = create_fragmented_trak (trex);
+
+	/* The first track fragment, its data offsets are relative to the moof box.
+	 * The second run has no data offset, it follows the first one. */
+	traf = create_traf (0);
+	trun = add_trun (traf, TRUN_DATA_OFFSET_PRESENT, 2);
+	trun->data_offset = 200;
+	add_trun (traf, 0, 2);
+	data_end = traf->QueueSamples (trak, moof_position, moof_position, true);
+	delete traf;
+
+	ASSERT_EQ (moof_position + 600, data_end);
+	ASSERT_EQ (moof_position + 200, trak->fragment_samples [0].offset);
+	ASSERT_EQ (moof_position + 300, trak->fragment_samples [1].offset);
+	ASSERT_EQ (moof_position + 400, trak->fragment_samples [2].offset);
+
+	/* The next track fragment without a base data offset follows the previous one */
+	traf = create_traf (0);
+	trun = add_trun (traf, TRUN_DATA_OFFSET_PRESENT, 1);
+	trun->data_offset = 16;
+	data_end = traf->QueueSamples (trak, moof_position, data_end, true);
+	delete traf;
+
+	ASSERT_EQ (moof_position + 600 + 16, trak->fragment_samples [4].offset);
+	ASSERT_EQ (moof_position + 716, data_end);
+
+	/* ... unless the tfhd box says its base is the moof box */
+	traf = create_traf (TFHD_DEFAULT_BASE_IS_MOOF);
+	trun = add_trun (traf, TRUN_DATA_OFFSET_PRESENT, 1);
+	trun->data_offset = 16;
+	data_end = traf->QueueSamples (trak, moof_position, data_end, true);
+	delete traf;
+
+	ASSERT_EQ (moof_position + 16, trak->fragment_samples [5].offset);
+
+	/* ... or has a base data offset, which is an absolute file offset */
+	traf = create_traf (TFHD_BASE_DATA_OFFSET_PRESENT | TFHD_DEFAULT_BASE_IS_MOOF);
+	traf->tfhd->base_data_offset = 5000;
+	trun = add_trun (traf, TRUN_DATA_OFFSET_PRESENT, 1);
+	trun->data_offset = -16;
+	data_end = traf->QueueSamples (trak, moof_position, data_end, true);
+	delete traf;
+
+	ASSERT_EQ (5000u - 16, trak->fragment_samples [6].offset);
+	ASSERT_EQ (5000u - 16 + 100, data_end);
+
+	delete trak;
+	delete trex;
+}
+
+TEST(Mp4Fragments, CompositionOffsets)
+{
+	TrexBox *trex = new TrexBox (0, 0);
+	TrakBox *trak;
+	TrafBox *traf;
+	TrunBox *trun;
+
+	/* Version 0 trun boxes have unsigned offsets, version 1 boxes signed ones */
+	ASSERT_EQ (2000, TrunBox::ToCompositionOffset (0, 2000));
+	ASSERT_EQ (G_MAXINT32, TrunBox::ToCompositionOffset (0, 0xFFFFF830));
+	ASSERT_EQ (2000, TrunBox::ToCompositionOffset (1, 2000));
+	ASSERT_EQ (-2000, TrunBox::ToCompositionOffset (1, 0xFFFFF830));
+
+	trex->default_sample_duration = 1000;
+	trak = create_fragmented_trak (trex);
+
+	traf = create_traf (0);
+	trun = add_trun (traf, TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT, 3);
+	trun->version = 1;
+	trun->sample_composition_time_offset [0] = TrunBox::ToCompositionOffset (1, 1000);
+	trun->sample_composition_time_offset [1] = TrunBox::ToCompositionOffset (1, 0xFFFFFC18);
+	trun->sample_composition_time_offset [2] = TrunBox::ToCompositionOffset (1, 0);
+	traf->QueueSamples (trak, 0, 0, true);
+
+	ASSERT_EQ (1000, trak->fragment_samples [0].composition_offset);
+	ASSERT_EQ (-1000, trak->fragment_samples [1].composition_offset);
+	ASSERT_EQ (0, trak->fragment_samples [2].composition_offset);
+
+	delete traf;
+	delete trak;
+	delete trex;
+}
+
+TEST(Mp4Fragments, FragmentTime)
+{
+	TrexBox *trex = new TrexBox (0, 0);
+	TrakBox *trak;
+	TrafBox *traf;
+	guint64 moov_end;
+
+	trex->default_sample_duration = 1000;
+	trak = create_fragmented_trak (trex);
+
+	/* The first fragment follows the samples in the moov box */
+	moov_end = trak->index->GetDecodingTime (trak->index->sample_count, NULL);
+	ASSERT_EQ (25u * (1000 + 1001 + 1002 + 1003), moov_end);
+	ASSERT_EQ (moov_end, trak->fragment_time);
+
+	traf = create_traf (0);
+	add_trun (traf, 0, 10);
+	traf->QueueSamples (trak, 0, 0, true);
+	ASSERT_EQ (moov_end, trak->fragment_samples [0].decoding_time);
+	ASSERT_EQ (moov_end + 9000, trak->fragment_samples [9].decoding_time);
+
+	/* The next fragment continues where the previous one ended */
+	traf->QueueSamples (trak, 0, 0, true);
+	ASSERT_EQ (moov_end + 10000, trak->fragment_samples [10].decoding_time);
+	ASSERT_EQ (moov_end + 20000, trak->fragment_time);
+
+	/* Seeking starts over after the moov box */
+	trak->ResetFragments ();
+	ASSERT_EQ (0u, trak->fragment_sample_count);
+	ASSERT_EQ (moov_end, trak->fragment_time);
+
+	/* A tfdt box sets the time */
+	traf->tfdt = new TfdtBox (0, 0);
+	traf->tfdt->base_media_decode_time = 12345678;
+	traf->QueueSamples (trak, 0, 0, true);
+	ASSERT_EQ (12345678u, trak->fragment_samples [0].decoding_time);
+	ASSERT_EQ (12345678u + 10000, trak->fragment_time);
+
+	delete traf;
+	delete trak;
+	delete trex;
+}
+
+/* The time->fragment table seeks use instead of reading every fragment from the start */
+TEST(Mp4Fragments, Table)
+{
+	Mp4FragmentTable *table = new Mp4FragmentTable (2);
+	/* track 0 has a key frame in every other fragment, track 1 in every fragment */
+	guint64 start [2];
+	guint64 key [2];
+
+	for (guint32 i = 0; i < 10; i++) {
+		start [0] = i * 1000;
+		start [1] = i * 500;
+		key [0] = (i % 2) == 0 ? i * 1000 + 100 : G_MAXUINT64;
+		key [1] = i * 500;
+		table->Add (10000 + i * 5000, start, key);
+	}
+	ASSERT_EQ (10u, table->count);
+
+	/* fragments read again after a seek aren't added again */
+	table->Add (10000 + 4 * 5000, start, key);
+	ASSERT_EQ (10u, table->count);
+
+	ASSERT_EQ (4, table->FindKeyFragment (0, 4100));
+	ASSERT_EQ (4, table->FindKeyFragment (0, 5999));
+	/* the key frame of fragment 4 is after the time, it's in fragment 2 */
+	ASSERT_EQ (2, table->FindKeyFragment (0, 4050));
+	ASSERT_EQ (8, table->FindKeyFragment (0, 1000000));
+	ASSERT_EQ (-1, table->FindKeyFragment (0, 50));
+	ASSERT_EQ (3, table->FindKeyFragment (1, 1700));
+	ASSERT_EQ (0, table->FindKeyFragment (1, 0));
+
+	ASSERT_EQ (3000u, table->GetStartTime (3, 0));
+	ASSERT_EQ (1500u, table->GetStartTime (3, 1));
+	ASSERT_EQ (25000u, table->position [3]);
+
+	delete table;
+}
+
+/* QueueSamples records the first key frame of the fragment for the table */
+TEST(Mp4Fragments, KeyTime)
+{
+	TrexBox *trex = new TrexBox (0, 0);
+	TrakBox *trak;
+	TrafBox *traf;
+	TrunBox *trun;
+	guint64 start;
+
+	trex->default_sample_duration = 1000;
+	trex->default_sample_size = 100;
+	trex->default_sample_flags = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trak = create_fragmented_trak (trex);
+	start = trak->fragment_time;
+
+	traf = create_traf (0);
+	trun = add_trun (traf, TRUN_SAMPLE_FLAGS_PRESENT, 4);
+	trun->sample_flags [0] = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trun->sample_flags [1] = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trun->sample_flags [2] = 0;
+	trun->sample_flags [3] = 0;
+
+	trak->fragment_key_time = G_MAXUINT64;
+	traf->QueueSamples (trak, 0, 0, false);
+	ASSERT_EQ (start + 2000, trak->fragment_key_time);
+
+	/* none at all */
+	trun->sample_flags [2] = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trun->sample_flags [3] = SAMPLE_FLAGS_IS_NON_SYNC_SAMPLE;
+	trak->fragment_key_time = G_MAXUINT64;
+	traf->QueueSamples (trak, 0, 0, false);
+	ASSERT_EQ (G_MAXUINT64, trak->fragment_key_time);
+
+	delete traf;
+	delete trak;
+	delete trex;
+}
@@ -0,0 +1,429 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <glib/gstdio.h>
+
+#include "runtime.h"
+#include "playlist.h"
+#include "mediaelement.h"
+#include "mediaplayer.h"
+#include "audio.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define TIMECODE_SHORT "file://" TEST_MEDIA_DIR "/video/timecode-short.wmv"
+
+/*
+ * Two plain entries with a zero duration entry between them (PlayNext skips
+ * it), and an entry ref at the end. The source of the second entry is given.
+ */
+#define ASX \
+	"<ASX version=\"3.0\">\n" \
+	"  <ENTRY><REF HREF=\"" TIMECODE_SHORT "\" /></ENTRY>\n" \
+	"  <ENTRY><DURATION value=\"00:00:00\" /><REF HREF=\"" TIMECODE_SHORT "\" /></ENTRY>\n" \
+	"  <ENTRY><REF HREF=\"%s\" /></ENTRY>\n" \
+	"  <ENTRYREF HREF=\"file://" TEST_MEDIA_DIR "/playlist/nested-1.asx\" />\n" \
+	"</ASX>\n"
+
+#define ENTRY_COUNT 4
+
+struct PlaylistTest {
+	guint32 saved_flags; /* moonlight_flags before the test, destroy_playlist restores them */
+	MediaElement *element;
+	Playlist *playlist;
+	PlaylistEntry *entries [ENTRY_COUNT];
+
+	/* what the playlist raised */
+	int errors;
+	int seeking;
+	int seek_completed;
+	int buffering;
+};
+
+static void
+count_event (EventObject *sender, EventArgs *args, gpointer closure)
+{
+	(*(int *) closure)++;
+}
+
+static void
+create_playlist (PlaylistTest *test, const char *second)
+{
+	char *asx = g_strdup_printf (ASX, second);
+	PlaylistEntry *root;
+	PlaylistNode *node;
+	Media *media;
+	int i = 0;
+
+	unit_init_runtime ();
+
+	memset (test, 0, sizeof (PlaylistTest));
+
+	/* the media player doesn't get an audio source */
+	test->saved_flags = moonlight_flags;
+	moonlight_flags |= RUNTIME_INIT_DISABLE_AUDIO;
+
+	test->element = MoonUnmanagedFactory::CreateMediaElement ();
+	test->element->CreatePlaylist ();
+	test->playlist = test->element->GetPlaylist ();
+	test->playlist->AddHandler (Playlist::MediaErrorEvent, count_event, &test->errors);
+	test->playlist->AddHandler (Playlist::SeekingEvent, count_event, &test->seeking);
+	test->playlist->AddHandler (Playlist::SeekCompletedEvent, count_event, &test->seek_completed);
+	test->playlist->AddHandler (Playlist::BufferingProgressChangedEvent, count_event, &test->buffering);
+
+	/* what the asx demuxer does once the playlist has been downloaded */
+	root = test->playlist->GetFirstEntry ();
+	media = new Media (root);
+	MemoryBuffer *buffer = new MemoryBuffer (media, asx, strlen (asx), true);
+	PlaylistParser *parser = new PlaylistParser (root, buffer);
+	ASSERT_EQ (MEDIA_SUCCESS, parser->Parse ());
+	delete parser;
+	buffer->unref ();
+	media->unref ();
+
+	ASSERT_EQ (ENTRY_COUNT, root->GetCount ());
+	for (node = root->GetFirstNode (); node != NULL; node = (PlaylistNode *) node->next)
+		test->entries [i++] = node->GetElement ();
+
+	ASSERT_TRUE (test->entries [0]->IsCurrent ());
+	ASSERT_TRUE (test->entries [3]->GetIsEntryRef ());
+}
+
+static void
+destroy_playlist (PlaylistTest *test)
+{
+	test->element->Dispose ();
+	test->element->unref ();
+
+	moonlight_flags = test->saved_flags;
+}
+
+/*
+ * The entry after the zero duration one is opened while the first one plays,
+ * and PlayNext doesn't open it again.
+ */
+TEST(Playlist, Preopen)
+{
+	PlaylistTest test;
+	Media *media;
+
+	create_playlist (&test, TIMECODE_SHORT);
+
+	ASSERT_EQ (test.entries [2], test.entries [0]->GetNextEntryLeaf ());
+
+	test.entries [0]->OpenNextInAdvance ();
+
+	ASSERT_FALSE (test.entries [0]->GetIsPreopened ());
+	ASSERT_TRUE (test.entries [1]->GetMedia () == NULL);
+	ASSERT_TRUE (test.entries [2]->GetIsPreopened ());
+	ASSERT_FALSE (test.entries [2]->HasPreopenError ());
+	media = test.entries [2]->GetMedia ();
+	ASSERT_TRUE (media != NULL);
+
+	/* its buffering isn't reported while the first entry is playing */
+	ProgressEventArgs *args = new ProgressEventArgs (0.5, 0.0);
+	test.entries [2]->BufferingProgressChangedHandler (media, args);
+	args->unref ();
+	ASSERT_EQ (0, test.buffering);
+
+	/* opening it again doesn't do anything */
+	test.entries [0]->OpenNextInAdvance ();
+	ASSERT_EQ (media, test.entries [2]->GetMedia ());
+
+	ASSERT_TRUE (test.playlist->GetFirstEntry ()->PlayNext ());
+	ASSERT_TRUE (test.entries [2]->IsCurrent ());
+	ASSERT_EQ (media, test.entries [2]->GetMedia ());
+	ASSERT_EQ (0, test.errors);
+
+	/* entry refs aren't opened in advance */
+	ASSERT_EQ (test.entries [3], test.entries [2]->GetNextEntryLeaf ());
+	test.entries [2]->OpenNextInAdvance ();
+	ASSERT_FALSE (test.entries [3]->GetIsPreopened ());
+	ASSERT_TRUE (test.entries [3]->GetMedia () == NULL);
+
+	destroy_playlist (&test);
+}
+
+/* An error in the preopened entry is reported once it becomes current, not while the first entry plays */
+TEST(Playlist, PreopenError)
+{
+	PlaylistTest test;
+	Media *media;
+
+	create_playlist (&test, "file://" TEST_MEDIA_DIR "/video/does-not-exist.wmv");
+
+	test.entries [0]->OpenNextInAdvance ();
+	media = test.entries [2]->GetMedia ();
+	ASSERT_TRUE (media != NULL);
+
+	ErrorEventArgs *args = new ErrorEventArgs (MediaError, MoonError (MoonError::EXCEPTION, 4001, "AG_E_NETWORK_ERROR"));
+	test.entries [2]->MediaErrorHandler (media, args);
+	args->unref ();
+
+	ASSERT_TRUE (test.entries [2]->HasPreopenError ());
+	ASSERT_EQ (0, test.errors);
+	ASSERT_TRUE (test.entries [0]->IsCurrent ());
+
+	test.playlist->GetFirstEntry ()->PlayNext ();
+	ASSERT_TRUE (test.entries [2]->IsCurrent ());
+	ASSERT_FALSE (test.entries [2]->HasPreopenError ());
+	ASSERT_FALSE (test.entries [2]->GetIsPreopened ());
+	ASSERT_EQ (1, test.errors);
+
+	destroy_playlist (&test);
+}
+
+/* Seeking the preopened entry (to its start time) while it prebuffers isn't reported as a seek of the playlist */
+TEST(Playlist, SeekWhilePrebuffering)
+{
+	PlaylistTest test;
+	Media *media;
+
+	create_playlist (&test, TIMECODE_SHORT);
+
+	test.entries [0]->OpenNextInAdvance ();
+	media = test.entries [2]->GetMedia ();
+	ASSERT_TRUE (media != NULL);
+
+	test.entries [2]->SeekingHandler (media, NULL);
+	test.entries [2]->SeekCompletedHandler (media, NULL);
+	ASSERT_EQ (0, test.seeking);
+	ASSERT_EQ (0, test.seek_completed);
+
+	/* the current entry's seeks are */
+	test.entries [0]->SeekingHandler (NULL, NULL);
+	test.entries [0]->SeekCompletedHandler (NULL, NULL);
+	ASSERT_EQ (1, test.seeking);
+	ASSERT_EQ (1, test.seek_completed);
+
+	/* and so are the preopened entry's once it's current */
+	test.playlist->GetFirstEntry ()->PlayNext ();
+	test.entries [2]->SeekingHandler (media, NULL);
+	test.entries [2]->SeekCompletedHandler (media, NULL);
+	ASSERT_EQ (2, test.seeking);
+	ASSERT_EQ (2, test.seek_completed);
+
+	destroy_playlist (&test);
+}
+
+/*
+ * Gapless playback: the audio of the preopened entry is queued to start on the
+ * sample after the last one of the current entry. Both entries get synthetic
+ * 16bit stereo streams (at the rate the mixer mixes at, so that it doesn't
+ * resample) counting up across the two, which are mixed into a file sink.
+ */
+
+#define SPLICE_RATE 44100
+#define SPLICE_FIRST 1000 /* frames, not a multiple of the 20 ms mixer period */
+#define SPLICE_SECOND 1500
+
+/* A demuxer which doesn't demux anything, the test enqueues the decoded frames itself */
+class SpliceDemuxer : public IMediaDemuxer {
+protected:
+	virtual ~SpliceDemuxer () {}
+
+	virtual void GetFrameAsyncInternal (IMediaStream *stream) {}
+	virtual void OpenDemuxerAsyncInternal () {}
+	virtual void SeekAsyncInternal (guint64 pts) {}
+	virtual void SwitchMediaStreamAsyncInternal (IMediaStream *stream) {}
+
+public:
+	SpliceDemuxer (Media *media)
+		: IMediaDemuxer (Type::IMEDIADEMUXER, media)
+	{
+	}
+};
+
+struct SpliceStream {
+	Media *media;
+	AudioStream *stream;
+	int first; /* the value of the first frame */
+	int frames;
+	gint enqueued;
+};
+
+class EnqueueFramesClosure : public MediaClosure {
+protected:
+	virtual ~EnqueueFramesClosure () {}
+
+public:
+	SpliceStream *ss;
+
+	EnqueueFramesClosure (Media *media, MediaCallback *callback, SpliceStream *ss)
+		: MediaClosure (media, callback, media, "enqueue frames")
+	{
+		this->ss = ss;
+	}
+};
+
+/* Frame i of the streams is (i + 1, -(i + 1)) */
+static MediaResult
+enqueue_frames_callback (MediaClosure *closure)
+{
+	SpliceStream *ss = ((EnqueueFramesClosure *) closure)->ss;
+	MediaFrame *frame = new MediaFrame (ss->stream);
+	gint16 *samples;
+
+	frame->AllocateBuffer (ss->frames * 2 * sizeof (gint16));
+	samples = (gint16 *) frame->GetBuffer ();
+	for (int i = 0; i < ss->frames; i++) {
+		samples [i * 2] = ss->first + i;
+		samples [i * 2 + 1] = -(ss->first + i);
+	}
+	frame->pts = 0;
+	frame->AddState (MediaFrameDecoded);
+
+	ss->stream->EnqueueDecodedFrame (frame);
+	ss->stream->SetOutputEnded (true);
+	frame->unref ();
+
+	g_atomic_int_set (&ss->enqueued, 1);
+
+	return MEDIA_SUCCESS;
+}
+
+static bool
+wait_for (gint *value, gint expected)
+{
+	for (int i = 0; i < 5000; i++) {
+		if (g_atomic_int_get (value) == expected)
+			return true;
+		g_usleep (1000);
+	}
+	return false;
+}
+
+static bool
+wait_for_ended (AudioSource *source)
+{
+	for (int i = 0; i < 5000; i++) {
+		if (source->GetFlag (AudioEnded))
+			return true;
+		g_usleep (1000);
+	}
+	return false;
+}
+
+static void
+create_stream (SpliceStream *ss, int first, int frames)
+{
+	SpliceDemuxer *demuxer;
+	MediaClosure *closure;
+
+	ss->media = new Media (NULL);
+	ss->stream = new AudioStream (ss->media);
+	ss->stream->SetChannels (2);
+	ss->stream->SetSampleRate (SPLICE_RATE);
+	ss->stream->SetBitsPerSample (16);
+	ss->first = first;
+	ss->frames = frames;
+	ss->enqueued = 0;
+
+	demuxer = new SpliceDemuxer (ss->media);
+	demuxer->AddStream (ss->stream);
+	ss->media->Initialize (demuxer);
+	demuxer->unref ();
+
+	closure = new EnqueueFramesClosure (ss->media, enqueue_frames_callback, ss);
+	ss->media->EnqueueWork (closure);
+	closure->unref ();
+}
+
+static void
+destroy_stream (SpliceStream *ss)
+{
+	ss->stream->unref ();
+	ss->media->Dispose ();
+	ss->media->unref ();
+}
+
+TEST(Playlist, GaplessSplice)
+{
+	char *filename = unit_create_temp_file ("splice", "", 0);
+	PlaylistTest test;
+	SpliceStream first;
+	SpliceStream second;
+	AudioSource *current;
+	AudioSource *queued;
+	gint16 *samples;
+	gchar *contents;
+	gsize length;
+	gsize frames;
+	char *sink;
+
+	create_playlist (&test, TIMECODE_SHORT);
+
+	/* the mixer with a file sink instead of the null audio player */
+	moonlight_flags &= ~RUNTIME_INIT_DISABLE_AUDIO;
+	sink = g_strdup_printf ("file:%s", filename);
+	g_setenv ("MOONLIGHT_AUDIO_SINK", sink, true);
+	g_free (sink);
+
+	create_stream (&first, 1, SPLICE_FIRST);
+	create_stream (&second, 1 + SPLICE_FIRST, SPLICE_SECOND);
+	ASSERT_TRUE (wait_for (&first.enqueued, 1));
+	ASSERT_TRUE (wait_for (&second.enqueued, 1));
+
+	/* what MediaPlayer::Open does for the current entry */
+	current = AudioPlayer::Add (test.element->GetMediaPlayer (), first.stream);
+	ASSERT_TRUE (current != NULL);
+
+	/* and Prebuffer for the preopened one */
+	test.entries [2]->QueueAudio (current, second.stream);
+
+	current->Play ();
+	ASSERT_TRUE (wait_for_ended (current));
+
+	/* the media player takes the queued source over when it opens the entry */
+	queued = test.entries [2]->TakeQueuedAudio (second.stream);
+	ASSERT_TRUE (queued != NULL);
+	ASSERT_FALSE (queued->GetFlag (AudioQueued));
+	ASSERT_TRUE (wait_for_ended (queued));
+	ASSERT_TRUE (test.entries [2]->TakeQueuedAudio (second.stream) == NULL);
+
+	AudioPlayer::Remove (current);
+	current->Dispose ();
+	current->unref ();
+	AudioPlayer::Remove (queued);
+	queued->Dispose ();
+	queued->unref ();
+
+	/* closes the sink, the next test gets a new audio player */
+	AudioPlayer::Shutdown ();
+	g_unsetenv ("MOONLIGHT_AUDIO_SINK");
+
+	ASSERT_TRUE (g_file_get_contents (filename, &contents, &length, NULL));
+	samples = (gint16 *) contents;
+	frames = length / (2 * sizeof (gint16));
+
+	/* both streams, without a gap between them, and the silence of the last period */
+	ASSERT_GE (frames, (gsize) (SPLICE_FIRST + SPLICE_SECOND));
+	ASSERT_LT (frames, (gsize) (SPLICE_FIRST + SPLICE_SECOND + SPLICE_RATE / 50));
+	for (gsize i = 0; i < SPLICE_FIRST + SPLICE_SECOND; i++) {
+		ASSERT_EQ ((gint16) (i + 1), samples [i * 2]) << "frame " << i;
+		ASSERT_EQ ((gint16) -(i + 1), samples [i * 2 + 1]) << "frame " << i;
+	}
+	for (gsize i = SPLICE_FIRST + SPLICE_SECOND; i < frames; i++)
+		ASSERT_EQ (0, samples [i * 2]) << "frame " << i;
+
+	g_free (contents);
+	g_unlink (filename);
+	g_free (filename);
+
+	destroy_stream (&first);
+	destroy_stream (&second);
+	destroy_playlist (&test);
+}
@@ -0,0 +1,394 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "richtextlayout.h"
+#include "richtextbox.h"
+#include "textelement.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define LINE_COUNT 100
+
+/*
+ * A document of LINE_COUNT lines ("line 0" to "line 99") in a single run,
+ * laid out natively (the way LayoutBlock lays them out) one line per line
+ * of text, every line 8 pixels per character wide.
+ */
+struct TestLayout {
+	RichTextBox *rtb;
+	Run *run;
+	RichTextLayout *layout;
+	guint32 start [LINE_COUNT]; // the offset of each line in the run
+	guint32 length [LINE_COUNT];
+};
+
+static void
+create_layout (TestLayout *test)
+{
+	Paragraph *paragraph;
+	TextLayoutAttributes *attrs;
+	GString *text = g_string_new ("");
+	guint32 offset = 0;
+
+	unit_init_runtime ();
+
+	for (int i = 0; i < LINE_COUNT; i++) {
+		char *line = g_strdup_printf ("line %d", i);
+
+		test->start [i] = offset;
+		test->length [i] = strlen (line);
+		offset += test->length [i] + 1;
+
+		g_string_append_printf (text, "%s%s", i > 0 ? "\n" : "", line);
+		g_free (line);
+	}
+
+	test->rtb = MoonUnmanagedFactory::CreateRichTextBox ();
+	test->run = MoonUnmanagedFactory::CreateRun ();
+	test->run->SetText (text->str);
+	paragraph = MoonUnmanagedFactory::CreateParagraph ();
+	paragraph->GetInlines ()->Add (test->run);
+	test->rtb->GetBlocks ()->Add (paragraph);
+	paragraph->unref ();
+	g_string_free (text, true);
+
+	test->layout = new RichTextLayout ();
+	test->layout->actual_width = 0.0;
+	test->layout->actual_height = 0.0;
+	attrs = new TextLayoutAttributes (test->run);
+
+	for (int i = 0; i < LINE_COUNT; i++) {
+		TextPointer start (test->run, test->start [i], LogicalDirectionForward);
+		TextPointer end (test->run, test->start [i] + test->length [i], LogicalDirectionBackward);
+		RichTextLayoutLine *line = new RichTextLayoutLine (test->layout, start, test->layout->actual_height);
+		RichTextLayoutInline *inline_ = new RichTextLayoutInlineGlyphs (line, attrs, start, end);
+
+		inline_->size.width = test->length [i] * 8.0;
+		line->AddInline (inline_);
+		test->layout->AddLine (line);
+	}
+}
+
+static void
+destroy_layout (TestLayout *test)
+{
+	delete test->layout;
+	test->run->unref ();
+	test->rtb->unref ();
+}
+
+static TextPointer
+pointer (TestLayout *test, guint32 offset)
+{
+	return TextPointer (test->run, offset, LogicalDirectionForward);
+}
+
+/* A y at the boundary of two lines is on the second one, and past the last line on none */
+TEST(RichTextLayout, LineIndexFromY)
+{
+	TestLayout test;
+	double height;
+
+	create_layout (&test);
+	height = test.layout->GetLineFromIndex (0)->size.height;
+	ASSERT_GT (height, 0.0);
+
+	ASSERT_EQ (0, test.layout->GetLineIndexFromY (-10.0));
+	ASSERT_EQ (0, test.layout->GetLineIndexFromY (0.0));
+	ASSERT_EQ (0, test.layout->GetLineIndexFromY (height - 0.01));
+	ASSERT_EQ (1, test.layout->GetLineIndexFromY (height));
+	ASSERT_EQ (1, test.layout->GetLineIndexFromY (height + 0.01));
+
+	for (int i = 0; i < LINE_COUNT; i++) {
+		ASSERT_EQ (i, test.layout->GetLineIndexFromY (i * height)) << "line " << i;
+		ASSERT_EQ (i, test.layout->GetLineIndexFromY ((i + 0.5) * height)) << "line " << i;
+	}
+
+	ASSERT_EQ (LINE_COUNT - 1, test.layout->GetLineIndexFromY (LINE_COUNT * height - 0.01));
+	ASSERT_EQ (LINE_COUNT, test.layout->GetLineIndexFromY (LINE_COUNT * height));
+	ASSERT_EQ (LINE_COUNT, test.layout->GetLineIndexFromY (LINE_COUNT * height * 2));
+
+	/* GetLineFromY is relative to the offset */
+	int index = -1;
+	ASSERT_TRUE (test.layout->GetLineFromY (Point (0, 100.0), 100.0 + 2.5 * height, &index) == test.layout->GetLineFromIndex (2));
+	ASSERT_EQ (2, index);
+	ASSERT_TRUE (test.layout->GetLineFromY (Point (0, 100.0), 100.0 + LINE_COUNT * height) == NULL);
+
+	destroy_layout (&test);
+}
+
+/* The first line starting at or after a pointer: the pointer's own line only if it's at its start */
+TEST(RichTextLayout, LineIndexFromPointer)
+{
+	TestLayout test;
+
+	create_layout (&test);
+
+	for (int i = 0; i < LINE_COUNT; i++) {
+		ASSERT_EQ (i, test.layout->GetLineIndexFromPointer (pointer (&test, test.start [i]))) << "line " << i;
+		ASSERT_EQ (i + 1, test.layout->GetLineIndexFromPointer (pointer (&test, test.start [i] + 1))) << "line " << i;
+		ASSERT_EQ (i + 1, test.layout->GetLineIndexFromPointer (pointer (&test, test.start [i] + test.length [i]))) << "line " << i;
+	}
+
+	/* the end of the run, past the start of every line */
+	ASSERT_EQ (LINE_COUNT, test.layout->GetLineIndexFromPointer (TextPointer (test.run, (guint32) -1, LogicalDirectionForward)));
+
+	destroy_layout (&test);
+}
+
+/*
+ * GetCursor only looks at the line before the first one starting at or
+ * after the pointer and at that line: the cursor is on the right line at
+ * the start, in the middle and at the end of every line.
+ */
+TEST(RichTextLayout, Cursor)
+{
+	TestLayout test;
+	Point offset (10.0, 20.0);
+	double height;
+	Rect r;
+
+	create_layout (&test);
+	height = test.layout->GetLineFromIndex (0)->size.height;
+
+	for (int i = 0; i < LINE_COUNT; i++) {
+		r = test.layout->GetCursor (offset, pointer (&test, test.start [i]));
+		ASSERT_EQ (20.0 + i * height, r.y) << "start of line " << i;
+		ASSERT_EQ (10.0, r.x) << "start of line " << i;
+		ASSERT_EQ (height, r.height) << "start of line " << i;
+
+		r = test.layout->GetCursor (offset, pointer (&test, test.start [i] + 2));
+		ASSERT_EQ (20.0 + i * height, r.y) << "middle of line " << i;
+		ASSERT_EQ (height, r.height) << "middle of line " << i;
+
+		r = test.layout->GetCursor (offset, pointer (&test, test.start [i] + test.length [i]));
+		ASSERT_EQ (20.0 + i * height, r.y) << "end of line " << i;
+		ASSERT_EQ (10.0 + test.length [i] * 8.0, r.x) << "end of line " << i;
+	}
+
+	/* the end of the run is the end of the last line */
+	r = test.layout->GetCursor (offset, TextPointer (test.run, (guint32) -1, LogicalDirectionForward));
+	ASSERT_EQ (20.0 + (LINE_COUNT - 1) * height, r.y);
+	ASSERT_EQ (10.0 + test.length [LINE_COUNT - 1] * 8.0, r.x);
+
+	destroy_layout (&test);
+}
+
+#define BLOCK_COUNT 3
+
+/*
+ * A document of BLOCK_COUNT paragraphs with a run each, laid out by
+ * RichTextLayout::Layout into a view of its own (the RichTextBox has no
+ * template, so nothing else lays it out).
+ */
+struct TestBlocks {
+	RichTextBox *rtb;
+	RichTextBoxView *view;
+	RichTextLayout *layout;
+	Paragraph *paragraph [BLOCK_COUNT];
+	Run *run [BLOCK_COUNT];
+};
+
+static void
+create_blocks (TestBlocks *test, const char **texts)
+{
+	unit_init_runtime ();
+
+	test->rtb = MoonUnmanagedFactory::CreateRichTextBox ();
+
+	for (int i = 0; i < BLOCK_COUNT; i++) {
+		test->run [i] = MoonUnmanagedFactory::CreateRun ();
+		test->run [i]->SetText (texts [i]);
+		test->paragraph [i] = MoonUnmanagedFactory::CreateParagraph ();
+		test->paragraph [i]->GetInlines ()->Add (test->run [i]);
+		test->rtb->GetBlocks ()->Add (test->paragraph [i]);
+		test->paragraph [i]->unref ();
+		test->run [i]->unref ();
+	}
+
+	test->view = MoonUnmanagedFactory::CreateRichTextBoxView ();
+	test->layout = new RichTextLayout ();
+	test->layout->SetBlocks (test->rtb->GetBlocks ());
+	test->layout->Layout (test->view);
+}
+
+static void
+destroy_blocks (TestBlocks *test)
+{
+	delete test->layout;
+	test->view->unref ();
+	test->rtb->unref ();
+}
+
+/* What the view does when the document changes */
+static void
+relayout_blocks (TestBlocks *test)
+{
+	test->layout->ContentChanged ();
+	test->layout->Layout (test->view);
+}
+
+static RichTextLayoutBlock *
+get_block (TestBlocks *test, int index)
+{
+	return &g_array_index (test->layout->block_lines, RichTextLayoutBlock, index);
+}
+
+/*
+ * Editing a paragraph only lays out that paragraph again: the lines of the
+ * paragraphs before it are left alone, the ones after it are moved.
+ */
+TEST(RichTextLayout, EditBlock)
+{
+	const char *texts [] = { "first", "second\nsecond", "third" };
+	RichTextLayoutLine *first, *third;
+	guint32 version;
+	TestBlocks test;
+	double height;
+
+	create_blocks (&test, texts);
+	ASSERT_EQ (4, test.layout->GetLineCount ());
+	ASSERT_EQ (BLOCK_COUNT, (int) test.layout->block_lines->len);
+	ASSERT_EQ (2u, get_block (&test, 1)->count);
+
+	height = test.layout->GetLineFromIndex (0)->size.height;
+	first = test.layout->GetLineFromIndex (0);
+	third = test.layout->GetLineFromIndex (3);
+	ASSERT_DOUBLE_EQ (3 * height, third->y);
+
+	/* the edit bumps the content version of the paragraph it's in, and only that one */
+	version = test.paragraph [0]->GetContentVersion ();
+	test.run [1]->SetText ("second\nsecond\nsecond");
+	ASSERT_NE (get_block (&test, 1)->version, test.paragraph [1]->GetContentVersion ());
+	ASSERT_EQ (version, test.paragraph [0]->GetContentVersion ());
+	relayout_blocks (&test);
+
+	ASSERT_EQ (5, test.layout->GetLineCount ());
+	ASSERT_EQ (3u, get_block (&test, 1)->count);
+	ASSERT_EQ (test.paragraph [1]->GetContentVersion (), get_block (&test, 1)->version);
+
+	/* the same lines, the last one a line lower */
+	ASSERT_TRUE (first == test.layout->GetLineFromIndex (0));
+	ASSERT_EQ (0.0, first->y);
+	ASSERT_TRUE (third == test.layout->GetLineFromIndex (4));
+	ASSERT_DOUBLE_EQ (4 * height, third->y);
+	ASSERT_EQ (4u, get_block (&test, 2)->first);
+	ASSERT_DOUBLE_EQ (5 * height, test.layout->actual_height);
+
+	/* and one line higher when the edit is undone */
+	test.run [1]->SetText ("second");
+	relayout_blocks (&test);
+
+	ASSERT_EQ (3, test.layout->GetLineCount ());
+	ASSERT_TRUE (first == test.layout->GetLineFromIndex (0));
+	ASSERT_TRUE (third == test.layout->GetLineFromIndex (2));
+	ASSERT_DOUBLE_EQ (2 * height, third->y);
+
+	destroy_blocks (&test);
+}
+
+/* The lines of a block are only good for the width they were laid out at */
+TEST(RichTextLayout, WidthChange)
+{
+	const char *texts [] = { "one two three", "four five six", "seven eight nine" };
+	TestBlocks test;
+
+	create_blocks (&test, texts);
+	test.layout->SetTextWrapping (TextWrappingWrap);
+	test.layout->ResetState ();
+	test.layout->Layout (test.view);
+	ASSERT_EQ (BLOCK_COUNT, test.layout->GetLineCount ());
+
+	/* narrower than any character, even the blocks nobody edited wrap */
+	ASSERT_TRUE (test.layout->SetMaxWidth (1.0));
+	relayout_blocks (&test);
+
+	ASSERT_GT (test.layout->GetLineCount (), BLOCK_COUNT);
+	for (int i = 0; i < BLOCK_COUNT; i++) {
+		ASSERT_GT (get_block (&test, i)->count, 1u) << "block " << i;
+		ASSERT_EQ (1.0, get_block (&test, i)->max_width) << "block " << i;
+		ASSERT_TRUE (get_block (&test, i)->wrapped) << "block " << i;
+	}
+
+	/* and back on a line each without a limit */
+	ASSERT_TRUE (test.layout->SetMaxWidth (0.0));
+	relayout_blocks (&test);
+
+	ASSERT_EQ (BLOCK_COUNT, test.layout->GetLineCount ());
+	for (int i = 0; i < BLOCK_COUNT; i++) {
+		ASSERT_EQ (1u, get_block (&test, i)->count) << "block " << i;
+		ASSERT_FALSE (get_block (&test, i)->wrapped) << "block " << i;
+	}
+
+	destroy_blocks (&test);
+}
+
+/*
+ * The UIElement of an InlineUIContainer is a child of the view for as long
+ * as the lines of its block are: it stays when another block is edited, is
+ * added back when its own block is, and goes away with its block.
+ */
+TEST(RichTextLayout, RemoveBlock)
+{
+	const char *texts [] = { "first", "second", "third" };
+	InlineUIContainer *container;
+	RichTextLayoutLine *third;
+	UIElementCollection *children;
+	TestBlocks test;
+	Border *border;
+
+	create_blocks (&test, texts);
+	children = test.view->GetChildren ();
+
+	border = MoonUnmanagedFactory::CreateBorder ();
+	border->SetWidth (20.0);
+	border->SetHeight (20.0);
+	container = MoonUnmanagedFactory::CreateInlineUIContainer ();
+	container->SetChild (border);
+	test.paragraph [1]->GetInlines ()->Add (container);
+	container->unref ();
+
+	relayout_blocks (&test);
+	ASSERT_EQ (1, children->GetCount ());
+	ASSERT_TRUE (border->GetVisualParent () == test.view);
+
+	/* another block is edited */
+	test.run [0]->SetText ("first, edited");
+	relayout_blocks (&test);
+	ASSERT_EQ (1, children->GetCount ());
+	ASSERT_TRUE (border->GetVisualParent () == test.view);
+
+	/* its own block is edited */
+	test.run [1]->SetText ("second, edited");
+	relayout_blocks (&test);
+	ASSERT_EQ (1, children->GetCount ());
+	ASSERT_TRUE (border->GetVisualParent () == test.view);
+
+	/* its block is removed, the block after it moves up */
+	third = test.layout->GetLineFromIndex (2);
+	test.rtb->GetBlocks ()->RemoveAt (1);
+	relayout_blocks (&test);
+
+	ASSERT_EQ (0, children->GetCount ());
+	ASSERT_TRUE (border->GetVisualParent () == NULL);
+	ASSERT_EQ (2, test.layout->GetLineCount ());
+	ASSERT_EQ (2, (int) test.layout->block_lines->len);
+	ASSERT_TRUE (third == test.layout->GetLineFromIndex (1));
+	ASSERT_EQ (test.layout->GetLineFromIndex (0)->size.height, third->y);
+
+	border->unref ();
+	destroy_blocks (&test);
+}
@@ -0,0 +1,167 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "textlayout.h"
+#include "textelement.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+#define TEXT "the quick brown fox jumps over the lazy dog, again and again"
+
+/* A wrapping TextLayout of TEXT in the font of a Run, laid out without a max width */
+static TextLayout *
+create_layout (Run **run)
+{
+	TextLayout *layout;
+	List *attrs;
+
+	unit_init_runtime ();
+
+	*run = MoonUnmanagedFactory::CreateRun ();
+	attrs = new List ();
+	attrs->Append (new TextLayoutAttributes ((ITextAttributes *) *run, 0));
+
+	layout = new TextLayout ();
+	layout->SetTextWrapping (TextWrappingWrap);
+	layout->SetText (TEXT);
+	layout->SetTextAttributes (attrs);
+	layout->Layout ();
+
+	return layout;
+}
+
+/* What measure and arrange do */
+static void
+layout_at (TextLayout *layout, double width)
+{
+	layout->SetMaxWidth (width);
+	layout->Layout ();
+}
+
+/*
+ * The text is shaped once whatever the width, and going back to one of the
+ * last few widths takes the lines laid out for it back.
+ */
+TEST(TextLayoutCache, Hit)
+{
+	TextLayoutLine *wide, *narrow;
+	TextLayout *layout;
+	Run *run;
+
+	layout = create_layout (&run);
+	ASSERT_EQ (1u, layout->GetStats ()->shaped);
+	ASSERT_EQ (1u, layout->GetStats ()->laid_out);
+	ASSERT_EQ (1, layout->GetLineCount ());
+	wide = layout->GetLineFromIndex (0);
+
+	layout_at (layout, 100.0);
+	ASSERT_GT (layout->GetLineCount (), 1);
+	ASSERT_EQ (1u, layout->GetStats ()->shaped);
+	ASSERT_EQ (2u, layout->GetStats ()->laid_out);
+	narrow = layout->GetLineFromIndex (0);
+
+	layout_at (layout, 0.0);
+	ASSERT_EQ (1u, layout->GetStats ()->restored);
+	ASSERT_EQ (2u, layout->GetStats ()->laid_out);
+	ASSERT_EQ (1, layout->GetLineCount ());
+	ASSERT_TRUE (wide == layout->GetLineFromIndex (0));
+
+	layout_at (layout, 100.0);
+	ASSERT_EQ (2u, layout->GetStats ()->restored);
+	ASSERT_EQ (2u, layout->GetStats ()->laid_out);
+	ASSERT_TRUE (narrow == layout->GetLineFromIndex (0));
+
+	ASSERT_EQ (1u, layout->GetStats ()->shaped);
+
+	delete layout;
+	run->unref ();
+}
+
+/* Only the last TEXT_LAYOUT_MAX_RESULTS widths are kept, the least recently used goes first */
+TEST(TextLayoutCache, Miss)
+{
+	TextLayout *layout;
+	guint32 laid_out;
+	Run *run;
+
+	layout = create_layout (&run);
+
+	/* 60 to 100, the wide layout goes out when the fifth result is saved */
+	for (int i = 0; i < TEXT_LAYOUT_MAX_RESULTS + 1; i++)
+		layout_at (layout, 60.0 + i * 10.0);
+	laid_out = layout->GetStats ()->laid_out;
+	ASSERT_EQ (TEXT_LAYOUT_MAX_RESULTS + 2, (int) laid_out);
+
+	layout_at (layout, 0.0);
+	ASSERT_EQ (++laid_out, layout->GetStats ()->laid_out);
+	ASSERT_EQ (0u, layout->GetStats ()->restored);
+
+	/* saving 100 and the wide layout pushed 60 and 70 out, 80 is still there */
+	layout_at (layout, 80.0);
+	ASSERT_EQ (laid_out, layout->GetStats ()->laid_out);
+	ASSERT_EQ (1u, layout->GetStats ()->restored);
+	layout_at (layout, 60.0);
+	ASSERT_EQ (++laid_out, layout->GetStats ()->laid_out);
+	layout_at (layout, 70.0);
+	ASSERT_EQ (++laid_out, layout->GetStats ()->laid_out);
+	ASSERT_EQ (1u, layout->GetStats ()->restored);
+
+	ASSERT_EQ (1u, layout->GetStats ()->shaped);
+
+	delete layout;
+	run->unref ();
+}
+
+/*
+ * New text, a font with other metrics or another layout property throw the
+ * saved results away. Only the first two need the text shaped again.
+ */
+TEST(TextLayoutCache, Invalidation)
+{
+	TextLayout *layout;
+	Run *run;
+
+	layout = create_layout (&run);
+
+	/* the text changes */
+	layout_at (layout, 100.0);
+	layout->SetText (TEXT " and again");
+	layout_at (layout, 0.0);
+	ASSERT_EQ (2u, layout->GetStats ()->shaped);
+	ASSERT_EQ (3u, layout->GetStats ()->laid_out);
+	layout_at (layout, 100.0);
+	ASSERT_EQ (4u, layout->GetStats ()->laid_out);
+	ASSERT_EQ (0u, layout->GetStats ()->restored);
+
+	/* the font of the run is resized behind the layout's back, its serial tells */
+	run->SetFontSize (run->GetFontSize () * 2);
+	layout_at (layout, 0.0);
+	ASSERT_EQ (3u, layout->GetStats ()->shaped);
+	ASSERT_EQ (5u, layout->GetStats ()->laid_out);
+	ASSERT_EQ (0u, layout->GetStats ()->restored);
+
+	/* the alignment changes, the shaping is still good */
+	layout_at (layout, 100.0);
+	ASSERT_EQ (6u, layout->GetStats ()->laid_out);
+	layout->SetTextAlignment (TextAlignmentCenter);
+	layout_at (layout, 0.0);
+	ASSERT_EQ (7u, layout->GetStats ()->laid_out);
+	ASSERT_EQ (0u, layout->GetStats ()->restored);
+	ASSERT_EQ (3u, layout->GetStats ()->shaped);
+
+	delete layout;
+	run->unref ();
+}
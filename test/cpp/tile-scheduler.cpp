@@ -0,0 +1,202 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "multiscaleimage.h"
+#include "tilesource.h"
+#include "uri.h"
+#include "factory.h"
+
+using namespace Moonlight;
+
+/* as in multiscaleimage.cpp */
+#define MAX_DOWNLOADERS 6
+
+/* The tiles the scheduler asked the tile source for, in the order it asked */
+struct TileLog {
+	int count;
+	int level [64];
+	int x [64];
+	int y [64];
+};
+
+static TileLog tile_log;
+
+static bool
+log_tile (MultiScaleTileSource *msts, int level, int x, int y, Uri **uri)
+{
+	char *str = g_strdup_printf ("http://tiles.example.com/%d/%d_%d.png", level, x, y);
+
+	if (tile_log.count < (int) G_N_ELEMENTS (tile_log.level)) {
+		tile_log.level [tile_log.count] = level;
+		tile_log.x [tile_log.count] = x;
+		tile_log.y [tile_log.count] = y;
+		tile_log.count++;
+	}
+
+	*uri = Uri::Create (str);
+	g_free (str);
+
+	return true;
+}
+
+/*
+ * A 1024x1024 image in 256x256 tiles (layers 0 to 8 are a single tile, 9 is
+ * 2x2 and 10 is 4x4) in a 256x256 MultiScaleImage. Without a surface the
+ * tiles are never downloaded, so they stay in flight until they're aborted.
+ */
+static MultiScaleImage *
+create_msi ()
+{
+	MultiScaleImage *msi;
+	MultiScaleTileSource *source;
+
+	unit_init_runtime ();
+
+	memset (&tile_log, 0, sizeof (TileLog));
+
+	source = MoonUnmanagedFactory::CreateMultiScaleTileSource ();
+	source->SetImageWidth (1024);
+	source->SetImageHeight (1024);
+	source->SetTileWidth (256);
+	source->SetTileHeight (256);
+	source->set_image_uri_func (log_tile);
+
+	msi = MoonUnmanagedFactory::CreateMultiScaleImage ();
+	msi->SetWidth (256);
+	msi->SetHeight (256);
+	msi->SetSource (source);
+	source->unref ();
+
+	return msi;
+}
+
+/* Visible tiles first, then the coarser layers, then from the center of the viewport out */
+TEST(TileScheduler, Order)
+{
+	MultiScaleImage *msi = create_msi ();
+
+	msi->RequestSingleTiles (10, 10, 0.0, 0.0, 1.0, false);
+	msi->RequestSingleTiles (0, 1, 0.0, 0.0, 1.0, true);
+	msi->RequestSingleTiles (9, 9, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+
+	ASSERT_EQ (MAX_DOWNLOADERS, tile_log.count);
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetDownloadCount ());
+
+	for (int i = 0; i < 4; i++)
+		ASSERT_EQ (9, tile_log.level [i]) << "tile " << i;
+
+	/* the four tiles in the middle of layer 10 are the closest to the center */
+	for (int i = 4; i < MAX_DOWNLOADERS; i++) {
+		ASSERT_EQ (10, tile_log.level [i]) << "tile " << i;
+		ASSERT_TRUE (tile_log.x [i] == 1 || tile_log.x [i] == 2) << "tile " << i;
+		ASSERT_TRUE (tile_log.y [i] == 1 || tile_log.y [i] == 2) << "tile " << i;
+	}
+
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetTileStats ()->tiles_requested);
+	ASSERT_EQ (0, msi->GetTileStats ()->tiles_prefetched);
+
+	/* prefetched tiles get the slots nobody else wants */
+	msi->StopDownloading ();
+	memset (&tile_log, 0, sizeof (TileLog));
+
+	msi->RequestSingleTiles (0, 1, 0.0, 0.0, 1.0, true);
+	msi->RequestSingleTiles (9, 9, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+
+	ASSERT_EQ (MAX_DOWNLOADERS, tile_log.count);
+	ASSERT_EQ (0, tile_log.level [4]);
+	ASSERT_EQ (1, tile_log.level [5]);
+	ASSERT_EQ (2, msi->GetTileStats ()->tiles_prefetched);
+
+	msi->unref ();
+}
+
+/* Tiles which are in flight aren't downloaded twice, or cancelled while they're still wanted */
+TEST(TileScheduler, InFlight)
+{
+	MultiScaleImage *msi = create_msi ();
+
+	msi->RequestSingleTiles (9, 10, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+	ASSERT_EQ (MAX_DOWNLOADERS, tile_log.count);
+
+	/* the next render wants the same tiles, and more than there are slots for */
+	msi->RequestSingleTiles (9, 10, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+
+	ASSERT_EQ (MAX_DOWNLOADERS, tile_log.count);
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetDownloadCount ());
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetTileStats ()->tiles_requested);
+	ASSERT_EQ (0, msi->GetTileStats ()->tiles_cancelled);
+
+	msi->unref ();
+}
+
+/* Tiles shown at less than a quarter of their size are decoded at a lower resolution */
+TEST(TileScheduler, DecodeSize)
+{
+	MultiScaleImage *msi = create_msi ();
+
+	/* layer 10 shown at a quarter of its size is decoded whole */
+	msi->RequestSingleTiles (10, 10, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetTileStats ()->tiles_requested);
+	ASSERT_EQ (0, msi->GetTileStats ()->tiles_downscaled);
+
+	/* at an eighth it's decoded at a quarter, with room for zooming in until layer 11 */
+	msi->StopDownloading ();
+	msi->RequestSingleTiles (10, 10, 0.0, 0.0, 2.0, false);
+	msi->ScheduleTiles ();
+	ASSERT_EQ (2 * MAX_DOWNLOADERS, msi->GetTileStats ()->tiles_requested);
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetTileStats ()->tiles_downscaled);
+
+	msi->unref ();
+}
+
+/* Tiles which went out of view are only cancelled for as many slots as the ones in view need */
+TEST(TileScheduler, Cancel)
+{
+	MultiScaleImage *msi = create_msi ();
+
+	msi->RequestSingleTiles (9, 10, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetDownloadCount ());
+
+	/* a pan to the bottom right corner of layer 10 */
+	msi->RequestSingleTiles (10, 10, 0.75, 0.75, 0.25, false);
+	msi->ScheduleTiles ();
+
+	ASSERT_EQ (1, msi->GetTileStats ()->tiles_cancelled);
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetDownloadCount ());
+	ASSERT_EQ (MAX_DOWNLOADERS + 1, tile_log.count);
+	ASSERT_EQ (10, tile_log.level [MAX_DOWNLOADERS]);
+	ASSERT_EQ (3, tile_log.x [MAX_DOWNLOADERS]);
+	ASSERT_EQ (3, tile_log.y [MAX_DOWNLOADERS]);
+
+	/* nothing in view needs a slot, the other downloads carry on */
+	msi->ScheduleTiles ();
+	ASSERT_EQ (1, msi->GetTileStats ()->tiles_cancelled);
+	ASSERT_EQ (MAX_DOWNLOADERS, msi->GetDownloadCount ());
+
+	/* the cancelled tile is downloaded again once it's back in view */
+	msi->RequestSingleTiles (9, 9, 0.0, 0.0, 1.0, false);
+	msi->ScheduleTiles ();
+	ASSERT_EQ (2, msi->GetTileStats ()->tiles_cancelled);
+	ASSERT_EQ (MAX_DOWNLOADERS + 2, tile_log.count);
+	ASSERT_EQ (9, tile_log.level [MAX_DOWNLOADERS + 1]);
+
+	msi->unref ();
+}
@@ -0,0 +1,132 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <glib/gstdio.h>
+
+#include "trace.h"
+#include "pal.h"
+
+using namespace Moonlight;
+
+#define TRACE_EVENTS 100000
+
+static void
+trace_events (int count)
+{
+	for (int i = 0; i < count; i++) {
+		MOON_TRACE_SCOPE ("test", "TraceTest::Outer");
+		MOON_TRACE_BEGIN ("test", MoonTrace::Intern ("TraceTest::Inner"));
+		MOON_TRACE_END ("test", "TraceTest::Inner");
+	}
+}
+
+static int
+count_occurrences (const char *haystack, const char *needle)
+{
+	int count = 0;
+	for (const char *p = strstr (haystack, needle); p != NULL; p = strstr (p + 1, needle))
+		count++;
+	return count;
+}
+
+TEST(Trace, ChromeFormat)
+{
+	char *filename = g_build_filename (g_get_tmp_dir (), "MoonlightTrace.json", NULL);
+	char *contents;
+
+	/* nothing is recorded while tracing is disabled */
+	ASSERT_FALSE (MoonTrace::IsEnabled ());
+	MOON_TRACE_BEGIN ("test", "TraceTest::Disabled");
+	MOON_TRACE_END ("test", "TraceTest::Disabled");
+
+	MoonTrace::Enable ();
+	trace_events (10);
+	ASSERT_TRUE (MoonTrace::Write (filename));
+	ASSERT_TRUE (MoonTrace::IsEnabled ());
+	MoonTrace::Disable ();
+
+	ASSERT_TRUE (g_file_get_contents (filename, &contents, NULL, NULL));
+	ASSERT_TRUE (g_str_has_prefix (contents, "{\"traceEvents\":["));
+	ASSERT_EQ (0, count_occurrences (contents, "TraceTest::Disabled"));
+	ASSERT_EQ (20, count_occurrences (contents, "\"TraceTest::Outer\""));
+	ASSERT_EQ (20, count_occurrences (contents, "\"TraceTest::Inner\""));
+	ASSERT_EQ (20, count_occurrences (contents, "\"ph\":\"B\""));
+	ASSERT_EQ (20, count_occurrences (contents, "\"ph\":\"E\""));
+
+	g_free (contents);
+	g_unlink (filename);
+	g_free (filename);
+}
+
+/* Only the last MOON_TRACE_BUFFER_EVENTS events of a thread are kept */
+TEST(Trace, Wrap)
+{
+	char *filename = g_build_filename (g_get_tmp_dir (), "MoonlightTraceWrap.json", NULL);
+	char *contents;
+
+	MoonTrace::Enable ();
+	trace_events (TRACE_EVENTS);
+	MoonTrace::Disable ();
+
+	ASSERT_TRUE (MoonTrace::Write (filename));
+	ASSERT_TRUE (g_file_get_contents (filename, &contents, NULL, NULL));
+	ASSERT_EQ (MOON_TRACE_BUFFER_EVENTS, count_occurrences (contents, "\"ph\":"));
+	ASSERT_EQ (MOON_TRACE_BUFFER_EVENTS / 2, count_occurrences (contents, "\"ph\":\"B\""));
+
+	g_free (contents);
+	g_unlink (filename);
+	g_free (filename);
+}
+
+static volatile gint recording;
+
+static gpointer
+record_pairs (gpointer data)
+{
+	while (g_atomic_int_get (&recording)) {
+		MoonTrace::Begin ("a", "A");
+		MoonTrace::Begin ("b", "B");
+	}
+	return NULL;
+}
+
+/* Writing the trace while another thread wraps around its buffer doesn't write half overwritten events */
+TEST(Trace, ConcurrentWrite)
+{
+	char *filename = g_build_filename (g_get_tmp_dir (), "MoonlightTraceConcurrent.json", NULL);
+	MoonThread *thread;
+	char *contents;
+
+	recording = 1;
+	ASSERT_EQ (0, MoonThread::StartJoinable (&thread, record_pairs));
+
+	for (int i = 0; i < 20; i++) {
+		int events;
+
+		ASSERT_TRUE (MoonTrace::Write (filename));
+		ASSERT_TRUE (g_file_get_contents (filename, &contents, NULL, NULL));
+		events = count_occurrences (contents, "\"tid\":");
+		ASSERT_EQ (events, count_occurrences (contents, "{\"cat\":\"a\",\"name\":\"A\"") +
+				   count_occurrences (contents, "{\"cat\":\"b\",\"name\":\"B\"") +
+				   count_occurrences (contents, "{\"cat\":\"test\",\"name\":\"TraceTest::"));
+		g_free (contents);
+	}
+
+	g_atomic_int_set (&recording, 0);
+	thread->Join ();
+
+	g_unlink (filename);
+	g_free (filename);
+}
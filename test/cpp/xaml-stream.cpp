@@ -0,0 +1,180 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include "xaml.h"
+#include "textblock.h"
+#include "deployment.h"
+
+using namespace Moonlight;
+
+/* é (2 bytes in UTF-8), € (3 bytes) and U+1F600 (4 bytes, a surrogate pair in UTF-16) */
+#define TEXT "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80"
+
+#define XAML \
+	"  <TextBlock xmlns=\"http://schemas.microsoft.com/client/2007\" Text=\"" TEXT "\" />\n"
+
+struct Encoding {
+	const char *name;
+	const char *bom;
+	gsize bom_length;
+};
+
+static Encoding encodings [] = {
+	{ "UTF-8", "", 0 },
+	{ "UTF-8", "\xef\xbb\xbf", 3 },
+	{ "UTF-16LE", "\xff\xfe", 2 },
+	{ "UTF-16BE", "\xfe\xff", 2 },
+	{ "UTF-32LE", "\xff\xfe\x00\x00", 4 },
+	{ "UTF-32BE", "\x00\x00\xfe\xff", 4 },
+};
+
+/* XAML in @encoding, with its byte order mark */
+static char *
+encode (Encoding *encoding, const char *xaml, gsize *length)
+{
+	gsize converted_length;
+	char *converted;
+	char *result;
+
+	converted = g_convert (xaml, -1, encoding->name, "UTF-8", NULL, &converted_length, NULL);
+	if (converted == NULL)
+		return NULL;
+
+	*length = encoding->bom_length + converted_length;
+	result = (char *) g_malloc (*length);
+	memcpy (result, encoding->bom, encoding->bom_length);
+	memcpy (result + encoding->bom_length, converted, converted_length);
+	g_free (converted);
+
+	return result;
+}
+
+/* Parses @data in chunks of @chunk_size bytes, returns the TextBlock (or NULL) */
+static TextBlock *
+parse (const char *data, gsize length, gsize chunk_size, ParserErrorEventArgs **error)
+{
+	SL3XamlLoader *loader = new SL3XamlLoader ((Surface *) NULL);
+	DependencyObject *result;
+	Type::Kind kind;
+
+	EXPECT_TRUE (loader->BeginParse ("stream.xaml", true));
+
+	for (gsize offset = 0; offset < length; offset += chunk_size) {
+		if (!loader->ParseChunk (data + offset, MIN (chunk_size, length - offset)))
+			break;
+	}
+
+	result = loader->EndParseDependencyObject (&kind);
+
+	if (error != NULL) {
+		*error = loader->error_args;
+		if (*error)
+			(*error)->ref ();
+	}
+
+	delete loader;
+
+	if (result != NULL && !result->Is (Type::TEXTBLOCK)) {
+		result->unref ();
+		result = NULL;
+	}
+
+	return (TextBlock *) result;
+}
+
+/*
+ * Every encoding TextStream::ReadBOM recognizes, in chunks of every size
+ * up to one bigger than a UTF-32 character, so that the mark and every
+ * multibyte sequence are split between chunks at every offset.
+ */
+TEST(XamlStream, Encodings)
+{
+	unit_init_runtime ();
+
+	for (guint i = 0; i < G_N_ELEMENTS (encodings); i++) {
+		gsize length;
+		char *data = encode (&encodings [i], XAML, &length);
+
+		ASSERT_TRUE (data != NULL) << encodings [i].name;
+
+		for (gsize chunk_size = 1; chunk_size <= 5; chunk_size++) {
+			TextBlock *text = parse (data, length, chunk_size, NULL);
+
+			ASSERT_TRUE (text != NULL) << encodings [i].name << " in chunks of " << chunk_size;
+			ASSERT_STREQ (TEXT, text->GetText ()) << encodings [i].name << " in chunks of " << chunk_size;
+			text->unref ();
+		}
+
+		/* all at once */
+		TextBlock *text = parse (data, length, length, NULL);
+		ASSERT_TRUE (text != NULL) << encodings [i].name;
+		ASSERT_STREQ (TEXT, text->GetText ()) << encodings [i].name;
+		text->unref ();
+
+		g_free (data);
+	}
+}
+
+/* A document ending in the middle of a character is an error, not a shorter text */
+TEST(XamlStream, Truncated)
+{
+	ParserErrorEventArgs *error;
+	gsize length;
+	char *data;
+
+	unit_init_runtime ();
+
+	/* the closing tag is cut off after the first byte of the second to last UTF-16 unit */
+	data = encode (&encodings [2], XAML, &length);
+	ASSERT_TRUE (parse (data, length - 3, 2, &error) == NULL);
+	ASSERT_TRUE (error != NULL);
+	error->unref ();
+	g_free (data);
+}
+
+/* Bytes which aren't valid in the encoding of the mark */
+TEST(XamlStream, InvalidSequence)
+{
+	ParserErrorEventArgs *error;
+	gsize length;
+	char *data;
+
+	unit_init_runtime ();
+
+	/* an unpaired low surrogate after the text, instead of the closing quote */
+	data = encode (&encodings [2], XAML, &length);
+	data [length - 10] = (char) 0x00;
+	data [length - 9] = (char) 0xdc;
+	ASSERT_TRUE (parse (data, length, 3, &error) == NULL);
+	ASSERT_TRUE (error != NULL);
+	error->unref ();
+	g_free (data);
+}
+
+/* Short documents, which end before the encoding is known */
+TEST(XamlStream, Short)
+{
+	ParserErrorEventArgs *error;
+
+	unit_init_runtime ();
+
+	ASSERT_TRUE (parse ("<a", 2, 1, &error) == NULL);
+	ASSERT_TRUE (error != NULL);
+	error->unref ();
+
+	ASSERT_TRUE (parse ("\xff\xfe", 2, 1, &error) == NULL);
+	ASSERT_TRUE (error != NULL);
+	error->unref ();
+}
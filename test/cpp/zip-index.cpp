@@ -0,0 +1,359 @@
+/*
+ * Native unit tests
+ *
+ * Contact:
+ *   Moonlight List (moonlight-list@lists.ximian.com)
+ *
+ * Copyright 2011 Novell, Inc. (http://www.novell.com)
+ *
+ * See the LICENSE file included with the distribution for details.
+ *
+ */
+
+#include "config.h"
+#include "main.h"
+
+#include <stdio.h>
+#include <zlib.h>
+#include <glib/gstdio.h>
+
+#include "zip-index.h"
+
+using namespace Moonlight;
+
+struct TestEntry {
+	const char *name;
+	const char *contents;
+	bool deflate;
+};
+
+static void
+put_uint16 (GByteArray *array, guint16 v)
+{
+	guint8 b [2] = { (guint8) v, (guint8) (v >> 8) };
+	g_byte_array_append (array, b, 2);
+}
+
+static void
+put_uint32 (GByteArray *array, guint32 v)
+{
+	guint8 b [4] = { (guint8) v, (guint8) (v >> 8), (guint8) (v >> 16), (guint8) (v >> 24) };
+	g_byte_array_append (array, b, 4);
+}
+
+/* writes a zip file with the given entries, deflating the ones which ask for it */
+static char *
+create_zip (TestEntry *entries, int n, bool corrupt_crc)
+{
+	GByteArray *zip = g_byte_array_new ();
+	GByteArray *cd = g_byte_array_new ();
+	guint32 cd_offset;
+	char *filename;
+
+	for (int i = 0; i < n; i++) {
+		guint32 size = strlen (entries [i].contents);
+		guint32 crc = crc32 (crc32 (0, Z_NULL, 0), (const Bytef *) entries [i].contents, size);
+		guint8 *data = (guint8 *) entries [i].contents;
+		guint32 compressed_size = size;
+		guint32 offset = zip->len;
+		guint8 deflated [1024];
+
+		if (entries [i].deflate) {
+			z_stream stream;
+
+			memset (&stream, 0, sizeof (stream));
+			deflateInit2 (&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+			stream.next_in = data;
+			stream.avail_in = size;
+			stream.next_out = deflated;
+			stream.avail_out = sizeof (deflated);
+			deflate (&stream, Z_FINISH);
+			compressed_size = stream.total_out;
+			deflateEnd (&stream);
+			data = deflated;
+		}
+
+		if (corrupt_crc)
+			crc ^= 1;
+
+		for (int header = 0; header < 2; header++) {
+			GByteArray *array = header == 0 ? zip : cd;
+
+			put_uint32 (array, header == 0 ? 0x04034b50 : 0x02014b50);
+			if (header == 1)
+				put_uint16 (array, 20); /* version made by */
+			put_uint16 (array, 20); /* version needed */
+			put_uint16 (array, 0); /* flags */
+			put_uint16 (array, entries [i].deflate ? 8 : 0);
+			put_uint32 (array, 0); /* time and date */
+			put_uint32 (array, crc);
+			put_uint32 (array, compressed_size);
+			put_uint32 (array, size);
+			put_uint16 (array, strlen (entries [i].name));
+			put_uint16 (array, 0); /* extra field */
+			if (header == 1) {
+				put_uint16 (array, 0); /* comment */
+				put_uint16 (array, 0); /* disk */
+				put_uint16 (array, 0); /* internal attributes */
+				put_uint32 (array, 0); /* external attributes */
+				put_uint32 (array, offset);
+			}
+			g_byte_array_append (array, (const guint8 *) entries [i].name, strlen (entries [i].name));
+		}
+
+		g_byte_array_append (zip, data, compressed_size);
+	}
+
+	cd_offset = zip->len;
+	g_byte_array_append (zip, cd->data, cd->len);
+
+	put_uint32 (zip, 0x06054b50);
+	put_uint16 (zip, 0); /* disk */
+	put_uint16 (zip, 0); /* disk with the central directory */
+	put_uint16 (zip, n);
+	put_uint16 (zip, n);
+	put_uint32 (zip, cd->len);
+	put_uint32 (zip, cd_offset);
+	put_uint16 (zip, 0); /* comment */
+
+	filename = unit_create_temp_file ("MoonlightZipIndex", zip->data, zip->len);
+
+	g_byte_array_free (zip, true);
+	g_byte_array_free (cd, true);
+
+	return filename;
+}
+
+static char *
+read_file (const char *path)
+{
+	char *contents;
+
+	if (!g_file_get_contents (path, &contents, NULL, NULL))
+		return NULL;
+
+	return contents;
+}
+
+static TestEntry test_entries [] = {
+	{ "AppManifest.xaml", "<Deployment xmlns=\"http://schemas.microsoft.com/client/2007/deployment\"/>", true },
+	{ "Images/", "", false },
+	{ "Images/Logo.png", "not really a png", false },
+	{ "empty.txt", "", true },
+	{ "App.dll", "MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ MZ", true },
+};
+
+TEST(ZipIndex, Find)
+{
+	char *filename = create_zip (test_entries, G_N_ELEMENTS (test_entries), false);
+	ZipIndex *index;
+	ZipEntry *entry;
+
+	ASSERT_TRUE (filename != NULL);
+
+	index = ZipIndex::Open (filename);
+	ASSERT_TRUE (index != NULL);
+	ASSERT_EQ (5u, index->GetCount ());
+
+	/* lookups are case-insensitive, like unzLocateFile */
+	entry = index->Find ("appmanifest.XAML");
+	ASSERT_TRUE (entry != NULL);
+	ASSERT_STREQ ("AppManifest.xaml", entry->name);
+	ASSERT_TRUE (index->Find ("images/")->is_directory);
+	ASSERT_FALSE (index->Find ("Images/Logo.png")->is_directory);
+	ASSERT_TRUE (index->Find ("Logo.png") == NULL);
+
+	/* stored entries are served straight from the file */
+	entry = index->Find ("images/logo.png");
+	ASSERT_TRUE (index->GetStoredData (entry) != NULL);
+	ASSERT_EQ (0, memcmp (index->GetStoredData (entry), "not really a png", entry->size));
+	ASSERT_TRUE (index->GetStoredData (index->Find ("App.dll")) == NULL);
+
+	delete index;
+	g_unlink (filename);
+	g_free (filename);
+}
+
+TEST(ZipIndex, Extract)
+{
+	char *filename = create_zip (test_entries, G_N_ELEMENTS (test_entries), false);
+	char *dir = g_build_filename (g_get_tmp_dir (), "MoonlightZipIndex.XXXXXX", NULL);
+	ZipExtraction files [4];
+	ZipIndex *index;
+	guint8 *buffer;
+	int n = 0;
+
+	ASSERT_TRUE (filename != NULL);
+	ASSERT_TRUE (g_mkdtemp (dir) != NULL);
+
+	index = ZipIndex::Open (filename);
+	ASSERT_TRUE (index != NULL);
+
+	for (guint i = 0; i < index->GetCount (); i++) {
+		ZipEntry *entry = index->GetEntry (i);
+
+		if (entry->is_directory)
+			continue;
+
+		buffer = index->ExtractToBuffer (entry);
+		ASSERT_TRUE (buffer != NULL);
+		ASSERT_STREQ (test_entries [i].contents, (const char *) buffer);
+		g_free (buffer);
+
+		files [n].entry = entry;
+		files [n].path = g_strdup_printf ("%s/%u", dir, i);
+		n++;
+	}
+
+	ASSERT_EQ (4, n);
+	ASSERT_TRUE (index->ExtractFiles (files, n, 2));
+
+	for (int i = 0; i < n; i++) {
+		char *contents = read_file (files [i].path);
+
+		ASSERT_TRUE (contents != NULL);
+		ASSERT_EQ (files [i].entry->size, strlen (contents));
+		g_free (contents);
+		g_unlink (files [i].path);
+		g_free ((char *) files [i].path);
+	}
+
+	delete index;
+	g_rmdir (dir);
+	g_unlink (filename);
+	g_free (filename);
+	g_free (dir);
+}
+
+TEST(ZipIndex, Corrupt)
+{
+	char *corrupt = create_zip (test_entries, G_N_ELEMENTS (test_entries), true);
+	char *not_a_zip = unit_create_temp_file ("MoonlightZipIndex", "this is not a zip file at all", 29);
+	ZipIndex *index;
+
+	ASSERT_TRUE (corrupt != NULL);
+	ASSERT_TRUE (not_a_zip != NULL);
+
+	/* entries whose crc doesn't match aren't extracted */
+	index = ZipIndex::Open (corrupt);
+	ASSERT_TRUE (index != NULL);
+	ASSERT_TRUE (index->ExtractToBuffer (index->Find ("App.dll")) == NULL);
+	ASSERT_TRUE (index->ExtractToBuffer (index->Find ("Images/Logo.png")) == NULL);
+	delete index;
+
+	ASSERT_TRUE (ZipIndex::Open (not_a_zip) == NULL);
+	ASSERT_TRUE (ZipIndex::Open ("/this/does/not/exist") == NULL);
+
+	g_unlink (corrupt);
+	g_unlink (not_a_zip);
+	g_free (corrupt);
+	g_free (not_a_zip);
+}
+
+/* Entries claiming to be larger than deflate could expand the archive to are rejected up front */
+TEST(ZipIndex, Sizes)
+{
+	char *filename = create_zip (test_entries, G_N_ELEMENTS (test_entries), false);
+	char *huge;
+	guint8 *contents;
+	gsize length;
+	guint8 *cd;
+
+	ASSERT_TRUE (filename != NULL);
+	ASSERT_TRUE (g_file_get_contents (filename, (char **) &contents, &length, NULL));
+
+	/* the size of the first entry in the central directory */
+	for (cd = contents; cd + 28 < contents + length && memcmp (cd, "PK\x01\x02", 4); cd++)
+		;
+	ASSERT_TRUE (cd + 28 < contents + length);
+	cd [24] = 0xf0;
+	cd [25] = 0xff;
+	cd [26] = 0xff;
+	cd [27] = 0x7f;
+
+	huge = unit_create_temp_file ("MoonlightZipIndex", contents, length);
+	ASSERT_TRUE (huge != NULL);
+	ASSERT_TRUE (ZipIndex::Open (huge) == NULL);
+
+	g_free (contents);
+	g_unlink (huge);
+	g_unlink (filename);
+	g_free (huge);
+	g_free (filename);
+}
+
+TEST(ZipIndex, SafeNames)
+{
+	ASSERT_TRUE (ZipIndex::IsSafeName ("AppManifest.xaml"));
+	ASSERT_TRUE (ZipIndex::IsSafeName ("Images/Logo.png"));
+	ASSERT_TRUE (ZipIndex::IsSafeName ("a..b/..c/d.."));
+
+	ASSERT_FALSE (ZipIndex::IsSafeName (""));
+	ASSERT_FALSE (ZipIndex::IsSafeName ("/etc/passwd"));
+	ASSERT_FALSE (ZipIndex::IsSafeName ("\\etc\\passwd"));
+	ASSERT_FALSE (ZipIndex::IsSafeName (".."));
+	ASSERT_FALSE (ZipIndex::IsSafeName ("../App.dll"));
+	ASSERT_FALSE (ZipIndex::IsSafeName ("Images/../../App.dll"));
+	ASSERT_FALSE (ZipIndex::IsSafeName ("Images\\..\\..\\App.dll"));
+	ASSERT_FALSE (ZipIndex::IsSafeName ("Images/.."));
+}
+
+/* Files which already exist are never written to, and failed extractions don't leave files behind */
+TEST(ZipIndex, ExistingFiles)
+{
+	char *filename = create_zip (test_entries, G_N_ELEMENTS (test_entries), false);
+	char *corrupt = create_zip (test_entries, G_N_ELEMENTS (test_entries), true);
+	char *dir = g_build_filename (g_get_tmp_dir (), "MoonlightZipIndex.XXXXXX", NULL);
+	ZipExtraction files [3];
+	ZipIndex *index;
+	char *existing, *fresh, *contents;
+	bool existed;
+
+	ASSERT_TRUE (filename != NULL && corrupt != NULL);
+	ASSERT_TRUE (g_mkdtemp (dir) != NULL);
+
+	existing = g_build_filename (dir, "existing", NULL);
+	fresh = g_build_filename (dir, "fresh", NULL);
+	ASSERT_TRUE (g_file_set_contents (existing, "old contents", -1, NULL));
+
+	index = ZipIndex::Open (filename);
+	ASSERT_TRUE (index != NULL);
+
+	ASSERT_FALSE (index->ExtractToFile (index->Find ("App.dll"), existing, &existed));
+	ASSERT_TRUE (existed);
+
+	/* the same path twice is only written once */
+	files [0].entry = index->Find ("App.dll");
+	files [0].path = existing;
+	files [1].entry = index->Find ("App.dll");
+	files [1].path = fresh;
+	files [2].entry = index->Find ("Images/Logo.png");
+	files [2].path = fresh;
+	ASSERT_TRUE (index->ExtractFiles (files, 3, 2));
+
+	contents = read_file (existing);
+	ASSERT_STREQ ("old contents", contents);
+	g_free (contents);
+	contents = read_file (fresh);
+	ASSERT_TRUE (!strcmp (contents, test_entries [4].contents) || !strcmp (contents, test_entries [2].contents));
+	g_free (contents);
+	g_unlink (fresh);
+	delete index;
+
+	index = ZipIndex::Open (corrupt);
+	ASSERT_TRUE (index != NULL);
+	ASSERT_FALSE (index->ExtractToFile (index->Find ("App.dll"), fresh, &existed));
+	ASSERT_FALSE (existed);
+	ASSERT_FALSE (g_file_test (fresh, G_FILE_TEST_EXISTS));
+	delete index;
+
+	g_unlink (existing);
+	g_rmdir (dir);
+	g_unlink (filename);
+	g_unlink (corrupt);
+	g_free (existing);
+	g_free (fresh);
+	g_free (filename);
+	g_free (corrupt);
+	g_free (dir);
+}